@@ -1,8 +1,11 @@
+#include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <algorithm>
 #include <endian.h>
 
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
@@ -90,61 +93,88 @@ void Asic::sendReadAddress(void)
 }
 
 // Function to set the hash frequency
-// gives the same PLL settings as the S21 dumps
-bool Asic::sendHashFrequency(float target_freq) {
-    float min_diff = 2.0;
-    uint8_t freqbuf[6] = {0x00, 0x08, 0x40, 0xA0, 0x02, 0x41};
-    int postdiv_min = 255;
-    int postdiv2_min = 255;
-    int refdiv, fb_divider, postdiv1, postdiv2;
-    float newf;
-    bool found = false;
-    int best_refdiv, best_fb_divider, best_postdiv1, best_postdiv2;
-    float best_newf;
-
-    for (refdiv = 2; refdiv > 0; refdiv--) {
-        for (postdiv1 = 7; postdiv1 > 0; postdiv1--) {
-            for (postdiv2 = 7; postdiv2 > 0; postdiv2--) {
-                fb_divider = (int)round(target_freq / 25.0 * (refdiv * postdiv2 * postdiv1));
-                newf = 25.0 * fb_divider / (refdiv * postdiv2 * postdiv1);
-                if (
-                    fb_divider >= 0xa0 && fb_divider <= 0xef &&
-                    fabs(target_freq - newf) <= min_diff &&
-                    postdiv1 >= postdiv2 &&
-                    postdiv1 * postdiv2 < postdiv_min &&
-                    postdiv2 <= postdiv2_min
-                ) {
-                    postdiv2_min = postdiv2;
-                    postdiv_min = postdiv1 * postdiv2;
-                    best_refdiv = refdiv;
-                    best_fb_divider = fb_divider;
-                    best_postdiv1 = postdiv1;
-                    best_postdiv2 = postdiv2;
-                    best_newf = newf;
-                    min_diff  = fabs(target_freq - newf);
-                    found = true;
-                }
-            }
-        }
+// the table gives the same PLL settings as the S21 dumps for the usual frequencies
+bool Asic::sendHashFrequency(float target_freq, pll_setting_t *setting) {
+    pll_setting_t pll;
+    if (!pll_lookup(target_freq, &pll)) {
+        ESP_LOGE(TAG, "Didn't find PLL settings for target frequency %.2f", target_freq);
+        return false;
+    }
+
+    uint32_t reg = pll_register(&pll);
+    send6(CMD_WRITE_ALL, 0x00, PLL0_PARAMETER, (reg >> 24) & 0xff, (reg >> 16) & 0xff, (reg >> 8) & 0xff, reg & 0xff);
+
+    float newf = pll_frequency(&pll);
+    ESP_LOGI(TAG, "Setting Frequency to %.2fMHz (%.2f) (error: %.2fMHZ)", target_freq, newf, fabs(target_freq - newf));
+    m_current_frequency = target_freq;
+    m_actual_current_frequency = newf;
+    if (setting) {
+        *setting = pll;
     }
+    return true;
+}
 
-    if (!found) {
-        ESP_LOGE(TAG, "Didn't find PLL settings for target frequency %.2f (error: %.2fMHZ)", target_freq, min_diff);
+// PLL0 is read again after this until all chips report the lock
+#define PLL_LOCK_POLL_MS 5
+
+// readback of PLL0 with the expected dividers and the lock bit
+static inline bool pllLocked(uint32_t value, uint32_t expected)
+{
+    return (value & PLL0_LOCKED) && (value & 0x00ffffff) == expected;
+}
+
+// true when all chips answered a read of PLL0 with the new setting and the
+// lock bit set, the read is repeated until they did or the timeout ran out
+bool Asic::waitPllSettled(const pll_setting_t *setting, uint32_t timeoutMs) {
+    if (!m_chipCount) {
+        vTaskDelay(pdMS_TO_TICKS(timeoutMs));
         return false;
     }
 
-    freqbuf[2] = (best_fb_divider * 25 / best_refdiv >= 2400) ? 0x50 : 0x40;
-    freqbuf[3] = best_fb_divider;
-    freqbuf[4] = best_refdiv;
-    freqbuf[5] = (((best_postdiv1 - 1) & 0xf) << 4) | ((best_postdiv2 - 1) & 0xf);
+    // the upper byte has status bits
+    uint32_t expected = pll_register(setting) & 0x00ffffff;
+    __atomic_store_n(&m_pllExpected, expected, __ATOMIC_RELAXED);
 
-    send(CMD_WRITE_ALL, freqbuf, sizeof(freqbuf));
-    //ESP_LOG_BUFFER_HEX(TAG, freqbuf, sizeof(freqbuf));
+    int64_t deadline = esp_timer_get_time() + (int64_t) timeoutMs * 1000;
 
-    ESP_LOGI(TAG, "Setting Frequency to %.2fMHz (%.2f) (error: %.2fMHZ)", target_freq, best_newf, min_diff);
-    m_current_frequency = target_freq;
-    m_actual_current_frequency = best_newf;
-    return true;
+    while (esp_timer_get_time() < deadline) {
+        __atomic_store_n(&m_pllReplies, 0, __ATOMIC_RELEASE);
+        send2(CMD_READ_ALL, 0x00, PLL0_PARAMETER);
+
+        int64_t retry = std::min(deadline, esp_timer_get_time() + (int64_t) PLL_LOCK_POLL_MS * 1000);
+
+        if (__atomic_load_n(&m_rxActive, __ATOMIC_ACQUIRE)) {
+            while (__atomic_load_n(&m_pllReplies, __ATOMIC_ACQUIRE) < (uint32_t) m_chipCount &&
+                   esp_timer_get_time() < retry) {
+                vTaskDelay(1);
+            }
+            if (__atomic_load_n(&m_pllReplies, __ATOMIC_ACQUIRE) >= (uint32_t) m_chipCount) {
+                return true;
+            }
+            continue;
+        }
+
+        // during init nothing else is on the line
+        int replies = 0;
+        while (replies < m_chipCount) {
+            int64_t remaining = (retry - esp_timer_get_time()) / 1000;
+            if (remaining <= 0) {
+                break;
+            }
+            asic_result_t frame;
+            if (SERIAL_rx((uint8_t *) &frame, sizeof(frame), (uint16_t) remaining) != sizeof(frame)) {
+                continue;
+            }
+            if (frame.preamble[0] == 0xAA && frame.preamble[1] == 0x55 && !(frame.crc & 0x80) &&
+                frame.job_id == PLL0_PARAMETER && pllLocked(__bswap32(frame.nonce), expected)) {
+                replies++;
+            }
+        }
+        if (replies >= m_chipCount) {
+            return true;
+        }
+    }
+    return false;
 }
 
 int Asic::setMaxBaud(void)
@@ -210,47 +240,37 @@ void Asic::readCounter(uint8_t reg) {
 
 
 // Function to perform frequency transition up or down
+// the steps grow while the chips confirm them quickly, without a confirmation
+// every step waits the settle timeout like the fixed 6.25MHz ramp did
 bool Asic::doFrequencyTransition(float target_frequency) {
-    float step = 6.25;
-    float current = m_current_frequency;
-    float target = target_frequency;
-
-    // Determine the direction of the transition
-    float direction = (target > current) ? step : -step;
-
-    // Align to the next 6.25-dividable value if not already on one
-    if (fmod(current, step) != 0) {
-        // If ramping up, round up to the next multiple; if ramping down, round down
-        float next_dividable;
-        if (direction > 0) {
-            next_dividable = ceil(current / step) * step;
-        } else {
-            next_dividable = floor(current / step) * step;
-        }
-        current = next_dividable;
-        if (!sendHashFrequency(current)) {
-            printf("ERROR: Failed to set frequency to %.2f MHz\n", current);
+    FrequencyRamp ramp;
+    ramp.start(m_current_frequency, target_frequency, m_rampProfile);
+
+    int64_t start = esp_timer_get_time();
+    int steps = 0;
+    int confirmed = 0;
+
+    float freq;
+    while (ramp.next(&freq)) {
+        pll_setting_t pll;
+        if (!sendHashFrequency(freq, &pll)) {
+            printf("ERROR: Failed to set frequency to %.2f MHz\n", freq);
             return false;
         }
-        vTaskDelay(pdMS_TO_TICKS(100));
-    }
 
-    // Ramp in the appropriate direction
-    while ((direction > 0 && current < target) || (direction < 0 && current > target)) {
-        float next_step = fmin(fabs(direction), fabs(target - current));
-        current += direction > 0 ? next_step : -next_step;
-        if (!sendHashFrequency(current)) {
-            printf("ERROR: Failed to set frequency to %.2f MHz\n", current);
-            return false;
+        int64_t sent = esp_timer_get_time();
+        bool settled = waitPllSettled(&pll, m_rampProfile.settleTimeoutMs);
+        uint32_t elapsed = (uint32_t) ((esp_timer_get_time() - sent) / 1000);
+        if (settled) {
+            vTaskDelay(pdMS_TO_TICKS(m_rampProfile.dwellMs));
+            confirmed++;
         }
-        vTaskDelay(pdMS_TO_TICKS(100));
+        ramp.settled(settled, elapsed);
+        steps++;
     }
 
-    // Set the exact target frequency to finalize
-    if (!sendHashFrequency(target)) {
-        printf("ERROR: Failed to set frequency to %.2f MHz\n", target);
-        return false;
-    }
+    ESP_LOGI(TAG, "Frequency transition to %.2fMHz: %d steps (%d confirmed) in %lldms", target_frequency, steps,
+             confirmed, (esp_timer_get_time() - start) / 1000);
     return true;
 }
 
@@ -271,6 +291,7 @@ int Asic::count_asics() {
             ESP_LOG_BUFFER_HEX(TAG, buf, sizeof(buf));
         }
     }
+    m_chipCount = chip_counter;
     return chip_counter;
 }
 
@@ -309,7 +330,7 @@ void Asic::setJobDifficultyMask(int difficulty)
     m_asicDifficulty = difficulty;
 }
 
-// can ramp up and down in 6.25MHz steps
+// ramps up and down, see doFrequencyTransition
 bool Asic::setAsicFrequency(float target_freq) {
     return doFrequencyTransition(target_freq);
 }
@@ -340,27 +361,67 @@ void Asic::sendRawJob(BM1368_job *job)
     send((TYPE_JOB | GROUP_SINGLE | CMD_WRITE), (uint8_t*) job, sizeof(BM1368_job));
 }
 
+void Asic::consumeRx(uint8_t len)
+{
+    m_rxLen -= len;
+    memmove(m_rxBuf, m_rxBuf + len, m_rxLen);
+}
+
+// Reads the next result frame from the serial stream
+//
+// Frames are 11 bytes starting with the AA 55 preamble and end with a crc5.
+// If a byte gets lost, the following bytes are scanned for the next valid
+// preamble + crc instead of flushing the uart, so only the broken frame is
+// dropped and the frames queued behind it are still processed.
 bool Asic::receiveWork(asic_result_t *result)
 {
-    // wait for a response, wait time is pretty arbitrary
-    int received = SERIAL_rx((uint8_t*) result, 11, 60000);
+    const uint8_t frame_len = sizeof(asic_result_t);
 
-    if (received < 0) {
-        ESP_LOGI(TAG, "Error in serial RX");
-        return false;
-    } else if (received == 0) {
-        // Didn't find a solution, restart and try again
-        return false;
-    }
+    while (true) {
+        // discard everything in front of the next preamble
+        uint8_t skip = 0;
+        while (skip < m_rxLen && !(m_rxBuf[skip] == 0xAA && (skip + 1 == m_rxLen || m_rxBuf[skip + 1] == 0x55))) {
+            skip++;
+        }
+        if (skip) {
+            ESP_LOGE(TAG, "Serial RX resync, dropping %d bytes", skip);
+            ESP_LOG_BUFFER_HEX(TAG, m_rxBuf, skip);
+            m_rxStats.resyncs++;
+            m_rxStats.droppedBytes += skip;
+            consumeRx(skip);
+        }
 
-    if (result->preamble[0] != 0xAA || result->preamble[1] != 0x55) {
-        ESP_LOGE(TAG, "Serial RX invalid %i", received);
-        ESP_LOG_BUFFER_HEX(TAG, (uint8_t*) result, received);
-        SERIAL_clear_buffer();
-        return false;
-    }
+        if (m_rxLen == frame_len) {
+            // the crc5 in the last byte covers everything after the preamble
+            if (crc5_check(m_rxBuf + 2, frame_len - 2)) {
+                memcpy(result, m_rxBuf, frame_len);
+                m_rxLen = 0;
+                m_rxStats.frames++;
+                return true;
+            }
 
-    return true;
+            // the preamble might have been payload, look for the next one
+            m_rxStats.crcErrors++;
+            ESP_LOGE(TAG, "Serial RX crc error (%lu total)", m_rxStats.crcErrors);
+            ESP_LOG_BUFFER_HEX(TAG, m_rxBuf, frame_len);
+            m_rxStats.droppedBytes++;
+            consumeRx(1);
+            continue;
+        }
+
+        // wait for the rest of the frame, wait time is pretty arbitrary
+        int received = SERIAL_rx(m_rxBuf + m_rxLen, frame_len - m_rxLen, 60000);
+
+        if (received < 0) {
+            ESP_LOGI(TAG, "Error in serial RX");
+            return false;
+        } else if (received == 0) {
+            // Didn't find a solution, restart and try again
+            return false;
+        }
+
+        m_rxLen += received;
+    }
 }
 
 
@@ -371,8 +432,17 @@ bool Asic::processWork(task_result *result)
         return false;
     }
 
+    // from now on the frequency ramp counts the PLL readback here
+    if (!m_rxActive) {
+        __atomic_store_n(&m_rxActive, true, __ATOMIC_RELEASE);
+    }
+
     if (!(asic_result.crc & 0x80)) {
         result->data = __bswap32(asic_result.nonce);
+        if (asic_result.job_id == PLL0_PARAMETER &&
+            pllLocked(result->data, __atomic_load_n(&m_pllExpected, __ATOMIC_RELAXED))) {
+            __atomic_add_fetch(&m_pllReplies, 1, __ATOMIC_RELEASE);
+        }
         result->reg = asic_result.job_id;
         result->is_reg_resp = 1;
         result->asic_nr = chipIndexFromAddr(asic_result.midstate_num);
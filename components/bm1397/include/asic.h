@@ -1,6 +1,7 @@
 #pragma once
 
 #include "mining.h"
+#include "pll.h"
 
 typedef struct __attribute__((__packed__))
 {
@@ -58,6 +59,8 @@ static inline int next_power_of_two(int num) {
 #define CLOCK_ORDER_CONTROL_1 0x84
 #define ORDERED_CLOCK_ENABLE 0x20
 #define CORE_REGISTER_CONTROL 0x3C
+#define PLL0_PARAMETER 0x08
+#define PLL0_LOCKED 0x80000000 // PLL0 readback, set by the chip once the PLL locked
 #define PLL3_PARAMETER 0x68
 #define FAST_UART_CONFIGURATION 0x28
 #define TICKET_MASK 0x14
@@ -93,18 +96,42 @@ typedef struct __attribute__((__packed__))
     uint8_t crc;
 } asic_result_t;
 
+typedef struct
+{
+    uint32_t frames;       // valid result frames
+    uint32_t crcErrors;    // frames with a valid preamble but a crc mismatch
+    uint32_t resyncs;      // times the stream had to be realigned on the preamble
+    uint32_t droppedBytes; // bytes discarded while searching the preamble
+} asic_rx_stats_t;
+
 class Asic {
 protected:
     float m_current_frequency;
     float m_actual_current_frequency;
     uint32_t m_asicDifficulty;
     uint8_t m_addressInterval = 2; ///< Chip address spacing (set during init)
+    int m_chipCount = 0;           ///< Chips that answered count_asics()
+
+    // PLL0 readback after a frequency step, counted by processWork once the
+    // result task reads the uart, read directly before that
+    bool m_rxActive = false;
+    uint32_t m_pllExpected = 0;
+    uint32_t m_pllReplies = 0;
+    asic_ramp_profile_t m_rampProfile = ASIC_RAMP_DEFAULT;
+
+    // result frame reassembly, bytes after a broken frame are kept for resync
+    uint8_t m_rxBuf[sizeof(asic_result_t)];
+    uint8_t m_rxLen = 0;
+    asic_rx_stats_t m_rxStats = {};
+
+    void consumeRx(uint8_t len);
 
     void send(uint8_t header, uint8_t *data, uint8_t data_len);
     void send2(uint8_t header, uint8_t b0, uint8_t b1);
     void send6(uint8_t header, uint8_t b0, uint8_t b1, uint8_t b2, uint8_t b3, uint8_t b4, uint8_t b5);
     int count_asics();
-    bool sendHashFrequency(float target_freq);
+    bool sendHashFrequency(float target_freq, pll_setting_t *setting = nullptr);
+    bool waitPllSettled(const pll_setting_t *setting, uint32_t timeoutMs);
     void setVrFreqReg(uint32_t value);
     bool doFrequencyTransition(float target_frequency);
     void setChipAddress(uint8_t chipAddr);
@@ -137,6 +164,14 @@ public:
     virtual void readCounter(uint8_t reg);
     virtual uint16_t getSmallCoreCount() = 0;
 
+    uint32_t getRxCrcErrors() {
+        return m_rxStats.crcErrors;
+    }
+
+    const asic_rx_stats_t* getRxStats() {
+        return &m_rxStats;
+    }
+
     void setVrFrequency(uint32_t freq);
     virtual uint32_t getDefaultVrFrequency() = 0;
 
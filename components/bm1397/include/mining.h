@@ -2,6 +2,10 @@
 
 #include "stratum/stratum_api.h"
 
+// inline string capacities incl. zero termination
+#define BM_JOB_ID_MAX_LEN 64
+#define BM_JOB_EXTRANONCE2_MAX_LEN 65 // 32 bytes hex
+
 typedef struct
 {
     uint32_t version;
@@ -24,20 +28,34 @@ typedef struct
     // pool ID
     int pool_id;
 
-    char *jobid;
-    char *extranonce2;
+    char jobid[BM_JOB_ID_MAX_LEN];
+    char extranonce2[BM_JOB_EXTRANONCE2_MAX_LEN];
 } bm_job;
 
-void free_bm_job(bm_job *job);
-
 char *construct_coinbase_tx(const char *coinbase_1, const char *coinbase_2, const char *extranonce, const char *extranonce_2);
 
 void calculate_merkle_root_hash(const char *coinbase_tx, const uint8_t merkle_branches[][32], const int num_merkle_branches,
                                 char merkle_root_hash[65]);
 
+void calculate_merkle_root_bin(const uint8_t coinbase_tx_hash[32], const uint8_t merkle_branches[][32], const int num_merkle_branches,
+                               uint8_t merkle_root[32]);
+
 void construct_bm_job(mining_notify *params, const char *merkle_root, const uint32_t version_mask, bm_job *new_job);
 
-double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version);
+void construct_bm_job_bin(const mining_notify *params, const uint8_t merkle_root[32], const uint32_t version_mask, bm_job *new_job);
+
+// true if a hash with these top 64 bits (bytes 24..31, little endian) can't reach diff:
+// the hash is at least top64 * 2^192 and truediffone is 0xFFFF0000 * 2^192
+static inline bool hash_below_diff(uint64_t top64, uint32_t diff)
+{
+    return diff && top64 > 0xFFFF0000ull / diff;
+}
+
+// returns the nonce difficulty - 0 means invalid or below min_diff (early exit)
+// hw_error (optional) is set if the difficulty is below hw_min_diff, for an early exit
+// from the same compare of the top 64 hash bits
+double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version, const uint32_t min_diff = 0,
+                        const uint32_t hw_min_diff = 0, bool *hw_error = nullptr);
 
 char *extranonce_2_generate(uint32_t extranonce_2, uint32_t length);
 
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+
+// PLL0 of the BM136x/BM137x chips: 25 MHz reference, feedback divider
+// 0xa0..0xef, refdiv 1..2 and two post dividers 1..7 with postdiv1 >= postdiv2.
+// All supported chip families use the same PLL, so there is one table.
+#define PLL_REF_MHZ 25
+#define PLL_FB_DIV_MIN 0xa0
+#define PLL_FB_DIV_MAX 0xef
+
+// settings for every multiple of 0.25 MHz in this range, other frequencies are searched
+#define PLL_TABLE_MIN_MHZ 50
+#define PLL_TABLE_MAX_MHZ 1200
+#define PLL_TABLE_STEPS_PER_MHZ 4
+
+typedef struct
+{
+    uint8_t fbDiv;
+    uint8_t refDiv;
+    uint8_t postDiv; // register layout, (postdiv1 - 1) << 4 | (postdiv2 - 1)
+} pll_setting_t;
+
+// frequency the setting results in
+float pll_frequency(const pll_setting_t *setting);
+
+// the search the frequency was always set with, the first post divider pair with
+// the lowest product that is within 2 MHz and not worse than the previous one
+bool pll_search(float target_freq, pll_setting_t *setting);
+
+// table entry when there is one, the closest frequency with the lowest post
+// dividers, otherwise pll_search()
+//
+// Against pll_search() on the 0.25 MHz grid 2827 entries are the same, 1705
+// closer and 21 as close with lower post dividers. Of the board options only
+// 777 MHz changes: fb 218, refdiv 1, postdiv 7/1 = 778.57 MHz instead of
+// fb 186, refdiv 2, postdiv 3/1 = 775.00 MHz. 48 frequencies above 1 GHz have
+// no setting within 2 MHz, test/host/tests/pll_test.cpp checks all of this.
+bool pll_lookup(float target_freq, pll_setting_t *setting);
+
+// 4 byte register value for PLL0 (0x08)
+uint32_t pll_register(const pll_setting_t *setting);
+
+typedef struct
+{
+    float minStep;             // MHz, the grid all intermediate steps are on
+    float maxStepUp;           // MHz
+    float maxStepDown;         // MHz
+    uint32_t settleTimeoutMs;  // wait for the chips, also the fixed delay without readback
+    uint32_t fastSettleMs;     // a step that settled within this doubles the next one
+    uint32_t dwellMs;          // held after the chips reported the lock, before the next step
+} asic_ramp_profile_t;
+
+extern const asic_ramp_profile_t ASIC_RAMP_DEFAULT;
+
+// Frequency steps from the current to the target frequency. Steps start at
+// minStep, double after a step the chips confirmed (PLL locked, see
+// Asic::waitPllSettled) within fastSettleMs and held for dwellMs up
+// to the direction's maximum and go back to minStep after a slow or
+// unconfirmed one. Intermediate steps are on the minStep grid, the last one
+// is the target. No hardware access, the caller sends and waits.
+class FrequencyRamp {
+  protected:
+    asic_ramp_profile_t m_profile;
+    float m_current = 0.0f;
+    float m_target = 0.0f;
+    float m_step = 0.0f;
+    bool m_done = true;
+
+  public:
+    void start(float current, float target, const asic_ramp_profile_t &profile);
+
+    // next frequency to set, false when the target was set
+    bool next(float *freq);
+
+    // result of the last step: confirmed by the chips and after how long
+    void settled(bool confirmed, uint32_t elapsedMs);
+
+    float getStep() const
+    {
+        return m_step;
+    }
+};
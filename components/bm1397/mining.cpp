@@ -6,13 +6,6 @@
 #include <stdio.h>
 #include <string.h>
 
-void free_bm_job(bm_job *job)
-{
-    free(job->jobid);
-    free(job->extranonce2);
-    free(job);
-}
-
 void calculate_merkle_root_hash(const char *coinbase_tx, const uint8_t merkle_branches[][32], const int num_merkle_branches, char merkle_root_hash[65])
 {
     size_t coinbase_tx_bin_len = strlen(coinbase_tx) / 2;
@@ -35,8 +28,31 @@ void calculate_merkle_root_hash(const char *coinbase_tx, const uint8_t merkle_br
     bin2hex(both_merkles, 32, merkle_root_hash, 65);
 }
 
+void calculate_merkle_root_bin(const uint8_t coinbase_tx_hash[32], const uint8_t merkle_branches[][32], const int num_merkle_branches,
+                               uint8_t merkle_root[32])
+{
+    uint8_t both_merkles[64];
+
+    memcpy(both_merkles, coinbase_tx_hash, 32);
+    for (int i = 0; i < num_merkle_branches; i++) {
+        memcpy(both_merkles + 32, merkle_branches[i], 32);
+        double_sha256_bin(both_merkles, 64, both_merkles);
+    }
+
+    memcpy(merkle_root, both_merkles, 32);
+}
+
 // take a mining_notify struct with ascii hex strings and convert it to a bm_job struct
 void construct_bm_job(mining_notify *params, const char *merkle_root, const uint32_t version_mask, bm_job *new_job)
+{
+    uint8_t merkle_root_bin[32];
+    hex2bin(merkle_root, merkle_root_bin, 32);
+
+    construct_bm_job_bin(params, merkle_root_bin, version_mask, new_job);
+}
+
+// same as construct_bm_job but with the binary merkle root (raw sha256 output)
+void construct_bm_job_bin(const mining_notify *params, const uint8_t merkle_root[32], const uint32_t version_mask, bm_job *new_job)
 {
     new_job->version = params->version;
     new_job->version_mask = version_mask;
@@ -45,13 +61,13 @@ void construct_bm_job(mining_notify *params, const char *merkle_root, const uint
     new_job->ntime = params->ntime;
     new_job->pool_diff = params->difficulty;
 
-    hex2bin(merkle_root, new_job->merkle_root, 32);
+    memcpy(new_job->merkle_root, merkle_root, 32);
 
-    // hex2bin(merkle_root, new_job.merkle_root_be, 32);
-    swap_endian_words(merkle_root, new_job->merkle_root_be);
+    // swap_endian_words on the hex string is the same as swap_endian_words_bin on the binary
+    swap_endian_words_bin((uint8_t *) merkle_root, new_job->merkle_root_be, 32);
     reverse_bytes(new_job->merkle_root_be, 32);
 
-    swap_endian_words_bin(params->_prev_block_hash, new_job->prev_block_hash, HASH_SIZE);
+    swap_endian_words_bin((uint8_t *) params->_prev_block_hash, new_job->prev_block_hash, HASH_SIZE);
     memcpy(new_job->prev_block_hash_be, params->_prev_block_hash, HASH_SIZE);
 
     // hex2bin(params->prev_block_hash, new_job.prev_block_hash_be, 32);
@@ -64,12 +80,14 @@ void construct_bm_job(mining_notify *params, const char *merkle_root, const uint
 static const double truediffone = 26959535291011309493156476344723991336010898738574164086137773096960.0;
 
 /* testing a nonce and return the diff - 0 means invalid */
-double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version)
+double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t rolled_version, const uint32_t min_diff,
+                        const uint32_t hw_min_diff, bool *hw_error)
 {
     double d64, s64, ds;
     unsigned char header[80];
 
     // copy data from job to header
+    // no midstate: the version is in the first block and the chips roll it for almost every nonce
     memcpy(header, &rolled_version, 4);
     memcpy(header + 4, job->prev_block_hash, 32);
     memcpy(header + 36, job->merkle_root, 32);
@@ -84,10 +102,24 @@ double test_nonce_value(const bm_job *job, const uint32_t nonce, const uint32_t
     mbedtls_sha256(header, 80, hash_buffer, 0);
     mbedtls_sha256(hash_buffer, 32, hash_result, 0);
 
+    // early exit below min_diff from the top 64 bits of the hash
+    uint64_t top64;
+    memcpy(&top64, hash_result + 24, 8);
+    if (hash_below_diff(top64, min_diff)) {
+        // the same bound for the hardware error threshold, only a hash right at it
+        // can be below and still pass
+        if (hw_error) {
+            *hw_error = hash_below_diff(top64, hw_min_diff);
+        }
+        return 0.0;
+    }
+
     d64 = truediffone;
     s64 = le256todouble(hash_result);
     ds = d64 / s64;
 
+    if (hw_error) {
+        *hw_error = ds < hw_min_diff;
+    }
     return ds;
 }
-
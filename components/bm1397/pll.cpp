@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <math.h>
+
+#include "pll.h"
+
+#define PLL_TABLE_SIZE ((PLL_TABLE_MAX_MHZ - PLL_TABLE_MIN_MHZ) * PLL_TABLE_STEPS_PER_MHZ + 1)
+
+// error in units of 1/(4 * divider) MHz, the search accepts up to 2 MHz
+#define PLL_MAX_ERROR_MHZ 2
+
+const asic_ramp_profile_t ASIC_RAMP_DEFAULT = {
+    .minStep = 6.25f,
+    .maxStepUp = 25.0f,
+    .maxStepDown = 50.0f,
+    .settleTimeoutMs = 100,
+    .fastSettleMs = 20,
+    .dwellMs = 5,
+};
+
+typedef struct
+{
+    pll_setting_t entries[PLL_TABLE_SIZE];
+} pll_table_t;
+
+// Closest setting for quarter / 4 MHz in integers, ties go to the lower post
+// divider product, then the lower postdiv2, then the search order of pll_search().
+static constexpr pll_setting_t pll_best(long quarter)
+{
+    pll_setting_t best = {0, 0, 0};
+    long bestNum = -1;
+    long bestDiv = 1;
+    int bestProduct = 0;
+    int bestPostDiv2 = 0;
+
+    for (int refdiv = 2; refdiv > 0; refdiv--) {
+        for (int postdiv1 = 7; postdiv1 > 0; postdiv1--) {
+            for (int postdiv2 = postdiv1; postdiv2 > 0; postdiv2--) {
+                long div = refdiv * postdiv1 * postdiv2;
+                // round(target / 25 * div)
+                long fb = (quarter * div + 50) / 100;
+                if (fb < PLL_FB_DIV_MIN || fb > PLL_FB_DIV_MAX) {
+                    continue;
+                }
+
+                // |target - 25 * fb / div| = num / (4 * div)
+                long num = quarter * div - 100 * fb;
+                num = num < 0 ? -num : num;
+                if (num > 4 * PLL_MAX_ERROR_MHZ * div) {
+                    continue;
+                }
+
+                int product = postdiv1 * postdiv2;
+                bool better = bestNum < 0 || num * bestDiv < bestNum * div ||
+                              (num * bestDiv == bestNum * div &&
+                               (product < bestProduct || (product == bestProduct && postdiv2 < bestPostDiv2)));
+                if (!better) {
+                    continue;
+                }
+
+                best.fbDiv = (uint8_t) fb;
+                best.refDiv = (uint8_t) refdiv;
+                best.postDiv = (uint8_t) (((postdiv1 - 1) << 4) | (postdiv2 - 1));
+                bestNum = num;
+                bestDiv = div;
+                bestProduct = product;
+                bestPostDiv2 = postdiv2;
+            }
+        }
+    }
+    return best;
+}
+
+static constexpr pll_table_t pll_make_table()
+{
+    pll_table_t table = {};
+    for (long i = 0; i < PLL_TABLE_SIZE; i++) {
+        table.entries[i] = pll_best(PLL_TABLE_MIN_MHZ * PLL_TABLE_STEPS_PER_MHZ + i);
+    }
+    return table;
+}
+
+// built by the compiler, lives in flash
+static constexpr pll_table_t s_table = pll_make_table();
+
+float pll_frequency(const pll_setting_t *setting)
+{
+    int postdiv1 = (setting->postDiv >> 4) + 1;
+    int postdiv2 = (setting->postDiv & 0xf) + 1;
+    return (float) PLL_REF_MHZ * setting->fbDiv / (setting->refDiv * postdiv1 * postdiv2);
+}
+
+bool pll_search(float target_freq, pll_setting_t *setting)
+{
+    float min_diff = 2.0;
+    int postdiv_min = 255;
+    int postdiv2_min = 255;
+    int refdiv, fb_divider, postdiv1, postdiv2;
+    float newf;
+    bool found = false;
+
+    for (refdiv = 2; refdiv > 0; refdiv--) {
+        for (postdiv1 = 7; postdiv1 > 0; postdiv1--) {
+            for (postdiv2 = 7; postdiv2 > 0; postdiv2--) {
+                fb_divider = (int) round(target_freq / 25.0 * (refdiv * postdiv2 * postdiv1));
+                newf = 25.0 * fb_divider / (refdiv * postdiv2 * postdiv1);
+                if (
+                    fb_divider >= PLL_FB_DIV_MIN && fb_divider <= PLL_FB_DIV_MAX &&
+                    fabs(target_freq - newf) <= min_diff &&
+                    postdiv1 >= postdiv2 &&
+                    postdiv1 * postdiv2 < postdiv_min &&
+                    postdiv2 <= postdiv2_min
+                ) {
+                    postdiv2_min = postdiv2;
+                    postdiv_min = postdiv1 * postdiv2;
+                    setting->fbDiv = fb_divider;
+                    setting->refDiv = refdiv;
+                    setting->postDiv = (((postdiv1 - 1) & 0xf) << 4) | ((postdiv2 - 1) & 0xf);
+                    min_diff = fabs(target_freq - newf);
+                    found = true;
+                }
+            }
+        }
+    }
+    return found;
+}
+
+bool pll_lookup(float target_freq, pll_setting_t *setting)
+{
+    float steps = target_freq * PLL_TABLE_STEPS_PER_MHZ;
+    long idx = lroundf(steps) - PLL_TABLE_MIN_MHZ * PLL_TABLE_STEPS_PER_MHZ;
+
+    if (fabsf(steps - roundf(steps)) < 0.001f && idx >= 0 && idx < PLL_TABLE_SIZE && s_table.entries[idx].fbDiv) {
+        *setting = s_table.entries[idx];
+        return true;
+    }
+    return pll_search(target_freq, setting);
+}
+
+uint32_t pll_register(const pll_setting_t *setting)
+{
+    // VCO range flag
+    uint8_t range = (setting->fbDiv * PLL_REF_MHZ / setting->refDiv >= 2400) ? 0x50 : 0x40;
+    return ((uint32_t) range << 24) | ((uint32_t) setting->fbDiv << 16) | ((uint32_t) setting->refDiv << 8) |
+           setting->postDiv;
+}
+
+void FrequencyRamp::start(float current, float target, const asic_ramp_profile_t &profile)
+{
+    m_profile = profile;
+    m_current = current;
+    m_target = target;
+    m_step = profile.minStep;
+    m_done = false;
+}
+
+bool FrequencyRamp::next(float *freq)
+{
+    if (m_done) {
+        return false;
+    }
+
+    bool up = m_target > m_current;
+    float step = std::min(m_step, up ? m_profile.maxStepUp : m_profile.maxStepDown);
+    float grid = m_profile.minStep;
+
+    // the furthest grid point within the step, off-grid frequencies align first
+    float next;
+    if (up) {
+        next = floorf((m_current + step) / grid) * grid;
+    } else {
+        next = ceilf((m_current - step) / grid) * grid;
+    }
+
+    if ((up && next >= m_target) || (!up && next <= m_target)) {
+        next = m_target;
+        m_done = true;
+    }
+
+    m_current = next;
+    *freq = next;
+    return true;
+}
+
+void FrequencyRamp::settled(bool confirmed, uint32_t elapsedMs)
+{
+    if (confirmed && elapsedMs <= m_profile.fastSettleMs) {
+        float max = std::max(m_profile.maxStepUp, m_profile.maxStepDown);
+        m_step = std::min(m_step * 2.0f, max);
+    } else {
+        m_step = m_profile.minStep;
+    }
+}
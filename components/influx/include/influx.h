@@ -1,6 +1,14 @@
 #pragma once
 
 #include <pthread.h>
+#include <stdint.h>
+
+#include "esp_http_client.h"
+
+// pending line protocol, a point is about 1.5kB with all fields
+#define INFLUX_BATCH_BUFFER_SIZE 65536
+#define INFLUX_MAX_BATCH_POINTS 32
+#define INFLUX_MAX_CHIPS 16
 
 typedef struct
 {
@@ -33,8 +41,48 @@ typedef struct
     float fan_rpm_1;
     float last_ping_rtt;
     float recent_ping_loss;
+    // per pool submit-to-ack latency
+    float submit_latency_avg[2];
+    float submit_latency_p90[2];
+    float submit_latency_max[2];
+    int submit_dropped[2];
+    // pool failover timing
+    int pool_switches;
+    int failover_ms;
+    int first_job_ms;
+    // CAN bus, only written on a CAN master
+    bool can_enabled;
+    float can_bus_load;
+    int can_frames_per_sec;
+    int can_tx_errors;
+    int can_tx_queue_max;
+    int can_arb_lost;
+    int can_bus_errors;
+    int can_rx_missed;
+    int can_incomplete;
+    float can_template_send_ms;
+    int can_max_slaves;
+    // per chip health, over its window
+    int chip_count;
+    float chip_hashrate[INFLUX_MAX_CHIPS];
+    float chip_hw_error_rate[INFLUX_MAX_CHIPS];
+    float chip_deviation[INFLUX_MAX_CHIPS];
+    bool chip_weak[INFLUX_MAX_CHIPS];
+    int weak_chips;
 } Stats;
 
+typedef struct
+{
+    uint32_t pointsWritten;
+    uint32_t pointsDropped; // buffer overflow or rejected by the server
+    uint32_t requests;
+    uint32_t requestErrors;
+    uint32_t connects;      // HTTP clients created, stays at 1 while the connection is kept
+    uint32_t lastLatencyMs;
+    uint32_t maxLatencyMs;
+    uint64_t latencySumMs;
+} InfluxWriterStats;
+
 class Influx {
   protected:
     char *m_host;
@@ -47,7 +95,30 @@ class Influx {
     char m_auth_header[128];
     char *m_big_buffer;
 
+    // write client, kept open between requests
+    esp_http_client_handle_t m_client = nullptr;
+    int m_responseLen = 0;
+
+    // points not yet written, newline separated
+    char *m_batch = nullptr;
+    size_t m_batchLen = 0;
+    int m_batchPoints = 0;
+    bool m_batchUntimed = false;
+
+    int m_maxBatchPoints = 1;
+    uint32_t m_flushIntervalMs = 0;
+    uint64_t m_lastFlushMs = 0;
+    uint64_t m_retryAfterMs = 0;
+
+    InfluxWriterStats m_writerStats;
+    pthread_mutex_t m_writerLock = PTHREAD_MUTEX_INITIALIZER;
+
     bool get_org_id(char *out_org_id, size_t max_len);
+    int formatPoint(char *buf, size_t size, uint32_t timestamp);
+    esp_http_client_handle_t getWriteClient();
+    void closeWriteClient();
+    void dropOldest();
+    static esp_err_t writeEventHandler(esp_http_client_event_t *evt);
 
   public:
     // make this beautiful later
@@ -57,7 +128,18 @@ class Influx {
     Influx();
 
     bool init(const char *host, int port, const char *token, const char *bucket, const char *org, const char *prefix);
-    void write();
+    void setBatching(int maxPoints, uint32_t flushIntervalMs);
+
+    // formats m_stats as a timestamped point and queues it, call with m_lock held
+    void addPoint();
+
+    // batch full, flush interval elapsed or points without timestamp pending
+    bool flushDue();
+
+    // writes all pending points in one request, call without m_lock
+    bool flush();
+
+    void getWriterStats(InfluxWriterStats *out);
     bool load_last_values();
     bool bucket_exists();
     bool create_bucket();
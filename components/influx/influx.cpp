@@ -2,6 +2,7 @@
 #include "psram_allocator.h"
 #include <esp_http_client.h>
 #include <esp_log.h>
+#include <esp_timer.h>
 #include <freertos/FreeRTOS.h>
 #include <freertos/semphr.h>
 #include <freertos/task.h>
@@ -19,6 +20,9 @@ static const char *TAG = "InfluxDB";
 
 #define m_big_buffer_SIZE 32768
 
+// 2023-11-14, anything before means the time isn't synced yet
+#define INFLUX_MIN_VALID_TIME 1700000000
+
 Influx::Influx() {
     // nop
 }
@@ -373,11 +377,9 @@ bool Influx::load_last_values()
     return false;
 }
 
-void Influx::write()
+int Influx::formatPoint(char *buf, size_t size, uint32_t timestamp)
 {
-    char url[256];
-
-    snprintf(m_big_buffer, m_big_buffer_SIZE,
+    int len = snprintf(buf, size,
             "%s temperature=%f,temperature2=%f,"
             "hashing_speed=%f,hashing_speed_1m=%f,invalid_shares=%d,valid_shares=%d,uptime=%d,"
             "best_difficulty=%f,total_best_difficulty=%f,pool_errors=%d,"
@@ -393,57 +395,272 @@ void Influx::write()
             m_stats.total_blocks_found, m_stats.duplicate_hashes, m_stats.last_ping_rtt, m_stats.recent_ping_loss,
             m_stats.fan_pwm_0, m_stats.fan_rpm_0, m_stats.fan_rpm_1, m_stats.fan_pwm_1);
 
+    for (int i = 0; i < 2 && len < (int) size; i++) {
+        len += snprintf(buf + len, size - len,
+                 ",pool%d_submit_latency_avg=%.1f,pool%d_submit_latency_p90=%.1f,pool%d_submit_latency_max=%.1f,pool%d_submit_dropped=%d",
+                 i, m_stats.submit_latency_avg[i], i, m_stats.submit_latency_p90[i], i, m_stats.submit_latency_max[i], i,
+                 m_stats.submit_dropped[i]);
+    }
+
+    if (len < (int) size) {
+        len += snprintf(buf + len, size - len, ",pool_switches=%d,failover_ms=%d,first_job_ms=%d",
+                 m_stats.pool_switches, m_stats.failover_ms, m_stats.first_job_ms);
+    }
+
+    if (m_stats.can_enabled && len < (int) size) {
+        len += snprintf(buf + len, size - len,
+                 ",can_bus_load=%.2f,can_frames_per_sec=%d,can_tx_errors=%d,can_tx_queue_max=%d,can_arb_lost=%d,"
+                 "can_bus_errors=%d,can_rx_missed=%d,can_incomplete=%d,can_template_send_ms=%.1f,can_max_slaves=%d",
+                 m_stats.can_bus_load, m_stats.can_frames_per_sec, m_stats.can_tx_errors, m_stats.can_tx_queue_max,
+                 m_stats.can_arb_lost, m_stats.can_bus_errors, m_stats.can_rx_missed, m_stats.can_incomplete,
+                 m_stats.can_template_send_ms, m_stats.can_max_slaves);
+    }
+
+    for (int i = 0; i < m_stats.chip_count && len < (int) size; i++) {
+        len += snprintf(buf + len, size - len, ",asic%d_hashrate=%.2f,asic%d_hw_error_rate=%.4f,asic%d_deviation=%.2f,asic%d_weak=%d",
+                 i, m_stats.chip_hashrate[i], i, m_stats.chip_hw_error_rate[i], i, m_stats.chip_deviation[i], i,
+                 m_stats.chip_weak[i] ? 1 : 0);
+    }
+
+    if (m_stats.chip_count && len < (int) size) {
+        len += snprintf(buf + len, size - len, ",weak_chips=%d", m_stats.weak_chips);
+    }
+
+    // the writer's own health, as of the previous request
+    if (len < (int) size) {
+        pthread_mutex_lock(&m_writerLock);
+        len += snprintf(buf + len, size - len, ",influx_points_dropped=%lu,influx_write_ms=%lu",
+                 (unsigned long) m_writerStats.pointsDropped, (unsigned long) m_writerStats.lastLatencyMs);
+        pthread_mutex_unlock(&m_writerLock);
+    }
+
+    // without a timestamp the server uses the time of the request
+    if (len < (int) size) {
+        if (timestamp) {
+            len += snprintf(buf + len, size - len, " %lu\n", (unsigned long) timestamp);
+        } else {
+            len += snprintf(buf + len, size - len, "\n");
+        }
+    }
+    return len;
+}
+
+void Influx::setBatching(int maxPoints, uint32_t flushIntervalMs)
+{
+    if (maxPoints < 1) {
+        maxPoints = 1;
+    }
+    if (maxPoints > INFLUX_MAX_BATCH_POINTS) {
+        maxPoints = INFLUX_MAX_BATCH_POINTS;
+    }
+    m_maxBatchPoints = maxPoints;
+    m_flushIntervalMs = flushIntervalMs;
+    m_lastFlushMs = esp_timer_get_time() / 1000ULL;
+}
+
+void Influx::dropOldest()
+{
+    char *end = (char *) memchr(m_batch, '\n', m_batchLen);
+    size_t len = end ? (size_t) (end - m_batch) + 1 : m_batchLen;
+
+    memmove(m_batch, m_batch + len, m_batchLen - len);
+    m_batchLen -= len;
+    m_batchPoints--;
+
+    pthread_mutex_lock(&m_writerLock);
+    m_writerStats.pointsDropped++;
+    pthread_mutex_unlock(&m_writerLock);
+}
+
+void Influx::addPoint()
+{
+    // points are stamped when taken, they are written later in a batch
+    time_t t = time(NULL);
+    bool timed = t > INFLUX_MIN_VALID_TIME;
+
+    int len = formatPoint(m_big_buffer, m_big_buffer_SIZE, timed ? (uint32_t) t : 0);
+    if (len <= 0 || len >= m_big_buffer_SIZE || (size_t) len > INFLUX_BATCH_BUFFER_SIZE) {
+        ESP_LOGE(TAG, "point too large");
+        return;
+    }
+
+    // the server doesn't take them, keep the newest
+    while (m_batchPoints && m_batchLen + len > INFLUX_BATCH_BUFFER_SIZE) {
+        dropOldest();
+    }
+
+    memcpy(m_batch + m_batchLen, m_big_buffer, len);
+    m_batchLen += len;
+    m_batchPoints++;
+    m_batchUntimed |= !timed;
+}
+
+bool Influx::flushDue()
+{
+    if (!m_batchPoints) {
+        return false;
+    }
+
+    uint64_t now = esp_timer_get_time() / 1000ULL;
+    if (now < m_retryAfterMs) {
+        return false;
+    }
+
+    return m_batchUntimed || m_batchPoints >= m_maxBatchPoints || now - m_lastFlushMs >= m_flushIntervalMs;
+}
+
+esp_err_t Influx::writeEventHandler(esp_http_client_event_t *evt)
+{
+    // keeps the start of the response body for error messages
+    Influx *self = (Influx *) evt->user_data;
+    if (evt->event_id == HTTP_EVENT_ON_DATA && self->m_responseLen < m_big_buffer_SIZE - 1) {
+        int len = evt->data_len;
+        if (len > m_big_buffer_SIZE - 1 - self->m_responseLen) {
+            len = m_big_buffer_SIZE - 1 - self->m_responseLen;
+        }
+        memcpy(self->m_big_buffer + self->m_responseLen, evt->data, len);
+        self->m_responseLen += len;
+    }
+    return ESP_OK;
+}
+
+esp_http_client_handle_t Influx::getWriteClient()
+{
+    if (m_client) {
+        return m_client;
+    }
+
+    char url[256];
     snprintf(url, sizeof(url), "%s:%d/api/v2/write?bucket=%s&org=%s&precision=s", m_host, m_port, m_bucket,
              m_org);
 
     ESP_LOGI(TAG, "URL: %s", url);
-    ESP_LOGI(TAG, "POST: %s", m_big_buffer);
 
+    // the client keeps the connection open as long as the server does
     esp_http_client_config_t config = {
         .url = url,
         .method = HTTP_METHOD_POST,
+        .timeout_ms = 5000,
+        .event_handler = writeEventHandler,
+        .user_data = this,
+        .keep_alive_enable = true,
     };
 
-    esp_http_client_handle_t client = esp_http_client_init(&config);
+    m_client = esp_http_client_init(&config);
+    if (!m_client) {
+        ESP_LOGE(TAG, "error creating http client");
+        return nullptr;
+    }
 
-    esp_http_client_set_header(client, "Authorization", m_auth_header);
-    esp_http_client_set_header(client, "Content-Type", "text/plain");
-    esp_http_client_set_post_field(client, m_big_buffer, strlen(m_big_buffer));
+    esp_http_client_set_header(m_client, "Authorization", m_auth_header);
+    esp_http_client_set_header(m_client, "Content-Type", "text/plain");
+
+    pthread_mutex_lock(&m_writerLock);
+    m_writerStats.connects++;
+    pthread_mutex_unlock(&m_writerLock);
 
+    return m_client;
+}
+
+void Influx::closeWriteClient()
+{
+    if (m_client) {
+        esp_http_client_cleanup(m_client);
+        m_client = nullptr;
+    }
+}
+
+bool Influx::flush()
+{
+    if (!m_batchPoints) {
+        return true;
+    }
+
+    esp_http_client_handle_t client = getWriteClient();
+    if (!client) {
+        return false;
+    }
+
+    ESP_LOGD(TAG, "POST: %.*s", (int) m_batchLen, m_batch);
+
+    m_responseLen = 0;
+    esp_http_client_set_post_field(client, m_batch, m_batchLen);
+
+    int64_t start = esp_timer_get_time();
     esp_err_t err = esp_http_client_perform(client);
-    if (err == ESP_OK) {
-        int status_code = esp_http_client_get_status_code(client);
-        int content_length = esp_http_client_get_content_length(client);
+    uint32_t latency = (uint32_t) ((esp_timer_get_time() - start) / 1000);
 
-        ESP_LOGI(TAG, "HTTP POST Status = %d, content_length = %d", status_code, content_length);
+    uint64_t now = esp_timer_get_time() / 1000ULL;
+    m_lastFlushMs = now;
 
-        if (status_code == 400) {
-            int len = esp_http_client_read(client, m_big_buffer, m_big_buffer_SIZE - 1);
-            if (len > 0) {
-                m_big_buffer[len] = 0; // Null-terminate the response
-                ESP_LOGE(TAG, "HTTP POST Error 400 Response: %s", m_big_buffer);
-            } else {
-                ESP_LOGE(TAG, "HTTP POST Error 400: No response body");
-            }
-        }
+    int status_code = (err == ESP_OK) ? esp_http_client_get_status_code(client) : -1;
+    m_big_buffer[m_responseLen] = 0;
+
+    // 2xx is written, other 4xx won't get better by retrying
+    bool written = status_code >= 200 && status_code < 300;
+    bool rejected = status_code >= 400 && status_code < 500 && status_code != 429;
+
+    pthread_mutex_lock(&m_writerLock);
+    m_writerStats.requests++;
+    m_writerStats.lastLatencyMs = latency;
+    m_writerStats.latencySumMs += latency;
+    if (latency > m_writerStats.maxLatencyMs) {
+        m_writerStats.maxLatencyMs = latency;
+    }
+    if (written) {
+        m_writerStats.pointsWritten += m_batchPoints;
     } else {
+        m_writerStats.requestErrors++;
+        if (rejected) {
+            m_writerStats.pointsDropped += m_batchPoints;
+        }
+    }
+    pthread_mutex_unlock(&m_writerLock);
+
+    if (err != ESP_OK) {
         ESP_LOGE(TAG, "HTTP POST request failed: %s", esp_err_to_name(err));
+        // reconnect with the next request
+        closeWriteClient();
+    } else if (written) {
+        ESP_LOGI(TAG, "%d points written in %lu ms", m_batchPoints, (unsigned long) latency);
+    } else {
+        ESP_LOGE(TAG, "HTTP POST Status = %d, Response: %s", status_code, m_responseLen ? m_big_buffer : "-");
     }
 
-    esp_http_client_cleanup(client);
+    if (written || rejected) {
+        m_batchLen = 0;
+        m_batchPoints = 0;
+        m_batchUntimed = false;
+        m_retryAfterMs = 0;
+        return written;
+    }
+
+    // keep the points and try again after the flush interval
+    m_retryAfterMs = now + (m_flushIntervalMs ? m_flushIntervalMs : 15000);
+    return false;
+}
+
+void Influx::getWriterStats(InfluxWriterStats *out)
+{
+    pthread_mutex_lock(&m_writerLock);
+    *out = m_writerStats;
+    pthread_mutex_unlock(&m_writerLock);
 }
 
 bool Influx::init(const char *host, int port, const char *token, const char *bucket, const char *org, const char *prefix)
 {
     m_big_buffer = (char*) MALLOC(m_big_buffer_SIZE);
 
-    if (!m_big_buffer) {
+    m_batch = (char*) MALLOC(INFLUX_BATCH_BUFFER_SIZE);
+
+    if (!m_big_buffer || !m_batch) {
         ESP_LOGE(TAG, "error allocating influx message buffer");
         return false;
     }
 
     // zero stats
     memset(&m_stats, 0, sizeof(m_stats));
+    memset(&m_writerStats, 0, sizeof(m_writerStats));
 
     m_port = port;
     m_host = strdup(host);
@@ -9,6 +9,10 @@
 extern "C" {
 #endif
 
+// Largest accepted frame payload, enough for a NewExtendedMiningJob with
+// a full merkle path and big coinbase parts
+#define SV2_NOISE_MAX_PAYLOAD (128 * 1024)
+
 typedef struct sv2_noise_ctx sv2_noise_ctx_t;
 
 // Create a new Noise context (allocates secp256k1 context internally).
@@ -32,12 +36,12 @@ int sv2_noise_send(sv2_noise_ctx_t *ctx, esp_transport_handle_t transport,
 
 // Receive and decrypt an SV2 frame via Noise.
 // hdr_out receives the 6-byte decrypted frame header.
-// payload_out receives the decrypted payload (up to max_payload_len bytes).
+// payload_out points to the payload, decrypted in place in the receive
+// buffer of the context. It stays valid until the next call.
 // payload_len_out receives the actual payload length.
 // Returns 0 on success, -1 on error.
 int sv2_noise_recv(sv2_noise_ctx_t *ctx, esp_transport_handle_t transport,
-                   uint8_t hdr_out[6], uint8_t *payload_out,
-                   int max_payload_len, int *payload_len_out);
+                   uint8_t hdr_out[6], uint8_t **payload_out, int *payload_len_out);
 
 #ifdef __cplusplus
 }
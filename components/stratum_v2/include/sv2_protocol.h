@@ -69,7 +69,10 @@ typedef struct {
     bool valid;
 } sv2_pending_job_t;
 
-// Extended mining job (heap-allocated, owns coinbase pointers)
+// Extended mining job
+//
+// The variable length fields are views: after parsing they point into the
+// received payload, for pending jobs into the buffer of their slot.
 typedef struct {
     uint32_t job_id;
     uint32_t version;
@@ -78,14 +81,23 @@ typedef struct {
     uint32_t ntime;
     uint32_t nbits;
     bool     clean_jobs;
-    uint8_t  merkle_path[SV2_MAX_MERKLE_BRANCHES][32];
+    const uint8_t *merkle_path;   // merkle_path_count * 32 bytes
     uint8_t  merkle_path_count;
-    uint8_t *coinbase_prefix;     // heap
+    const uint8_t *coinbase_prefix;
     uint16_t coinbase_prefix_len;
-    uint8_t *coinbase_suffix;     // heap
+    const uint8_t *coinbase_suffix;
     uint16_t coinbase_suffix_len;
 } sv2_ext_job_t;
 
+// Pending extended job, the buffer is reused for the following jobs
+// of the slot and only grows
+typedef struct {
+    sv2_ext_job_t job;
+    bool valid;
+    uint8_t *buf;
+    uint32_t buf_cap;
+} sv2_ext_pending_job_t;
+
 #define SV2_PENDING_JOBS_SIZE 8
 
 // SV2 connection state
@@ -109,7 +121,7 @@ typedef struct sv2_conn {
     uint8_t  extranonce_prefix[32];
     uint8_t  extranonce_prefix_len;
     uint8_t  extranonce_size;              // total extranonce bytes assigned by pool
-    sv2_ext_job_t *ext_pending_jobs[SV2_PENDING_JOBS_SIZE];
+    sv2_ext_pending_job_t ext_pending_jobs[SV2_PENDING_JOBS_SIZE];
 } sv2_conn_t;
 
 // --- Frame encode/decode ---
@@ -164,7 +176,7 @@ int sv2_parse_set_target(const uint8_t *payload, uint32_t len,
                          uint32_t *channel_id, uint8_t max_target[32]);
 
 int sv2_parse_submit_shares_success(const uint8_t *payload, uint32_t len,
-                                    uint32_t *channel_id,
+                                    uint32_t *channel_id, uint32_t *last_seq_num,
                                     uint32_t *new_submits_accepted_count);
 
 int sv2_parse_submit_shares_error(const uint8_t *payload, uint32_t len,
@@ -190,10 +202,20 @@ int sv2_parse_open_extended_channel_success(const uint8_t *payload, uint32_t len
                                             uint8_t *extranonce_prefix_len,
                                             uint32_t *group_channel_id);
 
-sv2_ext_job_t *sv2_parse_new_extended_mining_job(const uint8_t *payload, uint32_t len,
-                                                  uint32_t *channel_id_out);
+// Parses without copying, the job fields point into payload.
+int sv2_parse_new_extended_mining_job(const uint8_t *payload, uint32_t len,
+                                      sv2_ext_job_t *job, uint32_t *channel_id_out);
+
+// Copies the job into the slot so it outlives the payload. Returns 0 on success.
+int sv2_ext_job_store(sv2_ext_pending_job_t *slot, const sv2_ext_job_t *job);
+
+// --- Connection state ---
+
+// Clears the connection state, the pending job buffers are kept for reuse.
+void sv2_conn_reset(sv2_conn_t *conn);
 
-void sv2_ext_job_free(sv2_ext_job_t *job);
+// Frees the pending job buffers.
+void sv2_conn_free(sv2_conn_t *conn);
 
 // --- Helpers ---
 
@@ -22,6 +22,13 @@ static const char *TAG = "sv2_noise";
 #define TRANSPORT_TIMEOUT_MS 5000
 #define RECV_TIMEOUT_MS      (60 * 3 * 1000)
 
+#define NOISE_MAC_SIZE 16
+#define NOISE_ENC_HDR_SIZE (SV2_FRAME_HEADER_SIZE + NOISE_MAC_SIZE)
+
+// initial sizes of the frame buffers, they grow when a larger frame shows up
+#define NOISE_RECV_BUF_INITIAL (2048 + NOISE_MAC_SIZE)
+#define NOISE_SEND_BUF_INITIAL 512
+
 // Noise protocol name used to initialize h and ck
 static const char NOISE_PROTOCOL_NAME[] = "Noise_NX_Secp256k1+EllSwift_ChaChaPoly_SHA256";
 
@@ -36,6 +43,16 @@ struct sv2_noise_ctx {
     uint64_t recv_nonce;
     bool handshake_complete;
     secp256k1_context *secp_ctx;
+
+    // transport phase, keys are set once after the handshake
+    mbedtls_chachapoly_context send_aead;
+    mbedtls_chachapoly_context recv_aead;
+
+    // frames are encrypted and decrypted in place in these buffers
+    uint8_t *send_buf;
+    int send_buf_cap;
+    uint8_t *recv_buf;
+    int recv_buf_cap;
 };
 
 // --- Transport helpers ---
@@ -56,11 +73,31 @@ static int noise_recv_exact(esp_transport_handle_t transport, uint8_t *buf, int
 
 static int noise_send_all(esp_transport_handle_t transport, const uint8_t *buf, int len)
 {
-    int ret = esp_transport_write(transport, (const char *)buf, len, TRANSPORT_TIMEOUT_MS);
-    if (ret < 0) {
-        ESP_LOGE(TAG, "send failed: ret=%d", ret);
+    int sent = 0;
+    while (sent < len) {
+        int ret = esp_transport_write(transport, (const char *)buf + sent, len - sent, TRANSPORT_TIMEOUT_MS);
+        if (ret <= 0) {
+            ESP_LOGE(TAG, "send failed: ret=%d", ret);
+            return -1;
+        }
+        sent += ret;
+    }
+    return 0;
+}
+
+// grow-only buffer, keeps its content on failure
+static int noise_reserve(uint8_t **buf, int *cap, int needed)
+{
+    if (needed <= *cap) {
+        return 0;
+    }
+    uint8_t *tmp = realloc(*buf, needed);
+    if (!tmp) {
+        ESP_LOGE(TAG, "couldn't allocate frame buffer (%d bytes)", needed);
         return -1;
     }
+    *buf = tmp;
+    *cap = needed;
     return 0;
 }
 
@@ -119,33 +156,6 @@ static void build_nonce(uint64_t counter, uint8_t nonce[12])
     }
 }
 
-// ChaCha20-Poly1305 encrypt
-// out must have room for pt_len + 16 bytes
-static int noise_encrypt(const uint8_t key[32], uint64_t nonce_counter,
-                         const uint8_t *aad, size_t aad_len,
-                         const uint8_t *plaintext, size_t pt_len,
-                         uint8_t *out)
-{
-    uint8_t nonce[12];
-    build_nonce(nonce_counter, nonce);
-
-    mbedtls_chachapoly_context ctx;
-    mbedtls_chachapoly_init(&ctx);
-    mbedtls_chachapoly_setkey(&ctx, key);
-
-    int ret = mbedtls_chachapoly_encrypt_and_tag(&ctx, pt_len,
-                                                  nonce, aad, aad_len,
-                                                  plaintext, out,
-                                                  out + pt_len); // 16-byte tag appended
-    mbedtls_chachapoly_free(&ctx);
-
-    if (ret != 0) {
-        ESP_LOGE(TAG, "encrypt failed: %d", ret);
-        return -1;
-    }
-    return 0;
-}
-
 // ChaCha20-Poly1305 decrypt
 // ciphertext includes 16-byte tag at end. out receives ct_len - 16 bytes.
 static int noise_decrypt(const uint8_t key[32], uint64_t nonce_counter,
@@ -177,6 +187,38 @@ static int noise_decrypt(const uint8_t key[32], uint64_t nonce_counter,
     return 0;
 }
 
+// Transport phase ChaCha20-Poly1305, in place
+// buf holds len bytes of plaintext and gets the 16-byte tag appended
+static int noise_encrypt_inplace(mbedtls_chachapoly_context *aead, uint64_t nonce_counter,
+                                 uint8_t *buf, size_t len)
+{
+    uint8_t nonce[12];
+    build_nonce(nonce_counter, nonce);
+
+    int ret = mbedtls_chachapoly_encrypt_and_tag(aead, len, nonce, NULL, 0, buf, buf, buf + len);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "encrypt failed: %d", ret);
+        return -1;
+    }
+    return 0;
+}
+
+// buf holds len bytes of ciphertext followed by the 16-byte tag, the
+// ciphertext is authenticated while it is decrypted over itself
+static int noise_decrypt_inplace(mbedtls_chachapoly_context *aead, uint64_t nonce_counter,
+                                 uint8_t *buf, size_t len)
+{
+    uint8_t nonce[12];
+    build_nonce(nonce_counter, nonce);
+
+    int ret = mbedtls_chachapoly_auth_decrypt(aead, len, nonce, NULL, 0, buf + len, buf, buf);
+    if (ret != 0) {
+        ESP_LOGE(TAG, "decrypt failed: %d", ret);
+        return -1;
+    }
+    return 0;
+}
+
 // --- Public API ---
 
 sv2_noise_ctx_t *sv2_noise_create(void)
@@ -190,13 +232,21 @@ sv2_noise_ctx_t *sv2_noise_create(void)
         return NULL;
     }
 
+    mbedtls_chachapoly_init(&ctx->send_aead);
+    mbedtls_chachapoly_init(&ctx->recv_aead);
+
+    if (noise_reserve(&ctx->recv_buf, &ctx->recv_buf_cap, NOISE_RECV_BUF_INITIAL) != 0 ||
+        noise_reserve(&ctx->send_buf, &ctx->send_buf_cap, NOISE_SEND_BUF_INITIAL) != 0) {
+        sv2_noise_destroy(ctx);
+        return NULL;
+    }
+
     // Randomize the context for side-channel protection
     uint8_t seed[32];
     esp_fill_random(seed, sizeof(seed));
     if (!secp256k1_context_randomize(ctx->secp_ctx, seed)) {
         ESP_LOGE(TAG, "Failed to randomize secp256k1 context");
-        secp256k1_context_destroy(ctx->secp_ctx);
-        free(ctx);
+        sv2_noise_destroy(ctx);
         return NULL;
     }
 
@@ -212,9 +262,14 @@ void sv2_noise_destroy(sv2_noise_ctx_t *ctx)
     memset(ctx->send_key, 0, 32);
     memset(ctx->recv_key, 0, 32);
 
+    mbedtls_chachapoly_free(&ctx->send_aead);
+    mbedtls_chachapoly_free(&ctx->recv_aead);
+
     if (ctx->secp_ctx) {
         secp256k1_context_destroy(ctx->secp_ctx);
     }
+    free(ctx->send_buf);
+    free(ctx->recv_buf);
     free(ctx);
 }
 
@@ -482,6 +537,12 @@ int sv2_noise_handshake(sv2_noise_ctx_t *ctx, esp_transport_handle_t transport,
     memset(ctx->ck, 0, 32);
     memset(ctx->h, 0, 32);
 
+    if (mbedtls_chachapoly_setkey(&ctx->send_aead, ctx->send_key) != 0 ||
+        mbedtls_chachapoly_setkey(&ctx->recv_aead, ctx->recv_key) != 0) {
+        ESP_LOGE(TAG, "Failed to set transport keys");
+        return -1;
+    }
+
     ctx->send_nonce = 0;
     ctx->recv_nonce = 0;
     ctx->handshake_complete = true;
@@ -498,59 +559,51 @@ int sv2_noise_send(sv2_noise_ctx_t *ctx, esp_transport_handle_t transport,
         return -1;
     }
 
-    // Encrypt header (6 bytes -> 22 bytes)
-    uint8_t enc_hdr[22];
-    if (noise_encrypt(ctx->send_key, ctx->send_nonce++, NULL, 0,
-                      frame, SV2_FRAME_HEADER_SIZE, enc_hdr) != 0) {
+    // encrypted header (6 -> 22 bytes) and payload go out with one write
+    int payload_len = frame_len - SV2_FRAME_HEADER_SIZE;
+    int total = NOISE_ENC_HDR_SIZE + (payload_len > 0 ? payload_len + NOISE_MAC_SIZE : 0);
+    if (noise_reserve(&ctx->send_buf, &ctx->send_buf_cap, total) != 0) {
         return -1;
     }
 
-    if (noise_send_all(transport, enc_hdr, 22) != 0) {
+    uint8_t *buf = ctx->send_buf;
+    memcpy(buf, frame, SV2_FRAME_HEADER_SIZE);
+    if (noise_encrypt_inplace(&ctx->send_aead, ctx->send_nonce++, buf, SV2_FRAME_HEADER_SIZE) != 0) {
         return -1;
     }
 
-    // Encrypt payload if present
-    int payload_len = frame_len - SV2_FRAME_HEADER_SIZE;
     if (payload_len > 0) {
-        uint8_t *enc_payload = malloc(payload_len + 16);
-        if (!enc_payload) return -1;
-
-        if (noise_encrypt(ctx->send_key, ctx->send_nonce++, NULL, 0,
-                          frame + SV2_FRAME_HEADER_SIZE, payload_len,
-                          enc_payload) != 0) {
-            free(enc_payload);
+        uint8_t *payload = buf + NOISE_ENC_HDR_SIZE;
+        memcpy(payload, frame + SV2_FRAME_HEADER_SIZE, payload_len);
+        if (noise_encrypt_inplace(&ctx->send_aead, ctx->send_nonce++, payload, payload_len) != 0) {
             return -1;
         }
-
-        int ret = noise_send_all(transport, enc_payload, payload_len + 16);
-        free(enc_payload);
-        if (ret != 0) return -1;
     }
 
-    return 0;
+    return noise_send_all(transport, buf, total);
 }
 
 int sv2_noise_recv(sv2_noise_ctx_t *ctx, esp_transport_handle_t transport,
-                   uint8_t hdr_out[6], uint8_t *payload_out,
-                   int max_payload_len, int *payload_len_out)
+                   uint8_t hdr_out[6], uint8_t **payload_out, int *payload_len_out)
 {
     if (!ctx || !ctx->handshake_complete) {
         return -1;
     }
 
+    *payload_out = ctx->recv_buf;
     *payload_len_out = 0;
 
     // Receive and decrypt header (22 bytes -> 6 bytes)
-    uint8_t enc_hdr[22];
-    if (noise_recv_exact(transport, enc_hdr, 22) != 0) {
+    uint8_t enc_hdr[NOISE_ENC_HDR_SIZE];
+    if (noise_recv_exact(transport, enc_hdr, NOISE_ENC_HDR_SIZE) != 0) {
         return -1;
     }
 
-    if (noise_decrypt(ctx->recv_key, ctx->recv_nonce++, NULL, 0,
-                      enc_hdr, 22, hdr_out) != 0) {
+    if (noise_decrypt_inplace(&ctx->recv_aead, ctx->recv_nonce++, enc_hdr, SV2_FRAME_HEADER_SIZE) != 0) {
         ESP_LOGE(TAG, "Failed to decrypt frame header");
         return -1;
     }
+    memcpy(hdr_out, enc_hdr, SV2_FRAME_HEADER_SIZE);
 
     // Parse header to get msg_length
     sv2_frame_header_t hdr;
@@ -560,29 +613,27 @@ int sv2_noise_recv(sv2_noise_ctx_t *ctx, esp_transport_handle_t transport,
         return 0;
     }
 
-    if ((int)hdr.msg_length > max_payload_len) {
-        ESP_LOGE(TAG, "Payload too large: %lu > %d", hdr.msg_length, max_payload_len);
+    if (hdr.msg_length > SV2_NOISE_MAX_PAYLOAD) {
+        ESP_LOGE(TAG, "Payload too large: %lu > %d", hdr.msg_length, SV2_NOISE_MAX_PAYLOAD);
         return -1;
     }
 
-    // Receive and decrypt payload
-    int enc_len = hdr.msg_length + 16;
-    uint8_t *enc_payload = malloc(enc_len);
-    if (!enc_payload) return -1;
+    // Receive the payload into the frame buffer and decrypt it where it is
+    int enc_len = hdr.msg_length + NOISE_MAC_SIZE;
+    if (noise_reserve(&ctx->recv_buf, &ctx->recv_buf_cap, enc_len) != 0) {
+        return -1;
+    }
 
-    if (noise_recv_exact(transport, enc_payload, enc_len) != 0) {
-        free(enc_payload);
+    if (noise_recv_exact(transport, ctx->recv_buf, enc_len) != 0) {
         return -1;
     }
 
-    if (noise_decrypt(ctx->recv_key, ctx->recv_nonce++, NULL, 0,
-                      enc_payload, enc_len, payload_out) != 0) {
+    if (noise_decrypt_inplace(&ctx->recv_aead, ctx->recv_nonce++, ctx->recv_buf, hdr.msg_length) != 0) {
         ESP_LOGE(TAG, "Failed to decrypt payload");
-        free(enc_payload);
         return -1;
     }
 
-    free(enc_payload);
+    *payload_out = ctx->recv_buf;
     *payload_len_out = hdr.msg_length;
     return 0;
 }
@@ -1,5 +1,6 @@
 #include "sv2_protocol.h"
 #include <string.h>
+#include <stdlib.h>
 #include <math.h>
 
 // --- Difficulty conversion helpers (self-contained, no external dependency) ---
@@ -336,12 +337,13 @@ int sv2_parse_set_target(const uint8_t *payload, uint32_t len,
 }
 
 int sv2_parse_submit_shares_success(const uint8_t *payload, uint32_t len,
-                                    uint32_t *channel_id,
+                                    uint32_t *channel_id, uint32_t *last_seq_num,
                                     uint32_t *new_submits_accepted_count)
 {
     // channel_id(4) + last_seq(4) + accepted_count(4) + shares_sum(8) = 20 bytes
     if (len < 20) return -1;
     *channel_id = read_u32_le(payload);
+    *last_seq_num = read_u32_le(payload + 4);
     *new_submits_accepted_count = read_u32_le(payload + 8);
     return 0;
 }
@@ -465,12 +467,12 @@ int sv2_parse_open_extended_channel_success(const uint8_t *payload, uint32_t len
     return 0;
 }
 
-sv2_ext_job_t *sv2_parse_new_extended_mining_job(const uint8_t *payload, uint32_t len,
-                                                  uint32_t *channel_id_out)
+int sv2_parse_new_extended_mining_job(const uint8_t *payload, uint32_t len,
+                                      sv2_ext_job_t *job, uint32_t *channel_id_out)
 {
     // Minimum: channel_id(4) + job_id(4) + min_ntime option(1) + version(4) +
     //          version_rolling_allowed(1) + merkle_path(1) + coinbase_prefix(2) + coinbase_suffix(2) = 19
-    if (len < 19) return NULL;
+    if (len < 19) return -1;
 
     int pos = 0;
 
@@ -484,88 +486,121 @@ sv2_ext_job_t *sv2_parse_new_extended_mining_job(const uint8_t *payload, uint32_
     uint32_t min_ntime = 0;
     uint8_t option_flag = payload[pos++];
     if (option_flag == 0x01) {
-        if ((uint32_t)pos + 4 > len) return NULL;
+        if ((uint32_t)pos + 4 > len) return -1;
         has_min_ntime = true;
         min_ntime = read_u32_le(payload + pos); pos += 4;
     }
 
-    if ((uint32_t)pos + 4 + 1 > len) return NULL;
+    if ((uint32_t)pos + 4 + 1 > len) return -1;
     uint32_t version = read_u32_le(payload + pos); pos += 4;
 
     bool version_rolling_allowed = (payload[pos++] != 0);
 
     // merkle_path: SEQ0_255[U256] = 1 byte count + count * 32 bytes
-    if ((uint32_t)pos + 1 > len) return NULL;
+    if ((uint32_t)pos + 1 > len) return -1;
     uint8_t merkle_count = payload[pos++];
-    if (merkle_count > SV2_MAX_MERKLE_BRANCHES) return NULL;
-    if ((uint32_t)pos + (uint32_t)merkle_count * 32 > len) return NULL;
-
-    uint8_t merkle_path[SV2_MAX_MERKLE_BRANCHES][32];
-    for (int i = 0; i < merkle_count; i++) {
-        memcpy(merkle_path[i], payload + pos, 32);
-        pos += 32;
-    }
+    if (merkle_count > SV2_MAX_MERKLE_BRANCHES) return -1;
+    if ((uint32_t)pos + (uint32_t)merkle_count * 32 > len) return -1;
+    const uint8_t *merkle_path = payload + pos;
+    pos += merkle_count * 32;
 
     // coinbase_tx_prefix: B0_64K = 2 byte LE length + data
-    if ((uint32_t)pos + 2 > len) return NULL;
+    if ((uint32_t)pos + 2 > len) return -1;
     uint16_t prefix_len = read_u16_le(payload + pos); pos += 2;
-    if ((uint32_t)pos + prefix_len > len) return NULL;
+    if ((uint32_t)pos + prefix_len > len) return -1;
     const uint8_t *prefix_data = payload + pos;
     pos += prefix_len;
 
     // coinbase_tx_suffix: B0_64K = 2 byte LE length + data
-    if ((uint32_t)pos + 2 > len) return NULL;
+    if ((uint32_t)pos + 2 > len) return -1;
     uint16_t suffix_len = read_u16_le(payload + pos); pos += 2;
-    if ((uint32_t)pos + suffix_len > len) return NULL;
+    if ((uint32_t)pos + suffix_len > len) return -1;
     const uint8_t *suffix_data = payload + pos;
 
-    // Allocate and populate the job
-    sv2_ext_job_t *job = calloc(1, sizeof(sv2_ext_job_t));
-    if (!job) return NULL;
-
+    memset(job, 0, sizeof(sv2_ext_job_t));
     job->job_id = job_id;
     job->version = version;
     job->version_rolling_allowed = version_rolling_allowed;
     job->ntime = has_min_ntime ? min_ntime : 0;
+    job->merkle_path = merkle_path;
     job->merkle_path_count = merkle_count;
+    job->coinbase_prefix = prefix_len ? prefix_data : NULL;
+    job->coinbase_prefix_len = prefix_len;
+    job->coinbase_suffix = suffix_len ? suffix_data : NULL;
+    job->coinbase_suffix_len = suffix_len;
+
+    // clean_jobs is determined later when has_min_ntime == true
+    job->clean_jobs = has_min_ntime;
 
-    for (int i = 0; i < merkle_count; i++) {
-        memcpy(job->merkle_path[i], merkle_path[i], 32);
+    return 0;
+}
+
+int sv2_ext_job_store(sv2_ext_pending_job_t *slot, const sv2_ext_job_t *job)
+{
+    uint32_t merkle_len = (uint32_t)job->merkle_path_count * 32;
+    uint32_t needed = merkle_len + job->coinbase_prefix_len + job->coinbase_suffix_len;
+
+    slot->valid = false;
+
+    if (needed > slot->buf_cap) {
+        uint8_t *tmp = realloc(slot->buf, needed);
+        if (!tmp) return -1;
+        slot->buf = tmp;
+        slot->buf_cap = needed;
     }
 
-    if (prefix_len > 0) {
-        job->coinbase_prefix = malloc(prefix_len);
-        if (!job->coinbase_prefix) {
-            free(job);
-            return NULL;
-        }
-        memcpy(job->coinbase_prefix, prefix_data, prefix_len);
+    slot->job = *job;
+    slot->job.merkle_path = NULL;
+    slot->job.coinbase_prefix = NULL;
+    slot->job.coinbase_suffix = NULL;
+
+    uint8_t *p = slot->buf;
+    if (merkle_len) {
+        memcpy(p, job->merkle_path, merkle_len);
+        slot->job.merkle_path = p;
+        p += merkle_len;
     }
-    job->coinbase_prefix_len = prefix_len;
+    if (job->coinbase_prefix_len) {
+        memcpy(p, job->coinbase_prefix, job->coinbase_prefix_len);
+        slot->job.coinbase_prefix = p;
+        p += job->coinbase_prefix_len;
+    }
+    if (job->coinbase_suffix_len) {
+        memcpy(p, job->coinbase_suffix, job->coinbase_suffix_len);
+        slot->job.coinbase_suffix = p;
+    }
+
+    slot->valid = true;
+    return 0;
+}
 
-    if (suffix_len > 0) {
-        job->coinbase_suffix = malloc(suffix_len);
-        if (!job->coinbase_suffix) {
-            free(job->coinbase_prefix);
-            free(job);
-            return NULL;
-        }
-        memcpy(job->coinbase_suffix, suffix_data, suffix_len);
+// --- Connection state ---
+
+void sv2_conn_reset(sv2_conn_t *conn)
+{
+    uint8_t *bufs[SV2_PENDING_JOBS_SIZE];
+    uint32_t caps[SV2_PENDING_JOBS_SIZE];
+    for (int i = 0; i < SV2_PENDING_JOBS_SIZE; i++) {
+        bufs[i] = conn->ext_pending_jobs[i].buf;
+        caps[i] = conn->ext_pending_jobs[i].buf_cap;
     }
-    job->coinbase_suffix_len = suffix_len;
 
-    // clean_jobs is determined later when has_min_ntime == true
-    job->clean_jobs = has_min_ntime;
+    memset(conn, 0, sizeof(sv2_conn_t));
 
-    return job;
+    for (int i = 0; i < SV2_PENDING_JOBS_SIZE; i++) {
+        conn->ext_pending_jobs[i].buf = bufs[i];
+        conn->ext_pending_jobs[i].buf_cap = caps[i];
+    }
 }
 
-void sv2_ext_job_free(sv2_ext_job_t *job)
+void sv2_conn_free(sv2_conn_t *conn)
 {
-    if (!job) return;
-    free(job->coinbase_prefix);
-    free(job->coinbase_suffix);
-    free(job);
+    for (int i = 0; i < SV2_PENDING_JOBS_SIZE; i++) {
+        free(conn->ext_pending_jobs[i].buf);
+        conn->ext_pending_jobs[i].buf = NULL;
+        conn->ext_pending_jobs[i].buf_cap = 0;
+        conn->ext_pending_jobs[i].valid = false;
+    }
 }
 
 // --- Helpers ---
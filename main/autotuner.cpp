@@ -0,0 +1,347 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "autotuner.h"
+
+// windows with fewer errors are noise, not an unstable chip
+#define AUTOTUNE_MIN_HW_ERRORS 2
+
+static int find_option(const std::vector<uint32_t> &options, uint32_t value)
+{
+    // the highest option not above the value
+    int idx = 0;
+    for (size_t i = 0; i < options.size(); i++) {
+        if (options[i] <= value) {
+            idx = (int) i;
+        }
+    }
+    return idx;
+}
+
+bool AutoTuner::start(const autotune_config_t &config, const std::vector<uint32_t> &frequencies,
+                      const std::vector<uint32_t> &voltages, uint16_t frequency, uint16_t voltage, uint32_t nowMs)
+{
+    if (config.goal == AutoTuneGoal::OFF || frequencies.empty() || voltages.empty()) {
+        return false;
+    }
+
+    m_config = config;
+    m_frequencies = frequencies;
+    m_voltages = voltages;
+    m_initialFrequency = frequency;
+    m_initialVoltage = voltage;
+
+    m_hasBest = false;
+    m_logLen = 0;
+    m_sweepLen = 0;
+
+    // from the bottom, the lowest frequency is expected to hash at the lowest voltage
+    m_freqIdx = 0;
+    m_voltIdx = 0;
+    m_state = AutoTuneState::SWEEP;
+    startWindow(nowMs);
+    return true;
+}
+
+bool AutoTuner::resume(const autotune_config_t &config, const std::vector<uint32_t> &frequencies,
+                       const std::vector<uint32_t> &voltages, uint16_t frequency, uint16_t voltage,
+                       const autotune_step_t *log, int count, uint32_t nowMs)
+{
+    if (config.goal == AutoTuneGoal::OFF || frequencies.empty() || voltages.empty()) {
+        return false;
+    }
+
+    count = std::min(count, AUTOTUNE_LOG_SIZE);
+    memcpy(m_log, log, count * sizeof(autotune_step_t));
+    m_logLen = count;
+    m_hasBest = replay(config, frequencies, voltages, log, count, &m_best, &m_sweepLen) == AutoTuneState::HOLD;
+
+    m_config = config;
+    m_frequencies = frequencies;
+    m_voltages = voltages;
+    m_initialFrequency = frequency;
+    m_initialVoltage = voltage;
+
+    m_freqIdx = find_option(m_frequencies, frequency);
+    m_voltIdx = find_option(m_voltages, voltage);
+    m_state = AutoTuneState::HOLD;
+    startWindow(nowMs);
+    return true;
+}
+
+void AutoTuner::stop()
+{
+    m_state = AutoTuneState::IDLE;
+}
+
+void AutoTuner::startWindow(uint32_t nowMs)
+{
+    m_windowStartMs = nowMs;
+    m_measuring = false;
+    m_hashrateSum = 0.0;
+    m_powerSum = 0.0;
+    m_samples = 0;
+    m_tempMax = 0.0f;
+}
+
+uint16_t AutoTuner::getFrequency() const
+{
+    if (!isActive()) {
+        return m_initialFrequency;
+    }
+    return (uint16_t) m_frequencies[m_freqIdx];
+}
+
+uint16_t AutoTuner::getVoltage() const
+{
+    if (!isActive()) {
+        return m_initialVoltage;
+    }
+    return (uint16_t) m_voltages[m_voltIdx];
+}
+
+bool AutoTuner::update(const autotune_sample_t &sample, uint32_t nowMs)
+{
+    if (!isActive()) {
+        return false;
+    }
+
+    // limits are checked on every sample, the window ends at the first one over
+    bool overTemp = m_config.maxTemp > 0.0f && sample.chipTemp > m_config.maxTemp;
+    bool overPower = m_config.maxPower > 0.0f && sample.power > m_config.maxPower;
+    bool over = overTemp || overPower;
+
+    if (!m_measuring) {
+        if (!over && nowMs - m_windowStartMs < m_config.settleMs) {
+            return false;
+        }
+        m_measuring = true;
+        m_windowStartMs = nowMs;
+        m_nonces = sample.nonces;
+        m_hwErrors = sample.hwErrors;
+    }
+
+    m_hashrateSum += sample.hashrate;
+    m_powerSum += sample.power;
+    m_tempMax = std::max(m_tempMax, sample.chipTemp);
+    m_samples++;
+
+    if (!over && nowMs - m_windowStartMs < m_config.measureMs) {
+        return false;
+    }
+
+    float power = (float) (m_powerSum / m_samples);
+    if (overPower) {
+        // the sample that ended the window, the mean may still be below the limit
+        power = sample.power;
+    }
+
+    autotune_step_t step = {};
+    step.frequency = getFrequency();
+    step.voltage = getVoltage();
+    step.hashrate = (uint16_t) std::min(m_hashrateSum / m_samples + 0.5, 65535.0);
+    step.power = (uint16_t) std::min(power * 10.0f + 0.5f, 65535.0f);
+    step.hwErrors = (uint16_t) std::min(sample.hwErrors - m_hwErrors, (uint32_t) UINT16_MAX);
+    step.temp = (uint8_t) std::min(m_tempMax + 0.5f, 255.0f);
+    step.nonces = sample.nonces - m_nonces;
+
+    bool changed = this->step(step);
+    startWindow(nowMs);
+    return changed;
+}
+
+AutoTuneResult AutoTuner::classify(const autotune_step_t &step) const
+{
+    if (m_config.maxTemp > 0.0f && step.temp > m_config.maxTemp) {
+        return AUTOTUNE_OVER_TEMP;
+    }
+    if (m_config.maxPower > 0.0f && step.power / 10.0f > m_config.maxPower) {
+        return AUTOTUNE_OVER_POWER;
+    }
+
+    float expected = step.frequency * m_config.expectedGhsPerMhz;
+    if (!step.nonces || step.hashrate < expected * m_config.minYield) {
+        return AUTOTUNE_LOW_HASHRATE;
+    }
+    if (step.hwErrors >= AUTOTUNE_MIN_HW_ERRORS && step.hwErrors > m_config.maxErrorRate * step.nonces) {
+        return AUTOTUNE_HW_ERRORS;
+    }
+    return AUTOTUNE_STABLE;
+}
+
+float AutoTuner::efficiency(const autotune_step_t &step)
+{
+    if (!step.hashrate) {
+        return 0.0f;
+    }
+    return (step.power / 10.0f) / (step.hashrate / 1000.0f);
+}
+
+bool AutoTuner::isBetter(const autotune_step_t &a, const autotune_step_t &b) const
+{
+    if (m_config.goal == AutoTuneGoal::HASHRATE) {
+        if (a.hashrate != b.hashrate) {
+            return a.hashrate > b.hashrate;
+        }
+        return a.power < b.power;
+    }
+    return efficiency(a) < efficiency(b);
+}
+
+void AutoTuner::addLog(const autotune_step_t &step)
+{
+    // replay() needs the whole sweep from its first step, a full log only
+    // drops the oldest hold correction
+    if (m_logLen == AUTOTUNE_LOG_SIZE) {
+        if (m_logLen == m_sweepLen) {
+            return;
+        }
+        memmove(&m_log[m_sweepLen], &m_log[m_sweepLen + 1],
+                (AUTOTUNE_LOG_SIZE - m_sweepLen - 1) * sizeof(autotune_step_t));
+        m_logLen--;
+    }
+    m_log[m_logLen++] = step;
+    if (m_state == AutoTuneState::SWEEP) {
+        m_sweepLen = m_logLen;
+    }
+}
+
+void AutoTuner::finishSweep()
+{
+    if (!m_hasBest) {
+        m_state = AutoTuneState::FAILED;
+        return;
+    }
+    m_freqIdx = find_option(m_frequencies, m_best.frequency);
+    m_voltIdx = find_option(m_voltages, m_best.voltage);
+    m_state = AutoTuneState::HOLD;
+}
+
+bool AutoTuner::hold(const autotune_step_t &step)
+{
+    if (step.result == AUTOTUNE_STABLE) {
+        return false;
+    }
+    addLog(step);
+
+    int last = (int) m_voltages.size() - 1;
+    if (step.result == AUTOTUNE_HW_ERRORS || step.result == AUTOTUNE_LOW_HASHRATE) {
+        // the chips aged or got warmer, more voltage first
+        if (m_voltIdx < last) {
+            m_voltIdx++;
+        } else if (m_freqIdx > 0) {
+            m_freqIdx--;
+        } else {
+            return false;
+        }
+    } else {
+        if (m_freqIdx > 0) {
+            m_freqIdx--;
+        } else if (m_voltIdx > 0) {
+            m_voltIdx--;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AutoTuner::step(autotune_step_t &step)
+{
+    step.result = classify(step);
+
+    if (m_state == AutoTuneState::HOLD) {
+        return hold(step);
+    }
+    if (m_state != AutoTuneState::SWEEP) {
+        return false;
+    }
+
+    addLog(step);
+
+    switch (step.result) {
+    case AUTOTUNE_STABLE:
+        if (!m_hasBest || isBetter(step, m_best)) {
+            m_best = step;
+            m_hasBest = true;
+        }
+        if (m_freqIdx + 1 >= (int) m_frequencies.size()) {
+            finishSweep();
+        } else {
+            m_freqIdx++;
+        }
+        break;
+    case AUTOTUNE_HW_ERRORS:
+    case AUTOTUNE_LOW_HASHRATE:
+        if (m_voltIdx + 1 >= (int) m_voltages.size()) {
+            finishSweep();
+        } else {
+            m_voltIdx++;
+        }
+        break;
+    default:
+        // higher frequencies only draw more
+        finishSweep();
+        break;
+    }
+    return true;
+}
+
+AutoTuneState AutoTuner::replay(const autotune_config_t &config, const std::vector<uint32_t> &frequencies,
+                                const std::vector<uint32_t> &voltages, const autotune_step_t *log, int count,
+                                autotune_step_t *best, int *sweepLen)
+{
+    if (sweepLen) {
+        *sweepLen = 0;
+    }
+    AutoTuner tuner;
+    if (!count || !tuner.start(config, frequencies, voltages, log[0].frequency, log[0].voltage, 0)) {
+        return AutoTuneState::IDLE;
+    }
+
+    for (int i = 0; i < count; i++) {
+        autotune_step_t step = log[i];
+        tuner.step(step);
+    }
+
+    tuner.getBest(best);
+    if (sweepLen) {
+        *sweepLen = tuner.m_sweepLen;
+    }
+    return tuner.getState();
+}
+
+const char *AutoTuner::stateToStr(AutoTuneState state)
+{
+    switch (state) {
+    case AutoTuneState::IDLE:
+        return "idle";
+    case AutoTuneState::SWEEP:
+        return "sweep";
+    case AutoTuneState::HOLD:
+        return "hold";
+    case AutoTuneState::FAILED:
+        return "failed";
+    default:
+        return "unknown";
+    }
+}
+
+const char *AutoTuner::resultToStr(uint8_t result)
+{
+    switch (result) {
+    case AUTOTUNE_STABLE:
+        return "stable";
+    case AUTOTUNE_HW_ERRORS:
+        return "hw_errors";
+    case AUTOTUNE_LOW_HASHRATE:
+        return "low_hashrate";
+    case AUTOTUNE_OVER_POWER:
+        return "over_power";
+    case AUTOTUNE_OVER_TEMP:
+        return "over_temp";
+    default:
+        return "unknown";
+    }
+}
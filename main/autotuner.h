@@ -0,0 +1,178 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Searches the frequency/voltage pair of a board for a goal and keeps it there.
+ *
+ * The sweep walks up the board's frequency options. Each frequency starts at
+ * the voltage the previous one was stable at and goes up one voltage option
+ * at a time until the chips hash at the expected rate without hardware
+ * errors, so every frequency is measured at its lowest stable voltage. The
+ * sweep ends at the last frequency, the last voltage or the first step over
+ * the power or temperature limit. The best stable step is applied and held:
+ * a window that isn't stable anymore raises the voltage or lowers the
+ * frequency by one option.
+ *
+ * There is no hardware access in here. The power management task feeds one
+ * sample per poll and applies the setpoint, which keeps it buildable on the
+ * host against a simulated board. A step's verdict only depends on the
+ * measurements stored in the log and the config, replay() runs a saved log
+ * through the same decisions.
+ */
+
+#define AUTOTUNE_LOG_SIZE 64
+
+enum class AutoTuneGoal : uint8_t {
+    OFF = 0,
+    EFFICIENCY = 1, // lowest J/TH
+    HASHRATE = 2,   // highest hashrate within the limits
+};
+
+enum class AutoTuneState : uint8_t {
+    IDLE = 0,
+    SWEEP,
+    HOLD,
+    FAILED, // no stable step, the settings from before are restored
+};
+
+enum AutoTuneResult : uint8_t {
+    AUTOTUNE_STABLE = 0,
+    AUTOTUNE_HW_ERRORS,
+    AUTOTUNE_LOW_HASHRATE,
+    AUTOTUNE_OVER_POWER,
+    AUTOTUNE_OVER_TEMP,
+};
+
+typedef struct {
+    float hashrate;    // GH/s, chip counters
+    float power;       // W, input
+    float chipTemp;    // °C, hottest chip
+    uint32_t nonces;   // since boot
+    uint32_t hwErrors; // since boot
+} autotune_sample_t;
+
+// one measured setpoint, 16 bytes as saved in the log
+typedef struct {
+    uint16_t frequency; // MHz
+    uint16_t voltage;   // mV
+    uint16_t hashrate;  // GH/s, mean of the window
+    uint16_t power;     // 1/10 W, mean of the window
+    uint16_t hwErrors;
+    uint8_t temp;       // °C, max of the window
+    uint8_t result;     // AutoTuneResult
+    uint32_t nonces;
+} autotune_step_t;
+
+typedef struct {
+    AutoTuneGoal goal;
+    float maxPower;          // W, 0 for no limit
+    float maxTemp;           // °C, 0 for no limit
+    uint32_t settleMs;       // after a change, not measured
+    uint32_t measureMs;
+    float maxErrorRate;      // hardware errors per nonce
+    float minYield;          // measured / expected hashrate
+    float expectedGhsPerMhz; // whole board
+} autotune_config_t;
+
+class AutoTuner {
+  protected:
+    autotune_config_t m_config = {};
+    std::vector<uint32_t> m_frequencies;
+    std::vector<uint32_t> m_voltages;
+
+    AutoTuneState m_state = AutoTuneState::IDLE;
+    int m_freqIdx = 0;
+    int m_voltIdx = 0;
+
+    // setpoint before the sweep, restored when it fails
+    uint16_t m_initialFrequency = 0;
+    uint16_t m_initialVoltage = 0;
+
+    bool m_hasBest = false;
+    autotune_step_t m_best = {};
+
+    // current window
+    uint32_t m_windowStartMs = 0;
+    bool m_measuring = false;
+    double m_hashrateSum = 0.0;
+    double m_powerSum = 0.0;
+    uint32_t m_samples = 0;
+    float m_tempMax = 0.0f;
+    uint32_t m_nonces = 0;
+    uint32_t m_hwErrors = 0;
+
+    // the sweep first, then the hold corrections
+    autotune_step_t m_log[AUTOTUNE_LOG_SIZE];
+    int m_logLen = 0;
+    int m_sweepLen = 0;
+
+    void addLog(const autotune_step_t &step);
+    void startWindow(uint32_t nowMs);
+    bool isBetter(const autotune_step_t &a, const autotune_step_t &b) const;
+    void finishSweep();
+    bool hold(const autotune_step_t &step);
+
+  public:
+    // options ascending, as the boards list them
+    bool start(const autotune_config_t &config, const std::vector<uint32_t> &frequencies,
+               const std::vector<uint32_t> &voltages, uint16_t frequency, uint16_t voltage, uint32_t nowMs);
+
+    // keeps a setpoint found before, e.g. after a reboot, with the log of its sweep
+    bool resume(const autotune_config_t &config, const std::vector<uint32_t> &frequencies,
+                const std::vector<uint32_t> &voltages, uint16_t frequency, uint16_t voltage,
+                const autotune_step_t *log, int count, uint32_t nowMs);
+
+    void stop();
+
+    // one sample per poll, true when the setpoint changed
+    bool update(const autotune_sample_t &sample, uint32_t nowMs);
+
+    // verdict and next setpoint for a measured window, true when the setpoint changed
+    bool step(autotune_step_t &step);
+
+    AutoTuneResult classify(const autotune_step_t &step) const;
+
+    // runs a saved log through a fresh tuner, the setpoint it ends on is the result,
+    // *sweepLen (optional) gets the number of log entries of the sweep
+    static AutoTuneState replay(const autotune_config_t &config, const std::vector<uint32_t> &frequencies,
+                                const std::vector<uint32_t> &voltages, const autotune_step_t *log, int count,
+                                autotune_step_t *best, int *sweepLen = nullptr);
+
+    AutoTuneState getState() const
+    {
+        return m_state;
+    }
+
+    bool isActive() const
+    {
+        return m_state == AutoTuneState::SWEEP || m_state == AutoTuneState::HOLD;
+    }
+
+    uint16_t getFrequency() const;
+    uint16_t getVoltage() const;
+
+    const autotune_config_t &getConfig() const
+    {
+        return m_config;
+    }
+
+    bool getBest(autotune_step_t *best) const
+    {
+        *best = m_best;
+        return m_hasBest;
+    }
+
+    int getLog(const autotune_step_t **log) const
+    {
+        *log = m_log;
+        return m_logLen;
+    }
+
+    // joules per terahash of a step, 0 without hashrate
+    static float efficiency(const autotune_step_t &step);
+
+    static const char *stateToStr(AutoTuneState state);
+    static const char *resultToStr(uint8_t result);
+};
@@ -146,6 +146,17 @@ bool Board::setAsicFrequency(float frequency) {
     return m_asics->setAsicFrequency(frequency);
 }
 
+void Board::setAsicSettings(int frequency, int voltageMillis) {
+    if (m_absMaxAsicFrequency) {
+        frequency = std::min(frequency, m_absMaxAsicFrequency);
+    }
+    if (m_absMaxAsicVoltageMillis) {
+        voltageMillis = std::min(voltageMillis, m_absMaxAsicVoltageMillis);
+    }
+    m_asicFrequency = frequency;
+    m_asicVoltageMillis = voltageMillis;
+}
+
 // set and get version rolling frequency
 // requires loadSettings to update the variables
 void Board::setVrFrequency(uint32_t freq) {
@@ -127,6 +127,9 @@ public:
     bool validateFrequency(float frequency);
     bool validateVoltage(float core_voltage);
 
+    // setpoint of the autotuner, not saved, loadSettings() goes back to the saved one
+    void setAsicSettings(int frequency, int voltageMillis);
+
     void setVrFrequency(uint32_t freq);
 
     // abstract common methos
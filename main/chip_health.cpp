@@ -0,0 +1,250 @@
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#include "chip_health.h"
+
+#define NUM_SNAPSHOTS (CHIP_HEALTH_SLOTS + 1)
+
+// scales the median absolute deviation to a standard deviation
+#define MAD_TO_SIGMA 1.4826f
+
+// lower bound of the spread, about the noise of the hash counters
+#define MIN_RELATIVE_SPREAD 0.01f
+
+static float median(float *values, int count)
+{
+    std::sort(values, values + count);
+    if (count & 1) {
+        return values[count / 2];
+    }
+    return (values[count / 2 - 1] + values[count / 2]) / 2.0f;
+}
+
+ChipHealth::~ChipHealth()
+{
+    delete[] m_slots;
+}
+
+void ChipHealth::snapshot(const chip_health_sample_t *samples, uint32_t nowMs)
+{
+    m_newest = (m_newest + 1) % NUM_SNAPSHOTS;
+    m_filled = std::min(m_filled + 1, NUM_SNAPSHOTS);
+    m_slotTimeMs[m_newest] = nowMs;
+
+    for (int i = 0; i < m_count; i++) {
+        slot_t *s = slot(m_newest, i);
+        s->nonces = samples[i].nonces;
+        s->hwErrors = samples[i].hwErrors;
+        s->duplicates = samples[i].duplicates;
+        s->work = samples[i].work;
+        s->hashrate = m_samples ? (float) (m_hashrateSum[i] / m_samples) : 0.0f;
+        m_hashrateSum[i] = 0.0;
+    }
+    m_samples = 0;
+}
+
+bool ChipHealth::update(const chip_health_sample_t *samples, int count, bool useCounter, float expected,
+                        uint32_t nowMs)
+{
+    pthread_mutex_lock(&m_mutex);
+
+    count = std::min(count, CHIP_HEALTH_MAX_CHIPS);
+    if (!m_slots || count != m_count) {
+        delete[] m_slots;
+        m_count = count;
+        m_slots = new slot_t[NUM_SNAPSHOTS * m_count]();
+        m_filled = 0;
+        m_samples = 0;
+        memset(m_chips, 0, sizeof(m_chips));
+        memset(m_streak, 0, sizeof(m_streak));
+        m_voted = false;
+        m_weakMask = 0;
+    }
+
+    // a new source starts over, counter and nonce hashrates don't mix
+    if (useCounter != m_useCounter) {
+        m_useCounter = useCounter;
+        m_filled = 0;
+    }
+    m_expected = expected;
+
+    for (int i = 0; i < m_count; i++) {
+        m_hashrateSum[i] += samples[i].hashrate;
+        m_chips[i].temp = samples[i].temp;
+        m_chips[i].expected = expected;
+    }
+    m_samples++;
+
+    bool evaluated = false;
+    if (!m_filled) {
+        // the start of the first slot
+        m_newest = NUM_SNAPSHOTS - 1;
+        snapshot(samples, nowMs);
+    } else if (nowMs - m_slotTimeMs[m_newest] >= CHIP_HEALTH_SLOT_MS) {
+        snapshot(samples, nowMs);
+        evaluate();
+        evaluated = true;
+    }
+
+    pthread_mutex_unlock(&m_mutex);
+    return evaluated;
+}
+
+void ChipHealth::evaluate()
+{
+    int oldest = (m_newest - (m_filled - 1) + NUM_SNAPSHOTS) % NUM_SNAPSHOTS;
+    int slots = m_filled - 1;
+    m_windowMs = m_slotTimeMs[m_newest] - m_slotTimeMs[oldest];
+    if (!m_count || !slots || !m_windowMs) {
+        return;
+    }
+
+    float hashrates[CHIP_HEALTH_MAX_CHIPS];
+    float nonces[CHIP_HEALTH_MAX_CHIPS];
+    double nonceHashrateSum = 0.0;
+    uint32_t nonceSum = 0;
+
+    for (int i = 0; i < m_count; i++) {
+        chip_health_t *chip = &m_chips[i];
+        slot_t *first = slot(oldest, i);
+        slot_t *last = slot(m_newest, i);
+
+        chip->nonces = last->nonces - first->nonces;
+        chip->hwErrors = last->hwErrors - first->hwErrors;
+        chip->duplicates = last->duplicates - first->duplicates;
+        chip->hwErrorRate = chip->nonces ? (float) chip->hwErrors / chip->nonces : 0.0f;
+        chip->duplicateRate = chip->nonces ? (float) chip->duplicates / chip->nonces : 0.0f;
+
+        // every unit of difficulty is 2^32 hashes
+        uint32_t work = last->work - first->work;
+        chip->nonceHashrate = (float) ((double) work * 4294967296.0 / (m_windowMs / 1000.0) / 1e9);
+
+        if (m_useCounter) {
+            double sum = 0.0;
+            for (int s = 1; s <= slots; s++) {
+                sum += slot((oldest + s) % NUM_SNAPSHOTS, i)->hashrate;
+            }
+            chip->hashrate = (float) (sum / slots);
+        } else {
+            chip->hashrate = chip->nonceHashrate;
+        }
+
+        hashrates[i] = chip->hashrate;
+        nonces[i] = (float) chip->nonces;
+        nonceHashrateSum += chip->nonceHashrate;
+        nonceSum += chip->nonces;
+    }
+
+    // judged on a full enough window only, until then the flags stay
+    bool judge = slots >= CHIP_HEALTH_MIN_SLOTS;
+
+    float med = 0.0f;
+    float spread = 0.0f;
+    bool peers = m_count >= 3;
+    if (peers) {
+        float tmp[CHIP_HEALTH_MAX_CHIPS];
+        memcpy(tmp, hashrates, m_count * sizeof(float));
+        med = median(tmp, m_count);
+
+        for (int i = 0; i < m_count; i++) {
+            tmp[i] = fabsf(hashrates[i] - med);
+        }
+        spread = MAD_TO_SIGMA * median(tmp, m_count);
+        spread = std::max(spread, MIN_RELATIVE_SPREAD * med);
+
+        if (!m_useCounter) {
+            // a chip with the median hashrate returns about the median count of nonces
+            float medNonces = median(nonces, m_count);
+            if (medNonces < 1.0f) {
+                judge = false;
+            } else {
+                spread = std::max(spread, med / sqrtf(medNonces));
+            }
+        }
+    }
+
+    // an idle board has no weak chips
+    if (*std::max_element(hashrates, hashrates + m_count) <= 0.0f) {
+        judge = false;
+    }
+
+    // the nominal check gets the same Poisson floor, a chip hashing at
+    // expected returns expected / perNonce nonces in the window
+    float nominalLimit = CHIP_HEALTH_MIN_YIELD * m_expected;
+    bool nominal = m_expected > 0.0f;
+    if (nominal && !m_useCounter) {
+        float perNonce = nonceSum ? (float) (nonceHashrateSum / nonceSum) : 0.0f;
+        float expectedNonces = perNonce > 0.0f ? m_expected / perNonce : 0.0f;
+        if (expectedNonces < 1.0f) {
+            nominal = false;
+        } else {
+            nominalLimit -= CHIP_HEALTH_NOMINAL_SIGMA * m_expected / sqrtf(expectedNonces);
+        }
+    }
+
+    // the windows of consecutive evaluations overlap, the flags are only
+    // voted on when the window doesn't overlap the last voted one
+    bool vote = judge && (!m_voted || (int32_t) (m_slotTimeMs[oldest] - m_voteEndMs) >= 0);
+    if (vote) {
+        m_voted = true;
+        m_voteEndMs = m_slotTimeMs[m_newest];
+    }
+
+    for (int i = 0; i < m_count; i++) {
+        chip_health_t *chip = &m_chips[i];
+        chip->deviation = (peers && spread > 0.0f) ? (chip->hashrate - med) / spread : 0.0f;
+
+        if (!judge) {
+            m_streak[i] = 0;
+            continue;
+        }
+        if (!vote) {
+            continue;
+        }
+
+        bool belowPeers = peers && chip->deviation < -CHIP_HEALTH_MAX_DEVIATION &&
+                          chip->hashrate < CHIP_HEALTH_MIN_PEER_RATIO * med;
+        bool belowNominal = nominal && chip->hashrate < nominalLimit;
+        bool weak = belowPeers || belowNominal;
+
+        if (weak == chip->weak) {
+            m_streak[i] = 0;
+            continue;
+        }
+        if (++m_streak[i] >= CHIP_HEALTH_CONFIRM) {
+            chip->weak = weak;
+            m_streak[i] = 0;
+            if (weak) {
+                m_weakMask |= 1u << i;
+            } else {
+                m_weakMask &= ~(1u << i);
+            }
+        }
+    }
+}
+
+int ChipHealth::get(chip_health_t *chips, int max)
+{
+    pthread_mutex_lock(&m_mutex);
+    int count = std::min(max, m_count);
+    memcpy(chips, m_chips, count * sizeof(chip_health_t));
+    pthread_mutex_unlock(&m_mutex);
+    return count;
+}
+
+uint32_t ChipHealth::getWeakMask()
+{
+    pthread_mutex_lock(&m_mutex);
+    uint32_t mask = m_weakMask;
+    pthread_mutex_unlock(&m_mutex);
+    return mask;
+}
+
+uint32_t ChipHealth::getWindowMs()
+{
+    pthread_mutex_lock(&m_mutex);
+    uint32_t window = m_windowMs;
+    pthread_mutex_unlock(&m_mutex);
+    return window;
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * Per-chip hashrate and error statistics of a board, with detection of chips
+ * that fall behind their peers.
+ *
+ * The power management task feeds the cumulative counters of every chip on
+ * each poll. They are snapshotted once per slot and the statistics are taken
+ * over the last CHIP_HEALTH_SLOTS slots. The hashrate of a chip comes from its
+ * hash counter where the board has one, otherwise from the difficulty of the
+ * nonces it returned.
+ *
+ * A chip is compared with the median of the board. The spread is the median
+ * absolute deviation, so a single bad chip doesn't widen it, with a lower
+ * bound from the Poisson noise of the nonce counts when nonces are the
+ * source. A chip is weak when it is more than CHIP_HEALTH_MAX_DEVIATION
+ * spreads and CHIP_HEALTH_MIN_PEER_RATIO below the median, or below
+ * CHIP_HEALTH_MIN_YIELD of its nominal hashrate (the only check on boards
+ * with fewer than three chips). With nonces, the nominal limit is lowered by
+ * CHIP_HEALTH_NOMINAL_SIGMA times the Poisson noise of the nonces a chip
+ * would return at nominal.
+ *
+ * Consecutive windows overlap by all but one slot, so chips are only voted on
+ * once per full window. The flag changes after CHIP_HEALTH_CONFIRM votes in
+ * a row, on windows that don't share a slot.
+ *
+ * There is no hardware access in here, it builds on the host.
+ */
+
+#define CHIP_HEALTH_MAX_CHIPS 16
+
+#define CHIP_HEALTH_SLOT_MS (60 * 1000)
+#define CHIP_HEALTH_SLOTS 10
+// slots before chips are judged
+#define CHIP_HEALTH_MIN_SLOTS 5
+#define CHIP_HEALTH_CONFIRM 3
+
+#define CHIP_HEALTH_MAX_DEVIATION 3.0f
+#define CHIP_HEALTH_MIN_PEER_RATIO 0.9f
+#define CHIP_HEALTH_MIN_YIELD 0.8f
+// Poisson noise below the nominal limit that is still tolerated, in standard
+// deviations, less than for the peers since CHIP_HEALTH_CONFIRM independent
+// windows have to agree
+#define CHIP_HEALTH_NOMINAL_SIGMA 2.0f
+
+typedef struct
+{
+    float hashrate;      // GH/s, hash counter, 0 without
+    float temp;          // °C, 0 without sensor
+    uint32_t nonces;     // since boot
+    uint32_t hwErrors;   // since boot
+    uint32_t duplicates; // since boot
+    uint32_t work;       // sum of the difficulty of the valid nonces, wraps
+} chip_health_sample_t;
+
+typedef struct
+{
+    float hashrate;      // GH/s over the window, counter or nonces
+    float nonceHashrate; // GH/s from the nonces
+    float expected;      // GH/s, nominal at the frequency
+    float temp;
+    float hwErrorRate;   // per nonce
+    float duplicateRate; // per nonce
+    float deviation;     // versus the median in spreads, 0 without peers
+    uint32_t nonces;     // in the window
+    uint32_t hwErrors;
+    uint32_t duplicates;
+    bool weak;
+} chip_health_t;
+
+class ChipHealth {
+  protected:
+    typedef struct
+    {
+        uint32_t nonces;
+        uint32_t hwErrors;
+        uint32_t duplicates;
+        uint32_t work;
+        float hashrate; // mean counter hashrate of the slot ending here
+    } slot_t;
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    int m_count = 0;
+    bool m_useCounter = false;
+    float m_expected = 0.0f;
+
+    // ring of CHIP_HEALTH_SLOTS + 1 snapshots with m_count chips each
+    slot_t *m_slots = nullptr;
+    uint32_t m_slotTimeMs[CHIP_HEALTH_SLOTS + 1] = {};
+    int m_newest = 0;
+    int m_filled = 0;
+
+    // current slot
+    double m_hashrateSum[CHIP_HEALTH_MAX_CHIPS] = {};
+    uint32_t m_samples = 0;
+
+    chip_health_t m_chips[CHIP_HEALTH_MAX_CHIPS] = {};
+    uint8_t m_streak[CHIP_HEALTH_MAX_CHIPS] = {};
+    bool m_voted = false;
+    uint32_t m_voteEndMs = 0; // end of the last voted window
+    uint32_t m_weakMask = 0;
+    uint32_t m_windowMs = 0;
+
+    slot_t *slot(int idx, int chip)
+    {
+        return &m_slots[idx * m_count + chip];
+    }
+
+    void snapshot(const chip_health_sample_t *samples, uint32_t nowMs);
+    void evaluate();
+
+  public:
+    ~ChipHealth();
+
+    // one call per poll with the counters of all chips, true after an evaluation
+    bool update(const chip_health_sample_t *samples, int count, bool useCounter, float expected, uint32_t nowMs);
+
+    // copies the chips, returns their number
+    int get(chip_health_t *chips, int max);
+
+    uint32_t getWeakMask();
+
+    // span of the statistics, 0 before the first slot
+    uint32_t getWindowMs();
+
+    bool usesCounter()
+    {
+        return m_useCounter;
+    }
+};
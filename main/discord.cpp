@@ -42,16 +42,23 @@ bool Alerter::init()
     }
 
     loadConfig();
+
+    // settings changed over the API or the CAN bus take effect right away
+    Config::onChange("alrt_disc", Alerter::configChanged, this);
+    Config::onChange(NVS_CONFIG_HOSTNAME, Alerter::configChanged, this);
     return true;
 }
 
-void Alerter::loadConfig()
+void Alerter::configChanged(const char *key, void *ctx)
 {
-    safe_free(m_webhookUrl);
-    safe_free(m_host);
+    ((Alerter *) ctx)->loadConfig();
+}
 
-    m_host = Config::getHostname();
-    m_webhookUrl = Config::getDiscordWebhook();
+void Alerter::loadConfig()
+{
+    // shared strings, reloaded on every change before the old ones are freed
+    m_host = Config::getHostnameShared();
+    m_webhookUrl = Config::getDiscordWebhookShared();
     m_wdtAlertEnabled = Config::isDiscordWatchdogAlertEnabled();
     m_blockFoundAlertEnabled = Config::isDiscordBlockFoundAlertEnabled();
     m_bestDiffAlertEnabled = Config::isDiscordBestDiffAlertEnabled();
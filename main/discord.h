@@ -16,8 +16,8 @@ class Alerter {
 
     QueueHandle_t m_msgQueue = nullptr;
 
-    char *m_webhookUrl = nullptr;
-    char *m_host = nullptr;
+    const char *m_webhookUrl = nullptr;
+    const char *m_host = nullptr;
     bool m_wdtAlertEnabled = false;
     bool m_blockFoundAlertEnabled = false;
     bool m_bestDiffAlertEnabled = false;
@@ -25,6 +25,8 @@ class Alerter {
 
     virtual bool init();
 
+    static void configChanged(const char *key, void *ctx);
+
     virtual bool httpPost(const char* message) = 0;
     virtual bool enqueueMessage(const char *message) = 0;
   public:
@@ -990,6 +990,33 @@ void DisplayDriver::updateGlobalMiningStats(void)
     lv_label_set_text(m_ui->ui_lblhighFee, strData); // Update label
 }
 
+void DisplayDriver::updateChipHealth()
+{
+    uint32_t weak = POWER_MANAGEMENT_MODULE.getChipHealth().getWeakMask();
+    if (weak == m_weakChips) {
+        return;
+    }
+    m_weakChips = weak;
+
+    if (!weak) {
+        lv_label_set_text(m_ui->ui_lbASIC, SYSTEM_MODULE.getBoard()->getAsicModel());
+        lv_obj_set_style_text_color(m_ui->ui_lbASIC, lv_color_hex(0x000000), LV_PART_MAIN | LV_STATE_DEFAULT);
+        return;
+    }
+
+    // the first weak chip and how many more there are
+    char strData[20];
+    int first = __builtin_ctz(weak);
+    int count = __builtin_popcount(weak);
+    if (count == 1) {
+        snprintf(strData, sizeof(strData), "ASIC %d LOW", first);
+    } else {
+        snprintf(strData, sizeof(strData), "ASIC %d +%d LOW", first, count - 1);
+    }
+    lv_label_set_text(m_ui->ui_lbASIC, strData);
+    lv_obj_set_style_text_color(m_ui->ui_lbASIC, lv_color_hex(0xFF0000), LV_PART_MAIN | LV_STATE_DEFAULT);
+}
+
 void DisplayDriver::updateGlobalState(int pool)
 {
     PThreadGuard lock(m_lvglMutex);
@@ -1022,6 +1049,7 @@ void DisplayDriver::updateGlobalState(int pool)
     updateHashrate(&SYSTEM_MODULE, STRATUM_MANAGER, POWER_MANAGEMENT_MODULE.getPower(), pool);
     updateBTCprice();
     updateGlobalMiningStats();
+    updateChipHealth();
 
     Board *board = SYSTEM_MODULE.getBoard();
     uint16_t vcore = (int) (board->getVout() * 1000.0f);
@@ -113,6 +113,7 @@ class DisplayDriver {
 
     unsigned int m_btcPrice; // Current Bitcoin price
     uint32_t m_blockHeight; // Current Bitcoin price
+    uint32_t m_weakChips = 0; // shown in place of the ASIC model
 
     // Shutdown countdown state
     bool m_shutdownCountdownActive;
@@ -148,6 +149,7 @@ class DisplayDriver {
     void changeScreen(uint64_t now);   // Change between screens
     void updateBtcPrice();             // Update Bitcoin price on the screen
     void updateGlobalMiningStats();    // Update Global mining stats
+    void updateChipHealth();           // Weak chips on the mining screen
 
     // LVGL task handling
     void mainCreatSysteTasks();                    // Creates system tasks for LVGL
@@ -0,0 +1,87 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Bounded duplicate filter with O(1) insert and lookup
+//
+// Keys are 64bit fingerprints stored in a set-associative table of
+// NUM_SETS x WAYS entries. A key is remembered until it is older than
+// the time window or is evicted as the oldest entry of its set.
+template <std::size_t NUM_SETS, std::size_t WAYS = 4>
+class DuplicateFilter
+{
+    static_assert((NUM_SETS & (NUM_SETS - 1)) == 0, "NUM_SETS has to be a power of two");
+
+public:
+    explicit DuplicateFilter(uint32_t window_ms) : m_windowMs(window_ms) {}
+
+    // fingerprint of a share
+    static uint64_t makeKey(const char *jobid, const char *extranonce2, uint32_t nonce, uint32_t version)
+    {
+        uint64_t h = FNV_OFFSET;
+        h = fnv1a(h, jobid, strlen(jobid) + 1); // include the terminator as separator
+        h = fnv1a(h, extranonce2, strlen(extranonce2) + 1);
+        h = fnv1a(h, &nonce, sizeof(nonce));
+        h = fnv1a(h, &version, sizeof(version));
+        // 0 marks empty slots
+        return h ? h : 1;
+    }
+
+    // Insert only if the key is not already present; returns true if inserted.
+    bool insert_if_absent(uint64_t key, uint32_t now_ms)
+    {
+        Entry *set = &m_entries[(key ^ (key >> 32)) & (NUM_SETS - 1)][0];
+        Entry *victim = nullptr;
+        uint32_t victim_age = 0;
+
+        for (std::size_t i = 0; i < WAYS; ++i) {
+            Entry *e = &set[i];
+            uint32_t age = now_ms - e->time_ms;
+
+            // empty and expired slots are free
+            bool expired = !e->key || age > m_windowMs;
+            if (expired) {
+                age = UINT32_MAX;
+            } else if (e->key == key) {
+                return false;
+            }
+
+            // replace a free slot or the oldest one
+            if (!victim || age > victim_age) {
+                victim = e;
+                victim_age = age;
+            }
+        }
+
+        victim->key = key;
+        victim->time_ms = now_ms;
+        return true;
+    }
+
+    void clear() { memset(m_entries, 0, sizeof(m_entries)); }
+    void setWindow(uint32_t window_ms) { m_windowMs = window_ms; }
+    static constexpr std::size_t capacity() { return NUM_SETS * WAYS; }
+
+private:
+    static constexpr uint64_t FNV_OFFSET = 0xcbf29ce484222325ull;
+    static constexpr uint64_t FNV_PRIME = 0x100000001b3ull;
+
+    static uint64_t fnv1a(uint64_t h, const void *data, std::size_t len)
+    {
+        const uint8_t *p = (const uint8_t *) data;
+        for (std::size_t i = 0; i < len; ++i) {
+            h = (h ^ p[i]) * FNV_PRIME;
+        }
+        return h;
+    }
+
+    struct Entry
+    {
+        uint64_t key;
+        uint32_t time_ms;
+    };
+
+    Entry m_entries[NUM_SETS][WAYS] = {};
+    uint32_t m_windowMs;
+};
@@ -14,7 +14,7 @@
 
 #pragma GCC diagnostic error "-Wall"
 #pragma GCC diagnostic error "-Wextra"
-#pragma GCC diagnostic error "-Wmissing-prototypes"
+#pragma GCC diagnostic error "-Wmissing-declarations"
 
 static const char *TAG = "history";
 
@@ -41,6 +41,13 @@ void NonceDistribution::addShare(int asicNr)
     }
 }
 
+void NonceDistribution::addSlaveShare(int slaveId)
+{
+    if (slaveId > 0 && slaveId < CAN_SLAVE_MAX) {
+        m_slaveShares[slaveId]++;
+    }
+}
+
 void NonceDistribution::toLog()
 {
     // this can happen if we don't have asics
@@ -57,6 +64,14 @@ void NonceDistribution::toLog()
     }
     if (offset > 0) {
         buffer[offset - 1] = 0; // remove trailing slash
+        offset--;
+    }
+
+    // the slaves' ASICs are in can_share_stats, only the totals here
+    for (int i = 1; i < CAN_SLAVE_MAX && offset < sizeof(buffer); i++) {
+        if (m_slaveShares[i]) {
+            offset += snprintf(buffer + offset, sizeof(buffer) - offset, " s%d:%lu", i, m_slaveShares[i]);
+        }
     }
 
     ESP_LOGI(TAG, "nonce distribution: %s", buffer);
@@ -165,6 +180,11 @@ bool History::init(int num_asics)
 
     m_distribution.init(num_asics);
 
+    // works without the long-term tiers
+    if (!m_tiers.init()) {
+        ESP_LOGE(TAG, "long-term history couldn't be initialized");
+    }
+
     return isAvailable();
 }
 
@@ -262,7 +282,8 @@ void History::push(float rateGh, float vregTemp, float asicTemp, uint64_t timest
         rateGh = 0.0f;
 
     // store rate sample and timestamp
-    m_rates[WRAP(m_numSamples)] = (uint32_t) (rateGh * 1024.0); // -> Q22.10
+    uint32_t rate = (uint32_t) (rateGh * 1024.0); // -> Q22.10
+    m_rates[WRAP(m_numSamples)] = rate;
     m_vregTemps[WRAP(m_numSamples)] = vregTemp;
     m_asicTemps[WRAP(m_numSamples)] = asicTemp;
     m_timestamps[WRAP(m_numSamples)] = timestamp;
@@ -282,6 +303,8 @@ void History::push(float rateGh, float vregTemp, float asicTemp, uint64_t timest
 
     unlock();
 
+    m_tiers.push(rate, vregTemp, asicTemp);
+
     char p1 = (m_avg1m.isPreliminary()) ? '*' : ' ';
     char p2 = (m_avg10m.isPreliminary()) ? '*' : ' ';
     char p3 = (m_avg1h.isPreliminary()) ? '*' : ' ';
@@ -290,11 +313,15 @@ void History::push(float rateGh, float vregTemp, float asicTemp, uint64_t timest
              m_avg1h.getGh(), p3, m_avg1d.getGh(), p4);
 }
 
-void History::pushShare(int asic_nr)
+void History::pushShare(int asic_nr, int slave_id)
 {
     lock();
 
-    m_distribution.addShare(asic_nr);
+    if (slave_id) {
+        m_distribution.addSlaveShare(slave_id);
+    } else {
+        m_distribution.addShare(asic_nr);
+    }
     m_distribution.toLog();
 
     unlock();
@@ -407,3 +434,54 @@ void History::exportHistoryData(JsonObject &json_history, uint64_t start_timesta
 
     unlock();
 }
+
+// index of the first sample with a timestamp >= timestamp (ms since boot)
+int History::getFirstSampleAfter(int64_t timestamp)
+{
+    lock();
+    int index = searchNearestTimestamp(timestamp);
+    if (index < 0) {
+        index = m_numSamples;
+    } else if ((int64_t) getTimestampSample(index) < timestamp) {
+        index++;
+    }
+    unlock();
+    return index;
+}
+
+// Copies up to max samples starting at *first. Samples that were overwritten
+// in the meantime are skipped, *first is moved to the first copied one.
+// The lock is only held for the copy, not while the caller encodes.
+int History::copySamples(int *first, int max, history_sample_t *out)
+{
+    if (!isAvailable()) {
+        return 0;
+    }
+
+    lock();
+
+    int lowest_index = (m_numSamples - HISTORY_MAX_SAMPLES < 0) ? 0 : m_numSamples - HISTORY_MAX_SAMPLES;
+    if (*first < lowest_index) {
+        *first = lowest_index;
+    }
+
+    int count = m_numSamples - *first;
+    if (count > max) {
+        count = max;
+    }
+
+    for (int i = 0; i < count; i++) {
+        int index = WRAP(*first + i);
+        out[i].timestamp = m_timestamps[index];
+        out[i].hashrate1m = m_hashrate1m[index];
+        out[i].hashrate10m = m_hashrate10m[index];
+        out[i].hashrate1h = m_hashrate1h[index];
+        out[i].hashrate1d = m_hashrate1d[index];
+        out[i].vregTemp = m_vregTemps[index];
+        out[i].asicTemp = m_asicTemps[index];
+    }
+
+    unlock();
+
+    return (count > 0) ? count : 0;
+}
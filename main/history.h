@@ -3,7 +3,9 @@
 #include "ArduinoJson.h"
 
 #include "esp_psram.h"
+#include "can_sender.h"
 #include "hashrate_monitor_task.h"
+#include "history_tiers.h"
 
 #define NEXT_POWER_OF_TWO(x) \
     (1 << (32 - __builtin_clz((x) - 1)))
@@ -16,15 +18,28 @@
 
 class History;
 
+// one row of the history, copied out of the ring for the binary export
+typedef struct {
+    uint64_t timestamp;
+    float hashrate1m;
+    float hashrate10m;
+    float hashrate1h;
+    float hashrate1d;
+    float vregTemp;
+    float asicTemp;
+} history_sample_t;
+
 class NonceDistribution {
   protected:
     int m_numAsics;
     uint32_t *m_distribution = nullptr;
+    uint32_t m_slaveShares[CAN_SLAVE_MAX] = {}; // shares of the CAN slaves, by slave id
 
   public:
     NonceDistribution();
     void init(int numAsics);
     void addShare(int asicNr);
+    void addSlaveShare(int slaveId);
     void toLog();
 };
 
@@ -82,13 +97,15 @@ class History {
     HistoryAvg m_avg1h;
     HistoryAvg m_avg1d;
     NonceDistribution m_distribution;
+    HistoryTiers m_tiers; // long-term, see history_tiers.h
 
   public:
     History();
     bool init(int numAsics);
     bool isAvailable();
     void getTimestamps(uint64_t *first, uint64_t *last, int *num_samples);
-    void pushShare(int asic_nr);
+    // slave_id 0: share of the own chips, otherwise of the CAN slave
+    void pushShare(int asic_nr, int slave_id = 0);
     void push(float rateGh, float vregTemp, float asicTemp, uint64_t timestamp);
 
     void lock();
@@ -111,8 +128,17 @@ class History {
 
     void exportHistoryData(JsonObject &json_history, uint64_t start_timestamp, uint64_t end_timestamp, uint64_t current_timestamp, uint32_t limit);
 
+    // binary export (history_codec.h), both lock internally
+    int getFirstSampleAfter(int64_t timestamp);
+    int copySamples(int *first, int max, history_sample_t *out);
+
     int getNumSamples()
     {
         return m_numSamples;
     };
+
+    HistoryTiers *getTiers()
+    {
+        return &m_tiers;
+    }
 };
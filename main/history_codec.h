@@ -0,0 +1,152 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "history.h"
+#include "macros.h"
+
+/**
+ * Binary columnar history export, used by GET /api/v2/history.
+ *
+ * All numbers are little endian, varints are unsigned LEB128.
+ *
+ *   header   u8[4] "NQH1", u32 first (cursor of the first sample), u64 device time in ms
+ *   blocks   varint count (0 terminates), then count values of every column
+ *   trailer  u32 next (cursor for the following request), u8 flags (bit 0: more samples,
+ *            bit 1: the samples from next on were overwritten, the following response
+ *            starts after a gap)
+ *
+ * Columns in this order: timestamp (ms since boot), hashrate 1m/10m/1h/1d
+ * (GH/s as Q22.10 like the raw rates) and vreg/asic temperature (1/100 °C).
+ * Every value is stored as zigzag varint of the difference to the previous
+ * value of its column, the first one against 0. The previous values carry
+ * over from block to block.
+ *
+ * A 5 s sample typically needs 2 bytes for the timestamp and one per
+ * hashrate/temperature column instead of ~40 bytes of JSON.
+ */
+
+#define HISTORY_CODEC_MAGIC   "NQH1"
+#define HISTORY_CODEC_COLUMNS 7
+
+// samples copied out of the history per lock
+#define HISTORY_CODEC_BLOCK 128
+
+#define HISTORY_CODEC_MORE 0x01
+#define HISTORY_CODEC_GAP  0x02
+
+template <typename Writer> class HistoryEncoder {
+  protected:
+    Writer &m_w;
+    int64_t m_last[HISTORY_CODEC_COLUMNS] = {};
+
+    void varint(uint64_t v)
+    {
+        while (v >= 0x80) {
+            m_w.write((uint8_t) (v | 0x80));
+            v >>= 7;
+        }
+        m_w.write((uint8_t) v);
+    }
+
+    void le(uint64_t v, int bytes)
+    {
+        for (int i = 0; i < bytes; i++) {
+            m_w.write((uint8_t) (v >> (8 * i)));
+        }
+    }
+
+    void delta(int column, int64_t value)
+    {
+        int64_t d = value - m_last[column];
+        m_last[column] = value;
+        varint(((uint64_t) d << 1) ^ (uint64_t) (d >> 63));
+    }
+
+    static int64_t q10(float gh)
+    {
+        return (gh > 0.0f) ? (int64_t) (gh * 1024.0f) : 0;
+    }
+
+    static int64_t centi(float v)
+    {
+        return (int64_t) (v * 100.0f);
+    }
+
+  public:
+    explicit HistoryEncoder(Writer &w) : m_w(w) {}
+
+    void header(uint32_t first, uint64_t nowMs)
+    {
+        m_w.write((const uint8_t *) HISTORY_CODEC_MAGIC, 4);
+        le(first, 4);
+        le(nowMs, 8);
+    }
+
+    void block(const history_sample_t *samples, int count)
+    {
+        varint((uint64_t) count);
+        for (int i = 0; i < count; i++) delta(0, (int64_t) samples[i].timestamp);
+        for (int i = 0; i < count; i++) delta(1, q10(samples[i].hashrate1m));
+        for (int i = 0; i < count; i++) delta(2, q10(samples[i].hashrate10m));
+        for (int i = 0; i < count; i++) delta(3, q10(samples[i].hashrate1h));
+        for (int i = 0; i < count; i++) delta(4, q10(samples[i].hashrate1d));
+        for (int i = 0; i < count; i++) delta(5, centi(samples[i].vregTemp));
+        for (int i = 0; i < count; i++) delta(6, centi(samples[i].asicTemp));
+    }
+
+    void trailer(uint32_t next, bool hasMore, bool gap)
+    {
+        varint(0);
+        le(next, 4);
+        m_w.write((uint8_t) ((hasMore ? HISTORY_CODEC_MORE : 0) | (gap ? HISTORY_CODEC_GAP : 0)));
+    }
+};
+
+/**
+ * Streams up to limit samples starting at cursor first to w. The history is
+ * only locked while a block is copied, never while it is encoded or sent.
+ * If the ring overtook the cursor while sending, the stream ends in front of
+ * the lost samples with the gap flag. Returns false if out of memory,
+ * nothing was written then.
+ */
+template <typename Writer>
+bool history_export_binary(History *history, Writer &w, int first, int limit, uint64_t nowMs)
+{
+    history_sample_t *samples = (history_sample_t *) MALLOC(HISTORY_CODEC_BLOCK * sizeof(history_sample_t));
+    if (!samples) {
+        return false;
+    }
+
+    HistoryEncoder<Writer> enc(w);
+
+    // the header carries the real first cursor, copySamples may move it
+    int cursor = first;
+    int count = history->copySamples(&cursor, (limit < HISTORY_CODEC_BLOCK) ? limit : HISTORY_CODEC_BLOCK, samples);
+    enc.header((uint32_t) cursor, nowMs);
+
+    int left = limit;
+    bool gap = false;
+    while (count > 0) {
+        enc.block(samples, count);
+        cursor += count;
+        left -= count;
+        if (left <= 0) {
+            break;
+        }
+
+        // a moved cursor means samples were overwritten, a decoder would show them as continuous
+        int next = cursor;
+        count = history->copySamples(&next, (left < HISTORY_CODEC_BLOCK) ? left : HISTORY_CODEC_BLOCK, samples);
+        if (next != cursor) {
+            cursor = next;
+            gap = true;
+            break;
+        }
+    }
+
+    FREE(samples);
+
+    enc.trailer((uint32_t) cursor, cursor < history->getNumSamples(), gap);
+    return true;
+}
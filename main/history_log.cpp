@@ -0,0 +1,196 @@
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "history_log.h"
+#include "macros.h"
+
+static const char *TAG = "history_log";
+
+#define SECTOR_SIZE 4096
+#define RECORD_SIZE sizeof(history_record_t)
+
+static_assert(RECORD_SIZE == 16, "records must tile the sectors");
+
+static bool is_erased(const history_record_t *rec)
+{
+    const uint8_t *p = (const uint8_t *) rec;
+    for (size_t i = 0; i < RECORD_SIZE; i++) {
+        if (p[i] != 0xFF) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool is_valid(const history_record_t *rec)
+{
+    return rec->crc == HistoryLog::crc8((const uint8_t *) rec, RECORD_SIZE - 1);
+}
+
+// CRC-8, polynomial 0x31
+uint8_t HistoryLog::crc8(const uint8_t *data, int len)
+{
+    uint8_t crc = 0xFF;
+    for (int i = 0; i < len; i++) {
+        crc ^= data[i];
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x80) ? (uint8_t) ((crc << 1) ^ 0x31) : (uint8_t) (crc << 1);
+        }
+    }
+    return crc;
+}
+
+bool HistoryLog::readHeader(uint32_t sector, uint32_t *seq)
+{
+    history_record_t hdr;
+    if (esp_partition_read(m_partition, sector * SECTOR_SIZE, &hdr, sizeof(hdr)) != ESP_OK) {
+        return false;
+    }
+    if (hdr.time != HISTORY_LOG_MAGIC || hdr.tier != HISTORY_LOG_HEADER || !is_valid(&hdr)) {
+        return false;
+    }
+    *seq = hdr.hashrate;
+    return true;
+}
+
+bool HistoryLog::startSector(uint32_t sector, uint32_t seq)
+{
+    if (esp_partition_erase_range(m_partition, sector * SECTOR_SIZE, SECTOR_SIZE) != ESP_OK) {
+        ESP_LOGE(TAG, "erasing sector %lu failed", sector);
+        return false;
+    }
+
+    history_record_t hdr = {};
+    hdr.time = HISTORY_LOG_MAGIC;
+    hdr.hashrate = seq;
+    hdr.tier = HISTORY_LOG_HEADER;
+    hdr.crc = crc8((const uint8_t *) &hdr, RECORD_SIZE - 1);
+
+    if (esp_partition_write(m_partition, sector * SECTOR_SIZE, &hdr, sizeof(hdr)) != ESP_OK) {
+        ESP_LOGE(TAG, "writing sector header %lu failed", sector);
+        return false;
+    }
+
+    m_sector = sector;
+    m_seq = seq;
+    m_offset = RECORD_SIZE;
+    return true;
+}
+
+bool HistoryLog::init()
+{
+    m_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, HISTORY_LOG_PARTITION);
+    if (!m_partition) {
+        // devices updated via OTA keep their old partition table
+        ESP_LOGW(TAG, "no '%s' partition, long-term history isn't persisted", HISTORY_LOG_PARTITION);
+        return false;
+    }
+
+    m_numSectors = m_partition->size / SECTOR_SIZE;
+    if (m_numSectors < 2) {
+        ESP_LOGE(TAG, "partition too small");
+        m_partition = nullptr;
+        return false;
+    }
+
+    // continue in the newest sector
+    bool found = false;
+    for (uint32_t s = 0; s < m_numSectors; s++) {
+        uint32_t seq;
+        if (readHeader(s, &seq) && (!found || seq > m_seq)) {
+            m_sector = s;
+            m_seq = seq;
+            found = true;
+        }
+    }
+
+    if (!found) {
+        ESP_LOGI(TAG, "formatting history log");
+        if (!startSector(0, 1)) {
+            m_partition = nullptr;
+            return false;
+        }
+        return true;
+    }
+
+    history_record_t *buf = (history_record_t *) MALLOC(SECTOR_SIZE);
+    if (!buf) {
+        m_partition = nullptr;
+        return false;
+    }
+
+    m_offset = SECTOR_SIZE;
+    if (esp_partition_read(m_partition, m_sector * SECTOR_SIZE, buf, SECTOR_SIZE) == ESP_OK) {
+        for (uint32_t i = 1; i < SECTOR_SIZE / RECORD_SIZE; i++) {
+            if (is_erased(&buf[i])) {
+                m_offset = i * RECORD_SIZE;
+                break;
+            }
+        }
+    }
+    FREE(buf);
+
+    ESP_LOGI(TAG, "history log: %lu sectors, continuing in sector %lu at %lu (seq %lu)", m_numSectors, m_sector,
+             m_offset, m_seq);
+    return true;
+}
+
+void HistoryLog::replay(void (*cb)(const history_record_t *rec, void *ctx), void *ctx)
+{
+    if (!m_partition) {
+        return;
+    }
+
+    history_record_t *buf = (history_record_t *) MALLOC(SECTOR_SIZE);
+    if (!buf) {
+        return;
+    }
+
+    // the sector after the newest one is the oldest
+    int num = 0;
+    for (uint32_t i = 1; i <= m_numSectors; i++) {
+        uint32_t sector = (m_sector + i) % m_numSectors;
+        uint32_t seq;
+        if (!readHeader(sector, &seq) || seq > m_seq) {
+            continue;
+        }
+        if (esp_partition_read(m_partition, sector * SECTOR_SIZE, buf, SECTOR_SIZE) != ESP_OK) {
+            continue;
+        }
+        for (uint32_t r = 1; r < SECTOR_SIZE / RECORD_SIZE; r++) {
+            if (is_erased(&buf[r])) {
+                break;
+            }
+            if (!is_valid(&buf[r])) {
+                continue;
+            }
+            cb(&buf[r], ctx);
+            num++;
+        }
+    }
+    FREE(buf);
+
+    ESP_LOGI(TAG, "%d records loaded", num);
+}
+
+bool HistoryLog::append(history_record_t *rec)
+{
+    if (!m_partition) {
+        return false;
+    }
+
+    if (m_offset + RECORD_SIZE > SECTOR_SIZE) {
+        if (!startSector((m_sector + 1) % m_numSectors, m_seq + 1)) {
+            return false;
+        }
+    }
+
+    rec->crc = crc8((const uint8_t *) rec, RECORD_SIZE - 1);
+    if (esp_partition_write(m_partition, m_sector * SECTOR_SIZE + m_offset, rec, RECORD_SIZE) != ESP_OK) {
+        ESP_LOGE(TAG, "append failed");
+        return false;
+    }
+    m_offset += RECORD_SIZE;
+    return true;
+}
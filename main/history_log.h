@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_partition.h"
+
+// label of the data partition in partitions.csv
+#define HISTORY_LOG_PARTITION "history"
+
+// first record of every sector, hashrate holds the sector sequence
+#define HISTORY_LOG_MAGIC  0x31474C48 // "HLG1"
+#define HISTORY_LOG_HEADER 0xFE
+
+typedef struct __attribute__((packed)) {
+    uint32_t time;     // unix time of the bucket start
+    uint32_t hashrate; // average GH/s (uQ22.10)
+    int16_t vregTemp;  // 1/100 °C
+    int16_t asicTemp;  // 1/100 °C
+    uint16_t samples;  // raw samples in the bucket
+    uint8_t tier;
+    uint8_t crc;
+} history_record_t;
+
+/**
+ * Append-only record log on a raw flash partition.
+ *
+ * The partition is written sector by sector as a ring. A full sector
+ * continues in the next one, which is erased first, so every sector is
+ * erased once per round and the wear is spread over the whole partition.
+ * Each sector starts with a header carrying an increasing sequence number,
+ * at boot the newest sector is the one to continue in. Records have a CRC,
+ * torn writes from a power loss are skipped when reading.
+ */
+class HistoryLog {
+  protected:
+    const esp_partition_t *m_partition = nullptr;
+    uint32_t m_numSectors = 0;
+    uint32_t m_sector = 0;  // sector written to
+    uint32_t m_offset = 0;  // next free offset in m_sector
+    uint32_t m_seq = 0;     // sequence of m_sector
+
+    bool readHeader(uint32_t sector, uint32_t *seq);
+    bool startSector(uint32_t sector, uint32_t seq);
+
+  public:
+    static uint8_t crc8(const uint8_t *data, int len);
+
+    bool init();
+    bool isAvailable()
+    {
+        return m_partition != nullptr;
+    }
+
+    // calls cb for every valid record, oldest first
+    void replay(void (*cb)(const history_record_t *rec, void *ctx), void *ctx);
+
+    bool append(history_record_t *rec);
+};
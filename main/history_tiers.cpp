@@ -0,0 +1,179 @@
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "global_state.h"
+#include "history_tiers.h"
+#include "macros.h"
+
+static const char *TAG = "history_tiers";
+
+// 1m: 7 days, 15m: 30 days, 1h: 90 days
+const history_tier_def_t HistoryTiers::defs[HISTORY_TIER_COUNT] = {
+    {"1m", 60, 7 * 24 * 60, false},
+    {"15m", 15 * 60, 30 * 24 * 4, true},
+    {"1h", 3600, 90 * 24, true},
+};
+
+bool HistoryTiers::init()
+{
+    for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+        m_tiers[i].records = (history_record_t *) CALLOC(defs[i].capacity, sizeof(history_record_t));
+        if (!m_tiers[i].records) {
+            ESP_LOGE(TAG, "no memory for tier %s", defs[i].name);
+            return false;
+        }
+    }
+
+    // the flash only keeps the coarse tiers, the log is sized for the 1h tier
+    if (m_log.init()) {
+        PThreadGuard g(m_mutex);
+        m_log.replay(replayCb, this);
+    }
+
+    for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+        ESP_LOGI(TAG, "tier %s: %d records", defs[i].name, getNumRecords(i));
+    }
+    return true;
+}
+
+void HistoryTiers::replayCb(const history_record_t *rec, void *ctx)
+{
+    HistoryTiers *self = (HistoryTiers *) ctx;
+    if (rec->tier < HISTORY_TIER_COUNT && defs[rec->tier].persistent) {
+        self->addRecord(rec->tier, rec);
+    }
+}
+
+void HistoryTiers::addRecord(int tier, const history_record_t *rec)
+{
+    tier_t &t = m_tiers[tier];
+    t.records[t.numRecords % defs[tier].capacity] = *rec;
+    t.numRecords++;
+}
+
+void HistoryTiers::closeBucket(int tier)
+{
+    tier_t &t = m_tiers[tier];
+
+    history_record_t rec = {};
+    rec.time = t.bucket * defs[tier].interval;
+    rec.hashrate = (uint32_t) (t.sumRate / t.samples);
+    rec.vregTemp = (int16_t) (t.sumVreg / (int64_t) t.samples);
+    rec.asicTemp = (int16_t) (t.sumAsic / (int64_t) t.samples);
+    rec.samples = (t.samples > UINT16_MAX) ? UINT16_MAX : (uint16_t) t.samples;
+    rec.tier = (uint8_t) tier;
+
+    if (defs[tier].persistent) {
+        m_log.append(&rec);
+    }
+    addRecord(tier, &rec);
+
+    t.sumRate = 0;
+    t.sumVreg = 0;
+    t.sumAsic = 0;
+    t.samples = 0;
+}
+
+// called with every raw sample, the open buckets are lost on reboot
+void HistoryTiers::push(uint32_t rateQ10, float vregTemp, float asicTemp)
+{
+    if (!m_tiers[0].records) {
+        return;
+    }
+
+    if (!is_time_synced()) {
+        return;
+    }
+
+    if (m_waitingForTime) {
+        ESP_LOGI(TAG, "time synced, recording long-term history");
+        m_waitingForTime = false;
+    }
+
+    uint32_t ts = now();
+
+    PThreadGuard g(m_mutex);
+    for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+        tier_t &t = m_tiers[i];
+        uint32_t bucket = ts / defs[i].interval;
+        if (t.samples && bucket != t.bucket) {
+            closeBucket(i);
+        }
+        t.bucket = bucket;
+        t.sumRate += rateQ10;
+        t.sumVreg += (int64_t) (vregTemp * 100.0f);
+        t.sumAsic += (int64_t) (asicTemp * 100.0f);
+        t.samples++;
+    }
+}
+
+int HistoryTiers::getNumRecords(int tier)
+{
+    int num = m_tiers[tier].numRecords;
+    return (num < defs[tier].capacity) ? num : defs[tier].capacity;
+}
+
+uint32_t HistoryTiers::getOldestTime(int tier)
+{
+    const tier_t &t = m_tiers[tier];
+    if (!t.numRecords) {
+        return UINT32_MAX;
+    }
+    int lowest = (t.numRecords > defs[tier].capacity) ? t.numRecords - defs[tier].capacity : 0;
+    return t.records[lowest % defs[tier].capacity].time;
+}
+
+int HistoryTiers::selectTier(uint32_t span_s)
+{
+    PThreadGuard g(m_mutex);
+
+    // finest tier that stays within the point limit
+    int first = HISTORY_TIER_COUNT - 1;
+    for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+        if (span_s / defs[i].interval <= HISTORY_TIERS_MAX_POINTS) {
+            first = i;
+            break;
+        }
+    }
+
+    // prefer one that reaches back far enough, e.g. the 1m tier is empty after a reboot
+    uint32_t from = now() - span_s;
+    int oldest = first;
+    for (int i = first; i < HISTORY_TIER_COUNT; i++) {
+        uint32_t t = getOldestTime(i);
+        if (t <= from) {
+            return i;
+        }
+        if (t < getOldestTime(oldest)) {
+            oldest = i;
+        }
+    }
+    return oldest;
+}
+
+int HistoryTiers::query(int tier, uint32_t span_s, history_record_t *out, int max)
+{
+    if (tier < 0 || tier >= HISTORY_TIER_COUNT || !m_tiers[tier].records) {
+        return 0;
+    }
+
+    uint32_t from = now() - span_s;
+
+    PThreadGuard g(m_mutex);
+    const tier_t &t = m_tiers[tier];
+    const int capacity = defs[tier].capacity;
+    int lowest = (t.numRecords > capacity) ? t.numRecords - capacity : 0;
+
+    // walk back from the newest record, the cost only depends on the result
+    int start = t.numRecords;
+    while (start > lowest && t.numRecords - start < max && t.records[(start - 1) % capacity].time >= from) {
+        start--;
+    }
+
+    int num = t.numRecords - start;
+    for (int i = 0; i < num; i++) {
+        out[i] = t.records[(start + i) % capacity];
+    }
+    return num;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "history_log.h"
+
+/**
+ * Long-term history as downsampled tiers next to the 5 s ring of History.
+ *
+ * Every raw sample is added to the open bucket of each tier, a bucket is
+ * closed as soon as a sample of the next one arrives. The tiers are keyed
+ * on wall clock time, samples are only taken once the time is synced.
+ * The 15 minute and 1 hour tiers are appended to the history flash
+ * partition and reloaded at boot, the 1 minute tier is RAM only.
+ */
+
+enum {
+    HISTORY_TIER_1M = 0,
+    HISTORY_TIER_15M,
+    HISTORY_TIER_1H,
+    HISTORY_TIER_COUNT
+};
+
+// points a query returns at most, picks the tier
+#define HISTORY_TIERS_MAX_POINTS 1000
+
+typedef struct {
+    const char *name;
+    uint32_t interval; // seconds
+    int capacity;      // records kept in RAM
+    bool persistent;
+} history_tier_def_t;
+
+class HistoryTiers {
+  protected:
+    typedef struct {
+        history_record_t *records = nullptr;
+        int numRecords = 0; // monotonic like History::m_numSamples
+
+        // open bucket
+        uint32_t bucket = 0;
+        uint64_t sumRate = 0; // uQ22.10
+        int64_t sumVreg = 0;  // 1/100 °C
+        int64_t sumAsic = 0;
+        uint32_t samples = 0;
+    } tier_t;
+
+    tier_t m_tiers[HISTORY_TIER_COUNT];
+    HistoryLog m_log;
+    bool m_waitingForTime = true;
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    void addRecord(int tier, const history_record_t *rec);
+    void closeBucket(int tier);
+    static void replayCb(const history_record_t *rec, void *ctx);
+
+  public:
+    static const history_tier_def_t defs[HISTORY_TIER_COUNT];
+
+    bool init();
+    void push(uint32_t rateQ10, float vregTemp, float asicTemp);
+
+    // tier that covers span_s with at most HISTORY_TIERS_MAX_POINTS points
+    int selectTier(uint32_t span_s);
+
+    // copies the records of tier not older than now - span_s, oldest first
+    int query(int tier, uint32_t span_s, history_record_t *out, int max);
+
+    int getNumRecords(int tier);
+    uint32_t getOldestTime(int tier);
+    bool isPersistent()
+    {
+        return m_log.isAvailable();
+    }
+};
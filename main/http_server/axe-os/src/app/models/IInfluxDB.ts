@@ -6,4 +6,19 @@ export interface IInfluxDB {
     bucket: string;
     org: string;
     prefix: string;
+    sampleInterval?: number;
+    flushInterval?: number;
+    batchSize?: number;
+    writer?: IInfluxWriterStats;
+}
+
+export interface IInfluxWriterStats {
+    pointsWritten: number;
+    pointsDropped: number;
+    requests: number;
+    requestErrors: number;
+    connects: number;
+    lastLatencyMs: number;
+    maxLatencyMs: number;
+    avgLatencyMs: number;
 }
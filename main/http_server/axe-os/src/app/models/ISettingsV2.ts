@@ -56,6 +56,7 @@ export interface ISettingsV2 {
     poolMode: number;
     poolBalance: number;
     stratumKeep: number;
+    stratumHotStandby: number;
     jobInterval: number;
     stratumDifficulty: number;
     pools: ISettingsV2Pool[];
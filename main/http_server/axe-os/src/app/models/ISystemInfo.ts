@@ -89,6 +89,7 @@ export interface ISystemInfo {
     lastpingrtt: number,
     recentpingloss: number,
     stratum_keep: number,
+    stratum_hot?: number,
     defaultVrFrequency?: number,
     vrFrequency: number,
     shutdown: boolean,
@@ -151,6 +151,7 @@ export class EditComponent implements OnInit {
         // Build the form (Min/Max for volt/freq will be set dynamically right after)
         this.form = this.fb.group({
           stratumKeep: [info.stratumKeep == 1],
+          stratumHotStandby: [info.stratumHotStandby == 1],
           canMaster: [info.can.enabled == true],
           flipScreen: [info.flipScreen == 1],
           invertScreen: [info.invertScreen == 1],
@@ -420,6 +421,7 @@ export class EditComponent implements OnInit {
       poolMode: f.poolMode,
       poolBalance: f.poolBalance,
       stratumKeep: f.stratumKeep ? 1 : 0,
+      stratumHotStandby: f.stratumHotStandby ? 1 : 0,
       pools: [pool0, pool1],
       // Fans
       fans,
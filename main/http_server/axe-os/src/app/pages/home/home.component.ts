@@ -637,8 +637,11 @@ export class HomeComponent implements AfterViewChecked, OnInit, OnDestroy {
 
     this.historyDrainer = new HomeHistoryDrainer(
       {
+        // backfill over the binary history, the dashboard is only needed for the first chunk
         fetchInfo: (startTimestampMs, chunkSize) =>
-          this.systemService.getDashboardV2WithSpan(startTimestampMs, chunkSize, HOME_CFG.xAxis.maxWindowMs),
+          this.systemService
+            .getHistoryBinary({ ts: startTimestampMs, limit: chunkSize })
+            .pipe(map((res) => ({ history: res.history }))),
         importHistoryChunk: (history) => this.importHistoricalData(history),
         setRunning: (running) => (this.historyDrainRunning = running),
         setSuppressed: (suppressed) => (this.suppressChartUpdatesDuringHistoryDrain = suppressed),
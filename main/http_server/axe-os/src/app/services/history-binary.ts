@@ -0,0 +1,88 @@
+import { IHistory } from '../models/IHistory';
+
+// Decoder for the binary history of GET /api/v2/history (format: main/history_codec.h)
+
+export interface IHistoryBinary {
+  // IHistory compatible chunk, values scaled like the JSON history (x100)
+  history: IHistory;
+  // cursor of the first sample and cursor to continue with (`since`)
+  first: number;
+  next: number;
+  // samples from `next` on were overwritten while sending, the next chunk doesn't connect
+  gap: boolean;
+}
+
+const MAGIC = 'NQH1';
+const COLUMNS = 7;
+const FLAG_MORE = 0x01;
+const FLAG_GAP = 0x02;
+
+export function decodeHistoryBinary(buffer: ArrayBuffer, clientNowMs = Date.now()): IHistoryBinary {
+  const bytes = new Uint8Array(buffer);
+  const view = new DataView(buffer);
+  let pos = 0;
+
+  const need = (n: number) => {
+    if (pos + n > bytes.length) throw new Error('history: truncated response');
+  };
+
+  // plain arithmetic, timestamps don't fit into 32 bit operators
+  const varint = (): number => {
+    let value = 0;
+    let mul = 1;
+    for (;;) {
+      need(1);
+      const b = bytes[pos++];
+      value += (b & 0x7f) * mul;
+      if (b < 0x80) return value;
+      mul *= 128;
+    }
+  };
+  const zigzag = (z: number): number => (z % 2 ? -(z + 1) / 2 : z / 2);
+
+  need(16);
+  if (String.fromCharCode(bytes[0], bytes[1], bytes[2], bytes[3]) !== MAGIC) {
+    throw new Error('history: unknown format');
+  }
+  const first = view.getUint32(4, true);
+  const deviceNowMs = Number(view.getBigUint64(8, true));
+  pos = 16;
+
+  const columns: number[][] = Array.from({ length: COLUMNS }, () => []);
+  const last = new Array<number>(COLUMNS).fill(0);
+
+  for (let count = varint(); count > 0; count = varint()) {
+    for (let c = 0; c < COLUMNS; c++) {
+      const out = columns[c];
+      for (let i = 0; i < count; i++) {
+        last[c] += zigzag(varint());
+        out.push(last[c]);
+      }
+    }
+  }
+
+  need(5);
+  const next = view.getUint32(pos, true);
+  const flags = bytes[pos + 4];
+
+  // Q22.10 GH/s -> GH/s x100 like the JSON history
+  const hashrate = (q: number[]) => q.map((v) => (v * 100) / 1024);
+
+  return {
+    history: {
+      timestamps: columns[0],
+      // device timestamps are ms since boot
+      timestampBase: clientNowMs - deviceNowMs,
+      hashrate_1m: hashrate(columns[1]),
+      hashrate_10m: hashrate(columns[2]),
+      hashrate_1h: hashrate(columns[3]),
+      hashrate_1d: hashrate(columns[4]),
+      vregTemp: columns[5],
+      asicTemp: columns[6],
+      hasMore: (flags & FLAG_MORE) !== 0,
+    },
+    first,
+    next,
+    gap: (flags & FLAG_GAP) !== 0,
+  };
+}
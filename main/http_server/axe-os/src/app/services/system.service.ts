@@ -1,10 +1,12 @@
 import { HttpClient, HttpEvent, HttpParams } from '@angular/common/http';
 import { Injectable } from '@angular/core';
 import { Observable } from 'rxjs';
+import { map } from 'rxjs/operators';
 import { eASICModel } from '../models/enum/eASICModel';
 import { ISystemInfo } from '../models/ISystemInfo';
 import { IDashboardV2 } from '../models/IDashboardV2';
 import { IHistory } from '../models/IHistory';
+import { decodeHistoryBinary, IHistoryBinary } from './history-binary';
 import { IAlertSettings } from '../models/IAlertSettings';
 import { AsicInfo } from '../models/IAsicInfo';
 import { ISettingsV2 } from '../models/ISettingsV2';
@@ -212,6 +214,21 @@ export class SystemService {
     return this.httpClient.get<IDashboardV2>('/api/v2/dashboard', { params });
   }
 
+  // Binary history: either continues at a cursor (`next` of the previous call)
+  // or starts at client timestamp ts. Much smaller than the dashboard history.
+  public getHistoryBinary(opts: { since?: number; ts?: number; limit?: number }): Observable<IHistoryBinary> {
+    let params = new HttpParams();
+    if (opts.since != null) {
+      params = params.set('since', opts.since);
+    } else if (opts.ts != null && opts.ts > 0) {
+      params = params.set('ts', opts.ts).set('cur', Date.now());
+    }
+    if (opts.limit != null && opts.limit > 0) params = params.set('limit', opts.limit);
+    return this.httpClient
+      .get('/api/v2/history', { params, responseType: 'arraybuffer' })
+      .pipe(map((buf) => decodeHistoryBinary(buf)));
+  }
+
   public getAsicInfo(uri: string = ''): Observable<AsicInfo> {
     return this.httpClient.get<AsicInfo>(`${uri}/api/system/asic`);
   }
@@ -27,7 +27,7 @@ esp_err_t GET_alert_info(httpd_req_t *req)
         return ESP_FAIL;
     }
 
-    char *alertDiscordWebhook = Config::getDiscordWebhook();
+    const char *alertDiscordWebhook = Config::getDiscordWebhookShared();
 
     PSRAMAllocator allocator;
     JsonDocument doc(&allocator);
@@ -42,7 +42,6 @@ esp_err_t GET_alert_info(httpd_req_t *req)
     esp_err_t ret = sendJsonResponse(req, doc);
 
     doc.clear();
-    free(alertDiscordWebhook);
 
     return ret;
 }
@@ -97,9 +96,6 @@ esp_err_t POST_update_alert(httpd_req_t *req)
 
     httpd_resp_send_chunk(req, NULL, 0);
 
-    // reload discord alerter config
-    discordAlerter.loadConfig();
-
     // reload config
     SYSTEM_MODULE.loadSettings();
 
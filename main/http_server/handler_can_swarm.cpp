@@ -11,8 +11,11 @@
 #include "http_utils.h"
 #include "psram_allocator.h"
 #include "global_state.h"
+#include "macros.h"
 #include "nvs_config.h"
 #include "tasks/can_master_task.h"
+#include "tasks/can_metrics.h"
+#include "tasks/can_share_stats.h"
 #include "tasks/can_sender.h"
 
 static const char *TAG = "http_can_swarm";
@@ -57,6 +60,50 @@ esp_err_t GET_can_nodes(httpd_req_t *req)
     fleet["hashRate"] = fleetHashRate;
     fleet["power"]    = masterPower + can_master_get_slave_fleet_power();
 
+    // --- Bus utilisation, errors and job templates ---
+    {
+        can_metrics_t        m   = {};
+        can_template_stats_t tpl = {};
+        can_metrics_get(&m);
+        can_master_get_template_stats(&tpl);
+        JsonObject jbus = fleet["bus"].to<JsonObject>();
+        jbus["load"]              = m.load;
+        jbus["loadAvg"]           = m.loadAvg;
+        jbus["framesPerSec"]      = m.framesPerSec;
+        jbus["txFrames"]          = m.txFrames;
+        jbus["rxFrames"]          = m.rxFrames;
+        jbus["txErrors"]          = m.txErrors;
+        jbus["busOffRecoveries"]  = m.busOffRecoveries;
+        jbus["txQueue"]           = m.txQueue;
+        jbus["txQueueMax"]        = m.txQueueMax;
+        jbus["arbLost"]           = m.arbLost;
+        jbus["busErrors"]         = m.busErrors;
+        jbus["txFailed"]          = m.txFailed;
+        jbus["rxMissed"]          = m.rxMissed;
+        jbus["rxOverrun"]         = m.rxOverrun;
+        jbus["incomplete"]        = m.incomplete;
+        jbus["maxSlavesEstimate"] = m.maxSlavesEstimate;
+        jbus["templates"]         = tpl.templates;
+        jbus["templateResends"]   = tpl.templateResends;
+        jbus["templateBytes"]     = tpl.templateBytes;
+
+        // frames per message type, completion time of the multiframe ones
+        static const char *names[CAN_MSG_TYPES] = {"control", "nonce", "telemetry", "settings",
+                                                   "template", "templateAck", "config"};
+        JsonObject msgs = jbus["messages"].to<JsonObject>();
+        for (int t = 0; t < CAN_MSG_TYPES; t++) {
+            const can_msg_stats_t *ms = &m.msg[t];
+            JsonObject jm = msgs[names[t]].to<JsonObject>();
+            jm["frames"] = ms->frames;
+            if (ms->messages) {
+                jm["messages"] = ms->messages;
+                jm["lastMs"]   = ms->lastUs / 1000.0f;
+                jm["maxMs"]    = ms->maxUs / 1000.0f;
+                jm["avgMs"]    = (float) (ms->sumUs / ms->messages) / 1000.0f;
+            }
+        }
+    }
+
     JsonArray arr = doc["nodes"].to<JsonArray>();
 
     // --- Node [0]: master board ---
@@ -158,6 +205,47 @@ esp_err_t GET_can_nodes(httpd_req_t *req)
         node["flipScreen"]         = has_config && cfg.flipScreen;
         node["autoScreenOff"]      = has_config && cfg.autoScreenOff;
 
+        {
+            // template broadcast → first job on the slave
+            can_slave_job_stats_t js = {};
+            can_master_get_slave_job_stats((uint8_t) i, &js);
+            JsonObject jobs = node["jobDelivery"].to<JsonObject>();
+            jobs["templates"] = js.templates;
+            jobs["lastMs"]    = js.lastLatencyMs;
+            jobs["maxMs"]     = js.maxLatencyMs;
+            jobs["avgMs"]     = js.templates ? (uint32_t) (js.sumLatencyMs / js.templates) : 0;
+        }
+
+        {
+            // share accounting on the master, independent of the reported hashrate
+            can_slave_share_stats_t ss = {};
+            can_shares_get((uint8_t) i, &ss);
+            JsonObject shares = node["shares"].to<JsonObject>();
+            shares["submitted"]   = ss.shares;
+            shares["accepted"]    = ss.accepted;
+            shares["rejected"]    = ss.rejected;
+            shares["stale"]       = ss.stale;
+            shares["invalid"]     = ss.invalid;
+            shares["bestDiff"]    = ss.bestDiff;
+            shares["hashRate10m"] = ss.hashrate10m;
+            shares["hashRate1h"]  = ss.hashrate1h;
+            JsonArray asics = shares["asics"].to<JsonArray>();
+            for (int j = 0; j < ss.numAsics; j++) {
+                asics.add(ss.asicShares[j]);
+            }
+        }
+
+        {
+            can_slave_metrics_t sm = {};
+            can_metrics_get_slave((uint8_t) i, &sm);
+            JsonObject bus = node["bus"].to<JsonObject>();
+            bus["rxFrames"]           = sm.rxFrames;
+            bus["bitsPerSec"]         = sm.bitsPerSec;
+            bus["incompleteRestart"]  = sm.incomplete[CAN_INCOMPLETE_RESTART];
+            bus["incompleteOverflow"] = sm.incomplete[CAN_INCOMPLETE_OVERFLOW];
+            bus["incompleteTimeout"]  = sm.incomplete[CAN_INCOMPLETE_TIMEOUT];
+        }
+
         {
             JsonArray asicTemps = node["asicTemps"].to<JsonArray>();
             for (int j = 0; j < 4; j++) {
@@ -328,3 +416,39 @@ esp_err_t DELETE_can_slave(httpd_req_t *req)
     httpd_resp_sendstr(req, "{\"ok\":true}");
     return ESP_OK;
 }
+
+// GET /api/v2/can/nodes/{id}/history — share based hashrate of a slave
+esp_err_t GET_can_slave_history(httpd_req_t *req)
+{
+    ConGuard g(http_server, req);
+    if (is_network_allowed(req) != ESP_OK)
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Unauthorized");
+    httpd_resp_set_type(req, "application/json");
+    if (set_cors_headers(req) != ESP_OK) { httpd_resp_send_500(req); return ESP_FAIL; }
+
+    uint8_t slave_id;
+    const char *last = strrchr(req->uri, '/');
+    if (!last || strcmp(last + 1, "history") != 0 || parse_slave_id(req, &slave_id) != ESP_OK)
+        return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "not found");
+
+    float *rates = (float *) MALLOC(CAN_SHARE_HISTORY * sizeof(float));
+    if (!rates) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+    uint32_t age_s = 0;
+    int      count = can_shares_get_history(slave_id, rates, CAN_SHARE_HISTORY, &age_s);
+
+    PSRAMAllocator allocator;
+    JsonDocument doc(&allocator);
+    doc["id"]            = slave_id;
+    doc["bucketSeconds"] = CAN_SHARE_BUCKET_S;
+    doc["currentAge"]    = age_s;  // seconds since the start of the last bucket
+    JsonArray hashrate = doc["hashrate"].to<JsonArray>();
+    for (int i = 0; i < count; i++) {
+        hashrate.add((int) (rates[i] * 100.0f));
+    }
+    safe_free(rates);
+
+    return sendJsonResponse(req, doc);
+}
@@ -7,6 +7,7 @@
 #include "nvs_config.h"
 #include "http_cors.h"
 #include "http_utils.h"
+#include "influx_task.h"
 
 static const char* TAG="http_influx";
 
@@ -29,10 +30,10 @@ esp_err_t GET_influx_info(httpd_req_t *req)
     }
 
     // Retrieve configuration strings from NVS
-    char *influxURL    = Config::getInfluxURL();
-    char *influxBucket = Config::getInfluxBucket();
-    char *influxOrg    = Config::getInfluxOrg();
-    char *influxPrefix = Config::getInfluxPrefix();
+    const char *influxURL    = Config::getInfluxURLShared();
+    const char *influxBucket = Config::getInfluxBucketShared();
+    const char *influxOrg    = Config::getInfluxOrgShared();
+    const char *influxPrefix = Config::getInfluxPrefixShared();
 
     PSRAMAllocator allocator;
     JsonDocument doc(&allocator);
@@ -44,18 +45,28 @@ esp_err_t GET_influx_info(httpd_req_t *req)
     doc["org"]    = influxOrg;
     doc["prefix"] = influxPrefix;
     doc["enabled"] = Config::isInfluxEnabled() ? 1 : 0;
+    doc["sampleInterval"] = Config::getInfluxSampleInterval();
+    doc["flushInterval"]  = Config::getInfluxFlushInterval();
+    doc["batchSize"]      = Config::getInfluxBatchSize();
+
+    InfluxWriterStats stats;
+    if (influx_task_get_writer_stats(&stats)) {
+        JsonObject writer = doc["writer"].to<JsonObject>();
+        writer["pointsWritten"] = stats.pointsWritten;
+        writer["pointsDropped"] = stats.pointsDropped;
+        writer["requests"]      = stats.requests;
+        writer["requestErrors"] = stats.requestErrors;
+        writer["connects"]      = stats.connects;
+        writer["lastLatencyMs"] = stats.lastLatencyMs;
+        writer["maxLatencyMs"]  = stats.maxLatencyMs;
+        writer["avgLatencyMs"]  = stats.requests ? (uint32_t) (stats.latencySumMs / stats.requests) : 0;
+    }
 
     // Serialize the JSON document into a string (using Arduino's String type)
     esp_err_t ret = sendJsonResponse(req, doc);
 
     doc.clear();
 
-    // Free temporary strings from NVS retrieval
-    free(influxURL);
-    free(influxBucket);
-    free(influxOrg);
-    free(influxPrefix);
-
     return ret;
 }
 
@@ -109,6 +120,15 @@ esp_err_t PATCH_update_influx(httpd_req_t *req)
     if (doc["prefix"].is<const char*>()) {
         Config::setInfluxPrefix(doc["prefix"].as<const char*>());
     }
+    if (doc["sampleInterval"].is<uint16_t>() && doc["sampleInterval"].as<uint16_t>() > 0) {
+        Config::setInfluxSampleInterval(doc["sampleInterval"].as<uint16_t>());
+    }
+    if (doc["flushInterval"].is<uint16_t>()) {
+        Config::setInfluxFlushInterval(doc["flushInterval"].as<uint16_t>());
+    }
+    if (doc["batchSize"].is<uint16_t>() && doc["batchSize"].as<uint16_t>() > 0) {
+        Config::setInfluxBatchSize(doc["batchSize"].as<uint16_t>());
+    }
 
     doc.clear();
 
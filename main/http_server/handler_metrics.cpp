@@ -0,0 +1,307 @@
+#include <stdarg.h>
+#include <stdio.h>
+
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "global_state.h"
+#include "http_utils.h"
+#include "handler_metrics.h"
+#include "http_websocket.h"
+#include "nvs_config.h"
+#include "tasks/asic_result_task.h"
+
+static const char *TAG = "http_metrics";
+
+uint64_t getDuplicateHWNonces();
+uint32_t getDuplicateHWNoncesChip(int asic_nr);
+
+#define PREFIX "nerdqaxe_"
+
+// OpenMetrics text written line by line into the chunk writer, nothing is
+// buffered beyond the writer's chunk. Values are read from the modules'
+// getters, no JsonDocument and no module lock is held while sending.
+class MetricsWriter {
+  protected:
+    HttpdChunkHeapWriter &m_w;
+    char m_line[192];
+
+    void line(int len)
+    {
+        // a cut line would lose its newline and break the whole scrape, skip it instead
+        if ((size_t) len >= sizeof(m_line)) {
+            ESP_LOGW(TAG, "metrics line too long (%d bytes), skipped: %.40s", len, m_line);
+            return;
+        }
+        if (len > 0) {
+            m_w.write((const uint8_t *) m_line, (size_t) len);
+        }
+    }
+
+  public:
+    explicit MetricsWriter(HttpdChunkHeapWriter &w) : m_w(w) {}
+
+    void family(const char *name, const char *type, const char *help)
+    {
+        line(snprintf(m_line, sizeof(m_line), "# TYPE " PREFIX "%s %s\n# HELP " PREFIX "%s %s\n", name, type, name, help));
+    }
+
+    void gauge(const char *name, const char *labels, double value)
+    {
+        line(snprintf(m_line, sizeof(m_line), PREFIX "%s%s%s%s %.3f\n", name, labels ? "{" : "", labels ? labels : "",
+                      labels ? "}" : "", value));
+    }
+
+    // counter samples carry the _total suffix, the family doesn't
+    void counter(const char *name, const char *labels, uint64_t value)
+    {
+        line(snprintf(m_line, sizeof(m_line), PREFIX "%s_total%s%s%s %llu\n", name, labels ? "{" : "", labels ? labels : "",
+                      labels ? "}" : "", value));
+    }
+
+    void raw(const char *fmt, ...) __attribute__((format(printf, 2, 3)))
+    {
+        va_list args;
+        va_start(args, fmt);
+        line(vsnprintf(m_line, sizeof(m_line), fmt, args));
+        va_end(args);
+    }
+};
+
+static void write_hashrate(MetricsWriter &m, Board *board, bool shutdown)
+{
+    History *history = SYSTEM_MODULE.getHistory();
+    char labels[32];
+
+    m.family("hashrate_ghs", "gauge", "Hashrate in GH/s");
+    m.gauge("hashrate_ghs", "window=\"current\"", shutdown ? 0.0 : SYSTEM_MODULE.getCurrentHashrate());
+    m.gauge("hashrate_ghs", "window=\"1m\"", shutdown ? 0.0 : history->getCurrentHashrate1m());
+    m.gauge("hashrate_ghs", "window=\"10m\"", shutdown ? 0.0 : history->getCurrentHashrate10m());
+    m.gauge("hashrate_ghs", "window=\"1h\"", shutdown ? 0.0 : history->getCurrentHashrate1h());
+    m.gauge("hashrate_ghs", "window=\"1d\"", shutdown ? 0.0 : history->getCurrentHashrate1d());
+
+    int asics = board->getAsicCount();
+
+    m.family("asic_hashrate_ghs", "gauge", "Measured hashrate per ASIC in GH/s");
+    for (int i = 0; i < asics; i++) {
+        snprintf(labels, sizeof(labels), "asic=\"%d\"", i);
+        m.gauge("asic_hashrate_ghs", labels, HASHRATE_MONITOR.getChipHashrate(i));
+    }
+
+    m.family("asic_duplicate_nonces", "counter", "Duplicate nonces per ASIC");
+    for (int i = 0; i < asics; i++) {
+        snprintf(labels, sizeof(labels), "asic=\"%d\"", i);
+        m.counter("asic_duplicate_nonces", labels, getDuplicateHWNoncesChip(i));
+    }
+
+    m.family("asic_nonces", "counter", "Nonces per ASIC");
+    for (int i = 0; i < asics; i++) {
+        asic_chip_stats_t stats;
+        asic_result_get_chip_stats(i, &stats);
+        snprintf(labels, sizeof(labels), "asic=\"%d\"", i);
+        m.counter("asic_nonces", labels, stats.nonces);
+    }
+
+    m.family("asic_hw_errors", "counter", "Nonces below the ASIC difficulty per ASIC");
+    for (int i = 0; i < asics; i++) {
+        asic_chip_stats_t stats;
+        asic_result_get_chip_stats(i, &stats);
+        snprintf(labels, sizeof(labels), "asic=\"%d\"", i);
+        m.counter("asic_hw_errors", labels, stats.hwErrors);
+    }
+
+    // the health window, hashrate from the counter or the nonces
+    chip_health_t chips[CHIP_HEALTH_MAX_CHIPS];
+    int count = POWER_MANAGEMENT_MODULE.getChipHealth().get(chips, CHIP_HEALTH_MAX_CHIPS);
+
+    m.family("asic_window_hashrate_ghs", "gauge", "Hashrate per ASIC over the health window in GH/s");
+    for (int i = 0; i < count; i++) {
+        snprintf(labels, sizeof(labels), "asic=\"%d\"", i);
+        m.gauge("asic_window_hashrate_ghs", labels, chips[i].hashrate);
+    }
+
+    m.family("asic_expected_hashrate_ghs", "gauge", "Nominal hashrate per ASIC at the frequency in GH/s");
+    for (int i = 0; i < count; i++) {
+        snprintf(labels, sizeof(labels), "asic=\"%d\"", i);
+        m.gauge("asic_expected_hashrate_ghs", labels, chips[i].expected);
+    }
+
+    m.family("asic_deviation", "gauge", "Hashrate per ASIC versus the median of the board in robust standard deviations");
+    for (int i = 0; i < count; i++) {
+        snprintf(labels, sizeof(labels), "asic=\"%d\"", i);
+        m.gauge("asic_deviation", labels, chips[i].deviation);
+    }
+
+    m.family("asic_weak", "gauge", "ASIC hashing below its peers or its nominal hashrate");
+    for (int i = 0; i < count; i++) {
+        snprintf(labels, sizeof(labels), "asic=\"%d\"", i);
+        m.gauge("asic_weak", labels, chips[i].weak ? 1 : 0);
+    }
+
+    m.family("asic_temperature_celsius", "gauge", "Temperature per ASIC");
+    for (int i = 0; i < asics; i++) {
+        snprintf(labels, sizeof(labels), "asic=\"%d\"", i);
+        m.gauge("asic_temperature_celsius", labels, board->getChipTemp(i));
+    }
+
+    m.family("asic_frequency_mhz", "gauge", "ASIC frequency");
+    m.gauge("asic_frequency_mhz", nullptr, board->getAsicFrequency());
+}
+
+static void write_power(MetricsWriter &m, Board *board)
+{
+    char labels[32];
+
+    m.family("temperature_celsius", "gauge", "Board temperatures");
+    m.gauge("temperature_celsius", "sensor=\"asic_max\"", POWER_MANAGEMENT_MODULE.getChipTempMax());
+    m.gauge("temperature_celsius", "sensor=\"vr\"", POWER_MANAGEMENT_MODULE.getVRTemp());
+    m.gauge("temperature_celsius", "sensor=\"vr_internal\"", POWER_MANAGEMENT_MODULE.getVRTempInt());
+
+    m.family("power_watts", "gauge", "Input power");
+    m.gauge("power_watts", nullptr, POWER_MANAGEMENT_MODULE.getPower());
+    m.family("input_voltage_volts", "gauge", "Input voltage");
+    m.gauge("input_voltage_volts", nullptr, POWER_MANAGEMENT_MODULE.getVoltage() / 1000.0);
+    m.family("input_current_amperes", "gauge", "Input current");
+    m.gauge("input_current_amperes", nullptr, POWER_MANAGEMENT_MODULE.getCurrent() / 1000.0);
+    m.family("core_voltage_volts", "gauge", "Measured ASIC core voltage");
+    m.gauge("core_voltage_volts", nullptr, board->getVout());
+
+    m.family("fan_rpm", "gauge", "Fan speed");
+    for (int ch = 0; ch < board->getNumFans(); ch++) {
+        snprintf(labels, sizeof(labels), "fan=\"%d\"", ch);
+        m.gauge("fan_rpm", labels, POWER_MANAGEMENT_MODULE.getFanRPM(ch));
+    }
+    m.family("fan_duty_percent", "gauge", "Fan duty cycle");
+    for (int ch = 0; ch < board->getNumFans(); ch++) {
+        snprintf(labels, sizeof(labels), "fan=\"%d\"", ch);
+        m.gauge("fan_duty_percent", labels, POWER_MANAGEMENT_MODULE.getFanPerc(ch));
+    }
+}
+
+static void write_stratum(MetricsWriter &m)
+{
+    static const uint32_t limits[SHARE_LATENCY_BUCKETS] = SHARE_LATENCY_LIMITS_MS;
+    char labels[48];
+    int pools = STRATUM_MANAGER->isDualPool() ? 2 : 1;
+
+    m.family("shares_accepted", "counter", "Accepted shares per pool");
+    for (int i = 0; i < pools; i++) {
+        snprintf(labels, sizeof(labels), "pool=\"%d\"", i);
+        m.counter("shares_accepted", labels, STRATUM_MANAGER->getSharesAccepted(i));
+    }
+    m.family("shares_rejected", "counter", "Rejected shares per pool");
+    for (int i = 0; i < pools; i++) {
+        snprintf(labels, sizeof(labels), "pool=\"%d\"", i);
+        m.counter("shares_rejected", labels, STRATUM_MANAGER->getSharesRejected(i));
+    }
+
+    m.family("best_difficulty", "gauge", "Best share difficulty ever");
+    m.gauge("best_difficulty", nullptr, (double) STRATUM_MANAGER->getBestDiff());
+    m.family("duplicate_nonces", "counter", "Duplicate nonces of all ASICs");
+    m.counter("duplicate_nonces", nullptr, getDuplicateHWNonces());
+
+    // the submitter counts per bucket, OpenMetrics buckets are cumulative
+    m.family("share_submit_latency_seconds", "histogram", "Time from socket write to pool response");
+    for (int i = 0; i < 2; i++) {
+        share_submit_stats_t stats;
+        if (!STRATUM_MANAGER->getSubmitStats(i, &stats)) {
+            continue;
+        }
+        uint64_t count = 0;
+        for (int b = 0; b < SHARE_LATENCY_BUCKETS; b++) {
+            count += stats.latency[b];
+            if (limits[b] == UINT32_MAX) {
+                snprintf(labels, sizeof(labels), "pool=\"%d\",le=\"+Inf\"", i);
+            } else {
+                snprintf(labels, sizeof(labels), "pool=\"%d\",le=\"%.3f\"", i, limits[b] / 1000.0);
+            }
+            m.raw(PREFIX "share_submit_latency_seconds_bucket{%s} %llu\n", labels, count);
+        }
+        m.raw(PREFIX "share_submit_latency_seconds_count{pool=\"%d\"} %llu\n", i, count);
+        m.raw(PREFIX "share_submit_latency_seconds_sum{pool=\"%d\"} %.3f\n", i, stats.latencySumUs / 1e6);
+    }
+}
+
+static void write_system(MetricsWriter &m)
+{
+    m.family("uptime_seconds", "gauge", "Time since boot");
+    m.gauge("uptime_seconds", nullptr, (esp_timer_get_time() - SYSTEM_MODULE.getStartTime()) / 1000000.0);
+
+    m.family("heap_free_bytes", "gauge", "Free heap");
+    m.gauge("heap_free_bytes", "type=\"psram\"", heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+    m.gauge("heap_free_bytes", "type=\"internal\"", heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    m.family("heap_min_free_bytes", "gauge", "Lowest free heap since boot");
+    m.gauge("heap_min_free_bytes", "type=\"psram\"", heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+    m.gauge("heap_min_free_bytes", "type=\"internal\"", heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    m.family("heap_largest_free_block_bytes", "gauge", "Largest allocatable block");
+    m.gauge("heap_largest_free_block_bytes", "type=\"internal\"", heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+
+    m.family("log_dropped_lines", "counter", "Log lines the websocket clients lost to a full ring");
+    m.counter("log_dropped_lines", nullptr, websocket_get_dropped_lines());
+
+    nvs_config_stats_t nvs;
+    Config::getStats(&nvs);
+    m.family("nvs_ops", "counter", "Flash accesses of the config store");
+    m.counter("nvs_ops", "op=\"read\"", nvs.nvsReads);
+    m.counter("nvs_ops", "op=\"write\"", nvs.nvsWrites);
+    m.counter("nvs_ops", "op=\"commit\"", nvs.nvsCommits);
+    m.family("config_reads", "counter", "Config reads served from RAM");
+    m.counter("config_reads", "result=\"hit\"", nvs.cacheHits);
+    m.counter("config_reads", "result=\"default\"", nvs.cacheDefaults);
+    m.family("config_sets_unchanged", "counter", "Config sets skipped because the value didn't change");
+    m.counter("config_sets_unchanged", nullptr, nvs.setsUnchanged);
+
+    m.family("tasks", "gauge", "Number of FreeRTOS tasks");
+    m.gauge("tasks", nullptr, uxTaskGetNumberOfTasks());
+
+#if configUSE_TRACE_FACILITY
+    // only with CONFIG_FREERTOS_USE_TRACE_FACILITY
+    const UBaseType_t max_tasks = 40;
+    TaskStatus_t *tasks = (TaskStatus_t *) MALLOC(max_tasks * sizeof(TaskStatus_t));
+    if (tasks) {
+        UBaseType_t count = uxTaskGetSystemState(tasks, max_tasks, NULL);
+        m.family("task_stack_free_bytes", "gauge", "Lowest free stack per task");
+        for (UBaseType_t i = 0; i < count; i++) {
+            m.raw(PREFIX "task_stack_free_bytes{task=\"%s\"} %lu\n", tasks[i].pcTaskName,
+                  (unsigned long) tasks[i].usStackHighWaterMark * sizeof(StackType_t));
+        }
+        FREE(tasks);
+    }
+#endif
+}
+
+esp_err_t GET_metrics(httpd_req_t *req)
+{
+    ConGuard g(http_server, req);
+
+    if (is_network_allowed(req) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Unauthorized");
+    }
+
+    httpd_resp_set_type(req, "application/openmetrics-text; version=1.0.0; charset=utf-8");
+
+    HttpdChunkHeapWriter w(req, 2048);
+    if (w.m_failed) {
+        ESP_LOGE(TAG, "out of memory");
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+
+    Board *board = SYSTEM_MODULE.getBoard();
+    MetricsWriter m(w);
+
+    m.family("shutdown", "gauge", "1 while the miner is shut down");
+    bool shutdown = POWER_MANAGEMENT_MODULE.isShutdown();
+    m.gauge("shutdown", nullptr, shutdown ? 1 : 0);
+
+    write_hashrate(m, board, shutdown);
+    write_power(m, board);
+    write_stratum(m);
+    write_system(m);
+
+    m.raw("# EOF\n");
+    return w.finish();
+}
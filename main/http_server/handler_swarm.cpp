@@ -61,8 +61,6 @@ esp_err_t GET_swarm(httpd_req_t *req)
         return ESP_FAIL;
     }
 
-    char *swarm_config = Config::getSwarmConfig();
-    httpd_resp_sendstr(req, swarm_config);
-    free(swarm_config);
+    httpd_resp_sendstr(req, Config::getSwarmConfigShared());
     return ESP_OK;
 }
\ No newline at end of file
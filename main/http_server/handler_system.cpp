@@ -14,12 +14,15 @@
 
 #include "ping_task.h"
 #include "tasks/can_master_task.h"
+#include "tasks/create_jobs_task.h"
+#include "tasks/asic_result_task.h"
 
 static const char *TAG = "http_system";
 
 #define VR_FREQUENCY_ENABLED
 
 uint64_t getDuplicateHWNonces();
+uint32_t getDuplicateHWNoncesChip(int asic_nr);
 
 /* Simple handler for getting system handler */
 esp_err_t GET_system_info(httpd_req_t *req)
@@ -87,12 +90,12 @@ esp_err_t GET_system_info(httpd_req_t *req)
     bool shutdown = POWER_MANAGEMENT_MODULE.isShutdown();
 
     // Get configuration strings from NVS
-    char *ssid               = Config::getWifiSSID();
-    char *hostname           = Config::getHostname();
-    char *stratumURL         = Config::getStratumURL();
-    char *stratumUser        = Config::getStratumUser();
-    char *fallbackStratumURL = Config::getStratumFallbackURL();
-    char *fallbackStratumUser= Config::getStratumFallbackUser();
+    const char *ssid               = Config::getWifiSSIDShared();
+    const char *hostname           = Config::getHostnameShared();
+    const char *stratumURL         = Config::getStratumURLShared();
+    const char *stratumUser        = Config::getStratumUserShared();
+    const char *fallbackStratumURL = Config::getStratumFallbackURLShared();
+    const char *fallbackStratumUser= Config::getStratumFallbackUserShared();
 
     // static
     doc["asicCount"]          = board->getAsicCount();
@@ -143,6 +146,55 @@ esp_err_t GET_system_info(httpd_req_t *req)
         can_obj["fleetPower"] = POWER_MANAGEMENT_MODULE.getPower() + can_master_get_slave_fleet_power();
     }
     doc["duplicateHWNonces"]  = getDuplicateHWNonces();
+    doc["asicRxCrcErrors"]    = (board->getAsics()) ? board->getAsics()->getRxCrcErrors() : 0;
+
+    // serial result framing, resyncs mean lost or corrupted bytes on the asic uart
+    if (board->getAsics()) {
+        const asic_rx_stats_t *rx = board->getAsics()->getRxStats();
+
+        JsonObject rx_obj = doc["asicRx"].to<JsonObject>();
+        rx_obj["frames"]       = rx->frames;
+        rx_obj["crcErrors"]    = rx->crcErrors;
+        rx_obj["resyncs"]      = rx->resyncs;
+        rx_obj["droppedBytes"] = rx->droppedBytes;
+    }
+
+    // job pool, allocs/frees grow with every job but heapAllocs has to stay constant
+    {
+        bm_job_pool_stats_t stats;
+        bmJobPool.getStats(&stats);
+
+        JsonObject pool_obj = doc["jobPool"].to<JsonObject>();
+        pool_obj["allocs"]     = stats.allocs;
+        pool_obj["refs"]       = stats.refs;
+        pool_obj["frees"]      = stats.frees;
+        pool_obj["failures"]   = stats.failures;
+        pool_obj["inUse"]      = stats.inUse;
+        pool_obj["capacity"]   = stats.capacity;
+        pool_obj["heapAllocs"] = stats.heapAllocs;
+        pool_obj["heapBytes"]  = stats.heapBytes;
+    }
+
+    // mining pipeline timings
+    {
+        create_jobs_stats_t jobs;
+        create_jobs_get_stats(&jobs);
+
+        asic_result_stats_t results;
+        asic_result_get_stats(&results);
+
+        JsonObject pipeline_obj = doc["pipeline"].to<JsonObject>();
+        pipeline_obj["jobs"]              = jobs.jobs;
+        pipeline_obj["jobBuildAvgUs"]     = jobs.jobs ? (uint32_t) (jobs.buildTimeUs / jobs.jobs) : 0;
+        pipeline_obj["jobBuildMaxUs"]     = jobs.buildTimeMaxUs;
+        pipeline_obj["newWork"]           = jobs.newWork;
+        pipeline_obj["notifyToWorkUs"]    = jobs.notifyToWorkUs;
+        pipeline_obj["notifyToWorkMaxUs"] = jobs.notifyToWorkMaxUs;
+        pipeline_obj["nonces"]            = results.nonces;
+        pipeline_obj["nonceAvgUs"]        = results.nonces ? (uint32_t) (results.processTimeUs / results.nonces) : 0;
+        pipeline_obj["nonceMaxUs"]        = results.processTimeMaxUs;
+        pipeline_obj["hwErrors"]          = results.hwErrors;
+    }
 
     JsonObject stratum_obj = doc["stratum"].to<JsonObject>();
 
@@ -195,6 +247,14 @@ esp_err_t GET_system_info(httpd_req_t *req)
         }
     }
 
+    // duplicate nonces per chip
+    {
+        JsonArray arr = doc["duplicateHWNoncesPerChip"].to<JsonArray>();
+        for (int i=0;i<board->getAsicCount();i++) {
+            arr.add(getDuplicateHWNoncesChip(i));
+        }
+    }
+
     // If history was requested, add the history data as a nested object
     if (!shutdown && history_requested) {
         uint64_t span = history_span_ms;
@@ -247,14 +307,8 @@ esp_err_t GET_system_info(httpd_req_t *req)
     doc["fallbackStratumTLS"] = Config::isStratumFallbackTLS();
     doc["stratumProtocol"]    = Config::getStratumProtocol();
     doc["fallbackStratumProtocol"] = Config::getFallbackStratumProtocol();
-    {
-        char *sv2_auth = Config::getSV2AuthorityPubkey();
-        doc["sv2AuthorityPubkey"] = sv2_auth ? sv2_auth : "";
-        safe_free(sv2_auth);
-        char *fb_sv2_auth = Config::getFallbackSV2AuthorityPubkey();
-        doc["fallbackSv2AuthorityPubkey"] = fb_sv2_auth ? fb_sv2_auth : "";
-        safe_free(fb_sv2_auth);
-    }
+    doc["sv2AuthorityPubkey"] = Config::getSV2AuthorityPubkeyShared();
+    doc["fallbackSv2AuthorityPubkey"] = Config::getFallbackSV2AuthorityPubkeyShared();
     doc["sv2ChannelType"]     = Config::getSV2ChannelType();
     doc["fallbackSv2ChannelType"] = Config::getFallbackSV2ChannelType();
     doc["voltage"]            = POWER_MANAGEMENT_MODULE.getVoltage();
@@ -269,6 +323,7 @@ esp_err_t GET_system_info(httpd_req_t *req)
     doc["invertfanpolarity"]  = board->isInvertFanPolarityEnabled() ? 1 : 0;
     doc["autofanspeed"]       = Config::getTempControlMode();
     doc["stratum_keep"]       = Config::isStratumKeepaliveEnabled() ? 1 : 0;
+    doc["stratum_hot"]        = Config::isStratumHotStandbyEnabled() ? 1 : 0;
 #ifdef VR_FREQUENCY_ENABLED
     doc["vrFrequency"]        = board->getVrFrequency();
     doc["defaultVrFrequency"] = board->getDefaultVrFrequency();
@@ -293,14 +348,6 @@ esp_err_t GET_system_info(httpd_req_t *req)
     esp_err_t ret = sendJsonResponse(req, doc);
     doc.clear();
 
-    // Free temporary strings
-    free(ssid);
-    free(hostname);
-    free(stratumURL);
-    free(stratumUser);
-    free(fallbackStratumURL);
-    free(fallbackStratumUser);
-
     return ret;
 }
 
@@ -389,6 +436,10 @@ esp_err_t PATCH_update_settings(httpd_req_t *req)
         Config::setStratumKeepaliveEnabled(value);
         ESP_LOGI("system", "stratum_keep updated via WebUI: %s", value ? "ENABLED" : "DISABLED");
     }
+    if (doc["stratum_hot"].is<bool>() || doc["stratum_hot"].is<int>()) {
+        bool value = doc["stratum_hot"].as<int>() != 0;
+        Config::setStratumHotStandbyEnabled(value);
+    }
     if (doc["canMaster"].is<bool>() || doc["canMaster"].is<int>()) {
         bool value = doc["canMaster"].as<int>() != 0;
         Config::setCanEnabled(value);
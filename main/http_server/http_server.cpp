@@ -19,6 +19,9 @@
 #include "v2/handler_v2_settings.h"
 #include "v2/handler_v2_identify.h"
 #include "v2/handler_v2_system.h"
+#include "v2/handler_v2_history.h"
+#include "v2/handler_v2_autotune.h"
+#include "v2/handler_v2_asics.h"
 #include "handler_system.h"
 #include "handler_wifi_scan.h"
 #include "handler_ota.h"
@@ -27,6 +30,7 @@
 #include "handler_file.h"
 #include "handler_alert.h"
 #include "handler_otp.h"
+#include "handler_metrics.h"
 #include "macros.h"
 
 #pragma GCC diagnostic error "-Wall"
@@ -39,7 +43,6 @@ static const char *TAG = "http_server";
 
 httpd_handle_t http_server = NULL;
 
-extern int websocket_fd;
 
 /* Function for stopping the webserver */
 /*
@@ -107,11 +110,8 @@ static esp_err_t http_404_error_handler(httpd_req_t *req, httpd_err_code_t err)
 
 static void http_close_cb(void* hd, int sockfd)
 {
-    // If our websocket socket is being closed, reset logging
-    if (sockfd == websocket_fd) {
-        ESP_LOGI(TAG, "resetting websocket %d", sockfd);
-        websocket_reset();
-    }
+    // stop forwarding logs if it was a websocket
+    websocket_close(sockfd);
     ESP_LOGD(TAG, "http_close_cb: %d", sockfd);
     if (sockfd >= 0) {
         (void)close(sockfd);
@@ -150,7 +150,7 @@ esp_err_t start_rest_server(void * pvParameters)
 
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.uri_match_fn = httpd_uri_match_wildcard;
-    config.max_uri_handlers = 50;
+    config.max_uri_handlers = 60;
     config.lru_purge_enable = true;
     config.max_open_sockets = 10;
     config.stack_size = 12288;
@@ -225,6 +225,11 @@ esp_err_t start_rest_server(void * pvParameters)
         .uri = "/api/v2/can/nodes/*", .method = HTTP_DELETE, .handler = DELETE_can_slave, .user_ctx = rest_context};
     httpd_register_uri_handler(http_server, &can_slave_delete_uri);
 
+    // the exact GET /api/v2/can/nodes above is matched first
+    httpd_uri_t can_slave_history_uri = {
+        .uri = "/api/v2/can/nodes/*", .method = HTTP_GET, .handler = GET_can_slave_history, .user_ctx = rest_context};
+    httpd_register_uri_handler(http_server, &can_slave_history_uri);
+
     httpd_uri_t can_slave_wildcard_options_uri = {
         .uri = "/api/v2/can/nodes/*", .method = HTTP_OPTIONS, .handler = handle_options_request, .user_ctx = NULL};
     httpd_register_uri_handler(http_server, &can_slave_wildcard_options_uri);
@@ -237,6 +242,26 @@ esp_err_t start_rest_server(void * pvParameters)
         .uri = "/api/v2/dashboard", .method = HTTP_OPTIONS, .handler = handle_options_request, .user_ctx = NULL};
     httpd_register_uri_handler(http_server, &v2_dashboard_options_uri);
 
+    httpd_uri_t v2_history_get_uri = {
+        .uri = "/api/v2/history", .method = HTTP_GET, .handler = GET_V2_history, .user_ctx = rest_context};
+    httpd_register_uri_handler(http_server, &v2_history_get_uri);
+
+    httpd_uri_t v2_history_options_uri = {
+        .uri = "/api/v2/history", .method = HTTP_OPTIONS, .handler = handle_options_request, .user_ctx = NULL};
+    httpd_register_uri_handler(http_server, &v2_history_options_uri);
+
+    httpd_uri_t v2_history_tiers_get_uri = {
+        .uri = "/api/v2/history/tiers", .method = HTTP_GET, .handler = GET_V2_history_tiers, .user_ctx = rest_context};
+    httpd_register_uri_handler(http_server, &v2_history_tiers_get_uri);
+
+    httpd_uri_t v2_history_tiers_options_uri = {
+        .uri = "/api/v2/history/tiers", .method = HTTP_OPTIONS, .handler = handle_options_request, .user_ctx = NULL};
+    httpd_register_uri_handler(http_server, &v2_history_tiers_options_uri);
+
+    httpd_uri_t metrics_get_uri = {
+        .uri = "/metrics", .method = HTTP_GET, .handler = GET_metrics, .user_ctx = rest_context};
+    httpd_register_uri_handler(http_server, &metrics_get_uri);
+
     httpd_uri_t v2_settings_get = {
         .uri = "/api/v2/settings", .method = HTTP_GET, .handler = GET_V2_settings, .user_ctx = rest_context};
     httpd_register_uri_handler(http_server, &v2_settings_get);
@@ -247,6 +272,23 @@ esp_err_t start_rest_server(void * pvParameters)
         .uri = "/api/v2/settings", .method = HTTP_OPTIONS, .handler = handle_options_request, .user_ctx = NULL};
     httpd_register_uri_handler(http_server, &v2_settings_options);
 
+    httpd_uri_t v2_autotune_get = {
+        .uri = "/api/v2/autotune", .method = HTTP_GET, .handler = GET_V2_autotune, .user_ctx = rest_context};
+    httpd_register_uri_handler(http_server, &v2_autotune_get);
+    httpd_uri_t v2_autotune_patch = {
+        .uri = "/api/v2/autotune", .method = HTTP_PATCH, .handler = PATCH_V2_autotune, .user_ctx = rest_context};
+    httpd_register_uri_handler(http_server, &v2_autotune_patch);
+    httpd_uri_t v2_autotune_options = {
+        .uri = "/api/v2/autotune", .method = HTTP_OPTIONS, .handler = handle_options_request, .user_ctx = NULL};
+    httpd_register_uri_handler(http_server, &v2_autotune_options);
+
+    httpd_uri_t v2_asics_get = {
+        .uri = "/api/v2/asics", .method = HTTP_GET, .handler = GET_V2_asics, .user_ctx = rest_context};
+    httpd_register_uri_handler(http_server, &v2_asics_get);
+    httpd_uri_t v2_asics_options = {
+        .uri = "/api/v2/asics", .method = HTTP_OPTIONS, .handler = handle_options_request, .user_ctx = NULL};
+    httpd_register_uri_handler(http_server, &v2_asics_options);
+
     httpd_uri_t v2_identify_get = {
         .uri = "/api/v2/identify", .method = HTTP_GET, .handler = GET_V2_identify, .user_ctx = rest_context};
     httpd_register_uri_handler(http_server, &v2_identify_get);
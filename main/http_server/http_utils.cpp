@@ -69,88 +69,6 @@ static bool rateLimit() {
 
 
 
-struct HttpdChunkHeapWriter {
-    httpd_req_t* m_req = nullptr;
-    bool m_failed = false;
-
-    uint8_t* m_buf = nullptr;
-    size_t m_cap = 0;
-    size_t m_pos = 0;
-
-    explicit HttpdChunkHeapWriter(httpd_req_t* req, size_t capacity)
-        : m_req(req), m_cap(capacity) {
-        m_buf = static_cast<uint8_t*>(MALLOC(m_cap));
-        if (!m_buf) {
-            m_failed = true;
-            m_cap = 0;
-        }
-    }
-
-    ~HttpdChunkHeapWriter() {
-        if (m_buf) {
-            FREE(m_buf);
-            m_buf = nullptr;
-        }
-    }
-
-    size_t write(uint8_t c) {
-        if (m_failed) return 0;
-        if (m_pos >= m_cap) {
-            flush();
-            if (m_failed) return 0;
-        }
-        m_buf[m_pos++] = c;
-        return 1;
-    }
-
-    size_t write(const uint8_t* data, size_t len) {
-        if (m_failed) return 0;
-
-        size_t written = 0;
-        while (len > 0 && !m_failed) {
-            const size_t space = m_cap - m_pos;
-            if (space == 0) {
-                flush();
-                continue;
-            }
-
-            const size_t n = (len < space) ? len : space;
-            memcpy(&m_buf[m_pos], data, n);
-            m_pos += n;
-
-            data += n;
-            len -= n;
-            written += n;
-
-            if (m_pos == m_cap) {
-                flush();
-            }
-        }
-        return written;
-    }
-
-    void flush() {
-        if (m_failed || m_pos == 0) return;
-
-        const esp_err_t err = httpd_resp_send_chunk(
-            m_req,
-            reinterpret_cast<const char*>(m_buf),
-            m_pos
-        );
-        if (err != ESP_OK) {
-            m_failed = true;
-            return;
-        }
-        m_pos = 0;
-    }
-
-    esp_err_t finish() {
-        flush();
-        if (m_failed) return ESP_FAIL;
-        return httpd_resp_send_chunk(m_req, nullptr, 0);
-    }
-};
-
 esp_err_t sendJsonResponse(httpd_req_t* req, JsonDocument& doc)
 {
     HttpdChunkHeapWriter w(req, 2048);
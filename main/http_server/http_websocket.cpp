@@ -1,84 +1,106 @@
+#include <pthread.h>
+
 #include "esp_log.h"
 
 #include "http_cors.h"
 #include "http_utils.h"
 #include "http_websocket.h"
+#include "log_ring.h"
 #include "macros.h"
 
 static const char* TAG = "http_websocket";
 
-int websocket_fd = -1;
-
 extern httpd_handle_t http_server;
 
-QueueHandle_t log_queue = NULL;
+// ~300 lines of typical length, a line is cut at a quarter of the ring
+#define LOG_RING_SIZE (32 * 1024)
+#define LOG_RING_SLOTS 512
 
-void websocket_reset(void)
-{
-    // Restore normal logging
-    esp_log_set_vprintf(vprintf);
-    // Invalidate websocket websocket_fd
-    websocket_fd = -1;
-}
+// room in front of the lines for the dropped note
+#define WS_NOTE_SIZE 64
+#define WS_FRAME_SIZE (LOG_RING_SIZE / 4 + WS_NOTE_SIZE)
 
-static int log_to_queue(const char * format, va_list args)
-{
-    va_list args_copy;
-    va_copy(args_copy, args);
+typedef struct {
+    int fd;
+    uint32_t cursor;
+    int stalled; // polls without progress while newer lines exist
+} ws_client_t;
 
-    // Calculate the required buffer size
-    int needed_size = vsnprintf(NULL, 0, format, args_copy) + 1;
-    va_end(args_copy);
+// a line unpublished this long was lost by its writer
+#define WS_MAX_STALLED 10
 
-    // Allocate the buffer dynamically
-    char * log_buffer = (char *) CALLOC(needed_size + 2, sizeof(char));  // +2 for potential \n and \0
-    if (log_buffer == NULL) {
-        return 0;
-    }
+static LogRing log_ring;
+
+static ws_client_t ws_clients[WS_MAX_CLIENTS];
+static int ws_num_clients = 0;
+static pthread_mutex_t ws_clients_lock = PTHREAD_MUTEX_INITIALIZER;
 
-    // Format the string into the allocated buffer
-    va_copy(args_copy, args);
-    vsnprintf(log_buffer, needed_size, format, args_copy);
-    va_end(args_copy);
+// lines the clients didn't get because the ring was overwritten
+static uint32_t ws_dropped_lines = 0;
 
-    // Ensure the log message ends with a newline
-    size_t len = strlen(log_buffer);
-    if (len > 0 && log_buffer[len - 1] != '\n') {
-        log_buffer[len] = '\n';
-        log_buffer[len + 1] = '\0';
-        len++;
+// called from any task that logs, must not block or allocate
+static int log_to_ring(const char * format, va_list args)
+{
+    int len = 0;
+    const char *line = log_ring.vappend(format, args, &len);
+    if (!line) {
+        return vprintf(format, args);
     }
 
     // Print to standard output
-    printf("%s", log_buffer);
-
-	if (xQueueSendToBack(log_queue, (void*)&log_buffer, (TickType_t) 0) != pdPASS) {
-		if (log_buffer != NULL) {
-			FREE(log_buffer);
-		}
-	}
-    return 0;
+    fwrite(line, 1, len, stdout);
+    return len;
 }
 
-static void send_log_to_websocket(char *message)
+static bool websocket_add_client(int fd)
 {
-    httpd_ws_frame_t ws_pkt;
-    memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
-    ws_pkt.payload = (uint8_t *)message;
-    ws_pkt.len = strlen(message);
-    ws_pkt.type = HTTPD_WS_TYPE_TEXT;
+    PThreadGuard g(ws_clients_lock);
 
-    if (http_server != NULL && websocket_fd >= 0) {
-        esp_err_t err = httpd_ws_send_frame_async(http_server, websocket_fd, &ws_pkt);
-        if (err != ESP_OK) {
-            // Websocket is probably dead or socket reused
-            websocket_reset();
+    int free_slot = -1;
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (ws_clients[i].fd == fd) {
+            return true;
+        }
+        if (ws_clients[i].fd < 0 && free_slot < 0) {
+            free_slot = i;
         }
     }
+    if (free_slot < 0) {
+        return false;
+    }
 
-    FREE(message);
+    // new clients start with the next line
+    ws_clients[free_slot].fd = fd;
+    ws_clients[free_slot].cursor = log_ring.head();
+    ws_clients[free_slot].stalled = 0;
+    if (!ws_num_clients++) {
+        esp_log_set_vprintf(log_to_ring);
+    }
+    return true;
 }
 
+void websocket_close(int fd)
+{
+    PThreadGuard g(ws_clients_lock);
+
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        if (ws_clients[i].fd != fd) {
+            continue;
+        }
+        ws_clients[i].fd = -1;
+        if (!--ws_num_clients) {
+            // Restore normal logging
+            esp_log_set_vprintf(vprintf);
+        }
+        ESP_LOGI(TAG, "log client %d closed", fd);
+        return;
+    }
+}
+
+uint32_t websocket_get_dropped_lines()
+{
+    return __atomic_load_n(&ws_dropped_lines, __ATOMIC_RELAXED);
+}
 
 /*
  * This handler echos back the received ws data
@@ -91,9 +113,12 @@ esp_err_t echo_handler(httpd_req_t *req)
     }
 
     if (req->method == HTTP_GET) {
-        ESP_LOGI(TAG, "Handshake done, the new connection was opened");
-        websocket_fd = httpd_req_to_sockfd(req);
-        esp_log_set_vprintf(log_to_queue);
+        int fd = httpd_req_to_sockfd(req);
+        if (!websocket_add_client(fd)) {
+            ESP_LOGW(TAG, "too many log clients, not forwarding to %d", fd);
+            return ESP_OK;
+        }
+        ESP_LOGI(TAG, "Handshake done, log client %d opened", fd);
         return ESP_OK;
     }
 
@@ -108,46 +133,107 @@ esp_err_t echo_handler(httpd_req_t *req)
     }
 
     if (ws_pkt.type == HTTPD_WS_TYPE_CLOSE) {
-        ESP_LOGI(TAG, "WebSocket closed, disabling log forwarding");
-        websocket_reset();
+        websocket_close(httpd_req_to_sockfd(req));
     }
 
     // We don't care about payload here
     return ESP_OK;
 }
 
+// sends everything the client hasn't got yet, several lines per frame
+static void websocket_send_client(int slot, char *frame)
+{
+    int fd;
+    uint32_t cursor;
+    {
+        PThreadGuard g(ws_clients_lock);
+        fd = ws_clients[slot].fd;
+        cursor = ws_clients[slot].cursor;
+    }
+    if (fd < 0) {
+        return;
+    }
+    uint32_t first = cursor;
+
+    while (true) {
+        uint32_t dropped = 0;
+        size_t len = log_ring.read(&cursor, frame + WS_NOTE_SIZE, WS_FRAME_SIZE - WS_NOTE_SIZE, &dropped);
+        if (!len && !dropped) {
+            break;
+        }
+
+        char *payload = frame + WS_NOTE_SIZE;
+        if (dropped) {
+            char note[WS_NOTE_SIZE];
+            int n = snprintf(note, sizeof(note), "... %lu lines dropped ...\n", (unsigned long) dropped);
+            payload -= n;
+            memcpy(payload, note, n);
+            len += n;
+            __atomic_fetch_add(&ws_dropped_lines, dropped, __ATOMIC_RELAXED);
+        }
+
+        httpd_ws_frame_t ws_pkt;
+        memset(&ws_pkt, 0, sizeof(httpd_ws_frame_t));
+        ws_pkt.payload = (uint8_t *) payload;
+        ws_pkt.len = len;
+        ws_pkt.type = HTTPD_WS_TYPE_TEXT;
+
+        if (!http_server || httpd_ws_send_frame_async(http_server, fd, &ws_pkt) != ESP_OK) {
+            // Websocket is probably dead or socket reused
+            websocket_close(fd);
+            return;
+        }
+    }
+
+    PThreadGuard g(ws_clients_lock);
+    if (ws_clients[slot].fd != fd) {
+        return;
+    }
+    ws_clients[slot].stalled = (cursor == first && cursor != log_ring.head()) ? ws_clients[slot].stalled + 1 : 0;
+    if (ws_clients[slot].stalled >= WS_MAX_STALLED) {
+        uint32_t dropped = 0;
+        log_ring.skip(&cursor, &dropped);
+        __atomic_fetch_add(&ws_dropped_lines, dropped, __ATOMIC_RELAXED);
+        ws_clients[slot].stalled = 0;
+    }
+    ws_clients[slot].cursor = cursor;
+}
 
 void websocket_log_handler(void* param)
 {
+    char *frame = (char *) MALLOC(WS_FRAME_SIZE);
+    if (!frame) {
+        ESP_LOGE(TAG, "no memory for the log frame buffer");
+        vTaskDelete(NULL);
+        return;
+    }
+
     while (true)
     {
-        char *message = NULL;
-
-        if (xQueueReceive(log_queue, &message, (TickType_t) portMAX_DELAY) != pdPASS) {
-            // message is either NULL or undefined, but we set it above
-            vTaskDelay(pdMS_TO_TICKS(10));
+        // polling batches the lines, the loggers don't have to wake us
+        if (!ws_num_clients) {
+            vTaskDelay(pdMS_TO_TICKS(500));
             continue;
         }
 
-        if (websocket_fd == -1) {
-            // No active websocket, drop message
-            if (message != NULL) {
-                FREE(message);
-            }
-            vTaskDelay(pdMS_TO_TICKS(100));
-            continue;
+        for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+            websocket_send_client(i, frame);
         }
-
-        send_log_to_websocket(message);
+        vTaskDelay(pdMS_TO_TICKS(100));
     }
 }
 
 
 
 void websocket_start() {
-    log_queue = xQueueCreate(MESSAGE_QUEUE_SIZE, sizeof(char*));
+    for (int i = 0; i < WS_MAX_CLIENTS; i++) {
+        ws_clients[i].fd = -1;
+    }
+
+    if (!log_ring.init(LOG_RING_SIZE, LOG_RING_SLOTS)) {
+        ESP_LOGE(TAG, "no memory for the log ring");
+    }
 
     // Start websocket log handler thread
     xTaskCreate(&websocket_log_handler, "websocket_log_handler", 4096, NULL, 2, NULL);
 }
-
@@ -2,8 +2,13 @@
 
 #include "esp_http_server.h"
 
+// log viewers served at the same time
+#define WS_MAX_CLIENTS 4
+
 esp_err_t echo_handler(httpd_req_t *req);
 void websocket_log_handler(void* param);
 
 void websocket_start();
-void websocket_reset();
\ No newline at end of file
+void websocket_close(int fd);
+
+uint32_t websocket_get_dropped_lines();
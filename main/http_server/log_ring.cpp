@@ -0,0 +1,191 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "log_ring.h"
+#include "macros.h"
+
+bool LogRing::init(uint32_t size, uint32_t numSlots)
+{
+    // both are used as masks
+    if ((size & (size - 1)) || (numSlots & (numSlots - 1))) {
+        return false;
+    }
+
+    m_buffer = (char *) MALLOC(size);
+    m_slots = (slot_t *) CALLOC(numSlots, sizeof(slot_t));
+    if (!m_buffer || !m_slots) {
+        FREE(m_buffer);
+        FREE(m_slots);
+        return false;
+    }
+
+    // as if the slots held the lines before index 0
+    for (uint32_t i = 0; i < numSlots; i++) {
+        m_slots[i].seq = 2 * (i - numSlots) + 2;
+    }
+
+    m_size = size;
+    m_numSlots = numSlots;
+    m_maxLine = size / 4;
+    return true;
+}
+
+// a line never wraps, it starts over at the beginning of the buffer instead
+uint32_t LogRing::reserve(uint32_t len)
+{
+    uint32_t pos = __atomic_load_n(&m_bytePos, __ATOMIC_RELAXED);
+    uint32_t start;
+    do {
+        start = pos;
+        uint32_t offset = pos & (m_size - 1);
+        if (offset + len > m_size) {
+            start = pos + (m_size - offset);
+        }
+    } while (!__atomic_compare_exchange_n(&m_bytePos, &pos, start + len, true, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED));
+    return start;
+}
+
+const char *LogRing::vappend(const char *format, va_list args, int *len)
+{
+    if (!m_buffer) {
+        return nullptr;
+    }
+
+    va_list args_copy;
+    va_copy(args_copy, args);
+    int needed = vsnprintf(NULL, 0, format, args_copy);
+    va_end(args_copy);
+    if (needed < 0) {
+        return nullptr;
+    }
+
+    // room for the newline, vsnprintf also writes its terminator there
+    uint32_t n = (uint32_t) needed + 1;
+    if (n > m_maxLine) {
+        n = m_maxLine;
+        __atomic_fetch_add(&m_truncated, 1, __ATOMIC_RELAXED);
+    }
+
+    uint32_t start = reserve(n);
+    char *line = m_buffer + (start & (m_size - 1));
+
+    va_copy(args_copy, args);
+    vsnprintf(line, n, format, args_copy);
+    va_end(args_copy);
+
+    if (n >= 2 && line[n - 2] == '\n') {
+        n--;
+    } else {
+        line[n - 1] = '\n';
+    }
+
+    // claim the slot from the line one round before, a writer that stalled
+    // that long finds it taken and drops its line instead of mixing fields
+    uint32_t index = __atomic_fetch_add(&m_head, 1, __ATOMIC_RELAXED);
+    slot_t *slot = &m_slots[index & (m_numSlots - 1)];
+    uint32_t expected = 2 * (index - m_numSlots) + 2;
+    if (!__atomic_compare_exchange_n(&slot->seq, &expected, 2 * index + 1, false, __ATOMIC_ACQ_REL,
+                                     __ATOMIC_RELAXED)) {
+        __atomic_fetch_add(&m_lost, 1, __ATOMIC_RELAXED);
+        *len = (int) n;
+        return line;
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->start = start;
+
+    // like read(): if newer lines reserved these bytes again while this one
+    // was formatted, the line is published empty and the readers drop it
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    bool overrun = __atomic_load_n(&m_bytePos, __ATOMIC_RELAXED) - start > m_size;
+    slot->len = overrun ? 0 : n;
+
+    // publish, readers check seq before and after copying
+    __atomic_store_n(&slot->seq, 2 * index + 2, __ATOMIC_RELEASE);
+
+    if (overrun) {
+        __atomic_fetch_add(&m_lost, 1, __ATOMIC_RELAXED);
+        return nullptr;
+    }
+    *len = (int) n;
+    return line;
+}
+
+uint32_t LogRing::head()
+{
+    return __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+}
+
+size_t LogRing::read(uint32_t *cursor, char *out, size_t max, uint32_t *dropped)
+{
+    if (!m_buffer) {
+        return 0;
+    }
+
+    uint32_t c = *cursor;
+    size_t total = 0;
+
+    while (true) {
+        uint32_t head = __atomic_load_n(&m_head, __ATOMIC_ACQUIRE);
+        if (c == head) {
+            break;
+        }
+        if (head - c > m_numSlots) {
+            *dropped += head - c - m_numSlots;
+            c = head - m_numSlots;
+        }
+
+        slot_t *slot = &m_slots[c & (m_numSlots - 1)];
+        uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        int32_t diff = (int32_t) (seq - (2 * c + 2));
+
+        if (diff < 0) {
+            // reserved but not published yet, or being rewritten by a newer line
+            if (head - c < m_numSlots) {
+                break;
+            }
+            (*dropped)++;
+            c++;
+            continue;
+        }
+        if (diff > 0) {
+            (*dropped)++;
+            c++;
+            continue;
+        }
+
+        uint32_t start = slot->start;
+        uint32_t len = slot->len;
+        if ((start & (m_size - 1)) + len > m_size) {
+            (*dropped)++;
+            c++;
+            continue;
+        }
+        if (total + len > max) {
+            break;
+        }
+        memcpy(out + total, m_buffer + (start & (m_size - 1)), len);
+
+        // the copy is only good if neither the slot nor the bytes were reused meanwhile
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint32_t bytePos = __atomic_load_n(&m_bytePos, __ATOMIC_RELAXED);
+        if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq || bytePos - start > m_size) {
+            (*dropped)++;
+            c++;
+            continue;
+        }
+
+        total += len;
+        c++;
+    }
+
+    *cursor = c;
+    return total;
+}
+
+void LogRing::skip(uint32_t *cursor, uint32_t *dropped)
+{
+    if (*cursor != head()) {
+        (*cursor)++;
+        (*dropped)++;
+    }
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Preallocated ring of log lines with any number of readers.
+ *
+ * Writers never block and never allocate: a line is formatted straight
+ * into bytes reserved with a CAS on the byte position, then published in
+ * an index slot guarded by a sequence counter (odd while it is written).
+ * The oldest lines are overwritten, readers keep their own cursor and
+ * count the lines they lost. Positions are free running 32 bit counters,
+ * only their differences are used.
+ *
+ * A writer whose bytes were reserved again by newer lines while it
+ * formatted (a whole buffer was written by others) drops its line when it
+ * publishes; the bytes it wrote after that point can still end up in one of
+ * the newer lines. A writer preempted while a whole ring of slots is written
+ * loses its slot, a reader then waits on the unpublished line until it calls
+ * skip(). Both count as lost. Readers never copy out of bounds.
+ */
+class LogRing {
+  protected:
+    typedef struct {
+        uint32_t seq;   // 2 * (index + 1) when published, odd while written
+        uint32_t start; // byte position
+        uint32_t len;
+    } slot_t;
+
+    char *m_buffer = nullptr;
+    slot_t *m_slots = nullptr;
+    uint32_t m_size = 0;     // bytes, power of two
+    uint32_t m_numSlots = 0; // power of two
+    uint32_t m_maxLine = 0;
+
+    uint32_t m_bytePos = 0; // next byte to reserve
+    uint32_t m_head = 0;    // next line index
+
+    uint32_t m_truncated = 0;
+    uint32_t m_lost = 0; // writer stalled for a whole round of slots or bytes
+
+    uint32_t reserve(uint32_t len);
+
+  public:
+    bool init(uint32_t size, uint32_t numSlots);
+
+    // formats one line, a missing newline is added, returns the line or
+    // nullptr if it was lost to newer lines
+    const char *vappend(const char *format, va_list args, int *len);
+
+    // index the next line will get, where a new reader starts
+    uint32_t head();
+
+    // copies whole lines from *cursor on into out, returns the bytes copied
+    size_t read(uint32_t *cursor, char *out, size_t max, uint32_t *dropped);
+
+    // gives up on the line at *cursor if newer ones exist
+    void skip(uint32_t *cursor, uint32_t *dropped);
+
+    uint32_t getTruncated()
+    {
+        return m_truncated;
+    }
+    uint32_t getLost()
+    {
+        return m_lost;
+    }
+};
@@ -0,0 +1,65 @@
+#include "handler_v2_asics.h"
+
+#include "esp_http_server.h"
+#include "esp_log.h"
+
+#include "ArduinoJson.h"
+#include "psram_allocator.h"
+#include "global_state.h"
+#include "http_cors.h"
+#include "http_utils.h"
+
+static const char *TAG = "http_v2_asics";
+
+esp_err_t GET_V2_asics(httpd_req_t *req)
+{
+    ConGuard g(http_server, req);
+
+    if (is_network_allowed(req) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Unauthorized");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    if (set_cors_headers(req) != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    ChipHealth &health = POWER_MANAGEMENT_MODULE.getChipHealth();
+    chip_health_t chips[CHIP_HEALTH_MAX_CHIPS];
+    int count = health.get(chips, CHIP_HEALTH_MAX_CHIPS);
+
+    PSRAMAllocator allocator;
+    JsonDocument doc(&allocator);
+
+    doc["source"] = health.usesCounter() ? "counter" : "nonces";
+    doc["window"] = health.getWindowMs() / 1000;
+
+    JsonArray weak = doc["weak"].to<JsonArray>();
+    JsonArray asics = doc["asics"].to<JsonArray>();
+    for (int i = 0; i < count; i++) {
+        const chip_health_t *chip = &chips[i];
+        if (chip->weak) {
+            weak.add(i);
+        }
+
+        JsonObject obj = asics.add<JsonObject>();
+        obj["hashrate"]      = chip->hashrate;
+        obj["nonceHashrate"] = chip->nonceHashrate;
+        obj["expected"]      = chip->expected;
+        obj["temp"]          = chip->temp;
+        obj["nonces"]        = chip->nonces;
+        obj["hwErrors"]      = chip->hwErrors;
+        obj["hwErrorRate"]   = chip->hwErrorRate;
+        obj["duplicates"]    = chip->duplicates;
+        obj["duplicateRate"] = chip->duplicateRate;
+        obj["deviation"]     = chip->deviation;
+        obj["weak"]          = chip->weak;
+    }
+
+    ESP_LOGD(TAG, "%d asics, weak mask %08lx", count, (unsigned long) health.getWeakMask());
+
+    esp_err_t ret = sendJsonResponse(req, doc);
+    doc.clear();
+    return ret;
+}
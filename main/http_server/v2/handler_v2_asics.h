@@ -0,0 +1,4 @@
+#pragma once
+#include "esp_http_server.h"
+
+esp_err_t GET_V2_asics(httpd_req_t *req);
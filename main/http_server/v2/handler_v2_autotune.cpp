@@ -0,0 +1,150 @@
+#include "handler_v2_autotune.h"
+
+#include <string.h>
+#include "esp_http_server.h"
+#include "esp_log.h"
+
+#include "ArduinoJson.h"
+#include "psram_allocator.h"
+#include "global_state.h"
+#include "nvs_config.h"
+#include "http_cors.h"
+#include "http_utils.h"
+#include "macros.h"
+
+static const char *TAG = "http_v2_autotune";
+
+static void step_to_json(JsonObject obj, const autotune_step_t *step)
+{
+    obj["frequency"]  = step->frequency;
+    obj["voltage"]    = step->voltage;
+    obj["hashrate"]   = step->hashrate;
+    obj["power"]      = step->power / 10.0f;
+    obj["temp"]       = step->temp;
+    obj["hwErrors"]   = step->hwErrors;
+    obj["nonces"]     = step->nonces;
+    obj["efficiency"] = AutoTuner::efficiency(*step);
+    obj["result"]     = AutoTuner::resultToStr(step->result);
+}
+
+esp_err_t GET_V2_autotune(httpd_req_t *req)
+{
+    ConGuard g(http_server, req);
+
+    if (is_network_allowed(req) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Unauthorized");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    if (set_cors_headers(req) != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    autotune_step_t *log = (autotune_step_t *) MALLOC(AUTOTUNE_LOG_SIZE * sizeof(autotune_step_t));
+    if (!log) {
+        ESP_LOGE(TAG, "out of memory");
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+
+    // copied under the lock, the json is built without it
+    AutoTuneState state;
+    uint16_t frequency, voltage;
+    autotune_step_t best;
+    bool hasBest;
+    int count;
+    {
+        LockGuard lg(POWER_MANAGEMENT_MODULE);
+        const AutoTuner &tuner = POWER_MANAGEMENT_MODULE.getAutoTuner();
+        const autotune_step_t *steps;
+        state = tuner.getState();
+        frequency = tuner.getFrequency();
+        voltage = tuner.getVoltage();
+        hasBest = tuner.getBest(&best);
+        count = tuner.getLog(&steps);
+        memcpy(log, steps, count * sizeof(autotune_step_t));
+    }
+
+    PSRAMAllocator allocator;
+    JsonDocument doc(&allocator);
+
+    doc["goal"]     = Config::getAutoTuneGoal();
+    doc["maxPower"] = Config::getAutoTuneMaxPower();
+    doc["maxTemp"]  = Config::getAutoTuneMaxTemp();
+    doc["settle"]   = Config::getAutoTuneSettle();
+    doc["measure"]  = Config::getAutoTuneMeasure();
+
+    doc["state"] = AutoTuner::stateToStr(state);
+    if (state == AutoTuneState::SWEEP || state == AutoTuneState::HOLD) {
+        doc["frequency"] = frequency;
+        doc["voltage"]   = voltage;
+    }
+    if (hasBest) {
+        step_to_json(doc["best"].to<JsonObject>(), &best);
+    }
+
+    JsonArray steps = doc["log"].to<JsonArray>();
+    for (int i = 0; i < count; i++) {
+        step_to_json(steps.add<JsonObject>(), &log[i]);
+    }
+    FREE(log);
+
+    esp_err_t ret = sendJsonResponse(req, doc);
+    doc.clear();
+    return ret;
+}
+
+esp_err_t PATCH_V2_autotune(httpd_req_t *req)
+{
+    ConGuard g(http_server, req);
+
+    if (is_network_allowed(req) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Unauthorized");
+    }
+
+    if (set_cors_headers(req) != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    if (validateOTP(req) != ESP_OK) {
+        return ESP_FAIL;
+    }
+
+    PSRAMAllocator allocator;
+    JsonDocument doc(&allocator);
+
+    esp_err_t err = getJsonData(req, doc);
+    if (err != ESP_OK) {
+        return err;
+    }
+
+    if (doc["goal"].is<uint16_t>() && doc["goal"].as<uint16_t>() <= (uint16_t) AutoTuneGoal::HASHRATE) {
+        Config::setAutoTuneGoal(doc["goal"].as<uint16_t>());
+    }
+    if (doc["maxPower"].is<uint16_t>()) {
+        Config::setAutoTuneMaxPower(doc["maxPower"].as<uint16_t>());
+    }
+    if (doc["maxTemp"].is<uint16_t>()) {
+        Config::setAutoTuneMaxTemp(doc["maxTemp"].as<uint16_t>());
+    }
+    if (doc["settle"].is<uint16_t>()) {
+        Config::setAutoTuneSettle(doc["settle"].as<uint16_t>());
+    }
+    if (doc["measure"].is<uint16_t>() && doc["measure"].as<uint16_t>() > 0) {
+        Config::setAutoTuneMeasure(doc["measure"].as<uint16_t>());
+    }
+
+    // a new goal or new limits only take effect with the next sweep
+    const char *action = doc["action"].as<const char *>();
+    if (action && !strcmp(action, "start")) {
+        POWER_MANAGEMENT_MODULE.requestAutoTune(true);
+    } else if (action && !strcmp(action, "stop")) {
+        POWER_MANAGEMENT_MODULE.requestAutoTune(false);
+    }
+
+    doc.clear();
+
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
@@ -0,0 +1,5 @@
+#pragma once
+#include "esp_http_server.h"
+
+esp_err_t GET_V2_autotune(httpd_req_t *req);
+esp_err_t PATCH_V2_autotune(httpd_req_t *req);
@@ -135,8 +135,8 @@ esp_err_t GET_V2_dashboard(httpd_req_t *req)
         STRATUM_MANAGER->getManagerInfoJson(stratum);
 
         // Enrich each pool entry with host / port / user from NVS config
-        char *urls[2]  = { Config::getStratumURL(), Config::getStratumFallbackURL() };
-        char *users[2] = { Config::getStratumUser(), Config::getStratumFallbackUser() };
+        const char *urls[2]  = { Config::getStratumURLShared(), Config::getStratumFallbackURLShared() };
+        const char *users[2] = { Config::getStratumUserShared(), Config::getStratumFallbackUserShared() };
         int   ports[2] = { (int) Config::getStratumPortNumber(), (int) Config::getStratumFallbackPortNumber() };
 
         JsonArray pools = stratum["pools"].as<JsonArray>();
@@ -146,11 +146,6 @@ esp_err_t GET_V2_dashboard(httpd_req_t *req)
             pool["port"] = ports[i];
             pool["user"] = users[i] ? users[i] : "";
         }
-
-        for (int i = 0; i < 2; i++) {
-            if (urls[i])  free(urls[i]);
-            if (users[i]) free(users[i]);
-        }
     }
 
     // --- can ---
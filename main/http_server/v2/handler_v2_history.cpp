@@ -0,0 +1,152 @@
+#include "handler_v2_history.h"
+
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "ArduinoJson.h"
+#include "psram_allocator.h"
+#include "global_state.h"
+#include "history_codec.h"
+#include "http_cors.h"
+#include "http_utils.h"
+
+static const char *TAG = "http_v2_history";
+
+// samples per request, ~7 h at 5 s
+#define HISTORY_DEFAULT_LIMIT 1000
+#define HISTORY_MAX_LIMIT     5000
+
+// Binary history, format in history_codec.h.
+//   since=<cursor>        continue after a previous response ("next")
+//   ts=<ms>&cur=<ms>      start at client time ts, cur is the client's now
+//   limit=<n>             samples per response
+// Without since and ts the export starts at the oldest sample.
+esp_err_t GET_V2_history(httpd_req_t *req)
+{
+    ConGuard g(http_server, req);
+
+    if (is_network_allowed(req) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Unauthorized");
+    }
+
+    httpd_resp_set_type(req, "application/octet-stream");
+    if (set_cors_headers(req) != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    History *history = SYSTEM_MODULE.getHistory();
+    if (!history->isAvailable()) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "History not available");
+    }
+
+    uint64_t now_ms = esp_timer_get_time() / 1000ULL;
+    int first = 0;
+    int limit = HISTORY_DEFAULT_LIMIT;
+
+    char query_str[128];
+    if (httpd_req_get_url_query_str(req, query_str, sizeof(query_str)) == ESP_OK) {
+        char param[64];
+        if (httpd_query_key_value(query_str, "since", param, sizeof(param)) == ESP_OK) {
+            first = (int) strtoul(param, NULL, 10);
+            // cursor from before a reboot
+            if (first > history->getNumSamples()) {
+                first = 0;
+            }
+        } else if (httpd_query_key_value(query_str, "ts", param, sizeof(param)) == ESP_OK) {
+            int64_t start_timestamp = (int64_t) strtoull(param, NULL, 10);
+            int64_t current_timestamp = start_timestamp;
+            if (httpd_query_key_value(query_str, "cur", param, sizeof(param)) == ESP_OK) {
+                current_timestamp = (int64_t) strtoull(param, NULL, 10);
+            }
+            first = history->getFirstSampleAfter((int64_t) now_ms + start_timestamp - current_timestamp);
+        }
+        if (httpd_query_key_value(query_str, "limit", param, sizeof(param)) == ESP_OK) {
+            limit = (int) strtoul(param, NULL, 10);
+            if (limit <= 0 || limit > HISTORY_MAX_LIMIT) limit = HISTORY_MAX_LIMIT;
+        }
+    }
+
+    HttpdChunkHeapWriter w(req, 2048);
+    if (w.m_failed || !history_export_binary(history, w, first, limit, now_ms)) {
+        ESP_LOGE(TAG, "out of memory");
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+        return ESP_FAIL;
+    }
+    return w.finish();
+}
+
+// default span of the long-term history
+#define TIERS_DEFAULT_SPAN_S (7 * 24 * 3600)
+
+// Long-term history from the downsampled tiers.
+//   span=<s>   time span up to now, the tier is picked to keep the
+//              response below HISTORY_TIERS_MAX_POINTS points
+esp_err_t GET_V2_history_tiers(httpd_req_t *req)
+{
+    ConGuard g(http_server, req);
+
+    if (is_network_allowed(req) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_401_UNAUTHORIZED, "Unauthorized");
+    }
+
+    httpd_resp_set_type(req, "application/json");
+    if (set_cors_headers(req) != ESP_OK) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    uint32_t span = TIERS_DEFAULT_SPAN_S;
+    char query_str[64];
+    if (httpd_req_get_url_query_str(req, query_str, sizeof(query_str)) == ESP_OK) {
+        char param[32];
+        if (httpd_query_key_value(query_str, "span", param, sizeof(param)) == ESP_OK) {
+            span = strtoul(param, NULL, 10);
+            if (!span) span = TIERS_DEFAULT_SPAN_S;
+        }
+    }
+
+    HistoryTiers *tiers = SYSTEM_MODULE.getHistory()->getTiers();
+    int tier = tiers->selectTier(span);
+    const history_tier_def_t &def = HistoryTiers::defs[tier];
+
+    history_record_t *records = (history_record_t *) MALLOC(def.capacity * sizeof(history_record_t));
+    if (!records) {
+        return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+    }
+    int num = tiers->query(tier, span, records, def.capacity);
+
+    PSRAMAllocator allocator;
+    JsonDocument doc(&allocator);
+
+    doc["tier"] = def.name;
+    doc["interval"] = def.interval;
+    doc["span"] = span;
+    doc["persistent"] = tiers->isPersistent();
+
+    JsonArray timestamps = doc["timestamps"].to<JsonArray>();
+    JsonArray hashrate = doc["hashrate"].to<JsonArray>();
+    JsonArray vregTemp = doc["vregTemp"].to<JsonArray>();
+    JsonArray asicTemp = doc["asicTemp"].to<JsonArray>();
+    JsonArray samples = doc["samples"].to<JsonArray>();
+    for (int i = 0; i < num; i++) {
+        timestamps.add(records[i].time);
+        hashrate.add((uint32_t) ((uint64_t) records[i].hashrate * 100 / 1024));
+        vregTemp.add(records[i].vregTemp);
+        asicTemp.add(records[i].asicTemp);
+        samples.add(records[i].samples);
+    }
+    FREE(records);
+
+    JsonArray available = doc["tiers"].to<JsonArray>();
+    for (int i = 0; i < HISTORY_TIER_COUNT; i++) {
+        JsonObject t = available.add<JsonObject>();
+        t["name"] = HistoryTiers::defs[i].name;
+        t["interval"] = HistoryTiers::defs[i].interval;
+        t["records"] = tiers->getNumRecords(i);
+        t["persistent"] = HistoryTiers::defs[i].persistent && tiers->isPersistent();
+    }
+
+    return sendJsonResponse(req, doc);
+}
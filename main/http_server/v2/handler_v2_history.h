@@ -0,0 +1,5 @@
+#pragma once
+#include "esp_http_server.h"
+
+esp_err_t GET_V2_history(httpd_req_t *req);
+esp_err_t GET_V2_history_tiers(httpd_req_t *req);
@@ -71,6 +71,7 @@ esp_err_t GET_V2_settings(httpd_req_t *req)
     doc["poolMode"]        = Config::getPoolMode();
     doc["poolBalance"]     = Config::getPoolBalance();
     doc["stratumKeep"]    = Config::isStratumKeepaliveEnabled() ? 1 : 0;
+    doc["stratumHotStandby"] = Config::isStratumHotStandbyEnabled() ? 1 : 0;
     doc["jobInterval"]     = board->getAsicJobIntervalMs();
     doc["stratumDifficulty"] = Config::getStratumDifficulty();
     {
@@ -79,45 +80,37 @@ esp_err_t GET_V2_settings(httpd_req_t *req)
         // Pool 0 — primary
         {
             JsonObject pool = pools.add<JsonObject>();
-            char *url  = Config::getStratumURL();
-            char *user = Config::getStratumUser();
+            const char *url  = Config::getStratumURLShared();
+            const char *user = Config::getStratumUserShared();
             pool["url"]              = url  ? url  : "";
             pool["port"]             = Config::getStratumPortNumber();
             pool["user"]             = user ? user : "";
             pool["enonceSubscribe"]  = Config::isStratumEnonceSubscribe();
             pool["tls"]              = Config::isStratumTLS();
             pool["protocol"]         = Config::getStratumProtocol();
-            char *sv2 = Config::getSV2AuthorityPubkey();
-            pool["sv2AuthorityPubkey"] = sv2 ? sv2 : "";
-            safe_free(sv2);
+            pool["sv2AuthorityPubkey"] = Config::getSV2AuthorityPubkeyShared();
             pool["sv2ChannelType"]   = Config::getSV2ChannelType();
             pool["coinbaseVerifyMode"]  = Config::getCoinbaseVerifyMode(0);
             pool["coinbaseMaxFee"]      = Config::getCoinbaseMaxFee(0) / 10.0f;
             pool["coinbaseVerifyForce"] = Config::getCoinbaseVerifyForce(0);
-            free(url);
-            free(user);
         }
 
         // Pool 1 — fallback
         {
             JsonObject pool = pools.add<JsonObject>();
-            char *url  = Config::getStratumFallbackURL();
-            char *user = Config::getStratumFallbackUser();
+            const char *url  = Config::getStratumFallbackURLShared();
+            const char *user = Config::getStratumFallbackUserShared();
             pool["url"]              = url  ? url  : "";
             pool["port"]             = Config::getStratumFallbackPortNumber();
             pool["user"]             = user ? user : "";
             pool["enonceSubscribe"]  = Config::isStratumFallbackEnonceSubscribe();
             pool["tls"]              = Config::isStratumFallbackTLS();
             pool["protocol"]         = Config::getFallbackStratumProtocol();
-            char *sv2 = Config::getFallbackSV2AuthorityPubkey();
-            pool["sv2AuthorityPubkey"] = sv2 ? sv2 : "";
-            safe_free(sv2);
+            pool["sv2AuthorityPubkey"] = Config::getFallbackSV2AuthorityPubkeyShared();
             pool["sv2ChannelType"]   = Config::getFallbackSV2ChannelType();
             pool["coinbaseVerifyMode"]  = Config::getCoinbaseVerifyMode(1);
             pool["coinbaseMaxFee"]      = Config::getCoinbaseMaxFee(1) / 10.0f;
             pool["coinbaseVerifyForce"] = Config::getCoinbaseVerifyForce(1);
-            free(url);
-            free(user);
         }
     }
 
@@ -143,12 +136,10 @@ esp_err_t GET_V2_settings(httpd_req_t *req)
 
     // --- network ---
     {
-        char *hostname = Config::getHostname();
-        char *ssid     = Config::getWifiSSID();
+        const char *hostname = Config::getHostnameShared();
+        const char *ssid     = Config::getWifiSSIDShared();
         doc["hostname"] = hostname ? hostname : "";
         doc["ssid"]     = ssid     ? ssid     : "";
-        free(hostname);
-        free(ssid);
     }
 
     // --- display ---
@@ -240,6 +231,10 @@ esp_err_t PATCH_V2_settings(httpd_req_t *req)
         bool value = doc["stratumKeep"].as<int>() != 0;
         Config::setStratumKeepaliveEnabled(value);
     }
+    if (doc["stratumHotStandby"].is<bool>() || doc["stratumHotStandby"].is<int>()) {
+        bool value = doc["stratumHotStandby"].as<int>() != 0;
+        Config::setStratumHotStandbyEnabled(value);
+    }
     if (doc["canMaster"].is<bool>() || doc["canMaster"].is<int>()) {
         bool value = doc["canMaster"].as<int>() != 0;
         Config::setCanEnabled(value);
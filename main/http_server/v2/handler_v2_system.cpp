@@ -30,8 +30,8 @@ esp_err_t GET_V2_system(httpd_req_t *req)
 
     Board *board = SYSTEM_MODULE.getBoard();
 
-    char *hostname = Config::getHostname();
-    char *ssid     = Config::getWifiSSID();
+    const char *hostname = Config::getHostnameShared();
+    const char *ssid     = Config::getWifiSSIDShared();
 
     PSRAMAllocator allocator;
     JsonDocument doc(&allocator);
@@ -59,8 +59,5 @@ esp_err_t GET_V2_system(httpd_req_t *req)
     memory["freeHeap"]    = heap_caps_get_free_size(MALLOC_CAP_SPIRAM);
     memory["freeHeapInt"] = heap_caps_get_free_size(MALLOC_CAP_INTERNAL);
 
-    free(hostname);
-    free(ssid);
-
     return sendJsonResponse(req, doc);
 }
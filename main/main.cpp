@@ -60,8 +60,8 @@ FactoryOTAUpdate FACTORY_OTA_UPDATER;
 
 DiscordAlerter discordAlerter;
 
+BmJobPool bmJobPool;
 AsicJobs asicJobs;
-EXT_RAM_BSS_ATTR AsicJobs slaveAsicJobs[CAN_SLAVE_MAX];
 
 OTP otp;
 SNTP sntp;
@@ -218,6 +218,11 @@ extern "C" void app_main(void)
     ESP_LOGI(TAG, "Welcome to the Nerd*Axe - hack the planet!");
     ESP_ERROR_CHECK(nvs_flash_init());
 
+    // settings are read from RAM from here on, without it directly from NVS
+    if (!Config::init()) {
+        ESP_LOGE(TAG, "config cache not available");
+    }
+
     // shows and saves last reset reason
     esp_reset_reason_t reason = SYSTEM_MODULE.showLastResetReason();
 
@@ -1,152 +1,628 @@
+#include <pthread.h>
 #include <string.h>
 
 #include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
 #include "nvs.h"
 #include "nvs_config.h"
 #include "macros.h"
 
 #define NVS_CONFIG_NAMESPACE "main"
 
+// power of two, well above the number of keys
+#define NVS_CACHE_SLOTS 256
+#define NVS_MAX_LISTENERS 16
+
+// sets within this time are written together
+#define NVS_FLUSH_DELAY_MS 1000
+
+// replaced strings are freed after this time, see nvs_config_get_string_shared()
+#define NVS_RETIRE_GRACE_US (60 * 1000 * 1000)
+#define NVS_MAX_RETIRED 32
+
 namespace Config
 {
 
 static const char *TAG = "nvs_config";
 
-char *nvs_config_get_string(const char *key, const char *default_value)
+/**
+ * All values of the namespace are mirrored in RAM at boot. Reads don't lock:
+ * entries are published once and never removed, a value is changed under
+ * a sequence counter that readers check before and after copying. Sets
+ * only mark the entry dirty, the flush task writes all dirty entries in one
+ * go once no set came for a while. A replaced string is freed after a grace
+ * period, readers may still hold it.
+ */
+enum {
+    ENTRY_U16 = 1,
+    ENTRY_U64,
+    ENTRY_STR,
+};
+
+typedef struct {
+    char key[NVS_KEY_NAME_MAX_SIZE];
+    uint32_t used;   // set once the entry is published
+    uint32_t seq;    // odd while the value changes
+    uint8_t type;
+    bool dirty;
+    uint64_t value;
+    const char *str; // immutable, replaced on change
+} cache_entry_t;
+
+typedef struct {
+    char *str;
+    int64_t retiredUs;
+} retired_t;
+
+typedef struct {
+    const char *prefix;
+    change_cb_t cb;
+    void *ctx;
+} listener_t;
+
+static cache_entry_t *s_cache = nullptr;
+static uint32_t s_loaded = 0;
+static bool s_dirty = false;
+static uint32_t s_overflow = 0; // keys that didn't fit are read from NVS
+static pthread_mutex_t s_lock = PTHREAD_MUTEX_INITIALIZER;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+// one flush at a time, a flush() returns after the values are committed
+static pthread_mutex_t s_flushLock = PTHREAD_MUTEX_INITIALIZER;
+static SemaphoreHandle_t s_flushSem = nullptr;
+
+static retired_t s_retired[NVS_MAX_RETIRED];
+static int s_numRetired = 0;
+
+static listener_t s_listeners[NVS_MAX_LISTENERS];
+static int s_numListeners = 0;
+
+static nvs_config_stats_t s_stats = {};
+
+#define STAT_INC(field) __atomic_fetch_add(&s_stats.field, 1, __ATOMIC_RELAXED)
+
+// ---- direct NVS access, before init and when the cache is full ----
+
+static char *nvs_read_string(nvs_handle handle, const char *key)
+{
+    size_t size = 0;
+    if (nvs_get_str(handle, key, NULL, &size) != ESP_OK) {
+        return nullptr;
+    }
+
+    char *out = (char *) MALLOC(size);
+    if (!out) {
+        return nullptr;
+    }
+    if (nvs_get_str(handle, key, out, &size) != ESP_OK) {
+        FREE(out);
+        return nullptr;
+    }
+    STAT_INC(nvsReads);
+    return out;
+}
+
+static bool nvs_read_value(const char *key, uint8_t type, uint64_t *value, char **str)
 {
     nvs_handle handle;
-    esp_err_t err;
-    err = nvs_open(NVS_CONFIG_NAMESPACE, NVS_READONLY, &handle);
-    if (err != ESP_OK) {
-        return strdup(default_value);
+    if (nvs_open(NVS_CONFIG_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return false;
     }
 
-    size_t size = 0;
-    err = nvs_get_str(handle, key, NULL, &size);
+    esp_err_t err = ESP_FAIL;
+    if (type == ENTRY_U16) {
+        uint16_t v;
+        err = nvs_get_u16(handle, key, &v);
+        *value = v;
+    } else if (type == ENTRY_U64) {
+        uint64_t v;
+        err = nvs_get_u64(handle, key, &v);
+        *value = v;
+    } else if (type == ENTRY_STR) {
+        *str = nvs_read_string(handle, key);
+        err = *str ? ESP_OK : ESP_FAIL;
+    }
+    nvs_close(handle);
 
     if (err != ESP_OK) {
-        nvs_close(handle);
-        return strdup(default_value);
+        return false;
     }
+    if (type != ENTRY_STR) {
+        STAT_INC(nvsReads);
+    }
+    return true;
+}
 
-    char *out = (char *) MALLOC(size);
-    err = nvs_get_str(handle, key, out, &size);
+static esp_err_t nvs_write_value(nvs_handle handle, const char *key, uint8_t type, uint64_t value, const char *str)
+{
+    esp_err_t err = ESP_FAIL;
+    if (type == ENTRY_U16) {
+        err = nvs_set_u16(handle, key, (uint16_t) value);
+    } else if (type == ENTRY_U64) {
+        err = nvs_set_u64(handle, key, value);
+    } else if (type == ENTRY_STR) {
+        err = nvs_set_str(handle, key, str);
+    }
 
     if (err != ESP_OK) {
-        free(out);
-        nvs_close(handle);
-        return strdup(default_value);
+        ESP_LOGW(TAG, "Could not write nvs key: %s", key);
+        return err;
     }
-
-    nvs_close(handle);
-    return out;
+    STAT_INC(nvsWrites);
+    return ESP_OK;
 }
 
-void nvs_config_set_string(const char *key, const char *value)
+static void nvs_write_direct(const char *key, uint8_t type, uint64_t value, const char *str)
 {
-
     nvs_handle handle;
-    esp_err_t err;
-    err = nvs_open(NVS_CONFIG_NAMESPACE, NVS_READWRITE, &handle);
-    if (err != ESP_OK) {
+    if (nvs_open(NVS_CONFIG_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
         ESP_LOGW(TAG, "Could not open nvs");
         return;
     }
+    if (nvs_write_value(handle, key, type, value, str) == ESP_OK && nvs_commit(handle) == ESP_OK) {
+        STAT_INC(nvsCommits);
+    }
+    nvs_close(handle);
+}
 
-    err = nvs_set_str(handle, key, value);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Could not write nvs key: %s, value: %s", key, value);
+// ---- cache ----
+
+static bool is_loaded()
+{
+    return __atomic_load_n(&s_loaded, __ATOMIC_ACQUIRE) != 0;
+}
+
+// FNV-1a
+static uint32_t hash_key(const char *key)
+{
+    uint32_t h = 2166136261u;
+    while (*key) {
+        h = (h ^ (uint8_t) *key++) * 16777619u;
     }
+    return h;
+}
 
-    nvs_close(handle);
+static cache_entry_t *find_entry(const char *key)
+{
+    uint32_t h = hash_key(key);
+    for (uint32_t i = 0; i < NVS_CACHE_SLOTS; i++) {
+        cache_entry_t *e = &s_cache[(h + i) & (NVS_CACHE_SLOTS - 1)];
+        if (!__atomic_load_n(&e->used, __ATOMIC_ACQUIRE)) {
+            return nullptr;
+        }
+        if (!strcmp(e->key, key)) {
+            return e;
+        }
+    }
+    return nullptr;
 }
 
-uint16_t nvs_config_get_u16(const char *key, const uint16_t default_value)
+// with s_lock held, the entry is published with its value
+static cache_entry_t *insert_entry(const char *key, uint8_t type, uint64_t value, const char *str)
 {
-    nvs_handle handle;
-    esp_err_t err;
-    err = nvs_open(NVS_CONFIG_NAMESPACE, NVS_READONLY, &handle);
-    if (err != ESP_OK) {
-        return default_value;
+    if (strlen(key) >= NVS_KEY_NAME_MAX_SIZE) {
+        return nullptr;
     }
 
-    uint16_t out;
-    err = nvs_get_u16(handle, key, &out);
-    nvs_close(handle);
+    uint32_t h = hash_key(key);
+    for (uint32_t i = 0; i < NVS_CACHE_SLOTS; i++) {
+        cache_entry_t *e = &s_cache[(h + i) & (NVS_CACHE_SLOTS - 1)];
+        if (e->used) {
+            continue;
+        }
+        strcpy(e->key, key);
+        e->type = type;
+        e->value = value;
+        e->str = str;
+        __atomic_store_n(&e->used, 1, __ATOMIC_RELEASE);
+        s_stats.entries++;
+        return e;
+    }
+    return nullptr;
+}
 
-    if (err != ESP_OK) {
-        return default_value;
+// with s_lock held, the critical section keeps readers on this core from
+// spinning on a half written value
+static void update_entry(cache_entry_t *e, uint8_t type, uint64_t value, const char *str)
+{
+    portENTER_CRITICAL(&s_mux);
+    __atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e->type = type;
+    e->value = value;
+    e->str = str;
+    __atomic_store_n(&e->seq, e->seq + 1, __ATOMIC_RELEASE);
+    portEXIT_CRITICAL(&s_mux);
+}
+
+static bool read_entry(const char *key, uint8_t type, uint64_t *value, const char **str)
+{
+    cache_entry_t *e = find_entry(key);
+    if (!e) {
+        STAT_INC(cacheDefaults);
+        return false;
     }
-    return out;
+
+    uint32_t seq;
+    uint8_t t;
+    do {
+        seq = __atomic_load_n(&e->seq, __ATOMIC_ACQUIRE);
+        t = e->type;
+        *value = e->value;
+        if (str) {
+            *str = e->str;
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&e->seq, __ATOMIC_RELAXED));
+
+    // like NVS, a value of another type isn't found
+    if (t != type) {
+        STAT_INC(cacheDefaults);
+        return false;
+    }
+    STAT_INC(cacheHits);
+    return true;
 }
 
-void nvs_config_set_u16(const char *key, const uint16_t value)
+// with s_lock held
+static void retire_string(const char *str)
 {
+    if (s_numRetired >= NVS_MAX_RETIRED) {
+        // a flood of changes, not freeing is safe
+        ESP_LOGW(TAG, "too many replaced strings, not freeing one");
+        return;
+    }
+    s_retired[s_numRetired++] = {(char *) str, esp_timer_get_time()};
+    s_stats.retiredBytes += strlen(str) + 1;
+}
+
+// with s_lock held, returns true while strings wait for their grace period
+static bool free_retired()
+{
+    int64_t now = esp_timer_get_time();
+    int kept = 0;
+    for (int i = 0; i < s_numRetired; i++) {
+        retired_t *r = &s_retired[i];
+        if (now - r->retiredUs < NVS_RETIRE_GRACE_US) {
+            s_retired[kept++] = *r;
+            continue;
+        }
+        s_stats.retiredBytes -= strlen(r->str) + 1;
+        FREE(r->str);
+    }
+    s_numRetired = kept;
+    return kept != 0;
+}
+
+static void notify(const char *key)
+{
+    int num = __atomic_load_n(&s_numListeners, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < num; i++) {
+        const listener_t *l = &s_listeners[i];
+        if (!l->prefix || !strncmp(key, l->prefix, strlen(l->prefix))) {
+            l->cb(key, l->ctx);
+        }
+    }
+}
+
+static void set_value(const char *key, uint8_t type, uint64_t value, const char *str)
+{
+    if (!is_loaded()) {
+        nvs_write_direct(key, type, value, str);
+        return;
+    }
+
+    {
+        PThreadGuard g(s_lock);
+
+        cache_entry_t *e = find_entry(key);
+        if (e && e->type == type && (type == ENTRY_STR ? !strcmp(e->str, str) : e->value == value)) {
+            s_stats.setsUnchanged++;
+            return;
+        }
+
+        const char *copy = nullptr;
+        if (type == ENTRY_STR) {
+            copy = strdup(str);
+            if (!copy) {
+                nvs_write_direct(key, type, value, str);
+                return;
+            }
+        }
+
+        if (!e) {
+            e = insert_entry(key, type, value, copy);
+            if (!e) {
+                ESP_LOGE(TAG, "config cache full, writing %s directly", key);
+                __atomic_store_n(&s_overflow, 1, __ATOMIC_RELEASE);
+                free((void *) copy);
+                nvs_write_direct(key, type, value, str);
+                return;
+            }
+        } else {
+            // readers may still hold the old string
+            const char *old = e->str;
+            update_entry(e, type, value, copy);
+            if (old) {
+                retire_string(old);
+            }
+        }
+        e->dirty = true;
+        s_dirty = true;
+    }
+
+    xSemaphoreGive(s_flushSem);
+
+    notify(key);
+}
+
+void flush()
+{
+    if (!is_loaded()) {
+        return;
+    }
+
+    PThreadGuard fg(s_flushLock);
+    {
+        PThreadGuard g(s_lock);
+        if (!s_dirty) {
+            return;
+        }
+        // sets from now on mark their entries again
+        s_dirty = false;
+    }
 
     nvs_handle handle;
-    esp_err_t err;
-    err = nvs_open(NVS_CONFIG_NAMESPACE, NVS_READWRITE, &handle);
-    if (err != ESP_OK) {
+    if (nvs_open(NVS_CONFIG_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
         ESP_LOGW(TAG, "Could not open nvs");
+        PThreadGuard g(s_lock);
+        s_dirty = true;
         return;
     }
 
-    err = nvs_set_u16(handle, key, value);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Could not write nvs key: %s, value: %u", key, value);
+    // flash writes stall for milliseconds, s_lock is only held to take
+    // one value at a time
+    for (uint32_t i = 0; i < NVS_CACHE_SLOTS; i++) {
+        cache_entry_t *e = &s_cache[i];
+        uint8_t type;
+        uint64_t value;
+        const char *str;
+        {
+            PThreadGuard g(s_lock);
+            if (!e->used || !e->dirty) {
+                continue;
+            }
+            // values only change under s_lock, no need for the sequence counter here
+            e->dirty = false;
+            type = e->type;
+            value = e->value;
+            // stays valid for the grace period even if replaced meanwhile
+            str = e->str;
+        }
+        if (nvs_write_value(handle, e->key, type, value, str) != ESP_OK) {
+            PThreadGuard g(s_lock);
+            e->dirty = true;
+            s_dirty = true;
+        }
     }
 
+    if (nvs_commit(handle) == ESP_OK) {
+        STAT_INC(nvsCommits);
+    }
     nvs_close(handle);
 }
 
-uint64_t nvs_config_get_u64(const char *key, const uint64_t default_value)
+// writes the values once no set came for NVS_FLUSH_DELAY_MS, frees replaced
+// strings after their grace period
+static void flush_task(void *arg)
 {
-    nvs_handle handle;
+    bool retired = false;
+    while (1) {
+        // without pending sets, only wake up to free replaced strings
+        TickType_t wait = retired ? pdMS_TO_TICKS(NVS_RETIRE_GRACE_US / 1000) : portMAX_DELAY;
+        if (xSemaphoreTake(s_flushSem, wait) == pdTRUE) {
+            // every set restarts the delay, e.g. a settings PATCH is written at once
+            while (xSemaphoreTake(s_flushSem, pdMS_TO_TICKS(NVS_FLUSH_DELAY_MS)) == pdTRUE) {
+            }
+            flush();
+        }
+
+        PThreadGuard g(s_lock);
+        retired = free_retired();
+    }
+}
+
+static void flush_on_shutdown()
+{
+    flush();
+}
+
+static void load_entry(nvs_handle handle, const char *key, nvs_type_t nvs_type)
+{
+    uint8_t type;
+    uint64_t value = 0;
+    char *str = nullptr;
     esp_err_t err;
-    err = nvs_open(NVS_CONFIG_NAMESPACE, NVS_READONLY, &handle);
+
+    if (nvs_type == NVS_TYPE_U16) {
+        uint16_t v;
+        err = nvs_get_u16(handle, key, &v);
+        type = ENTRY_U16;
+        value = v;
+    } else if (nvs_type == NVS_TYPE_U64) {
+        err = nvs_get_u64(handle, key, &value);
+        type = ENTRY_U64;
+    } else if (nvs_type == NVS_TYPE_STR) {
+        str = nvs_read_string(handle, key);
+        err = str ? ESP_OK : ESP_FAIL;
+        type = ENTRY_STR;
+    } else {
+        // blobs and other types aren't used by the getters
+        return;
+    }
+
     if (err != ESP_OK) {
-        return default_value;
+        return;
+    }
+    if (type != ENTRY_STR) {
+        STAT_INC(nvsReads);
+    }
+    if (!insert_entry(key, type, value, str)) {
+        ESP_LOGE(TAG, "config cache full, %s stays in NVS", key);
+        FREE(str);
+        s_overflow = 1;
+    }
+}
+
+bool init()
+{
+    if (is_loaded()) {
+        return true;
     }
 
-    uint64_t out;
-    err = nvs_get_u64(handle, key, &out);
+    s_cache = (cache_entry_t *) CALLOC(NVS_CACHE_SLOTS, sizeof(cache_entry_t));
+    if (!s_cache) {
+        ESP_LOGE(TAG, "no memory for the config cache");
+        return false;
+    }
 
-    if (err != ESP_OK) {
-        nvs_close(handle);
-        return default_value;
+    s_flushSem = xSemaphoreCreateBinary();
+    if (!s_flushSem) {
+        ESP_LOGE(TAG, "error creating flush semaphore");
+        FREE(s_cache);
+        return false;
     }
 
-    nvs_close(handle);
-    return out;
+    {
+        PThreadGuard g(s_lock);
+
+        // a fresh device has no namespace yet
+        nvs_handle handle;
+        if (nvs_open(NVS_CONFIG_NAMESPACE, NVS_READONLY, &handle) == ESP_OK) {
+            nvs_iterator_t it = nullptr;
+            esp_err_t err = nvs_entry_find(NVS_DEFAULT_PART_NAME, NVS_CONFIG_NAMESPACE, NVS_TYPE_ANY, &it);
+            while (err == ESP_OK) {
+                nvs_entry_info_t info;
+                nvs_entry_info(it, &info);
+                load_entry(handle, info.key, info.type);
+                err = nvs_entry_next(&it);
+            }
+            nvs_release_iterator(it);
+            nvs_close(handle);
+        }
+    }
+
+    // esp_restart runs the shutdown handlers, settings saved right before a restart aren't lost
+    esp_register_shutdown_handler(flush_on_shutdown);
+
+    __atomic_store_n(&s_loaded, 1, __ATOMIC_RELEASE);
+
+    // low priority, the values are in RAM already
+    xTaskCreate(flush_task, "nvs flush", 4096, NULL, 1, NULL);
+
+    ESP_LOGI(TAG, "%lu config values cached", s_stats.entries);
+    return true;
 }
 
-void nvs_config_set_u64(const char *key, const uint64_t value)
+bool onChange(const char *prefix, change_cb_t cb, void *ctx)
 {
+    PThreadGuard g(s_lock);
+    if (s_numListeners >= NVS_MAX_LISTENERS) {
+        ESP_LOGE(TAG, "too many config listeners");
+        return false;
+    }
+    s_listeners[s_numListeners] = {prefix, cb, ctx};
+    __atomic_store_n(&s_numListeners, s_numListeners + 1, __ATOMIC_RELEASE);
+    return true;
+}
 
-    nvs_handle handle;
-    esp_err_t err;
-    err = nvs_open(NVS_CONFIG_NAMESPACE, NVS_READWRITE, &handle);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Could not open nvs");
-        return;
+void getStats(nvs_config_stats_t *stats)
+{
+    *stats = s_stats;
+}
+
+// ---- typed accessors ----
+
+// false if the key has to be read from NVS
+static bool use_cache(const char *key)
+{
+    if (!is_loaded()) {
+        return false;
     }
+    return !__atomic_load_n(&s_overflow, __ATOMIC_ACQUIRE) || find_entry(key);
+}
 
-    err = nvs_set_u64(handle, key, value);
-    if (err != ESP_OK) {
-        ESP_LOGW(TAG, "Could not write nvs key: %s, value: %llu", key, value);
+static bool get_value(const char *key, uint8_t type, uint64_t *value)
+{
+    if (use_cache(key)) {
+        return read_entry(key, type, value, nullptr);
     }
-    nvs_close(handle);
+    return nvs_read_value(key, type, value, nullptr);
+}
+
+char *nvs_config_get_string(const char *key, const char *default_value)
+{
+    if (!use_cache(key)) {
+        char *str = nullptr;
+        uint64_t unused;
+        if (nvs_read_value(key, ENTRY_STR, &unused, &str)) {
+            return str;
+        }
+        return strdup(default_value);
+    }
+    return strdup(nvs_config_get_string_shared(key, default_value));
+}
+
+const char *nvs_config_get_string_shared(const char *key, const char *default_value)
+{
+    uint64_t unused;
+    const char *str;
+    if (is_loaded() && read_entry(key, ENTRY_STR, &unused, &str)) {
+        return str;
+    }
+    return default_value;
+}
+
+void nvs_config_set_string(const char *key, const char *value)
+{
+    set_value(key, ENTRY_STR, 0, value);
+}
+
+uint16_t nvs_config_get_u16(const char *key, const uint16_t default_value)
+{
+    uint64_t value;
+    if (get_value(key, ENTRY_U16, &value)) {
+        return (uint16_t) value;
+    }
+    return default_value;
+}
+
+void nvs_config_set_u16(const char *key, const uint16_t value)
+{
+    set_value(key, ENTRY_U16, value, nullptr);
+}
+
+uint64_t nvs_config_get_u64(const char *key, const uint64_t default_value)
+{
+    uint64_t value;
+    if (get_value(key, ENTRY_U64, &value)) {
+        return value;
+    }
+    return default_value;
+}
+
+void nvs_config_set_u64(const char *key, const uint64_t value)
+{
+    set_value(key, ENTRY_U64, value, nullptr);
 }
 
 bool nvs_config_has_u16(const char *key)
 {
-    nvs_handle handle;
-    if (nvs_open(NVS_CONFIG_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
-        return false;
-    uint16_t dummy;
-    bool exists = (nvs_get_u16(handle, key, &dummy) == ESP_OK);
-    nvs_close(handle);
-    return exists;
+    uint64_t value;
+    return get_value(key, ENTRY_U16, &value);
 }
 
 void migrate_config()
@@ -22,6 +22,7 @@
 #define NVS_CONFIG_STRATUM_FALLBACK_TLS "fbstratumtls"
 #define NVS_CONFIG_STRATUM_DIFFICULTY "stratumdiff"
 #define NVS_CONFIG_STRATUM_KEEPALIVE "stratum_keep"
+#define NVS_CONFIG_STRATUM_HOT_STANDBY "stratum_hot"
 
 #define NVS_CONFIG_ASIC_FREQ "asicfrequency"
 #define NVS_CONFIG_ASIC_VOLTAGE "asicvoltage"
@@ -44,6 +45,9 @@
 #define NVS_CONFIG_INFLUX_BUCKET "influx_bucket"
 #define NVS_CONFIG_INFLUX_ORG "influx_org"
 #define NVS_CONFIG_INFLUX_PREFIX "influx_prefix"
+#define NVS_CONFIG_INFLUX_SAMPLE "influx_sample"
+#define NVS_CONFIG_INFLUX_FLUSH "influx_flush"
+#define NVS_CONFIG_INFLUX_BATCH "influx_batch"
 
 #define NVS_CONFIG_PID_TARGET_TEMP "pid_temp"
 #define NVS_CONFIG_PID_P "pid_p"
@@ -73,6 +77,13 @@
 
 #define NVS_CONFIG_VR_FREQUENCY "vr_frequency"
 
+// frequency/voltage autotuner
+#define NVS_CONFIG_AUTOTUNE_GOAL "at_goal"
+#define NVS_CONFIG_AUTOTUNE_MAX_POWER "at_max_power"
+#define NVS_CONFIG_AUTOTUNE_MAX_TEMP "at_max_temp"
+#define NVS_CONFIG_AUTOTUNE_SETTLE "at_settle"
+#define NVS_CONFIG_AUTOTUNE_MEASURE "at_measure"
+
 // device global stats
 #define NVS_TOTAL_FOUND_BLOCKS "totalblocks"
 #define NVS_CONFIG_BEST_DIFF "bestdiff"
@@ -121,8 +132,36 @@
 
 #include <stdint.h>
 
+typedef struct {
+    uint32_t nvsReads;      // values read from flash
+    uint32_t nvsWrites;     // values written to flash
+    uint32_t nvsCommits;
+    uint32_t cacheHits;
+    uint32_t cacheDefaults; // key not stored, default returned without flash access
+    uint32_t setsUnchanged; // sets dropped because the value didn't change
+    uint32_t entries;
+    uint32_t retiredBytes;  // replaced strings, kept for readers holding them until freed
+} nvs_config_stats_t;
+
 namespace Config {
+    // loads all keys into RAM, getters read NVS directly until then
+    bool init();
+
+    // writes changed values now instead of after the write-back delay
+    void flush();
+
+    // called after a value whose key starts with prefix changed, nullptr matches all
+    typedef void (*change_cb_t)(const char *key, void *ctx);
+    bool onChange(const char *prefix, change_cb_t cb, void *ctx);
+
+    void getStats(nvs_config_stats_t *stats);
+
+    // caller frees the copy
     char* nvs_config_get_string(const char* key, const char* default_value);
+    // shared and immutable, don't free; stays valid for a minute after the value
+    // changed, keep it longer only with an onChange() listener that reloads it;
+    // only for cached keys, the default otherwise
+    const char* nvs_config_get_string_shared(const char* key, const char* default_value);
     void nvs_config_set_string(const char* key, const char* value);
     uint16_t nvs_config_get_u16(const char* key, uint16_t default_value);
     void nvs_config_set_u16(const char* key, uint16_t value);
@@ -148,6 +187,22 @@ namespace Config {
     inline char* getSwarmConfig() { return nvs_config_get_string(NVS_CONFIG_SWARM, ""); }
     inline char* getDiscordWebhook() { return nvs_config_get_string(NVS_CONFIG_ALERT_DISCORD_URL, CONFIG_ALERT_DISCORD_URL); }
 
+    // ---- Shared String Getters, see nvs_config_get_string_shared ----
+    inline const char* getWifiSSIDShared() { return nvs_config_get_string_shared(NVS_CONFIG_WIFI_SSID, CONFIG_ESP_WIFI_SSID); }
+    inline const char* getHostnameShared() { return nvs_config_get_string_shared(NVS_CONFIG_HOSTNAME, CONFIG_LWIP_LOCAL_HOSTNAME); }
+    inline const char* getStratumURLShared() { return nvs_config_get_string_shared(NVS_CONFIG_STRATUM_URL, CONFIG_STRATUM_URL); }
+    inline const char* getStratumUserShared() { return nvs_config_get_string_shared(NVS_CONFIG_STRATUM_USER, CONFIG_STRATUM_USER); }
+    inline const char* getStratumFallbackURLShared() { return nvs_config_get_string_shared(NVS_CONFIG_STRATUM_FALLBACK_URL, CONFIG_STRATUM_FALLBACK_URL); }
+    inline const char* getStratumFallbackUserShared() { return nvs_config_get_string_shared(NVS_CONFIG_STRATUM_FALLBACK_USER, CONFIG_STRATUM_FALLBACK_USER); }
+    inline const char* getInfluxURLShared() { return nvs_config_get_string_shared(NVS_CONFIG_INFLUX_URL, CONFIG_INFLUX_URL); }
+    inline const char* getInfluxBucketShared() { return nvs_config_get_string_shared(NVS_CONFIG_INFLUX_BUCKET, CONFIG_INFLUX_BUCKET); }
+    inline const char* getInfluxOrgShared() { return nvs_config_get_string_shared(NVS_CONFIG_INFLUX_ORG, CONFIG_INFLUX_ORG); }
+    inline const char* getInfluxPrefixShared() { return nvs_config_get_string_shared(NVS_CONFIG_INFLUX_PREFIX, CONFIG_INFLUX_PREFIX); }
+    inline const char* getSwarmConfigShared() { return nvs_config_get_string_shared(NVS_CONFIG_SWARM, ""); }
+    inline const char* getDiscordWebhookShared() { return nvs_config_get_string_shared(NVS_CONFIG_ALERT_DISCORD_URL, CONFIG_ALERT_DISCORD_URL); }
+    inline const char* getSV2AuthorityPubkeyShared() { return nvs_config_get_string_shared(NVS_CONFIG_SV2_AUTHORITY_PUBKEY, ""); }
+    inline const char* getFallbackSV2AuthorityPubkeyShared() { return nvs_config_get_string_shared(NVS_CONFIG_FB_SV2_AUTHORITY_PUBKEY, ""); }
+
     // ---- String Setters ----
     inline void setWifiSSID(const char* value) { nvs_config_set_string(NVS_CONFIG_WIFI_SSID, value); }
     inline void setWifiPass(const char* value) { nvs_config_set_string(NVS_CONFIG_WIFI_PASS, value); }
@@ -172,9 +227,17 @@ namespace Config {
     inline uint16_t getFanSpeed() { return nvs_config_get_u16(NVS_CONFIG_FAN_SPEED, CONFIG_FAN_SPEED); }
     inline uint16_t getOverheatTemp() { return nvs_config_get_u16(NVS_CONFIG_OVERHEAT_TEMP, CONFIG_OVERHEAT_TEMP); }
     inline uint16_t getInfluxPort() { return nvs_config_get_u16(NVS_CONFIG_INFLUX_PORT, CONFIG_INFLUX_PORT); }
+    inline uint16_t getInfluxSampleInterval() { return nvs_config_get_u16(NVS_CONFIG_INFLUX_SAMPLE, 5); } // seconds
+    inline uint16_t getInfluxFlushInterval() { return nvs_config_get_u16(NVS_CONFIG_INFLUX_FLUSH, 30); } // seconds
+    inline uint16_t getInfluxBatchSize() { return nvs_config_get_u16(NVS_CONFIG_INFLUX_BATCH, 12); }
     inline uint16_t getTempControlMode() { return nvs_config_get_u16(NVS_CONFIG_AUTO_FAN_SPEED, CONFIG_AUTO_FAN_SPEED_VALUE); }
     inline uint16_t getPoolMode() { return nvs_config_get_u16(NVS_CONFIG_POOL_MODE, 0); }
     inline uint16_t getPoolBalance() { return nvs_config_get_u16(NVS_CONFIG_POOL_MODE_BALANCE, 50); }
+    inline uint16_t getAutoTuneGoal() { return nvs_config_get_u16(NVS_CONFIG_AUTOTUNE_GOAL, 0); }
+    inline uint16_t getAutoTuneMaxPower() { return nvs_config_get_u16(NVS_CONFIG_AUTOTUNE_MAX_POWER, 0); } // W, 0 = no limit
+    inline uint16_t getAutoTuneMaxTemp() { return nvs_config_get_u16(NVS_CONFIG_AUTOTUNE_MAX_TEMP, 65); } // °C
+    inline uint16_t getAutoTuneSettle() { return nvs_config_get_u16(NVS_CONFIG_AUTOTUNE_SETTLE, 60); } // seconds
+    inline uint16_t getAutoTuneMeasure() { return nvs_config_get_u16(NVS_CONFIG_AUTOTUNE_MEASURE, 180); } // seconds
 
     // ---- uint16_t Setters ----
     inline void setAsicFrequency(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_ASIC_FREQ, value); }
@@ -185,9 +248,17 @@ namespace Config {
     inline void setFanSpeed(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_FAN_SPEED, value); }
     inline void setOverheatTemp(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_OVERHEAT_TEMP, value); }
     inline void setInfluxPort(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_INFLUX_PORT, value); }
+    inline void setInfluxSampleInterval(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_INFLUX_SAMPLE, value); }
+    inline void setInfluxFlushInterval(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_INFLUX_FLUSH, value); }
+    inline void setInfluxBatchSize(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_INFLUX_BATCH, value); }
     inline void setTempControlMode(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_AUTO_FAN_SPEED, value); }
     inline void setPoolMode(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_POOL_MODE, value); }
     inline void setPoolBalance(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_POOL_MODE_BALANCE, value); }
+    inline void setAutoTuneGoal(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_AUTOTUNE_GOAL, value); }
+    inline void setAutoTuneMaxPower(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_AUTOTUNE_MAX_POWER, value); }
+    inline void setAutoTuneMaxTemp(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_AUTOTUNE_MAX_TEMP, value); }
+    inline void setAutoTuneSettle(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_AUTOTUNE_SETTLE, value); }
+    inline void setAutoTuneMeasure(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_AUTOTUNE_MEASURE, value); }
 
     inline void setPidTargetTemp(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_PID_TARGET_TEMP, value); }
     inline void setPidP(uint16_t value) { nvs_config_set_u16(NVS_CONFIG_PID_P, value); }
@@ -277,6 +348,7 @@ namespace Config {
     inline bool isDiscordBestDiffAlertEnabled() { return nvs_config_get_u16(NVS_CONFIG_ALERT_DISCORD_BEST_DIFF, CONFIG_ALERT_DISCORD_BEST_DIFF_ENABLE_VALUE) != 0; }
     inline bool isDiscordCoinbaseVerifyAlertEnabled() { return nvs_config_get_u16(NVS_CONFIG_ALERT_DISCORD_COINBASE_VERIFY, 0) != 0; }
     inline bool isStratumKeepaliveEnabled() { return nvs_config_get_u16(NVS_CONFIG_STRATUM_KEEPALIVE, CONFIG_STRATUM_KEEPALIVE_ENABLE_VALUE) != 0; }
+    inline bool isStratumHotStandbyEnabled() { return nvs_config_get_u16(NVS_CONFIG_STRATUM_HOT_STANDBY, 0) != 0; }
     inline bool isStratumEnonceSubscribe() { return nvs_config_get_u16(NVS_CONFIG_STRATUM_ENONCE_SUB, CONFIG_STRATUM_ENONCE_SUBSCRIBE_VALUE) != 0; }
     inline bool isStratumFallbackEnonceSubscribe() { return nvs_config_get_u16(NVS_CONFIG_STRATUM_FALLBACK_ENONCE_SUB, CONFIG_STRATUM_FALLBACK_ENONCE_SUBSCRIBE_VALUE) != 0; }
     inline bool isStratumTLS() { return nvs_config_get_u16(NVS_CONFIG_STRATUM_TLS, CONFIG_STRATUM_TLS_VALUE) != 0; }
@@ -310,6 +382,7 @@ namespace Config {
     inline void setDiscordAlertBestDiffEnabled(bool value) { nvs_config_set_u16(NVS_CONFIG_ALERT_DISCORD_BEST_DIFF, value ? 1 : 0); }
     inline void setDiscordCoinbaseVerifyAlertEnabled(bool value) { nvs_config_set_u16(NVS_CONFIG_ALERT_DISCORD_COINBASE_VERIFY, value ? 1 : 0); }
     inline void setStratumKeepaliveEnabled(bool value) { nvs_config_set_u16(NVS_CONFIG_STRATUM_KEEPALIVE, value ? 1 : 0); }
+    inline void setStratumHotStandbyEnabled(bool value) { nvs_config_set_u16(NVS_CONFIG_STRATUM_HOT_STANDBY, value ? 1 : 0); }
     inline void setStratumEnonceSubscribe(bool value) { nvs_config_set_u16(NVS_CONFIG_STRATUM_ENONCE_SUB, value ? 1 : 0); }
     inline void setStratumFallbackEnonceSubscribe(bool value) { nvs_config_set_u16(NVS_CONFIG_STRATUM_FALLBACK_ENONCE_SUB, value ? 1 : 0); }
     inline void setStratumTLS(bool value) { nvs_config_set_u16(NVS_CONFIG_STRATUM_TLS, value ? 1 : 0); }
@@ -338,6 +411,8 @@ namespace Config {
     inline void setOTPReplayState(int64_t base_step, uint8_t mask) {
         nvs_config_set_u64(NVS_CONFIG_OTP_LAST_STEP, (uint64_t) base_step);
         nvs_config_set_u16(NVS_CONFIG_OTP_USED_MASK, (uint16_t)(mask & 0x07));
+        // a used code must stay used across a power loss
+        flush();
     }
 
     inline void setOTPSecret(const char* value) { nvs_config_set_string(NVS_CONFIG_OTP_SECRET, value); }
@@ -0,0 +1,161 @@
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/netdb.h"
+
+#include "dns_cache.h"
+#include "macros.h"
+
+static const char *TAG = "DNS";
+
+bool DnsCache::resolve(const char *host, char *ip, size_t ip_len)
+{
+    struct addrinfo hints;
+    struct addrinfo *res;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET; // IPv4
+
+    // blocking lookup
+    int err = getaddrinfo(host, NULL, &hints, &res);
+    if (err != 0 || res == NULL) {
+        ESP_LOGE(TAG, "DNS lookup of %s failed: %d", host, err);
+        return false;
+    }
+
+    struct sockaddr_in *addr = (struct sockaddr_in *) res->ai_addr;
+    inet_ntop(AF_INET, &(addr->sin_addr), ip, ip_len);
+
+    freeaddrinfo(res);
+    return true;
+}
+
+DnsCache::entry_t *DnsCache::findLocked(const char *host)
+{
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        if (m_entries[i].host[0] && !strcmp(m_entries[i].host, host)) {
+            return &m_entries[i];
+        }
+    }
+    return nullptr;
+}
+
+void DnsCache::storeLocked(const char *host, const char *ip, int64_t now)
+{
+    entry_t *e = findLocked(host);
+    if (!e) {
+        // free slot or the oldest entry
+        e = &m_entries[0];
+        for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+            if (!m_entries[i].host[0]) {
+                e = &m_entries[i];
+                break;
+            }
+            if (m_entries[i].resolvedUs < e->resolvedUs) {
+                e = &m_entries[i];
+            }
+        }
+        strlcpy(e->host, host, sizeof(e->host));
+    }
+    strlcpy(e->ip, ip, sizeof(e->ip));
+    e->resolvedUs = now;
+}
+
+bool DnsCache::lookup(const char *host, char *ip, size_t ip_len)
+{
+    {
+        PThreadGuard g(m_mutex);
+        m_stats.lookups++;
+
+        entry_t *e = findLocked(host);
+        if (e && esp_timer_get_time() - e->resolvedUs < (int64_t) DNS_CACHE_TTL_S * 1000000) {
+            m_stats.hits++;
+            strlcpy(ip, e->ip, ip_len);
+            return true;
+        }
+    }
+
+    // not holding the lock while the resolver blocks
+    char resolved[INET_ADDRSTRLEN];
+    bool ok = resolve(host, resolved, sizeof(resolved));
+
+    PThreadGuard g(m_mutex);
+    if (ok) {
+        storeLocked(host, resolved, esp_timer_get_time());
+        strlcpy(ip, resolved, ip_len);
+        ESP_LOGI(TAG, "Resolved %s: %s", host, ip);
+        return true;
+    }
+
+    // an old address is better than none
+    entry_t *e = findLocked(host);
+    if (e) {
+        m_stats.stale++;
+        strlcpy(ip, e->ip, ip_len);
+        ESP_LOGW(TAG, "Using cached address of %s: %s", host, ip);
+        return true;
+    }
+
+    m_stats.failures++;
+    return false;
+}
+
+void DnsCache::refresh()
+{
+    for (int i = 0; i < DNS_CACHE_SIZE; i++) {
+        char host[DNS_CACHE_HOST_MAX_LEN];
+        {
+            PThreadGuard g(m_mutex);
+            entry_t *e = &m_entries[i];
+            if (!e->host[0] || esp_timer_get_time() - e->resolvedUs < (int64_t) DNS_CACHE_REFRESH_S * 1000000) {
+                continue;
+            }
+            strlcpy(host, e->host, sizeof(host));
+        }
+
+        char ip[INET_ADDRSTRLEN];
+        if (!resolve(host, ip, sizeof(ip))) {
+            // keep the old entry, the next round tries again
+            continue;
+        }
+
+        PThreadGuard g(m_mutex);
+        m_stats.refreshes++;
+        storeLocked(host, ip, esp_timer_get_time());
+    }
+}
+
+void DnsCache::taskWrapper(void *pvParameters)
+{
+    DnsCache *cache = static_cast<DnsCache *>(pvParameters);
+    cache->task();
+}
+
+void DnsCache::task()
+{
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(DNS_CACHE_CHECK_S * 1000));
+        refresh();
+    }
+}
+
+void DnsCache::expire(const char *host)
+{
+    PThreadGuard g(m_mutex);
+    entry_t *e = findLocked(host);
+    if (e) {
+        // the address stays available as stale fallback
+        e->resolvedUs = esp_timer_get_time() - (int64_t) DNS_CACHE_TTL_S * 1000000 - 1;
+    }
+}
+
+void DnsCache::getStats(dns_cache_stats_t *stats)
+{
+    PThreadGuard g(m_mutex);
+    *stats = m_stats;
+}
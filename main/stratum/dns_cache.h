@@ -0,0 +1,71 @@
+#pragma once
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "lwip/inet.h"
+
+// hosts of both pools plus a few after config changes
+#define DNS_CACHE_SIZE 4
+#define DNS_CACHE_HOST_MAX_LEN 128
+
+// lwIP doesn't report the record TTL, entries are considered fresh for this long
+#define DNS_CACHE_TTL_S 300
+
+// entries older than this are resolved again in the background
+#define DNS_CACHE_REFRESH_S 240
+
+// how often the refresh task checks the entries
+#define DNS_CACHE_CHECK_S 30
+
+typedef struct
+{
+    uint32_t lookups;   // resolve requests of the stratum tasks
+    uint32_t hits;      // answered from a fresh entry
+    uint32_t stale;     // resolver failed, answered from an expired entry
+    uint32_t failures;  // resolver failed and nothing cached
+    uint32_t refreshes; // background re-resolves
+} dns_cache_stats_t;
+
+// Resolver cache for the pool hosts
+//
+// Reconnects use the cached address instead of a blocking getaddrinfo.
+// The refresh task (taskWrapper, low priority) keeps the entries fresh, so a
+// failover never waits for DNS and the stratum manager never blocks in the
+// resolver. If the resolver fails, the last known address is used.
+class DnsCache {
+  protected:
+    typedef struct
+    {
+        char host[DNS_CACHE_HOST_MAX_LEN]; // "" = unused
+        char ip[INET_ADDRSTRLEN];
+        int64_t resolvedUs;
+    } entry_t;
+
+    entry_t m_entries[DNS_CACHE_SIZE] = {};
+    dns_cache_stats_t m_stats = {};
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    entry_t *findLocked(const char *host);
+    void storeLocked(const char *host, const char *ip, int64_t now);
+
+    static bool resolve(const char *host, char *ip, size_t ip_len);
+
+    void task();
+
+  public:
+    // task entry, the parameter is the DnsCache
+    static void taskWrapper(void *pvParameters);
+
+    // resolves the host, returns false if there is no address at all
+    bool lookup(const char *host, char *ip, size_t ip_len);
+
+    // re-resolves entries which are about to expire
+    void refresh();
+
+    // forces a new lookup, e.g. when the cached address refused the connection
+    void expire(const char *host);
+
+    void getStats(dns_cache_stats_t *stats);
+};
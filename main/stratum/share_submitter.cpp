@@ -0,0 +1,230 @@
+#include <string.h>
+#include <algorithm>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "global_state.h"
+#include "macros.h"
+#include "share_submitter.h"
+#include "stratum_manager.h"
+#include "utils.h"
+
+static const uint32_t latency_limits_ms[SHARE_LATENCY_BUCKETS] = SHARE_LATENCY_LIMITS_MS;
+
+ShareSubmitter::ShareSubmitter(StratumManager *manager, int index) : m_manager(manager), m_index(index)
+{
+    m_tag = index ? "share submit (Sec)" : "share submit (Pri)";
+}
+
+bool ShareSubmitter::start()
+{
+    m_queue = xQueueCreate(SHARE_QUEUE_LEN, sizeof(share_submit_t));
+    if (!m_queue) {
+        ESP_LOGE(m_tag, "Failed to create queue");
+        return false;
+    }
+
+    if (xTaskCreatePSRAM(taskWrapper, m_index ? "submit (sec)" : "submit (pri)", 8192, (void *) this, 5, NULL) != pdPASS) {
+        ESP_LOGE(m_tag, "Failed to create task");
+        return false;
+    }
+    return true;
+}
+
+void ShareSubmitter::taskWrapper(void *pvParameters)
+{
+    ShareSubmitter *submitter = (ShareSubmitter *) pvParameters;
+    submitter->task();
+}
+
+bool ShareSubmitter::enqueue(const char *jobid, const char *extranonce_2, uint32_t ntime, uint32_t nonce,
+                             uint32_t version_rolled, uint32_t version_base, uint8_t source)
+{
+    share_submit_t share;
+    strlcpy(share.jobid, jobid, sizeof(share.jobid));
+    strlcpy(share.extranonce2, extranonce_2 ? extranonce_2 : "", sizeof(share.extranonce2));
+    share.ntime = ntime;
+    share.nonce = nonce;
+    share.version_rolled = version_rolled;
+    share.version_base = version_base;
+    share.queuedUs = esp_timer_get_time();
+    share.source = source;
+
+    bool ok = m_queue && xQueueSend(m_queue, &share, 0) == pdTRUE;
+
+    PThreadGuard g(m_mutex);
+    if (!ok) {
+        m_stats.dropped++;
+        ESP_LOGE(m_tag, "submit queue full, dropping share");
+        return false;
+    }
+    m_stats.queued++;
+    return true;
+}
+
+void ShareSubmitter::task()
+{
+    while (1) {
+        if (xQueueReceive(m_queue, &m_batch[0], portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+
+        // everything that queued up in the meantime goes out with the same write
+        int count = 1;
+        while (count < SHARE_BATCH_MAX && xQueueReceive(m_queue, &m_batch[count], 0) == pdTRUE) {
+            count++;
+        }
+
+        // the response can be dispatched by the stratum task before the write
+        // returns, so the submits are pending before they go out
+        int first_id = m_manager->reserveShareIds(m_index, count);
+        int64_t now = esp_timer_get_time();
+        int sent = 0;
+        if (first_id < 0) {
+            ESP_LOGE(m_tag, "pool not connected, dropping %d shares", count);
+        } else {
+            addPending(first_id, count, now);
+            sent = m_manager->sendShares(m_index, m_batch, count, first_id);
+        }
+
+        PThreadGuard g(m_mutex);
+        if (first_id >= 0) {
+            removePendingLocked(first_id + sent, count - sent);
+        }
+        m_stats.dropped += count - sent;
+        if (!sent) {
+            continue;
+        }
+        m_stats.sent += sent;
+        m_stats.writes++;
+
+        for (int i = 0; i < sent; i++) {
+            uint32_t queue_time_us = (uint32_t) (now - m_batch[i].queuedUs);
+            m_stats.queueTimeSumUs += queue_time_us;
+            m_stats.queueTimeMaxUs = std::max(m_stats.queueTimeMaxUs, queue_time_us);
+        }
+    }
+}
+
+void ShareSubmitter::addPending(int first_id, int count, int64_t sentUs)
+{
+    PThreadGuard g(m_mutex);
+    for (int i = 0; i < count; i++) {
+        // oldest pending submits are overwritten if the pool never answers them
+        pending_t *p = &m_pending[m_pendingNext];
+        p->id = first_id + i;
+        p->sentUs = sentUs;
+        p->source = m_batch[i].source;
+        p->used = true;
+        m_pendingNext = (m_pendingNext + 1) % SHARE_PENDING_MAX;
+    }
+}
+
+void ShareSubmitter::removePendingLocked(int first_id, int count)
+{
+    for (int i = 0; i < SHARE_PENDING_MAX && count > 0; i++) {
+        pending_t *p = &m_pending[i];
+        if (p->used && (uint32_t) p->id - (uint32_t) first_id < (uint32_t) count) {
+            p->used = false;
+        }
+    }
+}
+
+void ShareSubmitter::recordLatencyLocked(int64_t latency_us)
+{
+    uint32_t latency_ms = (uint32_t) (latency_us / 1000);
+
+    int bucket = 0;
+    while (latency_ms >= latency_limits_ms[bucket] && bucket < SHARE_LATENCY_BUCKETS - 1) {
+        bucket++;
+    }
+
+    m_stats.acks++;
+    m_stats.latency[bucket]++;
+    m_stats.latencySumUs += (uint64_t) latency_us;
+    m_stats.latencyMaxMs = std::max(m_stats.latencyMaxMs, latency_ms);
+}
+
+int ShareSubmitter::onResponse(int id)
+{
+    int64_t now = esp_timer_get_time();
+
+    PThreadGuard g(m_mutex);
+    for (int i = 0; i < SHARE_PENDING_MAX; i++) {
+        pending_t *p = &m_pending[i];
+        if (p->used && p->id == id) {
+            recordLatencyLocked(now - p->sentUs);
+            p->used = false;
+            return p->source;
+        }
+    }
+    m_stats.unmatched++;
+    return -1;
+}
+
+int ShareSubmitter::takePending(int id)
+{
+    PThreadGuard g(m_mutex);
+    for (int i = 0; i < SHARE_PENDING_MAX; i++) {
+        pending_t *p = &m_pending[i];
+        if (p->used && p->id == id) {
+            p->used = false;
+            return p->source;
+        }
+    }
+    return -1;
+}
+
+int ShareSubmitter::takePendingUpTo(int last_id, uint8_t *sources, int max)
+{
+    int count = 0;
+
+    PThreadGuard g(m_mutex);
+    for (int i = 0; i < SHARE_PENDING_MAX && count < max; i++) {
+        pending_t *p = &m_pending[i];
+        // ids are sequence numbers that may wrap
+        if (p->used && (int32_t) ((uint32_t) p->id - (uint32_t) last_id) <= 0) {
+            p->used = false;
+            sources[count++] = p->source;
+        }
+    }
+    return count;
+}
+
+void ShareSubmitter::recordLatency(int64_t latency_us)
+{
+    PThreadGuard g(m_mutex);
+    recordLatencyLocked(latency_us);
+}
+
+void ShareSubmitter::clearPending()
+{
+    PThreadGuard g(m_mutex);
+    memset(m_pending, 0, sizeof(m_pending));
+    m_pendingNext = 0;
+}
+
+void ShareSubmitter::getStats(share_submit_stats_t *stats)
+{
+    PThreadGuard g(m_mutex);
+    *stats = m_stats;
+}
+
+uint32_t ShareSubmitter::percentileMs(const share_submit_stats_t *stats, float p)
+{
+    if (!stats->acks) {
+        return 0;
+    }
+
+    uint32_t target = (uint32_t) (p * stats->acks);
+    uint32_t sum = 0;
+    for (int i = 0; i < SHARE_LATENCY_BUCKETS - 1; i++) {
+        sum += stats->latency[i];
+        if (sum > target) {
+            return latency_limits_ms[i];
+        }
+    }
+    // open bucket, the max is the best guess
+    return stats->latencyMaxMs;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+
+#include "mining.h"
+
+// shares waiting to be written to the socket
+#define SHARE_QUEUE_LEN 16
+
+// max number of shares coalesced into one socket write
+#define SHARE_BATCH_MAX 8
+
+// submits waiting for their response
+#define SHARE_PENDING_MAX 32
+
+// submit-to-ack latency buckets, upper limits in ms, the last one is open
+#define SHARE_LATENCY_BUCKETS 8
+#define SHARE_LATENCY_LIMITS_MS {25, 50, 100, 250, 500, 1000, 2500, UINT32_MAX}
+
+// who found the share: the own ASICs or the CAN slave with this id
+#define SHARE_SOURCE_LOCAL 0
+
+typedef struct share_submit
+{
+    char jobid[BM_JOB_ID_MAX_LEN];
+    char extranonce2[BM_JOB_EXTRANONCE2_MAX_LEN];
+    uint32_t ntime;
+    uint32_t nonce;
+    uint32_t version_rolled; // full rolled version (base | rolled bits)
+    uint32_t version_base;   // original block template version
+    int64_t queuedUs;
+    uint8_t source;          // SHARE_SOURCE_LOCAL or CAN slave id
+} share_submit_t;
+
+typedef struct
+{
+    uint32_t queued;         // shares put into the queue
+    uint32_t dropped;        // shares dropped because the queue was full or the pool disconnected
+    uint32_t sent;           // shares written to the socket
+    uint32_t writes;         // socket writes, sent / writes is the coalescing factor
+    uint32_t acks;           // responses matched to a submit
+    uint32_t unmatched;      // responses without a pending submit
+    uint32_t queueTimeMaxUs; // time between result and socket write
+    uint64_t queueTimeSumUs;
+    uint32_t latencyMaxMs;   // time between socket write and response
+    uint64_t latencySumUs;   // in us, most acks take less than a ms on a LAN
+    uint32_t latency[SHARE_LATENCY_BUCKETS];
+} share_submit_stats_t;
+
+class StratumManager;
+
+// Asynchronous share submission for one pool
+//
+// The result tasks only copy the share into a queue, a separate task writes
+// it to the pool. Shares found while a write is in progress are coalesced
+// into the next write. Request ids are remembered with their send time to
+// build the submit-to-ack latency histogram when the response arrives.
+class ShareSubmitter {
+  protected:
+    StratumManager *m_manager;
+    int m_index;
+    const char *m_tag;
+
+    QueueHandle_t m_queue = nullptr;
+    share_submit_t m_batch[SHARE_BATCH_MAX];
+
+    typedef struct
+    {
+        int id;
+        int64_t sentUs;
+        uint8_t source;
+        bool used;
+    } pending_t;
+
+    pending_t m_pending[SHARE_PENDING_MAX] = {};
+    int m_pendingNext = 0;
+
+    share_submit_stats_t m_stats = {};
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    void task();
+    void recordLatencyLocked(int64_t latency_us);
+
+    // submits of the batch with the ids first_id.. are pending from sentUs on
+    void addPending(int first_id, int count, int64_t sentUs);
+    // forgets the submits that were not sent
+    void removePendingLocked(int first_id, int count);
+
+  public:
+    ShareSubmitter(StratumManager *manager, int index);
+
+    bool start();
+    static void taskWrapper(void *pvParameters);
+
+    // called by the result tasks, never blocks
+    bool enqueue(const char *jobid, const char *extranonce_2, uint32_t ntime, uint32_t nonce, uint32_t version_rolled,
+                 uint32_t version_base, uint8_t source);
+
+    // response to the submit with the given id (stratum v1), returns its source or -1
+    int onResponse(int id);
+
+    // response without latency measurement (stratum v2 error), returns the source or -1
+    int takePending(int id);
+
+    // all submits up to last_id were answered (stratum v2 success), returns
+    // the number of sources written to sources
+    int takePendingUpTo(int last_id, uint8_t *sources, int max);
+
+    // response without an id, latency measured by the protocol (stratum v2)
+    void recordLatency(int64_t latency_us);
+
+    // forget pending submits, ids start over after a reconnect
+    void clearPending();
+
+    void getStats(share_submit_stats_t *stats);
+
+    // upper limit of the bucket containing the given percentile (0..1)
+    static uint32_t percentileMs(const share_submit_stats_t *stats, float p);
+};
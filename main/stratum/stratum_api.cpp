@@ -8,9 +8,6 @@
 
 #include "stratum_api.h" // Assumes that types like StratumApiV1Message,
                          // mining_notify, STRATUM_ID_SUBSCRIBE, etc., are defined here.
-#include "ArduinoJson.h"
-#include "psram_allocator.h"
-
 #include "esp_log.h"
 #include "esp_ota_ops.h"
 #include "lwip/sockets.h"
@@ -21,14 +18,17 @@
 
 
 #include "macros.h"
+#include "mining.h"
+#include "share_submitter.h"
 
 // The logging tag for ESP logging.
 static const char *TAG = "stratum_api";
 
-StratumApi::StratumApi() : m_len(0), m_send_uid(1)
+StratumApi::StratumApi() : m_len(0), m_start(0), m_consumed(0), m_send_uid(1)
 {
     m_buffer = (char *) MALLOC(BIG_BUFFER_SIZE);
     m_requestBuffer = (char *) MALLOC(BUFFER_SIZE);
+    m_submitBuffer = (char *) MALLOC(SUBMIT_BUFFER_SIZE);
     clearBuffer();
 }
 
@@ -36,33 +36,7 @@ StratumApi::~StratumApi()
 {
     safe_free(m_buffer);
     safe_free(m_requestBuffer);
-}
-
-uint8_t StratumApi::hex2val(char c)
-{
-    if (c >= '0' && c <= '9') {
-        return c - '0';
-    } else if (c >= 'a' && c <= 'f') {
-        return c - 'a' + 10;
-    } else if (c >= 'A' && c <= 'F') {
-        return c - 'A' + 10;
-    } else {
-        return 0;
-    }
-}
-
-size_t StratumApi::hex2bin(const char *hex, uint8_t *bin, size_t bin_len)
-{
-    size_t len = 0;
-    while (*hex && len < bin_len) {
-        bin[len] = hex2val(*hex++) << 4;
-        if (!*hex) {
-            len++;
-            break;
-        }
-        bin[len++] |= hex2val(*hex++);
-    }
-    return len;
+    safe_free(m_submitBuffer);
 }
 
 void StratumApi::debugTx(const char *msg)
@@ -79,60 +53,63 @@ void StratumApi::debugTx(const char *msg)
 // receiveJsonRpcLine()
 //--------------------------------------------------------------------
 // Accumulates data from the given socket until a newline is found.
-// Returns a dynamically allocated line (caller must free the returned memory).
+// Returns the line in place inside the receive buffer, it stays valid
+// until the next call.
 //--------------------------------------------------------------------
 void StratumApi::resetBuffer()
 {
     m_len = 0;
+    m_start = 0;
+    m_consumed = 0;
     m_buffer[0] = '\0';
 }
 
-char *StratumApi::receiveJsonRpcLine(StratumTransport *transport)
+char *StratumApi::receiveJsonRpcLine(StratumTransport *transport, size_t *line_len)
 {
     // This function blocks until either:
     // - a full line (terminated by '\n') is available and returned, or
     // - an error/EOF occurs and NULL is returned.
 
+    // the line returned by the previous call isn't needed anymore
+    m_start += m_consumed;
+    m_consumed = 0;
+
     for (;;) {
         // Check if we already have a complete line in the buffer.
-        char *newline_ptr = strchr(m_buffer, '\n');
+        char *line = m_buffer + m_start;
+        char *newline_ptr = (char *) memchr(line, '\n', m_len - m_start);
         if (newline_ptr != NULL) {
             // Compute line length up to '\n'.
-            size_t line_length = static_cast<size_t>(newline_ptr - m_buffer);
+            size_t line_length = static_cast<size_t>(newline_ptr - line);
 
             // Handle optional '\r' before '\n' (CRLF).
-            if (line_length > 0 && m_buffer[line_length - 1] == '\r') {
+            if (line_length > 0 && line[line_length - 1] == '\r') {
                 line_length--;
             }
 
-            // Allocate memory for the line (without newline / CR).
-            char *line = (char *)MALLOC(line_length + 1);
-            if (line == NULL) {
-                ESP_LOGE(TAG, "Failed to allocate memory for line. Flushing buffer.");
-                resetBuffer();
-                return NULL;
-            }
+            // terminate the line in place, the data is released with the next call
+            line[line_length] = '\0';
+            m_consumed = static_cast<size_t>(newline_ptr - line) + 1; // include '\n'
 
-            // Copy the line and null-terminate it.
-            if (line_length > 0) {
-                memcpy(line, m_buffer, line_length);
+            if (line_len) {
+                *line_len = line_length;
             }
-            line[line_length] = '\0';
+            return line;
+        }
 
-            // Remove the consumed line (including the '\n') from the buffer.
-            size_t consumed = static_cast<size_t>(newline_ptr - m_buffer) + 1; // include '\n'
-            size_t remaining = m_len - consumed;
+        // No newline in buffer yet → move the partial line to the front
+        // (only once per incomplete line instead of once per received line)
+        if (m_start) {
+            size_t remaining = m_len - m_start;
             if (remaining > 0) {
-                memmove(m_buffer, m_buffer + consumed, remaining);
+                memmove(m_buffer, m_buffer + m_start, remaining);
             }
-
             m_len = remaining;
+            m_start = 0;
             m_buffer[m_len] = '\0';
-
-            return line;
         }
 
-        // No newline in buffer yet → need to read more data.
+        // need to read more data.
         if (m_len >= BIG_BUFFER_SIZE - 1) {
             ESP_LOGE(TAG, "Buffer full without newline. Flushing buffer.");
             resetBuffer();
@@ -174,8 +151,12 @@ char *StratumApi::receiveJsonRpcLine(StratumTransport *transport)
     }
 }
 
+bool StratumApi::tokenize(char *line, size_t len)
+{
+    return m_json.tokenize(line, len);
+}
 
-bool StratumApi::parseMethods(JsonDocument &doc, const char *method_str, StratumApiV1Message *message)
+bool StratumApi::parseMethods(const char *method_str, StratumApiV1Message *message)
 {
     message->method = STRATUM_UNKNOWN;
 
@@ -194,67 +175,94 @@ bool StratumApi::parseMethods(JsonDocument &doc, const char *method_str, Stratum
         return false;
     }
 
+    int params = m_json.find(m_json.root(), "params");
+
     switch (message->method) {
     case MINING_NOTIFY: {
         ESP_LOGI(TAG, "mining notify");
-        mining_notify *new_work = (mining_notify *) MALLOC(sizeof(mining_notify));
 
-        JsonArray params = doc["params"].as<JsonArray>();
-
-        new_work->job_id = strdup(params[0].as<const char *>());
-        hex2bin(params[1].as<const char *>(), new_work->_prev_block_hash, HASH_SIZE);
+        // format:
+        // ["job_id", "prevhash", "coinb1", "coinb2", ["merkle", ...], "version", "nbits", "ntime", clean_jobs]
+        int paramsLength = m_json.size(params);
+        if (paramsLength < 8) {
+            ESP_LOGE(TAG, "Invalid params for mining.notify.");
+            return false;
+        }
 
-        new_work->coinbase_1 = strdup(params[2].as<const char *>());
-        new_work->coinbase_2 = strdup(params[3].as<const char *>());
+        mining_notify *new_work = &m_notify;
 
-        JsonArray merkle_branch = params[4].as<JsonArray>();
-        new_work->n_merkle_branches = merkle_branch.size();
+        int merkle_branch = m_json.child(params, 4);
+        new_work->n_merkle_branches = m_json.size(merkle_branch);
         if (new_work->n_merkle_branches > MAX_MERKLE_BRANCHES) {
             ESP_LOGE(TAG, "Too many Merkle branches.");
-            freeMiningNotify(new_work);
-            safe_free(new_work);
             return false;
         }
 
+        // hex fields are decoded directly from the receive buffer, a field
+        // that doesn't decode completely rejects the whole notify, m_notify
+        // would mix it with the fields of the previous one
+        bool hexOk = m_json.hexToBin(m_json.child(params, 1), new_work->_prev_block_hash, HASH_SIZE);
         for (size_t i = 0; i < new_work->n_merkle_branches; i++) {
-            hex2bin(merkle_branch[i].as<const char *>(), new_work->_merkle_branches[i], HASH_SIZE);
+            hexOk = hexOk && m_json.hexToBin(m_json.child(merkle_branch, i), new_work->_merkle_branches[i], HASH_SIZE);
+        }
+        hexOk = hexOk && m_json.hexUint32(m_json.child(params, 5), &new_work->version) &&
+                m_json.hexUint32(m_json.child(params, 6), &new_work->target) &&
+                m_json.hexUint32(m_json.child(params, 7), &new_work->ntime);
+
+        // the coinbase parts are decoded when the job is built
+        hexOk = hexOk && m_json.isHex(m_json.child(params, 2)) && m_json.isHex(m_json.child(params, 3));
+        if (!hexOk) {
+            ESP_LOGE(TAG, "Invalid hex field in mining.notify, ignored.");
+            return false;
         }
 
-        new_work->version = strtoul(params[5].as<const char *>(), NULL, 16);
-        new_work->target = strtoul(params[6].as<const char *>(), NULL, 16);
-        new_work->ntime = strtoul(params[7].as<const char *>(), NULL, 16);
+        // strings stay in the receive buffer
+        new_work->job_id = (char *) m_json.string(m_json.child(params, 0));
+        new_work->coinbase_1 = (char *) m_json.string(m_json.child(params, 2));
+        new_work->coinbase_2 = (char *) m_json.string(m_json.child(params, 3));
 
-        message->mining_notification = new_work;
+        if (!new_work->job_id || !new_work->coinbase_1 || !new_work->coinbase_2) {
+            ESP_LOGE(TAG, "Invalid params for mining.notify.");
+            return false;
+        }
+
+        // jobs store the id inline, a cut id would get every share rejected
+        if (strlen(new_work->job_id) >= BM_JOB_ID_MAX_LEN) {
+            ESP_LOGE(TAG, "Job id too long (%d chars, max %d), mining.notify ignored.", (int) strlen(new_work->job_id),
+                     BM_JOB_ID_MAX_LEN - 1);
+            return false;
+        }
 
-        int paramsLength = params.size();
-        message->should_abandon_work = params[paramsLength - 1].as<bool>();
+        message->mining_notification = new_work;
+        message->should_abandon_work = m_json.asBool(m_json.child(params, paramsLength - 1));
         break;
     }
     case MINING_SET_DIFFICULTY:
-        message->new_difficulty = doc["params"][0].as<uint32_t>();
+        message->new_difficulty = (uint32_t) m_json.asDouble(m_json.child(params, 0));
         break;
     case MINING_SET_VERSION_MASK:
-        message->version_mask = strtoul(doc["params"][0].as<const char *>(), NULL, 16);
+        if (!m_json.hexUint32(m_json.child(params, 0), &message->version_mask)) {
+            ESP_LOGE(TAG, "Invalid version mask.");
+            return false;
+        }
         break;
     case MINING_SET_EXTRANONCE: {
         ESP_LOGI(TAG, "mining.set_extranonce");
 
         // format:
         // {"id": null, "method": "mining.set_extranonce", "params": ["<new_extranonce1>", <extranonce2_size>]}
-        JsonArray params = doc["params"].as<JsonArray>();
-
-        if (params.size() < 2) {
+        if (m_json.size(params) < 2) {
             ESP_LOGE(TAG, "Invalid result array for subscribe.");
             return false;
         }
-        message->extranonce_2_len = params[1].as<int>();
+        message->extranonce_2_len = m_json.asInt(m_json.child(params, 1));
 
-        const char *extranonce_str = params[0].as<const char *>();
+        const char *extranonce_str = m_json.string(m_json.child(params, 0));
         if (!extranonce_str) {
             ESP_LOGE(TAG, "extranonce is null");
             return false;
         }
-        message->extranonce_str = strdup(extranonce_str);
+        message->extranonce_str = (char *) extranonce_str;
 
         ESP_LOGI(TAG, "extranonce_str: %s", message->extranonce_str);
         ESP_LOGI(TAG, "extranonce_2_len: %d", message->extranonce_2_len);
@@ -264,56 +272,64 @@ bool StratumApi::parseMethods(JsonDocument &doc, const char *method_str, Stratum
         break;
     }
 
-    // ESP_LOGI(TAG, "allocs: %d, deallocs: %d, reallocs: %d", allocs, deallocs, reallocs);
     return true;
 }
 
-bool StratumApi::parseResult(JsonDocument &doc) {
-    JsonVariant result_json = doc["result"];
-    JsonVariant error_json = doc["error"];
+bool StratumApi::parseResult()
+{
+    int result_json = m_json.find(m_json.root(), "result");
+    int error_json = m_json.find(m_json.root(), "error");
 
-    if (!error_json.isNull()) {
+    if (!m_json.isNull(error_json)) {
         return false;
     }
 
-    if (!result_json.isNull()) {
-        return result_json.is<bool>() ? result_json.as<bool>() : false;
-    }
+    // only a boolean true is a success
+    return m_json.asBool(result_json);
+}
 
-    return false;
+// [21, "Job not found", null] is the usual answer to a stale share
+bool StratumApi::isStaleError()
+{
+    int error_json = m_json.find(m_json.root(), "error");
+    if (m_json.asInt(m_json.child(error_json, 0)) == 21) {
+        return true;
+    }
+    const char *msg = m_json.string(m_json.child(error_json, 1));
+    return msg && (strstr(msg, "stale") || strstr(msg, "Stale"));
 }
 
-bool StratumApi::parseResponses(JsonDocument &doc, StratumApiV1Message *message)
+bool StratumApi::parseResponses(StratumApiV1Message *message)
 {
     message->method = STRATUM_RESULT;
-    message->response_success = parseResult(doc);
+    message->response_success = parseResult();
+    message->response_stale = !message->response_success && isStaleError();
     return true;
 }
 
-bool StratumApi::parseSetupResponses(JsonDocument &doc, StratumApiV1Message *message)
+bool StratumApi::parseSetupResponses(StratumApiV1Message *message)
 {
     // first messages are responses to our mining setup requests
     message->method = STRATUM_UNKNOWN;
 
-    JsonVariant result_json = doc["result"];
+    int result_json = m_json.find(m_json.root(), "result");
 
     switch (message->message_id) {
     case STRATUM_ID_SUBSCRIBE: {
         message->method = STRATUM_RESULT_SUBSCRIBE;
 
-        JsonArray result_arr = result_json.as<JsonArray>();
-        if (result_arr.size() < 3) {
+        if (m_json.size(result_json) < 3) {
             ESP_LOGE(TAG, "Invalid result array for subscribe.");
             return false;
         }
-        message->extranonce_2_len = result_arr[2].as<int>();
+        message->extranonce_2_len = m_json.asInt(m_json.child(result_json, 2));
 
-        const char *extranonce_str = result_arr[1].as<const char *>();
+        const char *extranonce_str = m_json.string(m_json.child(result_json, 1));
         if (!extranonce_str) {
             ESP_LOGE(TAG, "extranonce is null");
             return false;
         }
-        message->extranonce_str = strdup(extranonce_str);
+        message->extranonce_str = (char *) extranonce_str;
 
         ESP_LOGI(TAG, "extranonce_str: %s", message->extranonce_str);
         ESP_LOGI(TAG, "extranonce_2_len: %d", message->extranonce_2_len);
@@ -322,27 +338,26 @@ bool StratumApi::parseSetupResponses(JsonDocument &doc, StratumApiV1Message *mes
     case STRATUM_ID_CONFIGURE: {
         message->method = STRATUM_RESULT_VERSION_MASK;
 
-        const char *mask = result_json["version-rolling.mask"].as<const char *>();
-        if (!mask) {
+        int mask = m_json.find(result_json, "version-rolling.mask");
+        if (!m_json.hexUint32(mask, &message->version_mask)) {
             return false;
         }
-        message->version_mask = strtoul(mask, NULL, 16);
         ESP_LOGI(TAG, "Set version mask: %08lx", message->version_mask);
         break;
     }
     case STRATUM_ID_AUTHORIZE: {
         message->method = STRATUM_RESULT_SETUP;
-        message->response_success = parseResult(doc);
+        message->response_success = parseResult();
         break;
     }
     case STRATUM_ID_SUGGEST_DIFFICULTY: {
         message->method = STRATUM_RESULT_SETUP;
-        message->response_success = parseResult(doc);
+        message->response_success = parseResult();
         break;
     }
     case STRATUM_ID_EXTRANONCE_SUBSCRIBE: {
         message->method = STRATUM_RESULT_SETUP;
-        message->response_success = parseResult(doc);
+        message->response_success = parseResult();
         break;
     }
     default:
@@ -352,53 +367,26 @@ bool StratumApi::parseSetupResponses(JsonDocument &doc, StratumApiV1Message *mes
     return true;
 }
 
-bool StratumApi::parse(StratumApiV1Message *message, const char *stratum_json)
+bool StratumApi::parse(StratumApiV1Message *message)
 {
-    PSRAMAllocator allocator;
-    JsonDocument doc(&allocator);
+    memset(message, 0, sizeof(StratumApiV1Message));
 
-    // Deserialize JSON
-    DeserializationError error = deserializeJson(doc, stratum_json);
-    if (error) {
-        ESP_LOGE(TAG, "Unable to parse JSON: %s", error.c_str());
-        return false;
-    }
-
-    return parse(message, doc);
-}
-
-bool StratumApi::parse(StratumApiV1Message *message, JsonDocument &doc)
-{
     // Extract message ID
-    message->message_id = doc["id"].is<int>() ? doc["id"].as<int>() : -1;
+    message->message_id = m_json.asInt(m_json.find(m_json.root(), "id"), -1);
 
     // Extract method
-    const char *method_str = doc["method"].as<const char *>();
+    const char *method_str = m_json.string(m_json.find(m_json.root(), "method"));
 
     if (method_str) {
-        return parseMethods(doc, method_str, message);
+        return parseMethods(method_str, message);
     } else {
         if (message->message_id <= STRATUM_LAST_SETUP_ID) {
-            return parseSetupResponses(doc, message);
+            return parseSetupResponses(message);
         }
-        return parseResponses(doc, message);
+        return parseResponses(message);
     }
 }
 
-//--------------------------------------------------------------------
-// freeMiningNotify()
-//--------------------------------------------------------------------
-void StratumApi::freeMiningNotify(mining_notify *params)
-{
-    // nothing to free
-    if (!params) {
-        return;
-    }
-    safe_free(params->job_id);
-    safe_free(params->coinbase_1);
-    safe_free(params->coinbase_2);
-}
-
 //--------------------------------------------------------------------
 // send()
 //--------------------------------------------------------------------
@@ -442,7 +430,7 @@ bool StratumApi::subscribe(StratumTransport *transport, const char *device, cons
     const esp_app_desc_t *app_desc = esp_app_get_description();
     const char *version = app_desc->version;
     snprintf(m_requestBuffer, BUFFER_SIZE, "{\"id\": %d, \"method\": \"mining.subscribe\", \"params\": [\"%s/%s/%s\"]}\n",
-             m_send_uid++, device, asic, version);
+             nextUid(), device, asic, version);
 
     return send(transport, m_requestBuffer);
 }
@@ -455,7 +443,7 @@ bool StratumApi::entranonceSubscribe(StratumTransport *transport)
     const esp_app_desc_t *app_desc = esp_app_get_description();
     const char *version = app_desc->version;
     snprintf(m_requestBuffer, BUFFER_SIZE, "{\"id\": %d, \"method\": \"mining.extranonce.subscribe\", \"params\": []}\n",
-        m_send_uid++);
+        nextUid());
 
     return send(transport, m_requestBuffer);
 }
@@ -466,7 +454,7 @@ bool StratumApi::entranonceSubscribe(StratumTransport *transport)
 bool StratumApi::suggestDifficulty(StratumTransport *transport, uint32_t difficulty)
 {
     snprintf(m_requestBuffer, BUFFER_SIZE, "{\"id\": %d, \"method\": \"mining.suggest_difficulty\", \"params\": [%ld]}\n",
-             m_send_uid++, difficulty);
+             nextUid(), difficulty);
 
     return send(transport, m_requestBuffer);
 }
@@ -477,7 +465,7 @@ bool StratumApi::suggestDifficulty(StratumTransport *transport, uint32_t difficu
 bool StratumApi::authenticate(StratumTransport *transport, const char *username, const char *pass)
 {
     snprintf(m_requestBuffer, BUFFER_SIZE, "{\"id\": %d, \"method\": \"mining.authorize\", \"params\": [\"%s\", \"%s\"]}\n",
-             m_send_uid++, username, pass);
+             nextUid(), username, pass);
 
     return send(transport, m_requestBuffer);
 }
@@ -485,14 +473,45 @@ bool StratumApi::authenticate(StratumTransport *transport, const char *username,
 //--------------------------------------------------------------------
 // submitShare()
 //--------------------------------------------------------------------
-bool StratumApi::submitShare(StratumTransport *transport, const char *username, const char *jobid, const char *extranonce_2, uint32_t ntime,
-                             uint32_t nonce, uint32_t version)
+int StratumApi::submitShares(StratumTransport *transport, const char *username, const share_submit_t *shares, int count,
+                             int first_id)
 {
-    snprintf(m_requestBuffer, BUFFER_SIZE,
-             "{\"id\": %d, \"method\": \"mining.submit\", \"params\": [\"%s\", \"%s\", \"%s\", \"%08lx\", \"%08lx\", \"%08lx\"]}\n",
-             m_send_uid++, username, jobid, extranonce_2, ntime, nonce, version);
+    size_t len = 0;
+    int id = first_id;
+    int n;
 
-    return send(transport, m_requestBuffer);
+    for (n = 0; n < count; n++) {
+        const share_submit_t *share = &shares[n];
+
+        // V1 mining.submit expects version rolling bits (delta), not full version
+        uint32_t version_delta = share->version_rolled ^ share->version_base;
+
+        int written = snprintf(m_submitBuffer + len, SUBMIT_BUFFER_SIZE - len,
+                               "{\"id\": %d, \"method\": \"mining.submit\", \"params\": [\"%s\", \"%s\", \"%s\", \"%08lx\", \"%08lx\", \"%08lx\"]}\n",
+                               id + n, username, share->jobid, share->extranonce2, share->ntime, share->nonce, version_delta);
+
+        // the share that didn't fit is dropped
+        if (written < 0 || len + written >= SUBMIT_BUFFER_SIZE) {
+            ESP_LOGE(TAG, "submit buffer full, sending %d of %d shares", n, count);
+            m_submitBuffer[len] = '\0';
+            break;
+        }
+        len += written;
+    }
+
+    if (!n || !send(transport, m_submitBuffer)) {
+        return 0;
+    }
+    return n;
+}
+
+//--------------------------------------------------------------------
+// nextUid()
+//--------------------------------------------------------------------
+int StratumApi::nextUid(int count)
+{
+    // the share submit task takes ids too
+    return __atomic_fetch_add(&m_send_uid, count, __ATOMIC_RELAXED);
 }
 
 //--------------------------------------------------------------------
@@ -503,7 +522,7 @@ bool StratumApi::configureVersionRolling(StratumTransport *transport)
     snprintf(m_requestBuffer, BUFFER_SIZE,
              "{\"id\": %d, \"method\": \"mining.configure\", \"params\": [[\"version-rolling\"], {\"version-rolling.mask\": "
              "\"1fffe000\"}]}\n",
-             m_send_uid++);
+             nextUid());
 
     return send(transport, m_requestBuffer);
 }
@@ -514,7 +533,7 @@ bool StratumApi::configureVersionRolling(StratumTransport *transport)
 void StratumApi::resetUid()
 {
     ESP_LOGI(TAG, "Resetting stratum uid");
-    m_send_uid = 1;
+    __atomic_store_n(&m_send_uid, 1, __ATOMIC_RELAXED);
 }
 
 //--------------------------------------------------------------------
@@ -524,4 +543,6 @@ void StratumApi::clearBuffer()
 {
     memset(m_buffer, 0, BIG_BUFFER_SIZE);
     m_len = 0;
+    m_start = 0;
+    m_consumed = 0;
 }
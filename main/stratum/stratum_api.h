@@ -3,10 +3,14 @@
 #include <cstddef>
 #include <stdbool.h>
 #include <stdint.h>
-#include "ArduinoJson.h"
 
+#include "stratum_json.h"
 #include "stratum_transport.h"
 
+// share_submitter.h includes mining.h, which includes this header
+struct share_submit;
+typedef struct share_submit share_submit_t;
+
 #define MAX_MERKLE_BRANCHES 32
 #define HASH_SIZE 32
 #define COINBASE_SIZE 100
@@ -34,6 +38,8 @@ static const int STRATUM_ID_EXTRANONCE_SUBSCRIBE = 5;
 
 #define STRATUM_LAST_SETUP_ID STRATUM_ID_EXTRANONCE_SUBSCRIBE
 
+// the strings of a parsed mining.notify point into the receive buffer
+// and are only valid until the next line is received
 typedef struct
 {
     char *job_id;
@@ -67,6 +73,7 @@ typedef struct
     uint32_t version_mask;
     // result
     bool response_success;
+    bool response_stale; // rejected because the job is gone
 } StratumApiV1Message;
 
 class StratumApi {
@@ -76,35 +83,43 @@ class StratumApi {
     {
         BUFFER_SIZE = 1024,
         BIG_BUFFER_SIZE = 16384,
+        SUBMIT_BUFFER_SIZE = 4096, // SHARE_BATCH_MAX submits
     };
     char *m_buffer;
     char *m_requestBuffer;
-    size_t m_len;   // Current length of valid data in m_buffer.
-    int m_send_uid; // Message ID counter (each message gets a unique ID).
+    char *m_submitBuffer; // own buffer, submits are sent from the share submit task
+    size_t m_len;      // Current length of valid data in m_buffer.
+    size_t m_start;    // Start of the unprocessed data in m_buffer.
+    size_t m_consumed; // Length of the line handed out last (released on the next receive).
+    int m_send_uid;    // Message ID counter (each message gets a unique ID), atomic.
+
+    // tokens of the last received line and storage for parsed notifies
+    StratumJson m_json;
+    mining_notify m_notify;
 
     // Helper: logs a transmit message (removing any trailing newline).
     void debugTx(const char *msg);
 
-    // Helper functions for hex conversion.
-    static uint8_t hex2val(char c);
-    static size_t hex2bin(const char *hex, uint8_t *bin, size_t bin_len);
-
     // Helper: checks whether the socket is still connected.
     static int isSocketConnected(StratumTransport *transport);
 
-    static bool parseMethods(JsonDocument &doc, const char* method_str, StratumApiV1Message *message);
-    static bool parseResponses(JsonDocument &doc, StratumApiV1Message *message);
-    static bool parseSetupResponses(JsonDocument &doc, StratumApiV1Message *message);
-    static bool parseResult(JsonDocument &doc);
+    bool parseMethods(const char* method_str, StratumApiV1Message *message);
+    bool parseResponses(StratumApiV1Message *message);
+    bool parseSetupResponses(StratumApiV1Message *message);
+    bool parseResult();
+    bool isStaleError();
 
     bool send(StratumTransport *transport, const char* message);
   public:
+    // Takes count consecutive message ids, returns the first one.
+    int nextUid(int count = 1);
+
     StratumApi();
     ~StratumApi();
 
     // Receives a JSON-RPC line (terminated by '\n') from the socket.
-    // Returns a dynamically allocated C-string that the caller must free.
-    char* receiveJsonRpcLine(StratumTransport *transport);
+    // The line is returned in place and stays valid until the next call.
+    char* receiveJsonRpcLine(StratumTransport *transport, size_t *line_len);
     void resetBuffer();
 
     // Sends a subscribe message.
@@ -119,9 +134,10 @@ class StratumApi {
     // Sends an authentication message.
     bool authenticate(StratumTransport *transport, const char *username, const char *pass);
 
-    // Submits a share.
-    bool submitShare(StratumTransport *transport, const char *username, const char *jobid, const char *extranonce_2, uint32_t ntime, uint32_t nonce,
-                     uint32_t version);
+    // Submits shares with a single socket write, returns the number of shares sent.
+    // The shares get consecutive ids starting with first_id, taken with nextUid(count).
+    int submitShares(StratumTransport *transport, const char *username, const share_submit_t *shares, int count,
+                     int first_id);
 
     // Sends a configure-version-rolling message.
     bool configureVersionRolling(StratumTransport *transport);
@@ -132,11 +148,16 @@ class StratumApi {
     // clear the message buffer
     void clearBuffer();
 
-    // Parses a received JSON string into a StratumApiV1Message.
-    static bool parse(StratumApiV1Message* message, const char* stratum_json);
-    static bool parse(StratumApiV1Message *message, JsonDocument &doc);
+    // Tokenizes a received line in place, fails on invalid JSON.
+    bool tokenize(char *line, size_t len);
 
-    // Frees a mining_notify structure allocated in parse().
-    static void freeMiningNotify(mining_notify *params);
+    // true if the last line couldn't be tokenized because it was too complex
+    bool tooManyTokens() const
+    {
+        return m_json.overflow();
+    }
 
+    // Parses the tokenized line into a StratumApiV1Message.
+    // Strings of the message point into the line.
+    bool parse(StratumApiV1Message *message);
 };
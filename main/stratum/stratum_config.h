@@ -23,6 +23,7 @@ class StratumConfig {
     bool m_enonceSub = false;
     bool m_tls = false;
     StratumProtocol m_protocol = STRATUM_V1;
+    uint16_t m_sv2Channel = 0; // 0 = extended, 1 = standard
 
   public:
     StratumConfig(int pool);
@@ -79,6 +80,11 @@ class StratumConfig {
         return m_protocol == STRATUM_V2;
     }
 
+    // pool provides the merkle root, header-only jobs
+    bool isSV2Standard() {
+        return isSV2() && m_sv2Channel == 1;
+    }
+
     //static void toLog(const StratumConfig &cfg, const char* prefix="");
 };
 
@@ -0,0 +1,372 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "stratum_json.h"
+
+static uint8_t hex2val(char c)
+{
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    }
+    return 0;
+}
+
+static bool is_hex(char c)
+{
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+}
+
+int StratumJson::addToken(json_type_t type, int start, int end, int parent)
+{
+    if (m_count >= STRATUM_JSON_MAX_TOKENS) {
+        m_overflow = true;
+        return -1;
+    }
+
+    json_token_t *tok = &m_tokens[m_count];
+    tok->type = type;
+    tok->start = start;
+    tok->end = end;
+    tok->size = 0;
+    tok->parent = parent;
+    tok->escaped = false;
+
+    if (parent != -1) {
+        m_tokens[parent].size++;
+    }
+    return m_count++;
+}
+
+bool StratumJson::tokenize(char *json, size_t len)
+{
+    m_json = json;
+    m_count = 0;
+    m_overflow = false;
+
+    // token offsets are 16bit
+    if (len > UINT16_MAX) {
+        return false;
+    }
+
+    int super = -1;
+
+    for (size_t pos = 0; pos < len; pos++) {
+        char c = json[pos];
+
+        switch (c) {
+        case '{':
+        case '[': {
+            // only a single root element
+            if (super == -1 && m_count) {
+                return false;
+            }
+            int tok = addToken(c == '{' ? JSON_OBJECT : JSON_ARRAY, pos, 0, super);
+            if (tok < 0) {
+                return false;
+            }
+            super = tok;
+            break;
+        }
+        case '}':
+        case ']': {
+            json_type_t type = c == '}' ? JSON_OBJECT : JSON_ARRAY;
+            if (super == -1 || m_tokens[super].type != type) {
+                return false;
+            }
+            m_tokens[super].end = pos + 1;
+            super = m_tokens[super].parent;
+            break;
+        }
+        case '"': {
+            if (super == -1) {
+                return false;
+            }
+            size_t start = ++pos;
+            bool escaped = false;
+            for (; pos < len && json[pos] != '"'; pos++) {
+                // skip escaped characters
+                if (json[pos] == '\\') {
+                    escaped = true;
+                    pos++;
+                }
+            }
+            if (pos >= len) {
+                return false;
+            }
+            int tok = addToken(JSON_STRING, start, pos, super);
+            if (tok < 0) {
+                return false;
+            }
+            m_tokens[tok].escaped = escaped;
+            break;
+        }
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+        case ':':
+        case ',':
+            break;
+        default: {
+            if (super == -1 || !c || !strchr("-0123456789tfn", c)) {
+                return false;
+            }
+            size_t start = pos;
+            while (pos < len && !strchr(" \t\r\n,:]}", json[pos])) {
+                pos++;
+            }
+            if (addToken(JSON_PRIMITIVE, start, pos, super) < 0) {
+                return false;
+            }
+            // reprocess the delimiter
+            pos--;
+            break;
+        }
+        }
+    }
+
+    // unclosed object or array
+    if (super != -1 || !m_count) {
+        return false;
+    }
+
+    return m_tokens[0].type == JSON_OBJECT;
+}
+
+int StratumJson::child(int parent, int index) const
+{
+    if (parent < 0 || index < 0 || index >= m_tokens[parent].size) {
+        return -1;
+    }
+    // children are stored in order after their parent, nested tokens in between
+    for (int i = parent + 1; i < m_count && m_tokens[i].start < m_tokens[parent].end; i++) {
+        if (m_tokens[i].parent == parent && !index--) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int StratumJson::find(int object, const char *key) const
+{
+    if (object < 0 || m_tokens[object].type != JSON_OBJECT) {
+        return -1;
+    }
+
+    size_t key_len = strlen(key);
+    int n = 0;
+    for (int i = object + 1; i < m_count && m_tokens[i].start < m_tokens[object].end; i++) {
+        if (m_tokens[i].parent != object) {
+            continue;
+        }
+        // even children are keys, odd children the values
+        if (n++ % 2) {
+            continue;
+        }
+        const json_token_t *tok = &m_tokens[i];
+        if (tok->type == JSON_STRING && (size_t) (tok->end - tok->start) == key_len &&
+            !memcmp(m_json + tok->start, key, key_len)) {
+            return child(object, n);
+        }
+    }
+    return -1;
+}
+
+int StratumJson::size(int tok) const
+{
+    return tok < 0 ? 0 : m_tokens[tok].size;
+}
+
+bool StratumJson::isString(int tok) const
+{
+    return tok >= 0 && m_tokens[tok].type == JSON_STRING;
+}
+
+bool StratumJson::isNull(int tok) const
+{
+    return tok < 0 || (m_tokens[tok].type == JSON_PRIMITIVE && m_json[m_tokens[tok].start] == 'n');
+}
+
+bool StratumJson::isInt(int tok) const
+{
+    if (tok < 0 || m_tokens[tok].type != JSON_PRIMITIVE) {
+        return false;
+    }
+    for (int i = m_tokens[tok].start; i < m_tokens[tok].end; i++) {
+        char c = m_json[i];
+        if (!(c >= '0' && c <= '9') && !(c == '-' && i == m_tokens[tok].start)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool StratumJson::asBool(int tok) const
+{
+    return tok >= 0 && m_tokens[tok].type == JSON_PRIMITIVE && m_json[m_tokens[tok].start] == 't';
+}
+
+int64_t StratumJson::asInt(int tok, int64_t def) const
+{
+    if (!isInt(tok)) {
+        return def;
+    }
+    return strtoll(m_json + m_tokens[tok].start, NULL, 10);
+}
+
+double StratumJson::asDouble(int tok) const
+{
+    if (tok < 0 || m_tokens[tok].type != JSON_PRIMITIVE) {
+        return 0.0;
+    }
+    return strtod(m_json + m_tokens[tok].start, NULL);
+}
+
+bool StratumJson::isHex(int tok) const
+{
+    if (!isString(tok) || (m_tokens[tok].end - m_tokens[tok].start) % 2) {
+        return false;
+    }
+    for (int i = m_tokens[tok].start; i < m_tokens[tok].end; i++) {
+        if (!is_hex(m_json[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool StratumJson::hexUint32(int tok, uint32_t *value) const
+{
+    if (!isString(tok)) {
+        return false;
+    }
+    int len = m_tokens[tok].end - m_tokens[tok].start;
+    if (len < 1 || len > 8) {
+        return false;
+    }
+    uint32_t v = 0;
+    for (int i = m_tokens[tok].start; i < m_tokens[tok].end; i++) {
+        if (!is_hex(m_json[i])) {
+            return false;
+        }
+        v = (v << 4) | hex2val(m_json[i]);
+    }
+    *value = v;
+    return true;
+}
+
+bool StratumJson::hexToBin(int tok, uint8_t *bin, size_t bin_len) const
+{
+    if (!isHex(tok) || (size_t) (m_tokens[tok].end - m_tokens[tok].start) != 2 * bin_len) {
+        return false;
+    }
+    const char *hex = m_json + m_tokens[tok].start;
+    for (size_t i = 0; i < bin_len; i++) {
+        bin[i] = (hex2val(hex[2 * i]) << 4) | hex2val(hex[2 * i + 1]);
+    }
+    return true;
+}
+
+// 4 hex digits of a \u escape, -1 if malformed
+static int32_t hex4(const char *s, const char *end)
+{
+    if (end - s < 4) {
+        return -1;
+    }
+    int32_t value = 0;
+    for (int i = 0; i < 4; i++) {
+        if (!is_hex(s[i])) {
+            return -1;
+        }
+        value = (value << 4) | hex2val(s[i]);
+    }
+    return value;
+}
+
+// decodes the escapes of [src, end) to dst, the result is never longer
+static char *unescape(char *dst, const char *src, const char *end)
+{
+    while (src < end) {
+        if (*src != '\\' || src + 1 >= end) {
+            *dst++ = *src++;
+            continue;
+        }
+        char c = src[1];
+        src += 2;
+        switch (c) {
+        case 'b':
+            *dst++ = '\b';
+            break;
+        case 'f':
+            *dst++ = '\f';
+            break;
+        case 'n':
+            *dst++ = '\n';
+            break;
+        case 'r':
+            *dst++ = '\r';
+            break;
+        case 't':
+            *dst++ = '\t';
+            break;
+        case 'u': {
+            int32_t cp = hex4(src, end);
+            if (cp < 0) {
+                *dst++ = '?';
+                break;
+            }
+            src += 4;
+            // surrogate pair
+            if (cp >= 0xd800 && cp < 0xdc00 && end - src >= 6 && src[0] == '\\' && src[1] == 'u') {
+                int32_t low = hex4(src + 2, end);
+                if (low >= 0xdc00 && low < 0xe000) {
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (low - 0xdc00);
+                    src += 6;
+                }
+            }
+            if (cp >= 0xd800 && cp < 0xe000) {
+                *dst++ = '?';
+            } else if (cp < 0x80) {
+                *dst++ = cp;
+            } else if (cp < 0x800) {
+                *dst++ = 0xc0 | (cp >> 6);
+                *dst++ = 0x80 | (cp & 0x3f);
+            } else if (cp < 0x10000) {
+                *dst++ = 0xe0 | (cp >> 12);
+                *dst++ = 0x80 | ((cp >> 6) & 0x3f);
+                *dst++ = 0x80 | (cp & 0x3f);
+            } else {
+                *dst++ = 0xf0 | (cp >> 18);
+                *dst++ = 0x80 | ((cp >> 12) & 0x3f);
+                *dst++ = 0x80 | ((cp >> 6) & 0x3f);
+                *dst++ = 0x80 | (cp & 0x3f);
+            }
+            break;
+        }
+        default:
+            // \" \\ \/
+            *dst++ = c;
+            break;
+        }
+    }
+    return dst;
+}
+
+const char *StratumJson::string(int tok)
+{
+    if (!isString(tok)) {
+        return nullptr;
+    }
+    json_token_t *t = &m_tokens[tok];
+    if (t->escaped) {
+        // decoded once, the token then covers the shorter result
+        t->end = unescape(m_json + t->start, m_json + t->start, m_json + t->end) - m_json;
+        t->escaped = false;
+    }
+    m_json[t->end] = '\0';
+    return m_json + t->start;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// a mining.notify with MAX_MERKLE_BRANCHES branches needs about 50 tokens
+#define STRATUM_JSON_MAX_TOKENS 128
+
+typedef enum
+{
+    JSON_UNDEFINED = 0,
+    JSON_OBJECT,
+    JSON_ARRAY,
+    JSON_STRING,
+    JSON_PRIMITIVE // number, true, false, null
+} json_type_t;
+
+typedef struct
+{
+    json_type_t type;
+    uint16_t start;  // first character (strings: after the opening quote)
+    uint16_t end;    // one past the last character (strings: the closing quote)
+    uint16_t size;   // number of direct children (objects: keys + values)
+    int16_t parent;
+    bool escaped;    // string with escape sequences string() hasn't decoded yet
+} json_token_t;
+
+// Minimal in-place JSON tokenizer for stratum messages
+//
+// The line is split into a flat token array without copying or allocating.
+// Values are read directly from the line, string() decodes the escapes of
+// a string token and terminates it in place, so the line must stay valid
+// and writable while the tokens are used.
+class StratumJson {
+  protected:
+    char *m_json = nullptr;
+    json_token_t m_tokens[STRATUM_JSON_MAX_TOKENS];
+    int m_count = 0;
+    bool m_overflow = false;
+
+    int addToken(json_type_t type, int start, int end, int parent);
+
+  public:
+    // tokenizes a zero terminated line, the root has to be an object
+    bool tokenize(char *json, size_t len);
+
+    // true if the last tokenize() failed because the line had too many tokens
+    bool overflow() const
+    {
+        return m_overflow;
+    }
+
+    // token navigation, all return -1 if not found
+    int root() const
+    {
+        return m_count ? 0 : -1;
+    }
+    int find(int object, const char *key) const;
+    int child(int parent, int index) const;
+    int size(int tok) const;
+
+    // value access
+    bool isString(int tok) const;
+    bool isNull(int tok) const;
+    bool isInt(int tok) const;
+    bool asBool(int tok) const;
+    int64_t asInt(int tok, int64_t def = 0) const;
+    double asDouble(int tok) const;
+
+    // hex string helpers, false unless the string is all hex digits
+    // whole bytes
+    bool isHex(int tok) const;
+    // 1 to 8 digits
+    bool hexUint32(int tok, uint32_t *value) const;
+    // exactly 2 * bin_len digits
+    bool hexToBin(int tok, uint8_t *bin, size_t bin_len) const;
+
+    // decodes escapes and zero terminates the string in place, returns it
+    const char *string(int tok);
+};
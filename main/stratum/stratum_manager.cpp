@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <ctype.h>
 #include <sys/socket.h>
 #include <sys/types.h>
@@ -13,6 +14,7 @@
 
 #include "asic_jobs.h"
 #include "boards/board.h"
+#include "can_share_stats.h"
 #include "connect.h"
 #include "create_jobs_task.h"
 #include "global_state.h"
@@ -95,6 +97,9 @@ void StratumManager::task()
 
     // Create the Stratum tasks for both pools
     for (int i = 0; i < 2; i++) {
+        m_submitters[i] = new ShareSubmitter(this, i);
+        m_submitters[i]->start();
+
         m_stratumTasks[i] = createTask(i);
         xTaskCreate(m_stratumTasks[i]->taskWrapper, (i == 0) ? "stratum task (pri)" : "stratum task (sec)", 8192,
                     (void *) m_stratumTasks[i], 5, NULL);
@@ -104,6 +109,9 @@ void StratumManager::task()
                     (void *) m_pingTasks[i], 1, NULL);
     }
 
+    // pool addresses are re-resolved in a low priority task, this loop never waits for DNS
+    xTaskCreate(DnsCache::taskWrapper, "dns refresh", 4096, (void *) &m_dnsCache, 1, NULL);
+
     if (m_poolmode == PoolMode::DUAL) {
         connect(PRIMARY);
         connect(SECONDARY);
@@ -133,19 +141,8 @@ void StratumManager::task()
     }
 }
 
-void StratumManager::freeStratumV1Message(StratumApiV1Message *message)
-{
-    if (!message) {
-        return;
-    }
-    StratumApi::freeMiningNotify(message->mining_notification);
-    safe_free(message->mining_notification);
-    safe_free(message->extranonce_str);
-}
-
-void StratumManager::dispatch(int pool, JsonDocument &doc)
+void StratumManager::dispatch(int pool, const StratumApiV1Message *message)
 {
-    // ensure consistent use of m_stratum_api_v1_message
     PThreadGuard lock(m_mutex);
 
     if (!acceptsNotifyFrom(pool)) {
@@ -161,25 +158,14 @@ void StratumManager::dispatch(int pool, JsonDocument &doc)
 
     const char *tag = selected->getTag();
 
-    // we keep the m_stratum_api_v1_message in the class
-    // to not have the struct on the stack
-    memset(&m_stratum_api_v1_message, 0, sizeof(StratumApiV1Message));
-
-    if (!StratumApi::parse(&m_stratum_api_v1_message, doc)) {
-        ESP_LOGE(m_tag, "error in stratum");
-        // free memory
-        freeStratumV1Message(&m_stratum_api_v1_message);
-        return;
-    }
-
-    switch (m_stratum_api_v1_message.method) {
+    switch (message->method) {
     case MINING_NOTIFY: {
-        setNetworkDifficulty(pool, m_stratum_api_v1_message.mining_notification->target);
-        processCoinbase(pool, m_stratum_api_v1_message.mining_notification);
-        create_job_mining_notify(pool, m_stratum_api_v1_message.mining_notification,
-                                 m_stratum_api_v1_message.should_abandon_work || selected->m_firstJob);
+        setNetworkDifficulty(pool, message->mining_notification->target);
+        processCoinbase(pool, message->mining_notification);
+        create_job_mining_notify(pool, message->mining_notification,
+                                 message->should_abandon_work || selected->m_firstJob);
 
-        if (m_stratum_api_v1_message.mining_notification->ntime) {
+        if (message->mining_notification->ntime) {
             m_stratumTasks[pool]->m_validNotify = true;
         }
 
@@ -188,34 +174,34 @@ void StratumManager::dispatch(int pool, JsonDocument &doc)
     }
 
     case MINING_SET_DIFFICULTY: {
-        setPoolDifficulty(pool, m_stratum_api_v1_message.new_difficulty);
-        if (create_job_set_difficulty(pool, m_stratum_api_v1_message.new_difficulty)) {
-            ESP_LOGI(tag, "Set stratum difficulty: %ld", m_stratum_api_v1_message.new_difficulty);
+        setPoolDifficulty(pool, message->new_difficulty);
+        if (create_job_set_difficulty(pool, message->new_difficulty)) {
+            ESP_LOGI(tag, "Set stratum difficulty: %ld", message->new_difficulty);
         }
         break;
     }
 
     case MINING_SET_VERSION_MASK:
     case STRATUM_RESULT_VERSION_MASK: {
-        ESP_LOGI(tag, "Set version mask: %08lx", m_stratum_api_v1_message.version_mask);
-        create_job_set_version_mask(pool, m_stratum_api_v1_message.version_mask);
+        ESP_LOGI(tag, "Set version mask: %08lx", message->version_mask);
+        create_job_set_version_mask(pool, message->version_mask);
         break;
     }
 
     case MINING_SET_EXTRANONCE: {
         // the new extranonce gets active with the next mining.notify
-        ESP_LOGI(tag, "Set next enonce %s enonce2-len: %d", m_stratum_api_v1_message.extranonce_str,
-                 m_stratum_api_v1_message.extranonce_2_len);
-        storeExtranonce(pool, m_stratum_api_v1_message.extranonce_str, m_stratum_api_v1_message.extranonce_2_len);
-        set_next_enonce(pool, m_stratum_api_v1_message.extranonce_str, m_stratum_api_v1_message.extranonce_2_len);
+        ESP_LOGI(tag, "Set next enonce %s enonce2-len: %d", message->extranonce_str,
+                 message->extranonce_2_len);
+        storeExtranonce(pool, message->extranonce_str, message->extranonce_2_len);
+        set_next_enonce(pool, message->extranonce_str, message->extranonce_2_len);
         break;
     }
 
     case STRATUM_RESULT_SUBSCRIBE: {
-        ESP_LOGI(tag, "Set enonce %s enonce2-len: %d", m_stratum_api_v1_message.extranonce_str,
-                 m_stratum_api_v1_message.extranonce_2_len);
-        storeExtranonce(pool, m_stratum_api_v1_message.extranonce_str, m_stratum_api_v1_message.extranonce_2_len);
-        create_job_set_enonce(pool, m_stratum_api_v1_message.extranonce_str, m_stratum_api_v1_message.extranonce_2_len);
+        ESP_LOGI(tag, "Set enonce %s enonce2-len: %d", message->extranonce_str,
+                 message->extranonce_2_len);
+        storeExtranonce(pool, message->extranonce_str, message->extranonce_2_len);
+        create_job_set_enonce(pool, message->extranonce_str, message->extranonce_2_len);
         break;
     }
 
@@ -225,7 +211,9 @@ void StratumManager::dispatch(int pool, JsonDocument &doc)
     }
 
     case STRATUM_RESULT: {
-        if (m_stratum_api_v1_message.response_success) {
+        int source = m_submitters[pool]->onResponse(message->message_id);
+        shareResult(source, message->response_success, message->response_stale);
+        if (message->response_success) {
             ESP_LOGI(tag, "message result accepted");
             acceptedShare(pool);
         } else {
@@ -237,7 +225,7 @@ void StratumManager::dispatch(int pool, JsonDocument &doc)
     }
 
     case STRATUM_RESULT_SETUP: {
-        if (m_stratum_api_v1_message.response_success) {
+        if (message->response_success) {
             ESP_LOGI(tag, "setup message accepted");
         } else {
             ESP_LOGE(tag, "setup message rejected");
@@ -249,15 +237,12 @@ void StratumManager::dispatch(int pool, JsonDocument &doc)
         // NOP
     }
     }
-
-    // free memory
-    freeStratumV1Message(&m_stratum_api_v1_message);
 }
 
 void StratumManager::submitShare(int pool, const char *jobid, const char *extranonce_2, const uint32_t ntime, const uint32_t nonce,
-                                 const uint32_t version_rolled, const uint32_t version_base)
+                                 const uint32_t version_rolled, const uint32_t version_base, uint8_t source)
 {
-    if (!m_stratumTasks[pool]) {
+    if (!m_stratumTasks[pool] || !m_submitters[pool]) {
         ESP_LOGE(m_tag, "stratum task is null");
         return;
     }
@@ -266,7 +251,91 @@ void StratumManager::submitShare(int pool, const char *jobid, const char *extran
         ESP_LOGE(m_tag, "selected pool not connected");
         return;
     }
-    m_stratumTasks[pool]->submitShare(jobid, extranonce_2, ntime, nonce, version_rolled, version_base);
+    // the network write happens in the share submit task
+    m_submitters[pool]->enqueue(jobid, extranonce_2, ntime, nonce, version_rolled, version_base, source);
+}
+
+void StratumManager::shareResult(int source, bool accepted, bool stale)
+{
+    // the own shares are counted per pool by acceptedShare() / rejectedShare()
+    if (source <= SHARE_SOURCE_LOCAL) {
+        return;
+    }
+    can_shares_result((uint8_t) source, accepted ? CAN_SHARE_ACCEPTED : (stale ? CAN_SHARE_STALE : CAN_SHARE_REJECTED));
+}
+
+int StratumManager::reserveShareIds(int pool, int count)
+{
+    if (!m_stratumTasks[pool] || !m_stratumTasks[pool]->m_isConnected) {
+        return -1;
+    }
+    return m_stratumTasks[pool]->reserveIds(count);
+}
+
+int StratumManager::sendShares(int pool, const share_submit_t *shares, int count, int first_id)
+{
+    // the pool could have disconnected while the shares were queued
+    if (!m_stratumTasks[pool] || !m_stratumTasks[pool]->m_isConnected) {
+        ESP_LOGE(m_tag, "selected pool not connected, dropping %d shares", count);
+        return 0;
+    }
+    return m_stratumTasks[pool]->submitShares(shares, count, first_id);
+}
+
+bool StratumManager::getSubmitStats(int pool, share_submit_stats_t *stats)
+{
+    if (!m_submitters[pool]) {
+        return false;
+    }
+    m_submitters[pool]->getStats(stats);
+    return true;
+}
+
+void StratumManager::activePoolLost(int pool)
+{
+    // keep the time of the first loss if the other pool is down too
+    if (!m_poolLostUs) {
+        m_poolLostUs = esp_timer_get_time();
+    }
+}
+
+void StratumManager::activePoolSwitched(int pool)
+{
+    int64_t now = esp_timer_get_time();
+
+    m_failoverStats.switches++;
+    m_switchUs = now;
+
+    if (m_poolLostUs) {
+        uint32_t failover_ms = (uint32_t) ((now - m_poolLostUs) / 1000);
+        m_failoverStats.lastFailoverMs = failover_ms;
+        m_failoverStats.maxFailoverMs = std::max(m_failoverStats.maxFailoverMs, failover_ms);
+        ESP_LOGI(m_tag, "switched to %s pool %lums after the active pool was lost", pool ? "secondary" : "primary",
+                 failover_ms);
+        // time to first job counts from the loss
+        m_switchUs = m_poolLostUs;
+        m_poolLostUs = 0;
+    }
+}
+
+void StratumManager::firstJobSent(int pool)
+{
+    PThreadGuard lock(m_mutex);
+
+    if (!m_switchUs) {
+        return;
+    }
+
+    uint32_t first_job_ms = (uint32_t) ((esp_timer_get_time() - m_switchUs) / 1000);
+    m_failoverStats.lastFirstJobMs = first_job_ms;
+    m_failoverStats.maxFirstJobMs = std::max(m_failoverStats.maxFirstJobMs, first_job_ms);
+    m_switchUs = 0;
+}
+
+void StratumManager::getFailoverStats(failover_stats_t *stats)
+{
+    PThreadGuard lock(m_mutex);
+    *stats = m_failoverStats;
 }
 
 // --- stratum config related; mutexed
@@ -583,6 +652,55 @@ void StratumManager::getManagerInfoJson(JsonObject &obj)
     obj["poolBalance"] = Config::getPoolBalance();
 
     obj["totalBestDiff"] = m_totalBestDiff;
+
+    JsonObject failover = obj["failover"].to<JsonObject>();
+    failover["switches"]       = m_failoverStats.switches;
+    failover["lastFailoverMs"] = m_failoverStats.lastFailoverMs;
+    failover["maxFailoverMs"]  = m_failoverStats.maxFailoverMs;
+    failover["lastFirstJobMs"] = m_failoverStats.lastFirstJobMs;
+    failover["maxFirstJobMs"]  = m_failoverStats.maxFirstJobMs;
+
+    dns_cache_stats_t dns;
+    m_dnsCache.getStats(&dns);
+    JsonObject dnsObj = obj["dns"].to<JsonObject>();
+    dnsObj["lookups"]   = dns.lookups;
+    dnsObj["hits"]      = dns.hits;
+    dnsObj["stale"]     = dns.stale;
+    dnsObj["failures"]  = dns.failures;
+    dnsObj["refreshes"] = dns.refreshes;
+}
+
+void StratumManager::getSubmitStatsJson(int pool, JsonObject &obj)
+{
+    share_submit_stats_t stats;
+    if (!getSubmitStats(pool, &stats)) {
+        return;
+    }
+
+    JsonObject submit = obj["submit"].to<JsonObject>();
+    submit["queued"]         = stats.queued;
+    submit["dropped"]        = stats.dropped;
+    submit["sent"]           = stats.sent;
+    submit["writes"]         = stats.writes;
+    submit["acks"]           = stats.acks;
+    submit["unmatched"]      = stats.unmatched;
+    submit["queueTimeAvgUs"] = stats.sent ? (uint32_t) (stats.queueTimeSumUs / stats.sent) : 0;
+    submit["queueTimeMaxUs"] = stats.queueTimeMaxUs;
+    submit["latencyAvgMs"]   = stats.acks ? (uint32_t) (stats.latencySumUs / 1000 / stats.acks) : 0;
+    submit["latencyP50Ms"]   = ShareSubmitter::percentileMs(&stats, 0.5f);
+    submit["latencyP90Ms"]   = ShareSubmitter::percentileMs(&stats, 0.9f);
+    submit["latencyMaxMs"]   = stats.latencyMaxMs;
+
+    // bucket i counts latencies below latencyBucketsMs[i], the last one everything above
+    static const uint32_t limits[SHARE_LATENCY_BUCKETS] = SHARE_LATENCY_LIMITS_MS;
+    JsonArray buckets = submit["latencyBucketsMs"].to<JsonArray>();
+    JsonArray hist = submit["latencyHist"].to<JsonArray>();
+    for (int i = 0; i < SHARE_LATENCY_BUCKETS; i++) {
+        if (i < SHARE_LATENCY_BUCKETS - 1) {
+            buckets.add(limits[i]);
+        }
+        hist.add(stats.latency[i]);
+    }
 }
 
 void StratumManager::checkForFoundBlock(int pool, double diff, uint32_t nbits)
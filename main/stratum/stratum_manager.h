@@ -8,11 +8,21 @@
 #include "ArduinoJson.h"
 
 #include "coinbase_decoder.h"
+#include "dns_cache.h"
 #include "stratum_task.h"
 #include "../tasks/ping_task.h"
 
 #define DIFF_STRING_SIZE 12
 
+typedef struct
+{
+    uint32_t switches;       // active pool changes
+    uint32_t lastFailoverMs; // active pool lost to the other pool selected
+    uint32_t maxFailoverMs;
+    uint32_t lastFirstJobMs; // active pool lost (or switch) to the first job of the new pool
+    uint32_t maxFirstJobMs;
+} failover_stats_t;
+
 /**
  * @brief StratumManager handles pool selection, connection management, and failover.
  */
@@ -23,6 +33,7 @@ class StratumManager {
     friend StratumTaskV1;
     friend StratumTaskV2;
     friend PingTask;
+    friend ShareSubmitter;
   public:
     enum Selected
     {
@@ -41,14 +52,21 @@ class StratumManager {
     const char *m_tag = "stratum-manager"; ///< Debug tag for logging
 
     pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER; ///< Mutex for thread safety
-    StratumApiV1Message m_stratum_api_v1_message;        ///< API message handler
     PoolMode m_poolmode;                                 // default FAILOVER
     uint64_t m_lastSubmitResponseTimestamp = 0;              ///< Timestamp of last submitted share response
 
     StratumTaskBase *m_stratumTasks[2]{};                    ///< Primary and secondary Stratum tasks
+    ShareSubmitter *m_submitters[2]{};                       ///< Share submit queues of both pools
     PingTask *m_pingTasks[2]{};
     StratumConfig *m_stratumConfig[2]{};
 
+    DnsCache m_dnsCache;                                     ///< Resolved pool hosts
+
+    // failover timing
+    failover_stats_t m_failoverStats = {};
+    int64_t m_poolLostUs = 0;   // active pool disconnected, 0 = no failover in progress
+    int64_t m_switchUs = 0;     // start of the pending time to first job, 0 = none
+
     uint32_t m_totalFoundBlocks = 0;
     uint32_t m_foundBlocks = 0;
 
@@ -83,13 +101,26 @@ class StratumManager {
 
     void copyConfigInto(int pool, StratumConfig *dst);
 
+    // adds the "submit" object of a pool to the manager info
+    void getSubmitStatsJson(int pool, JsonObject &obj);
+
+    // failover timing, called with the mutex held
+    void activePoolLost(int pool);
+    void activePoolSwitched(int pool);
+
     // Helper methods for connection management
     void connect(int index);     ///< Connect to a specified pool (0 = primary, 1 = secondary)
     void disconnect(int index);  ///< Disconnect from a specified pool
     bool isConnected(int index); ///< Check if a pool is connected
 
     // Handles incoming Stratum responses
-    void dispatch(int pool, JsonDocument &doc);
+    void dispatch(int pool, const StratumApiV1Message *message);
+
+    // Takes request ids for the next submits of the share submit task, -1 if not connected
+    int reserveShareIds(int pool, int count);
+
+    // Writes queued shares to the pool with the ids from first_id on, called from the share submit task
+    int sendShares(int pool, const share_submit_t *shares, int count, int first_id);
 
     // Factory method for creating protocol-specific tasks
     virtual StratumTaskBase* createTask(int index);
@@ -100,8 +131,6 @@ class StratumManager {
     // Clears queued mining jobs
     void cleanQueue();
 
-    void freeStratumV1Message(StratumApiV1Message *message);
-
     // abstract methods
     // reconnect logic for failover mode
     virtual void reconnectTimerCallback(int index) = 0;
@@ -127,11 +156,27 @@ class StratumManager {
     // Submit shares to the active Stratum pool
     // version_rolled = full rolled version (base | rolled bits)
     // version_base   = original block template version
+    // source = SHARE_SOURCE_LOCAL or the CAN slave id, the pool result is attributed to it
     void submitShare(int pool, const char *jobid, const char *extranonce_2, const uint32_t ntime, const uint32_t nonce,
-                     const uint32_t version_rolled, const uint32_t version_base);
+                     const uint32_t version_rolled, const uint32_t version_base, uint8_t source = SHARE_SOURCE_LOCAL);
+
+    // pool result of a share of the given source, called by the stratum tasks
+    void shareResult(int source, bool accepted, bool stale);
 
     void checkForFoundBlock(int pool, double diff, uint32_t nbits);
 
+    // share queue and submit-to-ack latency stats, false if the pool isn't set up yet
+    bool getSubmitStats(int pool, share_submit_stats_t *stats);
+
+    // called by create_jobs_task when the pool of the sent jobs changes
+    void firstJobSent(int pool);
+
+    void getFailoverStats(failover_stats_t *stats);
+
+    void getDnsStats(dns_cache_stats_t *stats) {
+        m_dnsCache.getStats(stats);
+    }
+
     bool isAnyConnected();
     int getNumConnectedPools();
 
@@ -166,6 +211,8 @@ class StratumManager {
     // compatibility
     virtual uint64_t getSharesAccepted() = 0;
     virtual uint64_t getSharesRejected() = 0;
+    virtual uint64_t getSharesAccepted(int pool) = 0;
+    virtual uint64_t getSharesRejected(int pool) = 0;
 
     uint32_t getTotalFoundBlocks() {
         return m_totalFoundBlocks;
@@ -6,6 +6,7 @@
 #include "global_state.h"
 #include "create_jobs_task.h"
 #include "macros.h"
+#include "nvs_config.h"
 #include "stratum_manager_fallback.h"
 #include "utils.h"
 
@@ -14,6 +15,22 @@ StratumManagerFallback::StratumManagerFallback() : StratumManager(PoolMode::FAIL
     // NOP
 }
 
+bool StratumManagerFallback::isUsable(int index)
+{
+    return isConnected(index) && m_stratumTasks[index]->m_validNotify && !isVerifyBlocked(index);
+}
+
+void StratumManagerFallback::selectPool(int index)
+{
+    if (index == m_selected) {
+        // the active pool came back, no failover happened
+        m_poolLostUs = 0;
+        return;
+    }
+    m_selected = index;
+    activePoolSwitched(index);
+}
+
 void StratumManagerFallback::reconnectTimerCallback(int index)
 {
     PThreadGuard lock(m_mutex);
@@ -25,8 +42,8 @@ void StratumManagerFallback::reconnectTimerCallback(int index)
         // primary is always allowed to reconnect
         m_stratumTasks[index]->connect();
     } else {
-        // secondary is only allowed if primary is NOT connected
-        if (!isConnected(PRIMARY) || isVerifyBlocked(PRIMARY)) {
+        // secondary is only allowed if primary is NOT connected or as hot standby
+        if (m_hotStandby || !isConnected(PRIMARY) || isVerifyBlocked(PRIMARY)) {
             m_stratumTasks[index]->connect();
         } else {
             // primary is good, we don't want secondary online
@@ -46,11 +63,21 @@ void StratumManagerFallback::connectedCallback(int index)
     }
 
     if (index == PRIMARY) {
-        // Primary is up → Secondary should go away (unless primary is blocked)
-        m_selected = PRIMARY;
         m_verificationCheckCount[PRIMARY] = 0;  // fresh start when primary reconnects
         m_verificationFailCount[PRIMARY] = 0;
 
+        if (m_hotStandby) {
+            // keep mining on a working secondary until the primary sent its first job,
+            // getNextActivePool switches back then
+            if (!isUsable(SECONDARY)) {
+                selectPool(PRIMARY);
+            }
+            return;
+        }
+
+        // Primary is up → Secondary should go away (unless primary is blocked)
+        selectPool(PRIMARY);
+
         if (m_stratumTasks[SECONDARY]) {
             m_stratumTasks[SECONDARY]->disconnect();
             m_stratumTasks[SECONDARY]->stopReconnectTimer();
@@ -59,14 +86,15 @@ void StratumManagerFallback::connectedCallback(int index)
         // Secondary is up
         if (!isConnected(PRIMARY) || isVerifyBlocked(PRIMARY)) {
             // Primary is dead or blocked → accept Secondary as active
-            m_selected = SECONDARY;
+            selectPool(SECONDARY);
             m_verificationCheckCount[SECONDARY] = 0;  // fresh start when secondary takes over
             m_verificationFailCount[SECONDARY] = 0;
-        } else {
+        } else if (!m_hotStandby) {
             // Primary is alive and usable → we don't allow Secondary online
             m_stratumTasks[SECONDARY]->disconnect();
             m_stratumTasks[SECONDARY]->stopReconnectTimer();
         }
+        // hot standby: stays connected and subscribed, receiving jobs
     }
 }
 
@@ -77,6 +105,10 @@ void StratumManagerFallback::disconnectedCallback(int index)
 
     m_stratumTasks[index]->m_validNotify = false;
 
+    if (index == m_selected) {
+        activePoolLost(index);
+    }
+
     if (index == PRIMARY) {
         // Primary went down -> allow secondary to try
         if (m_stratumTasks[SECONDARY]) {
@@ -84,15 +116,30 @@ void StratumManagerFallback::disconnectedCallback(int index)
             // m_stratumTasks[SECONDARY]->connect();
         }
         // m_selected will switch to SECONDARY once SECONDARY actually connects
+        // or right now if it is a hot standby with a valid job
     } else { // index == SECONDARY
         // Secondary went down. If Primary is still down too,
         // we might eventually reconnect SECONDARY anyway via its timer,
     }
+
+    // switch without waiting for the job timer
+    if (m_hotStandby) {
+        trigger_job_creation();
+    }
 }
 
 int StratumManagerFallback::getNextActivePool()
 {
     PThreadGuard lock(m_mutex);
+
+    // hot standby: the primary is preferred, both pools are kept up to date
+    if (m_hotStandby) {
+        if (isUsable(PRIMARY)) {
+            selectPool(PRIMARY);
+        } else if (isUsable(SECONDARY)) {
+            selectPool(SECONDARY);
+        }
+    }
     return m_selected;
 }
 
@@ -123,14 +170,30 @@ uint32_t StratumManagerFallback::selectAsicDiff(int pool, uint32_t poolDiff)
 
 bool StratumManagerFallback::acceptsNotifyFrom(int pool)
 {
-    return (pool == m_selected);
+    // a hot standby keeps its jobs current for an instant switch
+    return m_hotStandby || (pool == m_selected);
 }
 
 void StratumManagerFallback::loadSettings()
 {
     PThreadGuard lock(m_mutex);
 
+    m_hotStandby = Config::isStratumHotStandbyEnabled();
+
     StratumManager::loadSettings(false);
+
+    // apply a changed standby setting while the primary is up
+    if (!m_stratumTasks[SECONDARY] || !isConnected(PRIMARY) || isVerifyBlocked(PRIMARY)) {
+        return;
+    }
+    if (m_hotStandby) {
+        m_stratumTasks[SECONDARY]->connect();
+        m_stratumTasks[SECONDARY]->startReconnectTimer();
+    } else {
+        selectPool(PRIMARY);
+        m_stratumTasks[SECONDARY]->disconnect();
+        m_stratumTasks[SECONDARY]->stopReconnectTimer();
+    }
 };
 
 void StratumManagerFallback::saveSettings(const JsonDocument &doc) {
@@ -159,6 +222,8 @@ void StratumManagerFallback::getManagerInfoJson(JsonObject &obj) {
 
     // fallback specific
     obj["usingFallback"] = isUsingFallback();
+    obj["hotStandby"] = m_hotStandby;
+    obj["standbyConnected"] = m_hotStandby && isConnected(m_selected ^ 1);
 
     JsonArray arr = obj["pools"].to<JsonArray>();
 
@@ -166,8 +231,8 @@ void StratumManagerFallback::getManagerInfoJson(JsonObject &obj) {
 
     pool["connected"] = m_stratumTasks[m_selected] ? m_stratumTasks[m_selected]->m_isConnected : false;
     pool["verifyBlocked"] = getVerifyBlockedReason(m_selected) ? getVerifyBlockedReason(m_selected) : "";
-    pool["poolDifficulty"] = m_poolDifficulty;
-    pool["networkDifficulty"] = m_networkDifficulty;
+    pool["poolDifficulty"] = m_poolDifficulty[m_selected];
+    pool["networkDifficulty"] = m_networkDifficulty[m_selected];
     pool["poolDiffErr"] = false;
     pool["accepted"] = m_accepted;
     pool["rejected"] = m_rejected;
@@ -175,6 +240,8 @@ void StratumManagerFallback::getManagerInfoJson(JsonObject &obj) {
     pool["pingLoss"] = m_pingTasks[m_selected] ? m_pingTasks[m_selected]->get_recent_ping_loss() : 0;
     pool["bestDiff"] = m_bestSessionDiff;
     pool["activeProtocol"] = m_stratumConfig[m_selected] ? (int)m_stratumConfig[m_selected]->getProtocol() : 0;
+    pool["sv2Standard"] = m_stratumConfig[m_selected] ? m_stratumConfig[m_selected]->isSV2Standard() : false;
     pool["encrypted"] = m_stratumConfig[m_selected] ? (m_stratumConfig[m_selected]->isSV2() || m_stratumConfig[m_selected]->isTLS()) : false;
+    getSubmitStatsJson(m_selected, pool);
 }
 
@@ -10,10 +10,16 @@ class StratumManagerFallback : public StratumManager {
     int m_selected = 0;
     uint64_t m_accepted = 0;
     uint64_t m_rejected = 0;
-    uint32_t m_poolDifficulty = 0;
-    double m_networkDifficulty = 0;
+    uint32_t m_poolDifficulty[2] = {};
+    double m_networkDifficulty[2] = {};
     uint64_t m_bestSessionDiff = 0;
 
+    // keep the secondary connected and subscribed while the primary is active
+    bool m_hotStandby = false;
+
+    bool isUsable(int index);
+    void selectPool(int index);
+
     virtual void reconnectTimerCallback(int index);
     virtual void connectedCallback(int index);
     virtual void disconnectedCallback(int index);
@@ -21,12 +27,12 @@ class StratumManagerFallback : public StratumManager {
     virtual bool acceptsNotifyFrom(int pool);
 
     virtual void setPoolDifficulty(int pool, uint32_t diff) {
-        m_poolDifficulty = diff;
+        m_poolDifficulty[pool] = diff;
     };
 
     virtual void setNetworkDifficulty(int pool, uint32_t nbits) {
         if (nbits != 0) {
-            m_networkDifficulty = calculateNetworkDifficulty(nbits);
+            m_networkDifficulty[pool] = calculateNetworkDifficulty(nbits);
         }
     }
 
@@ -72,12 +78,21 @@ class StratumManagerFallback : public StratumManager {
         return m_rejected;
     }
 
+    // primary and fallback share one counter, reported as pool 0
+    virtual uint64_t getSharesAccepted(int pool) {
+        return pool ? 0 : m_accepted;
+    }
+
+    virtual uint64_t getSharesRejected(int pool) {
+        return pool ? 0 : m_rejected;
+    }
+
     virtual uint32_t getPoolDifficulty() {
-        return m_poolDifficulty;
+        return m_poolDifficulty[m_selected];
     };
 
     virtual double getNetworkDifficulty() {
-        return m_networkDifficulty;
+        return m_networkDifficulty[m_selected];
     }
 
     virtual void resetSessionStats() override {
@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <time.h>
@@ -57,34 +58,15 @@ bool StratumTaskBase::isWifiConnected()
 
 bool StratumTaskBase::resolveHostname(const char *hostname, char *ip_str, size_t ip_str_len)
 {
-    struct addrinfo hints;
-    struct addrinfo *res;
-    int err;
-
-    // Set up the hints for the lookup
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_family = AF_INET; // IPv4
-
-    // Perform the blocking DNS lookup
-    err = getaddrinfo(hostname, NULL, &hints, &res);
-    if (err != 0 || res == NULL) {
-        ESP_LOGE("DNS", "DNS lookup failed: %d", err);
+    // answered from the cache unless the entry expired
+    if (!m_manager->m_dnsCache.lookup(hostname, ip_str, ip_str_len)) {
         return false;
     }
 
-    // Extract the IP address from the result
-    struct sockaddr_in *addr = (struct sockaddr_in *) res->ai_addr;
-    inet_ntop(AF_INET, &(addr->sin_addr), ip_str, ip_str_len);
-
     // save IP adrdress
     strncpy(m_lastResolvedIp, ip_str, sizeof(m_lastResolvedIp));
     m_lastResolvedIp[sizeof(m_lastResolvedIp) - 1] = '\0';
 
-    ESP_LOGI("DNS", "Resolved IP: %s", ip_str);
-
-    // Free the result
-    freeaddrinfo(res);
-
     return true;
 }
 
@@ -117,12 +99,15 @@ void StratumTaskBase::reconnectTimerCallback(TimerHandle_t xTimer)
 // Connected Callback
 void StratumTaskBase::connectedCallback()
 {
+    m_retryDelayMs = STRATUM_RETRY_DELAY_MIN_MS;
     m_manager->connectedCallback(m_index);
 }
 
 // Disconnected Callback
 void StratumTaskBase::disconnectedCallback()
 {
+    // request ids start over with the next connection
+    m_manager->m_submitters[m_index]->clearPending();
     m_manager->disconnectedCallback(m_index);
 }
 
@@ -147,6 +132,14 @@ void StratumTaskBase::stopReconnectTimer()
     }
 }
 
+// the first retry after a lost connection is quick, the delay doubles
+// with every failed attempt
+void StratumTaskBase::retryDelay()
+{
+    vTaskDelay(pdMS_TO_TICKS(m_retryDelayMs));
+    m_retryDelayMs = std::min(m_retryDelayMs * 2, (uint32_t) STRATUM_RETRY_DELAY_MAX_MS);
+}
+
 void StratumTaskBase::taskWrapper(void *pvParameters)
 {
     StratumTaskBase *task = (StratumTaskBase *) pvParameters;
@@ -194,7 +187,7 @@ void StratumTaskBase::task()
         char ip[INET_ADDRSTRLEN] = {0};
         if (!resolveHostname(m_config->getHost(), ip, sizeof(ip))) {
             ESP_LOGE(m_tag, "%s couldn't be resolved!", m_config->getHost());
-            vTaskDelay(pdMS_TO_TICKS(10000));
+            retryDelay();
             continue;
         }
 
@@ -205,7 +198,9 @@ void StratumTaskBase::task()
 
         if (!m_transport->connect(m_config->getHost(), ip, m_config->getPort())) {
             ESP_LOGE(m_tag, "Socket unable to connect to %s:%d (errno %d)", m_config->getHost(), m_config->getPort(), errno);
-            vTaskDelay(pdMS_TO_TICKS(10000));
+            // the host could have moved, resolve it again next time
+            m_manager->m_dnsCache.expire(m_config->getHost());
+            retryDelay();
             continue;
         }
 
@@ -231,7 +226,7 @@ void StratumTaskBase::task()
         if (m_reconnect) {
             continue;
         }
-        vTaskDelay(pdMS_TO_TICKS(10000)); // Delay before attempting to reconnect
+        retryDelay(); // Delay before attempting to reconnect
     }
     vTaskDelete(NULL);
 }
@@ -288,6 +283,7 @@ void StratumTaskV1::protocolLoop()
     m_firstJob = true;
 
     char *line = nullptr;
+    size_t line_len = 0;
 
     while (1) {
         if (!m_transport->isConnected()) {
@@ -298,10 +294,8 @@ void StratumTaskV1::protocolLoop()
             }
             break;
         }
-        line = m_stratumAPI.receiveJsonRpcLine(m_transport);
-
-        // release memory when out of scope
-        MemoryGuard g(line);
+        // the line stays in the receive buffer until the next call
+        line = m_stratumAPI.receiveJsonRpcLine(m_transport, &line_len);
 
         if (!line && !m_reconnect) {
             ESP_LOGE(m_tag, "Failed to receive JSON-RPC line, reconnecting ...");
@@ -315,14 +309,14 @@ void StratumTaskV1::protocolLoop()
 
         ESP_LOGI(m_tag, "rx: %s", line); // debug incoming stratum messages
 
-        PSRAMAllocator allocator;
-        JsonDocument doc(&allocator);
-
-        // Deserialize JSON
+        // Tokenize JSON in place
         // we want to know if it's valid json before the connected callback is executed
-        DeserializationError error = deserializeJson(doc, line);
-        if (error) {
-            ESP_LOGE(m_tag, "Unable to parse JSON: %s", error.c_str());
+        if (!m_stratumAPI.tokenize(line, line_len)) {
+            if (m_stratumAPI.tooManyTokens()) {
+                ESP_LOGW(m_tag, "Ignoring too complex JSON message");
+                continue;
+            }
+            ESP_LOGE(m_tag, "Unable to parse JSON");
             return;
         }
 
@@ -340,14 +334,21 @@ void StratumTaskV1::protocolLoop()
         }
 
         // parse the line
-        m_manager->dispatch(m_index, doc);
+        if (!m_stratumAPI.parse(&m_message)) {
+            ESP_LOGE(m_tag, "error in stratum");
+            continue;
+        }
+
+        m_manager->dispatch(m_index, &m_message);
     }
 }
 
-void StratumTaskV1::submitShare(const char *jobid, const char *extranonce_2, const uint32_t ntime, const uint32_t nonce,
-                              const uint32_t version_rolled, const uint32_t version_base)
+int StratumTaskV1::reserveIds(int count)
+{
+    return m_stratumAPI.nextUid(count);
+}
+
+int StratumTaskV1::submitShares(const share_submit_t *shares, int count, int first_id)
 {
-    // V1 mining.submit expects version rolling bits (delta), not full version
-    uint32_t version_delta = version_rolled ^ version_base;
-    m_stratumAPI.submitShare(m_transport, m_config->getUser(), jobid, extranonce_2, ntime, nonce, version_delta);
+    return m_stratumAPI.submitShares(m_transport, m_config->getUser(), shares, count, first_id);
 }
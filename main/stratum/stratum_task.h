@@ -6,10 +6,15 @@
 #include "freertos/timers.h"
 #include "lwip/inet.h"
 
+#include "share_submitter.h"
 #include "stratum_api.h"
 #include "stratum_config.h"
 #include "stratum_transport.h"
 
+// reconnect backoff
+#define STRATUM_RETRY_DELAY_MIN_MS 1000
+#define STRATUM_RETRY_DELAY_MAX_MS 10000
+
 class StratumManager;
 class StratumManagerFallback;
 class StratumManagerDualPool;
@@ -42,6 +47,7 @@ class StratumTaskBase {
 
     volatile bool m_isConnected = false; ///< Connection state flag
     volatile bool m_reconnect = false;
+    uint32_t m_retryDelayMs = STRATUM_RETRY_DELAY_MIN_MS;
 
     // Connection and network-related methods
     bool isWifiConnected();                                                      ///< Check if Wi-Fi is connected
@@ -59,6 +65,7 @@ class StratumTaskBase {
     void stopReconnectTimer();                                       ///< Stops the reconnect timer
 
     void triggerReconnect();
+    void retryDelay(); ///< Waits before the next connection attempt
 
     // Connection event callbacks
     void connectedCallback();    ///< Called when a pool successfully connects
@@ -66,8 +73,12 @@ class StratumTaskBase {
 
     // Pure virtual - protocol specific
     virtual void protocolLoop() = 0;
-    virtual void submitShare(const char *jobid, const char *extranonce_2, const uint32_t ntime, const uint32_t nonce,
-                             const uint32_t version_rolled, const uint32_t version_base) = 0;
+    // takes count consecutive request ids for the next submits and returns the
+    // first one, called from the share submit task
+    virtual int reserveIds(int count) = 0;
+    // writes the shares to the pool with the ids from first_id on, returns the
+    // number of shares sent
+    virtual int submitShares(const share_submit_t *shares, int count, int first_id) = 0;
     virtual StratumTransport* selectTransport() = 0;
 
     // Stratum task function
@@ -107,13 +118,14 @@ class StratumTaskV1 : public StratumTaskBase {
 
   protected:
     StratumApi m_stratumAPI;     ///< API instance for Stratum V1 communication
+    StratumApiV1Message m_message; ///< last parsed message
 
     TcpStratumTransport m_tcpTransport;
     TlsStratumTransport m_tlsTransport;
 
     void protocolLoop() override;
-    void submitShare(const char *jobid, const char *extranonce_2, const uint32_t ntime, const uint32_t nonce,
-                     const uint32_t version_rolled, const uint32_t version_base) override;
+    int reserveIds(int count) override;
+    int submitShares(const share_submit_t *shares, int count, int first_id) override;
     StratumTransport* selectTransport() override;
 
   public:
@@ -39,6 +39,12 @@ StratumTaskV2::StratumTaskV2(StratumManager *manager, int index)
     m_channelType = SV2_CHANNEL_EXTENDED; // default
 }
 
+StratumTaskV2::~StratumTaskV2()
+{
+    sv2_conn_free(&m_sv2_conn);
+    safe_free(m_coinbaseHex);
+}
+
 StratumTransport *StratumTaskV2::selectTransport()
 {
     // Load authority pubkey from NVS and configure transport
@@ -102,16 +108,11 @@ bool StratumTaskV2::loadAuthorityPubkey(uint8_t out[32])
 
 void StratumTaskV2::protocolLoop()
 {
-    // Extended Channel only for now - Standard Channel support disabled
-    // To re-enable, uncomment the config read below:
-    // uint16_t chan_cfg = m_config->isPrimary()
-    //     ? Config::getSV2ChannelType()
-    //     : Config::getFallbackSV2ChannelType();
-    // m_channelType = (chan_cfg == 1) ? SV2_CHANNEL_STANDARD : SV2_CHANNEL_EXTENDED;
-    m_channelType = SV2_CHANNEL_EXTENDED;
-
-    // Reset connection state
-    memset(&m_sv2_conn, 0, sizeof(m_sv2_conn));
+    // channel type is a per pool setting, a change triggers a reconnect
+    m_channelType = m_config->isSV2Standard() ? SV2_CHANNEL_STANDARD : SV2_CHANNEL_EXTENDED;
+
+    // Reset connection state, the pending job buffers are reused
+    sv2_conn_reset(&m_sv2_conn);
     m_sv2_conn.channel_type = m_channelType;
     m_lastSubmitTimeUs = 0;
 
@@ -147,47 +148,39 @@ void StratumTaskV2::protocolLoop()
             return;
         }
 
+        sv2_frame_header_t hdr;
+        uint8_t *payload;
         int payload_len = 0;
-        sv2_noise_ctx_t *noise = m_noiseTransport.getNoiseCtx();
-        esp_transport_handle_t transport = m_noiseTransport.getTransportHandle();
-
-        if (!noise || !transport) {
-            ESP_LOGE(m_tag, "Noise context or transport lost");
-            return;
-        }
 
-        if (sv2_noise_recv(noise, transport, m_hdrBuf, m_recvBuf,
-                           sizeof(m_recvBuf), &payload_len) != 0) {
+        if (!receiveFrame(&hdr, &payload, &payload_len)) {
             ESP_LOGE(m_tag, "Failed to receive SV2 frame, reconnecting...");
             return;
         }
 
-        sv2_frame_header_t hdr;
-        sv2_parse_frame_header(m_hdrBuf, &hdr);
-
+        // handlers parse the decrypted payload in place
         switch (hdr.msg_type) {
         case SV2_MSG_NEW_MINING_JOB:
-            handleNewMiningJob(m_recvBuf, hdr.msg_length);
+            handleNewMiningJob(payload, payload_len);
             break;
 
         case SV2_MSG_NEW_EXTENDED_MINING_JOB:
-            handleNewExtendedMiningJob(m_recvBuf, hdr.msg_length);
+            handleNewExtendedMiningJob(payload, payload_len);
             break;
 
         case SV2_MSG_SET_NEW_PREV_HASH:
-            handleSetNewPrevHash(m_recvBuf, hdr.msg_length);
+            handleSetNewPrevHash(payload, payload_len);
             break;
 
         case SV2_MSG_SET_TARGET:
-            handleSetTarget(m_recvBuf, hdr.msg_length);
+            handleSetTarget(payload, payload_len);
             break;
 
         case SV2_MSG_SUBMIT_SHARES_SUCCESS:
-            handleSubmitSharesSuccess(m_recvBuf, hdr.msg_length);
+            handleSubmitSharesSuccess(payload, payload_len);
             break;
 
         case SV2_MSG_SUBMIT_SHARES_ERROR:
-            handleSubmitSharesError(m_recvBuf, hdr.msg_length);
+            handleSubmitSharesError(payload, payload_len);
             break;
 
         default:
@@ -198,6 +191,24 @@ void StratumTaskV2::protocolLoop()
     }
 }
 
+bool StratumTaskV2::receiveFrame(sv2_frame_header_t *hdr, uint8_t **payload, int *payload_len)
+{
+    sv2_noise_ctx_t *noise = m_noiseTransport.getNoiseCtx();
+    esp_transport_handle_t transport = m_noiseTransport.getTransportHandle();
+
+    if (!noise || !transport) {
+        ESP_LOGE(m_tag, "Noise context or transport lost");
+        return false;
+    }
+
+    if (sv2_noise_recv(noise, transport, m_hdrBuf, payload, payload_len) != 0) {
+        return false;
+    }
+
+    sv2_parse_frame_header(m_hdrBuf, hdr);
+    return true;
+}
+
 // ============================================================================
 // SV2 Protocol Handshake
 // ============================================================================
@@ -237,19 +248,15 @@ bool StratumTaskV2::sendSetupConnection()
 
 bool StratumTaskV2::receiveSetupConnectionSuccess()
 {
+    sv2_frame_header_t hdr;
+    uint8_t *payload;
     int payload_len = 0;
-    sv2_noise_ctx_t *noise = m_noiseTransport.getNoiseCtx();
-    esp_transport_handle_t transport = m_noiseTransport.getTransportHandle();
 
-    if (sv2_noise_recv(noise, transport, m_hdrBuf, m_recvBuf,
-                       sizeof(m_recvBuf), &payload_len) != 0) {
+    if (!receiveFrame(&hdr, &payload, &payload_len)) {
         ESP_LOGE(m_tag, "Failed to receive SetupConnectionSuccess");
         return false;
     }
 
-    sv2_frame_header_t hdr;
-    sv2_parse_frame_header(m_hdrBuf, &hdr);
-
     if (hdr.msg_type != SV2_MSG_SETUP_CONNECTION_SUCCESS) {
         ESP_LOGE(m_tag, "SetupConnection rejected by pool (msg_type=0x%02x)", hdr.msg_type);
         return false;
@@ -257,7 +264,7 @@ bool StratumTaskV2::receiveSetupConnectionSuccess()
 
     uint16_t used_version;
     uint32_t flags;
-    if (sv2_parse_setup_connection_success(m_recvBuf, payload_len, &used_version, &flags) != 0) {
+    if (sv2_parse_setup_connection_success(payload, payload_len, &used_version, &flags) != 0) {
         ESP_LOGE(m_tag, "Failed to parse SetupConnectionSuccess");
         return false;
     }
@@ -301,19 +308,15 @@ bool StratumTaskV2::sendOpenChannel()
 
 bool StratumTaskV2::receiveOpenChannelSuccess()
 {
+    sv2_frame_header_t hdr;
+    uint8_t *payload;
     int payload_len = 0;
-    sv2_noise_ctx_t *noise = m_noiseTransport.getNoiseCtx();
-    esp_transport_handle_t transport = m_noiseTransport.getTransportHandle();
 
-    if (sv2_noise_recv(noise, transport, m_hdrBuf, m_recvBuf,
-                       sizeof(m_recvBuf), &payload_len) != 0) {
+    if (!receiveFrame(&hdr, &payload, &payload_len)) {
         ESP_LOGE(m_tag, "Failed to receive OpenChannelSuccess");
         return false;
     }
 
-    sv2_frame_header_t hdr;
-    sv2_parse_frame_header(m_hdrBuf, &hdr);
-
     uint8_t expected_msg = (m_channelType == SV2_CHANNEL_EXTENDED)
                                ? SV2_MSG_OPEN_EXTENDED_MINING_CHANNEL_SUCCESS
                                : SV2_MSG_OPEN_STANDARD_MINING_CHANNEL_SUCCESS;
@@ -333,7 +336,7 @@ bool StratumTaskV2::receiveOpenChannelSuccess()
         uint8_t extranonce_prefix_len;
 
         if (sv2_parse_open_extended_channel_success(
-                m_recvBuf, payload_len, &request_id, &channel_id, target,
+                payload, payload_len, &request_id, &channel_id, target,
                 &extranonce_size, extranonce_prefix, &extranonce_prefix_len,
                 &group_channel_id) != 0) {
             ESP_LOGE(m_tag, "Failed to parse OpenExtendedChannelSuccess");
@@ -351,7 +354,7 @@ bool StratumTaskV2::receiveOpenChannelSuccess()
         uint8_t extranonce_prefix_len;
 
         if (sv2_parse_open_channel_success(
-                m_recvBuf, payload_len, &request_id, &channel_id, target,
+                payload, payload_len, &request_id, &channel_id, target,
                 extranonce_prefix, &extranonce_prefix_len,
                 &group_channel_id) != 0) {
             ESP_LOGE(m_tag, "Failed to parse OpenChannelSuccess");
@@ -418,36 +421,28 @@ void StratumTaskV2::handleNewMiningJob(const uint8_t *payload, uint32_t len)
 void StratumTaskV2::handleNewExtendedMiningJob(const uint8_t *payload, uint32_t len)
 {
     uint32_t channel_id;
-    sv2_ext_job_t *job = sv2_parse_new_extended_mining_job(payload, len, &channel_id);
-    if (!job) {
+    sv2_ext_job_t job;
+    if (sv2_parse_new_extended_mining_job(payload, len, &job, &channel_id) != 0) {
         ESP_LOGE(m_tag, "Failed to parse NewExtendedMiningJob");
         return;
     }
 
     ESP_LOGI(m_tag, "New extended mining job: id=%lu, version=%08lx, merkle_branches=%d",
-             (unsigned long)job->job_id, (unsigned long)job->version, job->merkle_path_count);
-
-    int slot = job->job_id % SV2_PENDING_JOBS_SIZE;
+             (unsigned long)job.job_id, (unsigned long)job.version, job.merkle_path_count);
+
+    // Has min_ntime — this is a current job, processed straight from the payload
+    if (job.ntime > 0 && m_sv2_conn.has_prev_hash) {
+        memcpy(job.prev_hash, m_sv2_conn.prev_hash, 32);
+        job.nbits = m_sv2_conn.prev_hash_nbits;
+        job.clean_jobs = true;
+        enqueueExtendedJob(&job);
+        return;
+    }
 
-    if (job->ntime > 0) {
-        // Has min_ntime — this is a current job
-        if (m_sv2_conn.has_prev_hash) {
-            memcpy(job->prev_hash, m_sv2_conn.prev_hash, 32);
-            job->nbits = m_sv2_conn.prev_hash_nbits;
-            job->clean_jobs = true;
-            enqueueExtendedJob(job);
-        } else {
-            if (m_sv2_conn.ext_pending_jobs[slot]) {
-                sv2_ext_job_free(m_sv2_conn.ext_pending_jobs[slot]);
-            }
-            m_sv2_conn.ext_pending_jobs[slot] = job;
-        }
-    } else {
-        // Future job — store in pending ring
-        if (m_sv2_conn.ext_pending_jobs[slot]) {
-            sv2_ext_job_free(m_sv2_conn.ext_pending_jobs[slot]);
-        }
-        m_sv2_conn.ext_pending_jobs[slot] = job;
+    // Future job or no prev_hash yet — copy into the pending ring
+    int slot = job.job_id % SV2_PENDING_JOBS_SIZE;
+    if (sv2_ext_job_store(&m_sv2_conn.ext_pending_jobs[slot], &job) != 0) {
+        ESP_LOGE(m_tag, "Failed to store pending extended job %lu", (unsigned long)job.job_id);
     }
 }
 
@@ -500,28 +495,16 @@ void StratumTaskV2::handleSetNewPrevHash(const uint8_t *payload, uint32_t len)
     }
 
     // Resolve extended channel pending jobs
-    if (m_sv2_conn.ext_pending_jobs[slot] &&
-        m_sv2_conn.ext_pending_jobs[slot]->job_id == job_id) {
-        sv2_ext_job_t *ext_job = m_sv2_conn.ext_pending_jobs[slot];
-        m_sv2_conn.ext_pending_jobs[slot] = nullptr;
-        memcpy(ext_job->prev_hash, prev_hash, 32);
-        ext_job->ntime = min_ntime;
-        ext_job->nbits = nbits;
-        ext_job->clean_jobs = true;
-        enqueueExtendedJob(ext_job);
+    if (m_sv2_conn.ext_pending_jobs[slot].valid &&
+        m_sv2_conn.ext_pending_jobs[slot].job.job_id == job_id) {
+        enqueuePendingExtendedJob(&m_sv2_conn.ext_pending_jobs[slot], prev_hash, min_ntime, nbits);
     }
 
     if (first_prev_hash) {
         for (int i = 0; i < SV2_PENDING_JOBS_SIZE; i++) {
-            if (m_sv2_conn.ext_pending_jobs[i] &&
-                m_sv2_conn.ext_pending_jobs[i]->job_id != job_id) {
-                sv2_ext_job_t *ext_job = m_sv2_conn.ext_pending_jobs[i];
-                m_sv2_conn.ext_pending_jobs[i] = nullptr;
-                memcpy(ext_job->prev_hash, prev_hash, 32);
-                ext_job->ntime = min_ntime;
-                ext_job->nbits = nbits;
-                ext_job->clean_jobs = true;
-                enqueueExtendedJob(ext_job);
+            if (m_sv2_conn.ext_pending_jobs[i].valid &&
+                m_sv2_conn.ext_pending_jobs[i].job.job_id != job_id) {
+                enqueuePendingExtendedJob(&m_sv2_conn.ext_pending_jobs[i], prev_hash, min_ntime, nbits);
             }
         }
     }
@@ -554,11 +537,14 @@ void StratumTaskV2::handleSetTarget(const uint8_t *payload, uint32_t len)
 void StratumTaskV2::handleSubmitSharesSuccess(const uint8_t *payload, uint32_t len)
 {
     uint32_t channel_id;
+    uint32_t last_seq = 0;
     uint32_t accepted_count = 0;
-    if (sv2_parse_submit_shares_success(payload, len, &channel_id, &accepted_count) == 0) {
+    if (sv2_parse_submit_shares_success(payload, len, &channel_id, &last_seq, &accepted_count) == 0) {
         if (m_lastSubmitTimeUs > 0) {
-            float response_time_ms = (float)(esp_timer_get_time() - m_lastSubmitTimeUs) / 1000.0f;
+            int64_t response_time_us = esp_timer_get_time() - m_lastSubmitTimeUs;
+            float response_time_ms = (float)response_time_us / 1000.0f;
             ESP_LOGI(m_tag, "Shares accepted: %lu (%.1f ms)", (unsigned long)accepted_count, response_time_ms);
+            m_manager->m_submitters[m_index]->recordLatency(response_time_us);
         } else {
             ESP_LOGI(m_tag, "Shares accepted: %lu", (unsigned long)accepted_count);
         }
@@ -569,6 +555,12 @@ void StratumTaskV2::handleSubmitSharesSuccess(const uint8_t *payload, uint32_t l
         for (uint32_t i = 0; i < accepted_count; i++) {
             m_manager->acceptedShare(m_index);
         }
+        // everything up to last_seq that didn't get an error was accepted
+        uint8_t sources[SHARE_PENDING_MAX];
+        int n = m_manager->m_submitters[m_index]->takePendingUpTo((int) last_seq, sources, SHARE_PENDING_MAX);
+        for (int i = 0; i < n; i++) {
+            m_manager->shareResult(sources[i], true, false);
+        }
         m_manager->m_lastSubmitResponseTimestamp = esp_timer_get_time();
     }
 }
@@ -581,6 +573,8 @@ void StratumTaskV2::handleSubmitSharesError(const uint8_t *payload, uint32_t len
                                        error_code, sizeof(error_code)) == 0) {
         ESP_LOGW(m_tag, "Share rejected: %s", error_code);
         m_manager->rejectedShare(m_index);
+        int source = m_manager->m_submitters[m_index]->takePending((int) seq_num);
+        m_manager->shareResult(source, false, strstr(error_code, "stale") != nullptr);
         m_manager->m_lastSubmitResponseTimestamp = esp_timer_get_time();
     }
 }
@@ -589,7 +583,28 @@ void StratumTaskV2::handleSubmitSharesError(const uint8_t *payload, uint32_t len
 // Share Submission
 // ============================================================================
 
-void StratumTaskV2::submitShare(const char *jobid, const char *extranonce_2,
+int StratumTaskV2::reserveIds(int count)
+{
+    // the sequence numbers serve as ids to attribute the results
+    return (int) __atomic_fetch_add(&m_sv2_conn.sequence_number, (uint32_t) count, __ATOMIC_RELAXED);
+}
+
+int StratumTaskV2::submitShares(const share_submit_t *shares, int count, int first_id)
+{
+    // every share is its own encrypted frame
+    int sent = 0;
+    for (int i = 0; i < count; i++) {
+        const share_submit_t *share = &shares[i];
+        if (!submitShare((uint32_t) (first_id + i), share->jobid, share->extranonce2, share->ntime, share->nonce,
+                         share->version_rolled, share->version_base)) {
+            break;
+        }
+        sent++;
+    }
+    return sent;
+}
+
+bool StratumTaskV2::submitShare(uint32_t sequence_number, const char *jobid, const char *extranonce_2,
                                 const uint32_t ntime, const uint32_t nonce,
                                 const uint32_t version_rolled, const uint32_t version_base)
 {
@@ -598,7 +613,7 @@ void StratumTaskV2::submitShare(const char *jobid, const char *extranonce_2,
 
     if (!noise || !transport) {
         ESP_LOGE(m_tag, "Cannot submit share: no connection");
-        return;
+        return false;
     }
 
     // Convert string job_id to uint32_t (SV2 uses numeric job IDs)
@@ -622,27 +637,29 @@ void StratumTaskV2::submitShare(const char *jobid, const char *extranonce_2,
 
         frame_len = sv2_build_submit_shares_extended(
             buf, sizeof(buf), m_sv2_conn.channel_id,
-            m_sv2_conn.sequence_number++,
+            sequence_number,
             sv2_job_id, nonce, ntime, version_rolled,
             en2_bin, (uint8_t)en2_bin_len);
     } else {
         // Standard channel: no extranonce
         frame_len = sv2_build_submit_shares_standard(
             buf, sizeof(buf), m_sv2_conn.channel_id,
-            m_sv2_conn.sequence_number++,
+            sequence_number,
             sv2_job_id, nonce, ntime, version_rolled);
     }
 
     if (frame_len < 0) {
         ESP_LOGE(m_tag, "Failed to build SubmitShares frame");
-        return;
+        return false;
     }
 
     m_lastSubmitTimeUs = esp_timer_get_time();
 
     if (sv2_noise_send(noise, transport, buf, frame_len) != 0) {
         ESP_LOGE(m_tag, "Failed to send share");
+        return false;
     }
+    return true;
 }
 
 // ============================================================================
@@ -659,11 +676,23 @@ void StratumTaskV2::enqueueStandardJob(uint32_t job_id, uint32_t version,
                             ntime, nbits, 0x1fffe000, pdiff, clean);
 }
 
-void StratumTaskV2::enqueueExtendedJob(sv2_ext_job_t *job)
+void StratumTaskV2::enqueuePendingExtendedJob(sv2_ext_pending_job_t *slot, const uint8_t prev_hash[32],
+                                              uint32_t ntime, uint32_t nbits)
+{
+    // the slot keeps its buffer for the next job
+    slot->valid = false;
+    memcpy(slot->job.prev_hash, prev_hash, 32);
+    slot->job.ntime = ntime;
+    slot->job.nbits = nbits;
+    slot->job.clean_jobs = true;
+    enqueueExtendedJob(&slot->job);
+}
+
+void StratumTaskV2::enqueueExtendedJob(const sv2_ext_job_t *job)
 {
     uint32_t pdiff = sv2_target_to_pdiff(m_sv2_conn.target);
 
-    // Process coinbase before handing off the job (data is freed by sv2_ext_job_free below).
+    // Process coinbase before handing off the job (the job only points into the frame buffer).
     // coinbase_prefix = coinbase_1 equivalent, coinbase_suffix = coinbase_2 equivalent.
     // extranonce_prefix = extranonce1. coinbase_process expects hex strings, so encode first.
     if (job->coinbase_prefix && job->coinbase_prefix_len > 0 &&
@@ -679,10 +708,19 @@ void StratumTaskV2::enqueueExtendedJob(sv2_ext_job_t *job)
         size_t pfx_hex_len = cb1_bin_len * 2 + 1;
         size_t sfx_hex_len = job->coinbase_suffix_len * 2 + 1;
 
-        char *pfx_hex = (char *)MALLOC(pfx_hex_len);
-        char *sfx_hex = (char *)MALLOC(sfx_hex_len);
+        // both strings share one buffer that is reused for the following jobs
+        if (pfx_hex_len + sfx_hex_len > m_coinbaseHexCap) {
+            char *tmp = (char *)REALLOC(m_coinbaseHex, pfx_hex_len + sfx_hex_len);
+            if (tmp) {
+                m_coinbaseHex = tmp;
+                m_coinbaseHexCap = pfx_hex_len + sfx_hex_len;
+            }
+        }
+
+        if (pfx_hex_len + sfx_hex_len <= m_coinbaseHexCap) {
+            char *pfx_hex = m_coinbaseHex;
+            char *sfx_hex = m_coinbaseHex + pfx_hex_len;
 
-        if (pfx_hex && sfx_hex) {
             // Build coinbase_1 = coinbase_prefix + extranonce_prefix
             bin2hex(job->coinbase_prefix, job->coinbase_prefix_len, pfx_hex, pfx_hex_len);
             bin2hex(m_sv2_conn.extranonce_prefix, m_sv2_conn.extranonce_prefix_len,
@@ -694,9 +732,6 @@ void StratumTaskV2::enqueueExtendedJob(sv2_ext_job_t *job)
             m_manager->processCoinbase(m_index, pfx_hex, sfx_hex, job->version, job->nbits,
                                        "", (int)m_sv2_conn.extranonce_size);
         }
-
-        free(pfx_hex);
-        free(sfx_hex);
     }
 
     create_job_sv2_extended(m_index, job,
@@ -704,5 +739,4 @@ void StratumTaskV2::enqueueExtendedJob(sv2_ext_job_t *job)
                             m_sv2_conn.extranonce_prefix_len,
                             m_sv2_conn.extranonce_size,
                             0x1fffe000, pdiff, job->clean_jobs);
-    sv2_ext_job_free(job);
 }
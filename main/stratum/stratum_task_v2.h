@@ -7,6 +7,7 @@ extern "C" {
 #include "sv2_protocol.h"
 }
 
+// outgoing frames, received frames are decrypted in the Noise context buffer
 #define SV2_MAX_FRAME_SIZE 2048
 
 class StratumManager;
@@ -30,11 +31,14 @@ class StratumTaskV2 : public StratumTaskBase {
 
     // StratumTaskBase overrides
     void protocolLoop() override;
-    void submitShare(const char *jobid, const char *extranonce_2, const uint32_t ntime,
-                     const uint32_t nonce, const uint32_t version_rolled, const uint32_t version_base) override;
+    int reserveIds(int count) override;
+    int submitShares(const share_submit_t *shares, int count, int first_id) override;
     StratumTransport *selectTransport() override;
 
   private:
+    bool submitShare(uint32_t sequence_number, const char *jobid, const char *extranonce_2, const uint32_t ntime,
+                     const uint32_t nonce, const uint32_t version_rolled, const uint32_t version_base);
+
     // SV2 protocol handshake steps
     bool sendSetupConnection();
     bool receiveSetupConnectionSuccess();
@@ -53,16 +57,25 @@ class StratumTaskV2 : public StratumTaskBase {
     void enqueueStandardJob(uint32_t job_id, uint32_t version,
                             const uint8_t merkle_root[32], const uint8_t prev_hash[32],
                             uint32_t ntime, uint32_t nbits, bool clean);
-    void enqueueExtendedJob(sv2_ext_job_t *job);
+    void enqueueExtendedJob(const sv2_ext_job_t *job);
+    void enqueuePendingExtendedJob(sv2_ext_pending_job_t *slot, const uint8_t prev_hash[32],
+                                   uint32_t ntime, uint32_t nbits);
 
     // Helper to load authority pubkey from NVS
     bool loadAuthorityPubkey(uint8_t out[32]);
 
+    // receives the next frame, the payload is only valid until the next call
+    bool receiveFrame(sv2_frame_header_t *hdr, uint8_t **payload, int *payload_len);
+
     // Frame buffers
     uint8_t m_frameBuf[SV2_MAX_FRAME_SIZE];
-    uint8_t m_recvBuf[SV2_MAX_FRAME_SIZE];
     uint8_t m_hdrBuf[SV2_FRAME_HEADER_SIZE];
 
+    // coinbase hex strings for processCoinbase, grows with the coinbase size
+    char *m_coinbaseHex = nullptr;
+    size_t m_coinbaseHexCap = 0;
+
   public:
     StratumTaskV2(StratumManager *manager, int index);
+    ~StratumTaskV2() override;
 };
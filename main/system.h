@@ -212,8 +212,8 @@ class System {
         return m_startupDone;
     }
 
-    void pushShare(int nr) {
-        m_history->pushShare(nr);
+    void pushShare(int nr, int slave_id = 0) {
+        m_history->pushShare(nr, slave_id);
     }
 
     void pushHistory();
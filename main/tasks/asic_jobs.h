@@ -5,6 +5,7 @@
 
 #include "esp_heap_caps.h"
 
+#include "bm_job_pool.h"
 #include "macros.h"
 #include "mining.h"
 
@@ -23,20 +24,6 @@ protected:
         pthread_mutex_unlock(&m_validJobsLock);
     }
 
-    bm_job *cloneBmJob(bm_job *src)
-    {
-        bm_job *dst = (bm_job *) MALLOC(sizeof(bm_job));
-
-        // copy all
-        memcpy(dst, src, sizeof(bm_job));
-
-        // copy strings
-        dst->extranonce2 = strdup(src->extranonce2);
-        dst->jobid = strdup(src->jobid);
-
-        return dst;
-    }
-
 public:
     AsicJobs() {
         m_validJobsLock = PTHREAD_MUTEX_INITIALIZER;
@@ -48,7 +35,7 @@ public:
         int deleted = 0;
         for (int i = 0; i < MAX_ASIC_JOBS; i++) {
             if (m_activeJobs[i] && m_activeJobs[i]->pool_id == pool) {
-                free_bm_job(m_activeJobs[i]);
+                bmJobPool.release(m_activeJobs[i]);
                 m_activeJobs[i] = 0;
                 deleted++;
             }
@@ -56,26 +43,28 @@ public:
         return deleted;
     }
 
+    // takes over the caller's reference of next_job
     void storeJob(bm_job *next_job, uint8_t asic_job_id) {
         PThreadGuard g(m_validJobsLock);
-        // if a slot was used before free it
+        // if a slot was used before release it
         if (m_activeJobs[asic_job_id]) {
-            free_bm_job(m_activeJobs[asic_job_id]);
+            bmJobPool.release(m_activeJobs[asic_job_id]);
         }
         // save job into slot
         m_activeJobs[asic_job_id] = next_job;
     }
 
-    bm_job *getClone(uint8_t asic_job_id) {
+    // returns a new reference to the job, has to be released with bmJobPool.release()
+    bm_job *getJob(uint8_t asic_job_id) {
         PThreadGuard g(m_validJobsLock);
         // check if we have a job with this job id
-        if (!m_activeJobs[asic_job_id]) {
+        bm_job *job = m_activeJobs[asic_job_id];
+        if (!job) {
             return NULL;
         }
-        // create a clone
-        bm_job *job = cloneBmJob(m_activeJobs[asic_job_id]);
+        // the slot keeps its own reference
+        bmJobPool.acquire(job);
 
-        // and return it
         return job;
     }
 
@@ -1,6 +1,9 @@
 #include <string.h>
+#include <algorithm>
 
+#include "esp_attr.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "serial.h"
 #include "utils.h"
@@ -9,28 +12,77 @@
 #include "system.h"
 #include "boards/board.h"
 
-#include "simple_ring64.hpp"
+#include "duplicate_filter.hpp"
 #include "utils.h"
+#include "asic_result_task.h"
 
 static const char *TAG = "asic_result";
 
-static SimpleRing64<32> s_seen_keys;
+// shares are remembered for 5 minutes or until their set of the filter overflows
+#define DUPLICATE_FILTER_WINDOW_MS (5 * 60 * 1000)
+#define DUPLICATE_FILTER_SETS 256
+
+static EXT_RAM_BSS_ATTR DuplicateFilter<DUPLICATE_FILTER_SETS> s_seen_shares(DUPLICATE_FILTER_WINDOW_MS);
 
 static uint64_t duplicateHWNonces = 0;
+static int numAsics = 0;
+
+// only written by the result task, the 32 bit fields are read without a lock
+static asic_chip_stats_t *chipStats = nullptr;
+
+static asic_chip_stats_t *getChipStats(int asic_nr) {
+    if (!chipStats || asic_nr < 0 || asic_nr >= numAsics) {
+        return nullptr;
+    }
+    return &chipStats[asic_nr];
+}
 
-static void countDuplicateHWNonces() {
+static void countDuplicateHWNonces(int asic_nr) {
     duplicateHWNonces++;
+    asic_chip_stats_t *chip = getChipStats(asic_nr);
+    if (chip) {
+        chip->duplicates++;
+    }
 }
 
 uint64_t getDuplicateHWNonces() {
     return duplicateHWNonces;
 }
 
-// Combine nonce + version into a single 64-bit key
-static inline uint64_t make_key(uint32_t nonce, uint32_t version)
+uint32_t getDuplicateHWNoncesChip(int asic_nr) {
+    asic_chip_stats_t *chip = getChipStats(asic_nr);
+    return chip ? chip->duplicates : 0;
+}
+
+void asic_result_get_chip_stats(int asic_nr, asic_chip_stats_t *stats)
 {
-    // This order must be consistent everywhere
-    return (uint64_t(nonce) << 32) | uint64_t(version);
+    asic_chip_stats_t *chip = getChipStats(asic_nr);
+    if (!chip) {
+        *stats = {};
+        return;
+    }
+    stats->nonces = chip->nonces;
+    stats->hwErrors = chip->hwErrors;
+    stats->duplicates = chip->duplicates;
+    stats->work = chip->work;
+}
+
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static asic_result_stats_t s_stats = {};
+
+void asic_result_get_stats(asic_result_stats_t *stats)
+{
+    PThreadGuard g(stats_mutex);
+    *stats = s_stats;
+}
+
+static void update_stats(uint32_t process_time_us, bool hw_error)
+{
+    PThreadGuard g(stats_mutex);
+    s_stats.nonces++;
+    s_stats.hwErrors += hw_error ? 1 : 0;
+    s_stats.processTimeUs += process_time_us;
+    s_stats.processTimeMaxUs = std::max(s_stats.processTimeMaxUs, process_time_us);
 }
 
 void ASIC_result_task(void *pvParameters)
@@ -38,6 +90,9 @@ void ASIC_result_task(void *pvParameters)
     Board* board = SYSTEM_MODULE.getBoard();
     Asic* asics = board->getAsics();
 
+    numAsics = board->getAsicCount();
+    chipStats = (asic_chip_stats_t *) CALLOC(numAsics, sizeof(asic_chip_stats_t));
+
     while (1) {
         if (POWER_MANAGEMENT_MODULE.isShutdown()) {
             ESP_LOGW(TAG, "suspended");
@@ -79,7 +134,9 @@ void ASIC_result_task(void *pvParameters)
 
         uint8_t asic_job_id = asic_result.job_id;
 
-        bm_job *job = asicJobs.getClone(asic_job_id);
+        uint64_t process_start = esp_timer_get_time();
+
+        bm_job *job = asicJobs.getJob(asic_job_id);
         if (!job) {
             //ESP_LOGI(TAG, "Invalid job id found, 0x%02X", asic_job_id);
             continue;
@@ -89,7 +146,17 @@ void ASIC_result_task(void *pvParameters)
         asic_result.rolled_version |= job->version;
 
         // check the nonce difficulty
-        double nonce_diff = test_nonce_value(job, asic_result.nonce, asic_result.rolled_version);
+        // nonces below the pool and the asic max difficulty are neither counted nor submitted
+        // so we let test_nonce_value reject them early
+        uint32_t min_diff = std::min(job->pool_diff, board->getAsicMaxDifficulty());
+
+        // the ticket mask is the difficulty rounded down to a power of two, a nonce below
+        // a quarter of it didn't pass the mask and is a hardware error. test_nonce_value
+        // tells from the top hash bits, also for the nonces it rejects early
+        uint32_t hw_min_diff = job->asic_diff / 4;
+        bool hw_error = false;
+        double nonce_diff = test_nonce_value(job, asic_result.nonce, asic_result.rolled_version, min_diff, hw_min_diff,
+                                             &hw_error);
 
         // get best known session diff
         char bestDiffString[16];
@@ -106,19 +173,27 @@ void ASIC_result_task(void *pvParameters)
                 nonce_diff, job->pool_diff, bestDiffString);
         }
 
-        uint64_t key = make_key(asic_result.nonce, asic_result.rolled_version);
-        bool duplicate = !s_seen_keys.insert_if_absent(key);
+        uint64_t key = s_seen_shares.makeKey(job->jobid, job->extranonce2, asic_result.nonce, asic_result.rolled_version);
+        bool duplicate = !s_seen_shares.insert_if_absent(key, (uint32_t) (process_start / 1000));
         if (duplicate) {
-            ESP_LOGW(TAG, "(%s) duplicate share detected!", pool_str);
-            countDuplicateHWNonces();
+            ESP_LOGW(TAG, "(%s) duplicate share detected! AsicNr: %d", pool_str, asic_result.asic_nr);
+            countDuplicateHWNonces(asic_result.asic_nr);
+        }
+
+        asic_chip_stats_t *chip = getChipStats(asic_result.asic_nr);
+        if (chip) {
+            chip->nonces++;
+            chip->hwErrors += hw_error ? 1 : 0;
+            // the work the nonce stands for, the chip returns every nonce above its difficulty
+            chip->work += (hw_error || duplicate) ? 0 : job->asic_diff;
         }
 
         if (!duplicate && nonce_diff >= board->getAsicMaxDifficulty()) {
             SYSTEM_MODULE.pushShare(asic_result.asic_nr);
         }
 
-        // send duplicates to the server (they will get rejected and counted as rejected)
-        if (nonce_diff >= job->pool_diff) {
+        // duplicates would only be rejected by the pool
+        if (!duplicate && nonce_diff >= job->pool_diff) {
             STRATUM_MANAGER->submitShare(job->pool_id, job->jobid, job->extranonce2, job->ntime, asic_result.nonce,
                                     asic_result.rolled_version, job->version);
         }
@@ -128,6 +203,8 @@ void ASIC_result_task(void *pvParameters)
         STRATUM_MANAGER->checkForFoundBlock(job->pool_id, nonce_diff, job->target);
 
 
-        free_bm_job(job);
+        bmJobPool.release(job);
+
+        update_stats((uint32_t) (esp_timer_get_time() - process_start), hw_error);
     }
 }
@@ -1,3 +1,26 @@
 #pragma once
+
+#include <stdint.h>
+
+typedef struct
+{
+    uint32_t nonces;          // nonces matched to a job
+    uint64_t processTimeUs;   // total time from job lookup to submit
+    uint32_t processTimeMaxUs;
+    uint32_t hwErrors;        // nonces well below the difficulty the chip was given
+} asic_result_stats_t;
+
+typedef struct
+{
+    uint32_t nonces;     // nonces of the chip matched to a job
+    uint32_t hwErrors;
+    uint32_t duplicates;
+    uint32_t work;       // sum of the difficulty of the valid nonces, wraps
+} asic_chip_stats_t;
+
 void ASIC_result_task(void *pvParameters);
 
+void asic_result_get_stats(asic_result_stats_t *stats);
+
+// counters of one chip, zero before the task runs
+void asic_result_get_chip_stats(int asic_nr, asic_chip_stats_t *stats);
@@ -0,0 +1,94 @@
+#include <string.h>
+
+#include "esp_log.h"
+
+#include "bm_job_pool.h"
+#include "macros.h"
+
+static const char *TAG = "bm_job_pool";
+
+// called with the mutex held
+bool BmJobPool::grow()
+{
+    size_t size = BM_JOB_POOL_CHUNK * sizeof(entry_t);
+    entry_t *chunk = (entry_t *) MALLOC(size);
+    if (!chunk) {
+        ESP_LOGE(TAG, "couldn't allocate job chunk (%d bytes)", (int) size);
+        return false;
+    }
+
+    for (int i = 0; i < BM_JOB_POOL_CHUNK; i++) {
+        chunk[i].next = m_free;
+        m_free = &chunk[i];
+    }
+
+    m_stats.capacity += BM_JOB_POOL_CHUNK;
+    m_stats.heapAllocs++;
+    m_stats.heapBytes += size;
+
+    ESP_LOGI(TAG, "pool grown to %lu jobs", m_stats.capacity);
+    return true;
+}
+
+bm_job *BmJobPool::alloc()
+{
+    PThreadGuard g(m_mutex);
+
+    if (!m_free && !grow()) {
+        m_stats.failures++;
+        return nullptr;
+    }
+
+    entry_t *e = m_free;
+    m_free = e->next;
+
+    e->next = nullptr;
+    e->refcount = 1;
+
+    // only the strings need a defined state, everything else is set by the job builders
+    e->job.jobid[0] = '\0';
+    e->job.extranonce2[0] = '\0';
+
+    m_stats.allocs++;
+    m_stats.inUse++;
+
+    return &e->job;
+}
+
+void BmJobPool::acquire(bm_job *job)
+{
+    PThreadGuard g(m_mutex);
+    toEntry(job)->refcount++;
+    m_stats.refs++;
+}
+
+void BmJobPool::release(bm_job *job)
+{
+    if (!job) {
+        return;
+    }
+
+    PThreadGuard g(m_mutex);
+    entry_t *e = toEntry(job);
+
+    if (!e->refcount) {
+        ESP_LOGE(TAG, "release of unreferenced job");
+        return;
+    }
+
+    if (--e->refcount) {
+        return;
+    }
+
+    e->next = m_free;
+    m_free = e;
+
+    m_stats.frees++;
+    m_stats.inUse--;
+}
+
+void BmJobPool::getStats(bm_job_pool_stats_t *stats)
+{
+    PThreadGuard g(m_mutex);
+    *stats = m_stats;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include "mining.h"
+
+// number of jobs allocated at once when the pool runs dry
+#define BM_JOB_POOL_CHUNK 32
+
+typedef struct
+{
+    uint32_t allocs;      // jobs handed out by alloc()
+    uint32_t refs;        // additional references handed out by acquire()
+    uint32_t frees;       // jobs returned to the free list
+    uint32_t failures;    // alloc() calls that couldn't get memory
+    uint32_t inUse;       // jobs currently referenced
+    uint32_t capacity;    // jobs owned by the pool
+    uint32_t heapAllocs;  // chunk allocations on the heap
+    uint32_t heapBytes;   // bytes allocated on the heap
+} bm_job_pool_stats_t;
+
+// Refcounted pool of bm_jobs
+//
+// Jobs are carved out of chunks allocated from PSRAM and are never given
+// back to the heap, so after warm-up the pool serves all jobs from its free
+// list. alloc() returns a job with one reference, every acquire() has to be
+// paired with a release(). The last release puts the job back on the free list.
+class BmJobPool {
+  protected:
+    typedef struct entry
+    {
+        bm_job job; // has to be the first member
+        struct entry *next;
+        uint16_t refcount;
+    } entry_t;
+
+    entry_t *m_free = nullptr;
+    bm_job_pool_stats_t m_stats = {};
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    static entry_t *toEntry(bm_job *job)
+    {
+        return reinterpret_cast<entry_t *>(job);
+    }
+
+    bool grow();
+
+  public:
+    BmJobPool() {};
+
+    bm_job *alloc();
+    void acquire(bm_job *job);
+    void release(bm_job *job);
+
+    void getStats(bm_job_pool_stats_t *stats);
+};
+
+extern BmJobPool bmJobPool;
@@ -0,0 +1,185 @@
+#include "can_job_template.h"
+
+#include <string.h>
+#include "esp_log.h"
+
+#include "macros.h"
+#include "mining_utils.h"
+
+static const char *TAG = "can_template";
+
+// maximum supported extranonce2 length in bytes
+#define MAX_EXTRANONCE_2_LEN 32
+
+size_t can_template_serialize(const job_template_t *tpl, uint8_t *buf, size_t cap)
+{
+    size_t prefix_len = tpl->coinbasePrefixLen[0] + tpl->coinbasePrefixLen[1];
+    size_t branches_len = (size_t) tpl->merkleCount * 32;
+    size_t len = sizeof(can_template_hdr_t) + prefix_len + tpl->coinbaseSuffixLen + branches_len;
+
+    if (len > cap || prefix_len > UINT16_MAX || tpl->coinbaseSuffixLen > UINT16_MAX ||
+        tpl->merkleCount > MAX_MERKLE_BRANCHES || tpl->extranonce2Len > MAX_EXTRANONCE_2_LEN) {
+        return 0;
+    }
+
+    can_template_hdr_t hdr = {};
+    hdr.id             = 0;
+    hdr.extranonce2Len = (uint8_t) tpl->extranonce2Len;
+    hdr.merkleCount    = (uint8_t) tpl->merkleCount;
+    hdr.prefixLen      = (uint16_t) prefix_len;
+    hdr.suffixLen      = (uint16_t) tpl->coinbaseSuffixLen;
+    hdr.version        = tpl->version;
+    hdr.nbits          = tpl->nbits;
+    hdr.ntime          = tpl->ntime;
+    hdr.poolDiff       = tpl->poolDiff;
+    memcpy(hdr.prevBlockHash, tpl->prevBlockHash, 32);
+
+    uint8_t *p = buf;
+    memcpy(p, &hdr, sizeof(hdr));
+    p += sizeof(hdr);
+    for (int i = 0; i < 2; i++) {
+        if (tpl->coinbasePrefixLen[i]) {
+            memcpy(p, tpl->coinbasePrefix[i], tpl->coinbasePrefixLen[i]);
+            p += tpl->coinbasePrefixLen[i];
+        }
+    }
+    if (tpl->coinbaseSuffixLen) {
+        memcpy(p, tpl->coinbaseSuffix, tpl->coinbaseSuffixLen);
+        p += tpl->coinbaseSuffixLen;
+    }
+    if (branches_len) {
+        memcpy(p, tpl->merkleBranches, branches_len);
+    }
+    return len;
+}
+
+void can_template_init(can_job_template_t *tpl)
+{
+    memset(tpl, 0, sizeof(can_job_template_t));
+    mbedtls_sha256_init(&tpl->midstate);
+}
+
+void can_template_free(can_job_template_t *tpl)
+{
+    safe_free(tpl->buf);
+    tpl->cap = 0;
+    tpl->len = 0;
+    tpl->valid = false;
+    mbedtls_sha256_free(&tpl->midstate);
+}
+
+bool can_template_load(can_job_template_t *tpl, const uint8_t *buf, size_t len)
+{
+    tpl->valid = false;
+
+    if (len < sizeof(can_template_hdr_t) || len > CAN_TEMPLATE_MAX_LEN) {
+        ESP_LOGW(TAG, "invalid template size %d", (int) len);
+        return false;
+    }
+
+    can_template_hdr_t hdr;
+    memcpy(&hdr, buf, sizeof(hdr));
+
+    size_t expected = sizeof(hdr) + hdr.prefixLen + hdr.suffixLen + (size_t) hdr.merkleCount * 32;
+    if (expected != len || hdr.merkleCount > MAX_MERKLE_BRANCHES || hdr.extranonce2Len > MAX_EXTRANONCE_2_LEN) {
+        ESP_LOGW(TAG, "template %d malformed (len %d, expected %d)", hdr.id, (int) len, (int) expected);
+        return false;
+    }
+
+    if (len > tpl->cap) {
+        uint8_t *tmp = (uint8_t *) REALLOC(tpl->buf, len);
+        if (!tmp) {
+            ESP_LOGE(TAG, "couldn't allocate template buffer (%d bytes)", (int) len);
+            return false;
+        }
+        tpl->buf = tmp;
+        tpl->cap = len;
+    }
+    memcpy(tpl->buf, buf, len);
+    tpl->len = len;
+    tpl->hdr = hdr;
+
+    const uint8_t *prefix = tpl->buf + sizeof(hdr);
+    tpl->suffix = prefix + hdr.prefixLen;
+    tpl->merkleBranches = (const uint8_t (*)[32])(tpl->suffix + hdr.suffixLen);
+
+    // everything in front of extranonce2 is the same for all jobs of the template
+    mbedtls_sha256_free(&tpl->midstate);
+    mbedtls_sha256_init(&tpl->midstate);
+    mbedtls_sha256_starts(&tpl->midstate, 0);
+    mbedtls_sha256_update(&tpl->midstate, prefix, hdr.prefixLen);
+
+    tpl->valid = true;
+    return true;
+}
+
+void can_template_build_job(const can_job_template_t *tpl, uint32_t extranonce_2, bm_job *job)
+{
+    const can_template_hdr_t *hdr = &tpl->hdr;
+
+    // generate binary extranonce2 (big endian, zero padded)
+    uint8_t extranonce_2_bin[MAX_EXTRANONCE_2_LEN] = {0};
+    for (int i = hdr->extranonce2Len - 1, shift = 0; i >= 0 && shift < 32; i--, shift += 8) {
+        extranonce_2_bin[i] = (uint8_t) (extranonce_2 >> shift);
+    }
+
+    // finish the coinbase tx hash from the prefix midstate
+    uint8_t coinbase_hash[32];
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_clone(&ctx, &tpl->midstate);
+    mbedtls_sha256_update(&ctx, extranonce_2_bin, hdr->extranonce2Len);
+    mbedtls_sha256_update(&ctx, tpl->suffix, hdr->suffixLen);
+    mbedtls_sha256_finish(&ctx, coinbase_hash);
+    mbedtls_sha256_free(&ctx);
+    mbedtls_sha256(coinbase_hash, 32, coinbase_hash, 0);
+
+    uint8_t merkle_root[32];
+    calculate_merkle_root_bin(coinbase_hash, tpl->merkleBranches, hdr->merkleCount, merkle_root);
+
+    job->version        = hdr->version;
+    job->target         = hdr->nbits;
+    job->ntime          = hdr->ntime;
+    job->starting_nonce = 0;
+    job->pool_diff      = hdr->poolDiff;
+
+    // same byte order as construct_bm_job_bin
+    memcpy(job->merkle_root, merkle_root, 32);
+    swap_endian_words_bin(merkle_root, job->merkle_root_be, 32);
+    reverse_bytes(job->merkle_root_be, 32);
+
+    memcpy(job->prev_block_hash, hdr->prevBlockHash, 32);
+    swap_endian_words_bin((uint8_t *) hdr->prevBlockHash, job->prev_block_hash_be, 32);
+    reverse_bytes(job->prev_block_hash_be, 32);
+
+    bin2hex(extranonce_2_bin, hdr->extranonce2Len, job->extranonce2, sizeof(job->extranonce2));
+}
+
+void can_raw_job_from_job(const bm_job *job, uint32_t extranonce_2, can_raw_job_t *raw)
+{
+    raw->extranonce2 = extranonce_2;
+    raw->version     = job->version;
+    raw->nbits       = job->target;
+    raw->ntime       = job->ntime;
+    raw->poolDiff    = job->pool_diff;
+    memcpy(raw->prevBlockHash, job->prev_block_hash, 32);
+    memcpy(raw->merkleRoot,    job->merkle_root,     32);
+}
+
+void can_raw_job_build_job(const can_raw_job_t *raw, bm_job *job)
+{
+    job->version        = raw->version;
+    job->target         = raw->nbits;
+    job->ntime          = raw->ntime;
+    job->starting_nonce = 0;
+    job->pool_diff      = raw->poolDiff;
+
+    // same byte order as can_template_build_job
+    memcpy(job->merkle_root, raw->merkleRoot, 32);
+    swap_endian_words_bin((uint8_t *) raw->merkleRoot, job->merkle_root_be, 32);
+    reverse_bytes(job->merkle_root_be, 32);
+
+    memcpy(job->prev_block_hash, raw->prevBlockHash, 32);
+    swap_endian_words_bin((uint8_t *) raw->prevBlockHash, job->prev_block_hash_be, 32);
+    reverse_bytes(job->prev_block_hash_be, 32);
+}
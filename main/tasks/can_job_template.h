@@ -0,0 +1,65 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mbedtls/sha256.h"
+
+#include "can_sender.h"
+#include "create_jobs_task.h"
+#include "mining.h"
+
+// Largest serialized template (~680 CAN frames). Jobs with a bigger
+// coinbase are not handed to the slaves.
+#define CAN_TEMPLATE_MAX_LEN 4096
+
+// Serialized job template as broadcast on CAN_ID_TEMPLATE.
+// The header is followed by prefixLen bytes coinbase prefix (everything in
+// front of extranonce2), suffixLen bytes coinbase suffix and merkleCount
+// merkle branches of 32 bytes each.
+typedef struct __attribute__((__packed__)) {
+    uint8_t  id;                 // template id, assigned by the master
+    uint8_t  extranonce2Len;     // bytes
+    uint8_t  merkleCount;
+    uint16_t prefixLen;
+    uint16_t suffixLen;
+    uint32_t version;
+    uint32_t nbits;
+    uint32_t ntime;
+    uint32_t poolDiff;           // slaves only forward nonces >= poolDiff
+    uint8_t  prevBlockHash[32];  // bm_job byte order
+} can_template_hdr_t;            // 55 bytes
+
+// Received template, owns a copy of the serialized bytes (the buffer only grows)
+typedef struct {
+    can_template_hdr_t hdr;
+    uint8_t           *buf;
+    size_t             len;
+    size_t             cap;
+    const uint8_t     *suffix;                // points into buf
+    const uint8_t    (*merkleBranches)[32];   // points into buf
+    mbedtls_sha256_context midstate;          // sha256 state over the coinbase prefix
+    bool               valid;
+} can_job_template_t;
+
+/** Serialize the shared part of the current pool job. Returns 0 if it doesn't fit into cap. */
+size_t can_template_serialize(const job_template_t *tpl, uint8_t *buf, size_t cap);
+
+void can_template_init(can_job_template_t *tpl);
+void can_template_free(can_job_template_t *tpl);
+
+/** Validate and copy a serialized template and precompute the coinbase prefix midstate. */
+bool can_template_load(can_job_template_t *tpl, const uint8_t *buf, size_t len);
+
+/**
+ * Build the job for one extranonce2 from a loaded template:
+ * coinbase hash, merkle root, header fields and the extranonce2 hex.
+ * jobid, pool_id and asic_diff are left to the caller.
+ */
+void can_template_build_job(const can_job_template_t *tpl, uint32_t extranonce_2, bm_job *job);
+
+/** Header fields of a job built by the master for one slave. */
+void can_raw_job_from_job(const bm_job *job, uint32_t extranonce_2, can_raw_job_t *raw);
+
+/** Job of a received raw job, the _be fields are derived. Job id and extranonce2 hex are left to the caller. */
+void can_raw_job_build_job(const can_raw_job_t *raw, bm_job *job);
@@ -1,5 +1,6 @@
 #include "can_master_task.h"
 
+#include <pthread.h>
 #include <stddef.h>
 #include <string.h>
 #include "driver/twai.h"
@@ -12,7 +13,11 @@
 #include "asic.h"
 #include "mining.h"
 #include "can_sender.h"
+#include "can_job_template.h"
+#include "can_metrics.h"
+#include "can_share_stats.h"
 #include "global_state.h"
+#include "macros.h"
 #include "system.h"
 #include "boards/board.h"
 #include "hashrate_monitor_task.h"
@@ -175,6 +180,7 @@ void can_master_delete_slave(uint8_t slave_id)
     memset(&s_slave_reg[slave_id], 0, sizeof(slave_reg_entry_t));
     memset(&s_slave_telemetry[slave_id], 0, sizeof(can_slave_telemetry_t));
     memset(&s_slave_config[slave_id], 0, sizeof(can_slave_config_t));
+    can_shares_reset(slave_id);
     nvs_save_registry();
     ESP_LOGI(TAG, "Deleted slave id=%d from registry", slave_id);
 }
@@ -218,6 +224,237 @@ static void nvs_save_registry(void)
     nvs_close(h);
 }
 
+// ── Job templates ────────────────────────────────────────────────────────────
+//
+// The shared part of the pool job is broadcast once, each slave builds its
+// own jobs from it with extranonce2 = (slave_id << 25) | counter. The last
+// templates are kept to rebuild the jobs of incoming nonces. The newest
+// template of each pool is never replaced by the other pool, so switching
+// pools doesn't cause a rebroadcast.
+//
+// Pool jobs without a template (SV2 standard channel, or a coinbase too big
+// for the bus) are built by the job task for each slave and sent complete.
+// The last of them are kept per slave for its nonces, template id 0 marks
+// them in the nonce payload.
+
+#define CAN_TEMPLATE_HISTORY   4
+#define CAN_TEMPLATE_RESEND_MS 2000  // repeat if an active slave didn't start on it
+#define CAN_RAW_JOB_HISTORY    4
+
+static_assert(CAN_SLAVE_MAX <= 32, "acked is a 32 bit mask");
+
+typedef struct {
+    can_job_template_t tpl;
+    int      pool_id;
+    char     jobid[BM_JOB_ID_MAX_LEN];
+    int64_t  sent_us;    // first broadcast, delivery latency is measured from here
+    int64_t  resent_us;  // last broadcast
+    uint32_t acked;      // bit per slave_id
+} master_template_t;
+
+static EXT_RAM_BSS_ATTR master_template_t     s_templates[CAN_TEMPLATE_HISTORY];
+static EXT_RAM_BSS_ATTR can_slave_job_stats_t s_slave_job_stats[CAN_SLAVE_MAX];
+static EXT_RAM_BSS_ATTR uint8_t               s_resend_buf[CAN_TEMPLATE_MAX_LEN];
+
+typedef struct {
+    bm_job  *job;          // reference from bmJobPool
+    uint32_t extranonce2;
+} master_raw_job_t;
+
+static EXT_RAM_BSS_ATTR master_raw_job_t s_raw_jobs[CAN_SLAVE_MAX][CAN_RAW_JOB_HISTORY];
+static EXT_RAM_BSS_ATTR uint8_t          s_raw_job_next[CAN_SLAVE_MAX];
+
+// protects the templates and their stats
+static pthread_mutex_t      s_job_mutex        = PTHREAD_MUTEX_INITIALIZER;
+static bool                 s_templates_init   = false;
+static int                  s_template_cur     = -1;
+static int                  s_pool_latest[2]   = {-1, -1};
+static uint8_t              s_template_next_id = 1;   // 0 is never used
+static can_template_stats_t s_template_stats   = {};
+
+static master_template_t *find_template_locked(uint8_t id)
+{
+    for (int i = 0; i < CAN_TEMPLATE_HISTORY; i++) {
+        if (s_templates[i].tpl.valid && s_templates[i].tpl.hdr.id == id) {
+            return &s_templates[i];
+        }
+    }
+    return NULL;
+}
+
+static master_raw_job_t *find_raw_job_locked(uint8_t slave_id, uint32_t extranonce_2)
+{
+    for (int i = 0; i < CAN_RAW_JOB_HISTORY; i++) {
+        if (s_raw_jobs[slave_id][i].job && s_raw_jobs[slave_id][i].extranonce2 == extranonce_2) {
+            return &s_raw_jobs[slave_id][i];
+        }
+    }
+    return NULL;
+}
+
+void can_master_publish_template(int pool_id, const char *jobid, uint8_t *buf, size_t len)
+{
+    {
+        PThreadGuard g(s_job_mutex);
+
+        if (!s_templates_init) {
+            for (int i = 0; i < CAN_TEMPLATE_HISTORY; i++) {
+                can_template_init(&s_templates[i].tpl);
+            }
+            s_templates_init = true;
+        }
+
+        // same template as last time for this pool (the id byte isn't set yet)
+        int latest = s_pool_latest[pool_id];
+        if (latest >= 0) {
+            const can_job_template_t *tpl = &s_templates[latest].tpl;
+            if (tpl->valid && tpl->len == len && !memcmp(tpl->buf + 1, buf + 1, len - 1)) {
+                s_template_cur = latest;
+                return;
+            }
+        }
+
+        // replace the oldest template that isn't the newest of the other pool
+        int     slot   = -1;
+        int64_t oldest = 0;
+        for (int i = 0; i < CAN_TEMPLATE_HISTORY; i++) {
+            if (i == s_pool_latest[pool_id ^ 1]) continue;
+            int64_t sent = s_templates[i].tpl.valid ? s_templates[i].sent_us : 0;
+            if (slot < 0 || sent < oldest) {
+                slot   = i;
+                oldest = sent;
+            }
+        }
+
+        buf[0] = s_template_next_id;
+        s_template_next_id = (s_template_next_id == 0xFF) ? 1 : s_template_next_id + 1;
+
+        master_template_t *t = &s_templates[slot];
+        s_pool_latest[pool_id] = -1;
+        s_template_cur         = -1;
+        if (!can_template_load(&t->tpl, buf, len)) {
+            return;
+        }
+        t->pool_id   = pool_id;
+        strlcpy(t->jobid, jobid, sizeof(t->jobid));
+        t->sent_us   = esp_timer_get_time();
+        t->resent_us = t->sent_us;
+        t->acked     = 0;
+
+        s_pool_latest[pool_id] = slot;
+        s_template_cur         = slot;
+        s_template_stats.templates++;
+        s_template_stats.templateBytes = len;
+    }
+
+    ESP_LOGI(TAG, "(%s) broadcast template id=%d job=%s (%d bytes)",
+             pool_id ? "Sec" : "Pri", buf[0], jobid, (int) len);
+    can_send_template(buf, len);
+}
+
+bool can_master_select_template(int pool_id)
+{
+    PThreadGuard g(s_job_mutex);
+    int latest = s_pool_latest[pool_id];
+    if (latest < 0 || !s_templates[latest].tpl.valid) {
+        return false;
+    }
+    s_template_cur = latest;
+    return true;
+}
+
+void can_master_send_job(uint8_t slave_id, uint32_t extranonce_2, bm_job *job)
+{
+    if (slave_id >= CAN_SLAVE_MAX) {
+        bmJobPool.release(job);
+        return;
+    }
+
+    can_raw_job_t raw;
+    can_raw_job_from_job(job, extranonce_2, &raw);
+    {
+        PThreadGuard g(s_job_mutex);
+        master_raw_job_t *r = &s_raw_jobs[slave_id][s_raw_job_next[slave_id]];
+        s_raw_job_next[slave_id] = (s_raw_job_next[slave_id] + 1) % CAN_RAW_JOB_HISTORY;
+        if (r->job) {
+            bmJobPool.release(r->job);
+        }
+        r->job         = job;
+        r->extranonce2 = extranonce_2;
+
+        // the slaves mine on their raw jobs, the tick only keeps them alive
+        s_template_cur = -1;
+    }
+
+    ESP_LOGD(TAG, "(%s) raw job slave=%d job=%s e2=%08lX",
+             job->pool_id ? "Sec" : "Pri", slave_id, job->jobid, extranonce_2);
+    can_send_raw_job(slave_id, &raw);
+}
+
+void can_master_job_tick(void)
+{
+    uint8_t id = 0;
+    size_t  resend_len = 0;
+    {
+        PThreadGuard g(s_job_mutex);
+        master_template_t *t = (s_template_cur >= 0) ? &s_templates[s_template_cur] : NULL;
+        if (t) {
+            id = t->tpl.hdr.id;
+        }
+
+        int64_t now = esp_timer_get_time();
+        if (t && (now - t->resent_us) / 1000 >= CAN_TEMPLATE_RESEND_MS) {
+            for (int i = 1; i < CAN_SLAVE_MAX; i++) {
+                if (can_master_is_slave_active((uint8_t) i) && !(t->acked & (1u << i))) {
+                    memcpy(s_resend_buf, t->tpl.buf, t->tpl.len);
+                    resend_len   = t->tpl.len;
+                    t->resent_us = now;
+                    s_template_stats.templateResends++;
+                    break;
+                }
+            }
+        }
+    }
+
+    // sent outside of the lock, the receiver task needs the templates for nonces
+    if (resend_len) {
+        ESP_LOGW(TAG, "repeating template id=%d for slaves that didn't start on it", id);
+        can_send_template(s_resend_buf, resend_len);
+    }
+    can_send_job_tick(id);
+}
+
+static void handle_template_ack(uint8_t slave_id, uint8_t template_id)
+{
+    PThreadGuard g(s_job_mutex);
+
+    master_template_t *t = find_template_locked(template_id);
+    if (!t || (t->acked & (1u << slave_id))) return;
+    t->acked |= 1u << slave_id;
+
+    uint32_t latency_ms = (uint32_t) ((esp_timer_get_time() - t->sent_us) / 1000);
+
+    can_slave_job_stats_t *st = &s_slave_job_stats[slave_id];
+    st->templates++;
+    st->lastLatencyMs = latency_ms;
+    st->sumLatencyMs += latency_ms;
+    if (latency_ms > st->maxLatencyMs) st->maxLatencyMs = latency_ms;
+}
+
+bool can_master_get_slave_job_stats(uint8_t slave_id, can_slave_job_stats_t *out)
+{
+    if (slave_id >= CAN_SLAVE_MAX || !s_slave_reg[slave_id].used) return false;
+    PThreadGuard g(s_job_mutex);
+    *out = s_slave_job_stats[slave_id];
+    return true;
+}
+
+void can_master_get_template_stats(can_template_stats_t *out)
+{
+    PThreadGuard g(s_job_mutex);
+    *out = s_template_stats;
+}
+
 static void handle_hello(const uint8_t mac[6])
 {
     // Known slave (in NVS/RAM) → re-assign same ID
@@ -254,8 +491,11 @@ static void handle_hello(const uint8_t mac[6])
 // Nonce payload layout (matches can_slave_task.cpp):
 //   [0..3]  nonce
 //   [4..7]  rolled_version
-//   [8]     job_id
-#define NONCE_PAYLOAD_LEN 9
+//   [8]     template_id (0: raw job)
+//   [9..12] extranonce2
+//   [13]    asic_nr (missing on older slave firmware)
+#define NONCE_PAYLOAD_LEN     14
+#define NONCE_PAYLOAD_LEN_OLD 13
 
 // Generic reassembly buffer (sized for the largest payload: telemetry = 44 bytes)
 #define RX_BUF_LEN sizeof(can_slave_telemetry_t)
@@ -264,6 +504,7 @@ typedef struct {
     uint8_t buf[RX_BUF_LEN];
     size_t  len;
     bool    in_frame;
+    int64_t start_us;  // first frame, for the completion time and the timeout
 } slave_rx_t;
 
 static EXT_RAM_BSS_ATTR slave_rx_t s_nonce_rx[CAN_SLAVE_MAX];
@@ -272,48 +513,98 @@ static EXT_RAM_BSS_ATTR slave_rx_t s_config_rx[CAN_SLAVE_MAX];
 
 static void handle_nonce(Board *board, uint8_t slave_id, const uint8_t *buf, size_t len)
 {
-    if (len != NONCE_PAYLOAD_LEN) {
+    if (len != NONCE_PAYLOAD_LEN && len != NONCE_PAYLOAD_LEN_OLD) {
         ESP_LOGW(TAG, "slave %d unexpected nonce len %d", slave_id, len);
         return;
     }
 
     uint32_t nonce          = 0;
     uint32_t rolled_version = 0;
-    uint8_t  job_id         = 0;
+    uint8_t  template_id    = 0;
+    uint32_t extranonce_2   = 0;
     memcpy(&nonce,          buf + 0, 4);
     memcpy(&rolled_version, buf + 4, 4);
-    job_id = buf[8];
+    template_id = buf[8];
+    memcpy(&extranonce_2,   buf + 9, 4);
+    uint8_t  asic_nr        = (len == NONCE_PAYLOAD_LEN) ? buf[13] : 0xFF;
+
+    ESP_LOGI(TAG, "slave %d nonce=%08lX template=%d e2=%08lX", slave_id, nonce, template_id, extranonce_2);
+
+    // the extranonce2 range of a slave is fixed by its id
+    if ((extranonce_2 >> CAN_ENONCE2_SLAVE_SHIFT) != slave_id) {
+        ESP_LOGW(TAG, "slave %d nonce with foreign extranonce2 %08lX", slave_id, extranonce_2);
+        return;
+    }
+
+    bm_job *job = NULL;
+
+    if (template_id) {
+        job = bmJobPool.alloc();
+        if (!job) {
+            return;
+        }
 
-    ESP_LOGI(TAG, "slave %d nonce=%08lX job_id=%02X", slave_id, nonce, job_id);
+        // rebuild the slave's job from the template it was derived from
+        bool found = false;
+        {
+            PThreadGuard g(s_job_mutex);
+            master_template_t *t = find_template_locked(template_id);
+            if (t) {
+                can_template_build_job(&t->tpl, extranonce_2, job);
+                strlcpy(job->jobid, t->jobid, sizeof(job->jobid));
+                job->pool_id = t->pool_id;
+                found = true;
+            }
+        }
+
+        if (!found) {
+            ESP_LOGW(TAG, "slave %d unknown template %d", slave_id, template_id);
+            bmJobPool.release(job);
+            return;
+        }
+    } else {
+        // raw job, kept as it was sent
+        PThreadGuard g(s_job_mutex);
+        master_raw_job_t *r = find_raw_job_locked(slave_id, extranonce_2);
+        if (r) {
+            job = r->job;
+            bmJobPool.acquire(job);
+        }
+    }
 
-    bm_job *job = slaveAsicJobs[slave_id].getClone(job_id);
     if (!job) {
-        ESP_LOGW(TAG, "slave %d unknown job_id 0x%02X", slave_id, job_id);
+        ESP_LOGW(TAG, "slave %d unknown job e2=%08lX", slave_id, extranonce_2);
         return;
     }
 
     rolled_version |= job->version;
 
-    double nonce_diff = test_nonce_value(job, nonce, rolled_version);
+    // slaves only forward nonces >= pool diff, everything below is rejected early
+    double nonce_diff = test_nonce_value(job, nonce, rolled_version, job->pool_diff);
 
     const char *pool_str = job->pool_id ? "Sec" : "Pri";
 
-    ESP_LOGI(TAG, "(%s) slave=%d job=%02X nonce=%08" PRIX32 " diff=%.1f/pool=%lu/asic=%lu",
-             pool_str, slave_id, job_id, nonce,
+    ESP_LOGI(TAG, "(%s) slave=%d asic=%d template=%d nonce=%08" PRIX32 " diff=%.1f/pool=%lu/asic=%lu",
+             pool_str, slave_id, asic_nr, template_id, nonce,
              nonce_diff, job->pool_diff, (uint32_t) board->getAsicMaxDifficulty());
 
-    // TODO: pushShare() for slave nonces — needs asic_nr from slave
-    // (slave_id * asics_per_slave + asic_nr), not yet transmitted over CAN
-
+    // the pool result is attributed to the slave by the share submitter
     if (nonce_diff >= job->pool_diff) {
+        can_shares_submitted(slave_id, asic_nr, nonce_diff, job->pool_diff);
+        // same threshold as the shares of the own chips
+        if (nonce_diff >= board->getAsicMaxDifficulty()) {
+            SYSTEM_MODULE.pushShare(asic_nr, slave_id);
+        }
         STRATUM_MANAGER->submitShare(job->pool_id, job->jobid, job->extranonce2,
-                                     job->ntime, nonce, rolled_version, job->version);
+                                     job->ntime, nonce, rolled_version, job->version, slave_id);
+    } else {
+        can_shares_invalid(slave_id);
     }
 
     STRATUM_MANAGER->checkForBestDiff(job->pool_id, nonce_diff, job->target);
     STRATUM_MANAGER->checkForFoundBlock(job->pool_id, nonce_diff, job->target);
 
-    free_bm_job(job);
+    bmJobPool.release(job);
 }
 
 static void handle_config(uint8_t slave_id, const uint8_t *buf, size_t len)
@@ -368,6 +659,24 @@ static void handle_telemetry(uint8_t slave_id, const uint8_t *buf, size_t len)
     HASHRATE_MONITOR.setExternalHashrate(total);
 }
 
+// drop messages whose last frame never arrived, otherwise the next frames
+// with a matching SEQ would be appended to the stale data
+static void check_rx_timeouts(void)
+{
+    int64_t now = esp_timer_get_time();
+
+    for (int i = 1; i < CAN_SLAVE_MAX; i++) {
+        slave_rx_t *rx[] = { &s_nonce_rx[i], &s_telem_rx[i], &s_config_rx[i] };
+        for (slave_rx_t *s : rx) {
+            if (s->in_frame && (now - s->start_us) / 1000 > CAN_METRICS_RX_TIMEOUT_MS) {
+                ESP_LOGW(TAG, "slave %d incomplete message (%d bytes), discarding", i, s->len);
+                s->in_frame = false;
+                can_metrics_incomplete((uint8_t) i, CAN_INCOMPLETE_TIMEOUT);
+            }
+        }
+    }
+}
+
 static void check_slave_timeouts(void)
 {
     int64_t now = esp_timer_get_time();
@@ -410,25 +719,31 @@ void can_master_task(void *pvParameters)
     // Announce boot so any already-running slaves re-negotiate immediately
     can_send_master_boot(s_master_mac);
 
-    int timeout_ticks = 0;
+    int64_t last_periodic_us = esp_timer_get_time();
+    can_metrics_update();
 
     for (;;) {
+        int64_t now_us = esp_timer_get_time();
+        if (now_us - last_periodic_us >= 1000000) {  // ~1 s, also under traffic
+            last_periodic_us = now_us;
+            can_metrics_update();
+
+            check_rx_timeouts();
+            check_slave_timeouts();
+
+            // Periodic TWAI status for debugging
+            twai_status_info_t st;
+            if (twai_get_status_info(&st) == ESP_OK) {
+                ESP_LOGI(TAG, "TWAI state=%d tx_err=%lu rx_err=%lu msgs_to_tx=%lu msgs_to_rx=%lu tx_fail=%lu",
+                         st.state, st.tx_error_counter, st.rx_error_counter,
+                         st.msgs_to_tx, st.msgs_to_rx, st.tx_failed_count);
+            }
+        }
+
         twai_message_t msg;
         esp_err_t err = twai_receive(&msg, pdMS_TO_TICKS(100));
 
         if (err == ESP_ERR_TIMEOUT) {
-            if (++timeout_ticks >= 10) {  // ~1 s
-                timeout_ticks = 0;
-                check_slave_timeouts();
-
-                // Periodic TWAI status for debugging
-                twai_status_info_t st;
-                if (twai_get_status_info(&st) == ESP_OK) {
-                    ESP_LOGI(TAG, "TWAI state=%d tx_err=%lu rx_err=%lu msgs_to_tx=%lu msgs_to_rx=%lu tx_fail=%lu",
-                             st.state, st.tx_error_counter, st.rx_error_counter,
-                             st.msgs_to_tx, st.msgs_to_rx, st.tx_failed_count);
-                }
-            }
             continue;
         }
         if (err != ESP_OK) {
@@ -436,6 +751,8 @@ void can_master_task(void *pvParameters)
             continue;
         }
 
+        can_metrics_frame_rx(&msg);
+
         // ── Negotiation frames ────────────────────────────────────────────────
         if (msg.identifier == CAN_ID_HELLO && msg.data_length_code == 6) {
             handle_hello(msg.data);
@@ -453,6 +770,13 @@ void can_master_task(void *pvParameters)
             continue;
         }
 
+        if (base == CAN_ID_TEMPLATE_ACK_BASE) {
+            if (msg.data_length_code >= 2 && msg.data[0] == CAN_SEQ_LAST) {
+                handle_template_ack(slave_id, msg.data[1]);
+            }
+            continue;
+        }
+
         if (base != CAN_ID_NONCE_BASE && base != CAN_ID_TELEMETRY_BASE && base != CAN_ID_CONFIG_BASE) {
             continue;
         }
@@ -475,9 +799,11 @@ void can_master_task(void *pvParameters)
             if (s->in_frame) {
                 ESP_LOGW(TAG, "slave %d new seq=0 while in_frame (base=0x%03lX), discarding %d bytes",
                          slave_id, base, s->len);
+                can_metrics_incomplete(slave_id, CAN_INCOMPLETE_RESTART);
             }
             s->len      = 0;
             s->in_frame = true;
+            s->start_us = esp_timer_get_time();
         } else if (!s->in_frame) {
             continue;
         }
@@ -485,6 +811,7 @@ void can_master_task(void *pvParameters)
         if (s->len + dlen > maxlen) {
             ESP_LOGW(TAG, "slave %d overflow (base=0x%03lX), discarding", slave_id, base);
             s->in_frame = false;
+            can_metrics_incomplete(slave_id, CAN_INCOMPLETE_OVERFLOW);
             continue;
         }
         memcpy(s->buf + s->len, data, dlen);
@@ -495,6 +822,7 @@ void can_master_task(void *pvParameters)
         }
 
         s->in_frame = false;
+        can_metrics_message_done(can_metrics_type(msg.identifier), (uint32_t) (esp_timer_get_time() - s->start_us));
 
         if (base == CAN_ID_NONCE_BASE) {
             handle_nonce(board, slave_id, s->buf, s->len);
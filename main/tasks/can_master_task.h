@@ -12,12 +12,58 @@ extern "C" {
  * CAN Master receiver task.
  *
  * Listens for nonce frames from slaves (CAN ID 0x300 | slave_id),
- * reassembles the multiframe payload, looks up the originating bm_job
- * from asicJobs, validates the nonce and submits to Stratum — exactly
- * like ASIC_result_task does for local ASICs.
+ * reassembles the multiframe payload, rebuilds the originating bm_job
+ * from the job template and extranonce2, validates the nonce and submits
+ * to Stratum — exactly like ASIC_result_task does for local ASICs.
  */
 void can_master_task(void *pvParameters);
 
+typedef struct {
+    uint32_t templates;      // templates the slave started mining on
+    uint32_t lastLatencyMs;  // template broadcast → first job on the slave
+    uint32_t maxLatencyMs;
+    uint64_t sumLatencyMs;
+} can_slave_job_stats_t;
+
+typedef struct {
+    uint32_t templates;       // templates broadcast
+    uint32_t templateResends; // templates repeated for slaves that missed them
+    uint32_t templateBytes;   // size of the current template
+} can_template_stats_t;
+
+/**
+ * Publish the serialized template of the job the master is mining on.
+ * An unchanged template is only selected again, a changed one gets a new id
+ * (written into buf[0]) and is broadcast to all slaves.
+ */
+void can_master_publish_template(int pool_id, const char *jobid, uint8_t *buf, size_t len);
+
+/**
+ * Select the last template published for pool_id again without comparing it.
+ * Returns false if there is none, then it has to be published.
+ */
+bool can_master_select_template(int pool_id);
+
+/**
+ * Send a complete job to one slave, for pools without a template. Takes over
+ * the caller's reference of job, it is kept to validate the slave's nonces.
+ * The slaves stop mining on templates until the next one is published.
+ */
+void can_master_send_job(uint8_t slave_id, uint32_t extranonce_2, bm_job *job);
+
+/**
+ * Called every job interval after can_master_publish_template() or
+ * can_master_send_job(). Sends the job tick and repeats the template if an
+ * active slave didn't start on it.
+ */
+void can_master_job_tick(void);
+
+/** Copy job delivery statistics for slave_id. Returns false if not known. */
+bool can_master_get_slave_job_stats(uint8_t slave_id, can_slave_job_stats_t *out);
+
+/** Template broadcast counters. Bus load and errors are in can_metrics.h. */
+void can_master_get_template_stats(can_template_stats_t *out);
+
 /** Returns true if slave_id has completed CAN negotiation and is active. */
 bool can_master_is_slave_active(uint8_t slave_id);
 
@@ -0,0 +1,203 @@
+#include "can_metrics.h"
+
+#include <string.h>
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+
+// weight of the newest second in the moving averages (~10 s)
+#define EWMA_ALPHA 0.1f
+
+// all counters are updated from several tasks
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static can_metrics_t       s_metrics                    = {};
+static can_slave_metrics_t s_slave_metrics[CAN_SLAVE_MAX] = {};
+
+// accumulated since the last can_metrics_update()
+static uint32_t s_frames                    = 0;
+static uint64_t s_bits                      = 0;
+static uint64_t s_slave_bits[CAN_SLAVE_MAX] = {};
+static float    s_slave_bps[CAN_SLAVE_MAX]  = {};
+static float    s_bps                       = 0.0f;
+static int64_t  s_last_update_us            = 0;
+
+can_msg_type_t can_metrics_type(uint32_t identifier)
+{
+    switch (identifier & 0xF80) {
+    case CAN_ID_NONCE_BASE:
+        return CAN_MSG_NONCE;
+    case CAN_ID_TELEMETRY_BASE:
+        return CAN_MSG_TELEMETRY;
+    case CAN_ID_SETTINGS_BASE:
+        return CAN_MSG_SETTINGS;
+    case CAN_ID_TEMPLATE:
+        return CAN_MSG_TEMPLATE;
+    case CAN_ID_TEMPLATE_ACK_BASE:
+        return CAN_MSG_TEMPLATE_ACK;
+    case CAN_ID_CONFIG_BASE:
+        return CAN_MSG_CONFIG;
+    default:
+        return CAN_MSG_CONTROL;
+    }
+}
+
+// frames the slaves send carry their id, everything else is shared traffic
+static bool is_slave_frame(can_msg_type_t type)
+{
+    return type == CAN_MSG_NONCE || type == CAN_MSG_TELEMETRY || type == CAN_MSG_TEMPLATE_ACK ||
+           type == CAN_MSG_CONFIG;
+}
+
+static void count_frame(const twai_message_t *msg, bool rx)
+{
+    can_msg_type_t type = can_metrics_type(msg->identifier);
+    uint32_t bits = CAN_FRAME_BITS(msg->data_length_code);
+    uint8_t slave_id = (uint8_t) (msg->identifier & 0x7F);
+
+    portENTER_CRITICAL(&s_mux);
+    s_frames++;
+    s_bits += bits;
+    s_metrics.msg[type].frames++;
+    if (rx) {
+        s_metrics.rxFrames++;
+        if (is_slave_frame(type) && slave_id < CAN_SLAVE_MAX) {
+            s_slave_metrics[slave_id].rxFrames++;
+            s_slave_bits[slave_id] += bits;
+        }
+    } else {
+        s_metrics.txFrames++;
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void can_metrics_frame_tx(const twai_message_t *msg)
+{
+    count_frame(msg, false);
+}
+
+void can_metrics_frame_rx(const twai_message_t *msg)
+{
+    count_frame(msg, true);
+}
+
+void can_metrics_tx_error(void)
+{
+    portENTER_CRITICAL(&s_mux);
+    s_metrics.txErrors++;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void can_metrics_bus_off_recovery(void)
+{
+    portENTER_CRITICAL(&s_mux);
+    s_metrics.busOffRecoveries++;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void can_metrics_message_done(can_msg_type_t type, uint32_t duration_us)
+{
+    portENTER_CRITICAL(&s_mux);
+    can_msg_stats_t *m = &s_metrics.msg[type];
+    m->messages++;
+    m->lastUs = duration_us;
+    m->sumUs += duration_us;
+    if (duration_us > m->maxUs) m->maxUs = duration_us;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void can_metrics_incomplete(uint8_t slave_id, can_incomplete_t reason)
+{
+    if (slave_id >= CAN_SLAVE_MAX) return;
+    portENTER_CRITICAL(&s_mux);
+    s_metrics.incomplete++;
+    s_slave_metrics[slave_id].incomplete[reason]++;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void can_metrics_sample_tx_queue(void)
+{
+    twai_status_info_t st;
+    if (twai_get_status_info(&st) != ESP_OK) return;
+
+    portENTER_CRITICAL(&s_mux);
+    if (st.msgs_to_tx > s_metrics.txQueueMax) s_metrics.txQueueMax = st.msgs_to_tx;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void can_metrics_update(void)
+{
+    int64_t now = esp_timer_get_time();
+    if (!s_last_update_us) {
+        s_last_update_us = now;
+        return;
+    }
+    float elapsed_s = (float) (now - s_last_update_us) / 1e6f;
+    s_last_update_us = now;
+    if (elapsed_s <= 0.0f) return;
+
+    twai_status_info_t st = {};
+    bool have_status = twai_get_status_info(&st) == ESP_OK;
+
+    portENTER_CRITICAL(&s_mux);
+    float bps = (float) s_bits / elapsed_s;
+    s_bps = s_bps ? s_bps + EWMA_ALPHA * (bps - s_bps) : bps;
+
+    s_metrics.load         = bps / (float) CAN_BITRATE * 100.0f;
+    s_metrics.loadAvg      = s_bps / (float) CAN_BITRATE * 100.0f;
+    s_metrics.framesPerSec = (uint32_t) ((float) s_frames / elapsed_s);
+    s_frames = 0;
+    s_bits   = 0;
+
+    // per slave traffic, the rest (templates, job ticks, settings) doesn't grow with the fleet
+    float slave_sum = 0.0f;
+    int   slaves    = 0;
+    for (int i = 1; i < CAN_SLAVE_MAX; i++) {
+        float sbps = (float) s_slave_bits[i] / elapsed_s;
+        s_slave_bits[i] = 0;
+        s_slave_bps[i] += EWMA_ALPHA * (sbps - s_slave_bps[i]);
+        s_slave_metrics[i].bitsPerSec = (uint32_t) s_slave_bps[i];
+        if (s_slave_bps[i] >= 1.0f) {
+            slave_sum += s_slave_bps[i];
+            slaves++;
+        }
+    }
+
+    s_metrics.maxSlavesEstimate = 0;
+    if (slaves) {
+        float per_slave = slave_sum / (float) slaves;
+        float shared    = s_bps > slave_sum ? s_bps - slave_sum : 0.0f;
+        float budget    = CAN_METRICS_LOAD_LIMIT / 100.0f * (float) CAN_BITRATE - shared;
+        if (budget > 0.0f) {
+            s_metrics.maxSlavesEstimate = (uint32_t) (budget / per_slave);
+        }
+    }
+
+    if (have_status) {
+        s_metrics.txQueue   = st.msgs_to_tx;
+        s_metrics.arbLost   = st.arb_lost_count;
+        s_metrics.busErrors = st.bus_error_count;
+        s_metrics.txFailed  = st.tx_failed_count;
+        s_metrics.rxMissed  = st.rx_missed_count;
+        s_metrics.rxOverrun = st.rx_overrun_count;
+        if (st.msgs_to_tx > s_metrics.txQueueMax) s_metrics.txQueueMax = st.msgs_to_tx;
+    }
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void can_metrics_get(can_metrics_t *out)
+{
+    portENTER_CRITICAL(&s_mux);
+    *out = s_metrics;
+    portEXIT_CRITICAL(&s_mux);
+}
+
+void can_metrics_get_slave(uint8_t slave_id, can_slave_metrics_t *out)
+{
+    if (slave_id >= CAN_SLAVE_MAX) {
+        memset(out, 0, sizeof(*out));
+        return;
+    }
+    portENTER_CRITICAL(&s_mux);
+    *out = s_slave_metrics[slave_id];
+    portEXIT_CRITICAL(&s_mux);
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/twai.h"
+#include "can_sender.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * CAN bus metrics, collected on the master.
+ *
+ * can_sender counts every transmitted frame, the master receiver task every
+ * received one. The master sees all traffic on the bus (it is the only
+ * receiver of the slave frames and the only sender of broadcasts), so the
+ * sum is the bus load. can_metrics_update() turns the counters into rates
+ * once per second and samples the TWAI driver error counters.
+ */
+
+// Bus load up to which the fleet size estimate is calculated. Stuff bits
+// aren't counted, they add up to ~20% on top.
+#define CAN_METRICS_LOAD_LIMIT 70.0f
+
+// A multiframe message that doesn't complete within this time is dropped
+#define CAN_METRICS_RX_TIMEOUT_MS 500
+
+typedef enum {
+    CAN_MSG_CONTROL = 0,   // HELLO, ASSIGN, MASTER_BOOT, JOB_TICK
+    CAN_MSG_NONCE,
+    CAN_MSG_TELEMETRY,
+    CAN_MSG_SETTINGS,
+    CAN_MSG_TEMPLATE,
+    CAN_MSG_TEMPLATE_ACK,
+    CAN_MSG_CONFIG,
+    CAN_MSG_TYPES
+} can_msg_type_t;
+
+// Why a multiframe message was dropped
+typedef enum {
+    CAN_INCOMPLETE_RESTART = 0, // new first frame while in frame
+    CAN_INCOMPLETE_OVERFLOW,    // longer than expected
+    CAN_INCOMPLETE_TIMEOUT,     // last frame didn't arrive
+} can_incomplete_t;
+
+typedef struct {
+    uint32_t frames;     // frames sent and received
+    uint32_t messages;   // completed multiframe messages
+    uint32_t lastUs;     // first to last frame of the latest message
+    uint32_t maxUs;
+    uint64_t sumUs;
+} can_msg_stats_t;
+
+typedef struct {
+    float    load;              // bus utilisation of the last second in %
+    float    loadAvg;           // moving average over ~10 s
+    uint32_t framesPerSec;
+    uint32_t txFrames;
+    uint32_t rxFrames;
+    uint32_t txErrors;          // twai_transmit() calls that failed
+    uint32_t busOffRecoveries;
+    uint32_t txQueue;           // frames waiting in the TWAI TX queue
+    uint32_t txQueueMax;
+    // TWAI driver counters since the driver was installed
+    uint32_t arbLost;
+    uint32_t busErrors;
+    uint32_t txFailed;
+    uint32_t rxMissed;
+    uint32_t rxOverrun;
+    uint32_t incomplete;        // dropped multiframe messages of all slaves
+    uint32_t maxSlavesEstimate; // slaves until CAN_METRICS_LOAD_LIMIT, 0 = unknown
+    can_msg_stats_t msg[CAN_MSG_TYPES];
+} can_metrics_t;
+
+typedef struct {
+    uint32_t rxFrames;
+    uint32_t bitsPerSec;        // moving average of the frames sent by the slave
+    uint32_t incomplete[3];     // indexed by can_incomplete_t
+} can_slave_metrics_t;
+
+/** Message type of a CAN identifier. */
+can_msg_type_t can_metrics_type(uint32_t identifier);
+
+/** A frame was handed to the TWAI driver. */
+void can_metrics_frame_tx(const twai_message_t *msg);
+
+/** A frame was received. */
+void can_metrics_frame_rx(const twai_message_t *msg);
+
+void can_metrics_tx_error(void);
+void can_metrics_bus_off_recovery(void);
+
+/** A multiframe message took duration_us from the first to the last frame. */
+void can_metrics_message_done(can_msg_type_t type, uint32_t duration_us);
+
+/** A multiframe message of slave_id was dropped. */
+void can_metrics_incomplete(uint8_t slave_id, can_incomplete_t reason);
+
+/** Sample the TX queue depth, called after bursts. */
+void can_metrics_sample_tx_queue(void);
+
+/** Update rates and driver counters, call about once a second. */
+void can_metrics_update(void);
+
+void can_metrics_get(can_metrics_t *out);
+void can_metrics_get_slave(uint8_t slave_id, can_slave_metrics_t *out);
+
+#ifdef __cplusplus
+}
+#endif
@@ -5,8 +5,9 @@
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
+#include "esp_timer.h"
 #include "mining.h"
-#include "asic.h"
+#include "can_metrics.h"
 
 static const char *TAG = "can_sender";
 
@@ -33,7 +34,11 @@ static void tx_unlock(void)
 static esp_err_t can_transmit_with_recovery(twai_message_t *frame)
 {
     esp_err_t err = twai_transmit(frame, pdMS_TO_TICKS(50));
-    if (err == ESP_OK) return ESP_OK;
+    if (err == ESP_OK) {
+        can_metrics_frame_tx(frame);
+        return ESP_OK;
+    }
+    can_metrics_tx_error();
 
     twai_status_info_t status;
     if (err == ESP_ERR_INVALID_STATE &&
@@ -42,6 +47,7 @@ static esp_err_t can_transmit_with_recovery(twai_message_t *frame)
         if (status.state == TWAI_STATE_BUS_OFF) {
             ESP_LOGW(TAG, "BUS_OFF detected (tx_err=%lu), initiating recovery", status.tx_error_counter);
             twai_initiate_recovery();
+            can_metrics_bus_off_recovery();
             for (int i = 0; i < 20; i++) {
                 vTaskDelay(pdMS_TO_TICKS(50));
                 if (twai_get_status_info(&status) == ESP_OK &&
@@ -169,27 +175,71 @@ void can_send_settings_cmd(uint8_t slave_id, const uint8_t *payload, size_t len)
     tx_unlock();
 }
 
-void can_send_raw_job(uint8_t slave_id, uint8_t job_id, const bm_job *job)
+void can_send_template(const uint8_t *data, size_t len)
 {
-    BM1368_job raw = {};
-
-    raw.job_id         = job_id;
-    raw.num_midstates  = 0x01;
-    memcpy(raw.starting_nonce, &job->starting_nonce, 4);
-    memcpy(raw.nbits,          &job->target,         4);
-    memcpy(raw.ntime,          &job->ntime,           4);
-    memcpy(raw.merkle_root,     job->merkle_root_be,  32);
-    memcpy(raw.prev_block_hash, job->prev_block_hash_be, 32);
-    memcpy(raw.version,        &job->version,         4);
-
-    // Append pool_diff so slave can filter nonces below pool threshold
-    uint8_t payload[sizeof(BM1368_job) + sizeof(uint32_t)];
-    memcpy(payload, &raw, sizeof(BM1368_job));
-    memcpy(payload + sizeof(BM1368_job), &job->pool_diff, sizeof(uint32_t));
+    size_t   offset = 0;
+    uint16_t seq    = 0;
+
+    ESP_LOGD(TAG, "TX TEMPLATE id=%d len=%d", len ? data[0] : 0, len);
+    tx_lock();
+    int64_t start_us = esp_timer_get_time();
+    while (offset < len) {
+        size_t remaining = len - offset;
+        bool   is_last   = (remaining <= CAN_TEMPLATE_FRAME_DATA);
+        size_t chunk     = is_last ? remaining : CAN_TEMPLATE_FRAME_DATA;
+        uint16_t s       = is_last ? (seq | CAN_TEMPLATE_SEQ_LAST) : seq;
+
+        twai_message_t frame = {};
+        frame.identifier       = CAN_ID_TEMPLATE;
+        frame.data_length_code = (uint8_t)(2 + chunk);
+        frame.data[0]          = (uint8_t)(s & 0xFF);
+        frame.data[1]          = (uint8_t)(s >> 8);
+        memcpy(&frame.data[2], data + offset, chunk);
+
+        // a lost frame breaks the template, slaves that miss it get it again
+        if (can_transmit_with_recovery(&frame) != ESP_OK) {
+            break;
+        }
+
+        offset += chunk;
+        seq++;
+    }
+    // the longest burst on the bus, the TX queue is fullest here
+    can_metrics_sample_tx_queue();
+    if (offset == len) {
+        can_metrics_message_done(CAN_MSG_TEMPLATE, (uint32_t) (esp_timer_get_time() - start_us));
+    }
+    tx_unlock();
+}
 
+void can_send_raw_job(uint8_t slave_id, const can_raw_job_t *job)
+{
     uint32_t can_id = CAN_ID_JOB_BASE | (slave_id & 0x7F);
-    ESP_LOGD(TAG, "TX JOB slave=%d ntime=%08lX pool_diff=%lu", slave_id, job->ntime, job->pool_diff);
+    ESP_LOGD(TAG, "TX JOB slave=%d e2=%08lX ntime=%08lX", slave_id, job->extranonce2, job->ntime);
+    tx_lock();
+    send_multiframe(can_id, (const uint8_t *) job, sizeof(can_raw_job_t));
+    tx_unlock();
+}
+
+void can_send_job_tick(uint8_t template_id)
+{
+    twai_message_t msg = {};
+    msg.identifier       = CAN_ID_JOB_TICK;
+    msg.data_length_code = 1;
+    msg.data[0]          = template_id;
+    tx_lock();
+    can_transmit_with_recovery(&msg);
+    tx_unlock();
+}
+
+void can_send_template_ack(uint8_t slave_id, uint8_t template_id)
+{
+    twai_message_t msg = {};
+    msg.identifier       = CAN_ID_TEMPLATE_ACK_BASE | (slave_id & 0x7F);
+    msg.data_length_code = 2;
+    msg.data[0]          = CAN_SEQ_LAST;
+    msg.data[1]          = template_id;
     tx_lock();
-    send_multiframe(can_id, payload, sizeof(payload));
+    can_transmit_with_recovery(&msg);
     tx_unlock();
 }
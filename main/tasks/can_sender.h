@@ -7,12 +7,15 @@
 #define CAN_ID_HELLO          0x100   // slave broadcast: MAC[6]
 #define CAN_ID_ASSIGN         0x101   // master broadcast: MAC[6] + can_id[1]
 #define CAN_ID_MASTER_BOOT    0x102   // master broadcast: no payload
+#define CAN_ID_JOB_TICK       0x103   // master broadcast: template_id[1], slaves start their next job
 
 // CAN IDs — operational range
-#define CAN_ID_JOB_BASE       0x200   // + slave_id, master→slave: raw ASIC job
+#define CAN_ID_JOB_BASE       0x200   // + slave_id, master→slave: complete job (can_raw_job_t) for pools without a template
 #define CAN_ID_NONCE_BASE     0x300   // + slave_id, slave→master: found nonce
 #define CAN_ID_TELEMETRY_BASE 0x400   // + slave_id, slave→master: live telemetry
 #define CAN_ID_SETTINGS_BASE  0x500   // + slave_id, master→slave: settings cmd
+#define CAN_ID_TEMPLATE       0x600   // master broadcast: job template (can_template_hdr_t + data)
+#define CAN_ID_TEMPLATE_ACK_BASE 0x680 // + slave_id, slave→master: template_id[1] after the first job from it
 #define CAN_ID_CONFIG_BASE    0x700   // + slave_id, slave→master: device info + settings (sent once after ASSIGN)
 
 #define CAN_SLAVE_ID_UNASSIGNED 0xFF
@@ -57,6 +60,19 @@ typedef struct __attribute__((__packed__)) {
     uint8_t  autoScreenOff;     // 1 = auto screen off enabled
 } can_slave_config_t;           // 46 bytes → 7 CAN frames
 
+// Complete job for one slave, used when the pool job has no template
+// (SV2 standard channel) or the template doesn't fit. Sent on
+// CAN_ID_JOB_BASE + slave_id.
+typedef struct __attribute__((__packed__)) {
+    uint32_t extranonce2;        // slave's extranonce2, identifies the job on the master
+    uint32_t version;
+    uint32_t nbits;
+    uint32_t ntime;
+    uint32_t poolDiff;           // slaves only forward nonces >= poolDiff
+    uint8_t  prevBlockHash[32];  // bm_job byte order
+    uint8_t  merkleRoot[32];     // bm_job byte order
+} can_raw_job_t;                 // 84 bytes → 12 CAN frames
+
 // Settings commands sent master→slave on CAN_ID_SETTINGS_BASE + slave_id.
 // All are single-frame: SEQ=0xFF, byte[1]=cmd, bytes[2..] = value.
 #define CAN_CMD_SET_FREQ     0x01  // uint16_le freq_mhz
@@ -71,6 +87,16 @@ typedef struct __attribute__((__packed__)) {
 // Multiframe SEQ byte: 0x00..0x7E = continuation, 0xFF = last frame
 #define CAN_SEQ_LAST        0xFF
 
+// Templates don't fit into 255 frames: 16 bit little endian SEQ in bytes 0..1
+// (bit 15 = last frame) followed by up to 6 data bytes
+#define CAN_TEMPLATE_SEQ_LAST 0x8000
+#define CAN_TEMPLATE_FRAME_DATA 6
+
+// Bits on the bus for a standard frame without stuff bits:
+// SOF, ID, RTR, IDE, r0, DLC (19) + data + CRC, delimiters, ACK, EOF, IFS (28)
+#define CAN_FRAME_BITS(dlc) (47 + 8 * (dlc))
+#define CAN_BITRATE 500000
+
 // Upper 7 bits of extranonce_2 encode the slave_id (0..127).
 // Lower 25 bits are the per-slave rolling counter.
 #define CAN_SLAVE_MAX       32   // maximum number of slaves on the bus
@@ -100,15 +126,22 @@ void can_send_config(uint8_t slave_id, const can_slave_config_t *c);
 void can_send_settings_cmd(uint8_t slave_id, const uint8_t *payload, size_t len);
 
 /**
- * Send a raw job to one slave over CAN.
- * Assembles the same BM1368_job byte layout that asic.cpp uses and
- * transmits it as multiframe CAN message. The slave forwards it 1:1 to its ASIC.
- *
- * @param slave_id  0..127
- * @param job_id    ASIC job ID byte (from jobToAsicId())
- * @param job       fully built bm_job for this slave (merkle_root already slave-specific)
+ * Broadcast a serialized job template (see can_job_template.h) to all slaves.
+ * Sent with the lowest priority of the job traffic, nonces overtake it.
  */
-void can_send_raw_job(uint8_t slave_id, uint8_t job_id, const bm_job *job);
+void can_send_template(const uint8_t *data, size_t len);
+
+/** Send a complete job to one slave (pools without a job template). */
+void can_send_raw_job(uint8_t slave_id, const can_raw_job_t *job);
+
+/**
+ * Broadcast the job tick: every slave starts the next job from template_id.
+ * Template id 0 only keeps the slaves alive, they mine on their raw jobs.
+ */
+void can_send_job_tick(uint8_t template_id);
+
+/** Slave confirms the first job built from template_id. */
+void can_send_template_ack(uint8_t slave_id, uint8_t template_id);
 
 /**
  * Returns the extranonce_2 value to use for a given slave and counter.
@@ -0,0 +1,168 @@
+#include "can_share_stats.h"
+
+#include <pthread.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+#include "macros.h"
+
+typedef struct {
+    can_slave_share_stats_t stats;
+    float    diffSum[CAN_SHARE_HISTORY]; // sum of the pool diffs of the shares per bucket
+    uint32_t firstBucket;                // bucket of the first share
+    uint32_t lastBucket;                 // newest bucket in diffSum
+    uint32_t startS;                     // time of the first share
+    bool     started;
+} slave_shares_t;
+
+static EXT_RAM_BSS_ATTR slave_shares_t s_slaves[CAN_SLAVE_MAX];
+static pthread_mutex_t                 s_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static uint32_t now_s(void)
+{
+    return (uint32_t) (esp_timer_get_time() / 1000000);
+}
+
+// GH/s for the sum of pool diffs found in the given time
+static float diff_to_ghs(double diff_sum, uint32_t seconds)
+{
+    if (!seconds) return 0.0f;
+    return (float) (diff_sum * 4294967296.0 / (double) seconds / 1e9);
+}
+
+// move the ring forward to bucket, buckets without shares are zeroed
+static void advance_locked(slave_shares_t *s, uint32_t bucket)
+{
+    if (!s->started || bucket <= s->lastBucket) return;
+
+    uint32_t n = bucket - s->lastBucket;
+    if (n > CAN_SHARE_HISTORY) n = CAN_SHARE_HISTORY;
+    for (uint32_t i = 1; i <= n; i++) {
+        s->diffSum[(s->lastBucket + i) % CAN_SHARE_HISTORY] = 0.0f;
+    }
+    s->lastBucket = bucket;
+}
+
+// share based hashrate of the last `buckets` buckets including the current one
+static float window_hashrate_locked(const slave_shares_t *s, uint32_t now, uint32_t buckets)
+{
+    uint32_t bucket  = now / CAN_SHARE_BUCKET_S;
+    uint32_t first   = (bucket + 1 >= buckets) ? bucket + 1 - buckets : 0;
+    if (first < s->firstBucket) first = s->firstBucket;
+
+    double sum = 0.0;
+    for (uint32_t b = first; b <= bucket; b++) {
+        sum += s->diffSum[b % CAN_SHARE_HISTORY];
+    }
+
+    uint32_t covered = now - first * CAN_SHARE_BUCKET_S;
+    uint32_t since   = now - s->startS;
+    return diff_to_ghs(sum, covered < since ? covered : since);
+}
+
+void can_shares_submitted(uint8_t slave_id, uint8_t asic_nr, double diff, uint32_t pool_diff)
+{
+    if (slave_id >= CAN_SLAVE_MAX) return;
+
+    uint32_t now    = now_s();
+    uint32_t bucket = now / CAN_SHARE_BUCKET_S;
+
+    PThreadGuard g(s_mutex);
+    slave_shares_t *s = &s_slaves[slave_id];
+    if (!s->started) {
+        memset(s->diffSum, 0, sizeof(s->diffSum));
+        s->firstBucket = bucket;
+        s->lastBucket  = bucket;
+        s->startS      = now;
+        s->started     = true;
+    }
+    advance_locked(s, bucket);
+    s->diffSum[bucket % CAN_SHARE_HISTORY] += (float) pool_diff;
+
+    can_slave_share_stats_t *st = &s->stats;
+    st->shares++;
+    if (diff > st->bestDiff) st->bestDiff = diff;
+    if (asic_nr < CAN_SHARE_ASICS_MAX) {
+        st->asicShares[asic_nr]++;
+        if (asic_nr >= st->numAsics) st->numAsics = asic_nr + 1;
+    }
+}
+
+void can_shares_invalid(uint8_t slave_id)
+{
+    if (slave_id >= CAN_SLAVE_MAX) return;
+    PThreadGuard g(s_mutex);
+    s_slaves[slave_id].stats.invalid++;
+}
+
+void can_shares_result(uint8_t slave_id, can_share_result_t result)
+{
+    if (slave_id >= CAN_SLAVE_MAX) return;
+
+    PThreadGuard g(s_mutex);
+    can_slave_share_stats_t *st = &s_slaves[slave_id].stats;
+    switch (result) {
+    case CAN_SHARE_ACCEPTED:
+        st->accepted++;
+        break;
+    case CAN_SHARE_STALE:
+        st->stale++;
+        // fall through, stale shares are rejected shares
+    case CAN_SHARE_REJECTED:
+        st->rejected++;
+        break;
+    }
+}
+
+void can_shares_reset(uint8_t slave_id)
+{
+    if (slave_id >= CAN_SLAVE_MAX) return;
+    PThreadGuard g(s_mutex);
+    memset(&s_slaves[slave_id], 0, sizeof(slave_shares_t));
+}
+
+bool can_shares_get(uint8_t slave_id, can_slave_share_stats_t *out)
+{
+    if (slave_id >= CAN_SLAVE_MAX) return false;
+
+    uint32_t now = now_s();
+
+    PThreadGuard g(s_mutex);
+    slave_shares_t *s = &s_slaves[slave_id];
+    advance_locked(s, now / CAN_SHARE_BUCKET_S);
+    *out = s->stats;
+    if (s->started) {
+        out->hashrate10m = window_hashrate_locked(s, now, 600 / CAN_SHARE_BUCKET_S);
+        out->hashrate1h  = window_hashrate_locked(s, now, 3600 / CAN_SHARE_BUCKET_S);
+    }
+    return true;
+}
+
+int can_shares_get_history(uint8_t slave_id, float *out, int max, uint32_t *current_age_s)
+{
+    *current_age_s = 0;
+    if (slave_id >= CAN_SLAVE_MAX || max <= 0) return 0;
+
+    uint32_t now    = now_s();
+    uint32_t bucket = now / CAN_SHARE_BUCKET_S;
+
+    PThreadGuard g(s_mutex);
+    slave_shares_t *s = &s_slaves[slave_id];
+    if (!s->started) return 0;
+    advance_locked(s, bucket);
+
+    uint32_t count = bucket - s->firstBucket + 1;
+    if (count > CAN_SHARE_HISTORY) count = CAN_SHARE_HISTORY;
+    if (count > (uint32_t) max) count = (uint32_t) max;
+
+    uint32_t first = bucket + 1 - count;
+    for (uint32_t b = first; b <= bucket; b++) {
+        uint32_t start    = b * CAN_SHARE_BUCKET_S;
+        if (start < s->startS) start = s->startS;
+        uint32_t duration = (b == bucket) ? now - start : (b + 1) * CAN_SHARE_BUCKET_S - start;
+        out[b - first] = diff_to_ghs(s->diffSum[b % CAN_SHARE_HISTORY], duration);
+    }
+    *current_age_s = now - bucket * CAN_SHARE_BUCKET_S;
+    return (int) count;
+}
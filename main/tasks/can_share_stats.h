@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "can_sender.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Share accounting for the CAN slaves, kept on the master.
+ *
+ * Every nonce a slave forwards is validated by the master and submitted with
+ * the slave id as source, the pool result is attributed back to the slave.
+ * The hashrate is derived from the shares: each share >= pool diff stands for
+ * pool_diff * 2^32 hashes on average, independent of what the slave reports.
+ */
+
+// per slave ASICs counted in the nonce distribution
+#define CAN_SHARE_ASICS_MAX 16
+
+// share history per slave: 5 minute buckets over 24 h
+#define CAN_SHARE_BUCKET_S 300
+#define CAN_SHARE_HISTORY  288
+
+typedef enum {
+    CAN_SHARE_ACCEPTED = 0,
+    CAN_SHARE_REJECTED,
+    CAN_SHARE_STALE,
+} can_share_result_t;
+
+typedef struct {
+    uint32_t shares;      // valid nonces submitted to the pool
+    uint32_t accepted;
+    uint32_t rejected;
+    uint32_t stale;       // rejected because the job was gone
+    uint32_t invalid;     // forwarded nonces that failed the master's check
+    double   bestDiff;
+    float    hashrate10m; // GH/s, share based
+    float    hashrate1h;
+    uint32_t asicShares[CAN_SHARE_ASICS_MAX];
+    uint8_t  numAsics;    // highest ASIC that sent a share + 1
+} can_slave_share_stats_t;
+
+/** A slave nonce >= pool diff was submitted. asic_nr 0xFF = unknown (old slave firmware). */
+void can_shares_submitted(uint8_t slave_id, uint8_t asic_nr, double diff, uint32_t pool_diff);
+
+/** A slave nonce didn't reach the pool diff on the master. */
+void can_shares_invalid(uint8_t slave_id);
+
+/** Pool result for a share of slave_id. */
+void can_shares_result(uint8_t slave_id, can_share_result_t result);
+
+/** Forget everything about slave_id, e.g. when it is deleted. */
+void can_shares_reset(uint8_t slave_id);
+
+bool can_shares_get(uint8_t slave_id, can_slave_share_stats_t *out);
+
+/**
+ * Share based hashrate history of slave_id in GH/s, oldest first. The last
+ * entry is the current, incomplete bucket. Returns the number of entries
+ * (at most max) and the age of the last bucket start in *current_age_s.
+ */
+int can_shares_get_history(uint8_t slave_id, float *out, int max, uint32_t *current_age_s);
+
+#ifdef __cplusplus
+}
+#endif
@@ -9,6 +9,7 @@
 
 #include "asic.h"
 #include "can_sender.h"
+#include "can_job_template.h"
 #include "global_state.h"
 #include "boards/board.h"
 #include "hashrate_monitor_task.h"
@@ -27,52 +28,232 @@ static const char *TAG = "can_slave";
 volatile uint8_t g_can_slave_id = CAN_SLAVE_ID_UNASSIGNED;
 
 
-// Job payload = BM1368_job (82 bytes) + pool_diff (4 bytes)
-#define JOB_PAYLOAD_LEN (sizeof(BM1368_job) + sizeof(uint32_t))
+// Templates received from the master, the job tick selects the one to mine on.
+// Several are kept so a dual pool master can alternate without rebroadcasting.
+#define SLAVE_TEMPLATE_SLOTS 4
+
+static EXT_RAM_BSS_ATTR can_job_template_t s_templates[SLAVE_TEMPLATE_SLOTS];
+static EXT_RAM_BSS_ATTR bool               s_template_acked[SLAVE_TEMPLATE_SLOTS];
+static int                                 s_template_next = 0;
+
+// Template reassembly
+static EXT_RAM_BSS_ATTR uint8_t s_template_rx[CAN_TEMPLATE_MAX_LEN];
+static size_t                   s_template_rx_len    = 0;
+static uint16_t                 s_template_rx_seq    = 0;
+static bool                     s_template_rx_active = false;
+
+// Raw job reassembly, the master sends complete jobs for pools without a template
+static EXT_RAM_BSS_ATTR can_raw_job_t s_raw_job_rx;
+static size_t                         s_raw_job_rx_len    = 0;
+static uint8_t                        s_raw_job_rx_seq    = 0;
+static bool                           s_raw_job_rx_active = false;
+
+// Per ASIC job id: everything the result task needs to filter and report nonces
+typedef struct {
+    uint8_t  prev_block_hash[32];  // bm_job byte order
+    uint8_t  merkle_root[32];
+    uint32_t version;
+    uint32_t ntime;
+    uint32_t nbits;
+    uint32_t pool_diff;
+    uint32_t extranonce2;
+    uint8_t  template_id;
+    bool     valid;
+} slave_job_t;
+
+static EXT_RAM_BSS_ATTR slave_job_t s_jobs[256];
+static EXT_RAM_BSS_ATTR bm_job      s_build_job;
+static uint32_t                     s_job_counter = 0;
+
+static double calc_nonce_diff(const slave_job_t *j, uint32_t nonce, uint32_t rolled_version, uint32_t min_diff)
+{
+    bm_job tmp = {};
+    memcpy(tmp.prev_block_hash, j->prev_block_hash, 32);
+    memcpy(tmp.merkle_root,     j->merkle_root,     32);
+    tmp.ntime  = j->ntime;
+    tmp.target = j->nbits;
 
-// Per-job-id store: BM1368_job + pool_diff for nonce filtering
-static EXT_RAM_BSS_ATTR BM1368_job  s_jobs[256];
-static EXT_RAM_BSS_ATTR uint32_t    s_pool_diffs[256];
-static EXT_RAM_BSS_ATTR bool        s_job_valid[256];
+    return test_nonce_value(&tmp, nonce, rolled_version, min_diff);
+}
 
-// Recover bm_job LE fields from BM1368_job BE fields and call test_nonce_value().
-static double calc_nonce_diff(const BM1368_job *j, uint32_t nonce, uint32_t rolled_version)
+static void clear_templates(void)
 {
-    bm_job tmp = {};
-    uint8_t t[32];
-
-    // BM1368_job.prev_block_hash = prev_block_hash_be = reverse_bytes(_prev_block_hash_binary)
-    // bm_job.prev_block_hash = swap_endian_words_bin(_prev_block_hash_binary)
-    //   → swap_endian_words_bin(reverse_bytes(BM1368_job.prev_block_hash))
-    memcpy(t, j->prev_block_hash, 32);
-    reverse_bytes(t, 32);
-    swap_endian_words_bin(t, tmp.prev_block_hash, 32);
-
-    // BM1368_job.merkle_root = merkle_root_be = reverse_bytes(swap_endian_words(hex_merkle))
-    // bm_job.merkle_root = hex2bin(hex_merkle)
-    //   → swap_endian_words_bin(reverse_bytes(BM1368_job.merkle_root))
-    memcpy(t, j->merkle_root, 32);
-    reverse_bytes(t, 32);
-    swap_endian_words_bin(t, tmp.merkle_root, 32);
-
-    memcpy(&tmp.ntime,  j->ntime, 4);
-    memcpy(&tmp.target, j->nbits, 4);
-
-    return test_nonce_value(&tmp, nonce, rolled_version);
+    for (int i = 0; i < SLAVE_TEMPLATE_SLOTS; i++) {
+        s_templates[i].valid = false;
+    }
+    s_template_rx_active = false;
+    s_raw_job_rx_active  = false;
+}
+
+static int find_template(uint8_t id)
+{
+    for (int i = 0; i < SLAVE_TEMPLATE_SLOTS; i++) {
+        if (s_templates[i].valid && s_templates[i].hdr.id == id) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static void handle_template_frame(const twai_message_t *msg)
+{
+    if (msg->data_length_code < 2) return;
+
+    uint16_t seq  = (uint16_t)(msg->data[0] | (msg->data[1] << 8));
+    bool     last = (seq & CAN_TEMPLATE_SEQ_LAST) != 0;
+    size_t   dlen = msg->data_length_code - 2;
+    seq &= ~CAN_TEMPLATE_SEQ_LAST;
+
+    if (seq == 0) {
+        if (s_template_rx_active) ESP_LOGW(TAG, "new template while in_frame, discarding %d bytes", s_template_rx_len);
+        s_template_rx_len    = 0;
+        s_template_rx_seq    = 0;
+        s_template_rx_active = true;
+    } else if (!s_template_rx_active) {
+        return;
+    } else if (seq != s_template_rx_seq) {
+        // the master repeats the template if we don't start on it
+        ESP_LOGW(TAG, "template frame %d lost, discarding", s_template_rx_seq);
+        s_template_rx_active = false;
+        return;
+    }
+
+    if (s_template_rx_len + dlen > sizeof(s_template_rx)) {
+        ESP_LOGW(TAG, "template reassembly overflow, discarding");
+        s_template_rx_active = false;
+        return;
+    }
+    memcpy(s_template_rx + s_template_rx_len, &msg->data[2], dlen);
+    s_template_rx_len += dlen;
+    s_template_rx_seq++;
+
+    if (!last) return;
+    s_template_rx_active = false;
+
+    // repeated because a slave didn't ack it, maybe our ack got lost
+    uint8_t id   = s_template_rx[0];
+    int     slot = find_template(id);
+    if (slot >= 0 && s_templates[slot].len == s_template_rx_len &&
+        !memcmp(s_templates[slot].buf, s_template_rx, s_template_rx_len)) {
+        s_template_acked[slot] = false;
+        return;
+    }
+    // ids wrap around, an old template with the same id is gone
+    if (slot >= 0) {
+        s_templates[slot].valid = false;
+    }
+
+    slot = s_template_next;
+    s_template_next = (s_template_next + 1) % SLAVE_TEMPLATE_SLOTS;
+    s_template_acked[slot] = false;
+
+    if (can_template_load(&s_templates[slot], s_template_rx, s_template_rx_len)) {
+        ESP_LOGI(TAG, "RX TEMPLATE id=%d %d bytes merkle=%d pool_diff=%lu",
+                 id, s_template_rx_len, s_templates[slot].hdr.merkleCount, s_templates[slot].hdr.poolDiff);
+    }
+}
+
+// Send s_build_job to the chips and keep what the result task needs
+static uint8_t send_job(Asic *asics, uint32_t e2, uint8_t template_id)
+{
+    uint8_t asic_job_id = asics->sendWork(s_job_counter++, &s_build_job);
+
+    slave_job_t *j = &s_jobs[asic_job_id];
+    j->valid = false;
+    memcpy(j->prev_block_hash, s_build_job.prev_block_hash, 32);
+    memcpy(j->merkle_root,     s_build_job.merkle_root,     32);
+    j->version     = s_build_job.version;
+    j->ntime       = s_build_job.ntime;
+    j->nbits       = s_build_job.target;
+    j->pool_diff   = s_build_job.pool_diff;
+    j->extranonce2 = e2;
+    j->template_id = template_id;
+    j->valid       = true;
+
+    ESP_LOGD(TAG, "JOB template=%d e2=%08lX → asic job %02X", template_id, e2, asic_job_id);
+    return asic_job_id;
 }
 
-// Nonce response layout sent back to master (9 bytes, 2 CAN frames):
+// Build our own job from the template: only extranonce2 differs from the other slaves
+static void start_job(Asic *asics, uint8_t slave_id, uint8_t template_id)
+{
+    int slot = find_template(template_id);
+    if (slot < 0) {
+        ESP_LOGD(TAG, "job tick for unknown template %d", template_id);
+        return;
+    }
+    const can_job_template_t *tpl = &s_templates[slot];
+
+    uint32_t e2 = can_make_extranonce2(slave_id, s_job_counter);
+    can_template_build_job(tpl, e2, &s_build_job);
+    send_job(asics, e2, template_id);
+
+    if (!s_template_acked[slot]) {
+        can_send_template_ack(slave_id, template_id);
+        s_template_acked[slot] = true;
+    }
+}
+
+// Returns true when the frame completed a raw job
+static bool handle_raw_job_frame(const twai_message_t *msg)
+{
+    if (msg->data_length_code < 2) return false;
+
+    uint8_t seq  = msg->data[0];
+    bool    last = (seq == CAN_SEQ_LAST);
+    size_t  dlen = msg->data_length_code - 1;
+
+    if (seq == 0) {
+        s_raw_job_rx_len    = 0;
+        s_raw_job_rx_seq    = 0;
+        s_raw_job_rx_active = true;
+    } else if (!s_raw_job_rx_active) {
+        return false;
+    } else if (!last && seq != s_raw_job_rx_seq) {
+        // the master sends the next job in the next job interval
+        ESP_LOGW(TAG, "job frame %d lost, discarding", s_raw_job_rx_seq);
+        s_raw_job_rx_active = false;
+        return false;
+    }
+
+    if (s_raw_job_rx_len + dlen > sizeof(s_raw_job_rx)) {
+        ESP_LOGW(TAG, "job reassembly overflow, discarding");
+        s_raw_job_rx_active = false;
+        return false;
+    }
+    memcpy((uint8_t *) &s_raw_job_rx + s_raw_job_rx_len, &msg->data[1], dlen);
+    s_raw_job_rx_len += dlen;
+    s_raw_job_rx_seq++;
+
+    if (!last) return false;
+    s_raw_job_rx_active = false;
+
+    return s_raw_job_rx_len == sizeof(s_raw_job_rx);
+}
+
+// Job built by the master for us, the pool job has no template
+static void start_raw_job(Asic *asics)
+{
+    can_raw_job_build_job(&s_raw_job_rx, &s_build_job);
+    send_job(asics, s_raw_job_rx.extranonce2, 0);
+}
+
+// Nonce response layout sent back to master (13 bytes, 2 CAN frames):
 //   [0..3]  nonce
 //   [4..7]  rolled_version
-//   [8]     job_id
-#define NONCE_PAYLOAD_LEN 9
+//   [8]     template_id (0: raw job)
+//   [9..12] extranonce2
+//   [13]    asic_nr
+#define NONCE_PAYLOAD_LEN 14
 
-static void send_nonce(uint8_t slave_id, const task_result *result)
+static void send_nonce(uint8_t slave_id, const task_result *result, const slave_job_t *job)
 {
     uint8_t buf[NONCE_PAYLOAD_LEN];
     memcpy(buf + 0, &result->nonce,          4);
     memcpy(buf + 4, &result->rolled_version, 4);
-    buf[8] = result->job_id;
+    buf[8] = job->template_id;
+    memcpy(buf + 9, &job->extranonce2,       4);
+    buf[13] = result->asic_nr;
 
     uint32_t can_id = CAN_ID_NONCE_BASE | (slave_id & 0x7F);
 
@@ -84,16 +265,16 @@ static void send_nonce(uint8_t slave_id, const task_result *result)
     memcpy(&f0.data[1], buf, 7);
     twai_transmit(&f0, pdMS_TO_TICKS(50));
 
-    // Frame 1: SEQ=0xFF (last) + 2 bytes
+    // Frame 1: SEQ=0xFF (last) + 7 bytes
     twai_message_t f1 = {};
     f1.identifier       = can_id;
-    f1.data_length_code = 3;
+    f1.data_length_code = 8;
     f1.data[0]          = CAN_SEQ_LAST;
-    memcpy(&f1.data[1], buf + 7, 2);
+    memcpy(&f1.data[1], buf + 7, 7);
     twai_transmit(&f1, pdMS_TO_TICKS(50));
 
-    ESP_LOGD(TAG, "TX NONCE slave=%d nonce=%08lX job_id=%02X",
-             slave_id, result->nonce, result->job_id);
+    ESP_LOGD(TAG, "TX NONCE slave=%d nonce=%08lX template=%d e2=%08lX",
+             slave_id, result->nonce, job->template_id, job->extranonce2);
 }
 
 static void send_slave_config(uint8_t slave_id)
@@ -208,9 +389,9 @@ void can_slave_task(void *pvParameters)
     TickType_t last_hello = xTaskGetTickCount() - pdMS_TO_TICKS(1000); // send immediately
     TickType_t last_job   = 0;
 
-    uint8_t  buf[128];
-    size_t   buf_len  = 0;
-    bool     in_frame = false;
+    for (int i = 0; i < SLAVE_TEMPLATE_SLOTS; i++) {
+        can_template_init(&s_templates[i]);
+    }
 
     for (;;) {
         TickType_t now = xTaskGetTickCount();
@@ -245,8 +426,8 @@ void can_slave_task(void *pvParameters)
             state          = SLAVE_UNASSIGNED;
             g_can_slave_id = CAN_SLAVE_ID_UNASSIGNED;
             last_hello     = now - pdMS_TO_TICKS(1000);
-            in_frame = false;
-            buf_len  = 0;
+            // template ids start over
+            clear_templates();
             continue;
         }
 
@@ -265,6 +446,13 @@ void can_slave_task(void *pvParameters)
             continue;
         }
 
+        // ── Job templates (broadcast, also collected while unassigned) ────────
+
+        if (msg.identifier == CAN_ID_TEMPLATE) {
+            handle_template_frame(&msg);
+            continue;
+        }
+
         if (state == SLAVE_UNASSIGNED) continue;
 
         // ── Job timeout → re-negotiate ────────────────────────────────────────
@@ -274,8 +462,6 @@ void can_slave_task(void *pvParameters)
             state          = SLAVE_UNASSIGNED;
             g_can_slave_id = CAN_SLAVE_ID_UNASSIGNED;
             last_hello     = now - pdMS_TO_TICKS(1000);
-            in_frame = false;
-            buf_len  = 0;
             continue;
         }
 
@@ -288,50 +474,24 @@ void can_slave_task(void *pvParameters)
             continue;
         }
 
-        // ── JOB frame reassembly ──────────────────────────────────────────────
-
-        if (msg.identifier != (uint32_t)(CAN_ID_JOB_BASE | g_can_slave_id)) continue;
-        if (msg.data_length_code < 1) continue;
+        // ── Raw job: complete job for pools without a template ────────────────
 
-        uint8_t  seq  = msg.data[0];
-        uint8_t *data = &msg.data[1];
-        size_t   dlen = msg.data_length_code - 1;
-
-        if (seq == 0x00) {
-            if (in_frame) ESP_LOGW(TAG, "new job seq=0 while in_frame, discarding %d bytes", buf_len);
-            buf_len  = 0;
-            in_frame = true;
-        } else if (!in_frame) {
-            continue;
-        }
-
-        if (buf_len + dlen > sizeof(buf)) {
-            ESP_LOGW(TAG, "reassembly overflow, discarding");
-            in_frame = false;
+        if (msg.identifier == (uint32_t)(CAN_ID_JOB_BASE | g_can_slave_id)) {
+            if (handle_raw_job_frame(&msg)) {
+                last_job = now;
+                start_raw_job(asics);
+            }
             continue;
         }
-        memcpy(buf + buf_len, data, dlen);
-        buf_len += dlen;
 
-        if (seq == CAN_SEQ_LAST) {
-            in_frame = false;
-            last_job = now; // reset timeout on successful job
+        // ── Job tick: next job from the announced template ────────────────────
 
-            if (buf_len != JOB_PAYLOAD_LEN) {
-                ESP_LOGW(TAG, "unexpected job size %d (expected %d)", buf_len, JOB_PAYLOAD_LEN);
-                continue;
+        if (msg.identifier == CAN_ID_JOB_TICK && msg.data_length_code >= 1) {
+            last_job = now; // reset timeout, the master is mining
+            // template id 0: we keep mining on the last raw job
+            if (msg.data[0]) {
+                start_job(asics, g_can_slave_id, msg.data[0]);
             }
-
-            BM1368_job *job = (BM1368_job *) buf;
-            uint32_t pool_diff;
-            memcpy(&pool_diff, buf + sizeof(BM1368_job), sizeof(uint32_t));
-
-            s_jobs[job->job_id]       = *job;
-            s_pool_diffs[job->job_id] = pool_diff;
-            s_job_valid[job->job_id]  = true;
-
-            ESP_LOGI(TAG, "RX JOB job_id=%02X pool_diff=%lu → sendRawJob", job->job_id, pool_diff);
-            asics->sendRawJob(job);
         }
     }
 }
@@ -371,24 +531,22 @@ void can_slave_result_task(void *pvParameters)
             continue;
         }
 
-        if (s_job_valid[result.job_id]) {
-            uint32_t version;
-            memcpy(&version, s_jobs[result.job_id].version, 4);
-            double diff = calc_nonce_diff(&s_jobs[result.job_id], result.nonce, result.rolled_version ^ version);
-            uint32_t pool_diff = s_pool_diffs[result.job_id];
-
-            if (diff < pool_diff) {
-                ESP_LOGI(TAG, "NONCE job=%02X nonce=%08lX diff=%.1f/%lu → drop",
-                         result.job_id, result.nonce, diff, pool_diff);
-                continue;
-            }
-            ESP_LOGI(TAG, "NONCE job=%02X nonce=%08lX diff=%.1f/%lu → TX to master",
-                     result.job_id, result.nonce, diff, pool_diff);
-        } else {
-            ESP_LOGI(TAG, "NONCE nonce=%08lX job_id=%02X (no job stored) → TX to master",
+        const slave_job_t *job = &s_jobs[result.job_id];
+        if (!job->valid) {
+            ESP_LOGI(TAG, "NONCE nonce=%08lX job_id=%02X (no job stored) → drop",
                      result.nonce, result.job_id);
+            continue;
+        }
+
+        double diff = calc_nonce_diff(job, result.nonce, result.rolled_version ^ job->version, job->pool_diff);
+        if (diff < job->pool_diff) {
+            ESP_LOGI(TAG, "NONCE job=%02X nonce=%08lX diff=%.1f/%lu → drop",
+                     result.job_id, result.nonce, diff, job->pool_diff);
+            continue;
         }
-        send_nonce(g_can_slave_id, &result);
+        ESP_LOGI(TAG, "NONCE job=%02X nonce=%08lX diff=%.1f/%lu → TX to master",
+                 result.job_id, result.nonce, diff, job->pool_diff);
+        send_nonce(g_can_slave_id, &result, job);
     }
 }
 
@@ -9,7 +9,7 @@ void can_init(int tx_gpio, int rx_gpio)
 {
     twai_general_config_t g_config = TWAI_GENERAL_CONFIG_DEFAULT(
         (gpio_num_t) tx_gpio, (gpio_num_t) rx_gpio, TWAI_MODE_NORMAL);
-    g_config.rx_queue_len = 32;  // default=5 is too small for 7-frame telemetry bursts
+    g_config.rx_queue_len = 64;  // default=5 is too small for telemetry and job template bursts
     g_config.intr_flags = ESP_INTR_FLAG_LEVEL1 | ESP_INTR_FLAG_SHARED;
 
     twai_timing_config_t  t_config = TWAI_TIMING_CONFIG_500KBITS();
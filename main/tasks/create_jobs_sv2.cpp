@@ -18,6 +18,8 @@ void create_job_sv2_standard(int pool, uint32_t job_id, uint32_t version,
                               uint32_t version_mask, uint32_t difficulty,
                               bool clean)
 {
+    create_jobs_new_work(pool);
+
     PThreadGuard g(current_stratum_job_mutex);
 
     // Lazily allocate
@@ -48,6 +50,8 @@ void create_job_sv2_extended(int pool, const sv2_ext_job_t *job,
                               uint32_t version_mask, uint32_t difficulty,
                               bool clean)
 {
+    create_jobs_new_work(pool);
+
     PThreadGuard g(current_stratum_job_mutex);
 
     // Lazily allocate
@@ -76,7 +80,8 @@ void create_job_sv2_set_difficulty(int pool, uint32_t difficulty)
 {
     PThreadGuard g(current_stratum_job_mutex);
 
-    if (s_v2_standard[pool]) {
+    // the channel type can change with a reconnect, only update the active one
+    if (s_v2_standard[pool] && miningInfo[pool] == s_v2_standard[pool]) {
         s_v2_standard[pool]->setDifficulty(difficulty);
         ESP_LOGI(TAG, "(%s) SV2 standard difficulty updated to %lu",
                  pool ? "Sec" : "Pri", (unsigned long)difficulty);
@@ -85,7 +90,7 @@ void create_job_sv2_set_difficulty(int pool, uint32_t difficulty)
         return;
     }
 
-    if (s_v2_extended[pool]) {
+    if (s_v2_extended[pool] && miningInfo[pool] == s_v2_extended[pool]) {
         s_v2_extended[pool]->setDifficulty(difficulty);
         ESP_LOGI(TAG, "(%s) SV2 extended difficulty updated to %lu",
                  pool ? "Sec" : "Pri", (unsigned long)difficulty);
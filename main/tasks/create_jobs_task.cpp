@@ -3,15 +3,19 @@
 #include <string.h>
 #include <sys/time.h>
 
+#include "esp_attr.h"
 #include "esp_log.h"
 #include "esp_system.h"
 #include "esp_timer.h"
+#include "mbedtls/sha256.h"
 #include "mining.h"
+#include "mining_utils.h"
 
 #include "global_state.h"
 #include "create_jobs_task.h"
 #include "can_sender.h"
 #include "can_master_task.h"
+#include "can_job_template.h"
 
 #include "boards/board.h"
 #include "macros.h"
@@ -27,18 +31,47 @@ pthread_cond_t job_cond = PTHREAD_COND_INITIALIZER;
 
 pthread_mutex_t current_stratum_job_mutex = PTHREAD_MUTEX_INITIALIZER;
 
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// serialized CAN job template, only used by the job task
+static EXT_RAM_BSS_ATTR uint8_t s_template_buf[CAN_TEMPLATE_MAX_LEN];
+// MiningInfo generation the last template of each pool was serialized from
+static uint32_t s_template_generation[2] = {0};
+static bool     s_template_published[2]  = {false};
+// extranonce2 counters of the slaves' raw jobs
+static EXT_RAM_BSS_ATTR uint32_t s_slave_extranonce_2[CAN_SLAVE_MAX];
+static create_jobs_stats_t s_stats = {};
+static uint64_t s_newWorkTime[2] = {0};
+
+#define min(a, b) ((a < b) ? (a) : (b))
+#define max(a, b) ((a > b) ? (a) : (b))
+
 // ============================================================================
 // MiningInfoBase - abstract interface for protocol-agnostic job construction
 // ============================================================================
 
 MiningInfoBase::~MiningInfoBase() {}
 
+void MiningInfoBase::newGeneration()
+{
+    static uint32_t s_generation = 0;
+
+    // 0 means "never changed"
+    if (++s_generation == 0) {
+        s_generation = 1;
+    }
+    m_generation = s_generation;
+}
+
 // ============================================================================
 // MiningInfoV1 - Stratum V1 job construction
 // ============================================================================
 
 class MiningInfoV1 : public MiningInfoBase {
   public:
+    // maximum supported extranonce2 length in bytes
+    static constexpr int MAX_EXTRANONCE_2_LEN = 32;
+
     mining_notify *current_job = nullptr;
 
     char *extranonce_str = nullptr;
@@ -51,20 +84,88 @@ class MiningInfoV1 : public MiningInfoBase {
     uint32_t active_stratum_difficulty = 8192;
     uint32_t version_mask = 0;
 
+  protected:
+    // binary coinbase parts of the current job, decoded once per mining.notify
+    // the coinbase tx is coinbase1 + extranonce1 + extranonce2 + coinbase2
+    uint8_t *m_coinbase1 = nullptr;
+    size_t m_coinbase1_len = 0;
+    size_t m_coinbase1_cap = 0;
+
+    uint8_t *m_coinbase2 = nullptr;
+    size_t m_coinbase2_len = 0;
+    size_t m_coinbase2_cap = 0;
+
+    uint8_t *m_extranonce1 = nullptr;
+    size_t m_extranonce1_len = 0;
+    size_t m_extranonce1_cap = 0;
+
+    // both coinbase parts of the current job decoded completely
+    bool m_coinbase_valid = false;
+
+    // sha256 state over coinbase1 + extranonce1
+    mbedtls_sha256_context m_coinbase_midstate;
+    bool m_coinbase_midstate_valid = false;
+
+    // decode a hex string into a reusable buffer that only grows,
+    // false (and len 0) unless it is all hex digits of whole bytes
+    static bool hexToBuffer(const char *hex, uint8_t *&buf, size_t &len, size_t &cap)
+    {
+        size_t hex_len = hex ? strlen(hex) : 0;
+        size_t bin_len = hex_len / 2;
+
+        if (!hex || hex_len % 2 || strspn(hex, "0123456789abcdefABCDEF") != hex_len) {
+            len = 0;
+            return false;
+        }
+
+        if (bin_len > cap) {
+            uint8_t *tmp = (uint8_t *) REALLOC(buf, bin_len);
+            if (!tmp) {
+                ESP_LOGE(TAG, "couldn't allocate coinbase buffer (%d bytes)", (int) bin_len);
+                len = 0;
+                return false;
+            }
+            buf = tmp;
+            cap = bin_len;
+        }
+        len = bin_len ? hex2bin(hex, buf, bin_len) : 0;
+        return len == bin_len;
+    }
+
+    // precompute the sha256 midstate of the coinbase prefix up to extranonce2
+    void updateCoinbaseMidstate()
+    {
+        m_coinbase_midstate_valid = false;
+
+        if (!m_coinbase_valid || !hexToBuffer(extranonce_str, m_extranonce1, m_extranonce1_len, m_extranonce1_cap)) {
+            return;
+        }
+
+        mbedtls_sha256_free(&m_coinbase_midstate);
+        mbedtls_sha256_init(&m_coinbase_midstate);
+        mbedtls_sha256_starts(&m_coinbase_midstate, 0);
+        mbedtls_sha256_update(&m_coinbase_midstate, m_coinbase1, m_coinbase1_len);
+        mbedtls_sha256_update(&m_coinbase_midstate, m_extranonce1, m_extranonce1_len);
+        m_coinbase_midstate_valid = true;
+    }
+
   public:
     MiningInfoV1()
     {
         current_job = (mining_notify *) CALLOC(1, sizeof(mining_notify));
+        mbedtls_sha256_init(&m_coinbase_midstate);
     }
 
     ~MiningInfoV1() override
     {
         safe_free(extranonce_str);
         safe_free(next_extranonce_str);
+        safe_free(m_coinbase1);
+        safe_free(m_coinbase2);
+        safe_free(m_extranonce1);
+        mbedtls_sha256_free(&m_coinbase_midstate);
         if (current_job) {
             safe_free(current_job->job_id);
-            safe_free(current_job->coinbase_1);
-            safe_free(current_job->coinbase_2);
             free(current_job);
         }
     }
@@ -73,28 +174,42 @@ class MiningInfoV1 : public MiningInfoBase {
 
     bm_job* buildBmJob(uint32_t extranonce_2, int pool_id, uint32_t asic_diff) override
     {
-        // generate extranonce2 hex string
-        char extranonce_2_str[extranonce_2_len * 2 + 1]; // +1 zero termination
-        snprintf(extranonce_2_str, sizeof(extranonce_2_str), "%0*lx", (int) extranonce_2_len * 2, (unsigned long) extranonce_2);
+        if (!m_coinbase_midstate_valid) {
+            return nullptr;
+        }
+
+        // generate binary extranonce2 (big endian, zero padded)
+        uint8_t extranonce_2_bin[MAX_EXTRANONCE_2_LEN] = {0};
+        for (int i = extranonce_2_len - 1, shift = 0; i >= 0 && shift < 32; i--, shift += 8) {
+            extranonce_2_bin[i] = (uint8_t) (extranonce_2 >> shift);
+        }
 
-        // generate coinbase tx
-        int coinbase_tx_len = strlen(current_job->coinbase_1) + strlen(extranonce_str) + strlen(extranonce_2_str) +
-                              strlen(current_job->coinbase_2);
-        char *coinbase_tx = (char *) MALLOC(coinbase_tx_len + 1);
-        snprintf(coinbase_tx, coinbase_tx_len + 1, "%s%s%s%s", current_job->coinbase_1, extranonce_str,
-                 extranonce_2_str, current_job->coinbase_2);
+        // finish the coinbase tx hash from the prefix midstate
+        uint8_t coinbase_hash[32];
+        mbedtls_sha256_context ctx;
+        mbedtls_sha256_init(&ctx);
+        mbedtls_sha256_clone(&ctx, &m_coinbase_midstate);
+        mbedtls_sha256_update(&ctx, extranonce_2_bin, extranonce_2_len);
+        mbedtls_sha256_update(&ctx, m_coinbase2, m_coinbase2_len);
+        mbedtls_sha256_finish(&ctx, coinbase_hash);
+        mbedtls_sha256_free(&ctx);
+        mbedtls_sha256(coinbase_hash, 32, coinbase_hash, 0);
 
         // calculate merkle root
-        char merkle_root[65];
-        calculate_merkle_root_hash(coinbase_tx, current_job->_merkle_branches, current_job->n_merkle_branches,
-                                   merkle_root);
-        free(coinbase_tx);
-
-        // we need malloc because we will save it in the job array
-        bm_job *next_job = (bm_job *) MALLOC(sizeof(bm_job));
-        construct_bm_job(current_job, merkle_root, version_mask, next_job);
-        next_job->jobid = strdup(current_job->job_id);
-        next_job->extranonce2 = strdup(extranonce_2_str);
+        uint8_t merkle_root[32];
+        calculate_merkle_root_bin(coinbase_hash, current_job->_merkle_branches, current_job->n_merkle_branches, merkle_root);
+
+        // the job comes from the pool because it will be saved in the job array
+        bm_job *next_job = bmJobPool.alloc();
+        if (!next_job) {
+            return nullptr;
+        }
+        construct_bm_job_bin(current_job, merkle_root, version_mask, next_job);
+
+        // extranonce2 hex string for share submission
+        bin2hex(extranonce_2_bin, extranonce_2_len, next_job->extranonce2, sizeof(next_job->extranonce2));
+
+        strlcpy(next_job->jobid, current_job->job_id, sizeof(next_job->jobid));
         next_job->pool_diff = active_stratum_difficulty;
         next_job->pool_id = pool_id;
         next_job->asic_diff = asic_diff;
@@ -131,6 +246,30 @@ class MiningInfoV1 : public MiningInfoBase {
         return version_mask;
     }
 
+    bool getJobTemplate(job_template_t *tpl) const override
+    {
+        if (!m_coinbase_midstate_valid) {
+            return false;
+        }
+
+        tpl->coinbasePrefix[0] = m_coinbase1;
+        tpl->coinbasePrefixLen[0] = m_coinbase1_len;
+        tpl->coinbasePrefix[1] = m_extranonce1;
+        tpl->coinbasePrefixLen[1] = m_extranonce1_len;
+        tpl->coinbaseSuffix = m_coinbase2;
+        tpl->coinbaseSuffixLen = m_coinbase2_len;
+        tpl->extranonce2Len = extranonce_2_len;
+        tpl->merkleBranches = current_job->_merkle_branches;
+        tpl->merkleCount = (int) current_job->n_merkle_branches;
+        swap_endian_words_bin(current_job->_prev_block_hash, tpl->prevBlockHash, HASH_SIZE);
+        tpl->version = current_job->version;
+        tpl->nbits = current_job->target;
+        tpl->ntime = current_job->ntime;
+        tpl->poolDiff = active_stratum_difficulty;
+        tpl->jobId = current_job->job_id;
+        return true;
+    }
+
     void invalidate() override
     {
         // mark as invalid
@@ -138,8 +277,11 @@ class MiningInfoV1 : public MiningInfoBase {
         safe_free(extranonce_str);
         safe_free(next_extranonce_str);
         safe_free(current_job->job_id);
-        safe_free(current_job->coinbase_1);
-        safe_free(current_job->coinbase_2);
+        m_coinbase1_len = 0;
+        m_coinbase2_len = 0;
+        m_coinbase_valid = false;
+        m_coinbase_midstate_valid = false;
+        newGeneration();
     }
 
     // --- V1-specific methods ---
@@ -164,7 +306,11 @@ class MiningInfoV1 : public MiningInfoBase {
         safe_free(extranonce_str);
 
         extranonce_str = strdup(enonce);
-        extranonce_2_len = enonce2_len;
+        extranonce_2_len = min(enonce2_len, MAX_EXTRANONCE_2_LEN);
+
+        // the prefix of a job we already have changed
+        updateCoinbaseMidstate();
+        newGeneration();
     }
 
     void set_next_enonce(char *enonce, int enonce2_len)
@@ -172,7 +318,7 @@ class MiningInfoV1 : public MiningInfoBase {
         safe_free(next_extranonce_str);
 
         next_extranonce_str = strdup(enonce);
-        next_extranonce_2_len = enonce2_len;
+        next_extranonce_2_len = min(enonce2_len, MAX_EXTRANONCE_2_LEN);
     }
 
     void create_job_mining_notify(mining_notify *notify)
@@ -187,18 +333,26 @@ class MiningInfoV1 : public MiningInfoBase {
         }
 
         safe_free(current_job->job_id);
-        safe_free(current_job->coinbase_1);
-        safe_free(current_job->coinbase_2);
 
         // copy trivial types
         memcpy(current_job, notify, sizeof(mining_notify));
         // duplicate dynamic strings with unknown length
         current_job->job_id = strdup(notify->job_id);
-        current_job->coinbase_1 = strdup(notify->coinbase_1);
-        current_job->coinbase_2 = strdup(notify->coinbase_2);
+
+        // the coinbase is only kept in binary form
+        current_job->coinbase_1 = nullptr;
+        current_job->coinbase_2 = nullptr;
+        // a coinbase that doesn't decode completely builds no jobs
+        m_coinbase_valid = hexToBuffer(notify->coinbase_1, m_coinbase1, m_coinbase1_len, m_coinbase1_cap) &&
+                           hexToBuffer(notify->coinbase_2, m_coinbase2, m_coinbase2_len, m_coinbase2_cap);
+        if (!m_coinbase_valid) {
+            ESP_LOGE(TAG, "invalid coinbase in job %s", current_job->job_id);
+        }
+        updateCoinbaseMidstate();
 
         // set active difficulty with the mining.notify command
         active_stratum_difficulty = stratum_difficulty;
+        newGeneration();
     }
 };
 
@@ -206,9 +360,6 @@ class MiningInfoV1 : public MiningInfoBase {
 static MiningInfoV1 s_miningInfoV1[2] = {MiningInfoV1{}, MiningInfoV1{}};
 MiningInfoBase* miningInfo[2] = {&s_miningInfoV1[0], &s_miningInfoV1[1]};
 
-#define min(a, b) ((a < b) ? (a) : (b))
-#define max(a, b) ((a > b) ? (a) : (b))
-
 static void create_job_timer(TimerHandle_t xTimer)
 {
     pthread_mutex_lock(&job_mutex);
@@ -263,6 +414,7 @@ void set_next_enonce(int pool, char *enonce, int enonce2_len)
 
 void create_job_mining_notify(int pool, mining_notify *notify, bool abandonWork)
 {
+    create_jobs_new_work(pool);
     {
         PThreadGuard g(current_stratum_job_mutex);
         // clear jobs for pool
@@ -281,6 +433,112 @@ void create_job_invalidate(int pool)
     asicJobs.cleanJobs(pool);
 }
 
+void create_jobs_new_work(int pool)
+{
+    PThreadGuard g(stats_mutex);
+    s_newWorkTime[pool] = esp_timer_get_time();
+    s_stats.newWork++;
+}
+
+void create_jobs_get_stats(create_jobs_stats_t *stats)
+{
+    PThreadGuard g(stats_mutex);
+    *stats = s_stats;
+}
+
+static void update_stats(int pool, uint32_t build_time_us)
+{
+    PThreadGuard g(stats_mutex);
+    s_stats.jobs++;
+    s_stats.buildTimeUs += build_time_us;
+    s_stats.buildTimeMaxUs = max(s_stats.buildTimeMaxUs, build_time_us);
+
+    // first job after new work arrived
+    if (s_newWorkTime[pool]) {
+        uint32_t latency = (uint32_t) (esp_timer_get_time() - s_newWorkTime[pool]);
+        s_stats.notifyToWorkUs = latency;
+        s_stats.notifyToWorkMaxUs = max(s_stats.notifyToWorkMaxUs, latency);
+        s_newWorkTime[pool] = 0;
+    }
+}
+
+// Hands the template of the pool job to the CAN slaves. It is only serialized
+// again when the MiningInfo changed. Returns false if the pool job has no
+// template (SV2 standard channel) or it doesn't fit, the slaves then need
+// a job each.
+static bool publish_template(int pool, const char *pool_str)
+{
+    uint32_t generation;
+    {
+        PThreadGuard g(current_stratum_job_mutex);
+        generation = miningInfo[pool]->getGeneration();
+    }
+    if (generation == s_template_generation[pool]) {
+        if (!s_template_published[pool]) {
+            return false;
+        }
+        if (can_master_select_template(pool)) {
+            return true;
+        }
+    }
+
+    bool has_template = false;
+    size_t template_len = 0;
+    char template_jobid[BM_JOB_ID_MAX_LEN];
+    {
+        PThreadGuard g(current_stratum_job_mutex);
+        MiningInfoBase *mi = miningInfo[pool];
+        job_template_t tpl;
+        generation = mi->getGeneration();
+        has_template = mi->getJobTemplate(&tpl);
+        if (has_template) {
+            template_len = can_template_serialize(&tpl, s_template_buf, sizeof(s_template_buf));
+            strlcpy(template_jobid, tpl.jobId, sizeof(template_jobid));
+        }
+    }
+
+    s_template_generation[pool] = generation;
+    s_template_published[pool] = template_len != 0;
+
+    if (has_template && !template_len) {
+        ESP_LOGW(TAG, "(%s) job template too large for the CAN slaves, sending jobs", pool_str);
+    }
+    if (!template_len) {
+        return false;
+    }
+    can_master_publish_template(pool, template_jobid, s_template_buf, template_len);
+    return true;
+}
+
+// Builds a job for each active slave like for the own chips
+static void send_slave_jobs(int pool)
+{
+    for (uint8_t slave = 1; slave < CAN_SLAVE_MAX; slave++) {
+        if (!can_master_is_slave_active(slave)) {
+            continue;
+        }
+
+        uint32_t extranonce_2 = can_make_extranonce2(slave, s_slave_extranonce_2[slave]);
+        bm_job *job = nullptr;
+        {
+            PThreadGuard g(current_stratum_job_mutex);
+            MiningInfoBase *mi = miningInfo[pool];
+            if (!mi->isValid()) {
+                return;
+            }
+            uint32_t asic_diff = STRATUM_MANAGER->selectAsicDiff(pool, mi->getActiveDifficulty());
+            job = mi->buildBmJob(extranonce_2, pool, asic_diff);
+        }
+
+        // SV2 standard channel: no header space left until ntime can roll again
+        if (!job) {
+            return;
+        }
+        s_slave_extranonce_2[slave]++;
+        can_master_send_job(slave, extranonce_2, job);
+    }
+}
+
 void create_jobs_task(void *pvParameters)
 {
     Board *board = SYSTEM_MODULE.getBoard();
@@ -306,11 +564,9 @@ void create_jobs_task(void *pvParameters)
 
     uint32_t last_ntime[2]{0};
     uint64_t last_submit_time = 0;
+    int last_pool = -1;
     uint32_t extranonce_2 = 0;
 
-    // CAN: per-slave rolling counters (upper 7 bits = slave_id, lower 25 = counter)
-    uint32_t slave_counters[CAN_SLAVE_MAX] = {0};
-
     int lastJobInterval = board->getAsicJobIntervalMs();
 
     while (1) {
@@ -330,6 +586,7 @@ void create_jobs_task(void *pvParameters)
         }
 
         bm_job *next_job = nullptr;
+        uint32_t build_time_us = 0;
         int active_pool = 0;
         const char *active_pool_str = "";
 
@@ -356,9 +613,15 @@ void create_jobs_task(void *pvParameters)
             }
 
             uint32_t asic_diff = STRATUM_MANAGER->selectAsicDiff(active_pool, mi->getActiveDifficulty());
+            uint64_t build_start = esp_timer_get_time();
             next_job = mi->buildBmJob(extranonce_2, active_pool, asic_diff);
+            build_time_us = (uint32_t) (esp_timer_get_time() - build_start);
         } // mutex
 
+        if (!next_job) {
+            continue;
+        }
+
         // set asic difficulty
         asics->setJobDifficultyMask(next_job->asic_diff);
 
@@ -372,33 +635,32 @@ void create_jobs_task(void *pvParameters)
 
         ESP_LOGD(TAG, "(%s) Sent Job (%d): %02X", active_pool_str, active_pool, asic_job_id);
 
+        update_stats(active_pool, build_time_us);
+
+        // first job after a pool switch
+        if (active_pool != last_pool) {
+            STRATUM_MANAGER->firstJobSent(active_pool);
+            last_pool = active_pool;
+        }
+
         // save job
         asicJobs.storeJob(next_job, asic_job_id);
 
         extranonce_2++;
 
-        // --- CAN: send raw job to each slave ---
-        for (uint8_t slave = 0; slave < CAN_SLAVE_MAX; slave++) {
-            if (!can_master_is_slave_active(slave)) continue;
-            uint32_t e2 = can_make_extranonce2(slave, slave_counters[slave]++);
-
-            bm_job *slave_job = nullptr;
-            {
-                PThreadGuard g(current_stratum_job_mutex);
-                MiningInfoBase *mi = miningInfo[active_pool];
-                if (mi->isValid()) {
-                    uint32_t asic_diff = STRATUM_MANAGER->selectAsicDiff(active_pool, mi->getActiveDifficulty());
-                    slave_job = mi->buildBmJob(e2, active_pool, asic_diff);
-                }
-            }
-
-            if (slave_job) {
-                can_send_raw_job(slave, (uint8_t) asic_job_id, slave_job);
-                slaveAsicJobs[slave].storeJob(slave_job, asic_job_id);
-                // slaveAsicJobs owns slave_job now — do not free here
-            }
+        // --- CAN: slaves build their own jobs from the shared template ---
+        bool slaves_active = false;
+        for (uint8_t slave = 1; slave < CAN_SLAVE_MAX && !slaves_active; slave++) {
+            slaves_active = can_master_is_slave_active(slave);
+        }
+        if (!slaves_active) {
+            continue;
         }
 
+        if (!publish_template(active_pool, active_pool_str)) {
+            send_slave_jobs(active_pool);
+        }
+        can_master_job_tick();
     }
 
 }
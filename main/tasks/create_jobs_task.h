@@ -6,6 +6,29 @@
 #include "stratum/stratum_api.h"
 #include "mining.h"
 
+/**
+ * @brief Shared part of all jobs of the current pool job, everything but extranonce2.
+ *
+ * The pointers refer to the MiningInfo buffers and are only valid while
+ * current_stratum_job_mutex is held.
+ */
+typedef struct
+{
+    const uint8_t *coinbasePrefix[2]; // coinbase in front of extranonce2, in two parts
+    size_t coinbasePrefixLen[2];
+    const uint8_t *coinbaseSuffix;
+    size_t coinbaseSuffixLen;
+    int extranonce2Len;
+    const uint8_t (*merkleBranches)[32];
+    int merkleCount;
+    uint8_t prevBlockHash[32]; // bm_job byte order
+    uint32_t version;
+    uint32_t nbits;
+    uint32_t ntime;
+    uint32_t poolDiff;
+    const char *jobId;
+} job_template_t;
+
 /**
  * @brief Abstract base class for protocol-agnostic mining job construction.
  *
@@ -24,6 +47,26 @@ class MiningInfoBase {
     virtual uint32_t getActiveDifficulty() const = 0;
     virtual uint32_t getVersionMask() const = 0;
     virtual void invalidate() = 0;
+
+    // jobs can be derived from a template (coinbase + merkle branches)
+    virtual bool getJobTemplate(job_template_t *tpl) const
+    {
+        return false;
+    }
+
+    // changes with every change of the job template, unique across all
+    // instances. 0 until the first change.
+    uint32_t getGeneration() const
+    {
+        return m_generation;
+    }
+
+  protected:
+    // called with current_stratum_job_mutex held
+    void newGeneration();
+
+  private:
+    uint32_t m_generation = 0;
 };
 
 // Global mining info instances - one per pool slot, protocol-polymorphic
@@ -32,12 +75,27 @@ extern MiningInfoBase* miningInfo[2];
 // Mutex for protecting miningInfo access
 extern pthread_mutex_t current_stratum_job_mutex;
 
+typedef struct
+{
+    uint32_t jobs;               // jobs sent to the asics
+    uint64_t buildTimeUs;        // total time spent in buildBmJob
+    uint32_t buildTimeMaxUs;
+    uint32_t newWork;            // new work received from the pools
+    uint32_t notifyToWorkUs;     // new work to first job sent, last value
+    uint32_t notifyToWorkMaxUs;
+} create_jobs_stats_t;
+
 // Main task entry point
 void create_jobs_task(void *pvParameters);
 
 // Trigger immediate job creation
 void trigger_job_creation();
 
+// Marks the arrival of new work for the notify to work latency
+void create_jobs_new_work(int pool);
+
+void create_jobs_get_stats(create_jobs_stats_t *stats);
+
 // V1-specific free functions (called from StratumManager::dispatch)
 void create_job_mining_notify(int pool, mining_notify *notify, bool abandonWork);
 void create_job_set_enonce(int pool, char *enonce, int enonce2_len);
@@ -84,7 +84,6 @@ class HashrateMonitor {
     Asic *m_asic = nullptr;
 
     void setChipHashrate(int nr, float temp);
-    float getChipHashrate(int nr);
     float getTotalChipHashrate();
 
   public:
@@ -98,6 +97,9 @@ class HashrateMonitor {
     // 'counterNow' is the 32-bit counter (host-endian).
     void onRegisterReply(uint8_t asic_idx, uint32_t counterNow);
 
+    // last measured hashrate of one chip in GH/s
+    float getChipHashrate(int nr);
+
     float getSmoothedTotalChipHashrate() {
       return m_smoothedHashrate;
     }
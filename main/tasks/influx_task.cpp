@@ -1,3 +1,4 @@
+#include <algorithm>
 #include <pthread.h>
 
 #include "esp_log.h"
@@ -9,6 +10,7 @@
 #include "ping_task.h"
 #include "influx_task.h"
 #include "stratum/stratum_manager.h"
+#include "tasks/can_metrics.h"
 
 static const char *TAG = "influx_task";
 
@@ -91,6 +93,25 @@ static void influx_task_fetch_from_stratum_manager(StratumManager *module) {
     // pool difficulty
     influxdb->m_stats.difficulty = module->getPoolDifficulty();
 
+    // submit-to-ack latency
+    for (int i = 0; i < 2; i++) {
+        share_submit_stats_t submit;
+        if (!module->getSubmitStats(i, &submit)) {
+            continue;
+        }
+        influxdb->m_stats.submit_latency_avg[i] = submit.acks ? (float) submit.latencySumUs / 1000.0f / submit.acks : 0.0f;
+        influxdb->m_stats.submit_latency_p90[i] = ShareSubmitter::percentileMs(&submit, 0.9f);
+        influxdb->m_stats.submit_latency_max[i] = submit.latencyMaxMs;
+        influxdb->m_stats.submit_dropped[i] = submit.dropped;
+    }
+
+    // failover timing
+    failover_stats_t failover;
+    module->getFailoverStats(&failover);
+    influxdb->m_stats.pool_switches = failover.switches;
+    influxdb->m_stats.failover_ms = failover.lastFailoverMs;
+    influxdb->m_stats.first_job_ms = failover.lastFirstJobMs;
+
     // found blocks
     int found = module->getFoundBlocks();
     if (found && !last_block_found) {
@@ -113,6 +134,59 @@ static void influx_task_fetch_from_system_module(System *module)
     influxdb->m_stats.recent_ping_loss = get_recent_ping_loss();
 }
 
+static void influx_task_fetch_from_can_metrics()
+{
+    // the influx task only runs on the master
+    influxdb->m_stats.can_enabled = Config::isCanEnabled();
+    if (!influxdb->m_stats.can_enabled) {
+        return;
+    }
+
+    can_metrics_t m;
+    can_metrics_get(&m);
+    const can_msg_stats_t *tpl = &m.msg[CAN_MSG_TEMPLATE];
+    influxdb->m_stats.can_bus_load = m.loadAvg;
+    influxdb->m_stats.can_frames_per_sec = m.framesPerSec;
+    influxdb->m_stats.can_tx_errors = m.txErrors;
+    influxdb->m_stats.can_tx_queue_max = m.txQueueMax;
+    influxdb->m_stats.can_arb_lost = m.arbLost;
+    influxdb->m_stats.can_bus_errors = m.busErrors;
+    influxdb->m_stats.can_rx_missed = m.rxMissed + m.rxOverrun;
+    influxdb->m_stats.can_incomplete = m.incomplete;
+    influxdb->m_stats.can_template_send_ms = tpl->lastUs / 1000.0f;
+    influxdb->m_stats.can_max_slaves = m.maxSlavesEstimate;
+}
+
+static void influx_task_fetch_chip_health()
+{
+    chip_health_t chips[CHIP_HEALTH_MAX_CHIPS];
+    int count = POWER_MANAGEMENT_MODULE.getChipHealth().get(chips, CHIP_HEALTH_MAX_CHIPS);
+
+    // nothing before the first window
+    if (!POWER_MANAGEMENT_MODULE.getChipHealth().getWindowMs()) {
+        count = 0;
+    }
+
+    influxdb->m_stats.chip_count = std::min(count, INFLUX_MAX_CHIPS);
+    influxdb->m_stats.weak_chips = 0;
+    for (int i = 0; i < influxdb->m_stats.chip_count; i++) {
+        influxdb->m_stats.chip_hashrate[i] = chips[i].hashrate;
+        influxdb->m_stats.chip_hw_error_rate[i] = chips[i].hwErrorRate;
+        influxdb->m_stats.chip_deviation[i] = chips[i].deviation;
+        influxdb->m_stats.chip_weak[i] = chips[i].weak;
+        influxdb->m_stats.weak_chips += chips[i].weak ? 1 : 0;
+    }
+}
+
+bool influx_task_get_writer_stats(InfluxWriterStats *stats)
+{
+    if (!influxdb) {
+        return false;
+    }
+    influxdb->getWriterStats(stats);
+    return true;
+}
+
 static void forever()
 {
     ESP_LOGI(TAG, "halting influx_task");
@@ -191,16 +265,44 @@ void influx_task(void *pvParameters)
         forever();
     }
 
+    // points are sampled every sampleInterval and written in batches
+    uint32_t sampleInterval = Config::getInfluxSampleInterval();
+    uint32_t flushInterval = Config::getInfluxFlushInterval();
+    int batchSize = Config::getInfluxBatchSize();
+    if (!sampleInterval) {
+        sampleInterval = 1;
+    }
+    influxdb->setBatching(batchSize, flushInterval * 1000);
+
+    ESP_LOGI(TAG, "sample interval: %lus, flush interval: %lus, batch size: %d", sampleInterval, flushInterval,
+             batchSize);
+
+    TickType_t lastWake = xTaskGetTickCount();
     while (1) {
         if (POWER_MANAGEMENT_MODULE.isShutdown()) {
+            // write what's pending before going quiet
+            influxdb->flush();
             ESP_LOGW(TAG, "suspended");
             vTaskSuspend(NULL);
+            lastWake = xTaskGetTickCount();
         }
         pthread_mutex_lock(&influxdb->m_lock);
         influx_task_fetch_from_system_module(module);
         influx_task_fetch_from_stratum_manager(STRATUM_MANAGER);
-        influxdb->write();
+        influx_task_fetch_from_can_metrics();
+        influx_task_fetch_chip_health();
+        influxdb->addPoint();
         pthread_mutex_unlock(&influxdb->m_lock);
-        vTaskDelay(pdMS_TO_TICKS(15000));
+
+        // the request runs without the stats lock, the uptime timer keeps ticking
+        if (influxdb->flushDue()) {
+            influxdb->flush();
+        }
+
+        // a slow request doesn't shift the sampling
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(sampleInterval * 1000));
+        if (xTaskGetTickCount() - lastWake > pdMS_TO_TICKS(sampleInterval * 1000)) {
+            lastWake = xTaskGetTickCount();
+        }
     }
 }
@@ -5,5 +5,8 @@
 void influx_task_set_temperature(float temp, float temp2);
 void influx_task_set_pwr(float vin, float iin, float pin, float vout, float iout, float pout);
 
+// false while the influx task isn't running
+bool influx_task_get_writer_stats(InfluxWriterStats *stats);
+
 void influx_task(void *pvParameters);
 void influx_set_fan(float pwm0, float rpm0, float pwm1, float rpm1);
\ No newline at end of file
@@ -4,8 +4,13 @@
 #include <cstdio>
 #include <cstdlib>
 
+#include <algorithm>
+
 #include "esp_log.h"
+#include "esp_timer.h"
 #include "mining.h"
+#include "bm_job_pool.h"
+#include "macros.h"
 
 extern "C" {
 #include "mining_utils.h"
@@ -13,6 +18,9 @@ extern "C" {
 
 static const char *TAG = "mining_info_v2";
 
+// maximum supported extranonce2 length in bytes
+#define MAX_EXTRANONCE_2_LEN 32
+
 // ============================================================================
 // MiningInfoV2Standard
 // ============================================================================
@@ -41,18 +49,30 @@ void MiningInfoV2Standard::updateJob(uint32_t job_id, uint32_t version,
     m_version_mask = version_mask;
     m_difficulty = difficulty;
     m_jobSent = false;  // new job from pool, ready to send
+    m_ntimeRoll = 0;
+    m_jobTimeUs = esp_timer_get_time();
     snprintf(m_jobid_str, sizeof(m_jobid_str), "%lu", (unsigned long)job_id);
 }
 
 bm_job *MiningInfoV2Standard::buildBmJob(uint32_t extranonce_2, int pool_id, uint32_t asic_diff)
 {
-    bm_job *job = (bm_job *)malloc(sizeof(bm_job));
+    // after the first job only roll ntime as far as real time has passed
+    uint32_t ntime_roll = 0;
+    if (m_jobSent) {
+        uint32_t elapsed_s = (uint32_t) ((esp_timer_get_time() - m_jobTimeUs) / 1000000);
+        if (elapsed_s <= m_ntimeRoll) {
+            return nullptr; // the ASICs keep working on the last job
+        }
+        ntime_roll = m_ntimeRoll + 1;
+    }
+
+    bm_job *job = bmJobPool.alloc();
     if (!job) return nullptr;
 
     job->version = m_version;
     job->version_mask = m_version_mask;
     job->target = m_nbits;
-    job->ntime = m_ntime;
+    job->ntime = m_ntime + ntime_roll;
     job->starting_nonce = 0;
     job->pool_diff = m_difficulty;
     job->asic_diff = asic_diff;
@@ -106,11 +126,12 @@ bm_job *MiningInfoV2Standard::buildBmJob(uint32_t extranonce_2, int pool_id, uin
     swap_endian_words_bin((uint8_t *)m_prev_hash, job->prev_block_hash_be, 32);
     reverse_bytes(job->prev_block_hash_be, 32);
 
-    job->jobid = strdup(m_jobid_str);
-    job->extranonce2 = strdup(""); // unused in SV2 standard channel
+    strlcpy(job->jobid, m_jobid_str, sizeof(job->jobid));
+    job->extranonce2[0] = '\0'; // unused in SV2 standard channel
 
-    // Standard Channel: mark as sent, don't resend on timer
+    // Standard Channel: following jobs only differ in ntime
     m_jobSent = true;
+    m_ntimeRoll = ntime_roll;
 
     return job;
 }
@@ -118,12 +139,11 @@ bm_job *MiningInfoV2Standard::buildBmJob(uint32_t extranonce_2, int pool_id, uin
 void MiningInfoV2Standard::setDifficulty(uint32_t difficulty)
 {
     m_difficulty = difficulty;
-    // Do NOT reset m_jobSent. Never resend the same Standard Channel job.
-    // ASIC keeps mining with version rolling. New difficulty applies to
-    // the NEXT job from the pool (matches Bitaxe behavior).
+    // Do NOT reset m_jobSent. Never resend the same Standard Channel header.
+    // New difficulty applies to the next (ntime rolled) job.
 }
 
-bool MiningInfoV2Standard::isValid() const { return m_ntime != 0 && !m_jobSent; }
+bool MiningInfoV2Standard::isValid() const { return m_ntime != 0; }
 
 bool MiningInfoV2Standard::isNewWork(uint32_t &last_ntime) const
 {
@@ -151,15 +171,16 @@ void MiningInfoV2Standard::invalidate()
 MiningInfoV2Extended::MiningInfoV2Extended()
 {
     memset(m_prev_hash, 0, 32);
-    memset(m_extranonce_prefix, 0, sizeof(m_extranonce_prefix));
     memset(m_merkle_path, 0, sizeof(m_merkle_path));
     m_jobid_str[0] = '\0';
+    mbedtls_sha256_init(&m_coinbase_midstate);
 }
 
 MiningInfoV2Extended::~MiningInfoV2Extended()
 {
-    free(m_coinbase_prefix);
-    free(m_coinbase_suffix);
+    safe_free(m_coinbase_suffix);
+    safe_free(m_coinbase_prefix);
+    mbedtls_sha256_free(&m_coinbase_midstate);
 }
 
 void MiningInfoV2Extended::updateJob(const sv2_ext_job_t *ext_job,
@@ -168,91 +189,96 @@ void MiningInfoV2Extended::updateJob(const sv2_ext_job_t *ext_job,
                                       uint8_t extranonce_size,
                                       uint32_t version_mask, uint32_t difficulty)
 {
+    // the job is invalid until the coinbase is complete
+    m_ntime = 0;
+    newGeneration();
+
+    // Copy the coinbase suffix into the reused buffer
+    uint16_t suffix_len = ext_job->coinbase_suffix ? ext_job->coinbase_suffix_len : 0;
+    if (suffix_len > m_coinbase_suffix_cap) {
+        uint8_t *tmp = (uint8_t *) REALLOC(m_coinbase_suffix, suffix_len);
+        if (!tmp) {
+            ESP_LOGE(TAG, "couldn't allocate coinbase suffix (%d bytes)", (int) suffix_len);
+            return;
+        }
+        m_coinbase_suffix = tmp;
+        m_coinbase_suffix_cap = suffix_len;
+    }
+    if (suffix_len) {
+        memcpy(m_coinbase_suffix, ext_job->coinbase_suffix, suffix_len);
+    }
+    m_coinbase_suffix_len = suffix_len;
+
+    // Keep everything in front of extranonce_2 for the CAN job template
+    uint16_t cb_prefix_len = ext_job->coinbase_prefix ? ext_job->coinbase_prefix_len : 0;
+    uint16_t prefix_len = cb_prefix_len + extranonce_prefix_len;
+    if (prefix_len > m_coinbase_prefix_cap) {
+        uint8_t *tmp = (uint8_t *) REALLOC(m_coinbase_prefix, prefix_len);
+        if (!tmp) {
+            ESP_LOGE(TAG, "couldn't allocate coinbase prefix (%d bytes)", (int) prefix_len);
+            return;
+        }
+        m_coinbase_prefix = tmp;
+        m_coinbase_prefix_cap = prefix_len;
+    }
+    if (cb_prefix_len) {
+        memcpy(m_coinbase_prefix, ext_job->coinbase_prefix, cb_prefix_len);
+    }
+    if (extranonce_prefix_len) {
+        memcpy(m_coinbase_prefix + cb_prefix_len, extranonce_prefix, extranonce_prefix_len);
+    }
+    m_coinbase_prefix_len = prefix_len;
+
+    // precompute the sha256 midstate of everything in front of extranonce_2
+    mbedtls_sha256_free(&m_coinbase_midstate);
+    mbedtls_sha256_init(&m_coinbase_midstate);
+    mbedtls_sha256_starts(&m_coinbase_midstate, 0);
+    if (prefix_len > 0) {
+        mbedtls_sha256_update(&m_coinbase_midstate, m_coinbase_prefix, prefix_len);
+    }
+    m_extranonce_size = std::min(extranonce_size, (uint8_t) MAX_EXTRANONCE_2_LEN);
+
+    // Merkle path
+    m_merkle_path_count = std::min(ext_job->merkle_path_count, (uint8_t) SV2_MAX_MERKLE_BRANCHES);
+    memcpy(m_merkle_path, ext_job->merkle_path, m_merkle_path_count * 32);
+
     m_job_id = ext_job->job_id;
     m_version = ext_job->version;
     memcpy(m_prev_hash, ext_job->prev_hash, 32);
-    m_ntime = ext_job->ntime;
     m_nbits = ext_job->nbits;
     m_version_mask = version_mask;
     m_difficulty = difficulty;
     snprintf(m_jobid_str, sizeof(m_jobid_str), "%lu", (unsigned long)ext_job->job_id);
-
-    // Copy coinbase components (deep copy)
-    free(m_coinbase_prefix);
-    m_coinbase_prefix = nullptr;
-    if (ext_job->coinbase_prefix && ext_job->coinbase_prefix_len > 0) {
-        m_coinbase_prefix = (uint8_t *)malloc(ext_job->coinbase_prefix_len);
-        memcpy(m_coinbase_prefix, ext_job->coinbase_prefix, ext_job->coinbase_prefix_len);
-        m_coinbase_prefix_len = ext_job->coinbase_prefix_len;
-    } else {
-        m_coinbase_prefix_len = 0;
-    }
-
-    free(m_coinbase_suffix);
-    m_coinbase_suffix = nullptr;
-    if (ext_job->coinbase_suffix && ext_job->coinbase_suffix_len > 0) {
-        m_coinbase_suffix = (uint8_t *)malloc(ext_job->coinbase_suffix_len);
-        memcpy(m_coinbase_suffix, ext_job->coinbase_suffix, ext_job->coinbase_suffix_len);
-        m_coinbase_suffix_len = ext_job->coinbase_suffix_len;
-    } else {
-        m_coinbase_suffix_len = 0;
-    }
-
-    // Extranonce info
-    m_extranonce_prefix_len = extranonce_prefix_len;
-    if (extranonce_prefix_len > 0) {
-        memcpy(m_extranonce_prefix, extranonce_prefix, extranonce_prefix_len);
-    }
-    m_extranonce_size = extranonce_size;
-
-    // Merkle path
-    m_merkle_path_count = ext_job->merkle_path_count;
-    if (m_merkle_path_count > 0 && m_merkle_path_count <= 32) {
-        memcpy(m_merkle_path, ext_job->merkle_path, m_merkle_path_count * 32);
-    }
+    m_ntime = ext_job->ntime;
 }
 
 bm_job *MiningInfoV2Extended::buildBmJob(uint32_t extranonce_2, int pool_id, uint32_t asic_diff)
 {
-    bm_job *job = (bm_job *)malloc(sizeof(bm_job));
-    if (!job) return nullptr;
-
-    // Derive extranonce_2 binary from counter (big-endian)
-    uint8_t en2_bin[32];
-    memset(en2_bin, 0, sizeof(en2_bin));
-    uint32_t counter = extranonce_2;
-    for (int i = m_extranonce_size - 1; i >= 0 && counter > 0; i--) {
-        en2_bin[i] = (uint8_t)(counter & 0xFF);
-        counter >>= 8;
-    }
-
-    // Compute coinbase tx hash: double_sha256(prefix + extranonce_prefix + extranonce_2 + suffix)
-    size_t coinbase_len = m_coinbase_prefix_len + m_extranonce_prefix_len + m_extranonce_size + m_coinbase_suffix_len;
-    uint8_t *coinbase = (uint8_t *)malloc(coinbase_len);
-    if (!coinbase) {
-        free(job);
-        return nullptr;
+    // Derive extranonce_2 binary from counter (big-endian, zero padded)
+    uint8_t en2_bin[MAX_EXTRANONCE_2_LEN] = {0};
+    for (int i = m_extranonce_size - 1, shift = 0; i >= 0 && shift < 32; i--, shift += 8) {
+        en2_bin[i] = (uint8_t) (extranonce_2 >> shift);
     }
 
-    size_t pos = 0;
-    memcpy(coinbase + pos, m_coinbase_prefix, m_coinbase_prefix_len); pos += m_coinbase_prefix_len;
-    memcpy(coinbase + pos, m_extranonce_prefix, m_extranonce_prefix_len); pos += m_extranonce_prefix_len;
-    memcpy(coinbase + pos, en2_bin, m_extranonce_size); pos += m_extranonce_size;
-    memcpy(coinbase + pos, m_coinbase_suffix, m_coinbase_suffix_len);
-
+    // Finish the coinbase tx hash from the prefix midstate:
+    // double_sha256(prefix + extranonce_prefix + extranonce_2 + suffix)
     uint8_t coinbase_hash[32];
-    double_sha256_bin(coinbase, coinbase_len, coinbase_hash);
-    free(coinbase);
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_clone(&ctx, &m_coinbase_midstate);
+    mbedtls_sha256_update(&ctx, en2_bin, m_extranonce_size);
+    mbedtls_sha256_update(&ctx, m_coinbase_suffix, m_coinbase_suffix_len);
+    mbedtls_sha256_finish(&ctx, coinbase_hash);
+    mbedtls_sha256_free(&ctx);
+    mbedtls_sha256(coinbase_hash, 32, coinbase_hash, 0);
 
     // Compute merkle root from coinbase hash + merkle path
     uint8_t merkle_root[32];
-    memcpy(merkle_root, coinbase_hash, 32);
-    for (int i = 0; i < m_merkle_path_count; i++) {
-        uint8_t concat[64];
-        memcpy(concat, merkle_root, 32);
-        memcpy(concat + 32, m_merkle_path[i], 32);
-        double_sha256_bin(concat, 64, merkle_root);
-    }
+    calculate_merkle_root_bin(coinbase_hash, m_merkle_path, m_merkle_path_count, merkle_root);
+
+    // the job comes from the pool because it will be saved in the job array
+    bm_job *job = bmJobPool.alloc();
+    if (!job) return nullptr;
 
     // Fill bm_job
     job->version = m_version;
@@ -273,17 +299,22 @@ bm_job *MiningInfoV2Extended::buildBmJob(uint32_t extranonce_2, int pool_id, uin
     swap_endian_words_bin((uint8_t *)m_prev_hash, job->prev_block_hash_be, 32);
     reverse_bytes(job->prev_block_hash_be, 32);
 
-    job->jobid = strdup(m_jobid_str);
+    strlcpy(job->jobid, m_jobid_str, sizeof(job->jobid));
 
     // Store extranonce_2 as hex for share submission
-    char en2_hex[65];
-    bin2hex(en2_bin, m_extranonce_size, en2_hex, sizeof(en2_hex));
-    job->extranonce2 = strdup(en2_hex);
+    bin2hex(en2_bin, m_extranonce_size, job->extranonce2, sizeof(job->extranonce2));
 
     return job;
 }
 
-void MiningInfoV2Extended::setDifficulty(uint32_t difficulty) { m_difficulty = difficulty; }
+void MiningInfoV2Extended::setDifficulty(uint32_t difficulty)
+{
+    // the pool difficulty is part of the CAN job template
+    if (difficulty != m_difficulty) {
+        m_difficulty = difficulty;
+        newGeneration();
+    }
+}
 
 bool MiningInfoV2Extended::isValid() const { return m_ntime != 0; }
 
@@ -300,12 +331,35 @@ const char *MiningInfoV2Extended::getJobId() const { return m_jobid_str; }
 uint32_t MiningInfoV2Extended::getActiveDifficulty() const { return m_difficulty; }
 uint32_t MiningInfoV2Extended::getVersionMask() const { return m_version_mask; }
 
+bool MiningInfoV2Extended::getJobTemplate(job_template_t *tpl) const
+{
+    if (!m_ntime) {
+        return false;
+    }
+
+    tpl->coinbasePrefix[0] = m_coinbase_prefix;
+    tpl->coinbasePrefixLen[0] = m_coinbase_prefix_len;
+    tpl->coinbasePrefix[1] = nullptr;
+    tpl->coinbasePrefixLen[1] = 0;
+    tpl->coinbaseSuffix = m_coinbase_suffix;
+    tpl->coinbaseSuffixLen = m_coinbase_suffix_len;
+    tpl->extranonce2Len = m_extranonce_size;
+    tpl->merkleBranches = m_merkle_path;
+    tpl->merkleCount = m_merkle_path_count;
+    memcpy(tpl->prevBlockHash, m_prev_hash, 32);
+    tpl->version = m_version;
+    tpl->nbits = m_nbits;
+    tpl->ntime = m_ntime;
+    tpl->poolDiff = m_difficulty;
+    tpl->jobId = m_jobid_str;
+    return true;
+}
+
 void MiningInfoV2Extended::invalidate()
 {
     m_ntime = 0;
     m_job_id = 0;
-    free(m_coinbase_prefix);  m_coinbase_prefix = nullptr;
-    free(m_coinbase_suffix);  m_coinbase_suffix = nullptr;
     m_coinbase_prefix_len = 0;
     m_coinbase_suffix_len = 0;
+    newGeneration();
 }
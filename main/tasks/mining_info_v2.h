@@ -2,6 +2,7 @@
 
 #include "create_jobs_task.h"
 #include "mining.h"
+#include "mbedtls/sha256.h"
 
 extern "C" {
 #include "sv2_protocol.h"
@@ -12,6 +13,10 @@ extern "C" {
  *
  * Pool provides complete merkle_root and prev_hash - no coinbase computation needed.
  * bm_job is filled directly from pool-provided data.
+ *
+ * A pool job is sent once. The header space of a single job is only nonce plus
+ * version rolling, so further jobs roll ntime by one second, never ahead of the
+ * time that passed since the job arrived (allowed by the SV2 spec).
  */
 class MiningInfoV2Standard : public MiningInfoBase {
   public:
@@ -45,7 +50,9 @@ class MiningInfoV2Standard : public MiningInfoBase {
     uint32_t m_version_mask = 0x1fffe000;
     uint32_t m_difficulty = 0;
     char m_jobid_str[16];
-    bool m_jobSent = false;  ///< Standard Channel: job already sent to ASIC, don't resend
+    bool m_jobSent = false;  ///< Standard Channel: job already sent to ASIC
+    uint32_t m_ntimeRoll = 0;   ///< seconds added to ntime of the last sent job
+    int64_t m_jobTimeUs = 0;    ///< arrival of the pool job
 };
 
 
@@ -55,6 +62,10 @@ class MiningInfoV2Standard : public MiningInfoBase {
  * Pool provides coinbase prefix/suffix and merkle path.
  * Miner computes coinbase from prefix + extranonce_prefix + extranonce_2 + suffix,
  * then merkle root from the merkle path.
+ *
+ * Only extranonce_2 changes between jobs, so the SHA-256 state over
+ * prefix + extranonce_prefix is computed once per pool job and each ASIC job
+ * only hashes extranonce_2 + suffix.
  */
 class MiningInfoV2Extended : public MiningInfoBase {
   public:
@@ -68,6 +79,7 @@ class MiningInfoV2Extended : public MiningInfoBase {
     uint32_t getActiveDifficulty() const override;
     uint32_t getVersionMask() const override;
     void invalidate() override;
+    bool getJobTemplate(job_template_t *tpl) const override;
 
     /// Update difficulty mid-job (from SetTarget)
     void setDifficulty(uint32_t difficulty);
@@ -88,18 +100,23 @@ class MiningInfoV2Extended : public MiningInfoBase {
     uint32_t m_difficulty = 0;
     char m_jobid_str[16];
 
-    // Coinbase components (owned copies)
+    // sha256 state over coinbase prefix + extranonce_prefix
+    mbedtls_sha256_context m_coinbase_midstate;
+
+    // Coinbase prefix + extranonce_prefix for the CAN job template (the buffer only grows)
     uint8_t *m_coinbase_prefix = nullptr;
     uint16_t m_coinbase_prefix_len = 0;
+    uint16_t m_coinbase_prefix_cap = 0;
+
+    // Coinbase suffix (owned copy, the buffer only grows)
     uint8_t *m_coinbase_suffix = nullptr;
     uint16_t m_coinbase_suffix_len = 0;
+    uint16_t m_coinbase_suffix_cap = 0;
 
     // Extranonce from pool
-    uint8_t m_extranonce_prefix[32];
-    uint8_t m_extranonce_prefix_len = 0;
     uint8_t m_extranonce_size = 0;  // miner's rollable portion
 
     // Merkle path
-    uint8_t m_merkle_path[32][32];
+    uint8_t m_merkle_path[SV2_MAX_MERKLE_BRANCHES][32];
     int m_merkle_path_count = 0;
 };
@@ -1,10 +1,12 @@
 #include <algorithm>
 #include <math.h>
+#include <string.h>
 
 #include "esp_log.h"
 #include "esp_timer.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "nvs.h"
 
 #include "mining.h"
 #include "periodic.hpp"
@@ -12,12 +14,37 @@
 #include "boards/board.h"
 #include "fan_controller.h"
 #include "global_state.h"
+#include "asic_result_task.h"
 #include "influx_task.h"
+#include "macros.h"
 #include "nvs_config.h"
 #include "serial.h"
 
 #define POLL_RATE 2000
 
+// the autotuner log survives reboots in its own namespace, like the CAN registry
+#define AUTOTUNE_NVS_NAMESPACE "autotune"
+#define AUTOTUNE_NVS_KEY "log"
+#define AUTOTUNE_LOG_VERSION 1
+
+// hardware errors per nonce and share of the nominal hashrate a stable step needs
+#define AUTOTUNE_MAX_ERROR_RATE 0.01f
+#define AUTOTUNE_MIN_YIELD 0.85f
+
+enum {
+    AUTOTUNE_REQUEST_NONE = 0,
+    AUTOTUNE_REQUEST_START,
+    AUTOTUNE_REQUEST_STOP,
+};
+
+typedef struct {
+    uint8_t version;
+    uint8_t goal;
+    uint8_t state;
+    uint8_t count;
+    autotune_step_t steps[AUTOTUNE_LOG_SIZE];
+} autotune_saved_t;
+
 static const char *TAG = "power_management";
 
 // #define MEASURE_LOOP_TIME
@@ -215,6 +242,11 @@ void PowerManagementTask::applyAsicSettings()
         return;
     }
 
+    // the autotuner owns the setpoint while it runs, also after a settings reload
+    if (m_autoTuner.isActive()) {
+        m_board->setAsicSettings(m_autoTuner.getFrequency(), m_autoTuner.getVoltage());
+    }
+
     // check if asic voltage changed
     checkCoreVoltageChanged();
 
@@ -225,6 +257,234 @@ void PowerManagementTask::applyAsicSettings()
     checkVrFrequencyChanged();
 }
 
+void PowerManagementTask::requestAutoTune(bool start)
+{
+    m_autoTuneRequest = start ? AUTOTUNE_REQUEST_START : AUTOTUNE_REQUEST_STOP;
+    trigger();
+}
+
+bool PowerManagementTask::getAutoTuneConfig(autotune_config_t *config)
+{
+    Asic *asics = m_board->getAsics();
+    if (!asics || !m_board->hasHashrateCounter()) {
+        // the nonce based hashrate is far too noisy for a few minutes per step
+        return false;
+    }
+
+    config->goal = (AutoTuneGoal) Config::getAutoTuneGoal();
+    config->maxPower = Config::getAutoTuneMaxPower();
+    config->maxTemp = Config::getAutoTuneMaxTemp();
+    config->settleMs = Config::getAutoTuneSettle() * 1000;
+    config->measureMs = Config::getAutoTuneMeasure() * 1000;
+    config->maxErrorRate = AUTOTUNE_MAX_ERROR_RATE;
+    config->minYield = AUTOTUNE_MIN_YIELD;
+    config->expectedGhsPerMhz = asics->getSmallCoreCount() * m_board->getAsicCount() / 1000.0f;
+    return config->goal != AutoTuneGoal::OFF;
+}
+
+void PowerManagementTask::saveAutoTuneLog()
+{
+    autotune_saved_t *saved = (autotune_saved_t *) CALLOC(1, sizeof(autotune_saved_t));
+    if (!saved) {
+        return;
+    }
+
+    const autotune_step_t *log;
+    int count = m_autoTuner.getLog(&log);
+    saved->version = AUTOTUNE_LOG_VERSION;
+    saved->goal = (uint8_t) m_autoTuner.getConfig().goal;
+    saved->state = (uint8_t) m_autoTuner.getState();
+    saved->count = (uint8_t) count;
+    memcpy(saved->steps, log, count * sizeof(autotune_step_t));
+
+    nvs_handle_t h;
+    if (nvs_open(AUTOTUNE_NVS_NAMESPACE, NVS_READWRITE, &h) == ESP_OK) {
+        nvs_set_blob(h, AUTOTUNE_NVS_KEY, saved, sizeof(autotune_saved_t));
+        nvs_commit(h);
+        nvs_close(h);
+    } else {
+        ESP_LOGW(TAG, "NVS open failed, autotune log not saved");
+    }
+    FREE(saved);
+}
+
+void PowerManagementTask::resumeAutoTune()
+{
+    autotune_config_t config;
+    if (!getAutoTuneConfig(&config)) {
+        return;
+    }
+
+    autotune_saved_t *saved = (autotune_saved_t *) CALLOC(1, sizeof(autotune_saved_t));
+    if (!saved) {
+        return;
+    }
+
+    size_t len = sizeof(autotune_saved_t);
+    nvs_handle_t h;
+    esp_err_t err = nvs_open(AUTOTUNE_NVS_NAMESPACE, NVS_READONLY, &h);
+    if (err == ESP_OK) {
+        err = nvs_get_blob(h, AUTOTUNE_NVS_KEY, saved, &len);
+        nvs_close(h);
+    }
+
+    bool valid = err == ESP_OK && len == sizeof(autotune_saved_t) && saved->version == AUTOTUNE_LOG_VERSION;
+    bool finished = valid && saved->goal == (uint8_t) config.goal && saved->state == (uint8_t) AutoTuneState::HOLD;
+    if (finished) {
+        uint32_t now = (uint32_t) (esp_timer_get_time() / 1000);
+        m_autoTuner.resume(config, m_board->getFrequencyOptions(), m_board->getVoltageOptions(),
+                           m_board->getAsicFrequency(), m_board->getAsicVoltageMillis(), saved->steps, saved->count, now);
+        ESP_LOGI(TAG, "autotune holding %uMHz / %umV", m_autoTuner.getFrequency(), m_autoTuner.getVoltage());
+    } else if (valid) {
+        // a sweep cut short by a reboot isn't restarted, it may have caused it
+        ESP_LOGW(TAG, "saved autotune sweep is unfinished or for another goal, not resuming");
+    }
+    FREE(saved);
+}
+
+void PowerManagementTask::handleAutoTuneRequest()
+{
+    int request = m_autoTuneRequest;
+    m_autoTuneRequest = AUTOTUNE_REQUEST_NONE;
+
+    if (request == AUTOTUNE_REQUEST_STOP) {
+        if (m_autoTuner.isActive()) {
+            ESP_LOGI(TAG, "autotune stopped");
+            m_autoTuner.stop();
+            saveAutoTuneLog();
+            // back to the saved settings, the last hold setpoint if there was one
+            m_board->loadSettings();
+        }
+        return;
+    }
+
+    autotune_config_t config;
+    if (!getAutoTuneConfig(&config)) {
+        ESP_LOGE(TAG, "autotune needs a goal and a board with hashrate counters");
+        return;
+    }
+
+    uint32_t now = (uint32_t) (esp_timer_get_time() / 1000);
+    if (m_autoTuner.isActive()) {
+        m_autoTuner.stop();
+        m_board->loadSettings();
+    }
+    m_autoTuner.start(config, m_board->getFrequencyOptions(), m_board->getVoltageOptions(), m_board->getAsicFrequency(),
+                      m_board->getAsicVoltageMillis(), now);
+    ESP_LOGI(TAG, "autotune sweep started at %uMHz / %umV", m_autoTuner.getFrequency(), m_autoTuner.getVoltage());
+    saveAutoTuneLog();
+}
+
+void PowerManagementTask::autoTune()
+{
+    // requests wait for the chips
+    if (m_shutdown || !m_board->isInitialized()) {
+        return;
+    }
+
+    if (!m_autoTuneResumed) {
+        m_autoTuneResumed = true;
+        resumeAutoTune();
+    }
+
+    if (m_autoTuneRequest != AUTOTUNE_REQUEST_NONE) {
+        handleAutoTuneRequest();
+    }
+
+    if (!m_autoTuner.isActive()) {
+        return;
+    }
+
+    asic_result_stats_t results;
+    asic_result_get_stats(&results);
+
+    autotune_sample_t sample;
+    sample.hashrate = HASHRATE_MONITOR.getHashrate();
+    sample.power = m_power;
+    sample.chipTemp = m_chipTempMax;
+    sample.nonces = results.nonces;
+    sample.hwErrors = results.hwErrors;
+
+    AutoTuneState before = m_autoTuner.getState();
+    if (!m_autoTuner.update(sample, (uint32_t) (esp_timer_get_time() / 1000))) {
+        return;
+    }
+
+    const autotune_step_t *log;
+    int count = m_autoTuner.getLog(&log);
+    if (count) {
+        const autotune_step_t *last = &log[count - 1];
+        ESP_LOGI(TAG, "autotune %uMHz / %umV: %uGH/s %.1fW %u°C %u/%lu errors, %s", last->frequency, last->voltage,
+                 last->hashrate, last->power / 10.0f, last->temp, last->hwErrors, (unsigned long) last->nonces,
+                 AutoTuner::resultToStr(last->result));
+    }
+
+    switch (m_autoTuner.getState()) {
+    case AutoTuneState::HOLD:
+        // saved, so the tuned setpoint is used from boot on
+        Config::setAsicFrequency(m_autoTuner.getFrequency());
+        Config::setAsicVoltage(m_autoTuner.getVoltage());
+        if (before == AutoTuneState::SWEEP) {
+            autotune_step_t best;
+            m_autoTuner.getBest(&best);
+            ESP_LOGI(TAG, "autotune done: %uMHz / %umV, %.2f J/TH", best.frequency, best.voltage,
+                     AutoTuner::efficiency(best));
+        }
+        break;
+    case AutoTuneState::FAILED:
+        ESP_LOGE(TAG, "autotune found no stable setting, restoring %uMHz / %umV", m_autoTuner.getFrequency(),
+                 m_autoTuner.getVoltage());
+        m_board->loadSettings();
+        break;
+    default:
+        break;
+    }
+    saveAutoTuneLog();
+}
+
+void PowerManagementTask::updateChipHealth()
+{
+    Asic *asics = m_board->getAsics();
+    if (m_shutdown || !asics) {
+        return;
+    }
+
+    int count = std::min(m_board->getAsicCount(), CHIP_HEALTH_MAX_CHIPS);
+    bool counter = m_board->hasHashrateCounter();
+
+    chip_health_sample_t samples[CHIP_HEALTH_MAX_CHIPS];
+    for (int i = 0; i < count; i++) {
+        asic_chip_stats_t stats;
+        asic_result_get_chip_stats(i, &stats);
+        samples[i].hashrate = counter ? HASHRATE_MONITOR.getChipHashrate(i) : 0.0f;
+        samples[i].temp = m_board->getChipTemp(i);
+        samples[i].nonces = stats.nonces;
+        samples[i].hwErrors = stats.hwErrors;
+        samples[i].duplicates = stats.duplicates;
+        samples[i].work = stats.work;
+    }
+
+    uint32_t weakBefore = m_chipHealth.getWeakMask();
+    float expected = asics->getSmallCoreCount() * m_board->getAsicFrequency() / 1000.0f;
+    if (!m_chipHealth.update(samples, count, counter, expected, (uint32_t) (esp_timer_get_time() / 1000))) {
+        return;
+    }
+
+    uint32_t weak = m_chipHealth.getWeakMask();
+    if (weak == weakBefore) {
+        return;
+    }
+
+    chip_health_t chips[CHIP_HEALTH_MAX_CHIPS];
+    m_chipHealth.get(chips, count);
+    for (int i = 0; i < count; i++) {
+        if ((weak ^ weakBefore) & (1u << i)) {
+            ESP_LOGW(TAG, "asic %d %s: %.1fGH/s of %.1fGH/s expected, deviation %.1f", i,
+                     chips[i].weak ? "weak" : "recovered", chips[i].hashrate, chips[i].expected, chips[i].deviation);
+        }
+    }
+}
+
 void PowerManagementTask::requestChipTemps()
 {
     // temperature measurements don't work before ASICs
@@ -298,6 +558,10 @@ void PowerManagementTask::task()
 
         influx_task_set_temperature(m_chipTempMax, m_vrTemp);
 
+        autoTune();
+
+        updateChipHealth();
+
         // Run fan controller (reads RPM, drives fans, updates overheat flags)
         m_fanController.update(m_chipTempMax, m_vrTemp);
 
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <pthread.h>
+#include "autotuner.h"
 #include "boards/board.h"
+#include "chip_health.h"
 #include "fan_controller.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/semphr.h"
@@ -36,6 +38,12 @@ class PowerManagementTask {
     FanController m_fanController;
     Board* m_board = nullptr;
 
+    AutoTuner m_autoTuner;
+    volatile int m_autoTuneRequest = 0; // set by the API, handled in the loop
+    bool m_autoTuneResumed = false;
+
+    ChipHealth m_chipHealth;
+
     void checkCoreVoltageChanged();
     void checkAsicFrequencyChanged();
     void checkVrFrequencyChanged();
@@ -49,6 +57,14 @@ class PowerManagementTask {
     void logChipTemps();
     void requestChipTemps();
 
+    bool getAutoTuneConfig(autotune_config_t *config);
+    void resumeAutoTune();
+    void handleAutoTuneRequest();
+    void autoTune();
+    void saveAutoTuneLog();
+
+    void updateChipHealth();
+
   public:
     PowerManagementTask();
 
@@ -105,6 +121,21 @@ class PowerManagementTask {
 
     void shutdown();
 
+    // starts a sweep with the saved goal or stops the tuner, applied by the task
+    void requestAutoTune(bool start);
+
+    // only while holding lock()
+    const AutoTuner &getAutoTuner()
+    {
+        return m_autoTuner;
+    }
+
+    // has its own lock
+    ChipHealth &getChipHealth()
+    {
+        return m_chipHealth;
+    }
+
     bool isShutdown() {
         return m_shutdown;
     }
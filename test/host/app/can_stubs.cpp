@@ -0,0 +1,28 @@
+// host build without CAN bus: no slaves, create_jobs_task only mines itself.
+// can_fleet_sim links the CAN tasks on the virtual bus instead.
+
+#include "can_master_task.h"
+#include "bm_job_pool.h"
+
+bool can_master_is_slave_active(uint8_t slave_id)
+{
+    return false;
+}
+
+void can_master_publish_template(int pool_id, const char *jobid, uint8_t *buf, size_t len)
+{
+}
+
+bool can_master_select_template(int pool_id)
+{
+    return false;
+}
+
+void can_master_send_job(uint8_t slave_id, uint32_t extranonce_2, bm_job *job)
+{
+    bmJobPool.release(job);
+}
+
+void can_master_job_tick(void)
+{
+}
@@ -0,0 +1,3 @@
+#pragma once
+
+// host build: the network is always up
@@ -0,0 +1,13 @@
+#pragma once
+
+// host build: alerts are only logged
+
+#include "coinbase_decoder.h"
+
+class DiscordAlerter {
+  public:
+    bool sendWatchdogAlert();
+    bool sendBlockFoundAlert(double diff, double networkDiff);
+    bool sendBestDifficultyAlert(double diff, double networkDiff);
+    bool sendCoinbaseVerifyFailed(int pool, const coinbase_result_t *cb, int mode);
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+// host build: the globals of main/global_state.h the mining pipeline uses,
+// without display, network, power and OTA hardware, the hashrate monitor
+// without its task (host_app.cpp)
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "asic.h"
+#include "bm1368.h"
+#include "tasks/asic_jobs.h"
+#include "tasks/can_sender.h"
+#include "tasks/hashrate_monitor_task.h"
+#include "stratum/stratum_manager.h"
+#include "stratum/stratum_manager_dual_pool.h"
+#include "stratum/stratum_manager_fallback.h"
+
+#include "boards/board.h"
+#include "system.h"
+#include "discord.h"
+
+// no fans on the host, the settings are only stored
+class FanController {
+  public:
+    void loadSettings()
+    {
+    }
+};
+
+// power, temperatures and fans of a board that runs cool at no power
+class PowerManagementTask {
+  protected:
+    bool m_shutdown = false;
+    FanController m_fanController;
+
+  public:
+    bool isShutdown()
+    {
+        return __atomic_load_n(&m_shutdown, __ATOMIC_RELAXED);
+    }
+    void shutdown()
+    {
+        __atomic_store_n(&m_shutdown, true, __ATOMIC_RELAXED);
+    }
+    float getPower()
+    {
+        return 0.0f;
+    }
+    float getCurrent()
+    {
+        return 0.0f;
+    }
+    float getChipTempMax()
+    {
+        return 50.0f;
+    }
+    float getVRTemp()
+    {
+        return 50.0f;
+    }
+    uint16_t getFanRPM(int channel)
+    {
+        return 0;
+    }
+    uint16_t getFanPerc(int ch = 0)
+    {
+        return 100;
+    }
+    FanController &getFanController()
+    {
+        return m_fanController;
+    }
+};
+
+class NetworkManager {
+  public:
+    bool hasWifiIp()
+    {
+        return true;
+    }
+    bool hasEthIp()
+    {
+        return false;
+    }
+};
+
+extern System SYSTEM_MODULE;
+extern PowerManagementTask POWER_MANAGEMENT_MODULE;
+extern HashrateMonitor HASHRATE_MONITOR;
+
+extern StratumManager *STRATUM_MANAGER;
+
+extern AsicJobs asicJobs;
+extern DiscordAlerter discordAlerter;
+
+extern NetworkManager NETWORK;
+uint64_t now_ms();
+uint32_t now();
+bool is_time_synced(void);
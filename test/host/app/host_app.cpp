@@ -0,0 +1,254 @@
+// host build: globals of main.cpp and stand-ins for the parts of the firmware
+// that need hardware (display, ICMP), CAN is in can_stubs.cpp or on the
+// virtual bus
+
+#include <algorithm>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "global_state.h"
+#include "displays/ui_ipc.h"
+#include "../tasks/ping_task.h"
+
+static const char *TAG = "host";
+
+System SYSTEM_MODULE;
+PowerManagementTask POWER_MANAGEMENT_MODULE;
+HashrateMonitor HASHRATE_MONITOR;
+StratumManager *STRATUM_MANAGER = nullptr;
+BmJobPool bmJobPool;
+AsicJobs asicJobs;
+DiscordAlerter discordAlerter;
+NetworkManager NETWORK;
+
+uint64_t now_ms()
+{
+    return esp_timer_get_time() / 1000ull;
+}
+
+uint32_t now()
+{
+    return (uint32_t) time(NULL);
+}
+
+bool is_time_synced(void)
+{
+    return true;
+}
+
+// Board, main/boards/board.cpp without the display of the self test
+Board::Board()
+{
+    m_absMaxAsicFrequency = 0;
+    m_absMaxAsicVoltageMillis = 0;
+    m_vrFrequency = m_defaultVrFrequency = 0;
+    m_hasHashCounter = false;
+    m_ecoAsicFrequency = 0;
+    m_ecoAsicVoltageMillis = 0;
+    m_numFans = 1;
+}
+
+void Board::loadSettings()
+{
+    m_fanPerc = Config::getFanSpeed();
+
+    if (m_absMaxAsicFrequency) {
+        m_asicFrequency = std::min((int) Config::getAsicFrequency(m_asicFrequency), m_absMaxAsicFrequency);
+    } else {
+        m_asicFrequency = (int) Config::getAsicFrequency(m_asicFrequency);
+    }
+
+    if (m_absMaxAsicVoltageMillis) {
+        m_asicVoltageMillis = std::min((int) Config::getAsicVoltage(m_asicVoltageMillis), m_absMaxAsicVoltageMillis);
+    } else {
+        m_asicVoltageMillis = (int) Config::getAsicVoltage(m_asicVoltageMillis);
+    }
+
+    m_asicJobIntervalMs = Config::getAsicJobInterval(m_asicJobIntervalMs);
+    m_fanInvertPolarity = Config::isFanPolarity(m_fanInvertPolarity);
+    m_flipScreen = Config::isFlipScreenEnabled(m_flipScreen);
+    m_vrFrequency = Config::getVrFrequency(m_defaultVrFrequency);
+}
+
+bool Board::initBoard()
+{
+    m_chipTemps = new float[m_asicCount]();
+    return true;
+}
+
+void Board::setChipTemp(int nr, float temp)
+{
+    if (nr < 0 || nr >= m_asicCount) {
+        return;
+    }
+    m_chipTemps[nr] = temp;
+}
+
+float Board::getChipTemp(int nr)
+{
+    if (nr < 0 || nr >= m_asicCount) {
+        return 0.0f;
+    }
+    return m_chipTemps[nr];
+}
+
+void Board::requestChipTemps()
+{
+    // NOP
+}
+
+float Board::getMaxChipTemp()
+{
+    float maxTemp = 0.0f;
+    for (int i = 0; i < m_asicCount; i++) {
+        maxTemp = std::max(maxTemp, m_chipTemps[i]);
+    }
+    return maxTemp;
+}
+
+const char *Board::getDeviceModel()
+{
+    return m_deviceModel;
+}
+
+const char *Board::getMiningAgent()
+{
+    return m_miningAgent;
+}
+
+int Board::getVersion()
+{
+    return m_version;
+}
+
+const char *Board::getAsicModel()
+{
+    return m_asicModel;
+}
+
+int Board::getAsicCount()
+{
+    return m_asicCount;
+}
+
+int Board::getAsicJobIntervalMs()
+{
+    return m_asicJobIntervalMs;
+}
+
+bool Board::selfTest()
+{
+    return false;
+}
+
+bool Board::setAsicFrequency(float frequency)
+{
+    if (!validateFrequency(frequency)) {
+        return false;
+    }
+    if (!m_asics) {
+        return false;
+    }
+    return m_asics->setAsicFrequency(frequency);
+}
+
+void Board::setAsicSettings(int frequency, int voltageMillis)
+{
+    if (m_absMaxAsicFrequency) {
+        frequency = std::min(frequency, m_absMaxAsicFrequency);
+    }
+    if (m_absMaxAsicVoltageMillis) {
+        voltageMillis = std::min(voltageMillis, m_absMaxAsicVoltageMillis);
+    }
+    m_asicFrequency = frequency;
+    m_asicVoltageMillis = voltageMillis;
+}
+
+void Board::setVrFrequency(uint32_t freq)
+{
+    if (!m_asics) {
+        return;
+    }
+    m_asics->setVrFrequency(freq);
+}
+
+bool Board::validateVoltage(float core_voltage)
+{
+    int millis = (int) (core_voltage * 1000.0f);
+    return !(m_absMaxAsicVoltageMillis && millis > m_absMaxAsicVoltageMillis);
+}
+
+bool Board::validateFrequency(float frequency)
+{
+    return !(m_absMaxAsicFrequency && frequency > (float) m_absMaxAsicFrequency);
+}
+
+// Discord alerts are only logged
+bool DiscordAlerter::sendWatchdogAlert()
+{
+    ESP_LOGW(TAG, "discord: watchdog alert");
+    return true;
+}
+
+bool DiscordAlerter::sendBlockFoundAlert(double diff, double networkDiff)
+{
+    ESP_LOGW(TAG, "discord: block found %.0f / %.0f", diff, networkDiff);
+    return true;
+}
+
+bool DiscordAlerter::sendBestDifficultyAlert(double diff, double networkDiff)
+{
+    return true;
+}
+
+bool DiscordAlerter::sendCoinbaseVerifyFailed(int pool, const coinbase_result_t *cb, int mode)
+{
+    ESP_LOGW(TAG, "discord: coinbase verification failed on pool %d", pool);
+    return true;
+}
+
+// no ICMP on the host, pings are never sent
+void PingTask::reset()
+{
+}
+
+void PingTask::ping_task()
+{
+}
+
+void PingTask::ping_task_wrapper(void *pvParameters)
+{
+    vTaskDelete(NULL);
+}
+
+double PingTask::get_last_ping_rtt()
+{
+    return 0.0;
+}
+
+double PingTask::get_recent_ping_loss()
+{
+    return 0.0;
+}
+
+// the chips of the simulation have no hash counters to read
+HashrateMonitor::HashrateMonitor()
+{
+}
+
+void HashrateMonitor::onRegisterReply(uint8_t asic_idx, uint32_t counterNow)
+{
+}
+
+// no display to blink
+bool ui_send_identify(uint32_t duration_ms)
+{
+    ESP_LOGW(TAG, "identify");
+    return true;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+// host build: the part of System the mining pipeline uses, shares are
+// counted per chip instead of going into the history
+
+#include <stdint.h>
+
+#include "boards/board.h"
+
+#define DIFF_STRING_SIZE 12 // Maximum size of the difficulty string
+
+class System {
+  protected:
+    Board *m_board = nullptr;
+    Board::Error m_boardError = Board::Error::NONE;
+    uint32_t m_errorCode = 0;
+
+    static constexpr int MAX_CHIPS = 256;
+    uint32_t m_shares[MAX_CHIPS] = {};
+    bool m_miningStarted = false;
+
+  public:
+    void setBoard(Board *board)
+    {
+        m_board = board;
+    }
+
+    Board *getBoard()
+    {
+        return m_board;
+    }
+
+    void notifyMiningStarted()
+    {
+        m_miningStarted = true;
+    }
+
+    bool isMiningStarted() const
+    {
+        return m_miningStarted;
+    }
+
+    float getCurrentHashrate()
+    {
+        return 0.0f;
+    }
+
+    void pushShare(int nr, int slave_id = 0)
+    {
+        if (!slave_id && nr >= 0 && nr < MAX_CHIPS) {
+            __atomic_add_fetch(&m_shares[nr], 1, __ATOMIC_RELAXED);
+        }
+    }
+
+    uint32_t getShares(int nr) const
+    {
+        return (nr >= 0 && nr < MAX_CHIPS) ? __atomic_load_n(&m_shares[nr], __ATOMIC_RELAXED) : 0;
+    }
+
+    void setBoardError(Board::Error error, uint32_t code)
+    {
+        m_errorCode = code;
+        m_boardError = error;
+    }
+
+    Board::Error getBoardError() const
+    {
+        return m_boardError;
+    }
+
+    void clearBoardError()
+    {
+        m_errorCode = 0;
+        m_boardError = Board::Error::NONE;
+    }
+};
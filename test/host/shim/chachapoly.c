@@ -0,0 +1,270 @@
+#include <string.h>
+
+#include "mbedtls/chachapoly.h"
+
+// RFC 8439: ChaCha20 with a 32 bit block counter and a 96 bit nonce,
+// Poly1305 in 26 bit limbs. Decrypt authenticates the ciphertext before it
+// is overwritten, so both directions work in place.
+
+#define ROTL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#define QUARTER(a, b, c, d)                                                                                            \
+    do {                                                                                                               \
+        a += b;                                                                                                        \
+        d = ROTL(d ^ a, 16);                                                                                           \
+        c += d;                                                                                                        \
+        b = ROTL(b ^ c, 12);                                                                                           \
+        a += b;                                                                                                        \
+        d = ROTL(d ^ a, 8);                                                                                            \
+        c += d;                                                                                                        \
+        b = ROTL(b ^ c, 7);                                                                                            \
+    } while (0)
+
+static uint32_t le32(const uint8_t *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = (uint8_t) v;
+    p[1] = (uint8_t) (v >> 8);
+    p[2] = (uint8_t) (v >> 16);
+    p[3] = (uint8_t) (v >> 24);
+}
+
+static void chacha20_block(const uint32_t key[8], uint32_t counter, const uint8_t nonce[12], uint8_t out[64])
+{
+    uint32_t in[16] = {0x61707865, 0x3320646e, 0x79622d32, 0x6b206574};
+    memcpy(in + 4, key, 32);
+    in[12] = counter;
+    in[13] = le32(nonce);
+    in[14] = le32(nonce + 4);
+    in[15] = le32(nonce + 8);
+
+    uint32_t x[16];
+    memcpy(x, in, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        QUARTER(x[0], x[4], x[8], x[12]);
+        QUARTER(x[1], x[5], x[9], x[13]);
+        QUARTER(x[2], x[6], x[10], x[14]);
+        QUARTER(x[3], x[7], x[11], x[15]);
+        QUARTER(x[0], x[5], x[10], x[15]);
+        QUARTER(x[1], x[6], x[11], x[12]);
+        QUARTER(x[2], x[7], x[8], x[13]);
+        QUARTER(x[3], x[4], x[9], x[14]);
+    }
+    for (int i = 0; i < 16; i++) {
+        put_le32(out + 4 * i, x[i] + in[i]);
+    }
+}
+
+static void chacha20_xor(const uint32_t key[8], uint32_t counter, const uint8_t nonce[12], const uint8_t *in,
+                         uint8_t *out, size_t len)
+{
+    uint8_t block[64];
+    while (len) {
+        chacha20_block(key, counter++, nonce, block);
+        size_t n = len < 64 ? len : 64;
+        for (size_t i = 0; i < n; i++) {
+            out[i] = in[i] ^ block[i];
+        }
+        in += n;
+        out += n;
+        len -= n;
+    }
+}
+
+typedef struct {
+    uint32_t r[5];
+    uint32_t h[5];
+    uint32_t pad[4];
+} poly1305_t;
+
+static void poly1305_init(poly1305_t *st, const uint8_t key[32])
+{
+    st->r[0] = le32(key) & 0x3ffffff;
+    st->r[1] = (le32(key + 3) >> 2) & 0x3ffff03;
+    st->r[2] = (le32(key + 6) >> 4) & 0x3ffc0ff;
+    st->r[3] = (le32(key + 9) >> 6) & 0x3f03fff;
+    st->r[4] = (le32(key + 12) >> 8) & 0x00fffff;
+    memset(st->h, 0, sizeof(st->h));
+    for (int i = 0; i < 4; i++) {
+        st->pad[i] = le32(key + 16 + 4 * i);
+    }
+}
+
+static void poly1305_block(poly1305_t *st, const uint8_t m[16])
+{
+    const uint32_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2], r3 = st->r[3], r4 = st->r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+
+    uint32_t h0 = st->h[0] + (le32(m) & 0x3ffffff);
+    uint32_t h1 = st->h[1] + ((le32(m + 3) >> 2) & 0x3ffffff);
+    uint32_t h2 = st->h[2] + ((le32(m + 6) >> 4) & 0x3ffffff);
+    uint32_t h3 = st->h[3] + ((le32(m + 9) >> 6) & 0x3ffffff);
+    uint32_t h4 = st->h[4] + ((le32(m + 12) >> 8) | (1 << 24));
+
+    uint64_t d0 = (uint64_t) h0 * r0 + (uint64_t) h1 * s4 + (uint64_t) h2 * s3 + (uint64_t) h3 * s2 + (uint64_t) h4 * s1;
+    uint64_t d1 = (uint64_t) h0 * r1 + (uint64_t) h1 * r0 + (uint64_t) h2 * s4 + (uint64_t) h3 * s3 + (uint64_t) h4 * s2;
+    uint64_t d2 = (uint64_t) h0 * r2 + (uint64_t) h1 * r1 + (uint64_t) h2 * r0 + (uint64_t) h3 * s4 + (uint64_t) h4 * s3;
+    uint64_t d3 = (uint64_t) h0 * r3 + (uint64_t) h1 * r2 + (uint64_t) h2 * r1 + (uint64_t) h3 * r0 + (uint64_t) h4 * s4;
+    uint64_t d4 = (uint64_t) h0 * r4 + (uint64_t) h1 * r3 + (uint64_t) h2 * r2 + (uint64_t) h3 * r1 + (uint64_t) h4 * r0;
+
+    uint32_t c = (uint32_t) (d0 >> 26);
+    h0 = (uint32_t) d0 & 0x3ffffff;
+    d1 += c;
+    c = (uint32_t) (d1 >> 26);
+    h1 = (uint32_t) d1 & 0x3ffffff;
+    d2 += c;
+    c = (uint32_t) (d2 >> 26);
+    h2 = (uint32_t) d2 & 0x3ffffff;
+    d3 += c;
+    c = (uint32_t) (d3 >> 26);
+    h3 = (uint32_t) d3 & 0x3ffffff;
+    d4 += c;
+    c = (uint32_t) (d4 >> 26);
+    h4 = (uint32_t) d4 & 0x3ffffff;
+    h0 += c * 5;
+    c = h0 >> 26;
+    h0 &= 0x3ffffff;
+    h1 += c;
+
+    st->h[0] = h0;
+    st->h[1] = h1;
+    st->h[2] = h2;
+    st->h[3] = h3;
+    st->h[4] = h4;
+}
+
+// the AEAD pads aad and ciphertext with zeros to full blocks
+static void poly1305_update_padded(poly1305_t *st, const uint8_t *data, size_t len)
+{
+    while (len >= 16) {
+        poly1305_block(st, data);
+        data += 16;
+        len -= 16;
+    }
+    if (len) {
+        uint8_t block[16] = {0};
+        memcpy(block, data, len);
+        poly1305_block(st, block);
+    }
+}
+
+static void poly1305_finish(poly1305_t *st, uint8_t tag[16])
+{
+    uint32_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], h3 = st->h[3], h4 = st->h[4];
+
+    uint32_t c = h1 >> 26;
+    h1 &= 0x3ffffff;
+    h2 += c;
+    c = h2 >> 26;
+    h2 &= 0x3ffffff;
+    h3 += c;
+    c = h3 >> 26;
+    h3 &= 0x3ffffff;
+    h4 += c;
+    c = h4 >> 26;
+    h4 &= 0x3ffffff;
+    h0 += c * 5;
+    c = h0 >> 26;
+    h0 &= 0x3ffffff;
+    h1 += c;
+
+    // h - p, taken if it doesn't borrow
+    uint32_t g0 = h0 + 5;
+    c = g0 >> 26;
+    g0 &= 0x3ffffff;
+    uint32_t g1 = h1 + c;
+    c = g1 >> 26;
+    g1 &= 0x3ffffff;
+    uint32_t g2 = h2 + c;
+    c = g2 >> 26;
+    g2 &= 0x3ffffff;
+    uint32_t g3 = h3 + c;
+    c = g3 >> 26;
+    g3 &= 0x3ffffff;
+    uint32_t g4 = h4 + c - (1 << 26);
+
+    uint32_t mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+
+    uint32_t w[4] = {h0 | (h1 << 26), (h1 >> 6) | (h2 << 20), (h2 >> 12) | (h3 << 14), (h3 >> 18) | (h4 << 8)};
+    uint64_t f = 0;
+    for (int i = 0; i < 4; i++) {
+        f = (uint64_t) w[i] + st->pad[i] + (f >> 32);
+        put_le32(tag + 4 * i, (uint32_t) f);
+    }
+}
+
+static void compute_tag(const uint32_t key[8], const uint8_t nonce[12], const uint8_t *aad, size_t aad_len,
+                        const uint8_t *ciphertext, size_t len, uint8_t tag[16])
+{
+    uint8_t block[64];
+    chacha20_block(key, 0, nonce, block);
+
+    poly1305_t st;
+    poly1305_init(&st, block);
+    poly1305_update_padded(&st, aad, aad_len);
+    poly1305_update_padded(&st, ciphertext, len);
+
+    uint8_t lengths[16];
+    put_le32(lengths, (uint32_t) aad_len);
+    put_le32(lengths + 4, (uint32_t) ((uint64_t) aad_len >> 32));
+    put_le32(lengths + 8, (uint32_t) len);
+    put_le32(lengths + 12, (uint32_t) ((uint64_t) len >> 32));
+    poly1305_block(&st, lengths);
+    poly1305_finish(&st, tag);
+}
+
+void mbedtls_chachapoly_init(mbedtls_chachapoly_context *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_chachapoly_free(mbedtls_chachapoly_context *ctx)
+{
+    if (ctx) {
+        memset(ctx, 0, sizeof(*ctx));
+    }
+}
+
+int mbedtls_chachapoly_setkey(mbedtls_chachapoly_context *ctx, const unsigned char key[32])
+{
+    for (int i = 0; i < 8; i++) {
+        ctx->key[i] = le32(key + 4 * i);
+    }
+    return 0;
+}
+
+int mbedtls_chachapoly_encrypt_and_tag(mbedtls_chachapoly_context *ctx, size_t length, const unsigned char nonce[12],
+                                       const unsigned char *aad, size_t aad_len, const unsigned char *input,
+                                       unsigned char *output, unsigned char tag[16])
+{
+    chacha20_xor(ctx->key, 1, nonce, input, output, length);
+    compute_tag(ctx->key, nonce, aad, aad_len, output, length, tag);
+    return 0;
+}
+
+int mbedtls_chachapoly_auth_decrypt(mbedtls_chachapoly_context *ctx, size_t length, const unsigned char nonce[12],
+                                    const unsigned char *aad, size_t aad_len, const unsigned char tag[16],
+                                    const unsigned char *input, unsigned char *output)
+{
+    uint8_t expected[16];
+    compute_tag(ctx->key, nonce, aad, aad_len, input, length, expected);
+
+    uint8_t diff = 0;
+    for (int i = 0; i < 16; i++) {
+        diff |= expected[i] ^ tag[i];
+    }
+    if (diff) {
+        return MBEDTLS_ERR_CHACHAPOLY_AUTH_FAILED;
+    }
+    chacha20_xor(ctx->key, 1, nonce, input, output, length);
+    return 0;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+// newlib's byte swap macros on top of the glibc header
+
+#include_next <endian.h>
+#include <byteswap.h>
+
+#ifndef __bswap16
+#define __bswap16(x) bswap_16(x)
+#endif
+#ifndef __bswap32
+#define __bswap32(x) bswap_32(x)
+#endif
+#ifndef __bswap64
+#define __bswap64(x) bswap_64(x)
+#endif
@@ -0,0 +1,4 @@
+#pragma once
+
+// the app description, esp_app_get_description() is in esp_ota_ops.h of the host build
+#include "esp_ota_ops.h"
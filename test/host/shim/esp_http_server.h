@@ -0,0 +1,5 @@
+#pragma once
+
+// main/guards.h only needs the HTTP client handle from here
+
+#include "esp_http_client.h"
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef enum {
+    ESP_MAC_WIFI_STA,
+    ESP_MAC_WIFI_SOFTAP,
+    ESP_MAC_BT,
+    ESP_MAC_ETH,
+} esp_mac_type_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// all types return the same address, 02:00:00:00:00:00 until the host sets one
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+
+// host only: the MAC of this process, each simulated CAN node has its own
+void host_set_mac(const uint8_t mac[6]);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,15 @@
+#pragma once
+
+typedef struct {
+    char version[32];
+    char project_name[32];
+    char time[16];
+    char date[16];
+    char idf_ver[32];
+} esp_app_desc_t;
+
+static inline const esp_app_desc_t *esp_app_get_description(void)
+{
+    static const esp_app_desc_t desc = {"host", "nerdqaxe-host", "00:00:00", "Jan 1 1970", "host"};
+    return &desc;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+
+typedef void (*shutdown_handler_t)(void);
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handle);
+void esp_restart(void);
+uint32_t esp_get_free_heap_size(void);
+
+#ifdef __cplusplus
+}
+#endif
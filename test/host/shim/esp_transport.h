@@ -0,0 +1,41 @@
+#pragma once
+
+// plain TCP over POSIX sockets, TLS is not available on the host
+
+#include <stdbool.h>
+
+#include "esp_err.h"
+
+typedef struct host_transport *esp_transport_handle_t;
+
+typedef struct {
+    bool keep_alive_enable;
+    int keep_alive_idle;
+    int keep_alive_interval;
+    int keep_alive_count;
+} esp_transport_keep_alive_t;
+
+typedef enum {
+    ERR_TCP_TRANSPORT_NO_MEM = -3,
+    ERR_TCP_TRANSPORT_CONNECTION_FAILED = -2,
+    ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN = -1,
+    ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT = 0,
+} esp_tcp_transport_err_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int esp_transport_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms);
+int esp_transport_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms);
+int esp_transport_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms);
+int esp_transport_poll_read(esp_transport_handle_t t, int timeout_ms);
+int esp_transport_poll_write(esp_transport_handle_t t, int timeout_ms);
+int esp_transport_close(esp_transport_handle_t t);
+esp_err_t esp_transport_destroy(esp_transport_handle_t t);
+int esp_transport_get_errno(esp_transport_handle_t t);
+int esp_transport_get_socket(esp_transport_handle_t t);
+
+#ifdef __cplusplus
+}
+#endif
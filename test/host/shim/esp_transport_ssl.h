@@ -0,0 +1,17 @@
+#pragma once
+
+#include "esp_transport.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// returns NULL, pools with TLS can't be used from the host build
+esp_transport_handle_t esp_transport_ssl_init(void);
+void esp_transport_ssl_crt_bundle_attach(esp_transport_handle_t t, esp_err_t (*crt_bundle_attach)(void *conf));
+void esp_transport_ssl_set_common_name(esp_transport_handle_t t, const char *common_name);
+void esp_transport_ssl_set_keep_alive(esp_transport_handle_t t, esp_transport_keep_alive_t *keep_alive_cfg);
+
+#ifdef __cplusplus
+}
+#endif
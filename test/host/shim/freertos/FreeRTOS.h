@@ -0,0 +1,66 @@
+#pragma once
+
+// FreeRTOS on pthreads for the host build, one tick is one millisecond
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sdkconfig.h"
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef uint8_t StackType_t;
+
+typedef struct host_task *TaskHandle_t;
+typedef struct host_queue *QueueHandle_t;
+typedef struct host_queue *SemaphoreHandle_t;
+typedef struct host_rtos_timer *TimerHandle_t;
+
+typedef void (*TaskFunction_t)(void *);
+
+typedef struct {
+    int unused;
+} StaticTask_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define errCOULD_NOT_ALLOCATE_REQUIRED_MEMORY (-1)
+
+#define portMAX_DELAY ((TickType_t) 0xffffffff)
+#define portTICK_PERIOD_MS 1
+#define configTICK_RATE_HZ 1000
+#define tskIDLE_PRIORITY 0
+#define tskNO_AFFINITY 0x7fffffff
+
+#define pdMS_TO_TICKS(ms) ((TickType_t) (ms))
+#define pdTICKS_TO_MS(ticks) ((uint32_t) (ticks))
+
+typedef struct {
+    pthread_mutex_t mutex;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {PTHREAD_MUTEX_INITIALIZER}
+#define portENTER_CRITICAL(mux) pthread_mutex_lock(&(mux)->mutex)
+#define portEXIT_CRITICAL(mux) pthread_mutex_unlock(&(mux)->mutex)
+#define portENTER_CRITICAL_ISR(mux) portENTER_CRITICAL(mux)
+#define portEXIT_CRITICAL_ISR(mux) portEXIT_CRITICAL(mux)
+#define taskENTER_CRITICAL(mux) portENTER_CRITICAL(mux)
+#define taskEXIT_CRITICAL(mux) portEXIT_CRITICAL(mux)
+
+#define configASSERT(x) ((void) 0)
+
+#ifndef MIN
+#define MIN(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef MAX
+#define MAX(a, b) (((a) > (b)) ? (a) : (b))
+#endif
+#ifndef BIT0
+#define BIT0 0x00000001
+#define BIT1 0x00000002
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "queue.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// semaphores are queues of empty items, like in FreeRTOS
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem);
+
+#ifdef __cplusplus
+}
+#endif
+
+#define vSemaphoreDelete(sem) vQueueDelete(sem)
+#define xSemaphoreGiveFromISR(sem, woken) xSemaphoreGive(sem)
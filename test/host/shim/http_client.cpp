@@ -0,0 +1,407 @@
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+
+#include "esp_http_client.h"
+#include "esp_log.h"
+
+static const char *TAG = "http-client";
+
+struct esp_http_client {
+    std::string host;
+    int port;
+    std::string path; // with the query
+    esp_http_client_method_t method;
+    int timeoutMs;
+    bool keepAlive; // TCP keep-alive probes, the connection is reused anyway
+    http_event_handle_cb handler;
+    void *userData;
+
+    std::string headers; // "key: value\r\n" each
+    std::string postData;
+
+    int fd = -1;
+    std::string rx; // received, not yet consumed
+    int status = 0;
+    int64_t contentLength = -1;
+    int64_t bodyLeft = 0;
+    bool serverCloses = false;
+};
+
+static const char *method_name(esp_http_client_method_t method)
+{
+    static const char *names[] = {"GET", "POST", "PUT", "PATCH", "DELETE", "HEAD"};
+    return (method >= HTTP_METHOD_GET && method <= HTTP_METHOD_HEAD) ? names[method] : "GET";
+}
+
+static void emit(esp_http_client_handle_t client, esp_http_client_event_id_t id, const void *data = NULL, int len = 0)
+{
+    if (!client->handler) {
+        return;
+    }
+    esp_http_client_event_t evt = {};
+    evt.event_id = id;
+    evt.client = client;
+    evt.data = (void *) data;
+    evt.data_len = len;
+    evt.user_data = client->userData;
+    client->handler(&evt);
+}
+
+// http://host[:port][/path]
+static bool parse_url(esp_http_client_handle_t client, const char *url)
+{
+    const char *p = url;
+    if (!strncmp(p, "http://", 7)) {
+        p += 7;
+    } else if (strstr(p, "://")) {
+        ESP_LOGE(TAG, "only http is supported: %s", url);
+        return false;
+    }
+    const char *slash = strchr(p, '/');
+    std::string hostPort = slash ? std::string(p, slash - p) : std::string(p);
+    client->path = slash ? std::string(slash) : std::string("/");
+
+    size_t colon = hostPort.rfind(':');
+    if (colon != std::string::npos) {
+        client->host = hostPort.substr(0, colon);
+        client->port = atoi(hostPort.c_str() + colon + 1);
+    } else {
+        client->host = hostPort;
+        client->port = 80;
+    }
+    return !client->host.empty();
+}
+
+static void disconnect(esp_http_client_handle_t client)
+{
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+        emit(client, HTTP_EVENT_DISCONNECTED);
+    }
+    client->rx.clear();
+}
+
+static bool connect_server(esp_http_client_handle_t client)
+{
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *res = NULL;
+    char port[8];
+    snprintf(port, sizeof(port), "%d", client->port);
+    if (getaddrinfo(client->host.c_str(), port, &hints, &res) || !res) {
+        return false;
+    }
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    bool ok = fd >= 0 && !connect(fd, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (!ok) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    if (client->keepAlive) {
+        setsockopt(fd, SOL_SOCKET, SO_KEEPALIVE, &one, sizeof(one));
+    }
+
+    client->fd = fd;
+    client->rx.clear();
+    emit(client, HTTP_EVENT_ON_CONNECTED);
+    return true;
+}
+
+static bool send_all(esp_http_client_handle_t client, const char *data, size_t len)
+{
+    while (len) {
+        ssize_t n = send(client->fd, data, len, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        data += n;
+        len -= n;
+    }
+    return true;
+}
+
+// appends to rx, false on timeout, error or EOF
+static bool receive_more(esp_http_client_handle_t client)
+{
+    struct pollfd pfd = {client->fd, POLLIN, 0};
+    if (poll(&pfd, 1, client->timeoutMs) <= 0) {
+        return false;
+    }
+    char buf[4096];
+    ssize_t n = recv(client->fd, buf, sizeof(buf), 0);
+    if (n <= 0) {
+        return false;
+    }
+    client->rx.append(buf, n);
+    return true;
+}
+
+static bool send_request(esp_http_client_handle_t client, int64_t bodyLen)
+{
+    std::string req = std::string(method_name(client->method)) + " " + client->path + " HTTP/1.1\r\nHost: " +
+                      client->host + "\r\n" + client->headers;
+    if (bodyLen >= 0) {
+        req += "Content-Length: " + std::to_string(bodyLen) + "\r\n";
+    }
+    req += "\r\n";
+    if (!send_all(client, req.data(), req.size())) {
+        return false;
+    }
+    emit(client, HTTP_EVENT_HEADERS_SENT);
+    return true;
+}
+
+// status line and headers, the body stays in rx
+static bool read_headers(esp_http_client_handle_t client)
+{
+    size_t end;
+    while ((end = client->rx.find("\r\n\r\n")) == std::string::npos) {
+        if (!receive_more(client)) {
+            return false;
+        }
+    }
+    std::string head = client->rx.substr(0, end);
+    client->rx.erase(0, end + 4);
+
+    if (head.compare(0, 5, "HTTP/") || head.size() < 12) {
+        return false;
+    }
+    client->status = atoi(head.c_str() + 9);
+    client->contentLength = -1;
+    client->serverCloses = !head.compare(0, 8, "HTTP/1.0");
+
+    size_t pos = head.find("\r\n");
+    while (pos != std::string::npos) {
+        size_t next = head.find("\r\n", pos + 2);
+        std::string line = head.substr(pos + 2, next == std::string::npos ? std::string::npos : next - pos - 2);
+        pos = next;
+
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string key = line.substr(0, colon);
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(' '));
+        if (!strcasecmp(key.c_str(), "Content-Length")) {
+            client->contentLength = atoll(value.c_str());
+        } else if (!strcasecmp(key.c_str(), "Connection")) {
+            client->serverCloses = !strcasecmp(value.c_str(), "close");
+        }
+    }
+
+    // no length: the body ends with the connection
+    if (client->contentLength < 0) {
+        client->serverCloses = true;
+    }
+    client->bodyLeft = (client->method == HTTP_METHOD_HEAD) ? 0 : client->contentLength;
+    return true;
+}
+
+static int read_body(esp_http_client_handle_t client, char *buffer, int len)
+{
+    if (client->bodyLeft == 0) {
+        return 0;
+    }
+    if (client->rx.empty() && !receive_more(client)) {
+        // EOF ends a body without length
+        client->bodyLeft = 0;
+        return client->contentLength < 0 ? 0 : -1;
+    }
+    size_t n = std::min(client->rx.size(), (size_t) len);
+    if (client->bodyLeft > 0) {
+        n = std::min(n, (size_t) client->bodyLeft);
+        client->bodyLeft -= n;
+    }
+    memcpy(buffer, client->rx.data(), n);
+    client->rx.erase(0, n);
+    return (int) n;
+}
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t *config)
+{
+    esp_http_client *client = new esp_http_client();
+    client->port = config->port ? config->port : 80;
+    client->method = config->method;
+    client->timeoutMs = config->timeout_ms ? config->timeout_ms : 5000;
+    client->keepAlive = config->keep_alive_enable;
+    client->handler = config->event_handler;
+    client->userData = config->user_data;
+
+    if (config->url) {
+        if (!parse_url(client, config->url)) {
+            delete client;
+            return NULL;
+        }
+    } else {
+        client->host = config->host ? config->host : "";
+        client->path = config->path ? config->path : "/";
+        if (config->query) {
+            client->path += std::string("?") + config->query;
+        }
+    }
+    return client;
+}
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char *url)
+{
+    std::string host = client->host;
+    int port = client->port;
+    if (!parse_url(client, url)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (host != client->host || port != client->port) {
+        disconnect(client);
+    }
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method)
+{
+    client->method = method;
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char *key, const char *value)
+{
+    client->headers += std::string(key) + ": " + value + "\r\n";
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_set_post_field(esp_http_client_handle_t client, const char *data, int len)
+{
+    client->postData.assign(data, len);
+    return ESP_OK;
+}
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client)
+{
+    return client->status;
+}
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client)
+{
+    return client->contentLength;
+}
+
+esp_err_t esp_http_client_perform(esp_http_client_handle_t client)
+{
+    bool hasBody = client->method != HTTP_METHOD_GET && client->method != HTTP_METHOD_HEAD;
+
+    // a kept connection the server closed in the meantime fails on the first try
+    for (int attempt = 0; attempt < 2; attempt++) {
+        bool reused = client->fd >= 0;
+        if (!reused && !connect_server(client)) {
+            ESP_LOGE(TAG, "connect to %s:%d failed", client->host.c_str(), client->port);
+            emit(client, HTTP_EVENT_ERROR);
+            return ESP_FAIL;
+        }
+
+        client->status = 0;
+        if (send_request(client, hasBody ? (int64_t) client->postData.size() : -1) &&
+            (!hasBody || send_all(client, client->postData.data(), client->postData.size())) &&
+            read_headers(client)) {
+            char buf[1024];
+            int n;
+            while ((n = read_body(client, buf, sizeof(buf))) > 0) {
+                emit(client, HTTP_EVENT_ON_DATA, buf, n);
+            }
+            emit(client, HTTP_EVENT_ON_FINISH);
+            if (n < 0 || client->serverCloses) {
+                disconnect(client);
+            }
+            return n < 0 ? ESP_FAIL : ESP_OK;
+        }
+
+        disconnect(client);
+        if (!reused) {
+            break;
+        }
+    }
+    emit(client, HTTP_EVENT_ERROR);
+    return ESP_FAIL;
+}
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len)
+{
+    if (client->fd < 0 && !connect_server(client)) {
+        return ESP_FAIL;
+    }
+    client->status = 0;
+    if (!send_request(client, write_len)) {
+        disconnect(client);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+int esp_http_client_write(esp_http_client_handle_t client, const char *buffer, int len)
+{
+    return (client->fd >= 0 && send_all(client, buffer, len)) ? len : -1;
+}
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client)
+{
+    if (client->fd < 0 || !read_headers(client)) {
+        return ESP_FAIL;
+    }
+    return client->contentLength < 0 ? 0 : client->contentLength;
+}
+
+int esp_http_client_read(esp_http_client_handle_t client, char *buffer, int len)
+{
+    if (client->fd < 0) {
+        return -1;
+    }
+    return read_body(client, buffer, len);
+}
+
+int esp_http_client_read_response(esp_http_client_handle_t client, char *buffer, int len)
+{
+    int total = 0;
+    while (total < len) {
+        int n = esp_http_client_read(client, buffer + total, len - total);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client)
+{
+    disconnect(client);
+    return ESP_OK;
+}
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client)
+{
+    if (client) {
+        disconnect(client);
+        delete client;
+    }
+    return ESP_OK;
+}
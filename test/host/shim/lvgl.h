@@ -0,0 +1,8 @@
+#pragma once
+
+// the board headers only keep image pointers
+typedef struct {
+    const void *data;
+} lv_img_dsc_t;
+
+#define LV_IMG_DECLARE(var_name) extern const lv_img_dsc_t var_name
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#define IP4ADDR_STRLEN_MAX 16
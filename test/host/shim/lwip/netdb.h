@@ -0,0 +1,5 @@
+#pragma once
+
+#include <netdb.h>
+
+#include "sockets.h"
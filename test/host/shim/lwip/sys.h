@@ -0,0 +1,8 @@
+#pragma once
+
+// lwip/sys.h pulls in FreeRTOS through arch/sys_arch.h
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
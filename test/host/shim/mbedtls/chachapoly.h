@@ -0,0 +1,34 @@
+#pragma once
+
+// the subset of the mbedtls ChaCha20-Poly1305 API the Noise transport uses,
+// portable C (RFC 8439)
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MBEDTLS_ERR_CHACHAPOLY_BAD_STATE -0x0054
+#define MBEDTLS_ERR_CHACHAPOLY_AUTH_FAILED -0x0056
+
+typedef struct {
+    uint32_t key[8];
+} mbedtls_chachapoly_context;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mbedtls_chachapoly_init(mbedtls_chachapoly_context *ctx);
+void mbedtls_chachapoly_free(mbedtls_chachapoly_context *ctx);
+int mbedtls_chachapoly_setkey(mbedtls_chachapoly_context *ctx, const unsigned char key[32]);
+
+// input and output may be the same buffer
+int mbedtls_chachapoly_encrypt_and_tag(mbedtls_chachapoly_context *ctx, size_t length, const unsigned char nonce[12],
+                                       const unsigned char *aad, size_t aad_len, const unsigned char *input,
+                                       unsigned char *output, unsigned char tag[16]);
+int mbedtls_chachapoly_auth_decrypt(mbedtls_chachapoly_context *ctx, size_t length, const unsigned char nonce[12],
+                                    const unsigned char *aad, size_t aad_len, const unsigned char tag[16],
+                                    const unsigned char *input, unsigned char *output);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,40 @@
+#pragma once
+
+// the subset of the mbedtls message digest API the Noise handshake uses:
+// HMAC-SHA256 over the SHA-256 of sha256.c
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "mbedtls/sha256.h"
+
+#define MBEDTLS_ERR_MD_BAD_INPUT_DATA -0x5100
+
+typedef enum {
+    MBEDTLS_MD_NONE = 0,
+    MBEDTLS_MD_SHA256 = 9,
+} mbedtls_md_type_t;
+
+typedef struct mbedtls_md_info_t mbedtls_md_info_t;
+
+typedef struct {
+    const mbedtls_md_info_t *md_info;
+    mbedtls_sha256_context sha;
+    uint8_t opad[64];
+} mbedtls_md_context_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t md_type);
+void mbedtls_md_init(mbedtls_md_context_t *ctx);
+void mbedtls_md_free(mbedtls_md_context_t *ctx);
+int mbedtls_md_setup(mbedtls_md_context_t *ctx, const mbedtls_md_info_t *md_info, int hmac);
+int mbedtls_md_hmac_starts(mbedtls_md_context_t *ctx, const unsigned char *key, size_t keylen);
+int mbedtls_md_hmac_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t ilen);
+int mbedtls_md_hmac_finish(mbedtls_md_context_t *ctx, unsigned char *output);
+
+#ifdef __cplusplus
+}
+#endif
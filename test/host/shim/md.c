@@ -0,0 +1,84 @@
+#include <string.h>
+
+#include "mbedtls/md.h"
+
+// RFC 2104 with SHA-256, the only digest the firmware asks for
+
+struct mbedtls_md_info_t {
+    mbedtls_md_type_t type;
+};
+
+static const mbedtls_md_info_t sha256_info = {MBEDTLS_MD_SHA256};
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t md_type)
+{
+    return md_type == MBEDTLS_MD_SHA256 ? &sha256_info : NULL;
+}
+
+void mbedtls_md_init(mbedtls_md_context_t *ctx)
+{
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void mbedtls_md_free(mbedtls_md_context_t *ctx)
+{
+    if (ctx) {
+        memset(ctx, 0, sizeof(*ctx));
+    }
+}
+
+int mbedtls_md_setup(mbedtls_md_context_t *ctx, const mbedtls_md_info_t *md_info, int hmac)
+{
+    if (!md_info || !hmac) {
+        return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    }
+    ctx->md_info = md_info;
+    return 0;
+}
+
+int mbedtls_md_hmac_starts(mbedtls_md_context_t *ctx, const unsigned char *key, size_t keylen)
+{
+    if (!ctx->md_info) {
+        return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    }
+
+    uint8_t k[64] = {0};
+    if (keylen > sizeof(k)) {
+        mbedtls_sha256(key, keylen, k, 0);
+    } else {
+        memcpy(k, key, keylen);
+    }
+
+    uint8_t ipad[64];
+    for (int i = 0; i < 64; i++) {
+        ipad[i] = k[i] ^ 0x36;
+        ctx->opad[i] = k[i] ^ 0x5c;
+    }
+    mbedtls_sha256_init(&ctx->sha);
+    mbedtls_sha256_starts(&ctx->sha, 0);
+    mbedtls_sha256_update(&ctx->sha, ipad, sizeof(ipad));
+    return 0;
+}
+
+int mbedtls_md_hmac_update(mbedtls_md_context_t *ctx, const unsigned char *input, size_t ilen)
+{
+    if (!ctx->md_info) {
+        return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    }
+    return mbedtls_sha256_update(&ctx->sha, input, ilen);
+}
+
+int mbedtls_md_hmac_finish(mbedtls_md_context_t *ctx, unsigned char *output)
+{
+    if (!ctx->md_info) {
+        return MBEDTLS_ERR_MD_BAD_INPUT_DATA;
+    }
+
+    uint8_t inner[32];
+    mbedtls_sha256_finish(&ctx->sha, inner);
+
+    mbedtls_sha256_starts(&ctx->sha, 0);
+    mbedtls_sha256_update(&ctx->sha, ctx->opad, sizeof(ctx->opad));
+    mbedtls_sha256_update(&ctx->sha, inner, sizeof(inner));
+    return mbedtls_sha256_finish(&ctx->sha, output);
+}
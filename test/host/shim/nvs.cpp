@@ -0,0 +1,213 @@
+#include <pthread.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "nvs.h"
+
+namespace
+{
+
+struct Value {
+    nvs_type_t type;
+    uint64_t number;
+    std::string bytes;
+};
+
+// namespace -> key -> value, handles are indices into s_namespaces
+pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+std::vector<std::string> s_namespaces;
+std::map<std::string, std::map<std::string, Value>> s_store;
+
+struct Lock {
+    Lock() { pthread_mutex_lock(&s_mutex); }
+    ~Lock() { pthread_mutex_unlock(&s_mutex); }
+};
+
+std::map<std::string, Value> *space(nvs_handle_t handle)
+{
+    if (handle == 0 || handle > s_namespaces.size()) {
+        return nullptr;
+    }
+    return &s_store[s_namespaces[handle - 1]];
+}
+
+const Value *find(nvs_handle_t handle, const char *key, nvs_type_t type)
+{
+    std::map<std::string, Value> *values = space(handle);
+    if (!values) {
+        return nullptr;
+    }
+    auto it = values->find(key);
+    return (it != values->end() && it->second.type == type) ? &it->second : nullptr;
+}
+
+esp_err_t store(nvs_handle_t handle, const char *key, Value value)
+{
+    std::map<std::string, Value> *values = space(handle);
+    if (!values) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    (*values)[key] = value;
+    return ESP_OK;
+}
+
+esp_err_t get_bytes(nvs_handle_t handle, const char *key, nvs_type_t type, void *out, size_t *length)
+{
+    Lock lock;
+    const Value *value = find(handle, key, type);
+    if (!value) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    // strings are reported with their terminating zero
+    size_t size = value->bytes.size() + (type == NVS_TYPE_STR ? 1 : 0);
+    if (out) {
+        if (*length < size) {
+            return ESP_ERR_INVALID_SIZE;
+        }
+        memcpy(out, value->bytes.c_str(), size);
+    }
+    *length = size;
+    return ESP_OK;
+}
+
+} // namespace
+
+struct host_nvs_iterator {
+    std::vector<nvs_entry_info_t> entries;
+    size_t pos;
+};
+
+esp_err_t nvs_open(const char *name, nvs_open_mode_t mode, nvs_handle_t *out_handle)
+{
+    Lock lock;
+    if (mode == NVS_READONLY && !s_store.count(name)) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    s_store[name];
+    for (size_t i = 0; i < s_namespaces.size(); i++) {
+        if (s_namespaces[i] == name) {
+            *out_handle = (nvs_handle_t) i + 1;
+            return ESP_OK;
+        }
+    }
+    s_namespaces.push_back(name);
+    *out_handle = (nvs_handle_t) s_namespaces.size();
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle) {}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    Lock lock;
+    std::map<std::string, Value> *values = space(handle);
+    return (values && values->erase(key)) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_get_u16(nvs_handle_t handle, const char *key, uint16_t *out)
+{
+    Lock lock;
+    const Value *value = find(handle, key, NVS_TYPE_U16);
+    if (!value) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *out = (uint16_t) value->number;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_u64(nvs_handle_t handle, const char *key, uint64_t *out)
+{
+    Lock lock;
+    const Value *value = find(handle, key, NVS_TYPE_U64);
+    if (!value) {
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *out = value->number;
+    return ESP_OK;
+}
+
+esp_err_t nvs_get_str(nvs_handle_t handle, const char *key, char *out, size_t *length)
+{
+    return get_bytes(handle, key, NVS_TYPE_STR, out, length);
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out, size_t *length)
+{
+    return get_bytes(handle, key, NVS_TYPE_BLOB, out, length);
+}
+
+esp_err_t nvs_set_u16(nvs_handle_t handle, const char *key, uint16_t value)
+{
+    Lock lock;
+    return store(handle, key, {NVS_TYPE_U16, value, {}});
+}
+
+esp_err_t nvs_set_u64(nvs_handle_t handle, const char *key, uint64_t value)
+{
+    Lock lock;
+    return store(handle, key, {NVS_TYPE_U64, value, {}});
+}
+
+esp_err_t nvs_set_str(nvs_handle_t handle, const char *key, const char *value)
+{
+    Lock lock;
+    return store(handle, key, {NVS_TYPE_STR, 0, value});
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    Lock lock;
+    return store(handle, key, {NVS_TYPE_BLOB, 0, std::string((const char *) value, length)});
+}
+
+esp_err_t nvs_entry_find(const char *part, const char *namespace_name, nvs_type_t type, nvs_iterator_t *it)
+{
+    Lock lock;
+    host_nvs_iterator *iter = new host_nvs_iterator{{}, 0};
+    for (auto &entry : s_store[namespace_name]) {
+        if (type != NVS_TYPE_ANY && entry.second.type != type) {
+            continue;
+        }
+        nvs_entry_info_t info = {};
+        strncpy(info.namespace_name, namespace_name, sizeof(info.namespace_name) - 1);
+        strncpy(info.key, entry.first.c_str(), sizeof(info.key) - 1);
+        info.type = entry.second.type;
+        iter->entries.push_back(info);
+    }
+    if (iter->entries.empty()) {
+        delete iter;
+        *it = nullptr;
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    *it = iter;
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_next(nvs_iterator_t *it)
+{
+    if (!*it || ++(*it)->pos >= (*it)->entries.size()) {
+        nvs_release_iterator(*it);
+        *it = nullptr;
+        return ESP_ERR_NVS_NOT_FOUND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t nvs_entry_info(nvs_iterator_t it, nvs_entry_info_t *info)
+{
+    *info = it->entries[it->pos];
+    return ESP_OK;
+}
+
+void nvs_release_iterator(nvs_iterator_t it)
+{
+    delete it;
+}
@@ -0,0 +1,590 @@
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "esp_log.h"
+#include "esp_mac.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+#include "freertos/timers.h"
+
+// ============================================================================
+// time
+// ============================================================================
+
+static int64_t monotonic_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t s_startUs = monotonic_us();
+
+int64_t esp_timer_get_time(void)
+{
+    return monotonic_us() - s_startUs;
+}
+
+static void deadline_after(struct timespec *ts, TickType_t ticks)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (long) (ticks % 1000) * 1000000;
+    if (ts->tv_nsec >= 1000000000) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000;
+    }
+}
+
+static void cond_init_monotonic(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+// ============================================================================
+// tasks
+// ============================================================================
+
+struct host_task {
+    TaskFunction_t fn;
+    void *arg;
+    pthread_t thread;
+};
+
+static void *task_entry(void *p)
+{
+    host_task *task = (host_task *) p;
+    task->fn(task->arg);
+    return nullptr;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                       TaskHandle_t *handle)
+{
+    host_task *task = new host_task{fn, arg, {}};
+    if (pthread_create(&task->thread, nullptr, task_entry, task)) {
+        delete task;
+        return pdFAIL;
+    }
+    pthread_detach(task->thread);
+    if (handle) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char *name, uint32_t stack, void *arg,
+                                   UBaseType_t prio, TaskHandle_t *handle, BaseType_t core)
+{
+    return xTaskCreate(fn, name, stack, arg, prio, handle);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t fn, const char *name, uint32_t stack, void *arg, UBaseType_t prio,
+                               StackType_t *stack_buf, StaticTask_t *tcb)
+{
+    TaskHandle_t handle = nullptr;
+    xTaskCreate(fn, name, stack, arg, prio, &handle);
+    return handle;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    struct timespec ts = {(time_t) (ticks / 1000), (long) (ticks % 1000) * 1000000};
+    while (nanosleep(&ts, &ts) && errno == EINTR) {
+    }
+}
+
+void vTaskDelayUntil(TickType_t *previous, TickType_t increment)
+{
+    *previous += increment;
+    int32_t wait = (int32_t) (*previous - xTaskGetTickCount());
+    if (wait > 0) {
+        vTaskDelay((TickType_t) wait);
+    }
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t) (esp_timer_get_time() / 1000);
+}
+
+void vTaskSuspend(TaskHandle_t task)
+{
+    while (true) {
+        pause();
+    }
+}
+
+void vTaskDelete(TaskHandle_t task)
+{
+    pthread_exit(nullptr);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return nullptr;
+}
+
+// ============================================================================
+// queues and semaphores
+// ============================================================================
+
+struct host_queue {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t changed;
+    uint8_t *items;
+    UBaseType_t length;
+    UBaseType_t itemSize;
+    UBaseType_t head = 0;
+    UBaseType_t count = 0;
+};
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    host_queue *q = new host_queue;
+    cond_init_monotonic(&q->changed);
+    q->length = length;
+    q->itemSize = item_size;
+    q->items = (uint8_t *) calloc(length, item_size ? item_size : 1);
+    return q;
+}
+
+void vQueueDelete(QueueHandle_t q)
+{
+    if (q) {
+        free(q->items);
+        delete q;
+    }
+}
+
+// waits while pred is true, false on timeout
+template <typename Pred> static bool queue_wait(host_queue *q, TickType_t wait, Pred pred)
+{
+    struct timespec deadline;
+    deadline_after(&deadline, wait);
+    while (pred()) {
+        if (!wait) {
+            return false;
+        }
+        if (wait == portMAX_DELAY) {
+            pthread_cond_wait(&q->changed, &q->mutex);
+        } else if (pthread_cond_timedwait(&q->changed, &q->mutex, &deadline) == ETIMEDOUT) {
+            return !pred();
+        }
+    }
+    return true;
+}
+
+static BaseType_t queue_send(QueueHandle_t q, const void *item, TickType_t wait, bool front)
+{
+    pthread_mutex_lock(&q->mutex);
+    if (!queue_wait(q, wait, [q] { return q->count == q->length; })) {
+        pthread_mutex_unlock(&q->mutex);
+        return pdFAIL;
+    }
+    UBaseType_t slot;
+    if (front) {
+        q->head = (q->head + q->length - 1) % q->length;
+        slot = q->head;
+    } else {
+        slot = (q->head + q->count) % q->length;
+    }
+    if (q->itemSize) {
+        memcpy(q->items + slot * q->itemSize, item, q->itemSize);
+    }
+    q->count++;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->mutex);
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t q, const void *item, TickType_t wait)
+{
+    return queue_send(q, item, wait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t q, const void *item, TickType_t wait)
+{
+    return queue_send(q, item, wait, true);
+}
+
+static BaseType_t queue_receive(QueueHandle_t q, void *item, TickType_t wait, bool remove)
+{
+    pthread_mutex_lock(&q->mutex);
+    if (!queue_wait(q, wait, [q] { return q->count == 0; })) {
+        pthread_mutex_unlock(&q->mutex);
+        return pdFAIL;
+    }
+    if (q->itemSize && item) {
+        memcpy(item, q->items + q->head * q->itemSize, q->itemSize);
+    }
+    if (remove) {
+        q->head = (q->head + 1) % q->length;
+        q->count--;
+        pthread_cond_broadcast(&q->changed);
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return pdPASS;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t q, void *item, TickType_t wait)
+{
+    return queue_receive(q, item, wait, true);
+}
+
+BaseType_t xQueuePeek(QueueHandle_t q, void *item, TickType_t wait)
+{
+    return queue_receive(q, item, wait, false);
+}
+
+BaseType_t xQueueReset(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->mutex);
+    q->head = 0;
+    q->count = 0;
+    pthread_cond_broadcast(&q->changed);
+    pthread_mutex_unlock(&q->mutex);
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t q)
+{
+    pthread_mutex_lock(&q->mutex);
+    UBaseType_t count = q->count;
+    pthread_mutex_unlock(&q->mutex);
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t q)
+{
+    return q->length - uxQueueMessagesWaiting(q);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t max, UBaseType_t initial)
+{
+    SemaphoreHandle_t sem = xQueueCreate(max, 0);
+    sem->count = initial;
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    return xSemaphoreCreateCounting(1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xSemaphoreCreateCounting(1, 0);
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t wait)
+{
+    return xQueueReceive(sem, nullptr, wait);
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem)
+{
+    return xQueueSend(sem, nullptr, 0);
+}
+
+// ============================================================================
+// software timers, FreeRTOS and esp_timer share one service thread
+// ============================================================================
+
+struct host_rtos_timer {
+    TimerCallbackFunction_t callback = nullptr;
+    esp_timer_cb_t espCallback = nullptr;
+    void *id = nullptr;
+    int64_t periodUs = 0;
+    bool autoReload = false;
+    bool active = false;
+    int64_t dueUs = 0;
+};
+
+struct host_timer {
+    host_rtos_timer t;
+};
+
+static pthread_mutex_t s_timerMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_timerCond;
+static std::vector<host_rtos_timer *> s_timers;
+static bool s_timerThreadStarted = false;
+
+static void *timer_service(void *)
+{
+    pthread_mutex_lock(&s_timerMutex);
+    while (true) {
+        int64_t now = esp_timer_get_time();
+        int64_t next = now + 100000;
+        host_rtos_timer *due = nullptr;
+        for (host_rtos_timer *t : s_timers) {
+            if (!t->active) {
+                continue;
+            }
+            if (t->dueUs <= now) {
+                due = t;
+                break;
+            }
+            next = std::min(next, t->dueUs);
+        }
+
+        if (due) {
+            if (due->autoReload) {
+                due->dueUs += due->periodUs;
+                if (due->dueUs < now) {
+                    due->dueUs = now + due->periodUs;
+                }
+            } else {
+                due->active = false;
+            }
+            // callbacks may use the timer API
+            pthread_mutex_unlock(&s_timerMutex);
+            if (due->callback) {
+                due->callback(due);
+            } else {
+                due->espCallback(due->id);
+            }
+            pthread_mutex_lock(&s_timerMutex);
+            continue;
+        }
+
+        struct timespec deadline;
+        deadline_after(&deadline, (TickType_t) ((next - now + 999) / 1000));
+        pthread_cond_timedwait(&s_timerCond, &s_timerMutex, &deadline);
+    }
+    return nullptr;
+}
+
+static void timer_add(host_rtos_timer *t)
+{
+    pthread_mutex_lock(&s_timerMutex);
+    if (!s_timerThreadStarted) {
+        cond_init_monotonic(&s_timerCond);
+        pthread_t thread;
+        pthread_create(&thread, nullptr, timer_service, nullptr);
+        pthread_detach(thread);
+        s_timerThreadStarted = true;
+    }
+    s_timers.push_back(t);
+    pthread_mutex_unlock(&s_timerMutex);
+}
+
+static void timer_arm(host_rtos_timer *t, bool active, int64_t periodUs)
+{
+    pthread_mutex_lock(&s_timerMutex);
+    if (periodUs) {
+        t->periodUs = periodUs;
+    }
+    t->active = active;
+    t->dueUs = esp_timer_get_time() + t->periodUs;
+    pthread_cond_signal(&s_timerCond);
+    pthread_mutex_unlock(&s_timerMutex);
+}
+
+static void timer_remove(host_rtos_timer *t)
+{
+    pthread_mutex_lock(&s_timerMutex);
+    s_timers.erase(std::remove(s_timers.begin(), s_timers.end(), t), s_timers.end());
+    pthread_mutex_unlock(&s_timerMutex);
+}
+
+TimerHandle_t xTimerCreate(const char *name, TickType_t period, UBaseType_t auto_reload, void *id,
+                           TimerCallbackFunction_t callback)
+{
+    host_rtos_timer *t = new host_rtos_timer;
+    t->callback = callback;
+    t->id = id;
+    t->periodUs = (int64_t) period * 1000;
+    t->autoReload = auto_reload;
+    timer_add(t);
+    return t;
+}
+
+BaseType_t xTimerStart(TimerHandle_t timer, TickType_t wait)
+{
+    timer_arm(timer, true, 0);
+    return pdPASS;
+}
+
+BaseType_t xTimerReset(TimerHandle_t timer, TickType_t wait)
+{
+    return xTimerStart(timer, wait);
+}
+
+BaseType_t xTimerStop(TimerHandle_t timer, TickType_t wait)
+{
+    timer_arm(timer, false, 0);
+    return pdPASS;
+}
+
+BaseType_t xTimerChangePeriod(TimerHandle_t timer, TickType_t period, TickType_t wait)
+{
+    // like FreeRTOS this also starts a dormant timer
+    timer_arm(timer, true, (int64_t) period * 1000);
+    return pdPASS;
+}
+
+BaseType_t xTimerDelete(TimerHandle_t timer, TickType_t wait)
+{
+    timer_remove(timer);
+    delete timer;
+    return pdPASS;
+}
+
+BaseType_t xTimerIsTimerActive(TimerHandle_t timer)
+{
+    pthread_mutex_lock(&s_timerMutex);
+    bool active = timer->active;
+    pthread_mutex_unlock(&s_timerMutex);
+    return active ? pdTRUE : pdFALSE;
+}
+
+void *pvTimerGetTimerID(TimerHandle_t timer)
+{
+    return timer->id;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *args, esp_timer_handle_t *out_handle)
+{
+    host_timer *timer = new host_timer;
+    timer->t.espCallback = args->callback;
+    timer->t.id = args->arg;
+    timer_add(&timer->t);
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    timer->t.autoReload = false;
+    timer_arm(&timer->t, true, (int64_t) timeout_us);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us)
+{
+    timer->t.autoReload = true;
+    timer_arm(&timer->t, true, (int64_t) period_us);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    timer_arm(&timer->t, false, 0);
+    return ESP_OK;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    timer_remove(&timer->t);
+    delete timer;
+    return ESP_OK;
+}
+
+// ============================================================================
+// log and system
+// ============================================================================
+
+static esp_log_level_t read_log_level()
+{
+    const char *env = getenv("HOST_LOG_LEVEL");
+    return env ? (esp_log_level_t) atoi(env) : ESP_LOG_WARN;
+}
+
+static esp_log_level_t s_logLevel = read_log_level();
+static pthread_mutex_t s_logMutex = PTHREAD_MUTEX_INITIALIZER;
+
+esp_log_level_t host_log_level(void)
+{
+    return s_logLevel;
+}
+
+void esp_log_level_set(const char *tag, esp_log_level_t level)
+{
+    // one level for all tags
+    s_logLevel = level;
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    static const char letters[] = "NEWIDV";
+    pthread_mutex_lock(&s_logMutex);
+    fprintf(stderr, "%c (%lld) %s: ", letters[level], (long long) (esp_timer_get_time() / 1000), tag);
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+    pthread_mutex_unlock(&s_logMutex);
+}
+
+void esp_log_buffer_hex_internal(const char *tag, const void *buffer, uint16_t len, esp_log_level_t level)
+{
+    if (s_logLevel < level) {
+        return;
+    }
+    char line[3 * 16 + 1];
+    const uint8_t *bytes = (const uint8_t *) buffer;
+    for (uint16_t i = 0; i < len; i += 16) {
+        int n = 0;
+        for (uint16_t j = i; j < len && j < i + 16; j++) {
+            n += snprintf(line + n, sizeof(line) - n, "%02x ", bytes[j]);
+        }
+        esp_log_write(level, tag, "%s", line);
+    }
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    return code == ESP_OK ? "ESP_OK" : "ESP_FAIL";
+}
+
+static std::vector<shutdown_handler_t> s_shutdownHandlers;
+
+esp_err_t esp_register_shutdown_handler(shutdown_handler_t handle)
+{
+    s_shutdownHandlers.push_back(handle);
+    return ESP_OK;
+}
+
+void esp_restart(void)
+{
+    for (shutdown_handler_t handler : s_shutdownHandlers) {
+        handler();
+    }
+    exit(0);
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    return 8 * 1024 * 1024;
+}
+
+static uint8_t s_mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x00};
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    memcpy(mac, s_mac, sizeof(s_mac));
+    return ESP_OK;
+}
+
+void host_set_mac(const uint8_t mac[6])
+{
+    memcpy(s_mac, mac, sizeof(s_mac));
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+// the Kconfig defaults the host build needs, see main/Kconfig.projbuild
+
+#define CONFIG_ESP_WIFI_SSID ""
+#define CONFIG_ESP_WIFI_PASSWORD ""
+#define CONFIG_LWIP_LOCAL_HOSTNAME "nerdqaxe-host"
+
+#define CONFIG_STRATUM_URL ""
+#define CONFIG_STRATUM_PORT 3333
+#define CONFIG_STRATUM_USER "host"
+#define CONFIG_STRATUM_PW "x"
+#define CONFIG_STRATUM_TLS_VALUE 0
+#define CONFIG_STRATUM_ENONCE_SUBSCRIBE_VALUE 0
+#define CONFIG_STRATUM_DIFFICULTY 1000
+#define CONFIG_STRATUM_FALLBACK_URL ""
+#define CONFIG_STRATUM_FALLBACK_PORT 3333
+#define CONFIG_STRATUM_FALLBACK_USER "host"
+#define CONFIG_STRATUM_FALLBACK_PW "x"
+#define CONFIG_STRATUM_FALLBACK_TLS_VALUE 0
+#define CONFIG_STRATUM_FALLBACK_ENONCE_SUBSCRIBE_VALUE 0
+#define CONFIG_STRATUM_KEEPALIVE_ENABLE_VALUE 0
+
+#define CONFIG_FAN_SPEED 100
+// the choice default, nvs_config.h derives CONFIG_AUTO_FAN_SPEED_VALUE from it
+#define CONFIG_FAN_MODE_MANUAL 1
+#define CONFIG_OVERHEAT_TEMP 70
+#define CONFIG_AUTO_SCREEN_OFF_VALUE 0
+#define CONFIG_SHOW_BLOCK_FOUND_ENABLE_VALUE 0
+
+#define CONFIG_INFLUX_ENABLE_VALUE 0
+#define CONFIG_INFLUX_URL ""
+#define CONFIG_INFLUX_PORT 8086
+#define CONFIG_INFLUX_TOKEN ""
+#define CONFIG_INFLUX_BUCKET ""
+#define CONFIG_INFLUX_ORG ""
+#define CONFIG_INFLUX_PREFIX ""
+
+#define CONFIG_ALERT_DISCORD_URL ""
+#define CONFIG_ALERT_DISCORD_WATCHDOG_ENABLE_VALUE 0
+#define CONFIG_ALERT_DISCORD_BLOCK_FOUND_ENABLE_VALUE 0
+#define CONFIG_ALERT_DISCORD_BEST_DIFF_ENABLE_VALUE 0
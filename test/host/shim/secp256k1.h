@@ -0,0 +1,32 @@
+#pragma once
+
+// Stand-in for libsecp256k1 (the submodule sources are not in the tree):
+// the functions the Noise handshake calls, with the types of the library.
+//
+// NOT elliptic curve cryptography. Both sides of an ECDH get the same secret
+// from the two public keys alone and a "signature" is a hash anyone can
+// compute. Good for a loopback test of the handshake messages and the
+// transport, nothing else. See secp256k1.c.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct secp256k1_context_struct secp256k1_context;
+
+typedef struct {
+    unsigned char data[64];
+} secp256k1_pubkey;
+
+#define SECP256K1_CONTEXT_NONE 1
+
+secp256k1_context *secp256k1_context_create(unsigned int flags);
+void secp256k1_context_destroy(secp256k1_context *ctx);
+int secp256k1_context_randomize(secp256k1_context *ctx, const unsigned char *seed32);
+
+#ifdef __cplusplus
+}
+#endif
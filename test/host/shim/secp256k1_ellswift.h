@@ -0,0 +1,30 @@
+#pragma once
+
+// ElligatorSwift part of the secp256k1 stand-in, see secp256k1.h
+
+#include "secp256k1.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef int (*secp256k1_ellswift_xdh_hash_function)(unsigned char *output, const unsigned char *x32,
+                                                    const unsigned char *ell_a64, const unsigned char *ell_b64,
+                                                    void *data);
+
+extern const secp256k1_ellswift_xdh_hash_function secp256k1_ellswift_xdh_hash_function_bip324;
+
+// ell64 = sha256(seckey || 0) || sha256(seckey || 1)
+int secp256k1_ellswift_create(const secp256k1_context *ctx, unsigned char *ell64, const unsigned char *seckey32,
+                              const unsigned char *auxrnd32);
+
+// x = sha256(ell_a64 || ell_b64), the secret key is not used
+int secp256k1_ellswift_xdh(const secp256k1_context *ctx, unsigned char *output, const unsigned char *ell_a64,
+                           const unsigned char *ell_b64, const unsigned char *seckey32, int party,
+                           secp256k1_ellswift_xdh_hash_function hashfp, void *data);
+
+int secp256k1_ellswift_decode(const secp256k1_context *ctx, secp256k1_pubkey *pubkey, const unsigned char *ell64);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,24 @@
+#pragma once
+
+// x-only keys of the secp256k1 stand-in, see secp256k1.h
+
+#include "secp256k1.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+    unsigned char data[64];
+} secp256k1_xonly_pubkey;
+
+int secp256k1_xonly_pubkey_parse(const secp256k1_context *ctx, secp256k1_xonly_pubkey *pubkey,
+                                 const unsigned char *input32);
+int secp256k1_xonly_pubkey_serialize(const secp256k1_context *ctx, unsigned char *output32,
+                                     const secp256k1_xonly_pubkey *pubkey);
+int secp256k1_xonly_pubkey_from_pubkey(const secp256k1_context *ctx, secp256k1_xonly_pubkey *xonly_pubkey,
+                                       int *pk_parity, const secp256k1_pubkey *pubkey);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,21 @@
+#pragma once
+
+// Schnorr signatures of the secp256k1 stand-in, see secp256k1.h
+
+#include "secp256k1_extrakeys.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// sig64 = sha256(pubkey || msg) || 32 zero bytes
+int secp256k1_schnorrsig_verify(const secp256k1_context *ctx, const unsigned char *sig64, const unsigned char *msg,
+                                size_t msglen, const secp256k1_xonly_pubkey *pubkey);
+
+// the signature verify accepts, for the mock pool
+void secp256k1_standin_sign(unsigned char *sig64, const unsigned char *msg, size_t msglen,
+                            const unsigned char *xonly_pubkey32);
+
+#ifdef __cplusplus
+}
+#endif
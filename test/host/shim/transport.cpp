@@ -0,0 +1,156 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "esp_transport.h"
+#include "esp_transport_ssl.h"
+#include "esp_transport_tcp.h"
+
+struct host_transport {
+    int sock;
+    int lastErrno;
+};
+
+esp_transport_handle_t esp_transport_tcp_init(void)
+{
+    return new host_transport{-1, 0};
+}
+
+void esp_transport_tcp_set_keep_alive(esp_transport_handle_t t, esp_transport_keep_alive_t *keep_alive_cfg) {}
+
+esp_transport_handle_t esp_transport_ssl_init(void)
+{
+    return nullptr;
+}
+
+void esp_transport_ssl_crt_bundle_attach(esp_transport_handle_t t, esp_err_t (*crt_bundle_attach)(void *conf)) {}
+void esp_transport_ssl_set_common_name(esp_transport_handle_t t, const char *common_name) {}
+void esp_transport_ssl_set_keep_alive(esp_transport_handle_t t, esp_transport_keep_alive_t *keep_alive_cfg) {}
+
+// -1 with errno on error, 0 on timeout, > 0 when ready
+static int wait_ready(esp_transport_handle_t t, short events, int timeout_ms)
+{
+    struct pollfd pfd = {t->sock, events, 0};
+    int ret;
+    do {
+        ret = poll(&pfd, 1, timeout_ms);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0) {
+        t->lastErrno = errno;
+        return -1;
+    }
+    if (ret > 0 && (pfd.revents & (POLLERR | POLLNVAL))) {
+        t->lastErrno = ECONNRESET;
+        return -1;
+    }
+    return ret;
+}
+
+int esp_transport_connect(esp_transport_handle_t t, const char *host, int port, int timeout_ms)
+{
+    struct addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    struct addrinfo *res = nullptr;
+    char service[8];
+    snprintf(service, sizeof(service), "%d", port);
+    if (getaddrinfo(host, service, &hints, &res) || !res) {
+        t->lastErrno = EHOSTUNREACH;
+        return -1;
+    }
+
+    t->sock = socket(AF_INET, SOCK_STREAM, 0);
+    int ret = t->sock < 0 ? -1 : connect(t->sock, res->ai_addr, res->ai_addrlen);
+    freeaddrinfo(res);
+    if (ret < 0) {
+        t->lastErrno = errno;
+        esp_transport_close(t);
+        return -1;
+    }
+    return 0;
+}
+
+int esp_transport_read(esp_transport_handle_t t, char *buffer, int len, int timeout_ms)
+{
+    int ready = wait_ready(t, POLLIN, timeout_ms);
+    if (ready <= 0) {
+        return ready < 0 ? -1 : ERR_TCP_TRANSPORT_CONNECTION_TIMEOUT;
+    }
+    ssize_t n = recv(t->sock, buffer, len, 0);
+    if (n == 0) {
+        return ERR_TCP_TRANSPORT_CONNECTION_CLOSED_BY_FIN;
+    }
+    if (n < 0) {
+        t->lastErrno = errno;
+        return -2;
+    }
+    return (int) n;
+}
+
+int esp_transport_write(esp_transport_handle_t t, const char *buffer, int len, int timeout_ms)
+{
+    int ready = wait_ready(t, POLLOUT, timeout_ms);
+    if (ready <= 0) {
+        return ready;
+    }
+    ssize_t n = send(t->sock, buffer, len, MSG_NOSIGNAL);
+    if (n < 0) {
+        t->lastErrno = errno;
+        return -1;
+    }
+    return (int) n;
+}
+
+int esp_transport_poll_read(esp_transport_handle_t t, int timeout_ms)
+{
+    return wait_ready(t, POLLIN, timeout_ms);
+}
+
+int esp_transport_poll_write(esp_transport_handle_t t, int timeout_ms)
+{
+    if (t->sock < 0) {
+        return -1;
+    }
+    // a closed peer shows up as POLLHUP with POLLOUT
+    struct pollfd pfd = {t->sock, POLLOUT, 0};
+    if (poll(&pfd, 1, timeout_ms) < 0 || (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+        return -1;
+    }
+    return (pfd.revents & POLLOUT) ? 1 : 0;
+}
+
+int esp_transport_close(esp_transport_handle_t t)
+{
+    if (t->sock >= 0) {
+        close(t->sock);
+        t->sock = -1;
+    }
+    return 0;
+}
+
+esp_err_t esp_transport_destroy(esp_transport_handle_t t)
+{
+    esp_transport_close(t);
+    delete t;
+    return ESP_OK;
+}
+
+int esp_transport_get_errno(esp_transport_handle_t t)
+{
+    int err = t->lastErrno;
+    t->lastErrno = 0;
+    return err;
+}
+
+int esp_transport_get_socket(esp_transport_handle_t t)
+{
+    return t->sock;
+}
@@ -0,0 +1,268 @@
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <deque>
+
+#include "driver/twai.h"
+#include "esp_log.h"
+
+static const char *TAG = "twai";
+
+// ============================================================================
+// driver state, one TWAI controller per process like on the ESP32
+// ============================================================================
+
+static int s_fd = -1;
+static pthread_t s_reader;
+static bool s_readerRunning = false;
+
+static pthread_mutex_t s_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t s_cond;
+
+static bool s_installed = false;
+static twai_state_t s_state = TWAI_STATE_STOPPED;
+static uint32_t s_txQueueLen = 0;
+static uint32_t s_rxQueueLen = 0;
+static uint32_t s_txPending = 0; // sent to the bus, TX_DONE not back yet
+static std::deque<twai_message_t> s_rx;
+static twai_status_info_t s_status = {};
+
+static void deadline_after(struct timespec *ts, uint32_t ticks)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += ticks / 1000;
+    ts->tv_nsec += (long) (ticks % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+// waits on s_cond while pred is true, false on timeout, s_mutex is held
+template <typename Pred> static bool wait_while(Pred pred, uint32_t ticks)
+{
+    if (ticks == 0xffffffff) {
+        while (pred()) {
+            pthread_cond_wait(&s_cond, &s_mutex);
+        }
+        return true;
+    }
+    struct timespec deadline;
+    deadline_after(&deadline, ticks);
+    while (pred()) {
+        if (pthread_cond_timedwait(&s_cond, &s_mutex, &deadline) == ETIMEDOUT) {
+            return !pred();
+        }
+    }
+    return true;
+}
+
+// frames from the bus: received frames of the other nodes and the
+// confirmations of our own
+static void *reader_task(void *arg)
+{
+    host_twai_wire_t wire;
+    for (;;) {
+        ssize_t n = recv(s_fd, &wire, sizeof(wire), 0);
+        if (n <= 0) {
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "virtual bus closed");
+            return NULL;
+        }
+        if (n != sizeof(wire)) {
+            continue;
+        }
+
+        pthread_mutex_lock(&s_mutex);
+        s_status.arb_lost_count = wire.arbLost;
+        if (wire.op == HOST_TWAI_TX_DONE) {
+            if (s_txPending) {
+                s_txPending--;
+            }
+        } else if (wire.op == HOST_TWAI_FRAME && s_installed && s_state == TWAI_STATE_RUNNING) {
+            if (s_rx.size() < s_rxQueueLen) {
+                s_rx.push_back(wire.msg);
+            } else {
+                s_status.rx_missed_count++;
+            }
+        }
+        pthread_cond_broadcast(&s_cond);
+        pthread_mutex_unlock(&s_mutex);
+    }
+}
+
+static bool send_wire(host_twai_op_t op, const twai_message_t *msg)
+{
+    host_twai_wire_t wire = {};
+    wire.op = op;
+    if (msg) {
+        wire.msg = *msg;
+    }
+    return send(s_fd, &wire, sizeof(wire), MSG_NOSIGNAL) == (ssize_t) sizeof(wire);
+}
+
+// ============================================================================
+// driver API
+// ============================================================================
+
+void host_twai_attach(int fd)
+{
+    s_fd = fd;
+}
+
+esp_err_t twai_driver_install(const twai_general_config_t *g_config, const twai_timing_config_t *t_config,
+                              const twai_filter_config_t *f_config)
+{
+    if (s_fd < 0) {
+        ESP_LOGE(TAG, "no virtual bus attached");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    pthread_mutex_lock(&s_mutex);
+    if (s_installed) {
+        pthread_mutex_unlock(&s_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    s_installed = true;
+    s_state = TWAI_STATE_STOPPED;
+    s_txQueueLen = g_config->tx_queue_len;
+    s_rxQueueLen = g_config->rx_queue_len;
+    s_rx.clear();
+    s_status = {};
+    pthread_mutex_unlock(&s_mutex);
+
+    if (!s_readerRunning) {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&s_cond, &attr);
+        pthread_condattr_destroy(&attr);
+
+        s_readerRunning = true;
+        pthread_create(&s_reader, NULL, reader_task, NULL);
+    }
+    return ESP_OK;
+}
+
+esp_err_t twai_driver_uninstall(void)
+{
+    pthread_mutex_lock(&s_mutex);
+    esp_err_t err = (s_installed && s_state != TWAI_STATE_RUNNING) ? ESP_OK : ESP_ERR_INVALID_STATE;
+    if (err == ESP_OK) {
+        s_installed = false;
+        s_rx.clear();
+    }
+    pthread_mutex_unlock(&s_mutex);
+    return err;
+}
+
+esp_err_t twai_start(void)
+{
+    pthread_mutex_lock(&s_mutex);
+    esp_err_t err = (s_installed && s_state == TWAI_STATE_STOPPED) ? ESP_OK : ESP_ERR_INVALID_STATE;
+    if (err == ESP_OK) {
+        s_state = TWAI_STATE_RUNNING;
+    }
+    pthread_mutex_unlock(&s_mutex);
+    return err;
+}
+
+esp_err_t twai_stop(void)
+{
+    pthread_mutex_lock(&s_mutex);
+    esp_err_t err = (s_installed && s_state == TWAI_STATE_RUNNING) ? ESP_OK : ESP_ERR_INVALID_STATE;
+    if (err == ESP_OK) {
+        s_state = TWAI_STATE_STOPPED;
+    }
+    pthread_mutex_unlock(&s_mutex);
+    if (err == ESP_OK) {
+        send_wire(HOST_TWAI_CLEAR, NULL);
+    }
+    return err;
+}
+
+// waits for a free place in the TX queue, the queue drains as fast as the
+// node wins the arbitration on the bus
+esp_err_t twai_transmit(const twai_message_t *message, uint32_t ticks_to_wait)
+{
+    if (message->data_length_code > TWAI_FRAME_MAX_DLC) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    pthread_mutex_lock(&s_mutex);
+    if (!s_installed || s_state != TWAI_STATE_RUNNING) {
+        pthread_mutex_unlock(&s_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!wait_while([] { return s_state == TWAI_STATE_RUNNING && s_txPending >= s_txQueueLen; }, ticks_to_wait)) {
+        pthread_mutex_unlock(&s_mutex);
+        return ESP_ERR_TIMEOUT;
+    }
+    if (s_state != TWAI_STATE_RUNNING) {
+        pthread_mutex_unlock(&s_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!send_wire(HOST_TWAI_FRAME, message)) {
+        s_status.tx_failed_count++;
+        pthread_mutex_unlock(&s_mutex);
+        return ESP_FAIL;
+    }
+    s_txPending++;
+    pthread_mutex_unlock(&s_mutex);
+    return ESP_OK;
+}
+
+esp_err_t twai_receive(twai_message_t *message, uint32_t ticks_to_wait)
+{
+    pthread_mutex_lock(&s_mutex);
+    if (!s_installed) {
+        pthread_mutex_unlock(&s_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!wait_while([] { return s_installed && s_rx.empty(); }, ticks_to_wait) || s_rx.empty()) {
+        pthread_mutex_unlock(&s_mutex);
+        return ESP_ERR_TIMEOUT;
+    }
+    *message = s_rx.front();
+    s_rx.pop_front();
+    pthread_mutex_unlock(&s_mutex);
+    return ESP_OK;
+}
+
+esp_err_t twai_get_status_info(twai_status_info_t *status_info)
+{
+    pthread_mutex_lock(&s_mutex);
+    if (!s_installed) {
+        pthread_mutex_unlock(&s_mutex);
+        return ESP_ERR_INVALID_STATE;
+    }
+    *status_info = s_status;
+    status_info->state = s_state;
+    status_info->msgs_to_tx = s_txPending;
+    status_info->msgs_to_rx = (uint32_t) s_rx.size();
+    pthread_mutex_unlock(&s_mutex);
+    return ESP_OK;
+}
+
+// the virtual bus has no bit errors, a node never goes bus off
+esp_err_t twai_initiate_recovery(void)
+{
+    return ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t twai_clear_transmit_queue(void)
+{
+    pthread_mutex_lock(&s_mutex);
+    esp_err_t err = (s_installed && s_state == TWAI_STATE_RUNNING) ? ESP_OK : ESP_ERR_INVALID_STATE;
+    pthread_mutex_unlock(&s_mutex);
+    if (err == ESP_OK) {
+        send_wire(HOST_TWAI_CLEAR, NULL);
+    }
+    return err;
+}
@@ -0,0 +1,62 @@
+#include <stddef.h>
+
+#include "alloc_count.h"
+
+// glibc's allocator behind the counting malloc family
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t n, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static uint64_t s_count = 0;
+static thread_local bool t_ignore = false;
+
+static inline void count()
+{
+    if (!t_ignore) {
+        __atomic_add_fetch(&s_count, 1, __ATOMIC_RELAXED);
+    }
+}
+
+extern "C" void *malloc(size_t size)
+{
+    count();
+    return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t n, size_t size)
+{
+    count();
+    return __libc_calloc(n, size);
+}
+
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    count();
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+uint64_t sim_alloc_count()
+{
+    return __atomic_load_n(&s_count, __ATOMIC_RELAXED);
+}
+
+void sim_alloc_ignore_thread()
+{
+    t_ignore = true;
+}
+
+SimAllocPause::SimAllocPause() : m_prev(t_ignore)
+{
+    t_ignore = true;
+}
+
+SimAllocPause::~SimAllocPause()
+{
+    t_ignore = m_prev;
+}
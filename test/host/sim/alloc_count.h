@@ -0,0 +1,21 @@
+#pragma once
+
+#include <stdint.h>
+
+// Heap allocations of the firmware, counted by the malloc family in
+// alloc_count.cpp. Allocations of the simulation (chain, pool) don't count:
+// their threads call sim_alloc_ignore_thread(), sim code running on a
+// firmware thread holds a SimAllocPause.
+
+uint64_t sim_alloc_count();
+
+void sim_alloc_ignore_thread();
+
+class SimAllocPause {
+  protected:
+    bool m_prev;
+
+  public:
+    SimAllocPause();
+    ~SimAllocPause();
+};
@@ -0,0 +1,248 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+
+#include "alloc_count.h"
+#include "mock_influx.h"
+
+static const char *TAG = "mock-influx";
+
+MockInflux::MockInflux(const char *token, const char *bucket, const char *org)
+    : m_token(token), m_bucket(bucket), m_org(org)
+{}
+
+MockInflux::~MockInflux()
+{
+    stop();
+}
+
+bool MockInflux::start()
+{
+    m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listenFd < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(m_listenFd, (struct sockaddr *) &addr, sizeof(addr)) || listen(m_listenFd, 8)) {
+        close(m_listenFd);
+        m_listenFd = -1;
+        return false;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(m_listenFd, (struct sockaddr *) &addr, &len);
+    m_port = ntohs(addr.sin_port);
+
+    m_running = true;
+    pthread_create(&m_thread, NULL, taskWrapper, this);
+    return true;
+}
+
+void MockInflux::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    __atomic_store_n(&m_running, false, __ATOMIC_RELEASE);
+    pthread_join(m_thread, NULL);
+    for (auto &conn : m_conns) {
+        close(conn.fd);
+    }
+    m_conns.clear();
+    close(m_listenFd);
+    m_listenFd = -1;
+}
+
+void MockInflux::script(const std::vector<int> &statusCodes)
+{
+    pthread_mutex_lock(&m_mutex);
+    m_script.assign(statusCodes.begin(), statusCodes.end());
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void MockInflux::closeAfterNext()
+{
+    pthread_mutex_lock(&m_mutex);
+    m_closeAfterNext = true;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void MockInflux::reset()
+{
+    pthread_mutex_lock(&m_mutex);
+    m_stats = {};
+    m_lines.clear();
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void MockInflux::getStats(stats_t *stats)
+{
+    pthread_mutex_lock(&m_mutex);
+    *stats = m_stats;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+std::vector<std::string> MockInflux::getLines()
+{
+    pthread_mutex_lock(&m_mutex);
+    std::vector<std::string> lines = m_lines;
+    pthread_mutex_unlock(&m_mutex);
+    return lines;
+}
+
+bool MockInflux::reply(conn_t &conn, int status, const std::string &body, bool close)
+{
+    const char *reason = (status < 300) ? "OK" : (status < 500) ? "Bad Request" : "Service Unavailable";
+    std::string resp = "HTTP/1.1 " + std::to_string(status) + " " + reason + "\r\n";
+    if (!body.empty()) {
+        resp += "Content-Type: application/json\r\n";
+    }
+    resp += "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body;
+
+    // close without announcing it, the client finds out with its next request
+    return send(conn.fd, resp.data(), resp.size(), MSG_NOSIGNAL) == (ssize_t) resp.size() && !close;
+}
+
+// one complete request in conn.rx, m_mutex is held
+bool MockInflux::handle(conn_t &conn)
+{
+    size_t end = conn.rx.find("\r\n\r\n");
+    std::string head = conn.rx.substr(0, end);
+
+    size_t length = 0;
+    std::string auth;
+    size_t pos = head.find("\r\n");
+    while (pos != std::string::npos) {
+        size_t next = head.find("\r\n", pos + 2);
+        std::string line = head.substr(pos + 2, next == std::string::npos ? std::string::npos : next - pos - 2);
+        pos = next;
+        size_t colon = line.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        std::string value = line.substr(colon + 1);
+        value.erase(0, value.find_first_not_of(' '));
+        if (!strncasecmp(line.c_str(), "Content-Length", colon)) {
+            length = strtoul(value.c_str(), NULL, 10);
+        } else if (!strncasecmp(line.c_str(), "Authorization", colon)) {
+            auth = value;
+        }
+    }
+
+    std::string body = conn.rx.substr(end + 4, length);
+    conn.rx.erase(0, end + 4 + length);
+
+    bool close = m_closeAfterNext;
+    m_closeAfterNext = false;
+
+    std::string path = "/api/v2/write?bucket=" + m_bucket + "&org=" + m_org + "&precision=s";
+    if (head.compare(0, 5 + path.size(), "POST " + path) || head.compare(5 + path.size(), 1, " ")) {
+        ESP_LOGW(TAG, "unexpected request: %s", head.substr(0, head.find("\r\n")).c_str());
+        m_stats.badRequests++;
+        return reply(conn, 400, "{\"code\":\"invalid\",\"message\":\"unexpected request\"}", close);
+    }
+    if (auth != "Token " + m_token) {
+        m_stats.badRequests++;
+        return reply(conn, 401, "{\"code\":\"unauthorized\",\"message\":\"unauthorized access\"}", close);
+    }
+
+    m_stats.requests++;
+    if (!m_script.empty()) {
+        int status = m_script.front();
+        m_script.pop_front();
+        if (status < 200 || status >= 300) {
+            return reply(conn, status, "{\"code\":\"invalid\",\"message\":\"scripted failure\"}", close);
+        }
+    }
+
+    size_t start = 0;
+    while (start < body.size()) {
+        size_t nl = body.find('\n', start);
+        if (nl == std::string::npos) {
+            nl = body.size();
+        }
+        if (nl > start) {
+            m_lines.push_back(body.substr(start, nl - start));
+        }
+        start = nl + 1;
+    }
+    return reply(conn, 204, "", close);
+}
+
+void MockInflux::task()
+{
+    sim_alloc_ignore_thread();
+
+    char buf[4096];
+    std::vector<struct pollfd> fds;
+
+    while (__atomic_load_n(&m_running, __ATOMIC_ACQUIRE)) {
+        fds.assign(1, {m_listenFd, POLLIN, 0});
+        for (auto &conn : m_conns) {
+            fds.push_back({conn.fd, POLLIN, 0});
+        }
+        if (poll(fds.data(), fds.size(), 10) <= 0) {
+            continue;
+        }
+
+        pthread_mutex_lock(&m_mutex);
+        if (fds[0].revents) {
+            int fd = accept(m_listenFd, NULL, NULL);
+            if (fd >= 0) {
+                int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                m_conns.push_back({fd, std::string()});
+                m_stats.connections++;
+            }
+        }
+
+        // fds and m_conns have the same order up to the new connection
+        for (size_t i = fds.size() - 1; i > 0; i--) {
+            if (!fds[i].revents) {
+                continue;
+            }
+            conn_t &conn = m_conns[i - 1];
+            ssize_t n = recv(conn.fd, buf, sizeof(buf), 0);
+            bool open = n > 0;
+            if (open) {
+                conn.rx.append(buf, n);
+            }
+
+            // complete requests: headers and Content-Length bytes of body
+            size_t end;
+            while (open && (end = conn.rx.find("\r\n\r\n")) != std::string::npos) {
+                const char *cl = strcasestr(conn.rx.c_str(), "Content-Length:");
+                size_t length = (cl && (size_t) (cl - conn.rx.c_str()) < end) ? strtoul(cl + 15, NULL, 10) : 0;
+                if (conn.rx.size() < end + 4 + length) {
+                    break;
+                }
+                open = handle(conn);
+            }
+
+            if (!open) {
+                close(conn.fd);
+                m_conns.erase(m_conns.begin() + (i - 1));
+            }
+        }
+        pthread_mutex_unlock(&m_mutex);
+    }
+}
+
+void *MockInflux::taskWrapper(void *arg)
+{
+    ((MockInflux *) arg)->task();
+    return NULL;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+// InfluxDB v2 write endpoint on localhost for the host tests
+//
+// Takes POST /api/v2/write on any number of keep-alive connections, checks
+// bucket, org, precision and the token and stores the lines of the body.
+// Scripted status codes answer the next writes instead (with an Influx
+// error body, the lines are not stored), closeAfterNext() drops the
+// connection after the next response like a server with a short idle
+// timeout.
+class MockInflux {
+  public:
+    typedef struct
+    {
+        uint32_t connections; // accepted
+        uint32_t requests;    // writes, including the failed ones
+        uint32_t badRequests; // wrong path or token, answered 400/401
+    } stats_t;
+
+  protected:
+    typedef struct
+    {
+        int fd;
+        std::string rx;
+    } conn_t;
+
+    std::string m_token;
+    std::string m_bucket;
+    std::string m_org;
+
+    int m_listenFd = -1;
+    uint16_t m_port = 0;
+    pthread_t m_thread;
+    bool m_running = false;
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    std::vector<conn_t> m_conns;
+    std::deque<int> m_script;
+    bool m_closeAfterNext = false;
+    std::vector<std::string> m_lines;
+    stats_t m_stats = {};
+
+    void task();
+    static void *taskWrapper(void *arg);
+
+    // false when the connection has to be closed
+    bool handle(conn_t &conn);
+    bool reply(conn_t &conn, int status, const std::string &body, bool close);
+
+  public:
+    MockInflux(const char *token, const char *bucket, const char *org);
+    ~MockInflux();
+
+    // listens on 127.0.0.1 with a free port
+    bool start();
+    void stop();
+
+    uint16_t getPort()
+    {
+        return m_port;
+    }
+
+    // status codes for the next writes, 2xx stores the lines
+    void script(const std::vector<int> &statusCodes);
+    void closeAfterNext();
+
+    // counters and lines back to zero, open connections stay
+    void reset();
+
+    void getStats(stats_t *stats);
+    std::vector<std::string> getLines();
+};
@@ -0,0 +1,403 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "ArduinoJson.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "alloc_count.h"
+#include "mock_pool.h"
+#include "sim_diff.h"
+
+static const char *TAG = "mock-pool";
+
+// mainnet-like nbits, the scaled nonces never find a block
+static const uint32_t NBITS = 0x17034219;
+
+// jobs kept for shares that arrive after the next notify
+static const size_t JOB_HISTORY = 4;
+
+static std::string to_hex(const uint8_t *data, size_t len)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    hex.reserve(len * 2);
+    for (size_t i = 0; i < len; i++) {
+        hex += digits[data[i] >> 4];
+        hex += digits[data[i] & 0x0f];
+    }
+    return hex;
+}
+
+static bool from_hex(const std::string &hex, std::vector<uint8_t> &out)
+{
+    if (hex.size() % 2) {
+        return false;
+    }
+    out.clear();
+    for (size_t i = 0; i < hex.size(); i += 2) {
+        unsigned int byte;
+        if (sscanf(hex.c_str() + i, "%2x", &byte) != 1) {
+            return false;
+        }
+        out.push_back((uint8_t) byte);
+    }
+    return true;
+}
+
+MockPool::MockPool(uint32_t difficulty, uint32_t notifyIntervalMs, int merkleBranches)
+    : m_difficulty(difficulty), m_notifyIntervalMs(notifyIntervalMs), m_merkleBranches(merkleBranches)
+{
+}
+
+MockPool::~MockPool()
+{
+    stop();
+}
+
+uint32_t MockPool::random()
+{
+    m_seed ^= m_seed << 13;
+    m_seed ^= m_seed >> 17;
+    m_seed ^= m_seed << 5;
+    return m_seed;
+}
+
+bool MockPool::start()
+{
+    m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listenFd < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(m_listenFd, (struct sockaddr *) &addr, sizeof(addr)) || listen(m_listenFd, 1)) {
+        close(m_listenFd);
+        m_listenFd = -1;
+        return false;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(m_listenFd, (struct sockaddr *) &addr, &len);
+    m_port = ntohs(addr.sin_port);
+
+    m_running = true;
+    pthread_create(&m_thread, NULL, taskWrapper, this);
+    return true;
+}
+
+void MockPool::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    __atomic_store_n(&m_running, false, __ATOMIC_RELEASE);
+    pthread_join(m_thread, NULL);
+    if (m_clientFd >= 0) {
+        close(m_clientFd);
+        m_clientFd = -1;
+    }
+    close(m_listenFd);
+    m_listenFd = -1;
+}
+
+void MockPool::getStats(stats_t *stats)
+{
+    pthread_mutex_lock(&m_mutex);
+    *stats = m_stats;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+std::vector<std::pair<std::vector<uint8_t>, int64_t>> MockPool::getNotifies()
+{
+    pthread_mutex_lock(&m_mutex);
+    auto notifies = m_notifies;
+    pthread_mutex_unlock(&m_mutex);
+    return notifies;
+}
+
+bool MockPool::sendLine(const std::string &line)
+{
+    std::string out = line + "\n";
+    size_t sent = 0;
+    while (sent < out.size()) {
+        ssize_t n = send(m_clientFd, out.data() + sent, out.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+void MockPool::sendNotify()
+{
+    job_t job;
+    char id[16];
+    snprintf(id, sizeof(id), "%x", m_nextJob++);
+    job.id = id;
+
+    // coinbase: version, one input with the block height and the extranonces
+    // in the script, one P2WPKH output
+    uint32_t height = 900000 + m_stats.notifies;
+    job.coinbase1 = {0x01, 0x00, 0x00, 0x00, 0x01};
+    job.coinbase1.insert(job.coinbase1.end(), 32, 0x00);
+    job.coinbase1.insert(job.coinbase1.end(), {0xff, 0xff, 0xff, 0xff});
+    job.coinbase1.push_back(1 + 3 + 8 + 4 + (uint8_t) m_extranonce2Len);
+    job.coinbase1.insert(job.coinbase1.end(), {0x03, (uint8_t) height, (uint8_t) (height >> 8), (uint8_t) (height >> 16)});
+    for (int i = 0; i < 8; i++) {
+        job.coinbase1.push_back((uint8_t) random());
+    }
+
+    job.coinbase2 = {0xff, 0xff, 0xff, 0xff, 0x01};
+    uint64_t value = 312500000;
+    for (int i = 0; i < 8; i++) {
+        job.coinbase2.push_back((uint8_t) (value >> (8 * i)));
+    }
+    job.coinbase2.insert(job.coinbase2.end(), {0x16, 0x00, 0x14});
+    for (int i = 0; i < 20; i++) {
+        job.coinbase2.push_back((uint8_t) random());
+    }
+    job.coinbase2.insert(job.coinbase2.end(), {0x00, 0x00, 0x00, 0x00});
+
+    for (int b = 0; b < m_merkleBranches; b++) {
+        std::vector<uint8_t> branch(32);
+        for (auto &byte : branch) {
+            byte = (uint8_t) random();
+        }
+        job.branches.push_back(branch);
+    }
+
+    for (auto &byte : job.prev) {
+        byte = (uint8_t) random();
+    }
+    job.version = 0x20000000;
+    job.nbits = NBITS;
+    job.ntime = (uint32_t) time(NULL);
+
+    // stratum sends the prev block hash with the bytes of each word swapped
+    uint8_t prev_stratum[32];
+    for (int i = 0; i < 32; i += 4) {
+        for (int j = 0; j < 4; j++) {
+            prev_stratum[i + j] = job.prev[i + 3 - j];
+        }
+    }
+
+    std::string branches;
+    for (size_t b = 0; b < job.branches.size(); b++) {
+        branches += (b ? ",\"" : "\"") + to_hex(job.branches[b].data(), 32) + "\"";
+    }
+
+    char numbers[64];
+    snprintf(numbers, sizeof(numbers), "\"%08x\",\"%08x\",\"%08x\"", job.version, job.nbits, job.ntime);
+
+    std::string line = "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"" + job.id + "\",\"" +
+                       to_hex(prev_stratum, 32) + "\",\"" + to_hex(job.coinbase1.data(), job.coinbase1.size()) +
+                       "\",\"" + to_hex(job.coinbase2.data(), job.coinbase2.size()) + "\",[" + branches + "]," +
+                       numbers + ",true]}";
+
+    job.sentUs = esp_timer_get_time();
+    {
+        pthread_mutex_lock(&m_mutex);
+        m_jobs.push_front(job);
+        if (m_jobs.size() > JOB_HISTORY) {
+            m_jobs.pop_back();
+        }
+        m_notifies.push_back({std::vector<uint8_t>(job.prev, job.prev + 32), job.sentUs});
+        m_stats.notifies++;
+        pthread_mutex_unlock(&m_mutex);
+    }
+    sendLine(line);
+}
+
+// 0 accepted, otherwise the stratum error code
+int MockPool::checkShare(const std::string &jobId, const std::string &extranonce2, uint32_t ntime, uint32_t nonce,
+                         uint32_t versionBits)
+{
+    pthread_mutex_lock(&m_mutex);
+
+    const job_t *job = nullptr;
+    bool current = false;
+    for (size_t i = 0; i < m_jobs.size(); i++) {
+        if (m_jobs[i].id == jobId) {
+            job = &m_jobs[i];
+            current = !i;
+        }
+    }
+
+    int result = 0;
+    std::vector<uint8_t> en1, en2;
+    if (!job) {
+        m_stats.rejectedStale++;
+        result = 21;
+    } else if (!from_hex(m_extranonce1, en1) || !from_hex(extranonce2, en2) || (int) en2.size() != m_extranonce2Len ||
+               (versionBits & ~m_versionMask)) {
+        m_stats.rejectedInvalid++;
+        result = 20;
+    } else {
+        std::vector<uint8_t> coinbase = job->coinbase1;
+        coinbase.insert(coinbase.end(), en1.begin(), en1.end());
+        coinbase.insert(coinbase.end(), en2.begin(), en2.end());
+        coinbase.insert(coinbase.end(), job->coinbase2.begin(), job->coinbase2.end());
+
+        uint8_t merkle[64];
+        sim_sha256d(coinbase.data(), coinbase.size(), merkle);
+        for (const auto &branch : job->branches) {
+            memcpy(merkle + 32, branch.data(), 32);
+            sim_sha256d(merkle, 64, merkle);
+        }
+
+        uint8_t header[80];
+        uint32_t version = job->version ^ versionBits;
+        memcpy(header, &version, 4);
+        memcpy(header + 4, job->prev, 32);
+        memcpy(header + 36, merkle, 32);
+        memcpy(header + 68, &ntime, 4);
+        memcpy(header + 72, &job->nbits, 4);
+        memcpy(header + 76, &nonce, 4);
+
+        char key[128];
+        snprintf(key, sizeof(key), "%s/%s/%08x/%08x/%08x", jobId.c_str(), extranonce2.c_str(), ntime, nonce, versionBits);
+
+        // the firmware computes the same double, allow for rounding only
+        if (sim_header_diff(header) < m_difficulty * (1.0 - 1e-9)) {
+            m_stats.rejectedLowDiff++;
+            result = 23;
+        } else if (!m_seen.insert(key).second) {
+            m_stats.rejectedDuplicate++;
+            result = 22;
+        } else {
+            m_stats.accepted++;
+            m_stats.acceptedDiff += m_difficulty;
+        }
+    }
+    if (result && result != 21) {
+        ESP_LOGW(TAG, "share rejected (%d) job %s%s", result, jobId.c_str(), current ? "" : " (previous)");
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return result;
+}
+
+void MockPool::handleLine(const std::string &line)
+{
+    JsonDocument doc;
+    if (deserializeJson(doc, line)) {
+        ESP_LOGE(TAG, "invalid json: %s", line.c_str());
+        return;
+    }
+
+    const char *method = doc["method"] | "";
+    std::string id = doc["id"].isNull() ? "null" : std::to_string(doc["id"].as<long>());
+    std::string reply = "{\"id\":" + id + ",";
+
+    if (!strcmp(method, "mining.subscribe")) {
+        char result[128];
+        snprintf(result, sizeof(result), "\"result\":[[[\"mining.notify\",\"1\"]],\"%s\",%d],\"error\":null}",
+                 m_extranonce1, m_extranonce2Len);
+        sendLine(reply + result);
+    } else if (!strcmp(method, "mining.configure")) {
+        char result[128];
+        snprintf(result, sizeof(result),
+                 "\"result\":{\"version-rolling\":true,\"version-rolling.mask\":\"%08x\"},\"error\":null}",
+                 m_versionMask);
+        sendLine(reply + result);
+    } else if (!strcmp(method, "mining.authorize")) {
+        sendLine(reply + "\"result\":true,\"error\":null}");
+        sendLine("{\"id\":null,\"method\":\"mining.set_difficulty\",\"params\":[" + std::to_string(m_difficulty) + "]}");
+        sendNotify();
+    } else if (!strcmp(method, "mining.submit")) {
+        {
+            pthread_mutex_lock(&m_mutex);
+            m_stats.submits++;
+            pthread_mutex_unlock(&m_mutex);
+        }
+        JsonArray params = doc["params"];
+        int code = 20;
+        if (params.size() >= 6) {
+            code = checkShare(params[1].as<std::string>(), params[2].as<std::string>(),
+                              (uint32_t) strtoul(params[3] | "", NULL, 16), (uint32_t) strtoul(params[4] | "", NULL, 16),
+                              (uint32_t) strtoul(params[5] | "", NULL, 16));
+        } else {
+            pthread_mutex_lock(&m_mutex);
+            m_stats.rejectedInvalid++;
+            pthread_mutex_unlock(&m_mutex);
+        }
+        if (!code) {
+            sendLine(reply + "\"result\":true,\"error\":null}");
+        } else {
+            static const char *const messages[] = {"Other/Unknown", "Job not found", "Duplicate share", "Low difficulty share"};
+            sendLine(reply + "\"result\":null,\"error\":[" + std::to_string(code) + ",\"" + messages[code - 20] + "\",null]}");
+        }
+    } else {
+        // suggest_difficulty, extranonce.subscribe
+        sendLine(reply + "\"result\":true,\"error\":null}");
+    }
+}
+
+void MockPool::task()
+{
+    sim_alloc_ignore_thread();
+
+    int64_t nextNotifyUs = 0;
+    char buf[4096];
+
+    while (__atomic_load_n(&m_running, __ATOMIC_ACQUIRE)) {
+        if (m_clientFd < 0) {
+            struct pollfd pfd = {m_listenFd, POLLIN, 0};
+            if (poll(&pfd, 1, 100) > 0) {
+                m_clientFd = accept(m_listenFd, NULL, NULL);
+                int one = 1;
+                setsockopt(m_clientFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                m_line.clear();
+                nextNotifyUs = 0;
+                ESP_LOGI(TAG, "miner connected");
+            }
+            continue;
+        }
+
+        struct pollfd pfd = {m_clientFd, POLLIN, 0};
+        if (poll(&pfd, 1, 10) > 0) {
+            ssize_t n = recv(m_clientFd, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                ESP_LOGW(TAG, "miner disconnected");
+                close(m_clientFd);
+                m_clientFd = -1;
+                continue;
+            }
+            m_line.append(buf, n);
+            size_t pos;
+            while ((pos = m_line.find('\n')) != std::string::npos) {
+                std::string line = m_line.substr(0, pos);
+                m_line.erase(0, pos + 1);
+                if (!line.empty()) {
+                    handleLine(line);
+                }
+                // the first notify goes out with the authorize response
+                if (!nextNotifyUs && m_stats.notifies) {
+                    nextNotifyUs = esp_timer_get_time() + (int64_t) m_notifyIntervalMs * 1000;
+                }
+            }
+        }
+
+        if (nextNotifyUs && esp_timer_get_time() >= nextNotifyUs) {
+            sendNotify();
+            nextNotifyUs += (int64_t) m_notifyIntervalMs * 1000;
+        }
+    }
+}
+
+void *MockPool::taskWrapper(void *arg)
+{
+    ((MockPool *) arg)->task();
+    return NULL;
+}
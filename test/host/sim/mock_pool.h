@@ -0,0 +1,96 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+// Stratum V1 pool on localhost for the host simulation
+//
+// Serves one miner: answers subscribe/configure/authorize, sends a new
+// mining.notify (clean jobs) every notify interval and checks each
+// mining.submit by rebuilding coinbase, merkle root and header at the
+// difficulty scale of sim_diff.h.
+class MockPool {
+  public:
+    typedef struct
+    {
+        uint32_t notifies;
+        uint32_t submits;
+        uint32_t accepted;
+        uint32_t rejectedLowDiff;
+        uint32_t rejectedStale;
+        uint32_t rejectedDuplicate;
+        uint32_t rejectedInvalid;
+        double acceptedDiff; // sum of the pool difficulty of the accepted shares
+    } stats_t;
+
+  protected:
+    typedef struct
+    {
+        std::string id;
+        std::vector<uint8_t> coinbase1;
+        std::vector<uint8_t> coinbase2;
+        std::vector<std::vector<uint8_t>> branches;
+        uint8_t prev[32]; // header byte order
+        uint32_t version;
+        uint32_t nbits;
+        uint32_t ntime;
+        int64_t sentUs;
+    } job_t;
+
+    uint32_t m_difficulty;
+    uint32_t m_notifyIntervalMs;
+    int m_merkleBranches;
+
+    int m_listenFd = -1;
+    int m_clientFd = -1;
+    uint16_t m_port = 0;
+    pthread_t m_thread;
+    bool m_running = false;
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    std::deque<job_t> m_jobs; // the newest job is in front
+    std::vector<std::pair<std::vector<uint8_t>, int64_t>> m_notifies;
+    std::set<std::string> m_seen;
+    uint32_t m_nextJob = 1;
+    uint32_t m_seed = 0x9e3779b9;
+    const char *m_extranonce1 = "f000000d";
+    int m_extranonce2Len = 4;
+    uint32_t m_versionMask = 0x1fffe000;
+
+    stats_t m_stats = {};
+
+    std::string m_line;
+
+    void task();
+    static void *taskWrapper(void *arg);
+
+    bool sendLine(const std::string &line);
+    void handleLine(const std::string &line);
+    void sendNotify();
+    int checkShare(const std::string &jobId, const std::string &extranonce2, uint32_t ntime, uint32_t nonce,
+                   uint32_t versionBits);
+    uint32_t random();
+
+  public:
+    MockPool(uint32_t difficulty, uint32_t notifyIntervalMs, int merkleBranches);
+    ~MockPool();
+
+    // listens on 127.0.0.1 with a free port
+    bool start();
+    void stop();
+
+    uint16_t getPort()
+    {
+        return m_port;
+    }
+
+    void getStats(stats_t *stats);
+
+    // prev block hashes (header byte order) and send times of the notifies
+    std::vector<std::pair<std::vector<uint8_t>, int64_t>> getNotifies();
+};
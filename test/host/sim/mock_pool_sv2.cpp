@@ -0,0 +1,720 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "mbedtls/md.h"
+#include "mbedtls/sha256.h"
+#include "secp256k1_ellswift.h"
+#include "secp256k1_schnorrsig.h"
+
+extern "C" {
+#include "libbase58.h"
+#include "sv2_protocol.h"
+}
+
+#include "alloc_count.h"
+#include "mock_pool_sv2.h"
+#include "sim_diff.h"
+
+static const char *TAG = "mock-pool-sv2";
+
+// mainnet-like nbits, the scaled nonces never find a block
+static const uint32_t NBITS = 0x17034219;
+
+// jobs kept for shares that arrive after the next block
+static const size_t JOB_HISTORY = 4;
+
+static const char NOISE_PROTOCOL_NAME[] = "Noise_NX_Secp256k1+EllSwift_ChaChaPoly_SHA256";
+static const int NOISE_MAC_SIZE = 16;
+static const int FRAME_TIMEOUT_MS = 5000;
+
+static void put_u16(std::vector<uint8_t> &out, uint16_t v)
+{
+    out.push_back((uint8_t) v);
+    out.push_back((uint8_t) (v >> 8));
+}
+
+static void put_u32(std::vector<uint8_t> &out, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        out.push_back((uint8_t) (v >> (8 * i)));
+    }
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void mix_hash(uint8_t h[32], const uint8_t *data, size_t len)
+{
+    mbedtls_sha256_context sha;
+    mbedtls_sha256_init(&sha);
+    mbedtls_sha256_starts(&sha, 0);
+    mbedtls_sha256_update(&sha, h, 32);
+    mbedtls_sha256_update(&sha, data, len);
+    mbedtls_sha256_finish(&sha, h);
+    mbedtls_sha256_free(&sha);
+}
+
+static void hmac_sha256(const uint8_t *key, size_t key_len, const uint8_t *data, size_t data_len, uint8_t out[32])
+{
+    mbedtls_md_context_t md;
+    mbedtls_md_init(&md);
+    mbedtls_md_setup(&md, mbedtls_md_info_from_type(MBEDTLS_MD_SHA256), 1);
+    mbedtls_md_hmac_starts(&md, key, key_len);
+    mbedtls_md_hmac_update(&md, data, data_len);
+    mbedtls_md_hmac_finish(&md, out);
+    mbedtls_md_free(&md);
+}
+
+// Noise HKDF with two outputs, out1 may be ck
+static void hkdf2(const uint8_t ck[32], const uint8_t *ikm, size_t ikm_len, uint8_t out1[32], uint8_t out2[32])
+{
+    uint8_t prk[32];
+    hmac_sha256(ck, 32, ikm, ikm_len, prk);
+    uint8_t one = 0x01;
+    hmac_sha256(prk, 32, &one, 1, out1);
+    uint8_t buf[33];
+    memcpy(buf, out1, 32);
+    buf[32] = 0x02;
+    hmac_sha256(prk, 32, buf, 33, out2);
+}
+
+// 4 zero bytes and the little endian counter
+static void build_nonce(uint64_t counter, uint8_t nonce[12])
+{
+    memset(nonce, 0, 4);
+    for (int i = 0; i < 8; i++) {
+        nonce[4 + i] = (uint8_t) (counter >> (i * 8));
+    }
+}
+
+// handshake messages, a fresh key with nonce 0 and the handshake hash as aad
+static void encrypt_with_ad(const uint8_t key[32], const uint8_t h[32], const uint8_t *plain, size_t len,
+                            uint8_t *out)
+{
+    uint8_t nonce[12];
+    build_nonce(0, nonce);
+    mbedtls_chachapoly_context aead;
+    mbedtls_chachapoly_init(&aead);
+    mbedtls_chachapoly_setkey(&aead, key);
+    mbedtls_chachapoly_encrypt_and_tag(&aead, len, nonce, h, 32, plain, out, out + len);
+    mbedtls_chachapoly_free(&aead);
+}
+
+// target = 0x00000000ffff0000... / difficulty, little endian like the SV2 U256
+static void difficulty_to_target(uint32_t difficulty, uint8_t target[32])
+{
+    uint8_t one[32] = {0};
+    one[4] = 0xff;
+    one[5] = 0xff;
+
+    uint64_t rem = 0;
+    for (int i = 0; i < 32; i++) {
+        rem = (rem << 8) | one[i];
+        target[31 - i] = (uint8_t) (rem / difficulty);
+        rem %= difficulty;
+    }
+}
+
+static void merkle_root(const std::vector<uint8_t> &coinbase, const std::vector<std::vector<uint8_t>> &branches,
+                        uint8_t root[32])
+{
+    uint8_t merkle[64];
+    sim_sha256d(coinbase.data(), (int) coinbase.size(), merkle);
+    for (const auto &branch : branches) {
+        memcpy(merkle + 32, branch.data(), 32);
+        sim_sha256d(merkle, 64, merkle);
+    }
+    memcpy(root, merkle, 32);
+}
+
+MockPoolSV2::MockPoolSV2(uint32_t difficulty, uint32_t notifyIntervalMs, int merkleBranches)
+    : m_difficulty(difficulty), m_notifyIntervalMs(notifyIntervalMs), m_merkleBranches(merkleBranches)
+{
+    mbedtls_chachapoly_init(&m_sendAead);
+    mbedtls_chachapoly_init(&m_recvAead);
+    mbedtls_sha256((const uint8_t *) "mock pool authority", 19, m_authorityKey, 0);
+}
+
+MockPoolSV2::~MockPoolSV2()
+{
+    stop();
+    mbedtls_chachapoly_free(&m_sendAead);
+    mbedtls_chachapoly_free(&m_recvAead);
+}
+
+uint32_t MockPoolSV2::random()
+{
+    m_seed ^= m_seed << 13;
+    m_seed ^= m_seed >> 17;
+    m_seed ^= m_seed << 5;
+    return m_seed;
+}
+
+bool MockPoolSV2::start()
+{
+    m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    if (m_listenFd < 0) {
+        return false;
+    }
+    int one = 1;
+    setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(m_listenFd, (struct sockaddr *) &addr, sizeof(addr)) || listen(m_listenFd, 1)) {
+        close(m_listenFd);
+        m_listenFd = -1;
+        return false;
+    }
+    socklen_t len = sizeof(addr);
+    getsockname(m_listenFd, (struct sockaddr *) &addr, &len);
+    m_port = ntohs(addr.sin_port);
+
+    m_running = true;
+    pthread_create(&m_thread, NULL, taskWrapper, this);
+    return true;
+}
+
+void MockPoolSV2::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    __atomic_store_n(&m_running, false, __ATOMIC_RELEASE);
+    pthread_join(m_thread, NULL);
+    if (m_clientFd >= 0) {
+        close(m_clientFd);
+        m_clientFd = -1;
+    }
+    close(m_listenFd);
+    m_listenFd = -1;
+}
+
+std::string MockPoolSV2::getAuthorityKey()
+{
+    // version 1 (u16 LE), the x-only key and the first 4 bytes of its sha256d
+    uint8_t bin[38] = {0x01, 0x00};
+    memcpy(bin + 2, m_authorityKey, 32);
+    uint8_t hash[32];
+    sim_sha256d(bin, 34, hash);
+    memcpy(bin + 34, hash, 4);
+
+    char b58[64];
+    size_t len = sizeof(b58);
+    if (!b58enc(b58, &len, bin, sizeof(bin))) {
+        return "";
+    }
+    return b58;
+}
+
+void MockPoolSV2::getStats(stats_t *stats)
+{
+    pthread_mutex_lock(&m_mutex);
+    *stats = m_stats;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+std::vector<std::pair<std::vector<uint8_t>, int64_t>> MockPoolSV2::getNotifies()
+{
+    pthread_mutex_lock(&m_mutex);
+    auto notifies = m_notifies;
+    pthread_mutex_unlock(&m_mutex);
+    return notifies;
+}
+
+bool MockPoolSV2::recvExact(uint8_t *buf, size_t len)
+{
+    size_t received = 0;
+    int64_t deadline = esp_timer_get_time() + (int64_t) FRAME_TIMEOUT_MS * 1000;
+    while (received < len) {
+        if (!__atomic_load_n(&m_running, __ATOMIC_ACQUIRE) || esp_timer_get_time() > deadline) {
+            return false;
+        }
+        struct pollfd pfd = {m_clientFd, POLLIN, 0};
+        if (poll(&pfd, 1, 100) <= 0) {
+            continue;
+        }
+        ssize_t n = recv(m_clientFd, buf + received, len - received, 0);
+        if (n <= 0) {
+            return false;
+        }
+        received += n;
+    }
+    return true;
+}
+
+bool MockPoolSV2::sendAll(const uint8_t *buf, size_t len)
+{
+    size_t sent = 0;
+    while (sent < len) {
+        ssize_t n = send(m_clientFd, buf + sent, len - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return false;
+        }
+        sent += n;
+    }
+    return true;
+}
+
+// Noise_NX responder: <- e, -> e, ee, s, es and the certificate as payload
+bool MockPoolSV2::handshake()
+{
+    uint8_t h[32], ck[32];
+    mbedtls_sha256((const uint8_t *) NOISE_PROTOCOL_NAME, strlen(NOISE_PROTOCOL_NAME), h, 0);
+    memcpy(ck, h, 32);
+    mix_hash(h, (const uint8_t *) "", 0);
+
+    uint8_t re[64];
+    if (!recvExact(re, sizeof(re))) {
+        ESP_LOGE(TAG, "no ephemeral key from the miner");
+        return false;
+    }
+    mix_hash(h, re, 64);
+    mix_hash(h, (const uint8_t *) "", 0);
+
+    uint8_t eSec[32], sSec[32];
+    for (int i = 0; i < 32; i++) {
+        eSec[i] = (uint8_t) random();
+        sSec[i] = (uint8_t) (0xa5 ^ i);
+    }
+    uint8_t msg[234];
+    uint8_t *e = msg;
+    uint8_t s[64];
+    secp256k1_ellswift_create(nullptr, e, eSec, nullptr);
+    secp256k1_ellswift_create(nullptr, s, sSec, nullptr);
+
+    mix_hash(h, e, 64);
+
+    uint8_t shared[32], tempK[32];
+    secp256k1_ellswift_xdh(nullptr, shared, re, e, eSec, 1, secp256k1_ellswift_xdh_hash_function_bip324, nullptr);
+    hkdf2(ck, shared, 32, ck, tempK);
+
+    encrypt_with_ad(tempK, h, s, 64, msg + 64);
+    mix_hash(h, msg + 64, 80);
+
+    secp256k1_ellswift_xdh(nullptr, shared, re, s, sSec, 1, secp256k1_ellswift_xdh_hash_function_bip324, nullptr);
+    hkdf2(ck, shared, 32, ck, tempK);
+
+    // version, valid from, not valid after and the signature over them and the static key
+    uint8_t cert[74] = {0};
+    uint32_t now = (uint32_t) time(NULL);
+    uint32_t validFrom = now - 3600, notValidAfter = now + 3600;
+    memcpy(cert + 2, &validFrom, 4);
+    memcpy(cert + 6, &notValidAfter, 4);
+    uint8_t sigHash[32];
+    {
+        mbedtls_sha256_context sha;
+        mbedtls_sha256_init(&sha);
+        mbedtls_sha256_starts(&sha, 0);
+        mbedtls_sha256_update(&sha, cert, 10);
+        mbedtls_sha256_update(&sha, s, 32);
+        mbedtls_sha256_finish(&sha, sigHash);
+        mbedtls_sha256_free(&sha);
+    }
+    secp256k1_standin_sign(cert + 10, sigHash, 32, m_authorityKey);
+    encrypt_with_ad(tempK, h, cert, sizeof(cert), msg + 144);
+
+    if (!sendAll(msg, sizeof(msg))) {
+        return false;
+    }
+
+    // split: the first key is the one of the initiator
+    uint8_t recvKey[32];
+    hkdf2(ck, (const uint8_t *) "", 0, recvKey, m_sendKey);
+    mbedtls_chachapoly_setkey(&m_recvAead, recvKey);
+    mbedtls_chachapoly_setkey(&m_sendAead, m_sendKey);
+    m_sendNonce = 0;
+    m_recvNonce = 0;
+    return true;
+}
+
+std::vector<uint8_t> MockPoolSV2::encodeFrame(uint8_t msgType, bool channelMsg, const std::vector<uint8_t> &payload)
+{
+    std::vector<uint8_t> out(SV2_FRAME_HEADER_SIZE + NOISE_MAC_SIZE + payload.size() +
+                             (payload.empty() ? 0 : NOISE_MAC_SIZE));
+    sv2_encode_frame_header(out.data(), channelMsg ? SV2_CHANNEL_MSG_FLAG : 0, msgType, (uint32_t) payload.size());
+
+    uint8_t nonce[12];
+    build_nonce(m_sendNonce++, nonce);
+    mbedtls_chachapoly_encrypt_and_tag(&m_sendAead, SV2_FRAME_HEADER_SIZE, nonce, NULL, 0, out.data(), out.data(),
+                                       out.data() + SV2_FRAME_HEADER_SIZE);
+    if (!payload.empty()) {
+        uint8_t *p = out.data() + SV2_FRAME_HEADER_SIZE + NOISE_MAC_SIZE;
+        build_nonce(m_sendNonce++, nonce);
+        mbedtls_chachapoly_encrypt_and_tag(&m_sendAead, payload.size(), nonce, NULL, 0, payload.data(), p,
+                                           p + payload.size());
+    }
+    return out;
+}
+
+bool MockPoolSV2::sendFrame(uint8_t msgType, bool channelMsg, const std::vector<uint8_t> &payload)
+{
+    std::vector<uint8_t> out = encodeFrame(msgType, channelMsg, payload);
+    return sendAll(out.data(), out.size());
+}
+
+bool MockPoolSV2::recvFrame(uint8_t *msgType, std::vector<uint8_t> &payload)
+{
+    uint8_t hdr[SV2_FRAME_HEADER_SIZE + NOISE_MAC_SIZE];
+    uint8_t nonce[12];
+    if (!recvExact(hdr, sizeof(hdr))) {
+        return false;
+    }
+    build_nonce(m_recvNonce++, nonce);
+    if (mbedtls_chachapoly_auth_decrypt(&m_recvAead, SV2_FRAME_HEADER_SIZE, nonce, NULL, 0,
+                                        hdr + SV2_FRAME_HEADER_SIZE, hdr, hdr)) {
+        ESP_LOGE(TAG, "frame header doesn't authenticate");
+        return false;
+    }
+    sv2_frame_header_t header;
+    sv2_parse_frame_header(hdr, &header);
+    *msgType = header.msg_type;
+
+    payload.resize(header.msg_length + NOISE_MAC_SIZE);
+    if (!header.msg_length) {
+        payload.clear();
+        return true;
+    }
+    if (!recvExact(payload.data(), payload.size())) {
+        return false;
+    }
+    build_nonce(m_recvNonce++, nonce);
+    if (mbedtls_chachapoly_auth_decrypt(&m_recvAead, header.msg_length, nonce, NULL, 0,
+                                        payload.data() + header.msg_length, payload.data(), payload.data())) {
+        ESP_LOGE(TAG, "payload doesn't authenticate");
+        return false;
+    }
+    payload.resize(header.msg_length);
+    return true;
+}
+
+bool MockPoolSV2::openChannel(const std::vector<uint8_t> &payload)
+{
+    if (payload.size() < 5) {
+        return false;
+    }
+    uint32_t requestId = get_u32(payload.data());
+
+    uint8_t target[32];
+    difficulty_to_target(m_difficulty, target);
+
+    std::vector<uint8_t> reply;
+    put_u32(reply, requestId);
+    put_u32(reply, m_channelId);
+    reply.insert(reply.end(), target, target + 32);
+    if (!m_standard) {
+        put_u16(reply, m_extranonceSize);
+    }
+    reply.push_back(sizeof(m_extranoncePrefix));
+    reply.insert(reply.end(), m_extranoncePrefix, m_extranoncePrefix + sizeof(m_extranoncePrefix));
+    put_u32(reply, 0);
+
+    m_channelOpen = true;
+    ESP_LOGI(TAG, "%s channel open", m_standard ? "standard" : "extended");
+    return sendFrame(m_standard ? SV2_MSG_OPEN_STANDARD_MINING_CHANNEL_SUCCESS
+                                : SV2_MSG_OPEN_EXTENDED_MINING_CHANNEL_SUCCESS,
+                     false, reply);
+}
+
+// a future job and the prev hash that activates it, a new block every time
+bool MockPoolSV2::sendJob()
+{
+    job_t job;
+    job.id = m_nextJob++;
+
+    // coinbase like the V1 mock pool: the extranonce prefix and the
+    // extranonce of the miner at the end of the input script
+    uint32_t height = 900000 + m_stats.notifies;
+    job.coinbasePrefix = {0x01, 0x00, 0x00, 0x00, 0x01};
+    job.coinbasePrefix.insert(job.coinbasePrefix.end(), 32, 0x00);
+    job.coinbasePrefix.insert(job.coinbasePrefix.end(), {0xff, 0xff, 0xff, 0xff});
+    job.coinbasePrefix.push_back(1 + 3 + 8 + sizeof(m_extranoncePrefix) + m_extranonceSize);
+    job.coinbasePrefix.insert(job.coinbasePrefix.end(),
+                              {0x03, (uint8_t) height, (uint8_t) (height >> 8), (uint8_t) (height >> 16)});
+    for (int i = 0; i < 8; i++) {
+        job.coinbasePrefix.push_back((uint8_t) random());
+    }
+
+    job.coinbaseSuffix = {0xff, 0xff, 0xff, 0xff, 0x01};
+    uint64_t value = 312500000;
+    for (int i = 0; i < 8; i++) {
+        job.coinbaseSuffix.push_back((uint8_t) (value >> (8 * i)));
+    }
+    job.coinbaseSuffix.insert(job.coinbaseSuffix.end(), {0x16, 0x00, 0x14});
+    for (int i = 0; i < 20; i++) {
+        job.coinbaseSuffix.push_back((uint8_t) random());
+    }
+    job.coinbaseSuffix.insert(job.coinbaseSuffix.end(), {0x00, 0x00, 0x00, 0x00});
+
+    for (int b = 0; b < m_merkleBranches; b++) {
+        std::vector<uint8_t> branch(32);
+        for (auto &byte : branch) {
+            byte = (uint8_t) random();
+        }
+        job.branches.push_back(branch);
+    }
+
+    // the standard channel gets the merkle root of the coinbase with a zero extranonce
+    std::vector<uint8_t> coinbase = job.coinbasePrefix;
+    coinbase.insert(coinbase.end(), m_extranoncePrefix, m_extranoncePrefix + sizeof(m_extranoncePrefix));
+    coinbase.insert(coinbase.end(), m_extranonceSize, 0x00);
+    coinbase.insert(coinbase.end(), job.coinbaseSuffix.begin(), job.coinbaseSuffix.end());
+    merkle_root(coinbase, job.branches, job.merkleRoot);
+
+    for (auto &byte : job.prev) {
+        byte = (uint8_t) random();
+    }
+    job.version = 0x20000000;
+    job.nbits = NBITS;
+    job.ntime = (uint32_t) time(NULL);
+
+    std::vector<uint8_t> msg;
+    put_u32(msg, m_channelId);
+    put_u32(msg, job.id);
+    msg.push_back(0x00); // no min_ntime: future job
+    put_u32(msg, job.version);
+    if (m_standard) {
+        msg.insert(msg.end(), job.merkleRoot, job.merkleRoot + 32);
+    } else {
+        msg.push_back(0x01); // version rolling allowed
+        msg.push_back((uint8_t) job.branches.size());
+        for (const auto &branch : job.branches) {
+            msg.insert(msg.end(), branch.begin(), branch.end());
+        }
+        put_u16(msg, (uint16_t) job.coinbasePrefix.size());
+        msg.insert(msg.end(), job.coinbasePrefix.begin(), job.coinbasePrefix.end());
+        put_u16(msg, (uint16_t) job.coinbaseSuffix.size());
+        msg.insert(msg.end(), job.coinbaseSuffix.begin(), job.coinbaseSuffix.end());
+    }
+
+    std::vector<uint8_t> prevHash;
+    put_u32(prevHash, m_channelId);
+    put_u32(prevHash, job.id);
+    prevHash.insert(prevHash.end(), job.prev, job.prev + 32);
+    put_u32(prevHash, job.ntime);
+    put_u32(prevHash, job.nbits);
+
+    job.sentUs = esp_timer_get_time();
+    {
+        pthread_mutex_lock(&m_mutex);
+        m_jobs.push_front(job);
+        if (m_jobs.size() > JOB_HISTORY) {
+            m_jobs.pop_back();
+        }
+        m_notifies.push_back({std::vector<uint8_t>(job.prev, job.prev + 32), job.sentUs});
+        m_stats.notifies++;
+        pthread_mutex_unlock(&m_mutex);
+    }
+    return sendFrame(m_standard ? SV2_MSG_NEW_MINING_JOB : SV2_MSG_NEW_EXTENDED_MINING_JOB, true, msg) &&
+           sendFrame(SV2_MSG_SET_NEW_PREV_HASH, true, prevHash);
+}
+
+// 0 accepted, 1 stale, 2 duplicate, 3 low difficulty, 4 invalid
+int MockPoolSV2::checkShare(uint32_t jobId, const uint8_t *extranonce, size_t extranonceLen, uint32_t ntime,
+                            uint32_t nonce, uint32_t version)
+{
+    pthread_mutex_lock(&m_mutex);
+
+    const job_t *job = nullptr;
+    bool current = false;
+    for (size_t i = 0; i < m_jobs.size(); i++) {
+        if (m_jobs[i].id == jobId) {
+            job = &m_jobs[i];
+            current = !i;
+        }
+    }
+
+    int result = 0;
+    uint8_t merkle[32];
+    if (!job) {
+        m_stats.rejectedStale++;
+        result = 1;
+    } else if (((version ^ job->version) & ~m_versionMask) ||
+               (!m_standard && extranonceLen != m_extranonceSize)) {
+        m_stats.rejectedInvalid++;
+        result = 4;
+    } else {
+        if (m_standard) {
+            memcpy(merkle, job->merkleRoot, 32);
+        } else {
+            std::vector<uint8_t> coinbase = job->coinbasePrefix;
+            coinbase.insert(coinbase.end(), m_extranoncePrefix, m_extranoncePrefix + sizeof(m_extranoncePrefix));
+            coinbase.insert(coinbase.end(), extranonce, extranonce + extranonceLen);
+            coinbase.insert(coinbase.end(), job->coinbaseSuffix.begin(), job->coinbaseSuffix.end());
+            merkle_root(coinbase, job->branches, merkle);
+        }
+
+        uint8_t header[80];
+        memcpy(header, &version, 4);
+        memcpy(header + 4, job->prev, 32);
+        memcpy(header + 36, merkle, 32);
+        memcpy(header + 68, &ntime, 4);
+        memcpy(header + 72, &job->nbits, 4);
+        memcpy(header + 76, &nonce, 4);
+
+        char key[128];
+        int len = snprintf(key, sizeof(key), "%u/%08x/%08x/%08x/", jobId, ntime, nonce, version);
+        for (size_t i = 0; i < extranonceLen && len < (int) sizeof(key) - 3; i++) {
+            len += snprintf(key + len, sizeof(key) - len, "%02x", extranonce[i]);
+        }
+
+        // the firmware computes the same double, allow for rounding only
+        if (sim_header_diff(header) < m_difficulty * (1.0 - 1e-9)) {
+            m_stats.rejectedLowDiff++;
+            result = 3;
+        } else if (!m_seen.insert(key).second) {
+            m_stats.rejectedDuplicate++;
+            result = 2;
+        } else {
+            m_stats.accepted++;
+            m_stats.acceptedDiff += m_difficulty;
+        }
+    }
+    if (result && result != 1) {
+        ESP_LOGW(TAG, "share rejected (%d) job %u%s", result, jobId, current ? "" : " (previous)");
+    }
+    pthread_mutex_unlock(&m_mutex);
+    return result;
+}
+
+bool MockPoolSV2::handleSubmit(uint8_t msgType, const std::vector<uint8_t> &payload)
+{
+    {
+        pthread_mutex_lock(&m_mutex);
+        m_stats.submits++;
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    const uint8_t *p = payload.data();
+    bool extended = msgType == SV2_MSG_SUBMIT_SHARES_EXTENDED;
+    if (payload.size() < 24 || (extended && (payload.size() < 25 || payload.size() < 25u + p[24]))) {
+        pthread_mutex_lock(&m_mutex);
+        m_stats.rejectedInvalid++;
+        pthread_mutex_unlock(&m_mutex);
+        return false;
+    }
+    uint32_t seq = get_u32(p + 4);
+    int code = 4;
+    if (extended == !m_standard && get_u32(p) == m_channelId) {
+        code = checkShare(get_u32(p + 8), extended ? p + 25 : nullptr, extended ? p[24] : 0, get_u32(p + 16),
+                          get_u32(p + 12), get_u32(p + 20));
+    } else {
+        pthread_mutex_lock(&m_mutex);
+        m_stats.rejectedInvalid++;
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    std::vector<uint8_t> reply;
+    put_u32(reply, m_channelId);
+    put_u32(reply, seq);
+    if (!code) {
+        put_u32(reply, 1);
+        put_u32(reply, m_difficulty);
+        put_u32(reply, 0);
+        return sendFrame(SV2_MSG_SUBMIT_SHARES_SUCCESS, true, reply);
+    }
+    static const char *const errors[] = {"", "stale-share", "duplicate-share", "difficulty-too-low", "invalid-share"};
+    reply.push_back((uint8_t) strlen(errors[code]));
+    reply.insert(reply.end(), errors[code], errors[code] + strlen(errors[code]));
+    return sendFrame(SV2_MSG_SUBMIT_SHARES_ERROR, true, reply);
+}
+
+bool MockPoolSV2::handleFrame(uint8_t msgType, const std::vector<uint8_t> &payload)
+{
+    switch (msgType) {
+    case SV2_MSG_SETUP_CONNECTION: {
+        // flag 0x01: requires standard jobs
+        if (payload.size() < 9 || payload[0] != 0x00) {
+            return false;
+        }
+        m_standard = get_u32(payload.data() + 5) & 0x01;
+        std::vector<uint8_t> reply;
+        put_u16(reply, 2);
+        put_u32(reply, 0);
+        return sendFrame(SV2_MSG_SETUP_CONNECTION_SUCCESS, false, reply);
+    }
+    case SV2_MSG_OPEN_STANDARD_MINING_CHANNEL:
+    case SV2_MSG_OPEN_EXTENDED_MINING_CHANNEL:
+        if ((msgType == SV2_MSG_OPEN_STANDARD_MINING_CHANNEL) != m_standard) {
+            ESP_LOGE(TAG, "channel type doesn't match the SetupConnection flags");
+            return false;
+        }
+        return openChannel(payload) && sendJob();
+    case SV2_MSG_SUBMIT_SHARES_STANDARD:
+    case SV2_MSG_SUBMIT_SHARES_EXTENDED:
+        return handleSubmit(msgType, payload);
+    default:
+        ESP_LOGW(TAG, "unexpected message 0x%02x", msgType);
+        return true;
+    }
+}
+
+void MockPoolSV2::task()
+{
+    sim_alloc_ignore_thread();
+
+    int64_t nextNotifyUs = 0;
+
+    while (__atomic_load_n(&m_running, __ATOMIC_ACQUIRE)) {
+        if (m_clientFd < 0) {
+            struct pollfd pfd = {m_listenFd, POLLIN, 0};
+            if (poll(&pfd, 1, 100) > 0) {
+                m_clientFd = accept(m_listenFd, NULL, NULL);
+                int one = 1;
+                setsockopt(m_clientFd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                m_channelOpen = false;
+                nextNotifyUs = 0;
+                if (!handshake()) {
+                    ESP_LOGE(TAG, "handshake failed");
+                    close(m_clientFd);
+                    m_clientFd = -1;
+                    continue;
+                }
+                pthread_mutex_lock(&m_mutex);
+                m_stats.handshakes++;
+                pthread_mutex_unlock(&m_mutex);
+                ESP_LOGI(TAG, "miner connected");
+            }
+            continue;
+        }
+
+        struct pollfd pfd = {m_clientFd, POLLIN, 0};
+        if (poll(&pfd, 1, 10) > 0) {
+            uint8_t msgType;
+            std::vector<uint8_t> payload;
+            if (!recvFrame(&msgType, payload) || !handleFrame(msgType, payload)) {
+                ESP_LOGW(TAG, "miner disconnected");
+                close(m_clientFd);
+                m_clientFd = -1;
+                continue;
+            }
+            // the first job goes out with the channel
+            if (!nextNotifyUs && m_channelOpen) {
+                nextNotifyUs = esp_timer_get_time() + (int64_t) m_notifyIntervalMs * 1000;
+            }
+        }
+
+        if (nextNotifyUs && esp_timer_get_time() >= nextNotifyUs) {
+            sendJob();
+            nextNotifyUs += (int64_t) m_notifyIntervalMs * 1000;
+        }
+    }
+}
+
+void *MockPoolSV2::taskWrapper(void *arg)
+{
+    ((MockPoolSV2 *) arg)->task();
+    return NULL;
+}
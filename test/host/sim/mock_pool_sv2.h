@@ -0,0 +1,126 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <deque>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "mbedtls/chachapoly.h"
+
+// Stratum V2 pool on localhost for the host simulation
+//
+// Serves one miner over Noise_NX as the responder, with the secp256k1
+// stand-in of the shim (see shim/secp256k1.h): answers SetupConnection and
+// the standard or extended OpenMiningChannel, sends a future job and its
+// SetNewPrevHash every notify interval and checks each SubmitShares by
+// rebuilding coinbase, merkle root and header at the difficulty scale of
+// sim_diff.h. The server certificate is signed for the authority key of
+// getAuthorityKey().
+class MockPoolSV2 {
+  public:
+    typedef struct
+    {
+        uint32_t handshakes;
+        uint32_t notifies;
+        uint32_t submits;
+        uint32_t accepted;
+        uint32_t rejectedLowDiff;
+        uint32_t rejectedStale;
+        uint32_t rejectedDuplicate;
+        uint32_t rejectedInvalid;
+        double acceptedDiff; // sum of the pool difficulty of the accepted shares
+    } stats_t;
+
+  protected:
+    typedef struct
+    {
+        uint32_t id;
+        std::vector<uint8_t> coinbasePrefix; // in front of the extranonce prefix
+        std::vector<uint8_t> coinbaseSuffix;
+        std::vector<std::vector<uint8_t>> branches;
+        uint8_t merkleRoot[32]; // standard channel, with an extranonce of zeros
+        uint8_t prev[32];       // header byte order
+        uint32_t version;
+        uint32_t nbits;
+        uint32_t ntime;
+        int64_t sentUs;
+    } job_t;
+
+    uint32_t m_difficulty;
+    uint32_t m_notifyIntervalMs;
+    int m_merkleBranches;
+
+    int m_listenFd = -1;
+    int m_clientFd = -1;
+    uint16_t m_port = 0;
+    pthread_t m_thread;
+    bool m_running = false;
+
+    // Noise transport keys after the handshake
+    mbedtls_chachapoly_context m_sendAead;
+    mbedtls_chachapoly_context m_recvAead;
+    uint8_t m_sendKey[32];
+    uint64_t m_sendNonce = 0;
+    uint64_t m_recvNonce = 0;
+
+    uint8_t m_authorityKey[32];
+
+    bool m_standard = false;
+    bool m_channelOpen = false;
+    uint32_t m_channelId = 7;
+    uint8_t m_extranoncePrefix[4] = {0xf0, 0x00, 0x00, 0x0d};
+    uint8_t m_extranonceSize = 8;
+    uint32_t m_versionMask = 0x1fffe000;
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    std::deque<job_t> m_jobs; // the newest job is in front
+    std::vector<std::pair<std::vector<uint8_t>, int64_t>> m_notifies;
+    std::set<std::string> m_seen;
+    uint32_t m_nextJob = 1;
+    uint32_t m_seed = 0x9e3779b9;
+
+    stats_t m_stats = {};
+
+    void task();
+    static void *taskWrapper(void *arg);
+
+    bool recvExact(uint8_t *buf, size_t len);
+    bool sendAll(const uint8_t *buf, size_t len);
+    bool handshake();
+    // encrypted header and payload with the next two send nonces
+    std::vector<uint8_t> encodeFrame(uint8_t msgType, bool channelMsg, const std::vector<uint8_t> &payload);
+    bool sendFrame(uint8_t msgType, bool channelMsg, const std::vector<uint8_t> &payload);
+    bool recvFrame(uint8_t *msgType, std::vector<uint8_t> &payload);
+
+    bool handleFrame(uint8_t msgType, const std::vector<uint8_t> &payload);
+    bool openChannel(const std::vector<uint8_t> &payload);
+    bool sendJob();
+    bool handleSubmit(uint8_t msgType, const std::vector<uint8_t> &payload);
+    int checkShare(uint32_t jobId, const uint8_t *extranonce, size_t extranonceLen, uint32_t ntime, uint32_t nonce,
+                   uint32_t version);
+    uint32_t random();
+
+  public:
+    MockPoolSV2(uint32_t difficulty, uint32_t notifyIntervalMs, int merkleBranches);
+    ~MockPoolSV2();
+
+    // listens on 127.0.0.1 with a free port
+    bool start();
+    void stop();
+
+    uint16_t getPort()
+    {
+        return m_port;
+    }
+
+    // base58check of the authority key, the format of the SV2 settings
+    std::string getAuthorityKey();
+
+    void getStats(stats_t *stats);
+
+    // prev block hashes (header byte order) and send times of the new blocks
+    std::vector<std::pair<std::vector<uint8_t>, int64_t>> getNotifies();
+};
@@ -0,0 +1,20 @@
+#include "mining.h"
+#include "sim_diff.h"
+
+// the firmware's nonce check at the scale of the simulation, linked with
+// -Wl,--wrap for the mangled name of test_nonce_value
+extern "C" double __real__Z16test_nonce_valuePK6bm_jobjjjjPb(const bm_job *job, uint32_t nonce, uint32_t rolled_version,
+                                                               uint32_t min_diff, uint32_t hw_min_diff, bool *hw_error);
+
+extern "C" double __wrap__Z16test_nonce_valuePK6bm_jobjjjjPb(const bm_job *job, uint32_t nonce, uint32_t rolled_version,
+                                                               uint32_t min_diff, uint32_t hw_min_diff, bool *hw_error)
+{
+    double diff = __real__Z16test_nonce_valuePK6bm_jobjjjjPb(job, nonce, rolled_version, 0, 0, nullptr) * SIM_DIFF_SCALE;
+    if (hw_error) {
+        *hw_error = diff < (double) hw_min_diff;
+    }
+    if (min_diff && diff < (double) min_diff) {
+        return 0.0;
+    }
+    return diff;
+}
@@ -0,0 +1,72 @@
+#include "esp_log.h"
+
+#include "bm1366.h"
+#include "bm1368.h"
+#include "bm1370.h"
+#include "serial.h"
+
+#include "sim_board.h"
+
+static const char *TAG = "sim-board";
+
+SimBoard::SimBoard(SimChain::Family family, int chips) : Board()
+{
+    m_deviceModel = "host";
+    m_miningAgent = "host";
+    m_version = 0;
+    m_asicCount = chips;
+    m_fanInvertPolarity = false;
+    m_fanPerc = 100;
+    m_flipScreen = false;
+    m_maxPin = 100.0f;
+    m_minPin = 0.0f;
+    m_maxVin = 13.0f;
+    m_minVin = 11.0f;
+    m_defaultAsicVoltageMillis = m_asicVoltageMillis = 1200;
+
+    switch (family) {
+    case SimChain::BM1366:
+        m_asicModel = "BM1366";
+        m_asicJobIntervalMs = 1500;
+        m_defaultAsicFrequency = m_asicFrequency = 485;
+        m_asicMaxDifficulty = 256;
+        m_asicMinDifficulty = 64;
+        m_asics = new BM1366();
+        break;
+    case SimChain::BM1368:
+        m_asicModel = "BM1368";
+        m_asicJobIntervalMs = 1200;
+        m_defaultAsicFrequency = m_asicFrequency = 490;
+        m_asicMaxDifficulty = 1024;
+        m_asicMinDifficulty = 256;
+        m_asics = new BM1368();
+        break;
+    case SimChain::BM1370:
+        m_asicModel = "BM1370";
+        m_asicJobIntervalMs = 500;
+        m_defaultAsicFrequency = m_asicFrequency = 600;
+        m_asicMaxDifficulty = 2048;
+        m_asicMinDifficulty = 512;
+        m_asics = new BM1370();
+        break;
+    }
+    m_asicMinDifficultyDualPool = m_asicMinDifficulty / 2;
+    m_defaultVrFrequency = m_asics->getDefaultVrFrequency();
+}
+
+// the init sequence of the boards after power and reset
+bool SimBoard::initAsics()
+{
+    SERIAL_clear_buffer();
+    m_chipsDetected = m_asics->init(m_asicFrequency, m_asicCount, m_asicMaxDifficulty, m_vrFrequency);
+    if (!m_chipsDetected) {
+        ESP_LOGE(TAG, "error initializing asics!");
+        return false;
+    }
+    int maxBaud = m_asics->setMaxBaud();
+    SERIAL_set_baud(maxBaud);
+    SERIAL_clear_buffer();
+
+    m_isInitialized = true;
+    return true;
+}
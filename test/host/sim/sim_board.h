@@ -0,0 +1,70 @@
+#pragma once
+
+#include "boards/board.h"
+
+#include "sim_chain.h"
+
+// Board with the ASIC settings of a real board of the chip family and no
+// power, fan or temperature hardware
+//
+// BM1366: NerdAxe, BM1368: NerdQAxe+, BM1370: NerdQAxe++
+class SimBoard : public Board {
+  public:
+    SimBoard(SimChain::Family family, int chips);
+
+    bool initAsics() override;
+
+    bool setVoltage(float core_voltage) override
+    {
+        return true;
+    }
+    void setFanPolarity(bool invert) override
+    {
+    }
+    void setFanSpeedCh(int channel, float perc) override
+    {
+    }
+    void getFanSpeedCh(int channel, uint16_t *rpm) override
+    {
+        *rpm = 0;
+    }
+    float getTemperature(int index) override
+    {
+        return 50.0f;
+    }
+    float getVRTemp() override
+    {
+        return 50.0f;
+    }
+    bool isPIDAvailable() override
+    {
+        return false;
+    }
+    float getVin() override
+    {
+        return 12.0f;
+    }
+    float getIin() override
+    {
+        return 0.0f;
+    }
+    float getPin() override
+    {
+        return 0.0f;
+    }
+    float getVout() override
+    {
+        return (float) m_asicVoltageMillis / 1000.0f;
+    }
+    float getIout() override
+    {
+        return 0.0f;
+    }
+    float getPout() override
+    {
+        return 0.0f;
+    }
+    void requestBuckTelemtry() override
+    {
+    }
+};
@@ -0,0 +1,491 @@
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "asic.h"
+#include "crc.h"
+#include "mining_utils.h"
+#include "serial.h"
+
+#include "alloc_count.h"
+#include "sim_chain.h"
+#include "sim_diff.h"
+
+static const char *TAG = "sim-chain";
+
+static const uint8_t CHIP_IDS[] = {0x66, 0x68, 0x70};
+
+// raw temperature reading of 55°C, see the 0xb4 reply in asic_result_task
+static const uint32_t TEMP_RAW = 2069;
+
+// time from a PLL0 write until the chip reports the lock
+static const int64_t PLL_LOCK_US = 2000;
+
+// 4 byte words in reverse order, how the jobs carry merkle root and prev block hash
+static void reverse_words(const uint8_t *in, uint8_t *out)
+{
+    for (int i = 0; i < 8; i++) {
+        memcpy(out + i * 4, in + (7 - i) * 4, 4);
+    }
+}
+
+static void abs_deadline(struct timespec *ts, uint32_t timeoutMs)
+{
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ts->tv_sec += timeoutMs / 1000;
+    ts->tv_nsec += (long) (timeoutMs % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+SimChain::SimChain(Family family, int chips, float noncesPerSecond)
+    : m_family(family), m_numChips(chips), m_noncesPerSecond(noncesPerSecond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&m_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    m_chips.resize(chips);
+    for (auto &chip : m_chips) {
+        chip = {0, false, 0, 0};
+    }
+}
+
+SimChain::~SimChain()
+{
+    stop();
+    pthread_cond_destroy(&m_cond);
+}
+
+const char *SimChain::familyName(Family family)
+{
+    switch (family) {
+    case BM1366:
+        return "BM1366";
+    case BM1368:
+        return "BM1368";
+    default:
+        return "BM1370";
+    }
+}
+
+bool SimChain::parseFamily(const char *name, Family *family)
+{
+    for (Family f : {BM1366, BM1368, BM1370}) {
+        if (!strcasecmp(name, familyName(f))) {
+            *family = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+void SimChain::start()
+{
+    m_running = true;
+    pthread_create(&m_thread, NULL, taskWrapper, this);
+}
+
+void SimChain::stop()
+{
+    if (!m_running) {
+        return;
+    }
+    {
+        pthread_mutex_lock(&m_mutex);
+        m_running = false;
+        pthread_cond_broadcast(&m_cond);
+        pthread_mutex_unlock(&m_mutex);
+    }
+    pthread_join(m_thread, NULL);
+}
+
+uint32_t SimChain::random()
+{
+    // xorshift32, reproducible runs
+    m_seed ^= m_seed << 13;
+    m_seed ^= m_seed >> 17;
+    m_seed ^= m_seed << 5;
+    return m_seed;
+}
+
+void SimChain::write(const uint8_t *data, int len)
+{
+    SimAllocPause pause;
+    pthread_mutex_lock(&m_mutex);
+    m_tx.insert(m_tx.end(), data, data + len);
+    parseTx();
+    pthread_mutex_unlock(&m_mutex);
+}
+
+int SimChain::read(uint8_t *buf, int size, uint32_t timeoutMs)
+{
+    struct timespec deadline;
+    abs_deadline(&deadline, timeoutMs);
+
+    pthread_mutex_lock(&m_mutex);
+    while ((int) m_rx.size() < size) {
+        if (pthread_cond_timedwait(&m_cond, &m_mutex, &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    int n = std::min(size, (int) m_rx.size());
+    memcpy(buf, m_rx.data(), n);
+    m_rx.erase(m_rx.begin(), m_rx.begin() + n);
+    pthread_mutex_unlock(&m_mutex);
+    return n;
+}
+
+void SimChain::clear()
+{
+    pthread_mutex_lock(&m_mutex);
+    m_rx.clear();
+    pthread_mutex_unlock(&m_mutex);
+}
+
+void SimChain::getStats(stats_t *stats)
+{
+    pthread_mutex_lock(&m_mutex);
+    *stats = m_stats;
+    pthread_mutex_unlock(&m_mutex);
+}
+
+int64_t SimChain::firstJobUs(const uint8_t prev[32])
+{
+    pthread_mutex_lock(&m_mutex);
+    auto it = m_firstJobUs.find(std::vector<uint8_t>(prev, prev + 32));
+    int64_t us = (it == m_firstJobUs.end()) ? 0 : it->second;
+    pthread_mutex_unlock(&m_mutex);
+    return us;
+}
+
+// packets: 55 AA header length data crc, length counts everything after the preamble
+void SimChain::parseTx()
+{
+    size_t pos = 0;
+    while (m_tx.size() - pos >= 4) {
+        if (m_tx[pos] != 0x55 || m_tx[pos + 1] != 0xAA) {
+            pos++;
+            continue;
+        }
+        int total = m_tx[pos + 3] + 2;
+        if (total < 5) {
+            pos++;
+            continue;
+        }
+        if (m_tx.size() - pos < (size_t) total) {
+            break;
+        }
+
+        const uint8_t *packet = m_tx.data() + pos;
+        bool job = packet[2] & TYPE_JOB;
+        bool crc_ok;
+        if (job) {
+            uint16_t crc = crc16_false(packet + 2, total - 4);
+            crc_ok = packet[total - 2] == (crc >> 8) && packet[total - 1] == (crc & 0xff);
+        } else {
+            crc_ok = crc5(packet + 2, total - 3) == packet[total - 1];
+        }
+
+        if (!crc_ok) {
+            m_stats.crcErrors++;
+            pos++;
+            continue;
+        }
+
+        if (job) {
+            handleJob(packet, total);
+        } else {
+            handleCommand(packet, total);
+        }
+        pos += total;
+    }
+    m_tx.erase(m_tx.begin(), m_tx.begin() + pos);
+}
+
+void SimChain::handleCommand(const uint8_t *packet, int len)
+{
+    m_stats.commands++;
+
+    uint8_t header = packet[2];
+    const uint8_t *data = packet + 4;
+    bool all = header & GROUP_ALL;
+
+    switch (header & 0x0f) {
+    case CMD_SETADDRESS:
+        for (auto &chip : m_chips) {
+            if (!chip.addressed) {
+                chip.address = data[0];
+                chip.addressed = true;
+                break;
+            }
+        }
+        break;
+    case CMD_INACTIVE:
+        for (auto &chip : m_chips) {
+            chip.addressed = false;
+        }
+        break;
+    case CMD_WRITE: {
+        if (len < 11) {
+            break;
+        }
+        uint8_t reg = data[1];
+        uint32_t value = ((uint32_t) data[2] << 24) | ((uint32_t) data[3] << 16) | ((uint32_t) data[4] << 8) | data[5];
+        for (auto &chip : m_chips) {
+            if (!all && chip.address != data[0]) {
+                continue;
+            }
+            if (reg == PLL0_PARAMETER) {
+                chip.pll0 = value & ~PLL0_LOCKED;
+                chip.pllWrittenUs = esp_timer_get_time();
+            }
+        }
+        if (reg == TICKET_MASK) {
+            // the bytes are bit reversed, see Asic::setJobDifficultyMask
+            uint32_t mask = 0;
+            for (int i = 0; i < 4; i++) {
+                mask |= (uint32_t) _reverse_bits(data[5 - i]) << (8 * i);
+            }
+            m_ticketMask = mask;
+        }
+        break;
+    }
+    case CMD_READ: {
+        uint8_t reg = data[1];
+        for (auto &chip : m_chips) {
+            if (!all && chip.address != data[0]) {
+                continue;
+            }
+            uint32_t value = 0;
+            switch (reg) {
+            case 0x00:
+                value = 0x13000000 | ((uint32_t) CHIP_IDS[m_family] << 16);
+                break;
+            case PLL0_PARAMETER:
+                value = chip.pll0;
+                if (esp_timer_get_time() - chip.pllWrittenUs >= PLL_LOCK_US) {
+                    value |= PLL0_LOCKED;
+                }
+                break;
+            case 0xb4:
+                value = 0x80000000 | TEMP_RAW;
+                break;
+            default:
+                break;
+            }
+            pushRegister(chip.address, reg, value);
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void SimChain::handleJob(const uint8_t *packet, int len)
+{
+    if (len != (int) sizeof(BM1368_job) + 6) {
+        return;
+    }
+    m_stats.jobs++;
+
+    BM1368_job in;
+    memcpy(&in, packet + 4, sizeof(in));
+
+    job_t *job = &m_jobs[in.job_id & 0x7f];
+    memcpy(job->header, in.version, 4);
+    reverse_words(in.prev_block_hash, job->header + 4);
+    reverse_words(in.merkle_root, job->header + 36);
+    memcpy(job->header + 68, in.ntime, 4);
+    memcpy(job->header + 72, in.nbits, 4);
+    memset(job->header + 76, 0, 4);
+    memcpy(&job->version, in.version, 4);
+    job->receivedUs = esp_timer_get_time();
+    job->valid = true;
+
+    // the chips switch to a new job right away
+    m_currentJob = in.job_id & 0x7f;
+
+    std::vector<uint8_t> prev(job->header + 4, job->header + 36);
+    if (!m_firstJobUs.count(prev)) {
+        m_firstJobUs[prev] = job->receivedUs;
+    }
+}
+
+// crc5 in the low bits of the last byte, 0x80 marks job results
+void SimChain::pushFrame(uint8_t *frame)
+{
+    uint8_t flags = frame[10] & 0xe0;
+    for (int c = 0; c < 32; c++) {
+        frame[10] = flags | c;
+        if (crc5_check(frame + 2, 9)) {
+            m_rx.insert(m_rx.end(), frame, frame + 11);
+            pthread_cond_broadcast(&m_cond);
+            return;
+        }
+    }
+    ESP_LOGE(TAG, "no crc5 for the result frame");
+}
+
+void SimChain::pushRegister(uint8_t chipAddress, uint8_t reg, uint32_t value)
+{
+    uint8_t frame[11] = {0xAA, 0x55};
+    frame[2] = value >> 24;
+    frame[3] = value >> 16;
+    frame[4] = value >> 8;
+    frame[5] = value;
+    frame[6] = chipAddress;
+    frame[7] = reg;
+    frame[10] = 0x00;
+    pushFrame(frame);
+    m_stats.registerReplies++;
+}
+
+// searches a nonce above the ticket mask on the current job, called without the mutex
+bool SimChain::mineNonce(int chipIndex)
+{
+    pthread_mutex_lock(&m_mutex);
+    if (m_currentJob < 0) {
+        pthread_mutex_unlock(&m_mutex);
+        return false;
+    }
+    int jobId = m_currentJob;
+    job_t job = m_jobs[jobId];
+    uint8_t address = m_chips[chipIndex].address;
+    uint32_t target = m_ticketMask + 1;
+    uint32_t start = random();
+    uint16_t rolled = (uint16_t) random();
+    uint8_t low = (uint8_t) random();
+    pthread_mutex_unlock(&m_mutex);
+
+    // the chips roll the version bits 13..28
+    uint32_t version = job.version | ((uint32_t) rolled << 13);
+    memcpy(job.header, &version, 4);
+
+    uint64_t hashes = 0;
+    for (uint32_t c = start;; c++) {
+        // nonce bits 17..24 (big endian) carry the chip address
+        uint32_t nonce_h = ((c >> 17) << 25) | ((uint32_t) address << 17) | (c & 0x1ffff);
+        uint32_t nonce = __builtin_bswap32(nonce_h);
+        memcpy(job.header + 76, &nonce, 4);
+        hashes++;
+        if (sim_header_diff(job.header) < target) {
+            continue;
+        }
+
+        uint8_t frame[11] = {0xAA, 0x55};
+        memcpy(frame + 2, &nonce, 4);
+        frame[6] = 0;
+        if (m_family == BM1366) {
+            frame[7] = jobId | (low & 0x07);
+        } else {
+            frame[7] = (jobId << 1) | (low & 0x0f);
+        }
+        uint16_t version_bits = __builtin_bswap16(rolled);
+        memcpy(frame + 8, &version_bits, 2);
+        frame[10] = 0x80;
+
+        pthread_mutex_lock(&m_mutex);
+        pushFrame(frame);
+        m_stats.nonces++;
+        m_stats.hashes += hashes;
+        pthread_mutex_unlock(&m_mutex);
+        return true;
+    }
+}
+
+void SimChain::task()
+{
+    sim_alloc_ignore_thread();
+
+    int64_t last = esp_timer_get_time();
+    double credit = 0.0;
+
+    while (true) {
+        struct timespec deadline;
+        abs_deadline(&deadline, 1);
+        pthread_mutex_lock(&m_mutex);
+        if (m_running) {
+            pthread_cond_timedwait(&m_cond, &m_mutex, &deadline);
+        }
+        bool running = m_running;
+        bool mining = m_currentJob >= 0;
+        pthread_mutex_unlock(&m_mutex);
+
+        if (!running) {
+            break;
+        }
+
+        int64_t now = esp_timer_get_time();
+        if (mining) {
+            // a chain that fell behind doesn't catch up with a burst
+            credit = std::min(credit + m_noncesPerSecond * (now - last) / 1e6, (double) m_noncesPerSecond / 10.0 + 1.0);
+        }
+        last = now;
+
+        while (credit >= 1.0) {
+            credit -= 1.0;
+            mineNonce(m_nextChip);
+            m_nextChip = (m_nextChip + 1) % m_numChips;
+        }
+    }
+}
+
+void *SimChain::taskWrapper(void *arg)
+{
+    ((SimChain *) arg)->task();
+    return NULL;
+}
+
+// serial.h on top of the simulated chain
+static SimChain *s_chain = nullptr;
+
+void sim_serial_attach(SimChain *chain)
+{
+    s_chain = chain;
+}
+
+void SERIAL_init(void)
+{
+}
+
+void SERIAL_set_baud(int baud)
+{
+    ESP_LOGI(TAG, "baud %d", baud);
+}
+
+int SERIAL_send(uint8_t *data, int len)
+{
+    if (s_chain) {
+        s_chain->write(data, len);
+    }
+    return len;
+}
+
+int16_t SERIAL_rx(uint8_t *buf, uint16_t size, uint16_t timeout_ms)
+{
+    if (!s_chain) {
+        vTaskDelay(pdMS_TO_TICKS(timeout_ms));
+        return 0;
+    }
+    return (int16_t) s_chain->read(buf, size, timeout_ms);
+}
+
+void SERIAL_clear_buffer(void)
+{
+    if (s_chain) {
+        s_chain->clear();
+    }
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <map>
+#include <vector>
+
+// Simulated chain of BM1366/BM1368/BM1370 chips behind the serial port
+//
+// Decodes the command and job packets the drivers send, answers register
+// reads (chip id, PLL0, temperature) and returns nonces for the current job
+// in the result frame format of the chip family. The chips hash for real,
+// at the difficulty scale of sim_diff.h, and find nonces at a fixed rate
+// per chain instead of a hashrate.
+class SimChain {
+  public:
+    enum Family
+    {
+        BM1366,
+        BM1368,
+        BM1370
+    };
+
+    typedef struct
+    {
+        uint32_t jobs;            // job packets received
+        uint32_t commands;        // command packets received
+        uint32_t crcErrors;       // packets with a wrong crc
+        uint32_t nonces;          // result frames returned
+        uint32_t registerReplies; // register frames returned
+        uint64_t hashes;          // headers hashed to find the nonces
+    } stats_t;
+
+  protected:
+    typedef struct
+    {
+        uint8_t address;
+        bool addressed;
+        uint32_t pll0;
+        int64_t pllWrittenUs; // the lock bit reads back set PLL_LOCK_US later
+    } chip_t;
+
+    typedef struct
+    {
+        bool valid;
+        uint8_t header[80]; // version | prev | merkle | ntime | nbits | nonce
+        uint32_t version;
+        int64_t receivedUs;
+    } job_t;
+
+    Family m_family;
+    int m_numChips;
+    float m_noncesPerSecond;
+    std::vector<chip_t> m_chips;
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t m_cond;
+    pthread_t m_thread;
+    bool m_running = false;
+
+    // serial line, firmware -> chips and chips -> firmware
+    std::vector<uint8_t> m_tx;
+    std::vector<uint8_t> m_rx;
+
+    job_t m_jobs[128] = {};
+    int m_currentJob = -1;
+    uint32_t m_ticketMask = 0xff;
+    uint32_t m_seed = 0x12345678;
+    int m_nextChip = 0;
+
+    // first job per prev block hash, for the notify to work latency
+    std::map<std::vector<uint8_t>, int64_t> m_firstJobUs;
+
+    stats_t m_stats = {};
+
+    void parseTx();
+    void handleCommand(const uint8_t *packet, int len);
+    void handleJob(const uint8_t *packet, int len);
+    void pushRegister(uint8_t chipAddress, uint8_t reg, uint32_t value);
+    void pushFrame(uint8_t *frame);
+    bool mineNonce(int chip);
+    uint32_t random();
+
+    void task();
+    static void *taskWrapper(void *arg);
+
+  public:
+    SimChain(Family family, int chips, float noncesPerSecond);
+    ~SimChain();
+
+    void start();
+    void stop();
+
+    // serial.h side
+    void write(const uint8_t *data, int len);
+    int read(uint8_t *buf, int size, uint32_t timeoutMs);
+    void clear();
+
+    void getStats(stats_t *stats);
+
+    // time the first job with this prev block hash (header byte order) arrived, 0 if none
+    int64_t firstJobUs(const uint8_t prev[32]);
+
+    static const char *familyName(Family family);
+    static bool parseFamily(const char *name, Family *family);
+};
+
+// the chain SERIAL_send/SERIAL_rx talk to
+void sim_serial_attach(SimChain *chain);
@@ -0,0 +1,31 @@
+#include <string.h>
+
+#include "mbedtls/sha256.h"
+
+#include "sim_diff.h"
+
+// 0x00000000FFFF0000000000000000000000000000000000000000000000000000
+static const double truediffone = 26959535291011309493156476344723991336010898738574164086137773096960.0;
+
+void sim_sha256d(const uint8_t *data, int len, uint8_t hash[32])
+{
+    uint8_t first[32];
+    mbedtls_sha256(data, len, first, 0);
+    mbedtls_sha256(first, 32, hash, 0);
+}
+
+double sim_header_diff(const uint8_t header[80])
+{
+    uint8_t hash[32];
+    sim_sha256d(header, 80, hash);
+
+    // the hash is a little endian 256 bit number
+    double value = 0.0;
+    for (int i = 31; i >= 0; i--) {
+        value = value * 256.0 + hash[i];
+    }
+    if (value == 0.0) {
+        return 0.0;
+    }
+    return truediffone / value * SIM_DIFF_SCALE;
+}
@@ -0,0 +1,15 @@
+#pragma once
+
+#include <stdint.h>
+
+// A nonce of difficulty 1 takes 2^32 hashes on the real chips. The simulation
+// scales every difficulty by 2^32, so a nonce of difficulty d takes about d
+// hashes: the simulated chips and the mock pool use sim_header_diff(), the
+// firmware's test_nonce_value() is wrapped at link time (nonce_wrap.cpp).
+#define SIM_DIFF_SCALE 4294967296.0
+
+// scaled difficulty of an 80 byte block header
+double sim_header_diff(const uint8_t header[80]);
+
+// sha256(sha256(data))
+void sim_sha256d(const uint8_t *data, int len, uint8_t hash[32]);
@@ -0,0 +1,322 @@
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "esp_log.h"
+
+#include "virtual_can_bus.h"
+
+static const char *TAG = "can-bus";
+
+// longest sleep of the bus thread, bounds the time the destructor waits
+static const int64_t POLL_MAX_NS = 10 * 1000000LL;
+
+static int64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+VirtualCanBus::VirtualCanBus(int nodes, uint32_t bitrate) : m_bitrate(bitrate)
+{
+    m_nodes.resize(nodes);
+    for (auto &node : m_nodes) {
+        int fds[2] = {-1, -1};
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds)) {
+            ESP_LOGE(TAG, "socketpair: %s", strerror(errno));
+        }
+        node.busFd = fds[0];
+        node.nodeFd = fds[1];
+        node.alive = fds[0] >= 0;
+        node.stats = {};
+    }
+}
+
+VirtualCanBus::~VirtualCanBus()
+{
+    if (m_running) {
+        __atomic_store_n(&m_running, false, __ATOMIC_RELEASE);
+        pthread_join(m_thread, NULL);
+    }
+    for (auto &node : m_nodes) {
+        if (node.busFd >= 0) {
+            close(node.busFd);
+        }
+        if (node.nodeFd >= 0) {
+            close(node.nodeFd);
+        }
+    }
+}
+
+void VirtualCanBus::forked(int node)
+{
+    for (int i = 0; i < (int) m_nodes.size(); i++) {
+        close(m_nodes[i].busFd);
+        m_nodes[i].busFd = -1;
+        if (i != node) {
+            close(m_nodes[i].nodeFd);
+            m_nodes[i].nodeFd = -1;
+        }
+    }
+}
+
+bool VirtualCanBus::start(int localNode)
+{
+    // the sockets of forked nodes are only open in their processes, the bus
+    // sees EOF when one exits
+    for (int i = 0; i < (int) m_nodes.size(); i++) {
+        if (!m_nodes[i].alive) {
+            return false;
+        }
+        if (i != localNode) {
+            close(m_nodes[i].nodeFd);
+            m_nodes[i].nodeFd = -1;
+        }
+    }
+    m_startNs = monotonic_ns();
+    m_running = true;
+    pthread_create(&m_thread, NULL, taskWrapper, this);
+    return true;
+}
+
+void VirtualCanBus::getStats(stats_t *stats, int node)
+{
+    pthread_mutex_lock(&m_mutex);
+    if (node >= 0) {
+        *stats = m_nodes[node].stats;
+    } else {
+        *stats = {};
+        for (const auto &n : m_nodes) {
+            stats->frames += n.stats.frames;
+            stats->bits += n.stats.bits;
+            stats->stuffBits += n.stats.stuffBits;
+            stats->arbLost += n.stats.arbLost;
+            stats->waitUs += n.stats.waitUs;
+            stats->maxWaitUs = std::max(stats->maxWaitUs, n.stats.maxWaitUs);
+        }
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
+float VirtualCanBus::getLoad()
+{
+    pthread_mutex_lock(&m_mutex);
+    int64_t elapsed = monotonic_ns() - m_startNs;
+    float load = elapsed > 0 ? (float) m_busyNs / (float) elapsed * 100.0f : 0.0f;
+    pthread_mutex_unlock(&m_mutex);
+    return load;
+}
+
+// SOF, identifier, RTR, IDE, r0, DLC, data and the CRC-15 are bit stuffed,
+// CRC delimiter, ACK, EOF and the interframe space (13 bits) are not
+uint32_t VirtualCanBus::frameBits(const twai_message_t *msg, uint32_t *stuffBits)
+{
+    uint8_t bits[19 + 64 + 15];
+    int n = 0;
+    auto put = [&](uint32_t value, int count) {
+        for (int i = count - 1; i >= 0; i--) {
+            bits[n++] = (value >> i) & 1;
+        }
+    };
+
+    uint8_t dlc = std::min<uint8_t>(msg->data_length_code, 8);
+    put(0, 1);
+    put(msg->identifier & 0x7FF, 11);
+    put(0, 3);
+    put(dlc, 4);
+    for (int i = 0; i < dlc; i++) {
+        put(msg->data[i], 8);
+    }
+
+    uint16_t crc = 0;
+    for (int i = 0; i < n; i++) {
+        bool next = bits[i] ^ ((crc >> 14) & 1);
+        crc = (crc << 1) & 0x7FFF;
+        if (next) {
+            crc ^= 0x4599;
+        }
+    }
+    put(crc, 15);
+
+    // a bit of the other level after five equal bits, it starts the next run
+    uint32_t stuff = 0;
+    int run = 0;
+    uint8_t last = 2;
+    for (int i = 0; i < n; i++) {
+        if (bits[i] == last) {
+            run++;
+        } else {
+            last = bits[i];
+            run = 1;
+        }
+        if (run == 5) {
+            stuff++;
+            last = !last;
+            run = 1;
+        }
+    }
+
+    *stuffBits = stuff;
+    return (uint32_t) n + stuff + 13;
+}
+
+bool VirtualCanBus::sendWire(int node, host_twai_op_t op, const twai_message_t *msg)
+{
+    node_t &n = m_nodes[node];
+    if (!n.alive) {
+        return false;
+    }
+    host_twai_wire_t wire = {};
+    wire.op = op;
+    wire.arbLost = (uint32_t) n.stats.arbLost;
+    if (msg) {
+        wire.msg = *msg;
+    }
+    // blocking: the reader thread of the node drains its socket all the time
+    bool ok = send(n.busFd, &wire, sizeof(wire), MSG_NOSIGNAL) == (ssize_t) sizeof(wire);
+    if (!ok) {
+        n.alive = false;
+        n.queue.clear();
+    }
+    return ok;
+}
+
+// frames and clear requests of one node, m_mutex is held
+void VirtualCanBus::receive(int node)
+{
+    node_t &n = m_nodes[node];
+    host_twai_wire_t wire;
+    for (;;) {
+        ssize_t len = recv(n.busFd, &wire, sizeof(wire), MSG_DONTWAIT);
+        if (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return;
+        }
+        if (len <= 0) {
+            if (len < 0 && errno == EINTR) {
+                continue;
+            }
+            n.alive = false;
+            n.queue.clear();
+            return;
+        }
+        if (len != sizeof(wire)) {
+            continue;
+        }
+
+        if (wire.op == HOST_TWAI_FRAME) {
+            n.queue.push_back({wire.msg, monotonic_ns()});
+        } else if (wire.op == HOST_TWAI_CLEAR) {
+            // the frame on the bus is finished, the rest is dropped
+            size_t dropped = n.queue.size();
+            n.queue.clear();
+            for (size_t i = 0; i < dropped; i++) {
+                sendWire(node, HOST_TWAI_TX_DONE, NULL);
+            }
+        }
+    }
+}
+
+// m_mutex is held
+void VirtualCanBus::arbitrate()
+{
+    int winner = -1;
+    for (int i = 0; i < (int) m_nodes.size(); i++) {
+        if (m_nodes[i].queue.empty()) {
+            continue;
+        }
+        if (winner < 0 || m_nodes[i].queue.front().msg.identifier < m_nodes[winner].queue.front().msg.identifier) {
+            winner = i;
+        }
+    }
+    if (winner < 0) {
+        return;
+    }
+    for (int i = 0; i < (int) m_nodes.size(); i++) {
+        if (i != winner && !m_nodes[i].queue.empty()) {
+            m_nodes[i].stats.arbLost++;
+        }
+    }
+
+    node_t &n = m_nodes[winner];
+    m_onBus = winner;
+    m_frame = n.queue.front();
+    n.queue.pop_front();
+
+    // back to back with the previous frame if the bus thread woke up late
+    int64_t start = std::max(m_frame.queuedNs, m_busFreeNs);
+    uint32_t stuff;
+    uint32_t bits = frameBits(&m_frame.msg, &stuff);
+    int64_t duration = (int64_t) bits * 1000000000LL / m_bitrate;
+    m_busFreeNs = start + duration;
+    m_busyNs += duration;
+
+    uint32_t waitUs = (uint32_t) std::max<int64_t>(0, (start - m_frame.queuedNs) / 1000);
+    n.stats.frames++;
+    n.stats.bits += bits;
+    n.stats.stuffBits += stuff;
+    n.stats.waitUs += waitUs;
+    n.stats.maxWaitUs = std::max(n.stats.maxWaitUs, waitUs);
+}
+
+// the frame on the bus is complete, m_mutex is held
+void VirtualCanBus::deliver()
+{
+    for (int i = 0; i < (int) m_nodes.size(); i++) {
+        if (i != m_onBus) {
+            sendWire(i, HOST_TWAI_FRAME, &m_frame.msg);
+        }
+    }
+    sendWire(m_onBus, HOST_TWAI_TX_DONE, NULL);
+    m_onBus = -1;
+}
+
+void VirtualCanBus::task()
+{
+    std::vector<struct pollfd> fds(m_nodes.size());
+
+    while (__atomic_load_n(&m_running, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&m_mutex);
+        int64_t now = monotonic_ns();
+        if (m_onBus >= 0 && now >= m_busFreeNs) {
+            deliver();
+        }
+        if (m_onBus < 0) {
+            arbitrate();
+        }
+        int64_t sleepNs = POLL_MAX_NS;
+        if (m_onBus >= 0) {
+            sleepNs = std::max<int64_t>(0, std::min(sleepNs, m_busFreeNs - now));
+        }
+        for (size_t i = 0; i < m_nodes.size(); i++) {
+            fds[i].fd = m_nodes[i].alive ? m_nodes[i].busFd : -1;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        pthread_mutex_unlock(&m_mutex);
+
+        struct timespec timeout = {(time_t) (sleepNs / 1000000000LL), (long) (sleepNs % 1000000000LL)};
+        if (ppoll(fds.data(), fds.size(), &timeout, NULL) <= 0) {
+            continue;
+        }
+
+        pthread_mutex_lock(&m_mutex);
+        for (size_t i = 0; i < m_nodes.size(); i++) {
+            if (fds[i].revents) {
+                receive((int) i);
+            }
+        }
+        pthread_mutex_unlock(&m_mutex);
+    }
+}
+
+void *VirtualCanBus::taskWrapper(void *arg)
+{
+    ((VirtualCanBus *) arg)->task();
+    return NULL;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <deque>
+#include <vector>
+
+#include "driver/twai.h"
+
+// CAN bus between the processes of the host simulation
+//
+// Every node (the master and the forked slaves) talks to the bus thread over
+// its own socket, see host_twai_attach(). The bus sends one frame at a time
+// and holds it for the bit time of the frame including the stuff bits. When
+// the bus gets free the lowest identifier of the oldest frames of the nodes
+// wins the arbitration, the others count a lost arbitration. Every frame is
+// received by all other nodes like with the accept-all filter.
+class VirtualCanBus {
+  public:
+    typedef struct
+    {
+        uint64_t frames;
+        uint64_t bits;      // on the wire, including stuff bits
+        uint64_t stuffBits;
+        uint64_t arbLost;
+        uint64_t waitUs;    // queued on the bus until it won the arbitration
+        uint32_t maxWaitUs;
+    } stats_t;
+
+  protected:
+    typedef struct
+    {
+        twai_message_t msg;
+        int64_t queuedNs;
+    } pending_t;
+
+    typedef struct
+    {
+        int busFd;
+        int nodeFd;
+        bool alive;
+        std::deque<pending_t> queue;
+        stats_t stats;
+    } node_t;
+
+    uint32_t m_bitrate;
+    std::vector<node_t> m_nodes;
+
+    pthread_t m_thread;
+    bool m_running = false;
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+    int m_onBus = -1;        // node whose frame is on the bus
+    pending_t m_frame;
+    int64_t m_busFreeNs = 0; // end of the frame on the bus
+    int64_t m_startNs = 0;
+    int64_t m_busyNs = 0;
+
+    void task();
+    static void *taskWrapper(void *arg);
+
+    void receive(int node);
+    void arbitrate();
+    void deliver();
+    bool sendWire(int node, host_twai_op_t op, const twai_message_t *msg);
+
+  public:
+    explicit VirtualCanBus(int nodes, uint32_t bitrate = 500000);
+    ~VirtualCanBus();
+
+    // socket of the node for host_twai_attach()
+    int nodeFd(int node) const
+    {
+        return m_nodes[node].nodeFd;
+    }
+
+    // in the forked process of a node: keeps only the socket of the node
+    void forked(int node);
+
+    // in the bus process after all nodes were forked, localNode is the node
+    // of this process (or -1)
+    bool start(int localNode = -1);
+
+    // one node or the whole bus (node -1)
+    void getStats(stats_t *stats, int node = -1);
+
+    // time the bus was busy since start() in %
+    float getLoad();
+
+    // bits of a standard frame on the wire, *stuffBits of them are stuff bits
+    static uint32_t frameBits(const twai_message_t *msg, uint32_t *stuffBits);
+};
@@ -0,0 +1,312 @@
+// AutoTuner of main/autotuner.cpp against a synthetic chip model
+//
+// The model is a NerdQAxe++ chain whose lowest stable voltage rises with the
+// frequency. Below it the chips return hardware errors, far below it they
+// also lose hashrate. Power goes with f·V², the chip temperature with the
+// power. Checks the sweep result against the best point of the model for
+// both goals and the limits, hold corrections when the chips age, replay()
+// and resume() of the log, and that a full log keeps its sweep.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <vector>
+
+#include "autotuner.h"
+
+static int failures = 0;
+
+#define EXPECT(cond, ...)                                                                                                  \
+    do {                                                                                                                   \
+        if (!(cond)) {                                                                                                     \
+            if (failures++ < 10) {                                                                                         \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+                printf(__VA_ARGS__);                                                                                       \
+                printf("\n");                                                                                              \
+            }                                                                                                              \
+        }                                                                                                                  \
+    } while (0)
+
+// options of main/boards/nerdqaxeplus2.cpp
+static const std::vector<uint32_t> FREQUENCIES = {500, 515, 525, 550, 575, 590, 600};
+static const std::vector<uint32_t> VOLTAGES = {1120, 1130, 1140, 1150, 1160, 1170, 1180, 1190, 1200};
+
+static const uint32_t POLL_MS = 1000;
+
+class ChipModel {
+  public:
+    float ghsPerMhz = 4 * 2040 / 1000.0f; // 4x BM1370
+    float vminAt500 = 1.100f;             // V
+    float vminPerMhz = 0.0008f;
+    float aging = 0.0f;                   // V on top of the lowest stable voltage
+
+    uint32_t nonces = 0;
+    uint32_t hwErrors = 0;
+
+    float vmin(float frequency) const
+    {
+        return vminAt500 + (frequency - 500.0f) * vminPerMhz + aging;
+    }
+
+    float power(float frequency, float volts) const
+    {
+        return 5.0f + 0.095f * frequency * volts * volts;
+    }
+
+    float temp(float power) const
+    {
+        return 30.0f + power * 0.4f;
+    }
+
+    autotune_sample_t sample(uint16_t frequency, uint16_t voltage)
+    {
+        float volts = voltage / 1000.0f;
+        float below = vmin(frequency) - volts;
+        float yield = below <= 0.0f ? 1.0f : below < 0.015f ? 0.97f : 0.7f;
+
+        uint32_t n = frequency / 10;
+        nonces += n;
+        if (below > 0.0f) {
+            hwErrors += n / 20;
+        }
+
+        autotune_sample_t s = {};
+        s.hashrate = frequency * ghsPerMhz * yield;
+        s.power = power(frequency, volts);
+        s.chipTemp = temp(s.power);
+        s.nonces = nonces;
+        s.hwErrors = hwErrors;
+        return s;
+    }
+};
+
+static autotune_config_t make_config(AutoTuneGoal goal, float maxPower, float maxTemp)
+{
+    autotune_config_t config = {};
+    config.goal = goal;
+    config.maxPower = maxPower;
+    config.maxTemp = maxTemp;
+    config.settleMs = 2000;
+    config.measureMs = 5000;
+    config.maxErrorRate = 0.01f;
+    config.minYield = 0.85f;
+    config.expectedGhsPerMhz = 4 * 2040 / 1000.0f;
+    return config;
+}
+
+// one poll per POLL_MS until the tuner leaves the state or the windows run out
+static void run(AutoTuner &tuner, ChipModel &model, uint32_t &now, AutoTuneState state, int windows)
+{
+    uint32_t end = now + windows * 8 * POLL_MS;
+    while (tuner.getState() == state && now < end) {
+        now += POLL_MS;
+        tuner.update(model.sample(tuner.getFrequency(), tuner.getVoltage()), now);
+    }
+}
+
+// what the sweep has to find: each frequency at its lowest stable voltage,
+// up to the first one over a limit
+static bool model_best(const ChipModel &model, const autotune_config_t &config, uint32_t *frequency,
+                       uint32_t *voltage)
+{
+    bool found = false;
+    float best = 0.0f;
+    for (uint32_t f : FREQUENCIES) {
+        uint32_t v = 0;
+        for (uint32_t option : VOLTAGES) {
+            if (option / 1000.0f >= model.vmin(f)) {
+                v = option;
+                break;
+            }
+        }
+        if (!v) {
+            break;
+        }
+        float power = model.power(f, v / 1000.0f);
+        if ((config.maxPower > 0.0f && power > config.maxPower) ||
+            (config.maxTemp > 0.0f && model.temp(power) > config.maxTemp)) {
+            break;
+        }
+        float hashrate = f * model.ghsPerMhz;
+        float score = config.goal == AutoTuneGoal::HASHRATE ? hashrate : -power / hashrate;
+        if (!found || score > best) {
+            found = true;
+            best = score;
+            *frequency = f;
+            *voltage = v;
+        }
+    }
+    return found;
+}
+
+static void test_sweep(AutoTuneGoal goal, float maxPower, float maxTemp)
+{
+    ChipModel model;
+    autotune_config_t config = make_config(goal, maxPower, maxTemp);
+
+    AutoTuner tuner;
+    uint32_t now = 0;
+    EXPECT(tuner.start(config, FREQUENCIES, VOLTAGES, 550, 1150, now), "start");
+    run(tuner, model, now, AutoTuneState::SWEEP, 64);
+
+    uint32_t frequency = 0, voltage = 0;
+    EXPECT(model_best(model, config, &frequency, &voltage), "model has a best point");
+
+    autotune_step_t best;
+    EXPECT(tuner.getState() == AutoTuneState::HOLD, "goal %d: state %s", (int) goal,
+           AutoTuner::stateToStr(tuner.getState()));
+    EXPECT(tuner.getBest(&best), "goal %d: no best step", (int) goal);
+    EXPECT(best.frequency == frequency && best.voltage == voltage, "goal %d limits %.0fW %.0fC: best %u/%u, model %u/%u",
+           (int) goal, maxPower, maxTemp, best.frequency, best.voltage, frequency, voltage);
+    EXPECT(tuner.getFrequency() == frequency && tuner.getVoltage() == voltage, "goal %d: holds %u/%u", (int) goal,
+           tuner.getFrequency(), tuner.getVoltage());
+
+    // every frequency of the sweep ended at its lowest stable voltage
+    const autotune_step_t *log;
+    int count = tuner.getLog(&log);
+    EXPECT(count > 0 && log[0].frequency == FREQUENCIES[0] && log[0].voltage == VOLTAGES[0], "sweep starts at the bottom");
+    for (int i = 0; i < count; i++) {
+        if (log[i].result == AUTOTUNE_STABLE) {
+            EXPECT(log[i].voltage / 1000.0f >= model.vmin(log[i].frequency) &&
+                       (log[i].voltage == VOLTAGES[0] || (log[i].voltage - 10) / 1000.0f < model.vmin(log[i].frequency)),
+                   "stable step %u/%u isn't the lowest stable voltage", log[i].frequency, log[i].voltage);
+        }
+    }
+    if (maxPower > 0.0f) {
+        EXPECT(log[count - 1].result == AUTOTUNE_OVER_POWER, "sweep ends over power, not %s",
+               AutoTuner::resultToStr(log[count - 1].result));
+    }
+    if (maxTemp > 0.0f) {
+        EXPECT(log[count - 1].result == AUTOTUNE_OVER_TEMP, "sweep ends over temperature, not %s",
+               AutoTuner::resultToStr(log[count - 1].result));
+    }
+
+    autotune_step_t replayed;
+    EXPECT(AutoTuner::replay(config, FREQUENCIES, VOLTAGES, log, count, &replayed) == AutoTuneState::HOLD, "replay");
+    EXPECT(!memcmp(&replayed, &best, sizeof(best)), "replay finds the same best step");
+}
+
+static void test_failed()
+{
+    // not even the highest voltage is stable at the lowest frequency
+    ChipModel model;
+    model.aging = 0.2f;
+    autotune_config_t config = make_config(AutoTuneGoal::EFFICIENCY, 0.0f, 0.0f);
+
+    AutoTuner tuner;
+    uint32_t now = 0;
+    tuner.start(config, FREQUENCIES, VOLTAGES, 550, 1150, now);
+    run(tuner, model, now, AutoTuneState::SWEEP, 64);
+
+    EXPECT(tuner.getState() == AutoTuneState::FAILED, "state %s", AutoTuner::stateToStr(tuner.getState()));
+    EXPECT(tuner.getFrequency() == 550 && tuner.getVoltage() == 1150, "restores %u/%u", tuner.getFrequency(),
+           tuner.getVoltage());
+}
+
+static void test_hold()
+{
+    ChipModel model;
+    autotune_config_t config = make_config(AutoTuneGoal::EFFICIENCY, 0.0f, 0.0f);
+
+    AutoTuner tuner;
+    uint32_t now = 0;
+    tuner.start(config, FREQUENCIES, VOLTAGES, 550, 1150, now);
+    run(tuner, model, now, AutoTuneState::SWEEP, 64);
+    uint16_t frequency = tuner.getFrequency();
+    uint16_t voltage = tuner.getVoltage();
+    const autotune_step_t *log;
+    int sweep = tuner.getLog(&log);
+
+    // stable windows change nothing and aren't logged
+    for (int i = 0; i < 10 * 8; i++) {
+        now += POLL_MS;
+        EXPECT(!tuner.update(model.sample(tuner.getFrequency(), tuner.getVoltage()), now), "stable window changed");
+    }
+    EXPECT(tuner.getLog(&log) == sweep, "stable windows logged");
+
+    // the chips need 15 mV more, one voltage option after the other until stable
+    model.aging = 0.015f;
+    for (int i = 0; i < 10 * 8; i++) {
+        now += POLL_MS;
+        tuner.update(model.sample(tuner.getFrequency(), tuner.getVoltage()), now);
+    }
+    EXPECT(tuner.getState() == AutoTuneState::HOLD, "state %s", AutoTuner::stateToStr(tuner.getState()));
+    EXPECT(tuner.getFrequency() == frequency, "frequency %u, was %u", tuner.getFrequency(), frequency);
+    EXPECT(tuner.getVoltage() / 1000.0f >= model.vmin(frequency) && tuner.getVoltage() - voltage <= 20,
+           "voltage %u, was %u", tuner.getVoltage(), voltage);
+    int count = tuner.getLog(&log);
+    EXPECT(count > sweep, "hold corrections logged");
+    for (int i = sweep; i < count; i++) {
+        EXPECT(log[i].result != AUTOTUNE_STABLE, "stable hold window logged");
+    }
+}
+
+static void test_full_log()
+{
+    ChipModel model;
+    autotune_config_t config = make_config(AutoTuneGoal::EFFICIENCY, 0.0f, 0.0f);
+
+    AutoTuner tuner;
+    uint32_t now = 0;
+    tuner.start(config, FREQUENCIES, VOLTAGES, 550, 1150, now);
+    run(tuner, model, now, AutoTuneState::SWEEP, 64);
+
+    const autotune_step_t *log;
+    int sweep = tuner.getLog(&log);
+    std::vector<autotune_step_t> sweepLog(log, log + sweep);
+    autotune_step_t best;
+    tuner.getBest(&best);
+
+    // unstable at every setpoint: a correction per window until the log is full several times
+    model.aging = 0.3f;
+    for (int i = 0; i < 4 * AUTOTUNE_LOG_SIZE * 8; i++) {
+        now += POLL_MS;
+        tuner.update(model.sample(tuner.getFrequency(), tuner.getVoltage()), now);
+    }
+
+    int count = tuner.getLog(&log);
+    EXPECT(count == AUTOTUNE_LOG_SIZE, "log has %d steps", count);
+    EXPECT(!memcmp(log, sweepLog.data(), sweep * sizeof(autotune_step_t)), "sweep steps were dropped");
+    EXPECT(log[count - 1].frequency == tuner.getFrequency() && log[count - 1].voltage == tuner.getVoltage(),
+           "newest correction %u/%u, tuner at %u/%u", log[count - 1].frequency, log[count - 1].voltage,
+           tuner.getFrequency(), tuner.getVoltage());
+
+    autotune_step_t replayed;
+    EXPECT(AutoTuner::replay(config, FREQUENCIES, VOLTAGES, log, count, &replayed) == AutoTuneState::HOLD,
+           "replay of the full log");
+    EXPECT(!memcmp(&replayed, &best, sizeof(best)), "replay of the full log: best %u/%u, was %u/%u", replayed.frequency,
+           replayed.voltage, best.frequency, best.voltage);
+
+    // after a reboot: the same best step, and the sweep stays when the log fills up again
+    AutoTuner resumed;
+    EXPECT(resumed.resume(config, FREQUENCIES, VOLTAGES, best.frequency, best.voltage, log, count, now), "resume");
+    autotune_step_t resumedBest;
+    EXPECT(resumed.getBest(&resumedBest) && !memcmp(&resumedBest, &best, sizeof(best)), "resumed best");
+    EXPECT(resumed.getFrequency() == best.frequency && resumed.getVoltage() == best.voltage, "resumed setpoint");
+    for (int i = 0; i < 2 * AUTOTUNE_LOG_SIZE * 8; i++) {
+        now += POLL_MS;
+        resumed.update(model.sample(resumed.getFrequency(), resumed.getVoltage()), now);
+    }
+    count = resumed.getLog(&log);
+    EXPECT(count == AUTOTUNE_LOG_SIZE && !memcmp(log, sweepLog.data(), sweep * sizeof(autotune_step_t)),
+           "resumed log lost its sweep");
+}
+
+int main()
+{
+    test_sweep(AutoTuneGoal::EFFICIENCY, 0.0f, 0.0f);
+    test_sweep(AutoTuneGoal::HASHRATE, 0.0f, 0.0f);
+    test_sweep(AutoTuneGoal::HASHRATE, 75.0f, 0.0f);
+    test_sweep(AutoTuneGoal::HASHRATE, 0.0f, 58.0f);
+    test_failed();
+    test_hold();
+    test_full_log();
+
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("autotuner ok\n");
+    return 0;
+}
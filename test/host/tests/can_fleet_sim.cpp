@@ -0,0 +1,289 @@
+// CAN master and slaves on a virtual bus against a mock Stratum V1 pool
+//
+// The master runs the mining pipeline of pipeline_sim plus can_master_task,
+// every slave is a forked process with its own simulated chain running
+// can_slave_task, can_slave_result_task and can_slave_telemetry_task. All
+// of them are compiled from main/ unchanged and talk over a VirtualCanBus at
+// 500 kbit/s. After all slaves came online and sent a share it measures for
+// --seconds and reports the bus load (measured on the bus and estimated by
+// can_metrics), arbitration, template distribution and the shares per
+// slave. Fails if a slave isn't active or had no share accepted, the pool
+// rejected a share, a multiframe message was dropped or the chain of the
+// master saw a CRC error.
+//
+//   can_fleet_sim [--slaves n] [--family BM1366|BM1368|BM1370] [--chips n] [--seconds s]
+//                 [--rate nonces/s] [--diff pool difficulty] [--notify ms]
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/prctl.h>
+#include <unistd.h>
+
+#include "driver/twai.h"
+#include "esp_mac.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "asic_result_task.h"
+#include "can_master_task.h"
+#include "can_metrics.h"
+#include "can_share_stats.h"
+#include "can_slave_task.h"
+#include "can_task.h"
+#include "create_jobs_task.h"
+#include "global_state.h"
+#include "nvs_config.h"
+
+#include "mock_pool.h"
+#include "sim_board.h"
+#include "sim_chain.h"
+#include "virtual_can_bus.h"
+
+typedef struct
+{
+    int64_t us;
+    MockPool::stats_t pool;
+    VirtualCanBus::stats_t bus;
+    can_metrics_t metrics;
+    can_template_stats_t templates;
+    can_slave_share_stats_t shares[CAN_SLAVE_MAX];
+} snapshot_t;
+
+static void take_snapshot(MockPool *pool, VirtualCanBus *bus, int slaves, snapshot_t *s)
+{
+    s->us = esp_timer_get_time();
+    pool->getStats(&s->pool);
+    bus->getStats(&s->bus);
+    can_metrics_get(&s->metrics);
+    can_master_get_template_stats(&s->templates);
+    for (int id = 1; id <= slaves; id++) {
+        if (!can_shares_get((uint8_t) id, &s->shares[id])) {
+            memset(&s->shares[id], 0, sizeof(s->shares[id]));
+        }
+    }
+}
+
+static bool init_board(SimChain::Family family, int chips, SimChain *chain)
+{
+    sim_serial_attach(chain);
+    chain->start();
+
+    SimBoard *board = new SimBoard(family, chips);
+    board->loadSettings();
+    SYSTEM_MODULE.setBoard(board);
+    board->initBoard();
+    return board->initAsics();
+}
+
+// the process of one slave, like main.cpp in CAN slave mode
+static void run_slave(int node, VirtualCanBus *bus, SimChain::Family family, int chips, float rate)
+{
+    // the slaves go with the master
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+
+    bus->forked(node);
+    host_twai_attach(bus->nodeFd(node));
+
+    uint8_t mac[6] = {0x02, 0x00, 0x00, 0x00, 0x01, (uint8_t) node};
+    host_set_mac(mac);
+
+    SimChain chain(family, chips, rate);
+    if (!init_board(family, chips, &chain)) {
+        fprintf(stderr, "slave %d: asic init failed\n", node);
+        _exit(1);
+    }
+
+    can_init(0, 0);
+    xTaskCreate(can_slave_task, "can slave", 4096, NULL, 10, NULL);
+    xTaskCreate(can_slave_result_task, "can result", 4096, NULL, 10, NULL);
+    xTaskCreate(can_slave_telemetry_task, "can telem", 4096, NULL, 5, NULL);
+
+    for (;;) {
+        pause();
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int slaves = 4;
+    SimChain::Family family = SimChain::BM1368;
+    int chips = 4;
+    int seconds = 10;
+    float rate = 100.0f;
+    uint32_t diff = 0;
+    uint32_t notifyMs = 2000;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (!value) {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return 2;
+        }
+        if (!strcmp(arg, "--slaves")) {
+            slaves = atoi(value);
+        } else if (!strcmp(arg, "--family")) {
+            if (!SimChain::parseFamily(value, &family)) {
+                fprintf(stderr, "unknown chip family %s\n", value);
+                return 2;
+            }
+        } else if (!strcmp(arg, "--chips")) {
+            chips = atoi(value);
+        } else if (!strcmp(arg, "--seconds")) {
+            seconds = atoi(value);
+        } else if (!strcmp(arg, "--rate")) {
+            rate = atof(value);
+        } else if (!strcmp(arg, "--diff")) {
+            diff = strtoul(value, NULL, 10);
+        } else if (!strcmp(arg, "--notify")) {
+            notifyMs = strtoul(value, NULL, 10);
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return 2;
+        }
+        i++;
+    }
+    if (slaves < 1 || slaves >= CAN_SLAVE_MAX) {
+        fprintf(stderr, "--slaves must be 1..%d\n", CAN_SLAVE_MAX - 1);
+        return 2;
+    }
+
+    // node 0 is the master, the slaves are forked before any thread runs
+    VirtualCanBus bus(slaves + 1);
+    fflush(stdout);
+    fflush(stderr);
+    for (int node = 1; node <= slaves; node++) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (!pid) {
+            run_slave(node, &bus, family, chips, rate);
+        }
+    }
+    if (!bus.start(0)) {
+        fprintf(stderr, "virtual bus: no sockets\n");
+        return 1;
+    }
+    host_twai_attach(bus.nodeFd(0));
+
+    SimChain chain(family, chips, rate);
+    if (!init_board(family, chips, &chain)) {
+        fprintf(stderr, "asic init failed\n");
+        return 1;
+    }
+    Board *board = SYSTEM_MODULE.getBoard();
+
+    // every nonce the chips return is a share unless --diff says otherwise
+    if (!diff) {
+        diff = board->getAsicMinDifficulty();
+    }
+    MockPool pool(diff, notifyMs, 12);
+    if (!pool.start()) {
+        fprintf(stderr, "mock pool: can't listen\n");
+        return 1;
+    }
+
+    Config::setStratumURL("127.0.0.1");
+    Config::setStratumPortNumber(pool.getPort());
+    Config::setStratumUser("host.sim");
+    Config::setStratumPass("x");
+
+    STRATUM_MANAGER = new StratumManagerFallback();
+    STRATUM_MANAGER->loadSettings();
+
+    can_init(0, 0);
+    xTaskCreate(can_master_task, "can master", 4096, NULL, 5, NULL);
+    xTaskCreate(create_jobs_task, "stratum miner", 8192, NULL, 10, NULL);
+    xTaskCreate(ASIC_result_task, "asic result", 8192, NULL, 15, NULL);
+    xTaskCreate(StratumManager::taskWrapper, "stratum manager", 8192, (void *) STRATUM_MANAGER, 5, NULL);
+
+    // warm-up: every slave assigned, online and with a share accepted
+    snapshot_t start;
+    bool ready = false;
+    for (int i = 0; i < 300 && !ready; i++) {
+        usleep(100 * 1000);
+        take_snapshot(&pool, &bus, slaves, &start);
+        ready = start.pool.accepted > 0;
+        for (int id = 1; id <= slaves; id++) {
+            ready = ready && can_master_is_slave_active((uint8_t) id) && start.shares[id].accepted > 0;
+        }
+    }
+    if (!ready) {
+        fprintf(stderr, "slaves not mining within 30s:");
+        for (int id = 1; id <= slaves; id++) {
+            fprintf(stderr, " %d:%s/%lu", id, can_master_is_slave_active(id) ? "active" : "offline",
+                    (unsigned long) start.shares[id].accepted);
+        }
+        fprintf(stderr, "\n");
+        _exit(1);
+    }
+
+    usleep((useconds_t) seconds * 1000000);
+
+    snapshot_t end;
+    take_snapshot(&pool, &bus, slaves, &end);
+
+    double window = (end.us - start.us) / 1e6;
+    uint32_t accepted = end.pool.accepted - start.pool.accepted;
+    uint32_t rejected = end.pool.rejectedLowDiff + end.pool.rejectedDuplicate + end.pool.rejectedInvalid;
+    uint64_t frames = end.bus.frames - start.bus.frames;
+    uint64_t bits = end.bus.bits - start.bus.bits;
+    uint64_t stuffBits = end.bus.stuffBits - start.bus.stuffBits;
+    double load = bits / window / 500000.0 * 100.0;
+
+    printf("%d slaves + master, %s x%d each, %.1fs, pool diff %lu\n", slaves, SimChain::familyName(family), chips,
+           window, (unsigned long) diff);
+    printf("  shares/s            %.1f (%lu accepted, %lu rejected, %lu stale total)\n", accepted / window,
+           (unsigned long) accepted, (unsigned long) rejected, (unsigned long) end.pool.rejectedStale);
+    printf("  bus load            %.2f%% on the wire (%.1f%% stuff bits), can_metrics %.2f%% (avg %.2f%%)\n", load,
+           bits ? stuffBits * 100.0 / bits : 0.0, end.metrics.load, end.metrics.loadAvg);
+    printf("  frames/s            %.0f on the wire, can_metrics %lu\n", frames / window,
+           (unsigned long) end.metrics.framesPerSec);
+    printf("  arbitration         %llu lost, wait avg %.0fus max %luus\n",
+           (unsigned long long) (end.bus.arbLost - start.bus.arbLost),
+           frames ? (double) (end.bus.waitUs - start.bus.waitUs) / frames : 0.0, (unsigned long) end.bus.maxWaitUs);
+    printf("  templates           %lu sent, %lu resent, %lu bytes, template message avg %.1fms max %.1fms\n",
+           (unsigned long) (end.templates.templates - start.templates.templates),
+           (unsigned long) (end.templates.templateResends - start.templates.templateResends),
+           (unsigned long) end.templates.templateBytes,
+           end.metrics.msg[CAN_MSG_TEMPLATE].messages
+               ? end.metrics.msg[CAN_MSG_TEMPLATE].sumUs / 1e3 / end.metrics.msg[CAN_MSG_TEMPLATE].messages
+               : 0.0,
+           end.metrics.msg[CAN_MSG_TEMPLATE].maxUs / 1e3);
+    printf("  dropped messages    %lu, rx missed %lu, tx errors %lu\n", (unsigned long) end.metrics.incomplete,
+           (unsigned long) end.metrics.rxMissed, (unsigned long) end.metrics.txErrors);
+    printf("  fleet estimate      %lu slaves up to %.0f%% load\n", (unsigned long) end.metrics.maxSlavesEstimate,
+           CAN_METRICS_LOAD_LIMIT);
+
+    bool ok = accepted > 0 && !rejected && !end.metrics.incomplete;
+    for (int id = 1; id <= slaves; id++) {
+        can_slave_job_stats_t jobs = {};
+        can_master_get_slave_job_stats((uint8_t) id, &jobs);
+        can_slave_metrics_t metrics;
+        can_metrics_get_slave((uint8_t) id, &metrics);
+        VirtualCanBus::stats_t node;
+        bus.getStats(&node, id);
+        uint32_t slaveAccepted = end.shares[id].accepted - start.shares[id].accepted;
+        bool active = can_master_is_slave_active((uint8_t) id);
+        printf("  slave %-3d           %s, %.1f shares/s (%lu rejected, %lu invalid), %lu bit/s, "
+               "template latency avg %.0fms max %lums\n",
+               id, active ? "active" : "OFFLINE", slaveAccepted / window,
+               (unsigned long) (end.shares[id].rejected - start.shares[id].rejected),
+               (unsigned long) (end.shares[id].invalid - start.shares[id].invalid), (unsigned long) metrics.bitsPerSec,
+               jobs.templates ? (double) jobs.sumLatencyMs / jobs.templates : 0.0, (unsigned long) jobs.maxLatencyMs);
+        ok = ok && active && slaveAccepted > 0 && end.shares[id].invalid == 0;
+    }
+    fflush(stdout);
+
+    SimChain::stats_t chainStats;
+    chain.getStats(&chainStats);
+    ok = ok && chainStats.crcErrors == 0;
+
+    // the firmware tasks never return, the slaves die with the master
+    _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,78 @@
+// Throughput of the CRCs on the packet sizes of the serial protocol, table
+// versions of components/bm1397/crc.cpp against the bitwise reference
+//
+//   crc_bench [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "crc.h"
+
+#include "crc_reference.h"
+
+static volatile uint32_t sink;
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+template <typename F> static double bench(F f, const uint8_t *buf, int len, int iterations)
+{
+    uint32_t acc = 0;
+    double start = now_ns();
+    for (int i = 0; i < iterations; i++) {
+        acc += f(buf + (i & 7), len);
+    }
+    double ns = now_ns() - start;
+    sink = acc;
+    return ns / iterations;
+}
+
+static uint8_t crc5_table(const uint8_t *buf, int len)
+{
+    return crc5(buf, len);
+}
+
+static uint16_t crc16_false_table(const uint8_t *buf, int len)
+{
+    return crc16_false(buf, len);
+}
+
+static uint16_t crc16_false_reference(const uint8_t *buf, int len)
+{
+    return crc16_bitwise(0xffff, buf, len);
+}
+
+int main(int argc, char **argv)
+{
+    int iterations = argc > 1 ? atoi(argv[1]) : 2000000;
+
+    uint8_t buf[128];
+    for (size_t i = 0; i < sizeof(buf); i++) {
+        buf[i] = (uint8_t) (i * 37 + 11);
+    }
+
+    // result frame after the preamble, register write (header, length, 6 data bytes)
+    struct
+    {
+        const char *name;
+        int len;
+    } sizes[] = {{"crc5 result frame", 9}, {"crc5 register write", 8}};
+
+    printf("%-24s %5s %12s %12s %8s\n", "", "bytes", "bitwise ns", "table ns", "speedup");
+    for (auto &s : sizes) {
+        double ref = bench(crc5_bitwise, buf, s.len, iterations);
+        double tab = bench(crc5_table, buf, s.len, iterations);
+        printf("%-24s %5d %12.1f %12.1f %7.1fx\n", s.name, s.len, ref, tab, ref / tab);
+    }
+
+    // header, length and the 82 byte job of BM1366/68/70
+    double ref = bench(crc16_false_reference, buf, 84, iterations / 4);
+    double tab = bench(crc16_false_table, buf, 84, iterations / 4);
+    printf("%-24s %5d %12.1f %12.1f %7.1fx\n", "crc16_false job", 84, ref, tab, ref / tab);
+    return 0;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// the bitwise implementations the tables in components/bm1397/crc.cpp replaced
+
+// crc5 shift register, one step per bit (adapted from
+// https://mightydevices.com/index.php/2018/02/reverse-engineering-antminer-s1/).
+// The bit counter is an int here, the firmware version counted in an uint8_t
+// and overflowed for 32 bytes or more.
+static inline uint8_t crc5_bitwise(const uint8_t *data, int len)
+{
+    uint8_t crcin[5] = {1, 1, 1, 1, 1};
+    uint8_t crcout[5];
+
+    for (int i = 0; i < len * 8; i++) {
+        uint8_t din = (data[i / 8] >> (7 - (i % 8))) & 1;
+        crcout[0] = crcin[4] ^ din;
+        crcout[1] = crcin[0];
+        crcout[2] = crcin[1] ^ crcin[4] ^ din;
+        crcout[3] = crcin[2];
+        crcout[4] = crcin[3];
+        memcpy(crcin, crcout, 5);
+    }
+
+    return (crcin[4] << 4) | (crcin[3] << 3) | (crcin[2] << 2) | (crcin[1] << 1) | crcin[0];
+}
+
+// CRC-16/CCITT (poly 0x1021, msb first) with the given init value
+static inline uint16_t crc16_bitwise(uint16_t crc, const uint8_t *data, int len)
+{
+    for (int i = 0; i < len; i++) {
+        crc ^= (uint16_t) data[i] << 8;
+        for (int b = 0; b < 8; b++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : (crc << 1);
+        }
+    }
+    return crc;
+}
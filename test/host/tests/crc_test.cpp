@@ -0,0 +1,134 @@
+// Table CRCs of components/bm1397/crc.cpp against the bitwise reference
+//
+// crc5: every 1..3 byte input and random inputs up to the 255 bytes its
+// length argument allows. crc5_check: the documented chip id response and
+// one valid crc per frame. crc16/crc16_false: every 1..2 byte input, random
+// inputs and the catalogue check values.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "crc.h"
+
+#include "crc_reference.h"
+
+static int failures = 0;
+
+#define EXPECT(cond, ...)                                                                                                  \
+    do {                                                                                                                   \
+        if (!(cond)) {                                                                                                     \
+            if (failures++ < 10) {                                                                                         \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+                printf(__VA_ARGS__);                                                                                       \
+                printf("\n");                                                                                              \
+            }                                                                                                              \
+        }                                                                                                                  \
+    } while (0)
+
+static uint32_t rng = 0x12345678;
+
+static uint8_t random_byte()
+{
+    // xorshift32
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return (uint8_t) rng;
+}
+
+static void test_crc5_exhaustive()
+{
+    uint8_t buf[3];
+    for (uint32_t v = 0; v < (1u << 24); v++) {
+        buf[0] = v >> 16;
+        buf[1] = v >> 8;
+        buf[2] = v;
+        EXPECT(crc5(buf, 3) == crc5_bitwise(buf, 3), "crc5 %06x", v);
+        if (v < (1u << 16)) {
+            EXPECT(crc5(buf + 1, 2) == crc5_bitwise(buf + 1, 2), "crc5 %04x", v);
+        }
+        if (v < (1u << 8)) {
+            EXPECT(crc5(buf + 2, 1) == crc5_bitwise(buf + 2, 1), "crc5 %02x", v);
+        }
+    }
+    EXPECT(crc5(buf, 0) == 0x1f, "crc5 of nothing is the init value");
+}
+
+static void test_crc5_random()
+{
+    uint8_t buf[255];
+    for (int i = 0; i < 200000; i++) {
+        int len = 1 + (random_byte() % sizeof(buf));
+        for (int j = 0; j < len; j++) {
+            buf[j] = random_byte();
+        }
+        EXPECT(crc5(buf, len) == crc5_bitwise(buf, len), "crc5 random len %d", len);
+    }
+}
+
+static void test_crc5_check()
+{
+    // chip id response of a BM1368, crc in the low 5 bits of the last byte
+    uint8_t chipId[] = {0xAA, 0x55, 0x13, 0x68, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x0F};
+    EXPECT(crc5_check(chipId + 2, 9), "chip id response");
+
+    // every single bit error is detected
+    for (int bit = 0; bit < 9 * 8; bit++) {
+        chipId[2 + bit / 8] ^= 1 << (bit % 8);
+        EXPECT(!crc5_check(chipId + 2, 9), "bit %d flipped", bit);
+        chipId[2 + bit / 8] ^= 1 << (bit % 8);
+    }
+
+    // exactly one of the 32 crc values matches a frame
+    uint8_t frame[9];
+    for (int i = 0; i < 20000; i++) {
+        for (int j = 0; j < 9; j++) {
+            frame[j] = random_byte();
+        }
+        int matches = 0;
+        for (int crc = 0; crc < 32; crc++) {
+            frame[8] = (frame[8] & 0xe0) | crc;
+            matches += crc5_check(frame, 9);
+        }
+        EXPECT(matches == 1, "%d crc values match", matches);
+    }
+}
+
+static void test_crc16()
+{
+    const uint8_t check[] = "123456789";
+    EXPECT(crc16(check, 9) == 0x31C3, "CRC-16/XMODEM check value %04x", crc16(check, 9));
+    EXPECT(crc16_false(check, 9) == 0x29B1, "CRC-16/CCITT-FALSE check value %04x", crc16_false(check, 9));
+
+    uint8_t buf[256];
+    for (uint32_t v = 0; v < (1u << 16); v++) {
+        buf[0] = v >> 8;
+        buf[1] = v;
+        EXPECT(crc16(buf, 2) == crc16_bitwise(0, buf, 2), "crc16 %04x", v);
+        EXPECT(crc16_false(buf, 2) == crc16_bitwise(0xffff, buf, 2), "crc16_false %04x", v);
+    }
+
+    for (int i = 0; i < 100000; i++) {
+        int len = random_byte() + 1;
+        for (int j = 0; j < len; j++) {
+            buf[j] = random_byte();
+        }
+        EXPECT(crc16(buf, len) == crc16_bitwise(0, buf, len), "crc16 random len %d", len);
+        EXPECT(crc16_false(buf, len) == crc16_bitwise(0xffff, buf, len), "crc16_false random len %d", len);
+    }
+}
+
+int main()
+{
+    test_crc5_exhaustive();
+    test_crc5_random();
+    test_crc5_check();
+    test_crc16();
+
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("crc: all tests passed\n");
+    return 0;
+}
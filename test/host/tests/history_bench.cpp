@@ -0,0 +1,230 @@
+// Binary history export of main/history_codec.h against the JSON history of
+// the dashboard (History::exportHistoryData + serializeJson)
+//
+// A day of 5 s samples at ~5 TH/s with noise. Both paths export the same
+// window, the binary one is decoded again and compared with the samples.
+// The `since` cursor has to continue where the previous response ended.
+//
+//   history_bench [samples per request] [repetitions]
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <vector>
+
+#include "ArduinoJson.h"
+#include "esp_timer.h"
+
+#include "history.h"
+#include "history_codec.h"
+
+static int failures = 0;
+
+#define EXPECT(cond, ...)                                                                                                  \
+    do {                                                                                                                   \
+        if (!(cond)) {                                                                                                     \
+            if (failures++ < 10) {                                                                                         \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+                printf(__VA_ARGS__);                                                                                       \
+                printf("\n");                                                                                              \
+            }                                                                                                              \
+        }                                                                                                                  \
+    } while (0)
+
+// the time functions of main.cpp, the history needs nothing else of the firmware
+uint32_t now()
+{
+    return (uint32_t) time(NULL);
+}
+
+bool is_time_synced(void)
+{
+    return true;
+}
+
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// what the http writers do, byte by byte and in blocks
+class BufferWriter {
+  public:
+    std::vector<uint8_t> m_buf;
+
+    size_t write(uint8_t c)
+    {
+        m_buf.push_back(c);
+        return 1;
+    }
+
+    size_t write(const uint8_t *data, size_t len)
+    {
+        m_buf.insert(m_buf.end(), data, data + len);
+        return len;
+    }
+};
+
+typedef struct
+{
+    uint32_t first;
+    uint32_t next;
+    uint8_t flags;
+    std::vector<int64_t> columns[HISTORY_CODEC_COLUMNS];
+} decoded_t;
+
+// the decoder of the web UI (history-binary.ts) in C++
+static bool decode(const std::vector<uint8_t> &buf, decoded_t *out)
+{
+    size_t pos = 0;
+    auto le = [&](int bytes) {
+        uint64_t v = 0;
+        for (int i = 0; i < bytes && pos < buf.size(); i++) {
+            v |= (uint64_t) buf[pos++] << (8 * i);
+        }
+        return v;
+    };
+    auto varint = [&]() {
+        uint64_t v = 0;
+        for (int shift = 0; pos < buf.size() && shift < 64; shift += 7) {
+            uint8_t b = buf[pos++];
+            v |= (uint64_t) (b & 0x7f) << shift;
+            if (!(b & 0x80)) {
+                break;
+            }
+        }
+        return v;
+    };
+
+    if (buf.size() < 16 || memcmp(buf.data(), HISTORY_CODEC_MAGIC, 4)) {
+        return false;
+    }
+    pos = 4;
+    out->first = (uint32_t) le(4);
+    le(8);
+
+    int64_t last[HISTORY_CODEC_COLUMNS] = {};
+    for (;;) {
+        uint64_t count = varint();
+        if (!count) {
+            break;
+        }
+        for (int c = 0; c < HISTORY_CODEC_COLUMNS; c++) {
+            for (uint64_t i = 0; i < count; i++) {
+                uint64_t z = varint();
+                last[c] += (int64_t) (z >> 1) ^ -(int64_t) (z & 1);
+                out->columns[c].push_back(last[c]);
+            }
+        }
+    }
+    out->next = (uint32_t) le(4);
+    out->flags = pos < buf.size() ? buf[pos++] : 0;
+    return pos == buf.size();
+}
+
+static void check_decoded(History *history, const decoded_t &d, int first, int count)
+{
+    std::vector<history_sample_t> samples(count);
+    int cursor = first;
+    int copied = history->copySamples(&cursor, count, samples.data());
+    EXPECT(copied == count && (int) d.columns[0].size() == count, "decoded %d samples, expected %d",
+           (int) d.columns[0].size(), count);
+    if ((int) d.columns[0].size() != count || copied != count) {
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        const history_sample_t &s = samples[i];
+        EXPECT(d.columns[0][i] == (int64_t) s.timestamp, "sample %d: timestamp %lld", i, (long long) d.columns[0][i]);
+        const float rates[] = {s.hashrate1m, s.hashrate10m, s.hashrate1h, s.hashrate1d};
+        for (int c = 0; c < 4; c++) {
+            // Q22.10
+            EXPECT(fabsf(d.columns[1 + c][i] / 1024.0f - rates[c]) <= 1.0f / 1024.0f, "sample %d: rate %d %.4f / %.4f",
+                   i, c, d.columns[1 + c][i] / 1024.0f, rates[c]);
+        }
+        EXPECT(fabsf(d.columns[5][i] / 100.0f - s.vregTemp) <= 0.01f && fabsf(d.columns[6][i] / 100.0f - s.asicTemp) <= 0.01f,
+               "sample %d: temperatures", i);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int limit = argc > 1 ? atoi(argv[1]) : 1000;
+    int repetitions = argc > 2 ? atoi(argv[2]) : 200;
+
+    History history;
+    if (!history.init(1)) {
+        printf("history not available\n");
+        return 1;
+    }
+
+    // a day of samples, the timer of the host starts at 0 so they end in the future
+    const int samples = HISTORY_RAW;
+    uint64_t ts = 1000;
+    srand(1);
+    for (int i = 0; i < samples; i++) {
+        ts += 5000 + (rand() % 40) - 20;
+        float rate = 5000.0f + (rand() % 400) - 200;
+        history.push(rate, 55.0f + (rand() % 200) / 100.0f, 60.0f + (rand() % 200) / 100.0f, ts);
+    }
+
+    int first = samples / 2;
+    if (limit > samples - first) {
+        limit = samples - first;
+    }
+
+    // binary, as GET /api/v2/history?since=first&limit=limit
+    BufferWriter bin;
+    double start = now_ns();
+    for (int r = 0; r < repetitions; r++) {
+        bin.m_buf.clear();
+        history_export_binary(&history, bin, first, limit, 0);
+    }
+    double binUs = (now_ns() - start) / 1000.0 / repetitions;
+
+    // JSON, the same window as the dashboard requests it
+    uint64_t startTs = history.getTimestampSample(first);
+    uint64_t endTs = history.getTimestampSample(first + limit - 1);
+    BufferWriter json;
+    start = now_ns();
+    for (int r = 0; r < repetitions; r++) {
+        JsonDocument doc;
+        JsonObject jsonHistory = doc["history"].to<JsonObject>();
+        uint64_t current = esp_timer_get_time() / 1000ULL;
+        history.exportHistoryData(jsonHistory, startTs, endTs, current, limit);
+        json.m_buf.clear();
+        serializeJson(doc, json);
+    }
+    double jsonUs = (now_ns() - start) / 1000.0 / repetitions;
+
+    decoded_t d;
+    EXPECT(decode(bin.m_buf, &d), "binary response doesn't decode");
+    EXPECT(d.first == (uint32_t) first && d.next == (uint32_t) (first + limit), "first %u next %u", d.first, d.next);
+    EXPECT((d.flags & HISTORY_CODEC_MORE) && !(d.flags & HISTORY_CODEC_GAP), "flags %02x", d.flags);
+    check_decoded(&history, d, first, limit);
+
+    // the cursor continues behind the last response up to the newest sample
+    BufferWriter rest;
+    history_export_binary(&history, rest, (int) d.next, samples, 0);
+    decoded_t r;
+    EXPECT(decode(rest.m_buf, &r), "second response doesn't decode");
+    EXPECT(r.first == d.next && r.next == (uint32_t) samples && !(r.flags & HISTORY_CODEC_MORE),
+           "since %u: first %u next %u flags %02x", d.next, r.first, r.next, r.flags);
+    check_decoded(&history, r, (int) d.next, samples - (int) d.next);
+
+    printf("%d samples: binary %zu B (%.1f B/sample) %.0f us, json %zu B (%.1f B/sample) %.0f us\n", limit,
+           bin.m_buf.size(), (double) bin.m_buf.size() / limit, binUs, json.m_buf.size(),
+           (double) json.m_buf.size() / limit, jsonUs);
+
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("history_bench ok\n");
+    return 0;
+}
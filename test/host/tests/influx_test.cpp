@@ -0,0 +1,252 @@
+// Batched Influx writer of components/influx/influx.cpp against a mock
+// InfluxDB (sim/mock_influx.h) over the socket HTTP client of the shim
+//
+// batching: a request per full batch, all on one connection. retry: 5xx and
+// 429 keep the points until a later request takes them, 4xx drops the batch.
+// overflow: while the server fails the oldest points are dropped, written
+// plus dropped is every point taken. reconnect: a connection the server
+// closed is opened again without losing points, also after the server was
+// unreachable.
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "influx.h"
+
+#include "mock_influx.h"
+
+static int failures = 0;
+
+#define EXPECT(cond, ...)                                                                                                  \
+    do {                                                                                                                   \
+        if (!(cond)) {                                                                                                     \
+            if (failures++ < 10) {                                                                                         \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+                printf(__VA_ARGS__);                                                                                       \
+                printf("\n");                                                                                              \
+            }                                                                                                              \
+        }                                                                                                                  \
+    } while (0)
+
+// what the influx task does every sample interval
+static void sample(Influx &influx)
+{
+    pthread_mutex_lock(&influx.m_lock);
+    influx.addPoint();
+    pthread_mutex_unlock(&influx.m_lock);
+    if (influx.flushDue()) {
+        influx.flush();
+    }
+}
+
+// a port nothing listens on
+static uint16_t closed_port()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+    socklen_t len = sizeof(addr);
+    getsockname(fd, (struct sockaddr *) &addr, &len);
+    close(fd);
+    return ntohs(addr.sin_port);
+}
+
+static void test_batching(MockInflux &server, Influx &influx)
+{
+    InfluxWriterStats s;
+    MockInflux::stats_t m;
+
+    influx.setBatching(4, 1000000);
+    for (int i = 0; i < 10; i++) {
+        sample(influx);
+    }
+    influx.getWriterStats(&s);
+    EXPECT(s.requests == 2 && s.pointsWritten == 8, "full batches: %u requests, %u points", s.requests,
+           s.pointsWritten);
+    EXPECT(!influx.flushDue(), "2 points are due");
+
+    influx.flush();
+    influx.getWriterStats(&s);
+    server.getStats(&m);
+    std::vector<std::string> lines = server.getLines();
+    EXPECT(m.requests == 3 && lines.size() == 10 && s.pointsWritten == 10, "%u requests, %zu lines, %u written",
+           m.requests, lines.size(), s.pointsWritten);
+    EXPECT(m.connections == 1 && s.connects == 1, "%u connections, %u clients", m.connections, s.connects);
+    EXPECT(m.badRequests == 0, "%u bad requests", m.badRequests);
+
+    // timestamped in s, the device time is valid on the host
+    for (auto &line : lines) {
+        const char *ts = strrchr(line.c_str(), ' ');
+        EXPECT(!line.compare(0, 6, "miner ") && ts && strlen(ts + 1) == 10, "line %.40s...%s", line.c_str(),
+               ts ? ts : "");
+    }
+    printf("batching: %u requests, %zu points, %zu bytes per point, %u connection\n", m.requests, lines.size(),
+           lines.empty() ? 0 : lines[0].size() + 1, m.connections);
+}
+
+static void test_retry(MockInflux &server, Influx &influx)
+{
+    InfluxWriterStats before, s;
+    MockInflux::stats_t m;
+    influx.getWriterStats(&before);
+    server.reset();
+
+    server.script({503, 429});
+    influx.setBatching(4, 50);
+    for (int i = 0; i < 4; i++) {
+        sample(influx); // the 4th is sent, 503
+    }
+    sample(influx); // no retry before the flush interval
+    influx.getWriterStats(&s);
+    EXPECT(s.requests - before.requests == 1 && s.requestErrors - before.requestErrors == 1,
+           "503: %u requests, %u errors", s.requests - before.requests, s.requestErrors - before.requestErrors);
+
+    usleep(60000);
+    sample(influx); // 429
+    usleep(60000);
+    sample(influx); // taken, all 7 points
+    influx.getWriterStats(&s);
+    server.getStats(&m);
+    EXPECT(m.requests == 3 && server.getLines().size() == 7, "%u requests, %zu lines", m.requests,
+           server.getLines().size());
+    EXPECT(s.requestErrors - before.requestErrors == 2 && s.pointsDropped == before.pointsDropped &&
+               s.pointsWritten - before.pointsWritten == 7,
+           "%u errors, %u dropped, %u written", s.requestErrors - before.requestErrors,
+           s.pointsDropped - before.pointsDropped, s.pointsWritten - before.pointsWritten);
+
+    // 400 won't get better, the batch is dropped
+    server.reset();
+    server.script({400});
+    influx.setBatching(2, 1000000);
+    sample(influx);
+    sample(influx);
+    influx.getWriterStats(&before);
+    EXPECT(before.pointsDropped - s.pointsDropped == 2 && !influx.flushDue(), "400: %u dropped",
+           before.pointsDropped - s.pointsDropped);
+    EXPECT(server.getLines().empty(), "400: %zu lines stored", server.getLines().size());
+    EXPECT(before.requests && before.maxLatencyMs >= before.lastLatencyMs &&
+               before.latencySumMs >= before.maxLatencyMs,
+           "latency: last %u max %u sum %llu", before.lastLatencyMs, before.maxLatencyMs,
+           (unsigned long long) before.latencySumMs);
+    printf("retry: 503 and 429 kept 7 points, 400 dropped 2, latency avg %llu ms max %u ms\n",
+           (unsigned long long) (before.latencySumMs / before.requests), before.maxLatencyMs);
+}
+
+static void test_overflow(MockInflux &server, Influx &influx)
+{
+    InfluxWriterStats before, s;
+    influx.getWriterStats(&before);
+    server.reset();
+
+    // more points than the buffer holds while every request fails
+    size_t pointLen = 0;
+    {
+        std::vector<int> fails(1000, 503);
+        server.script(fails);
+    }
+    influx.setBatching(4, 1);
+    int points = 0;
+    for (;;) {
+        sample(influx);
+        points++;
+        usleep(2000);
+        influx.getWriterStats(&s);
+        if (s.pointsDropped - before.pointsDropped >= 8 || points > 1000) {
+            break;
+        }
+    }
+    server.script({});
+    usleep(2000);
+    influx.flush();
+
+    influx.getWriterStats(&s);
+    std::vector<std::string> lines = server.getLines();
+    uint32_t dropped = s.pointsDropped - before.pointsDropped;
+    if (!lines.empty()) {
+        pointLen = lines[0].size() + 1;
+    }
+    EXPECT(dropped > 0 && dropped + lines.size() == (size_t) points, "%d points: %zu written, %u dropped", points,
+           lines.size(), dropped);
+    EXPECT(lines.size() * pointLen <= INFLUX_BATCH_BUFFER_SIZE, "%zu lines of %zu bytes in the buffer", lines.size(),
+           pointLen);
+    EXPECT(s.pointsWritten - before.pointsWritten == lines.size(), "%u written, %zu lines",
+           s.pointsWritten - before.pointsWritten, lines.size());
+    printf("overflow: %d points while failing, %zu written, %u oldest dropped\n", points, lines.size(), dropped);
+}
+
+static void test_reconnect(MockInflux &server, Influx &influx, const char *host)
+{
+    InfluxWriterStats before, s;
+    MockInflux::stats_t m;
+    influx.getWriterStats(&before);
+    server.reset();
+
+    // the server closes after a response, the next request finds the kept
+    // connection closed and opens a new one
+    influx.setBatching(2, 1000000);
+    server.closeAfterNext();
+    for (int i = 0; i < 6; i++) {
+        sample(influx);
+    }
+    influx.getWriterStats(&s);
+    server.getStats(&m);
+    EXPECT(m.requests == 3 && server.getLines().size() == 6 && m.connections == 1,
+           "closed by the server: %u requests, %zu lines, %u new connections", m.requests, server.getLines().size(),
+           m.connections);
+    EXPECT(s.requestErrors == before.requestErrors && s.connects == before.connects,
+           "closed by the server: %u errors, %u clients", s.requestErrors - before.requestErrors,
+           s.connects - before.connects);
+
+    // unreachable: the points are kept, the next request makes a new client
+    Influx offline;
+    offline.init(host, closed_port(), "token", "bucket", "org", "miner");
+    offline.setBatching(2, 1);
+    sample(offline);
+    sample(offline);
+    offline.getWriterStats(&s);
+    EXPECT(s.requestErrors == 1 && s.pointsDropped == 0 && s.connects == 1, "unreachable: %u errors, %u dropped",
+           s.requestErrors, s.pointsDropped);
+    usleep(2000);
+    sample(offline);
+    offline.getWriterStats(&s);
+    EXPECT(s.requestErrors == 2 && s.connects == 2, "unreachable: %u errors, %u clients", s.requestErrors,
+           s.connects);
+    printf("reconnect: closed connection reopened, unreachable server kept its points\n");
+}
+
+int main()
+{
+    MockInflux server("token", "bucket", "org");
+    if (!server.start()) {
+        printf("mock server didn't start\n");
+        return 1;
+    }
+
+    const char *host = "http://127.0.0.1";
+    Influx influx;
+    if (!influx.init(host, server.getPort(), "token", "bucket", "org", "miner")) {
+        printf("influx init failed\n");
+        return 1;
+    }
+
+    test_batching(server, influx);
+    test_retry(server, influx);
+    test_overflow(server, influx);
+    test_reconnect(server, influx, host);
+
+    server.stop();
+
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("influx_test ok\n");
+    return 0;
+}
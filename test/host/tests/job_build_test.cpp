@@ -0,0 +1,413 @@
+// Job construction of create_jobs_task.cpp against the full coinbase path
+// of components/bm1397/mining.cpp it replaced
+//
+// v1: jobs built from the binary coinbase and the prefix midstate have the
+// merkle root and header fields of the hex coinbase string through
+// calculate_merkle_root_hash() and construct_bm_job() for every extranonce2.
+// A coinbase that doesn't decode builds no jobs, neither does an
+// extranonce after invalidate() without a new notify.
+//
+// v2 extended: MiningInfoV2Extended from the coinbase prefix midstate
+// against the builder it had, which hashed the whole coinbase of every job.
+//
+// bench: jobs/s of both builders of both protocols for coinbases of a
+// solo/small pool, a usual pool and a pool paying many outputs in the
+// coinbase.
+//
+//   job_build_test [jobs per run]
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <time.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "bm_job_pool.h"
+#include "create_jobs_task.h"
+#include "mining.h"
+#include "mining_info_v2.h"
+#include "mining_utils.h"
+
+static int failures = 0;
+
+#define EXPECT(cond, ...)                                                                                                  \
+    do {                                                                                                                   \
+        if (!(cond)) {                                                                                                     \
+            if (failures++ < 10) {                                                                                         \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+                printf(__VA_ARGS__);                                                                                       \
+                printf("\n");                                                                                              \
+            }                                                                                                              \
+        }                                                                                                                  \
+    } while (0)
+
+static const char *COINBASE_1 = "01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff2003"
+                                "0862062f503253482f04b8864e5008";
+static const char *COINBASE_2 = "072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327"
+                                "048ed988ac00000000";
+static const char *EXTRANONCE_1 = "f8002c90";
+static const int EXTRANONCE_2_LEN = 4;
+static const uint32_t VERSION_MASK = 0x1fffe000;
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void fill_bytes(uint8_t *buf, size_t len, uint32_t seed)
+{
+    for (size_t i = 0; i < len; i++) {
+        seed = seed * 1103515245 + 12345;
+        buf[i] = (uint8_t) (seed >> 16);
+    }
+}
+
+static void fill_notify(mining_notify *notify, char *job_id, char *coinbase_1, char *coinbase_2, int branches)
+{
+    memset(notify, 0, sizeof(*notify));
+    notify->job_id = job_id;
+    notify->coinbase_1 = coinbase_1;
+    notify->coinbase_2 = coinbase_2;
+    for (int i = 0; i < 32; i++) {
+        notify->_prev_block_hash[i] = (uint8_t) (i * 7 + 3);
+    }
+    notify->n_merkle_branches = branches;
+    for (int b = 0; b < branches; b++) {
+        for (int i = 0; i < 32; i++) {
+            notify->_merkle_branches[b][i] = (uint8_t) (b * 31 + i * 11 + 1);
+        }
+    }
+    notify->version = 0x20000000;
+    notify->target = 0x17034219;
+    notify->ntime = 0x66000000;
+}
+
+// the job as buildBmJob built it before, from the hex coinbase
+static void reference_job(mining_notify *notify, const char *extranonce_1, uint32_t extranonce_2, int extranonce_2_len,
+                          bm_job *job)
+{
+    char extranonce_2_str[extranonce_2_len * 2 + 1];
+    snprintf(extranonce_2_str, sizeof(extranonce_2_str), "%0*lx", extranonce_2_len * 2, (unsigned long) extranonce_2);
+
+    size_t len = strlen(notify->coinbase_1) + strlen(extranonce_1) + strlen(extranonce_2_str) +
+                 strlen(notify->coinbase_2);
+    char *coinbase_tx = (char *) malloc(len + 1);
+    snprintf(coinbase_tx, len + 1, "%s%s%s%s", notify->coinbase_1, extranonce_1, extranonce_2_str, notify->coinbase_2);
+
+    char merkle_root[65];
+    calculate_merkle_root_hash(coinbase_tx, notify->_merkle_branches, notify->n_merkle_branches, merkle_root);
+    free(coinbase_tx);
+
+    memset(job, 0, sizeof(*job));
+    construct_bm_job(notify, merkle_root, VERSION_MASK, job);
+    strlcpy(job->extranonce2, extranonce_2_str, sizeof(job->extranonce2));
+}
+
+static bool same_header(const bm_job *a, const bm_job *b)
+{
+    return a->version == b->version && a->version_mask == b->version_mask &&
+           !memcmp(a->prev_block_hash, b->prev_block_hash, 32) &&
+           !memcmp(a->prev_block_hash_be, b->prev_block_hash_be, 32) && !memcmp(a->merkle_root, b->merkle_root, 32) &&
+           !memcmp(a->merkle_root_be, b->merkle_root_be, 32) && a->ntime == b->ntime && a->target == b->target;
+}
+
+static bm_job *build(int pool, uint32_t extranonce_2)
+{
+    pthread_mutex_lock(&current_stratum_job_mutex);
+    bm_job *job = miningInfo[pool]->buildBmJob(extranonce_2, pool, 256);
+    pthread_mutex_unlock(&current_stratum_job_mutex);
+    return job;
+}
+
+static void test_v1()
+{
+    char job_id[] = "1a2b";
+    char coinbase_1[256], coinbase_2[256], extranonce_1[16];
+    strcpy(coinbase_1, COINBASE_1);
+    strcpy(coinbase_2, COINBASE_2);
+    strcpy(extranonce_1, EXTRANONCE_1);
+
+    mining_notify notify;
+    fill_notify(&notify, job_id, coinbase_1, coinbase_2, 12);
+    create_job_set_version_mask(0, VERSION_MASK);
+    create_job_set_enonce(0, extranonce_1, EXTRANONCE_2_LEN);
+    create_job_mining_notify(0, &notify, false);
+
+    int mismatches = 0;
+    for (uint32_t extranonce_2 = 0; extranonce_2 < 1000; extranonce_2 += 7) {
+        bm_job ref;
+        reference_job(&notify, EXTRANONCE_1, extranonce_2, EXTRANONCE_2_LEN, &ref);
+        bm_job *job = build(0, extranonce_2);
+        if (!job) {
+            mismatches++;
+            continue;
+        }
+        if (!same_header(job, &ref) || strcmp(job->extranonce2, ref.extranonce2) || strcmp(job->jobid, job_id)) {
+            mismatches++;
+        }
+        bmJobPool.release(job);
+    }
+    EXPECT(!mismatches, "v1: %d jobs differ from the full coinbase path", mismatches);
+
+    // coinbase2 that doesn't decode: no jobs from a cut coinbase
+    char bad[256];
+    strcpy(bad, COINBASE_2);
+    bad[10] = 'x';
+    fill_notify(&notify, job_id, coinbase_1, bad, 12);
+    create_job_mining_notify(0, &notify, false);
+    bm_job *job = build(0, 1);
+    EXPECT(!job, "v1: job from a coinbase2 with a non-hex digit");
+    if (job) {
+        bmJobPool.release(job);
+    }
+
+    // odd length coinbase1
+    strcpy(bad, COINBASE_1);
+    bad[strlen(bad) - 1] = '\0';
+    fill_notify(&notify, job_id, bad, coinbase_2, 12);
+    create_job_mining_notify(0, &notify, false);
+    job = build(0, 1);
+    EXPECT(!job, "v1: job from an odd length coinbase1");
+    if (job) {
+        bmJobPool.release(job);
+    }
+
+    // a valid notify again
+    fill_notify(&notify, job_id, coinbase_1, coinbase_2, 12);
+    create_job_mining_notify(0, &notify, false);
+    job = build(0, 1);
+    EXPECT(job, "v1: no job after a valid notify");
+    if (job) {
+        bmJobPool.release(job);
+    }
+
+    // invalidate() drops the coinbase, a new extranonce alone builds nothing
+    create_job_invalidate(0);
+    create_job_set_enonce(0, extranonce_1, EXTRANONCE_2_LEN);
+    job = build(0, 1);
+    EXPECT(!job, "v1: job after invalidate and set_enonce without a notify");
+    if (job) {
+        bmJobPool.release(job);
+    }
+
+    create_job_mining_notify(0, &notify, false);
+    job = build(0, 1);
+    EXPECT(job, "v1: no job after the notify following invalidate");
+    if (job) {
+        bmJobPool.release(job);
+    }
+}
+
+// extended job with a coinbase of prefix_len + extranonce + suffix_len bytes
+typedef struct
+{
+    std::vector<uint8_t> prefix;
+    std::vector<uint8_t> suffix;
+    std::vector<uint8_t> merklePath;
+    uint8_t extranoncePrefix[8];
+    uint8_t extranonceSize;
+    sv2_ext_job_t job;
+} ext_job_t;
+
+static void make_ext_job(ext_job_t *e, size_t prefix_len, size_t suffix_len, int branches)
+{
+    e->prefix.resize(prefix_len);
+    e->suffix.resize(suffix_len);
+    e->merklePath.resize(branches * 32);
+    fill_bytes(e->prefix.data(), prefix_len, 1);
+    fill_bytes(e->suffix.data(), suffix_len, 2);
+    fill_bytes(e->merklePath.data(), branches * 32, 3);
+    fill_bytes(e->extranoncePrefix, sizeof(e->extranoncePrefix), 4);
+    e->extranonceSize = 8;
+
+    memset(&e->job, 0, sizeof(e->job));
+    e->job.job_id = 4711;
+    e->job.version = 0x20000000;
+    e->job.version_rolling_allowed = true;
+    fill_bytes(e->job.prev_hash, 32, 5);
+    e->job.ntime = 0x66000000;
+    e->job.nbits = 0x17034219;
+    e->job.merkle_path = e->merklePath.data();
+    e->job.merkle_path_count = branches;
+    e->job.coinbase_prefix = e->prefix.data();
+    e->job.coinbase_prefix_len = prefix_len;
+    e->job.coinbase_suffix = e->suffix.data();
+    e->job.coinbase_suffix_len = suffix_len;
+}
+
+// MiningInfoV2Extended::buildBmJob as it was: the whole coinbase in a new
+// buffer and hashed for every job
+static void reference_ext_job(const ext_job_t *e, uint32_t extranonce_2, bm_job *job)
+{
+    uint8_t en2_bin[32] = {0};
+    uint32_t counter = extranonce_2;
+    for (int i = e->extranonceSize - 1; i >= 0 && counter > 0; i--) {
+        en2_bin[i] = (uint8_t) (counter & 0xff);
+        counter >>= 8;
+    }
+
+    size_t coinbase_len = e->prefix.size() + sizeof(e->extranoncePrefix) + e->extranonceSize + e->suffix.size();
+    uint8_t *coinbase = (uint8_t *) malloc(coinbase_len);
+    size_t pos = 0;
+    memcpy(coinbase + pos, e->prefix.data(), e->prefix.size());
+    pos += e->prefix.size();
+    memcpy(coinbase + pos, e->extranoncePrefix, sizeof(e->extranoncePrefix));
+    pos += sizeof(e->extranoncePrefix);
+    memcpy(coinbase + pos, en2_bin, e->extranonceSize);
+    pos += e->extranonceSize;
+    memcpy(coinbase + pos, e->suffix.data(), e->suffix.size());
+
+    uint8_t merkle_root[32];
+    double_sha256_bin(coinbase, coinbase_len, merkle_root);
+    free(coinbase);
+    for (int i = 0; i < e->job.merkle_path_count; i++) {
+        uint8_t concat[64];
+        memcpy(concat, merkle_root, 32);
+        memcpy(concat + 32, e->job.merkle_path + i * 32, 32);
+        double_sha256_bin(concat, 64, merkle_root);
+    }
+
+    memset(job, 0, sizeof(*job));
+    job->version = e->job.version;
+    job->version_mask = VERSION_MASK;
+    job->target = e->job.nbits;
+    job->ntime = e->job.ntime;
+    memcpy(job->merkle_root, merkle_root, 32);
+    swap_endian_words_bin(merkle_root, job->merkle_root_be, 32);
+    reverse_bytes(job->merkle_root_be, 32);
+    memcpy(job->prev_block_hash, e->job.prev_hash, 32);
+    swap_endian_words_bin((uint8_t *) e->job.prev_hash, job->prev_block_hash_be, 32);
+    reverse_bytes(job->prev_block_hash_be, 32);
+    snprintf(job->jobid, sizeof(job->jobid), "%lu", (unsigned long) e->job.job_id);
+    bin2hex(en2_bin, e->extranonceSize, job->extranonce2, sizeof(job->extranonce2));
+}
+
+static void test_v2_extended()
+{
+    // with and without merkle path, extranonce2 counters across byte boundaries
+    static const struct
+    {
+        size_t prefix;
+        size_t suffix;
+        int branches;
+    } shapes[] = {{0, 0, 0}, {41, 57, 0}, {64, 64, 1}, {90, 300, 12}, {120, 4000, 15}};
+
+    MiningInfoV2Extended info;
+    for (auto &shape : shapes) {
+        ext_job_t e;
+        make_ext_job(&e, shape.prefix, shape.suffix, shape.branches);
+        info.updateJob(&e.job, e.extranoncePrefix, sizeof(e.extranoncePrefix), e.extranonceSize, VERSION_MASK, 1000);
+
+        int mismatches = 0;
+        static const uint32_t counters[] = {0, 1, 0xff, 0x100, 0xffff, 0x10000, 0x12345678, 0xffffffff};
+        for (uint32_t extranonce_2 : counters) {
+            bm_job ref;
+            reference_ext_job(&e, extranonce_2, &ref);
+            bm_job *job = info.buildBmJob(extranonce_2, 1, 256);
+            if (!job) {
+                mismatches++;
+                continue;
+            }
+            if (!same_header(job, &ref) || strcmp(job->extranonce2, ref.extranonce2) || strcmp(job->jobid, ref.jobid) ||
+                job->pool_diff != 1000 || job->pool_id != 1 || job->asic_diff != 256) {
+                mismatches++;
+            }
+            bmJobPool.release(job);
+        }
+        EXPECT(!mismatches, "v2 extended %zu+%zu bytes, %d branches: %d jobs differ from the full coinbase path",
+               shape.prefix, shape.suffix, shape.branches, mismatches);
+    }
+}
+
+// jobs/s of build() over n jobs
+template <typename F> static double rate(int n, F build)
+{
+    double start = now_s();
+    for (int i = 0; i < n; i++) {
+        build((uint32_t) i);
+    }
+    return n / (now_s() - start);
+}
+
+static void bench(int n)
+{
+    // coinbase bytes in front of and behind the extranonce, merkle branches
+    static const struct
+    {
+        const char *name;
+        size_t prefix;
+        size_t suffix;
+        int branches;
+    } sizes[] = {
+        {"small", 60, 120, 10},
+        {"typical", 90, 400, 12},
+        {"many outputs", 100, 3000, 12},
+    };
+
+    printf("%-13s %6s %12s %12s %12s %12s\n", "coinbase", "bytes", "v1 jobs/s", "v1 before", "ext jobs/s",
+           "ext before");
+
+    MiningInfoV2Extended info;
+    for (auto &size : sizes) {
+        // v1 with coinbase1 + extranonce1 as prefix
+        size_t coinbase_1_len = size.prefix - 4;
+        std::vector<uint8_t> bin(std::max(coinbase_1_len, size.suffix));
+        std::vector<char> coinbase_1(coinbase_1_len * 2 + 1), coinbase_2(size.suffix * 2 + 1);
+        fill_bytes(bin.data(), coinbase_1_len, 6);
+        bin2hex(bin.data(), coinbase_1_len, coinbase_1.data(), coinbase_1.size());
+        fill_bytes(bin.data(), size.suffix, 7);
+        bin2hex(bin.data(), size.suffix, coinbase_2.data(), coinbase_2.size());
+
+        char job_id[] = "b1";
+        char extranonce_1[16];
+        strcpy(extranonce_1, EXTRANONCE_1);
+        mining_notify notify;
+        fill_notify(&notify, job_id, coinbase_1.data(), coinbase_2.data(), size.branches);
+        create_job_set_enonce(0, extranonce_1, EXTRANONCE_2_LEN);
+        create_job_mining_notify(0, &notify, false);
+
+        double v1 = rate(n, [](uint32_t en2) { bmJobPool.release(build(0, en2)); });
+        // the jobs were malloc'd before the job pool
+        double v1Before = rate(n, [&](uint32_t en2) {
+            bm_job *job = (bm_job *) malloc(sizeof(bm_job));
+            reference_job(&notify, EXTRANONCE_1, en2, EXTRANONCE_2_LEN, job);
+            free(job);
+        });
+
+        ext_job_t e;
+        make_ext_job(&e, size.prefix - sizeof(e.extranoncePrefix), size.suffix, size.branches);
+        info.updateJob(&e.job, e.extranoncePrefix, sizeof(e.extranoncePrefix), e.extranonceSize, VERSION_MASK, 1000);
+
+        double ext = rate(n, [&](uint32_t en2) { bmJobPool.release(info.buildBmJob(en2, 0, 256)); });
+        double extBefore = rate(n, [&](uint32_t en2) {
+            bm_job *job = bmJobPool.alloc();
+            reference_ext_job(&e, en2, job);
+            bmJobPool.release(job);
+        });
+
+        size_t bytes = size.prefix + 8 + size.suffix;
+        printf("%-13s %6zu %12.0f %12.0f %12.0f %12.0f\n", size.name, bytes, v1, v1Before, ext, extBefore);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int n = argc > 1 ? atoi(argv[1]) : 10000;
+
+    test_v1();
+    test_v2_extended();
+    bench(n);
+
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("job_build_test ok\n");
+    return 0;
+}
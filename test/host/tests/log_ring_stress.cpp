@@ -0,0 +1,222 @@
+// Four producers and two readers on main/http_server/log_ring.cpp, built
+// with AddressSanitizer
+//
+// The ring is small (4 KiB, 64 slots) so the producers overwrite lines the
+// readers are still copying. Every line carries its producer and sequence
+// number and is rebuilt from them to check the bytes. A reader has to get
+// every line intact or count it as dropped: lines read + dropped = lines
+// appended, the lines of a producer arrive in order. A garbled line is only
+// allowed if a writer was overrun (lost), see the class comment.
+//
+//   log_ring_stress [lines per producer]
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log_ring.h"
+
+#define PRODUCERS 4
+#define READERS 2
+
+#define RING_SIZE 4096
+#define RING_SLOTS 64
+
+// polls without progress before a reader gives up on an unpublished line,
+// like the websocket clients
+#define MAX_STALLED 1000
+
+static int failures = 0;
+
+#define EXPECT(cond, ...)                                                                                                  \
+    do {                                                                                                                   \
+        if (!(cond)) {                                                                                                     \
+            if (failures++ < 10) {                                                                                         \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+                printf(__VA_ARGS__);                                                                                       \
+                printf("\n");                                                                                              \
+            }                                                                                                              \
+        }                                                                                                                  \
+    } while (0)
+
+static LogRing ring;
+static uint32_t linesPerProducer = 200000;
+static int producersDone = 0;
+
+static uint32_t appendedLines = 0;
+static uint32_t returnedNull = 0;
+
+#define MAX_PAYLOAD 300
+static char payload[MAX_PAYLOAD + 26 + 1];
+
+// the payload length varies with the sequence number, up to a third of a
+// maximum line
+static int format_line(char *out, size_t size, int producer, uint32_t seq)
+{
+    int len = (int) ((seq * 7 + (uint32_t) producer * 13) % MAX_PAYLOAD);
+    return snprintf(out, size, "p%d %u %.*s %08x", producer, seq, len, payload + (seq % 26),
+                    seq * 2654435761u ^ (uint32_t) producer);
+}
+
+static const char *append(int *len, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    const char *line = ring.vappend(format, args, len);
+    va_end(args);
+    return line;
+}
+
+static void *producer_thread(void *arg)
+{
+    int id = (int) (intptr_t) arg;
+    char line[512];
+
+    for (uint32_t seq = 0; seq < linesPerProducer; seq++) {
+        format_line(line, sizeof(line), id, seq);
+        int len = 0;
+        if (!append(&len, "%s\n", line)) {
+            __atomic_fetch_add(&returnedNull, 1, __ATOMIC_RELAXED);
+        }
+        __atomic_fetch_add(&appendedLines, 1, __ATOMIC_RELAXED);
+    }
+    __atomic_fetch_add(&producersDone, 1, __ATOMIC_RELEASE);
+    return nullptr;
+}
+
+typedef struct {
+    uint32_t read;
+    uint32_t dropped;
+    uint32_t garbled;
+    uint32_t outOfOrder;
+    uint32_t skipped;
+    uint32_t cursor;
+} reader_t;
+
+// true if the line is one a producer wrote, byte for byte
+static bool check_line(const char *line, int len, int *producer, uint32_t *seq)
+{
+    unsigned p;
+    if (sscanf(line, "p%u %u", &p, seq) != 2 || p >= PRODUCERS || *seq >= linesPerProducer) {
+        return false;
+    }
+    *producer = (int) p;
+
+    char expected[512];
+    int n = format_line(expected, sizeof(expected), *producer, *seq);
+    return n == len && !memcmp(line, expected, n);
+}
+
+static void *reader_thread(void *arg)
+{
+    reader_t *r = (reader_t *) arg;
+    char *buf = (char *) malloc(RING_SIZE);
+    int64_t last[PRODUCERS];
+    for (int i = 0; i < PRODUCERS; i++) {
+        last[i] = -1;
+    }
+    int stalled = 0;
+
+    while (true) {
+        bool done = __atomic_load_n(&producersDone, __ATOMIC_ACQUIRE) == PRODUCERS;
+
+        size_t n = ring.read(&r->cursor, buf, RING_SIZE, &r->dropped);
+        for (size_t pos = 0; pos < n;) {
+            const char *end = (const char *) memchr(buf + pos, '\n', n - pos);
+            if (!end) {
+                r->garbled++;
+                break;
+            }
+            int len = (int) (end - (buf + pos));
+            int producer;
+            uint32_t seq;
+            if (!check_line(buf + pos, len, &producer, &seq)) {
+                r->garbled++;
+            } else {
+                if ((int64_t) seq <= last[producer]) {
+                    r->outOfOrder++;
+                }
+                last[producer] = seq;
+            }
+            r->read++;
+            pos += len + 1;
+        }
+
+        if (n) {
+            stalled = 0;
+            continue;
+        }
+        if (r->cursor == ring.head()) {
+            if (done) {
+                break;
+            }
+            stalled = 0;
+            sched_yield();
+            continue;
+        }
+        sched_yield();
+        if (++stalled > MAX_STALLED) {
+            ring.skip(&r->cursor, &r->dropped);
+            r->skipped++;
+            stalled = 0;
+        }
+    }
+
+    free(buf);
+    return nullptr;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1) {
+        linesPerProducer = (uint32_t) strtoul(argv[1], NULL, 10);
+    }
+    for (int i = 0; i < (int) sizeof(payload) - 1; i++) {
+        payload[i] = (char) ('a' + i % 26);
+    }
+
+    EXPECT(ring.init(RING_SIZE, RING_SLOTS), "init");
+    EXPECT(!LogRing().init(RING_SIZE + 1, RING_SLOTS), "size not a power of two");
+
+    reader_t readers[READERS] = {};
+    pthread_t threads[PRODUCERS + READERS];
+    for (int i = 0; i < READERS; i++) {
+        readers[i].cursor = ring.head();
+        pthread_create(&threads[PRODUCERS + i], nullptr, reader_thread, &readers[i]);
+    }
+    for (int i = 0; i < PRODUCERS; i++) {
+        pthread_create(&threads[i], nullptr, producer_thread, (void *) (intptr_t) i);
+    }
+    for (int i = 0; i < PRODUCERS + READERS; i++) {
+        pthread_join(threads[i], nullptr);
+    }
+
+    uint32_t total = PRODUCERS * linesPerProducer;
+    uint32_t lost = ring.getLost();
+    EXPECT(appendedLines == total && ring.head() == total, "appended %u head %u", appendedLines, ring.head());
+    EXPECT(returnedNull <= lost, "%u lines returned as lost, %u lost", returnedNull, lost);
+    EXPECT(ring.getTruncated() == 0, "%u truncated", ring.getTruncated());
+
+    printf("%u lines of %d producers, ring %d bytes %d slots, %u lost\n", total, PRODUCERS, RING_SIZE, RING_SLOTS,
+           lost);
+    printf("reader      read   dropped  garbled  skipped\n");
+    for (int i = 0; i < READERS; i++) {
+        reader_t *r = &readers[i];
+        printf("%6d  %8u  %8u  %7u  %7u\n", i, r->read, r->dropped, r->garbled, r->skipped);
+
+        EXPECT(r->read + r->dropped == total, "reader %d: %u read + %u dropped != %u", i, r->read, r->dropped, total);
+        EXPECT(r->read > 0, "reader %d got nothing", i);
+        EXPECT(r->outOfOrder == 0, "reader %d: %u lines out of order", i, r->outOfOrder);
+        EXPECT(r->garbled == 0 || lost > 0, "reader %d: %u garbled lines without a lost writer", i, r->garbled);
+    }
+
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("log_ring_stress ok\n");
+    return 0;
+}
@@ -0,0 +1,423 @@
+// Noise decrypt + parse of NewExtendedMiningJob frames: the in-place receive
+// path of components/stratum_v2 (sv2_noise_recv, the parser's views and the
+// pending job slots) against the copying one it replaced (sv2_noise_reference.h)
+//
+// Both paths read the same ciphertext from a loopback socket after a Noise
+// handshake with MockPoolSV2, on the shim ChaCha20-Poly1305. Each frame is
+// first checked on both paths: same header and plaintext, same parsed job,
+// also after it was copied into its pending slot. The copying path gets a
+// buffer for the largest payload, the firmware had 2 KB and reconnected on
+// larger frames. Then it reports frames/s and heap allocations per frame
+// ("copy" is the old path).
+//
+//   noise_bench [MB per run]
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <vector>
+
+#include "esp_transport.h"
+#include "esp_transport_tcp.h"
+
+extern "C" {
+#include "sv2_noise.h"
+#include "sv2_protocol.h"
+}
+
+#include "alloc_count.h"
+#include "mock_pool_sv2.h"
+#include "sv2_noise_reference.h"
+
+// the pool end of a connection, without the pool task
+class BenchPool : public MockPoolSV2 {
+  public:
+    BenchPool() : MockPoolSV2(1, 1000, 0) {}
+
+    bool respond(int fd)
+    {
+        m_clientFd = fd;
+        __atomic_store_n(&m_running, true, __ATOMIC_RELEASE);
+        bool ok = handshake();
+        __atomic_store_n(&m_running, false, __ATOMIC_RELEASE);
+        return ok;
+    }
+
+    std::vector<uint8_t> encode(const std::vector<uint8_t> &payload)
+    {
+        return encodeFrame(SV2_MSG_NEW_EXTENDED_MINING_JOB, true, payload);
+    }
+
+    bool send(const std::vector<uint8_t> &bytes)
+    {
+        return sendAll(bytes.data(), bytes.size());
+    }
+
+    const uint8_t *sendKey()
+    {
+        return m_sendKey;
+    }
+
+    const uint8_t *authorityKey()
+    {
+        return m_authorityKey;
+    }
+};
+
+typedef struct
+{
+    BenchPool *pool;
+    int fd;
+    bool ok;
+    const std::vector<uint8_t> *stream;
+    int copies;
+} pool_thread_t;
+
+static void *respond_thread(void *arg)
+{
+    pool_thread_t *t = (pool_thread_t *) arg;
+    sim_alloc_ignore_thread();
+    t->ok = t->pool->respond(t->fd);
+    return NULL;
+}
+
+static void *writer_thread(void *arg)
+{
+    pool_thread_t *t = (pool_thread_t *) arg;
+    sim_alloc_ignore_thread();
+    t->ok = true;
+    for (int i = 0; i < t->copies && t->ok; i++) {
+        t->ok = t->pool->send(*t->stream);
+    }
+    return NULL;
+}
+
+typedef struct
+{
+    BenchPool pool;
+    sv2_noise_ctx_t *noise = nullptr;
+    esp_transport_handle_t transport = nullptr;
+    int fd = -1;
+} session_t;
+
+static bool open_session(int listenFd, uint16_t port, session_t *s)
+{
+    s->transport = esp_transport_tcp_init();
+    if (esp_transport_connect(s->transport, "127.0.0.1", port, 1000) != 0) {
+        return false;
+    }
+    s->fd = accept(listenFd, NULL, NULL);
+    if (s->fd < 0) {
+        return false;
+    }
+
+    pool_thread_t t = {&s->pool, s->fd, false, nullptr, 0};
+    pthread_t thread;
+    pthread_create(&thread, NULL, respond_thread, &t);
+    s->noise = sv2_noise_create();
+    int ret = s->noise ? sv2_noise_handshake(s->noise, s->transport, s->pool.authorityKey()) : -1;
+    pthread_join(thread, NULL);
+    return t.ok && ret == 0;
+}
+
+static void close_session(session_t *s)
+{
+    if (s->noise) {
+        sv2_noise_destroy(s->noise);
+    }
+    if (s->transport) {
+        esp_transport_close(s->transport);
+        esp_transport_destroy(s->transport);
+    }
+    if (s->fd >= 0) {
+        close(s->fd);
+    }
+}
+
+static void put_u16(std::vector<uint8_t> &out, uint16_t v)
+{
+    out.push_back((uint8_t) v);
+    out.push_back((uint8_t) (v >> 8));
+}
+
+static void put_u32(std::vector<uint8_t> &out, uint32_t v)
+{
+    for (int i = 0; i < 4; i++) {
+        out.push_back((uint8_t) (v >> (8 * i)));
+    }
+}
+
+// future job (no min_ntime), 403 bytes with 12 branches and no coinbase
+static std::vector<uint8_t> job_payload(uint32_t jobId, int branches, int coinbaseLen)
+{
+    std::vector<uint8_t> out;
+    put_u32(out, 7);
+    put_u32(out, jobId);
+    out.push_back(0);
+    put_u32(out, 0x20000000);
+    out.push_back(1);
+    out.push_back((uint8_t) branches);
+    for (int i = 0; i < branches * 32; i++) {
+        out.push_back((uint8_t) (jobId * 31 + i * 7));
+    }
+    int prefixLen = coinbaseLen / 3;
+    int suffixLen = coinbaseLen - prefixLen;
+    put_u16(out, (uint16_t) prefixLen);
+    for (int i = 0; i < prefixLen; i++) {
+        out.push_back((uint8_t) (jobId + i));
+    }
+    put_u16(out, (uint16_t) suffixLen);
+    for (int i = 0; i < suffixLen; i++) {
+        out.push_back((uint8_t) (jobId ^ (i * 13)));
+    }
+    return out;
+}
+
+static bool same_job(const sv2_ext_job_t *view, const sv2_ext_job_copy_t *copy)
+{
+    if (view->job_id != copy->job_id || view->version != copy->version ||
+        view->version_rolling_allowed != copy->version_rolling_allowed || view->ntime != copy->ntime ||
+        view->clean_jobs != copy->clean_jobs || view->merkle_path_count != copy->merkle_path_count ||
+        view->coinbase_prefix_len != copy->coinbase_prefix_len ||
+        view->coinbase_suffix_len != copy->coinbase_suffix_len) {
+        return false;
+    }
+    for (int i = 0; i < view->merkle_path_count; i++) {
+        if (memcmp(view->merkle_path + 32 * i, copy->merkle_path[i], 32)) {
+            return false;
+        }
+    }
+    return (!view->coinbase_prefix_len ||
+            !memcmp(view->coinbase_prefix, copy->coinbase_prefix, view->coinbase_prefix_len)) &&
+           (!view->coinbase_suffix_len ||
+            !memcmp(view->coinbase_suffix, copy->coinbase_suffix, view->coinbase_suffix_len));
+}
+
+// CPU time of the reader, the writer thread shares the core on a small host
+static double now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static const int MERKLE_BRANCHES = 12;
+
+// coinbase sizes of the timed runs: 771, 1971 and 8471 byte payloads
+static const int COINBASE_SIZES[] = {368, 1568, 8068};
+
+// every frame goes out twice, the in-place path reads the first copy, the
+// copying path the second one with its own nonce counter
+static int check_equivalence(int listenFd, uint16_t port, std::vector<uint8_t> &oldBuf)
+{
+    static const struct
+    {
+        int branches;
+        int coinbase;
+    } shapes[] = {{0, 0}, {1, 2}, {12, 368}, {12, 1568}, {12, 8068}, {SV2_MAX_MERKLE_BRANCHES, 30000}};
+
+    session_t s;
+    if (!open_session(listenFd, port, &s)) {
+        fprintf(stderr, "equivalence: handshake failed\n");
+        close_session(&s);
+        return 1;
+    }
+
+    std::vector<std::vector<uint8_t>> payloads;
+    std::vector<uint8_t> stream;
+    for (uint32_t jobId = 1; jobId <= 24; jobId++) {
+        payloads.push_back(job_payload(jobId, shapes[jobId % 6].branches, shapes[jobId % 6].coinbase));
+        std::vector<uint8_t> frame = s.pool.encode(payloads.back());
+        stream.insert(stream.end(), frame.begin(), frame.end());
+        stream.insert(stream.end(), frame.begin(), frame.end());
+    }
+
+    pool_thread_t writer = {&s.pool, s.fd, false, &stream, 1};
+    pthread_t thread;
+    pthread_create(&thread, NULL, writer_thread, &writer);
+
+    sv2_ext_pending_job_t slots[SV2_PENDING_JOBS_SIZE] = {};
+    uint64_t oldNonce = 0;
+    int failures = 0;
+    for (const auto &expected : payloads) {
+        uint8_t hdr[6], oldHdr[6];
+        uint8_t *payload;
+        int len = 0, oldLen = 0;
+        if (sv2_noise_recv(s.noise, s.transport, hdr, &payload, &len) != 0 ||
+            sv2_noise_recv_copy(s.pool.sendKey(), &oldNonce, s.transport, oldHdr, oldBuf.data(), (int) oldBuf.size(),
+                                &oldLen) != 0) {
+            fprintf(stderr, "equivalence: frame doesn't decrypt\n");
+            failures++;
+            break;
+        }
+        if (memcmp(hdr, oldHdr, sizeof(hdr)) || len != oldLen || len != (int) expected.size() ||
+            memcmp(payload, oldBuf.data(), len) || memcmp(payload, expected.data(), len)) {
+            fprintf(stderr, "equivalence: plaintext of a %d byte payload differs\n", (int) expected.size());
+            failures++;
+            continue;
+        }
+
+        sv2_ext_job_t job;
+        sv2_ext_job_copy_t *copy = sv2_parse_new_extended_mining_job_copy(oldBuf.data(), oldLen, NULL);
+        if (sv2_parse_new_extended_mining_job(payload, len, &job, NULL) != 0 || !copy) {
+            fprintf(stderr, "equivalence: a %d byte job doesn't parse\n", len);
+            failures++;
+            sv2_ext_job_copy_free(copy);
+            continue;
+        }
+        sv2_ext_pending_job_t *slot = &slots[job.job_id % SV2_PENDING_JOBS_SIZE];
+        if (!same_job(&job, copy) || sv2_ext_job_store(slot, &job) != 0 || !same_job(&slot->job, copy)) {
+            fprintf(stderr, "equivalence: job %lu differs\n", (unsigned long) job.job_id);
+            failures++;
+        }
+        sv2_ext_job_copy_free(copy);
+    }
+
+    if (failures) {
+        shutdown(s.fd, SHUT_RDWR);
+    }
+    pthread_join(thread, NULL);
+    for (auto &slot : slots) {
+        free(slot.buf);
+    }
+    close_session(&s);
+
+    printf("equivalence: %d frames of %d shapes, %s\n\n", (int) payloads.size(), (int) (sizeof(shapes) / sizeof(shapes[0])),
+           failures ? "FAILED" : "same plaintext and jobs");
+    return failures;
+}
+
+typedef struct
+{
+    int frames;
+    double framesPerSec;
+    double allocsPerFrame;
+} result_t;
+
+static int bench(int listenFd, uint16_t port, int coinbase, int megabytes, std::vector<uint8_t> &oldBuf,
+                 result_t *inPlace, result_t *copying)
+{
+    session_t s;
+    if (!open_session(listenFd, port, &s)) {
+        fprintf(stderr, "bench: handshake failed\n");
+        close_session(&s);
+        return 1;
+    }
+
+    std::vector<uint8_t> stream;
+    int frames = 0;
+    while (stream.size() < (size_t) megabytes << 20) {
+        std::vector<uint8_t> frame = s.pool.encode(job_payload(frames + 1, MERKLE_BRANCHES, coinbase));
+        stream.insert(stream.end(), frame.begin(), frame.end());
+        frames++;
+    }
+
+    pool_thread_t writer = {&s.pool, s.fd, false, &stream, 2};
+    pthread_t thread;
+    pthread_create(&thread, NULL, writer_thread, &writer);
+
+    int errors = 0;
+    inPlace->frames = copying->frames = frames;
+
+    sv2_ext_pending_job_t slots[SV2_PENDING_JOBS_SIZE] = {};
+    uint64_t allocs = sim_alloc_count();
+    double start = now_ns();
+    for (int i = 0; i < frames; i++) {
+        uint8_t hdr[6];
+        uint8_t *payload;
+        int len;
+        sv2_ext_job_t job;
+        if (sv2_noise_recv(s.noise, s.transport, hdr, &payload, &len) != 0 ||
+            sv2_parse_new_extended_mining_job(payload, len, &job, NULL) != 0 ||
+            sv2_ext_job_store(&slots[job.job_id % SV2_PENDING_JOBS_SIZE], &job) != 0) {
+            errors++;
+            break;
+        }
+    }
+    double ns = now_ns() - start;
+    inPlace->framesPerSec = frames / (ns / 1e9);
+    inPlace->allocsPerFrame = (double) (sim_alloc_count() - allocs) / frames;
+
+    sv2_ext_job_copy_t *pending[SV2_PENDING_JOBS_SIZE] = {};
+    uint64_t oldNonce = 0;
+    allocs = sim_alloc_count();
+    start = now_ns();
+    for (int i = 0; i < frames && !errors; i++) {
+        uint8_t hdr[6];
+        int len;
+        sv2_ext_job_copy_t *job = NULL;
+        if (sv2_noise_recv_copy(s.pool.sendKey(), &oldNonce, s.transport, hdr, oldBuf.data(), (int) oldBuf.size(),
+                                &len) != 0 ||
+            !(job = sv2_parse_new_extended_mining_job_copy(oldBuf.data(), len, NULL))) {
+            errors++;
+            break;
+        }
+        int slot = job->job_id % SV2_PENDING_JOBS_SIZE;
+        sv2_ext_job_copy_free(pending[slot]);
+        pending[slot] = job;
+    }
+    ns = now_ns() - start;
+    copying->framesPerSec = frames / (ns / 1e9);
+    copying->allocsPerFrame = (double) (sim_alloc_count() - allocs) / frames;
+
+    // a failed reader leaves the writer blocked on a full socket
+    if (errors) {
+        shutdown(s.fd, SHUT_RDWR);
+    }
+    pthread_join(thread, NULL);
+    for (int i = 0; i < SV2_PENDING_JOBS_SIZE; i++) {
+        free(slots[i].buf);
+        sv2_ext_job_copy_free(pending[i]);
+    }
+    close_session(&s);
+
+    if (errors) {
+        fprintf(stderr, "bench: a %d byte coinbase frame failed\n", coinbase);
+    }
+    return errors;
+}
+
+int main(int argc, char **argv)
+{
+    int megabytes = argc > 1 ? atoi(argv[1]) : 32;
+
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    if (listenFd < 0 || bind(listenFd, (struct sockaddr *) &addr, sizeof(addr)) || listen(listenFd, 1) ||
+        getsockname(listenFd, (struct sockaddr *) &addr, &addrLen)) {
+        fprintf(stderr, "can't listen on loopback\n");
+        return 1;
+    }
+    uint16_t port = ntohs(addr.sin_port);
+
+    std::vector<uint8_t> oldBuf(SV2_NOISE_MAX_PAYLOAD);
+
+    int failures = check_equivalence(listenFd, port, oldBuf);
+
+    printf("%-8s %7s %14s %14s %14s %14s\n", "payload", "frames", "copy frames/s", "frames/s", "copy allocs",
+           "allocs");
+    for (int coinbase : COINBASE_SIZES) {
+        result_t inPlace, copying;
+        if (bench(listenFd, port, coinbase, megabytes, oldBuf, &inPlace, &copying)) {
+            failures++;
+            continue;
+        }
+        int payload = (int) job_payload(0, MERKLE_BRANCHES, coinbase).size();
+        printf("%-8d %7d %14.0f %14.0f %14.2f %14.2f\n", payload, inPlace.frames, copying.framesPerSec,
+               inPlace.framesPerSec, copying.allocsPerFrame, inPlace.allocsPerFrame);
+    }
+
+    close(listenFd);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,257 @@
+// Nonce validation speed of test_nonce_value against the per job cache of
+// header midstates it had before (nonce_reference.h)
+//
+// The nonces and rolled versions come from a simulated chain of each family
+// through the firmware's ASIC driver. The cache is keyed by the rolled
+// version, so its hit rate is what the chips' version rolling leaves of it;
+// "no rolling" replays the same nonces on the base version, the case of a
+// pool without version rolling.
+//
+// The early exit below the pool difficulty and the hardware error flag
+// come from the top 64 bits of the hash (hash_below_diff). They are checked
+// against the exact difficulty on hashes around each threshold.
+//
+//   nonce_bench [nonces per family] [passes per round]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <algorithm>
+
+#include "mining.h"
+
+#include "nonce_reference.h"
+#include "sim_board.h"
+#include "sim_chain.h"
+
+typedef struct
+{
+    uint32_t nonce;
+    uint32_t rolled_version;
+} result_t;
+
+static volatile double sink;
+
+static double now_s()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void build_job(bm_job *job)
+{
+    mining_notify notify = {};
+    for (int i = 0; i < 32; i++) {
+        notify._prev_block_hash[i] = (uint8_t) (i * 7 + 3);
+    }
+    notify.version = 0x20000000;
+    notify.target = 0x17034219;
+    notify.ntime = 0x66000000;
+    notify.difficulty = 1;
+
+    uint8_t merkle_root[32];
+    for (int i = 0; i < 32; i++) {
+        merkle_root[i] = (uint8_t) (i * 13 + 5);
+    }
+
+    memset(job, 0, sizeof(*job));
+    construct_bm_job_bin(&notify, merkle_root, 0x1fffe000, job);
+}
+
+// nonces of one job from the simulated chain, read through the driver
+static int collect(SimChain::Family family, const bm_job *job, result_t *results, int count)
+{
+    SimChain chain(family, 1, 20000.0f);
+    sim_serial_attach(&chain);
+    chain.start();
+
+    SimBoard *board = new SimBoard(family, 1);
+    board->loadSettings();
+    board->initBoard();
+    if (!board->initAsics()) {
+        fprintf(stderr, "%s: asic init failed\n", SimChain::familyName(family));
+        return 0;
+    }
+
+    Asic *asics = board->getAsics();
+    asics->setJobDifficultyMask(board->getAsicMinDifficulty());
+    asics->sendWork(0, (bm_job *) job);
+
+    int n = 0;
+    for (int tries = 0; n < count && tries < count * 4; tries++) {
+        task_result result;
+        if (!asics->processWork(&result) || result.is_reg_resp) {
+            continue;
+        }
+        results[n].nonce = result.nonce;
+        results[n].rolled_version = result.rolled_version | job->version;
+        n++;
+    }
+
+    chain.stop();
+    return n;
+}
+
+typedef struct
+{
+    double cachedNs;
+    double plainNs;
+    double hitRate;
+    int mismatches;
+} run_t;
+
+// seconds per nonce of one pass over the results
+template <typename F> static double time_pass(F check, const result_t *results, int count, int passes)
+{
+    double acc = 0.0;
+    double start = now_s();
+    for (int p = 0; p < passes; p++) {
+        for (int i = 0; i < count; i++) {
+            acc += check(results[i]);
+        }
+    }
+    sink = acc;
+    return (now_s() - start) / ((double) passes * count);
+}
+
+static run_t run(const bm_job *job, const result_t *results, int count, int passes, bool rolling)
+{
+    run_t r = {};
+    midstate_cache_t cache;
+    midstate_cache_init(job, &cache);
+
+    auto version = [&](const result_t &result) { return rolling ? result.rolled_version : job->version; };
+    auto cached = [&](const result_t &result) {
+        return test_nonce_value_cached(job, &cache, result.nonce, version(result));
+    };
+    auto plain = [&](const result_t &result) { return test_nonce_value(job, result.nonce, version(result)); };
+
+    // best of a few alternating rounds, against frequency scaling and other load
+    r.cachedNs = r.plainNs = 1e9;
+    for (int round = 0; round < 5; round++) {
+        r.cachedNs = std::min(r.cachedNs, time_pass(cached, results, count, passes) * 1e9);
+        r.plainNs = std::min(r.plainNs, time_pass(plain, results, count, passes) * 1e9);
+    }
+
+    r.hitRate = (double) cache.hits / (cache.hits + cache.misses);
+
+    for (int i = 0; i < count; i++) {
+        if (cached(results[i]) != plain(results[i])) {
+            r.mismatches++;
+        }
+    }
+    return r;
+}
+
+// hash_below_diff against the exact difficulty, on hashes whose top 64 bits
+// are around the bound of each threshold, returns the number of failures
+static int check_early_exit()
+{
+    static const double truediffone = 26959535291011309493156476344723991336010898738574164086137773096960.0;
+    static const uint32_t diffs[] = {1, 3, 256, 1000, 4096, 65536, 1000000, 1u << 24, 0x7fffffff, 0xffffffff};
+
+    uint32_t rng = 0x9e3779b9;
+    int wrong = 0, boundary = 0, checked = 0;
+    for (uint32_t diff : diffs) {
+        uint64_t bound = 0xFFFF0000ull / diff;
+        for (int64_t delta = -3; delta <= 3; delta++) {
+            if ((int64_t) bound + delta < 0) {
+                continue;
+            }
+            uint64_t top64 = bound + delta;
+            for (int i = 0; i < 64; i++) {
+                uint8_t hash[32];
+                for (int b = 0; b < 24; b++) {
+                    rng ^= rng << 13;
+                    rng ^= rng >> 17;
+                    rng ^= rng << 5;
+                    hash[b] = (uint8_t) rng;
+                }
+                memcpy(hash + 24, &top64, 8);
+
+                double exact = truediffone / le256todouble(hash);
+                bool below = hash_below_diff(top64, diff);
+                checked++;
+                // below has to be right, the rest may only miss at the bound itself
+                if (below && exact >= diff) {
+                    wrong++;
+                } else if (!below && exact < diff) {
+                    if (top64 == bound) {
+                        boundary++;
+                    } else {
+                        wrong++;
+                    }
+                }
+            }
+        }
+    }
+    printf("early exit: %d hashes around 10 thresholds, %d wrong, %d passed at the bound\n", checked, wrong, boundary);
+    return wrong ? 1 : 0;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 2000;
+    int passes = argc > 2 ? atoi(argv[2]) : 10;
+
+    bm_job job;
+    build_job(&job);
+
+    result_t *results = new result_t[count];
+    int failures = 0;
+
+    printf("midstate cache %d x %d bytes per job\n\n", MIDSTATE_CACHE_SIZE, (int) sizeof(cached_midstate_t));
+    printf("%-8s %-10s %7s %9s %13s %13s\n", "family", "versions", "hits", "distinct", "cache nonce/s", "plain nonce/s");
+
+    for (SimChain::Family family : {SimChain::BM1366, SimChain::BM1368, SimChain::BM1370}) {
+        int n = collect(family, &job, results, count);
+        if (n < count) {
+            fprintf(stderr, "%s: only %d of %d nonces\n", SimChain::familyName(family), n, count);
+            failures++;
+            continue;
+        }
+
+        // the simulated nonces have no real difficulty: rejected early below 1 and
+        // flagged as hardware errors, not flagged without a threshold
+        int flags = 0;
+        for (int i = 0; i < n; i++) {
+            bool hw = false, noHw = true;
+            double early = test_nonce_value(&job, results[i].nonce, results[i].rolled_version, 1, 1, &hw);
+            test_nonce_value(&job, results[i].nonce, results[i].rolled_version, 0, 0, &noHw);
+            flags += (early != 0.0 || !hw || noHw);
+        }
+        if (flags) {
+            fprintf(stderr, "%s: %d nonces with a wrong early exit or hardware error flag\n",
+                    SimChain::familyName(family), flags);
+            failures++;
+        }
+
+        int distinct = 0;
+        for (int i = 0; i < n; i++) {
+            int j = 0;
+            while (j < i && results[j].rolled_version != results[i].rolled_version) {
+                j++;
+            }
+            distinct += (j == i);
+        }
+
+        for (bool rolling : {true, false}) {
+            run_t r = run(&job, results, n, passes, rolling);
+            printf("%-8s %-10s %6.1f%% %9d %13.0f %13.0f\n", SimChain::familyName(family), rolling ? "rolled" : "no rolling",
+                   r.hitRate * 100.0, rolling ? distinct : 1, 1e9 / r.cachedNs, 1e9 / r.plainNs);
+            if (r.mismatches) {
+                fprintf(stderr, "%s: %d nonces with a different difficulty\n", SimChain::familyName(family), r.mismatches);
+                failures++;
+            }
+        }
+    }
+
+    delete[] results;
+
+    printf("\n");
+    failures += check_early_exit();
+    return failures ? 1 : 0;
+}
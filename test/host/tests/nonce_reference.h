@@ -0,0 +1,98 @@
+#pragma once
+
+#include <string.h>
+
+#include "mbedtls/sha256.h"
+
+#include "mining.h"
+#include "mining_utils.h"
+
+// test_nonce_value with the per job cache of header midstates keyed by the
+// rolled version that components/bm1397/mining.cpp had before, for the
+// comparison in nonce_bench
+
+#define MIDSTATE_CACHE_SIZE 4
+
+typedef struct
+{
+    uint32_t version;
+    bool valid;
+    mbedtls_sha256_context ctx;
+} cached_midstate_t;
+
+typedef struct
+{
+    cached_midstate_t midstates[MIDSTATE_CACHE_SIZE];
+    uint8_t next;
+    uint32_t hits;
+    uint32_t misses;
+} midstate_cache_t;
+
+static inline void midstate_calculate(const bm_job *job, uint32_t version, cached_midstate_t *midstate)
+{
+    unsigned char block[64];
+
+    memcpy(block, &version, 4);
+    memcpy(block + 4, job->prev_block_hash, 32);
+    memcpy(block + 36, job->merkle_root, 28);
+
+    mbedtls_sha256_init(&midstate->ctx);
+    mbedtls_sha256_starts(&midstate->ctx, 0);
+    mbedtls_sha256_update(&midstate->ctx, block, 64);
+
+    midstate->version = version;
+    midstate->valid = true;
+}
+
+// the base version midstate was computed when the job was built
+static inline void midstate_cache_init(const bm_job *job, midstate_cache_t *cache)
+{
+    memset(cache, 0, sizeof(*cache));
+    midstate_calculate(job, job->version, &cache->midstates[0]);
+    cache->next = 1;
+}
+
+static inline const cached_midstate_t *midstate_get(const bm_job *job, midstate_cache_t *cache, uint32_t rolled_version)
+{
+    for (int i = 0; i < MIDSTATE_CACHE_SIZE; i++) {
+        if (cache->midstates[i].valid && cache->midstates[i].version == rolled_version) {
+            cache->hits++;
+            return &cache->midstates[i];
+        }
+    }
+    cache->misses++;
+
+    cached_midstate_t *midstate = &cache->midstates[cache->next];
+    cache->next = (cache->next + 1) % MIDSTATE_CACHE_SIZE;
+
+    midstate_calculate(job, rolled_version, midstate);
+    return midstate;
+}
+
+static inline double test_nonce_value_cached(const bm_job *job, midstate_cache_t *cache, uint32_t nonce,
+                                             uint32_t rolled_version)
+{
+    static const double truediffone = 26959535291011309493156476344723991336010898738574164086137773096960.0;
+
+    unsigned char tail[16];
+    memcpy(tail, job->merkle_root + 28, 4);
+    memcpy(tail + 4, &job->ntime, 4);
+    memcpy(tail + 8, &job->target, 4);
+    memcpy(tail + 12, &nonce, 4);
+
+    unsigned char hash_buffer[32];
+    unsigned char hash_result[32];
+
+    const cached_midstate_t *midstate = midstate_get(job, cache, rolled_version);
+
+    mbedtls_sha256_context ctx;
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_clone(&ctx, &midstate->ctx);
+    mbedtls_sha256_update(&ctx, tail, 16);
+    mbedtls_sha256_finish(&ctx, hash_buffer);
+    mbedtls_sha256_free(&ctx);
+
+    mbedtls_sha256(hash_buffer, 32, hash_result, 0);
+
+    return truediffone / le256todouble(hash_result);
+}
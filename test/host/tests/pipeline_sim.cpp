@@ -0,0 +1,200 @@
+// Mining pipeline on simulated chips against a mock Stratum V1 pool
+//
+// Runs create_jobs_task, ASIC_result_task and the Stratum client of the
+// firmware unchanged, with the serial port connected to a SimChain and the
+// pool on localhost. After a warm-up it measures for --seconds and reports
+// shares/s, notify-to-work latency, job build time and heap allocations per
+// share. Fails if the pool rejected a share or none was accepted.
+//
+//   pipeline_sim [--family BM1366|BM1368|BM1370] [--chips n] [--seconds s]
+//                [--rate nonces/s] [--diff pool difficulty] [--notify ms] [--branches n]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "asic_result_task.h"
+#include "create_jobs_task.h"
+#include "global_state.h"
+#include "nvs_config.h"
+
+#include "alloc_count.h"
+#include "mock_pool.h"
+#include "sim_board.h"
+#include "sim_chain.h"
+
+typedef struct
+{
+    int64_t us;
+    MockPool::stats_t pool;
+    SimChain::stats_t chain;
+    create_jobs_stats_t jobs;
+    asic_result_stats_t results;
+    uint64_t allocs;
+} snapshot_t;
+
+static void take_snapshot(MockPool *pool, SimChain *chain, snapshot_t *s)
+{
+    s->us = esp_timer_get_time();
+    pool->getStats(&s->pool);
+    chain->getStats(&s->chain);
+    create_jobs_get_stats(&s->jobs);
+    asic_result_get_stats(&s->results);
+    s->allocs = sim_alloc_count();
+}
+
+int main(int argc, char **argv)
+{
+    SimChain::Family family = SimChain::BM1368;
+    int chips = 4;
+    int seconds = 10;
+    float rate = 200.0f;
+    uint32_t diff = 0;
+    uint32_t notifyMs = 2000;
+    int branches = 12;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (!value) {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return 2;
+        }
+        if (!strcmp(arg, "--family")) {
+            if (!SimChain::parseFamily(value, &family)) {
+                fprintf(stderr, "unknown chip family %s\n", value);
+                return 2;
+            }
+        } else if (!strcmp(arg, "--chips")) {
+            chips = atoi(value);
+        } else if (!strcmp(arg, "--seconds")) {
+            seconds = atoi(value);
+        } else if (!strcmp(arg, "--rate")) {
+            rate = atof(value);
+        } else if (!strcmp(arg, "--diff")) {
+            diff = strtoul(value, NULL, 10);
+        } else if (!strcmp(arg, "--notify")) {
+            notifyMs = strtoul(value, NULL, 10);
+        } else if (!strcmp(arg, "--branches")) {
+            branches = atoi(value);
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return 2;
+        }
+        i++;
+    }
+    sim_alloc_ignore_thread();
+
+    SimChain chain(family, chips, rate);
+    sim_serial_attach(&chain);
+    chain.start();
+
+    SimBoard *board = new SimBoard(family, chips);
+
+    // every nonce the chips return is a share unless --diff says otherwise
+    if (!diff) {
+        diff = board->getAsicMinDifficulty();
+    }
+    MockPool pool(diff, notifyMs, branches);
+    if (!pool.start()) {
+        fprintf(stderr, "mock pool: can't listen\n");
+        return 1;
+    }
+
+    Config::setStratumURL("127.0.0.1");
+    Config::setStratumPortNumber(pool.getPort());
+    Config::setStratumUser("host.sim");
+    Config::setStratumPass("x");
+
+    board->loadSettings();
+    SYSTEM_MODULE.setBoard(board);
+    board->initBoard();
+    if (!board->initAsics()) {
+        fprintf(stderr, "asic init failed\n");
+        return 1;
+    }
+
+    STRATUM_MANAGER = new StratumManagerFallback();
+    STRATUM_MANAGER->loadSettings();
+
+    xTaskCreate(create_jobs_task, "stratum miner", 8192, NULL, 10, NULL);
+    xTaskCreate(ASIC_result_task, "asic result", 8192, NULL, 15, NULL);
+    xTaskCreate(StratumManager::taskWrapper, "stratum manager", 8192, (void *) STRATUM_MANAGER, 5, NULL);
+
+    // warm-up: connected, first job on the chips and the first share accepted,
+    // slow on a loaded host
+    snapshot_t start;
+    for (int i = 0; i < 300; i++) {
+        take_snapshot(&pool, &chain, &start);
+        if (start.pool.accepted) {
+            break;
+        }
+        usleep(100 * 1000);
+    }
+    if (!start.pool.accepted) {
+        fprintf(stderr, "no share accepted within 30s\n");
+        // the firmware tasks still use the pool and the chain, no destructors
+        _exit(1);
+    }
+
+    usleep((useconds_t) seconds * 1000000);
+
+    snapshot_t end;
+    take_snapshot(&pool, &chain, &end);
+
+    double window = (end.us - start.us) / 1e6;
+    uint32_t accepted = end.pool.accepted - start.pool.accepted;
+    uint32_t nonces = end.results.nonces - start.results.nonces;
+    uint32_t jobs = end.jobs.jobs - start.jobs.jobs;
+
+    // pool notify to the first job with its prev block hash on the chips
+    int latencies = 0;
+    int64_t latencySum = 0;
+    int64_t latencyMax = 0;
+    for (const auto &notify : pool.getNotifies()) {
+        if (notify.second < start.us || notify.second > end.us) {
+            continue;
+        }
+        int64_t first = chain.firstJobUs(notify.first.data());
+        if (!first) {
+            continue;
+        }
+        int64_t latency = first - notify.second;
+        latencySum += latency;
+        latencyMax = std::max(latencyMax, latency);
+        latencies++;
+    }
+
+    uint32_t rejected = end.pool.rejectedLowDiff + end.pool.rejectedDuplicate + end.pool.rejectedInvalid;
+
+    printf("%s x%d, %.1fs, pool diff %lu, %d merkle branches\n", SimChain::familyName(family), chips, window,
+           (unsigned long) diff, branches);
+    printf("  shares/s            %.1f (%lu accepted, %lu rejected, %lu stale total)\n", accepted / window,
+           (unsigned long) accepted, (unsigned long) rejected, (unsigned long) end.pool.rejectedStale);
+    printf("  nonces/s            %.1f\n", nonces / window);
+    printf("  notify-to-work      pool->chip avg %.2fms max %.2fms (%d notifies), firmware max %.2fms\n",
+           latencies ? latencySum / 1e3 / latencies : 0.0, latencyMax / 1e3, latencies, end.jobs.notifyToWorkMaxUs / 1e3);
+    printf("  job build time      avg %.1fus max %luus (%lu jobs)\n",
+           jobs ? (double) (end.jobs.buildTimeUs - start.jobs.buildTimeUs) / jobs : 0.0,
+           (unsigned long) end.jobs.buildTimeMaxUs, (unsigned long) jobs);
+    printf("  nonce processing    avg %.1fus max %luus\n",
+           nonces ? (double) (end.results.processTimeUs - start.results.processTimeUs) / nonces : 0.0,
+           (unsigned long) end.results.processTimeMaxUs);
+    printf("  heap allocations    %.2f per share, %.2f per job (%llu total)\n",
+           accepted ? (double) (end.allocs - start.allocs) / accepted : 0.0,
+           jobs ? (double) (end.allocs - start.allocs) / jobs : 0.0, (unsigned long long) (end.allocs - start.allocs));
+    printf("  hw errors           %lu\n", (unsigned long) (end.results.hwErrors - start.results.hwErrors));
+    fflush(stdout);
+
+    bool ok = accepted > 0 && !rejected && end.chain.crcErrors == 0;
+
+    // the firmware tasks never return
+    _exit(ok ? 0 : 1);
+}
@@ -0,0 +1,252 @@
+// PLL table and frequency ramp of components/bm1397/pll.cpp
+//
+// table: every entry on the 0.25 MHz grid against pll_search(), the search
+// the frequency was set with before. An entry has to be the same setting or
+// closer to the target, never worse. board options: the frequencies of
+// main/boards/*.cpp, only 777 MHz changes (see pll.h). ramp: steps grow only
+// after a fast confirmation, go back to the minimum step after a slow or
+// unconfirmed one, stay on the grid and end on the target.
+
+#include <math.h>
+#include <stdio.h>
+
+#include "pll.h"
+
+static int failures = 0;
+
+#define EXPECT(cond, ...)                                                                                                  \
+    do {                                                                                                                   \
+        if (!(cond)) {                                                                                                     \
+            if (failures++ < 10) {                                                                                         \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+                printf(__VA_ARGS__);                                                                                       \
+                printf("\n");                                                                                              \
+            }                                                                                                              \
+        }                                                                                                                  \
+    } while (0)
+
+static bool same_setting(const pll_setting_t &a, const pll_setting_t &b)
+{
+    return a.fbDiv == b.fbDiv && a.refDiv == b.refDiv && a.postDiv == b.postDiv;
+}
+
+static void test_table()
+{
+    int identical = 0;
+    int closer = 0;
+    int tied = 0;
+    int searchless = 0;
+    int unreachable = 0;
+    float maxError = 0.0f;
+
+    for (int q = PLL_TABLE_MIN_MHZ * PLL_TABLE_STEPS_PER_MHZ; q <= PLL_TABLE_MAX_MHZ * PLL_TABLE_STEPS_PER_MHZ; q++) {
+        float f = (float) q / PLL_TABLE_STEPS_PER_MHZ;
+        pll_setting_t table = {};
+        pll_setting_t search = {};
+        bool inTable = pll_lookup(f, &table);
+        bool found = pll_search(f, &search);
+
+        // some frequencies above 1 GHz have no setting within 2 MHz
+        EXPECT(inTable || !found, "no table entry for %.2f MHz", f);
+        if (!inTable) {
+            unreachable++;
+            continue;
+        }
+
+        int postdiv1 = (table.postDiv >> 4) + 1;
+        int postdiv2 = (table.postDiv & 0xf) + 1;
+        EXPECT(table.fbDiv >= PLL_FB_DIV_MIN && table.fbDiv <= PLL_FB_DIV_MAX && table.refDiv >= 1 &&
+                   table.refDiv <= 2 && postdiv1 <= 7 && postdiv2 >= 1 && postdiv1 >= postdiv2,
+               "%.2f MHz: invalid setting %02x/%d/%02x", f, table.fbDiv, table.refDiv, table.postDiv);
+
+        float errTable = fabsf(f - pll_frequency(&table));
+        maxError = fmaxf(maxError, errTable);
+        if (!found) {
+            searchless++;
+            continue;
+        }
+
+        float errSearch = fabsf(f - pll_frequency(&search));
+        if (same_setting(table, search)) {
+            identical++;
+        } else {
+            EXPECT(errTable < errSearch + 1e-4f, "%.2f MHz: table %.4f MHz off, search %.4f MHz", f, errTable,
+                   errSearch);
+            if (errTable < errSearch - 1e-4f) {
+                closer++;
+            } else {
+                // as close, lower post dividers
+                tied++;
+            }
+        }
+    }
+
+    EXPECT(maxError <= 2.0f, "max error %.4f MHz", maxError);
+    printf("table: %d identical, %d closer, %d as close, %d only in the table, %d unreachable, max error %.4f MHz\n",
+           identical, closer, tied, searchless, unreachable, maxError);
+}
+
+static void test_board_options()
+{
+    // all frequencies of the boards in main/boards/*.cpp
+    static const int options[] = {300, 325, 350, 375, 400, 425, 450, 475, 485, 490, 495, 500,
+                                  515, 525, 550, 575, 590, 600, 625, 650, 675, 700, 725, 750,
+                                  775, 777, 800, 825, 850, 875, 900, 925, 950, 975, 1000};
+
+    for (int option : options) {
+        pll_setting_t table = {};
+        pll_setting_t search = {};
+        pll_lookup((float) option, &table);
+        pll_search((float) option, &search);
+
+        if (option != 777) {
+            EXPECT(same_setting(table, search), "%d MHz: table %.2f MHz (%02x/%d/%02x), search %.2f MHz", option,
+                   pll_frequency(&table), table.fbDiv, table.refDiv, table.postDiv, pll_frequency(&search));
+            continue;
+        }
+
+        // documented in pll.h
+        EXPECT(table.fbDiv == 0xda && table.refDiv == 1 && table.postDiv == 0x60,
+               "777 MHz: table %02x/%d/%02x", table.fbDiv, table.refDiv, table.postDiv);
+        printf("777 MHz: table %.2f MHz (fb %d refdiv %d postdiv %d/%d), search %.2f MHz (fb %d refdiv %d postdiv %d/%d)\n",
+               pll_frequency(&table), table.fbDiv, table.refDiv, (table.postDiv >> 4) + 1, (table.postDiv & 0xf) + 1,
+               pll_frequency(&search), search.fbDiv, search.refDiv, (search.postDiv >> 4) + 1,
+               (search.postDiv & 0xf) + 1);
+    }
+}
+
+// runs a ramp, answer() decides how the chips confirm each step, returns the
+// steps and the time the transition takes like doFrequencyTransition waits
+template <typename Answer>
+static int run_ramp(float from, float to, const asic_ramp_profile_t &profile, Answer answer, uint32_t *ms,
+                    float *maxStep = nullptr)
+{
+    FrequencyRamp ramp;
+    ramp.start(from, to, profile);
+
+    int steps = 0;
+    uint32_t total = 0;
+    float prev = from;
+    float freq;
+    float largest = 0.0f;
+    while (ramp.next(&freq)) {
+        float step = fabsf(freq - prev);
+        largest = fmaxf(largest, step);
+        EXPECT(step <= fmaxf(profile.maxStepUp, profile.maxStepDown) + 1e-3f, "step %.2f -> %.2f", prev, freq);
+        EXPECT((to > from) ? freq > prev : freq < prev, "step %.2f -> %.2f goes the wrong way", prev, freq);
+
+        // intermediate steps are on the grid and have a table entry
+        float grid = freq / profile.minStep;
+        EXPECT(freq == to || fabsf(grid - roundf(grid)) < 1e-4f, "%.2f MHz not on the grid", freq);
+        pll_setting_t pll;
+        EXPECT(pll_lookup(freq, &pll), "no setting for %.2f MHz", freq);
+
+        uint32_t elapsed = 0;
+        bool confirmed = answer(steps, &elapsed);
+        total += confirmed ? elapsed + profile.dwellMs : profile.settleTimeoutMs;
+        ramp.settled(confirmed, elapsed);
+
+        prev = freq;
+        steps++;
+        if (steps > 10000) {
+            break;
+        }
+    }
+    EXPECT(prev == to, "ramp %.2f -> %.2f ended at %.2f", from, to, prev);
+    if (ms) {
+        *ms = total;
+    }
+    if (maxStep) {
+        *maxStep = largest;
+    }
+    return steps;
+}
+
+static void test_ramp()
+{
+    const asic_ramp_profile_t &p = ASIC_RAMP_DEFAULT;
+    // the fixed ramp the firmware had before
+    const asic_ramp_profile_t fixed = {6.25f, 6.25f, 6.25f, 100, 0, 0};
+
+    auto unconfirmed = [](int, uint32_t *elapsed) {
+        *elapsed = 0;
+        return false;
+    };
+    auto fast = [](int, uint32_t *elapsed) {
+        *elapsed = 10;
+        return true;
+    };
+    auto slow = [&](int, uint32_t *elapsed) {
+        *elapsed = p.fastSettleMs + 1;
+        return true;
+    };
+
+    uint32_t ms;
+    float maxStep;
+
+    int steps = run_ramp(56.25f, 600.0f, fixed, unconfirmed, &ms);
+    EXPECT(steps == 87 && ms == 8700, "fixed ramp: %d steps, %u ms", steps, ms);
+    printf("ramp 56.25 -> 600 MHz fixed: %d steps, %u ms\n", steps, ms);
+
+    // without a confirmation the new ramp is the fixed one
+    steps = run_ramp(56.25f, 600.0f, p, unconfirmed, &ms, &maxStep);
+    EXPECT(steps == 87 && ms == 8700 && maxStep == p.minStep, "unconfirmed: %d steps, %u ms, max step %.2f", steps,
+           ms, maxStep);
+
+    // confirmed but slower than fastSettleMs: no growth either
+    steps = run_ramp(56.25f, 600.0f, p, slow, nullptr, &maxStep);
+    EXPECT(steps == 87 && maxStep == p.minStep, "slow: %d steps, max step %.2f", steps, maxStep);
+
+    steps = run_ramp(56.25f, 600.0f, p, fast, &ms, &maxStep);
+    EXPECT(steps == 23 && maxStep == p.maxStepUp, "fast: %d steps, max step %.2f", steps, maxStep);
+    printf("ramp 56.25 -> 600 MHz, chips lock in 10 ms: %d steps, %u ms\n", steps, ms);
+
+    steps = run_ramp(600.0f, 400.0f, p, fast, nullptr, &maxStep);
+    EXPECT(maxStep == p.maxStepDown, "down: %d steps, max step %.2f", steps, maxStep);
+
+    // 6.25, 12.5, 25, 25, ... with every step confirmed fast
+    FrequencyRamp ramp;
+    ramp.start(500.0f, 600.0f, p);
+    float freq;
+    const float growing[] = {506.25f, 518.75f, 543.75f, 568.75f, 593.75f, 600.0f};
+    for (float expected : growing) {
+        EXPECT(ramp.next(&freq) && freq == expected, "growing: %.2f instead of %.2f", freq, expected);
+        ramp.settled(true, 10);
+    }
+    EXPECT(!ramp.next(&freq), "growing: step after the target");
+
+    // a missing confirmation goes back to the minimum step, then it grows again
+    ramp.start(500.0f, 600.0f, p);
+    const float fallback[] = {506.25f, 518.75f, 543.75f, 550.0f, 562.5f, 587.5f};
+    const bool confirmed[] = {true, true, false, true, true, true};
+    for (int i = 0; i < 6; i++) {
+        EXPECT(ramp.next(&freq) && freq == fallback[i], "fallback: %.2f instead of %.2f", freq, fallback[i]);
+        ramp.settled(confirmed[i], 10);
+        if (!confirmed[i]) {
+            EXPECT(ramp.getStep() == p.minStep, "fallback: step %.2f", ramp.getStep());
+        }
+    }
+
+    // off-grid start aligns to the grid first, the target may be off-grid
+    ramp.start(500.3f, 525.1f, p);
+    EXPECT(ramp.next(&freq) && freq == 506.25f, "off grid: first step %.2f", freq);
+    run_ramp(500.3f, 525.1f, p, fast, nullptr);
+
+    // nothing to do for the current frequency
+    ramp.start(500.0f, 500.0f, p);
+    EXPECT(ramp.next(&freq) && freq == 500.0f && !ramp.next(&freq), "no transition");
+}
+
+int main()
+{
+    test_table();
+    test_board_options();
+    test_ramp();
+
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("pll_test ok\n");
+    return 0;
+}
@@ -0,0 +1,170 @@
+// In-place Stratum V1 parsing of main/stratum/stratum_json.cpp and
+// StratumApi::parse()
+//
+// tokens: nesting, key lookup, primitives, invalid lines and the token
+// limit. strings: escapes are decoded in place (\" \\ \/ \n, \u with
+// surrogate pairs to UTF-8), a second string() returns the same. notify:
+// a job id with escapes reaches the mining_notify decoded, the stale check
+// reads the decoded error message. A hex field that doesn't decode
+// completely (length, non-hex digit) rejects the notify.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
+#include "stratum_api.h"
+#include "stratum_json.h"
+
+static int failures = 0;
+
+#define EXPECT(cond, ...)                                                                                                  \
+    do {                                                                                                                   \
+        if (!(cond)) {                                                                                                     \
+            if (failures++ < 10) {                                                                                         \
+                printf("FAIL %s:%d: ", __FILE__, __LINE__);                                                                \
+                printf(__VA_ARGS__);                                                                                       \
+                printf("\n");                                                                                              \
+            }                                                                                                              \
+        }                                                                                                                  \
+    } while (0)
+
+static const char *NOTIFY_TAIL =
+    "\"4d16b6f85af6e2198f44ae2a6de67f78487ae5611b77c6c0440b921e00000000\","
+    "\"01000000010000000000000000000000000000000000000000000000000000000000000000ffffffff20020862062f503253482f04b8864e5008\","
+    "\"072f736c7573682f000000000100f2052a010000001976a914d23fcdf86f7e756a64a7a9688ef9903327048ed988ac00000000\","
+    "[\"1c3e9a8a1e4b2b3d3f8c0e5a6b7d8e9f0a1b2c3d4e5f60718293a4b5c6d7e8f9\"],"
+    "\"00000002\",\"1c2ac4af\",\"504e86b9\",true]}";
+
+static void test_tokens()
+{
+    StratumJson json;
+    std::string line = "{\"id\": 7, \"result\": [true, -12, null, {\"a\": [1, 2]}], \"error\": null}";
+    EXPECT(json.tokenize(&line[0], line.size()), "tokenize");
+
+    int result = json.find(json.root(), "result");
+    EXPECT(json.size(result) == 4, "result has %d children", json.size(result));
+    EXPECT(json.asInt(json.find(json.root(), "id"), -1) == 7, "id");
+    EXPECT(json.asBool(json.child(result, 0)), "true");
+    EXPECT(json.asInt(json.child(result, 1)) == -12, "-12");
+    EXPECT(json.isNull(json.child(result, 2)) && json.isNull(json.find(json.root(), "error")), "null");
+    EXPECT(json.size(json.find(json.child(result, 3), "a")) == 2, "nested array");
+    EXPECT(json.find(json.root(), "missing") == -1 && json.child(result, 4) == -1, "not found");
+
+    const char *invalid[] = {"", "[1, 2]", "{\"a\": 1", "{\"a\": \"b}", "{\"a\": 1]", "{} {}", "{\"a\": x}"};
+    for (const char *s : invalid) {
+        std::string bad = s;
+        EXPECT(!json.tokenize(&bad[0], bad.size()), "accepted %s", s);
+    }
+
+    std::string big = "{\"a\": [";
+    for (int i = 0; i < STRATUM_JSON_MAX_TOKENS; i++) {
+        big += i ? ",1" : "1";
+    }
+    big += "]}";
+    EXPECT(!json.tokenize(&big[0], big.size()) && json.overflow(), "token limit");
+}
+
+static void test_strings()
+{
+    StratumJson json;
+    std::string line = "{\"s\": [\"plain\", \"a\\\"b\\\\c\\/d\", \"tab\\tnl\\n\", \"\\u00e9\\u20ac\\ud83d\\ude00\", "
+                       "\"\\u12\", \"\\udc00x\"], \"key\\\"q\": 1}";
+    EXPECT(json.tokenize(&line[0], line.size()), "tokenize");
+    int s = json.find(json.root(), "s");
+
+    const char *expected[] = {"plain", "a\"b\\c/d", "tab\tnl\n", "\xc3\xa9\xe2\x82\xac\xf0\x9f\x98\x80", "?12", "?x"};
+    for (int i = 0; i < 6; i++) {
+        const char *str = json.string(json.child(s, i));
+        EXPECT(str && !strcmp(str, expected[i]), "string %d: '%s'", i, str ? str : "(null)");
+        // decoded once, the second call doesn't decode again
+        const char *again = json.string(json.child(s, i));
+        EXPECT(again == str && !strcmp(again, expected[i]), "string %d again: '%s'", i, again ? again : "(null)");
+    }
+
+    // the tokens after a decoded string still point to their values
+    EXPECT(json.string(json.child(s, 0)) && !strcmp(json.string(json.child(s, 0)), "plain"), "first string");
+}
+
+static void test_notify()
+{
+    StratumApi api;
+    StratumApiV1Message msg;
+
+    std::string line = std::string("{\"id\": null, \"method\": \"mining.notify\", \"params\": [\"j\\\"1\\\\2\",") +
+                       NOTIFY_TAIL;
+    EXPECT(api.tokenize(&line[0], line.size()) && api.parse(&msg), "notify");
+    EXPECT(msg.method == MINING_NOTIFY && msg.mining_notification, "method %d", msg.method);
+    if (msg.mining_notification) {
+        mining_notify *n = msg.mining_notification;
+        EXPECT(!strcmp(n->job_id, "j\"1\\2"), "job id '%s'", n->job_id);
+        EXPECT(n->version == 2 && n->target == 0x1c2ac4af && n->ntime == 0x504e86b9 && n->n_merkle_branches == 1,
+               "fields");
+        EXPECT(n->_prev_block_hash[0] == 0x4d && n->_merkle_branches[0][31] == 0xf9, "hashes");
+        EXPECT(strlen(n->coinbase_1) == 116 && !strncmp(n->coinbase_2, "072f", 4), "coinbase");
+        EXPECT(msg.should_abandon_work, "clean jobs");
+    }
+
+    // the stale check reads the decoded message
+    line = "{\"id\": 12, \"result\": null, \"error\": [23, \"\\u0053tale share\", null]}";
+    EXPECT(api.tokenize(&line[0], line.size()) && api.parse(&msg), "response");
+    EXPECT(msg.method == STRATUM_RESULT && !msg.response_success && msg.response_stale, "stale %d %d",
+           msg.response_success, msg.response_stale);
+}
+
+static void test_notify_invalid()
+{
+    StratumApi api;
+    StratumApiV1Message msg;
+
+    // one field broken at a time, each in place of the valid one
+    static const struct
+    {
+        const char *valid;
+        const char *broken;
+    } cases[] = {
+        {"\"4d16b6f8", "\"4d16b6"}, // prev hash too short
+        {"\"4d16b6f8", "\"4d16b6f8ab"}, // too long
+        {"\"4d16b6f8", "\"4d16b6g8"}, // non-hex
+        {"[\"1c3e9a8a", "[\"1c3e9x8a"}, // merkle branch
+        {"[\"1c3e9a8a", "[12, \"1c3e9a8a"}, // branch not a string
+        {"\"00000002\"", "\"0000000002\""}, // version too long
+        {"\"1c2ac4af\"", "\"\""}, // empty nbits
+        {"\"504e86b9\"", "\"504e86z9\""}, // ntime
+        {"\"072f736c", "\"072f73-c"}, // coinbase 2
+        {"\"0100000001", "\"010000001"}, // coinbase 1 odd length
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        std::string tail = NOTIFY_TAIL;
+        size_t pos = tail.find(cases[i].valid);
+        if (pos == std::string::npos) {
+            EXPECT(false, "case %zu: %s not found", i, cases[i].valid);
+            continue;
+        }
+        tail.replace(pos, strlen(cases[i].valid), cases[i].broken);
+        std::string line = "{\"id\": null, \"method\": \"mining.notify\", \"params\": [\"j1\"," + tail;
+        EXPECT(!(api.tokenize(&line[0], line.size()) && api.parse(&msg)), "case %zu (%s) accepted", i,
+               cases[i].broken);
+    }
+
+    std::string line = "{\"id\": null, \"method\": \"mining.set_version_mask\", \"params\": [\"1fffe00g\"]}";
+    EXPECT(!(api.tokenize(&line[0], line.size()) && api.parse(&msg)), "version mask accepted");
+    line = "{\"id\": null, \"method\": \"mining.set_version_mask\", \"params\": [\"1fffe000\"]}";
+    EXPECT(api.tokenize(&line[0], line.size()) && api.parse(&msg) && msg.version_mask == 0x1fffe000, "version mask");
+}
+
+int main()
+{
+    test_tokens();
+    test_strings();
+    test_notify();
+    test_notify_invalid();
+
+    if (failures) {
+        printf("%d failures\n", failures);
+        return 1;
+    }
+    printf("stratum_json_test ok\n");
+    return 0;
+}
@@ -0,0 +1,224 @@
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_transport.h"
+#include "mbedtls/chachapoly.h"
+
+extern "C" {
+#include "sv2_protocol.h"
+}
+
+// The SV2 receive path that components/stratum_v2 had before frames were
+// decrypted in place, for the comparison in noise_bench: every message sets
+// up a ChaCha20-Poly1305 context for its key, each payload is read into a
+// malloc'd ciphertext buffer and decrypted into the caller's buffer, and
+// every NewExtendedMiningJob is copied into a heap job.
+
+typedef struct
+{
+    uint32_t job_id;
+    uint32_t version;
+    bool version_rolling_allowed;
+    uint32_t ntime;
+    bool clean_jobs;
+    uint8_t merkle_path[SV2_MAX_MERKLE_BRANCHES][32];
+    uint8_t merkle_path_count;
+    uint8_t *coinbase_prefix;
+    uint16_t coinbase_prefix_len;
+    uint8_t *coinbase_suffix;
+    uint16_t coinbase_suffix_len;
+} sv2_ext_job_copy_t;
+
+static inline uint16_t ref_read_u16_le(const uint8_t *p)
+{
+    return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static inline uint32_t ref_read_u32_le(const uint8_t *p)
+{
+    return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline int noise_decrypt_copy(const uint8_t key[32], uint64_t nonce_counter, const uint8_t *ciphertext,
+                                     size_t ct_len, uint8_t *out)
+{
+    if (ct_len < 16) {
+        return -1;
+    }
+
+    uint8_t nonce[12] = {0};
+    for (int i = 0; i < 8; i++) {
+        nonce[4 + i] = (uint8_t) (nonce_counter >> (i * 8));
+    }
+
+    size_t pt_len = ct_len - 16;
+    mbedtls_chachapoly_context ctx;
+    mbedtls_chachapoly_init(&ctx);
+    mbedtls_chachapoly_setkey(&ctx, key);
+    int ret = mbedtls_chachapoly_auth_decrypt(&ctx, pt_len, nonce, NULL, 0, ciphertext + pt_len, ciphertext, out);
+    mbedtls_chachapoly_free(&ctx);
+    return ret ? -1 : 0;
+}
+
+static inline int noise_recv_exact_copy(esp_transport_handle_t transport, uint8_t *buf, int len)
+{
+    int received = 0;
+    while (received < len) {
+        int r = esp_transport_read(transport, (char *) buf + received, len - received, 5000);
+        if (r <= 0) {
+            return -1;
+        }
+        received += r;
+    }
+    return 0;
+}
+
+static inline int sv2_noise_recv_copy(const uint8_t key[32], uint64_t *recv_nonce, esp_transport_handle_t transport,
+                                      uint8_t hdr_out[6], uint8_t *payload_out, int max_payload_len,
+                                      int *payload_len_out)
+{
+    *payload_len_out = 0;
+
+    uint8_t enc_hdr[22];
+    if (noise_recv_exact_copy(transport, enc_hdr, 22) != 0 ||
+        noise_decrypt_copy(key, (*recv_nonce)++, enc_hdr, 22, hdr_out) != 0) {
+        return -1;
+    }
+
+    sv2_frame_header_t hdr;
+    sv2_parse_frame_header(hdr_out, &hdr);
+    if (hdr.msg_length == 0) {
+        return 0;
+    }
+    if ((int) hdr.msg_length > max_payload_len) {
+        return -1;
+    }
+
+    int enc_len = hdr.msg_length + 16;
+    uint8_t *enc_payload = (uint8_t *) malloc(enc_len);
+    if (!enc_payload) {
+        return -1;
+    }
+    if (noise_recv_exact_copy(transport, enc_payload, enc_len) != 0 ||
+        noise_decrypt_copy(key, (*recv_nonce)++, enc_payload, enc_len, payload_out) != 0) {
+        free(enc_payload);
+        return -1;
+    }
+    free(enc_payload);
+    *payload_len_out = hdr.msg_length;
+    return 0;
+}
+
+static inline void sv2_ext_job_copy_free(sv2_ext_job_copy_t *job)
+{
+    if (!job) {
+        return;
+    }
+    free(job->coinbase_prefix);
+    free(job->coinbase_suffix);
+    free(job);
+}
+
+static inline sv2_ext_job_copy_t *sv2_parse_new_extended_mining_job_copy(const uint8_t *payload, uint32_t len,
+                                                                         uint32_t *channel_id_out)
+{
+    if (len < 19) {
+        return NULL;
+    }
+
+    uint32_t pos = 0;
+    uint32_t channel_id = ref_read_u32_le(payload + pos);
+    pos += 4;
+    if (channel_id_out) {
+        *channel_id_out = channel_id;
+    }
+    uint32_t job_id = ref_read_u32_le(payload + pos);
+    pos += 4;
+
+    bool has_min_ntime = false;
+    uint32_t min_ntime = 0;
+    if (payload[pos++] == 0x01) {
+        if (pos + 4 > len) {
+            return NULL;
+        }
+        has_min_ntime = true;
+        min_ntime = ref_read_u32_le(payload + pos);
+        pos += 4;
+    }
+
+    if (pos + 4 + 1 > len) {
+        return NULL;
+    }
+    uint32_t version = ref_read_u32_le(payload + pos);
+    pos += 4;
+    bool version_rolling_allowed = payload[pos++] != 0;
+
+    if (pos + 1 > len) {
+        return NULL;
+    }
+    uint8_t merkle_count = payload[pos++];
+    if (merkle_count > SV2_MAX_MERKLE_BRANCHES || pos + (uint32_t) merkle_count * 32 > len) {
+        return NULL;
+    }
+    uint8_t merkle_path[SV2_MAX_MERKLE_BRANCHES][32];
+    for (int i = 0; i < merkle_count; i++) {
+        memcpy(merkle_path[i], payload + pos, 32);
+        pos += 32;
+    }
+
+    if (pos + 2 > len) {
+        return NULL;
+    }
+    uint16_t prefix_len = ref_read_u16_le(payload + pos);
+    pos += 2;
+    if (pos + prefix_len > len) {
+        return NULL;
+    }
+    const uint8_t *prefix_data = payload + pos;
+    pos += prefix_len;
+
+    if (pos + 2 > len) {
+        return NULL;
+    }
+    uint16_t suffix_len = ref_read_u16_le(payload + pos);
+    pos += 2;
+    if (pos + suffix_len > len) {
+        return NULL;
+    }
+    const uint8_t *suffix_data = payload + pos;
+
+    sv2_ext_job_copy_t *job = (sv2_ext_job_copy_t *) calloc(1, sizeof(sv2_ext_job_copy_t));
+    if (!job) {
+        return NULL;
+    }
+    job->job_id = job_id;
+    job->version = version;
+    job->version_rolling_allowed = version_rolling_allowed;
+    job->ntime = has_min_ntime ? min_ntime : 0;
+    job->merkle_path_count = merkle_count;
+    for (int i = 0; i < merkle_count; i++) {
+        memcpy(job->merkle_path[i], merkle_path[i], 32);
+    }
+    if (prefix_len) {
+        job->coinbase_prefix = (uint8_t *) malloc(prefix_len);
+        if (!job->coinbase_prefix) {
+            sv2_ext_job_copy_free(job);
+            return NULL;
+        }
+        memcpy(job->coinbase_prefix, prefix_data, prefix_len);
+    }
+    job->coinbase_prefix_len = prefix_len;
+    if (suffix_len) {
+        job->coinbase_suffix = (uint8_t *) malloc(suffix_len);
+        if (!job->coinbase_suffix) {
+            sv2_ext_job_copy_free(job);
+            return NULL;
+        }
+        memcpy(job->coinbase_suffix, suffix_data, suffix_len);
+    }
+    job->coinbase_suffix_len = suffix_len;
+    job->clean_jobs = has_min_ntime;
+    return job;
+}
@@ -0,0 +1,258 @@
+// Mining pipeline on simulated chips against a mock Stratum V2 pool
+//
+// Like pipeline_sim, with StratumTaskV2 of the firmware: Noise handshake
+// (certificate checked against the authority key of the pool), SetupConnection
+// and a standard or extended channel. After a warm-up it measures for
+// --seconds and reports shares/s, notify-to-work latency, job build time and
+// the share round trip (submit to SubmitShares.Success). Fails if the pool
+// rejected a share, none was accepted, no round trip was measured or the
+// miner had to reconnect.
+//
+// The Noise handshake runs on the shim ChaCha20-Poly1305 on both ends, it is
+// checked against RFC 8439 first.
+//
+//   sv2_pool_sim [--channel standard|extended] [--family BM1366|BM1368|BM1370] [--chips n]
+//                [--seconds s] [--rate nonces/s] [--diff pool difficulty] [--notify ms] [--branches n]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "mbedtls/chachapoly.h"
+
+#include "asic_result_task.h"
+#include "create_jobs_task.h"
+#include "global_state.h"
+#include "nvs_config.h"
+#include "share_submitter.h"
+
+#include "mock_pool_sv2.h"
+#include "sim_board.h"
+#include "sim_chain.h"
+
+typedef struct
+{
+    int64_t us;
+    MockPoolSV2::stats_t pool;
+    SimChain::stats_t chain;
+    create_jobs_stats_t jobs;
+    share_submit_stats_t submits;
+} snapshot_t;
+
+static void take_snapshot(MockPoolSV2 *pool, SimChain *chain, snapshot_t *s)
+{
+    s->us = esp_timer_get_time();
+    pool->getStats(&s->pool);
+    chain->getStats(&s->chain);
+    create_jobs_get_stats(&s->jobs);
+    if (!STRATUM_MANAGER->getSubmitStats(0, &s->submits)) {
+        memset(&s->submits, 0, sizeof(s->submits));
+    }
+}
+
+// RFC 8439 2.8.2, both ends of the loopback use the shim
+static bool check_aead()
+{
+    uint8_t key[32];
+    for (int i = 0; i < 32; i++) {
+        key[i] = (uint8_t) (0x80 + i);
+    }
+    static const uint8_t nonce[12] = {0x07, 0x00, 0x00, 0x00, 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47};
+    static const uint8_t aad[12] = {0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7};
+    static const uint8_t ct_start[8] = {0xd3, 0x1a, 0x8d, 0x34, 0x64, 0x8e, 0x60, 0xdb};
+    static const uint8_t expected_tag[16] = {0x1a, 0xe1, 0x0b, 0x59, 0x4f, 0x09, 0xe2, 0x6a,
+                                             0x7e, 0x90, 0x2e, 0xcb, 0xd0, 0x60, 0x06, 0x91};
+    const char *plain = "Ladies and Gentlemen of the class of '99: If I could offer you only one tip for the future, "
+                        "sunscreen would be it.";
+    size_t len = strlen(plain);
+
+    uint8_t buf[128], tag[16];
+    memcpy(buf, plain, len);
+    mbedtls_chachapoly_context aead;
+    mbedtls_chachapoly_init(&aead);
+    mbedtls_chachapoly_setkey(&aead, key);
+    mbedtls_chachapoly_encrypt_and_tag(&aead, len, nonce, aad, sizeof(aad), buf, buf, tag);
+    bool ok = !memcmp(buf, ct_start, sizeof(ct_start)) && buf[len - 1] == 0x16 && !memcmp(tag, expected_tag, 16);
+
+    ok = ok && !mbedtls_chachapoly_auth_decrypt(&aead, len, nonce, aad, sizeof(aad), tag, buf, buf) &&
+         !memcmp(buf, plain, len);
+    buf[len - 1] ^= 0x01;
+    ok = ok && mbedtls_chachapoly_auth_decrypt(&aead, len, nonce, aad, sizeof(aad), tag, buf, buf) ==
+                   MBEDTLS_ERR_CHACHAPOLY_AUTH_FAILED;
+    mbedtls_chachapoly_free(&aead);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    bool standard = false;
+    SimChain::Family family = SimChain::BM1368;
+    int chips = 4;
+    int seconds = 10;
+    float rate = 200.0f;
+    uint32_t diff = 0;
+    uint32_t notifyMs = 2000;
+    int branches = 12;
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (!value) {
+            fprintf(stderr, "missing value for %s\n", arg);
+            return 2;
+        }
+        if (!strcmp(arg, "--channel")) {
+            if (strcmp(value, "standard") && strcmp(value, "extended")) {
+                fprintf(stderr, "unknown channel type %s\n", value);
+                return 2;
+            }
+            standard = !strcmp(value, "standard");
+        } else if (!strcmp(arg, "--family")) {
+            if (!SimChain::parseFamily(value, &family)) {
+                fprintf(stderr, "unknown chip family %s\n", value);
+                return 2;
+            }
+        } else if (!strcmp(arg, "--chips")) {
+            chips = atoi(value);
+        } else if (!strcmp(arg, "--seconds")) {
+            seconds = atoi(value);
+        } else if (!strcmp(arg, "--rate")) {
+            rate = atof(value);
+        } else if (!strcmp(arg, "--diff")) {
+            diff = strtoul(value, NULL, 10);
+        } else if (!strcmp(arg, "--notify")) {
+            notifyMs = strtoul(value, NULL, 10);
+        } else if (!strcmp(arg, "--branches")) {
+            branches = atoi(value);
+        } else {
+            fprintf(stderr, "unknown option %s\n", arg);
+            return 2;
+        }
+        i++;
+    }
+
+    if (!check_aead()) {
+        fprintf(stderr, "ChaCha20-Poly1305 of the shim doesn't match RFC 8439\n");
+        return 1;
+    }
+
+    SimChain chain(family, chips, rate);
+    sim_serial_attach(&chain);
+    chain.start();
+
+    SimBoard *board = new SimBoard(family, chips);
+
+    // every nonce the chips return is a share unless --diff says otherwise
+    if (!diff) {
+        diff = board->getAsicMinDifficulty();
+    }
+    MockPoolSV2 pool(diff, notifyMs, branches);
+    if (!pool.start()) {
+        fprintf(stderr, "mock pool: can't listen\n");
+        return 1;
+    }
+
+    Config::setStratumURL("127.0.0.1");
+    Config::setStratumPortNumber(pool.getPort());
+    Config::setStratumUser("host.sim");
+    Config::setStratumPass("x");
+    Config::setStratumProtocol(STRATUM_V2);
+    Config::setSV2ChannelType(standard ? 1 : 0);
+    Config::setSV2AuthorityPubkey(pool.getAuthorityKey().c_str());
+
+    board->loadSettings();
+    SYSTEM_MODULE.setBoard(board);
+    board->initBoard();
+    if (!board->initAsics()) {
+        fprintf(stderr, "asic init failed\n");
+        return 1;
+    }
+
+    STRATUM_MANAGER = new StratumManagerFallback();
+    STRATUM_MANAGER->loadSettings();
+
+    xTaskCreate(create_jobs_task, "stratum miner", 8192, NULL, 10, NULL);
+    xTaskCreate(ASIC_result_task, "asic result", 8192, NULL, 15, NULL);
+    xTaskCreate(StratumManager::taskWrapper, "stratum manager", 8192, (void *) STRATUM_MANAGER, 5, NULL);
+
+    // warm-up: handshake, channel, first job on the chips and the first share
+    // accepted, slow on a loaded host
+    snapshot_t start;
+    for (int i = 0; i < 300; i++) {
+        take_snapshot(&pool, &chain, &start);
+        if (start.pool.accepted) {
+            break;
+        }
+        usleep(100 * 1000);
+    }
+    if (!start.pool.accepted) {
+        fprintf(stderr, "no share accepted within 30s (%u handshakes)\n", start.pool.handshakes);
+        // the firmware tasks still use the pool and the chain, no destructors
+        _exit(1);
+    }
+
+    usleep((useconds_t) seconds * 1000000);
+
+    snapshot_t end;
+    take_snapshot(&pool, &chain, &end);
+
+    double window = (end.us - start.us) / 1e6;
+    uint32_t accepted = end.pool.accepted - start.pool.accepted;
+    uint32_t jobs = end.jobs.jobs - start.jobs.jobs;
+    uint32_t acks = end.submits.acks - start.submits.acks;
+
+    // pool block to the first job with its prev block hash on the chips
+    int latencies = 0;
+    int64_t latencySum = 0;
+    int64_t latencyMax = 0;
+    for (const auto &notify : pool.getNotifies()) {
+        if (notify.second < start.us || notify.second > end.us) {
+            continue;
+        }
+        int64_t first = chain.firstJobUs(notify.first.data());
+        if (!first) {
+            continue;
+        }
+        int64_t latency = first - notify.second;
+        latencySum += latency;
+        latencyMax = std::max(latencyMax, latency);
+        latencies++;
+    }
+
+    uint32_t rejected = end.pool.rejectedLowDiff + end.pool.rejectedDuplicate + end.pool.rejectedInvalid;
+
+    // the histogram of the window only
+    share_submit_stats_t window_submits = end.submits;
+    window_submits.acks = acks;
+    for (int i = 0; i < SHARE_LATENCY_BUCKETS; i++) {
+        window_submits.latency[i] -= start.submits.latency[i];
+    }
+
+    printf("%s channel, %s x%d, %.1fs, pool diff %lu, %d merkle branches\n", standard ? "standard" : "extended",
+           SimChain::familyName(family), chips, window, (unsigned long) diff, branches);
+    printf("  shares/s            %.1f (%lu accepted, %lu rejected, %lu stale total)\n", accepted / window,
+           (unsigned long) accepted, (unsigned long) rejected, (unsigned long) end.pool.rejectedStale);
+    printf("  notify-to-work      pool->chip avg %.2fms max %.2fms (%d blocks), firmware max %.2fms\n",
+           latencies ? latencySum / 1e3 / latencies : 0.0, latencyMax / 1e3, latencies, end.jobs.notifyToWorkMaxUs / 1e3);
+    printf("  job build time      avg %.1fus max %luus (%lu jobs)\n",
+           jobs ? (double) (end.jobs.buildTimeUs - start.jobs.buildTimeUs) / jobs : 0.0,
+           (unsigned long) end.jobs.buildTimeMaxUs, (unsigned long) jobs);
+    printf("  share round trip    avg %.2fms max %lums, p50 <%lums p99 <%lums (%lu acks)\n",
+           acks ? (double) (end.submits.latencySumUs - start.submits.latencySumUs) / 1e3 / acks : 0.0,
+           (unsigned long) end.submits.latencyMaxMs, (unsigned long) ShareSubmitter::percentileMs(&window_submits, 0.5f),
+           (unsigned long) ShareSubmitter::percentileMs(&window_submits, 0.99f), (unsigned long) acks);
+    printf("  handshakes          %lu\n", (unsigned long) end.pool.handshakes);
+    fflush(stdout);
+
+    bool ok = accepted > 0 && !rejected && acks > 0 && jobs > 0 && end.pool.handshakes == 1 &&
+              end.chain.crcErrors == 0;
+
+    // the firmware tasks never return
+    _exit(ok ? 0 : 1);
+}